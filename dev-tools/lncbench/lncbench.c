@@ -0,0 +1,1197 @@
+/*
+ * lncbench.c
+ *
+ * End-to-end benchmark of the libnetconf server side RPC processing.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "libnetconf.h"
+
+#ifdef __GNUC__
+#  define UNUSED(x) UNUSED_ ## x __attribute__((__unused__))
+#else
+#  define UNUSED(x) UNUSED_ ## x
+#endif
+
+#define ARGUMENTS "d:hi:m:n:o:ps:t:vz"
+
+#define BENCH_NS "urn:libnetconf:bench"
+#define BENCH_NS_BASE "urn:ietf:params:xml:ns:netconf:base:1.0"
+#define BENCH_NS_NOTIF "urn:ietf:params:xml:ns:netconf:notification:1.0"
+#define BENCH_EOM "]]>]]>"
+
+#define BENCH_ENTRIES 10000
+#define BENCH_ITERATIONS 100
+#define BENCH_SUBSCRIBERS 4
+
+/* synthetic model of a single list with the configurable number of entries */
+static const char* bench_model =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<module name=\"bench\" xmlns=\"urn:ietf:params:xml:ns:yang:yin:1\" xmlns:b=\"" BENCH_NS "\">\n"
+	"  <namespace uri=\"" BENCH_NS "\"/>\n"
+	"  <prefix value=\"b\"/>\n"
+	"  <container name=\"bench\">\n"
+	"    <list name=\"entry\">\n"
+	"      <key value=\"name\"/>\n"
+	"      <leaf name=\"name\"><type name=\"string\"/></leaf>\n"
+	"      <leaf name=\"value\"><type name=\"uint32\"/></leaf>\n"
+	"      <leaf name=\"enabled\"><type name=\"boolean\"/><default value=\"true\"/></leaf>\n"
+	"    </list>\n"
+	"    <container name=\"state\">\n"
+	"      <config value=\"false\"/>\n"
+	"      <leaf name=\"entries\"><type name=\"uint32\"/></leaf>\n"
+	"    </container>\n"
+	"  </container>\n"
+	"</module>\n";
+
+/* RelaxNG schema of the model found by ncds_new() next to the model, it enables <validate> */
+static const char* bench_schema =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<grammar xmlns=\"http://relaxng.org/ns/structure/1.0\" datatypeLibrary=\"http://www.w3.org/2001/XMLSchema-datatypes\">\n"
+	"  <start>\n"
+	"    <element name=\"config\" ns=\"" BENCH_NS_BASE "\">\n"
+	"      <optional>\n"
+	"        <element name=\"bench\" ns=\"" BENCH_NS "\">\n"
+	"          <zeroOrMore>\n"
+	"            <element name=\"entry\">\n"
+	"              <interleave>\n"
+	"                <element name=\"name\"><data type=\"string\"/></element>\n"
+	"                <optional><element name=\"value\"><data type=\"unsignedInt\"/></element></optional>\n"
+	"                <optional><element name=\"enabled\"><data type=\"boolean\"/></element></optional>\n"
+	"              </interleave>\n"
+	"            </element>\n"
+	"          </zeroOrMore>\n"
+	"        </element>\n"
+	"      </optional>\n"
+	"    </element>\n"
+	"  </start>\n"
+	"</grammar>\n";
+
+/**
+ * @brief Client side of a NETCONF session connected to the in-process server.
+ */
+struct bench_conn {
+	int fd;                      /**< client end of the socketpair */
+	int srv_fd;                  /**< server end of the socketpair */
+	struct nc_session* session;  /**< server session accepted on srv_fd */
+	pthread_t thread;            /**< server thread processing the session */
+	int subscriber;              /**< server thread ends in ncntf_dispatch_send() */
+	unsigned int msgid;          /**< last used message-id */
+	char* buf;                   /**< received, not yet decoded data */
+	size_t start, len, size;
+	char* msg;                   /**< last decoded message */
+	size_t msg_len, msg_size;
+	size_t chunk_left;           /**< remaining length of the current chunk */
+	uint64_t rx_bytes;           /**< received data of the messages, as framed on the wire */
+	unsigned int rx_compressed;  /**< number of the received compressed messages */
+};
+
+struct bench_ctx {
+	const char* dstype;
+	unsigned int entries;
+	unsigned int iterations;
+	unsigned int subscribers;
+	unsigned int seed;
+	struct bench_conn* conn;
+	struct bench_conn** subs;
+	FILE* out;
+	int trace;                   /**< report the latency breakdown of the RPCs */
+	int deflate;                 /**< negotiate the compact encoding of the messages */
+	uint64_t rx_bytes;           /**< received data of the timed steps */
+	unsigned int rx_compressed;  /**< compressed messages received in the timed steps */
+};
+
+/**
+ * @brief Description of a single benchmark. The prepare and finish steps
+ * run around every timed run step and are not included in the results.
+ */
+struct bench_test {
+	const char* name;
+	int (*setup)(struct bench_ctx* ctx);
+	int (*prepare)(struct bench_ctx* ctx, unsigned int i);
+	int (*run)(struct bench_ctx* ctx, unsigned int i);
+	int (*finish)(struct bench_ctx* ctx, unsigned int i);
+	void (*cleanup)(struct bench_ctx* ctx);
+};
+
+static volatile unsigned int state_entries = 0;
+
+/* announce the compact encoding in the client's hello */
+static int hello_deflate = 0;
+
+/* names of NC_TRACE_PHASE in the results */
+static const char* trace_phases[NC_TRACE_PHASES] = {"receive", "parse", "nacm", "edit", "validate", "transapi", "sync", "reply"};
+
+/* sum of the RPC traces received during the timed steps */
+static struct {
+	pthread_mutex_t lock;
+	int active;
+	unsigned int rpcs;
+	uint64_t phases[NC_TRACE_PHASES];
+} trace_sum = {PTHREAD_MUTEX_INITIALIZER, 0, 0, {0}};
+
+static void clb_rpc_trace(const struct nc_rpc_trace* trace)
+{
+	int i;
+
+	pthread_mutex_lock(&trace_sum.lock);
+	if (trace_sum.active) {
+		trace_sum.rpcs++;
+		for (i = 0; i < NC_TRACE_PHASES; i++) {
+			trace_sum.phases[i] += trace->phases[i];
+		}
+	}
+	pthread_mutex_unlock(&trace_sum.lock);
+}
+
+static void trace_activate(int active)
+{
+	pthread_mutex_lock(&trace_sum.lock);
+	trace_sum.active = active;
+	pthread_mutex_unlock(&trace_sum.lock);
+}
+
+void clb_print(NC_VERB_LEVEL level, const char* msg)
+{
+	switch (level) {
+	case NC_VERB_ERROR:
+		fprintf(stderr, "libnetconf ERROR: %s\n", msg);
+		break;
+	case NC_VERB_WARNING:
+		fprintf(stderr, "libnetconf WARNING: %s\n", msg);
+		break;
+	case NC_VERB_VERBOSE:
+		fprintf(stderr, "libnetconf VERBOSE: %s\n", msg);
+		break;
+	case NC_VERB_DEBUG:
+		fprintf(stderr, "libnetconf DEBUG: %s\n", msg);
+		break;
+	}
+}
+
+static char* get_state(const char* UNUSED(model), const char* UNUSED(running), struct nc_err** UNUSED(err))
+{
+	char* state = NULL;
+
+	if (asprintf(&state, "<bench xmlns=\"%s\"><state><entries>%u</entries></state></bench>", BENCH_NS, state_entries) == -1) {
+		return (NULL);
+	}
+	return (state);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static int write_all(int fd, const char* data, size_t len)
+{
+	ssize_t w;
+
+	while (len > 0) {
+		if ((w = write(fd, data, len)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return (EXIT_FAILURE);
+		}
+		data += w;
+		len -= w;
+	}
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Read more data from the server into the connection buffer.
+ */
+static int conn_fill(struct bench_conn* conn)
+{
+	ssize_t r;
+	char* aux;
+
+	if (conn->start == conn->len) {
+		conn->start = conn->len = 0;
+	} else if (conn->start > conn->size / 2) {
+		memmove(conn->buf, conn->buf + conn->start, conn->len - conn->start);
+		conn->len -= conn->start;
+		conn->start = 0;
+	}
+	if (conn->size - conn->len < 4096) {
+		if ((aux = realloc(conn->buf, conn->size * 2 + 4096)) == NULL) {
+			return (EXIT_FAILURE);
+		}
+		conn->buf = aux;
+		conn->size = conn->size * 2 + 4096;
+	}
+
+	do {
+		r = read(conn->fd, conn->buf + conn->len, conn->size - conn->len);
+	} while (r == -1 && errno == EINTR);
+	if (r <= 0) {
+		return (EXIT_FAILURE);
+	}
+	conn->len += r;
+	return (EXIT_SUCCESS);
+}
+
+static int msg_append(struct bench_conn* conn, const char* data, size_t len)
+{
+	char* aux;
+	size_t size;
+
+	if (conn->msg_len + len + 1 > conn->msg_size) {
+		size = (conn->msg_len + len + 1) * 2;
+		if ((aux = realloc(conn->msg, size)) == NULL) {
+			return (EXIT_FAILURE);
+		}
+		conn->msg = aux;
+		conn->msg_size = size;
+	}
+	memcpy(conn->msg + conn->msg_len, data, len);
+	conn->msg_len += len;
+	conn->msg[conn->msg_len] = '\0';
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Decode the chunked framing (RFC 6242) of the received data.
+ * @return 1 if the message is complete, 0 if more data are needed, -1 on error.
+ */
+static int conn_decode(struct bench_conn* conn)
+{
+	size_t avail, n;
+	char* end;
+
+	while (conn->start < conn->len) {
+		avail = conn->len - conn->start;
+		if (conn->chunk_left > 0) {
+			n = (conn->chunk_left < avail) ? conn->chunk_left : avail;
+			if (msg_append(conn, conn->buf + conn->start, n) != EXIT_SUCCESS) {
+				return (-1);
+			}
+			conn->start += n;
+			conn->chunk_left -= n;
+			conn->rx_bytes += n;
+			continue;
+		}
+
+		if (avail < 4) {
+			return (0);
+		}
+		if (conn->buf[conn->start] != '\n' || conn->buf[conn->start + 1] != '#') {
+			return (-1);
+		}
+		if (conn->buf[conn->start + 2] == '#') {
+			if (conn->buf[conn->start + 3] != '\n') {
+				return (-1);
+			}
+			conn->start += 4;
+			return (1);
+		}
+		if ((end = memchr(conn->buf + conn->start + 2, '\n', avail - 2)) == NULL) {
+			return ((avail > 16) ? -1 : 0);
+		}
+		conn->chunk_left = strtoul(conn->buf + conn->start + 2, NULL, 10);
+		if (conn->chunk_left == 0) {
+			return (-1);
+		}
+		conn->start = (end - conn->buf) + 1;
+	}
+	return (0);
+}
+
+/**
+ * @brief Replace the received compressed message by its decompressed content.
+ */
+static int msg_inflate(struct bench_conn* conn)
+{
+	z_stream zs;
+	char* out = NULL, *aux;
+	size_t len = 0, size = 0;
+	int r;
+
+	memset(&zs, 0, sizeof(zs));
+	if (inflateInit(&zs) != Z_OK) {
+		return (EXIT_FAILURE);
+	}
+	zs.next_in = (Bytef*) conn->msg;
+	zs.avail_in = conn->msg_len;
+	do {
+		if (size - len < 4096) {
+			if ((aux = realloc(out, size * 2 + 4096)) == NULL) {
+				r = Z_MEM_ERROR;
+				break;
+			}
+			out = aux;
+			size = size * 2 + 4096;
+		}
+		zs.next_out = (Bytef*) out + len;
+		zs.avail_out = size - len - 1;
+		r = inflate(&zs, Z_NO_FLUSH);
+		len = size - 1 - zs.avail_out;
+	} while (r == Z_OK);
+	inflateEnd(&zs);
+	if (r != Z_STREAM_END) {
+		free(out);
+		return (EXIT_FAILURE);
+	}
+
+	out[len] = '\0';
+	free(conn->msg);
+	conn->msg = out;
+	conn->msg_len = len;
+	conn->msg_size = size;
+	conn->rx_compressed++;
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Receive the next message, it is available in conn->msg.
+ */
+static int conn_recv(struct bench_conn* conn)
+{
+	int r;
+
+	conn->msg_len = 0;
+	msg_append(conn, "", 0);
+	while ((r = conn_decode(conn)) == 0) {
+		if (conn_fill(conn) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+	}
+	if (r != 1) {
+		return (EXIT_FAILURE);
+	}
+	/* compressed message starts with the zlib header */
+	if (conn->msg_len > 0 && (unsigned char) conn->msg[0] == 0x78) {
+		return (msg_inflate(conn));
+	}
+	return (EXIT_SUCCESS);
+}
+
+static int conn_send(struct bench_conn* conn, const char* content)
+{
+	char* msg = NULL, header[32];
+	int len, ret;
+
+	len = asprintf(&msg, "<rpc message-id=\"%u\" xmlns=\"%s\">%s</rpc>", ++conn->msgid, BENCH_NS_BASE, content);
+	if (len == -1) {
+		return (EXIT_FAILURE);
+	}
+	snprintf(header, sizeof(header), "\n#%d\n", len);
+	ret = write_all(conn->fd, header, strlen(header));
+	if (ret == EXIT_SUCCESS) {
+		ret = write_all(conn->fd, msg, len);
+	}
+	if (ret == EXIT_SUCCESS) {
+		ret = write_all(conn->fd, "\n##\n", 4);
+	}
+	free(msg);
+	return (ret);
+}
+
+/**
+ * @brief Send the RPC and wait for its reply.
+ * @return 0 on success, 1 if rpc-error was received, -1 on failure.
+ */
+static int conn_rpc(struct bench_conn* conn, const char* content)
+{
+	size_t head;
+
+	if (conn_send(conn, content) != EXIT_SUCCESS || conn_recv(conn) != EXIT_SUCCESS) {
+		return (-1);
+	}
+	/* rpc-error follows right after the rpc-reply start tag */
+	head = (conn->msg_len < 1024) ? conn->msg_len : 1024;
+	if (memmem(conn->msg, head, "<rpc-error", 10) != NULL) {
+		return (1);
+	}
+	return (0);
+}
+
+static int conn_rpcf(struct bench_conn* conn, const char* format, ...)
+{
+	va_list ap;
+	char* content = NULL;
+	int ret;
+
+	va_start(ap, format);
+	ret = vasprintf(&content, format, ap);
+	va_end(ap);
+	if (ret == -1) {
+		return (-1);
+	}
+	ret = conn_rpc(conn, content);
+	free(content);
+	return (ret);
+}
+
+static void* server_thread(void* arg)
+{
+	struct bench_conn* conn = (struct bench_conn*) arg;
+	struct nc_session* session;
+	nc_rpc* rpc = NULL;
+	nc_reply* reply;
+	NC_MSG_TYPE msgtype;
+	int done = 0, subscribe;
+
+	if ((session = nc_session_accept_inout(NULL, NULL, conn->srv_fd, conn->srv_fd)) == NULL) {
+		fprintf(stderr, "Accepting the NETCONF session failed.\n");
+		/* let the client know */
+		shutdown(conn->srv_fd, SHUT_RDWR);
+		return (NULL);
+	}
+	conn->session = session;
+
+	while (!done && nc_session_get_status(session) == NC_SESSION_STATUS_WORKING) {
+		msgtype = nc_session_recv_rpc(session, -1, &rpc);
+		if (msgtype != NC_MSG_RPC) {
+			continue;
+		}
+
+		subscribe = 0;
+		switch (nc_rpc_get_op(rpc)) {
+		case NC_OP_CLOSESESSION:
+			reply = nc_reply_ok();
+			done = 1;
+			break;
+#ifndef DISABLE_NOTIFICATIONS
+		case NC_OP_CREATESUBSCRIPTION:
+			reply = ncntf_subscription_check(rpc);
+			subscribe = (nc_reply_get_type(reply) == NC_REPLY_OK);
+			break;
+#endif
+		default:
+			reply = ncds_apply_rpc2all(session, rpc, NULL);
+			if (reply == NULL || reply == NCDS_RPC_NOT_APPLICABLE) {
+				reply = nc_reply_error(nc_err_new(NC_ERR_OP_NOT_SUPPORTED));
+			}
+			break;
+		}
+		nc_session_send_reply(session, rpc, reply);
+		nc_reply_free(reply);
+
+#ifndef DISABLE_NOTIFICATIONS
+		if (subscribe) {
+			/* the session is freed by the main thread which stops the dispatching */
+			ncntf_dispatch_send(session, rpc);
+			nc_rpc_free(rpc);
+			return (NULL);
+		}
+#endif
+		nc_rpc_free(rpc);
+	}
+
+	nc_session_free(session);
+	conn->session = NULL;
+	return (NULL);
+}
+
+static struct bench_conn* conn_open(int subscriber)
+{
+	struct bench_conn* conn;
+	int fds[2];
+	char* eom;
+	const char* hello;
+#define BENCH_HELLO(CAPS) "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" \
+		"<hello xmlns=\"" BENCH_NS_BASE "\"><capabilities>" \
+		"<capability>urn:ietf:params:netconf:base:1.1</capability>" \
+		"<capability>urn:ietf:params:netconf:capability:candidate:1.0</capability>" \
+		"<capability>urn:ietf:params:netconf:capability:validate:1.1</capability>" \
+		"<capability>urn:ietf:params:netconf:capability:notification:1.0</capability>" \
+		CAPS "</capabilities></hello>" BENCH_EOM
+
+	hello = hello_deflate ?
+			BENCH_HELLO("<capability>urn:cesnet:params:netconf:capability:deflate:1.0</capability>") :
+			BENCH_HELLO("");
+
+	if ((conn = calloc(1, sizeof(struct bench_conn))) == NULL) {
+		return (NULL);
+	}
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+		fprintf(stderr, "socketpair() failed (%s).\n", strerror(errno));
+		free(conn);
+		return (NULL);
+	}
+	conn->fd = fds[0];
+	conn->srv_fd = fds[1];
+	conn->subscriber = subscriber;
+
+	if (pthread_create(&conn->thread, NULL, server_thread, conn) != 0) {
+		close(fds[0]);
+		close(fds[1]);
+		free(conn);
+		return (NULL);
+	}
+
+	/* hello messages are always delimited by the end-of-message sequence */
+	if (write_all(conn->fd, hello, strlen(hello)) != EXIT_SUCCESS) {
+		goto error;
+	}
+	while ((eom = (conn->len > 0) ? memmem(conn->buf, conn->len, BENCH_EOM, strlen(BENCH_EOM)) : NULL) == NULL) {
+		if (conn_fill(conn) != EXIT_SUCCESS) {
+			fprintf(stderr, "Receiving the server's hello failed.\n");
+			goto error;
+		}
+	}
+	if (memmem(conn->buf, eom - conn->buf, "urn:ietf:params:netconf:base:1.1", 32) == NULL) {
+		fprintf(stderr, "The server does not support the chunked framing.\n");
+		goto error;
+	}
+	conn->start = (eom - conn->buf) + strlen(BENCH_EOM);
+	return (conn);
+
+error:
+	shutdown(conn->fd, SHUT_RDWR);
+	pthread_join(conn->thread, NULL);
+	close(conn->fd);
+	close(conn->srv_fd);
+	free(conn->buf);
+	free(conn);
+	return (NULL);
+}
+
+static void conn_close(struct bench_conn* conn)
+{
+	if (conn == NULL) {
+		return;
+	}
+
+	if (conn->subscriber) {
+		if (conn->session != NULL) {
+			nc_session_free(conn->session);
+		}
+		shutdown(conn->fd, SHUT_RDWR);
+	} else if (conn_rpc(conn, "<close-session/>") != 0) {
+		shutdown(conn->fd, SHUT_RDWR);
+	}
+	pthread_join(conn->thread, NULL);
+
+	close(conn->fd);
+	close(conn->srv_fd);
+	free(conn->buf);
+	free(conn->msg);
+	free(conn);
+}
+
+static unsigned int bench_random(struct bench_ctx* ctx)
+{
+	return ((unsigned int)rand_r(&ctx->seed) % ctx->entries);
+}
+
+static int bench_populate(struct bench_ctx* ctx)
+{
+	FILE* config;
+	char* content = NULL;
+	size_t len;
+	unsigned int i;
+	int ret;
+
+	if ((config = open_memstream(&content, &len)) == NULL) {
+		return (-1);
+	}
+	fprintf(config, "<copy-config><target><running/></target><source><config><bench xmlns=\"%s\">", BENCH_NS);
+	for (i = 0; i < ctx->entries; i++) {
+		fprintf(config, "<entry><name>e%07u</name><value>%u</value></entry>", i, i);
+	}
+	fprintf(config, "</bench></config></source></copy-config>");
+	fclose(config);
+
+	ret = conn_rpc(ctx->conn, content);
+	free(content);
+	state_entries = ctx->entries;
+	return (ret);
+}
+
+static int run_get(struct bench_ctx* ctx, unsigned int UNUSED(i))
+{
+	return (conn_rpc(ctx->conn, "<get/>"));
+}
+
+static int run_getconfig(struct bench_ctx* ctx, unsigned int UNUSED(i))
+{
+	return (conn_rpc(ctx->conn, "<get-config><source><running/></source></get-config>"));
+}
+
+static int run_getconfig_filter(struct bench_ctx* ctx, unsigned int UNUSED(i))
+{
+	return (conn_rpcf(ctx->conn, "<get-config><source><running/></source><filter type=\"subtree\">"
+			"<bench xmlns=\"%s\"><entry><name>e%07u</name></entry></bench></filter></get-config>",
+			BENCH_NS, bench_random(ctx)));
+}
+
+static int edit(struct bench_ctx* ctx, const char* target, const char* operation, unsigned int entry, unsigned int value)
+{
+	if (operation == NULL) {
+		return (conn_rpcf(ctx->conn, "<edit-config><target><%s/></target><config><bench xmlns=\"%s\">"
+				"<entry><name>e%07u</name><value>%u</value></entry></bench></config></edit-config>",
+				target, BENCH_NS, entry, value));
+	}
+	return (conn_rpcf(ctx->conn, "<edit-config><target><%s/></target><config><bench xmlns=\"%s\">"
+			"<entry xmlns:nc=\"%s\" nc:operation=\"%s\"><name>e%07u</name><value>%u</value>"
+			"<enabled>%s</enabled></entry></bench></config></edit-config>",
+			target, BENCH_NS, BENCH_NS_BASE, operation, entry, value, (value % 2) ? "false" : "true"));
+}
+
+static int run_edit_merge(struct bench_ctx* ctx, unsigned int i)
+{
+	return (edit(ctx, "running", NULL, bench_random(ctx), ctx->entries + i));
+}
+
+static int run_edit_replace(struct bench_ctx* ctx, unsigned int i)
+{
+	return (edit(ctx, "running", "replace", bench_random(ctx), ctx->entries + i));
+}
+
+static unsigned int deleted_entry;
+
+static int run_edit_delete(struct bench_ctx* ctx, unsigned int UNUSED(i))
+{
+	deleted_entry = bench_random(ctx);
+	return (conn_rpcf(ctx->conn, "<edit-config><target><running/></target><config><bench xmlns=\"%s\">"
+			"<entry xmlns:nc=\"%s\" nc:operation=\"delete\"><name>e%07u</name></entry></bench></config></edit-config>",
+			BENCH_NS, BENCH_NS_BASE, deleted_entry));
+}
+
+static int finish_edit_delete(struct bench_ctx* ctx, unsigned int UNUSED(i))
+{
+	/* put the entry back to keep the size of the datastore */
+	return (edit(ctx, "running", NULL, deleted_entry, deleted_entry));
+}
+
+static int setup_candidate(struct bench_ctx* ctx)
+{
+	return (conn_rpc(ctx->conn, "<discard-changes/>"));
+}
+
+/* also makes the validated content differ from the previously validated one */
+static int prepare_commit(struct bench_ctx* ctx, unsigned int i)
+{
+	return (edit(ctx, "candidate", NULL, bench_random(ctx), ctx->entries + i));
+}
+
+static int run_commit(struct bench_ctx* ctx, unsigned int UNUSED(i))
+{
+	return (conn_rpc(ctx->conn, "<commit/>"));
+}
+
+static int run_validate(struct bench_ctx* ctx, unsigned int UNUSED(i))
+{
+	return (conn_rpc(ctx->conn, "<validate><source><candidate/></source></validate>"));
+}
+
+#ifndef DISABLE_NOTIFICATIONS
+
+static void cleanup_notification(struct bench_ctx* ctx);
+
+static int setup_notification(struct bench_ctx* ctx)
+{
+	unsigned int i, tries;
+	struct pollfd pfd;
+	static const char* probe = "<bench-event xmlns=\"" BENCH_NS "\"><seq>probe</seq></bench-event>";
+
+	if ((ctx->subs = calloc(ctx->subscribers, sizeof(struct bench_conn*))) == NULL) {
+		return (-1);
+	}
+	for (i = 0; i < ctx->subscribers; i++) {
+		if ((ctx->subs[i] = conn_open(1)) == NULL ||
+				conn_rpc(ctx->subs[i], "<create-subscription xmlns=\"" BENCH_NS_NOTIF "\"/>") != 0) {
+			cleanup_notification(ctx);
+			return (-1);
+		}
+	}
+
+	/*
+	 * the dispatching starts after the reply is sent and the events generated
+	 * before are not delivered, so probe every subscriber until it is ready
+	 */
+	for (i = 0; i < ctx->subscribers; i++) {
+		pfd.fd = ctx->subs[i]->fd;
+		pfd.events = POLLIN;
+		for (tries = 0; tries < 100; tries++) {
+			ncntf_event_new(-1, NCNTF_GENERIC, probe);
+			if (poll(&pfd, 1, 100) > 0) {
+				break;
+			}
+		}
+		if (tries == 100 || conn_recv(ctx->subs[i]) != EXIT_SUCCESS) {
+			cleanup_notification(ctx);
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+static int run_notification(struct bench_ctx* ctx, unsigned int i)
+{
+	char* event = NULL, seq[32];
+	unsigned int j;
+	struct bench_conn* sub;
+
+	if (asprintf(&event, "<bench-event xmlns=\"%s\"><seq>%u</seq></bench-event>", BENCH_NS, i) == -1) {
+		return (-1);
+	}
+	if (ncntf_event_new(-1, NCNTF_GENERIC, event) != EXIT_SUCCESS) {
+		free(event);
+		return (1);
+	}
+	free(event);
+
+	/* wait until all the subscribers get the event */
+	snprintf(seq, sizeof(seq), "<seq>%u</seq>", i);
+	for (j = 0; j < ctx->subscribers; j++) {
+		sub = ctx->subs[j];
+		do {
+			if (conn_recv(sub) != EXIT_SUCCESS) {
+				return (-1);
+			}
+		} while (strstr(sub->msg, seq) == NULL);
+	}
+	return (0);
+}
+
+static void cleanup_notification(struct bench_ctx* ctx)
+{
+	unsigned int i;
+
+	if (ctx->subs == NULL) {
+		return;
+	}
+	for (i = 0; i < ctx->subscribers; i++) {
+		conn_close(ctx->subs[i]);
+	}
+	free(ctx->subs);
+	ctx->subs = NULL;
+}
+
+#endif /* not DISABLE_NOTIFICATIONS */
+
+static struct bench_test tests[] = {
+	{"get", NULL, NULL, run_get, NULL, NULL},
+	{"get-config", NULL, NULL, run_getconfig, NULL, NULL},
+	{"get-config-filter", NULL, NULL, run_getconfig_filter, NULL, NULL},
+	{"edit-config-merge", NULL, NULL, run_edit_merge, NULL, NULL},
+	{"edit-config-replace", NULL, NULL, run_edit_replace, NULL, NULL},
+	{"edit-config-delete", NULL, NULL, run_edit_delete, finish_edit_delete, NULL},
+	{"commit", setup_candidate, prepare_commit, run_commit, NULL, NULL},
+	{"validate", setup_candidate, prepare_commit, run_validate, NULL, NULL},
+#ifndef DISABLE_NOTIFICATIONS
+	{"notification", setup_notification, NULL, run_notification, NULL, cleanup_notification},
+#endif
+	{NULL, NULL, NULL, NULL, NULL, NULL}
+};
+
+static int cmp_u64(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+
+	return ((x > y) - (x < y));
+}
+
+static double percentile_us(uint64_t* lat, unsigned int count, unsigned int p)
+{
+	unsigned int idx;
+
+	if (count == 0) {
+		return (0);
+	}
+	/* nearest-rank method */
+	idx = (count * p + 99) / 100;
+	return (lat[(idx > 0) ? idx - 1 : 0] / 1000.0);
+}
+
+static void report(struct bench_ctx* ctx, const char* name, uint64_t* lat, unsigned int ops, unsigned int errors)
+{
+	uint64_t total = 0;
+	unsigned int i;
+
+	for (i = 0; i < ops; i++) {
+		total += lat[i];
+	}
+	qsort(lat, ops, sizeof(uint64_t), cmp_u64);
+
+	fprintf(ctx->out, "{\"bench\":\"%s\",\"datastore\":\"%s\",\"entries\":%u,\"ops\":%u,\"errors\":%u,"
+			"\"ops_per_sec\":%.1f,\"mean_us\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f",
+			name, ctx->dstype, ctx->entries, ops, errors,
+			(total > 0) ? ops * 1e9 / total : 0.0,
+			(ops > 0) ? total / 1000.0 / ops : 0.0,
+			percentile_us(lat, ops, 50), percentile_us(lat, ops, 99),
+			(ops > 0) ? lat[ops - 1] / 1000.0 : 0.0);
+	if (ctx->deflate) {
+		/* mean size of the received data per operation */
+		fprintf(ctx->out, ",\"compressed\":%u,\"rx_bytes\":%.1f", ctx->rx_compressed,
+				(ops > 0) ? (double) ctx->rx_bytes / ops : 0.0);
+	}
+	if (ctx->trace && trace_sum.rpcs > 0) {
+		/* mean time of the phases per traced RPC */
+		fprintf(ctx->out, ",\"rpcs\":%u,\"phases_us\":{", trace_sum.rpcs);
+		for (i = 0; i < NC_TRACE_PHASES; i++) {
+			fprintf(ctx->out, "%s\"%s\":%.1f", (i > 0) ? "," : "", trace_phases[i],
+					(trace_sum.rpcs > 0) ? trace_sum.phases[i] / 1000.0 / trace_sum.rpcs : 0.0);
+		}
+		fprintf(ctx->out, "}");
+	}
+	fprintf(ctx->out, "}\n");
+	fflush(ctx->out);
+}
+
+static int bench_run(struct bench_ctx* ctx, struct bench_test* test, uint64_t* lat)
+{
+	unsigned int i, errors = 0, rx_compressed;
+	uint64_t start, rx_bytes;
+	int r;
+
+	if (test->setup != NULL && test->setup(ctx) != 0) {
+		fprintf(stderr, "Setting up the %s benchmark failed.\n", test->name);
+		return (EXIT_FAILURE);
+	}
+
+	memset(trace_sum.phases, 0, sizeof(trace_sum.phases));
+	trace_sum.rpcs = 0;
+	ctx->rx_bytes = 0;
+	ctx->rx_compressed = 0;
+	for (i = 0; i < ctx->iterations; i++) {
+		if (test->prepare != NULL && test->prepare(ctx, i) == -1) {
+			break;
+		}
+		trace_activate(ctx->trace);
+		rx_bytes = ctx->conn->rx_bytes;
+		rx_compressed = ctx->conn->rx_compressed;
+		start = now_ns();
+		r = test->run(ctx, i);
+		lat[i] = now_ns() - start;
+		ctx->rx_bytes += ctx->conn->rx_bytes - rx_bytes;
+		ctx->rx_compressed += ctx->conn->rx_compressed - rx_compressed;
+		trace_activate(0);
+		if (r == -1) {
+			break;
+		} else if (r != 0) {
+			errors++;
+		}
+		if (test->finish != NULL && test->finish(ctx, i) == -1) {
+			i++;
+			break;
+		}
+	}
+
+	if (test->cleanup != NULL) {
+		test->cleanup(ctx);
+	}
+
+	report(ctx, test->name, lat, i, errors);
+	if (i < ctx->iterations) {
+		fprintf(stderr, "The %s benchmark was interrupted by a communication failure.\n", test->name);
+		return (EXIT_FAILURE);
+	}
+	return (EXIT_SUCCESS);
+}
+
+static int write_file(const char* path, const char* content)
+{
+	FILE* f;
+
+	if ((f = fopen(path, "w")) == NULL) {
+		fprintf(stderr, "Creating \"%s\" failed (%s).\n", path, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	fputs(content, f);
+	fclose(f);
+	return (EXIT_SUCCESS);
+}
+
+static int remove_item(const char* path, const struct stat* UNUSED(sb), int UNUSED(flag), struct FTW* UNUSED(ftw))
+{
+	return (remove(path));
+}
+
+void usage(char* progname)
+{
+	int i;
+
+	printf("Benchmark the libnetconf server side RPC processing.\n\n");
+	printf("Usage: %s [-hpvz] [-d file|kv] [-m <metrics>] [-n <entries>] [-i <iterations>] [-s <subscribers>] [-t <tests>] [-o <output>]\n", progname);
+	printf("-d file|kv        Datastore implementation, file is default\n");
+	printf("-h                Show this help\n");
+	printf("-i <iterations>   Number of operations of each benchmark, %d is default\n", BENCH_ITERATIONS);
+	printf("-m <metrics>      Write the libnetconf metrics collected during the run to the file\n");
+	printf("-n <entries>      Number of list entries in the datastore, %d is default\n", BENCH_ENTRIES);
+	printf("-o <output>       Append results to the file instead of printing them to stdout\n");
+	printf("-p                Report also the mean time of the RPC processing phases\n");
+	printf("-s <subscribers>  Number of subscribers of the notification benchmark, %d is default\n", BENCH_SUBSCRIBERS);
+	printf("-t <tests>        Comma-separated list of benchmarks to run, all are run by default\n");
+	printf("-v                Verbose mode\n");
+	printf("-z                Negotiate the compact (deflate) encoding of the messages\n\n");
+	printf("Available benchmarks:");
+	for (i = 0; tests[i].name != NULL; i++) {
+		printf(" %s", tests[i].name);
+	}
+	printf("\n\nResults are printed as one JSON object per line.\n\n");
+}
+
+static int selected(const char* list, const char* name)
+{
+	const char* p;
+	size_t len = strlen(name);
+
+	if (list == NULL) {
+		return (1);
+	}
+	for (p = list; (p = strstr(p, name)) != NULL; p += len) {
+		if ((p == list || p[-1] == ',') && (p[len] == '\0' || p[len] == ',')) {
+			return (1);
+		}
+	}
+	return (0);
+}
+
+int main(int argc, char* argv[])
+{
+	int ret = EXIT_SUCCESS, c, i, flags;
+	NC_VERB_LEVEL verbose = NC_VERB_ERROR;
+	struct bench_ctx ctx;
+	struct ncds_ds* ds;
+	NCDS_TYPE dstype = NCDS_TYPE_FILE;
+	char dir[] = "/tmp/lncbench-XXXXXX";
+	char path[PATH_MAX], *list = NULL, *output = NULL, *metrics = NULL;
+	uint64_t *lat = NULL, start;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.dstype = "file";
+	ctx.entries = BENCH_ENTRIES;
+	ctx.iterations = BENCH_ITERATIONS;
+	ctx.subscribers = BENCH_SUBSCRIBERS;
+	ctx.seed = 1;
+
+	while ((c = getopt(argc, argv, ARGUMENTS)) != -1) {
+		switch (c) {
+		case 'd': /* datastore type */
+			if (strcmp(optarg, "file") == 0) {
+				dstype = NCDS_TYPE_FILE;
+			} else if (strcmp(optarg, "kv") == 0) {
+				dstype = NCDS_TYPE_KV;
+			} else {
+				fprintf(stderr, "Unknown datastore type \"%s\".\n", optarg);
+				return (EXIT_FAILURE);
+			}
+			ctx.dstype = optarg;
+			break;
+
+		case 'h': /* Show help */
+			usage(argv[0]);
+			return (EXIT_SUCCESS);
+
+		case 'i': /* iterations */
+			ctx.iterations = (unsigned int) atoi(optarg);
+			break;
+
+		case 'm': /* metrics */
+			metrics = optarg;
+			break;
+
+		case 'n': /* entries */
+			ctx.entries = (unsigned int) atoi(optarg);
+			break;
+
+		case 'o': /* output file */
+			output = optarg;
+			break;
+
+		case 'p': /* phases */
+			ctx.trace = 1;
+			break;
+
+		case 's': /* subscribers */
+			ctx.subscribers = (unsigned int) atoi(optarg);
+			break;
+
+		case 't': /* tests */
+			list = optarg;
+			break;
+
+		case 'v': /* Verbose operation */
+			verbose = NC_VERB_VERBOSE;
+			break;
+
+		case 'z': /* compact encoding */
+			ctx.deflate = hello_deflate = 1;
+			break;
+
+		default:
+			fprintf(stderr, "unknown argument -%c", optopt);
+			break;
+		}
+	}
+	if (ctx.entries == 0 || ctx.iterations == 0 || ctx.subscribers == 0) {
+		fprintf(stderr, "The number of entries, iterations and subscribers must be positive.\n");
+		return (EXIT_FAILURE);
+	}
+
+	if (output == NULL) {
+		ctx.out = stdout;
+	} else if ((ctx.out = fopen(output, "a")) == NULL) {
+		fprintf(stderr, "Opening \"%s\" failed (%s).\n", output, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	if ((lat = malloc(ctx.iterations * sizeof(uint64_t))) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	/* the server writes into sockets closed by the client */
+	signal(SIGPIPE, SIG_IGN);
+
+	nc_verbosity(verbose);
+	nc_callback_print(clb_print);
+	if (ctx.trace) {
+		nc_callback_rpc_trace(clb_rpc_trace);
+	}
+
+	/* everything the benchmark creates is kept in a temporary directory */
+	if (mkdtemp(dir) == NULL) {
+		fprintf(stderr, "Creating the working directory failed (%s).\n", strerror(errno));
+		free(lat);
+		return (EXIT_FAILURE);
+	}
+	flags = NC_INIT_SINGLELAYER | NC_INIT_DATASTORES | NC_INIT_MONITORING | NC_INIT_VALIDATE;
+	if (metrics != NULL) {
+		flags |= NC_INIT_METRICS;
+	}
+	if (ctx.deflate) {
+		flags |= NC_INIT_DEFLATE;
+	}
+#ifndef DISABLE_NOTIFICATIONS
+	if (selected(list, "notification")) {
+		setenv("LIBNETCONF_STREAMS", dir, 1);
+		flags |= NC_INIT_NOTIF;
+	}
+#endif
+	if (nc_init(flags) == -1) {
+		fprintf(stderr, "libnetconf initialization failed.\n");
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	snprintf(path, sizeof(path), "%s/bench-config.rng", dir);
+	if (write_file(path, bench_schema) != EXIT_SUCCESS) {
+		ret = EXIT_FAILURE;
+		goto close;
+	}
+	snprintf(path, sizeof(path), "%s/bench.yin", dir);
+	if (write_file(path, bench_model) != EXIT_SUCCESS || (ds = ncds_new(dstype, path, get_state)) == NULL) {
+		ret = EXIT_FAILURE;
+		goto close;
+	}
+
+	if (dstype == NCDS_TYPE_KV) {
+		snprintf(path, sizeof(path), "%s/datastore.kv", dir);
+		c = ncds_kv_set_path(ds, path);
+	} else {
+		snprintf(path, sizeof(path), "%s/datastore.xml", dir);
+		c = ncds_file_set_path(ds, path);
+	}
+	if (c != EXIT_SUCCESS) {
+		ncds_free(ds);
+		ret = EXIT_FAILURE;
+		goto close;
+	}
+	if (ncds_init(ds) <= 0 || ncds_consolidate() != EXIT_SUCCESS) {
+		fprintf(stderr, "Initiating the datastore failed.\n");
+		ncds_free(ds);
+		ret = EXIT_FAILURE;
+		goto close;
+	}
+
+	if ((ctx.conn = conn_open(0)) == NULL) {
+		ret = EXIT_FAILURE;
+		goto close;
+	}
+
+#ifdef RCSID
+	fprintf(ctx.out, "{\"libnetconf\":\"%s\",\"datastore\":\"%s\",\"entries\":%u,\"iterations\":%u}\n",
+			RCSID, ctx.dstype, ctx.entries, ctx.iterations);
+#endif
+
+	start = now_ns();
+	c = bench_populate(&ctx);
+	lat[0] = now_ns() - start;
+	report(&ctx, "populate", lat, (c == -1) ? 0 : 1, (c != 0) ? 1 : 0);
+	if (c != 0) {
+		fprintf(stderr, "Populating the datastore failed.\n");
+		ret = EXIT_FAILURE;
+	}
+
+	for (i = 0; ret == EXIT_SUCCESS && tests[i].name != NULL; i++) {
+		if (selected(list, tests[i].name)) {
+			ret = bench_run(&ctx, &tests[i], lat);
+		}
+	}
+
+	conn_close(ctx.conn);
+
+close:
+	if (metrics != NULL && nc_metrics_write(metrics) != EXIT_SUCCESS) {
+		ret = EXIT_FAILURE;
+	}
+	nc_close();
+
+cleanup:
+	free(lat);
+	nftw(dir, remove_item, 16, FTW_DEPTH | FTW_PHYS);
+	if (ctx.out != stdout) {
+		fclose(ctx.out);
+	}
+
+	return (ret);
+}
@@ -0,0 +1,933 @@
+/*
+ * lncmicro.c
+ *
+ * Micro-benchmarks of the libnetconf hot kernels.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+/*
+ * The kernels are internal functions of the library, so this benchmark is
+ * linked with the library objects instead of the shared library and uses
+ * the internal headers. Static kernels are measured through their nearest
+ * caller: the framing (nc_session_read_until(), nc_session_parse_len()) and
+ * message parsing through nc_session_recv_rpc(), ncxml_subtree_filter()
+ * through ncxml_filter() and xmldiff_list() through xmldiff_diff().
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include <libxml/tree.h>
+#include <libxml/parser.h>
+
+#include "libnetconf.h"
+#include "netconf_internal.h"
+#include "nacm.h"
+#include "datastore/edit_config.h"
+#include "datastore/datastore_internal.h"
+#include "transapi/xmldiff.h"
+#include "transapi/yinparser.h"
+
+#ifdef __GNUC__
+#  define UNUSED(x) UNUSED_ ## x __attribute__((__unused__))
+#else
+#  define UNUSED(x) UNUSED_ ## x
+#endif
+
+#define ARGUMENTS "hi:n:o:t:v"
+
+#define MICRO_NS "urn:libnetconf:bench"
+#define MICRO_NS_BASE "urn:ietf:params:xml:ns:netconf:base:1.0"
+#define MICRO_EOM "]]>]]>"
+
+#define MICRO_SIZES "10,100,1000"
+#define MICRO_ITERATIONS 20
+
+/* number of the NACM data rules checked by nacm_check_data() */
+#define MICRO_NACM_RULES 16
+
+/* the same synthetic model as used by lncbench */
+static const char* micro_model =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<module name=\"bench\" xmlns=\"urn:ietf:params:xml:ns:yang:yin:1\" xmlns:b=\"" MICRO_NS "\">\n"
+	"  <namespace uri=\"" MICRO_NS "\"/>\n"
+	"  <prefix value=\"b\"/>\n"
+	"  <container name=\"bench\">\n"
+	"    <list name=\"entry\">\n"
+	"      <key value=\"name\"/>\n"
+	"      <leaf name=\"name\"><type name=\"string\"/></leaf>\n"
+	"      <leaf name=\"value\"><type name=\"uint32\"/></leaf>\n"
+	"      <leaf name=\"enabled\"><type name=\"boolean\"/><default value=\"true\"/></leaf>\n"
+	"    </list>\n"
+	"  </container>\n"
+	"</module>\n";
+
+static struct ns_pair micro_ns_mapping[] = {
+	{"b", MICRO_NS},
+	{NULL, NULL}
+};
+
+/* NACM datastore of the library, replaced by micro_nacm_ds for the nacm_check_data benchmark */
+extern struct ncds_ds* nacm_ds;
+
+struct micro_ctx {
+	unsigned int size;           /**< number of list entries of the generated inputs */
+	unsigned int iterations;
+	unsigned int seed;
+	int param;                   /**< parameter of the current benchmark */
+	FILE* out;
+	const char* dir;             /**< temporary working directory */
+	xmlDocPtr model;             /**< extended (indexed) model of the datastore */
+	keyList keys;
+	struct model_tree* tree;     /**< model parsed for xmldiff */
+
+	/* state of the current benchmark */
+	xmlDocPtr data;
+	xmlDocPtr work;
+	xmlNodePtr* nodes;           /**< nodes to process in the iterations */
+	xmlNodePtr result;
+	char* text;
+	int fd_in, fd_out;
+	struct nc_session* session;
+	nc_rpc* rpc;
+	struct nc_filter* filter;
+	struct xmldiff_tree* diff;
+	struct ncds_ds* nacm_saved;
+	int nacm_active;
+	char stream[32];
+};
+
+/**
+ * @brief Description of a single benchmark. The setup and cleanup steps run
+ * for each input size, the prepare and finish steps around every timed run
+ * step. None of them are included in the results.
+ */
+struct micro_test {
+	const char* name;
+	int param;
+	int (*setup)(struct micro_ctx* ctx);
+	int (*prepare)(struct micro_ctx* ctx, unsigned int i);
+	int (*run)(struct micro_ctx* ctx, unsigned int i);
+	void (*finish)(struct micro_ctx* ctx, unsigned int i);
+	void (*cleanup)(struct micro_ctx* ctx);
+};
+
+void clb_print(NC_VERB_LEVEL level, const char* msg)
+{
+	switch (level) {
+	case NC_VERB_ERROR:
+		fprintf(stderr, "libnetconf ERROR: %s\n", msg);
+		break;
+	case NC_VERB_WARNING:
+		fprintf(stderr, "libnetconf WARNING: %s\n", msg);
+		break;
+	case NC_VERB_VERBOSE:
+		fprintf(stderr, "libnetconf VERBOSE: %s\n", msg);
+		break;
+	case NC_VERB_DEBUG:
+		fprintf(stderr, "libnetconf DEBUG: %s\n", msg);
+		break;
+	}
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static unsigned int micro_random(struct micro_ctx* ctx)
+{
+	return ((unsigned int)rand_r(&ctx->seed) % ctx->size);
+}
+
+/**
+ * @brief Generate the configuration data with the given number of list entries.
+ * @param[in] value Value of all the value leaves.
+ * @param[in] enabled Add the enabled leaves with their default value.
+ */
+static xmlDocPtr gen_data(unsigned int size, unsigned int value, int enabled)
+{
+	xmlDocPtr doc;
+	xmlNodePtr root, entry;
+	xmlNsPtr ns;
+	char buf[16];
+	unsigned int i;
+
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	root = xmlNewNode(NULL, BAD_CAST "bench");
+	ns = xmlNewNs(root, BAD_CAST MICRO_NS, NULL);
+	xmlSetNs(root, ns);
+	xmlDocSetRootElement(doc, root);
+
+	for (i = 0; i < size; i++) {
+		entry = xmlNewChild(root, ns, BAD_CAST "entry", NULL);
+		snprintf(buf, sizeof(buf), "e%07u", i);
+		xmlNewChild(entry, ns, BAD_CAST "name", BAD_CAST buf);
+		snprintf(buf, sizeof(buf), "%u", value);
+		xmlNewChild(entry, ns, BAD_CAST "value", BAD_CAST buf);
+		if (enabled) {
+			xmlNewChild(entry, ns, BAD_CAST "enabled", BAD_CAST "true");
+		}
+	}
+
+	return (doc);
+}
+
+/**
+ * @brief Pick the entries of the data processed by the iterations.
+ */
+static int pick_entries(struct micro_ctx* ctx, xmlDocPtr doc)
+{
+	xmlNodePtr* entries, node;
+	unsigned int i;
+
+	if ((entries = malloc(ctx->size * sizeof(xmlNodePtr))) == NULL
+			|| (ctx->nodes = malloc(ctx->iterations * sizeof(xmlNodePtr))) == NULL) {
+		free(entries);
+		return (-1);
+	}
+	for (i = 0, node = doc->children->children; node != NULL; node = node->next) {
+		entries[i++] = node;
+	}
+	for (i = 0; i < ctx->iterations; i++) {
+		ctx->nodes[i] = entries[micro_random(ctx)];
+	}
+	free(entries);
+	return (0);
+}
+
+static char* dump_data(xmlDocPtr doc)
+{
+	xmlBufferPtr buf;
+	char* text;
+
+	buf = xmlBufferCreate();
+	xmlNodeDump(buf, doc, doc->children, 0, 0);
+	text = strdup((char*)xmlBufferContent(buf));
+	xmlBufferFree(buf);
+	return (text);
+}
+
+static char* gen_rpc(unsigned int size, unsigned int msgid)
+{
+	xmlDocPtr doc;
+	char *config, *rpc = NULL;
+
+	doc = gen_data(size, msgid, 0);
+	config = dump_data(doc);
+	xmlFreeDoc(doc);
+	if (config == NULL || asprintf(&rpc, "<rpc message-id=\"%u\" xmlns=\"%s\"><edit-config><target><running/></target>"
+			"<config>%s</config></edit-config></rpc>", msgid, MICRO_NS_BASE, config) == -1) {
+		rpc = NULL;
+	}
+	free(config);
+	return (rpc);
+}
+
+static void cleanup_state(struct micro_ctx* ctx)
+{
+	xmlFreeDoc(ctx->data);
+	ctx->data = NULL;
+	xmlFreeDoc(ctx->work);
+	ctx->work = NULL;
+	free(ctx->nodes);
+	ctx->nodes = NULL;
+	free(ctx->text);
+	ctx->text = NULL;
+}
+
+/*
+ * Framing and parsing - the session reads prepared messages from a regular
+ * file, so the results do not depend on another process feeding the data.
+ * The parameter is the chunk size, 0 for a single chunk and -1 for the
+ * NETCONF 1.0 end-of-message framing.
+ */
+static int setup_recv(struct micro_ctx* ctx)
+{
+	FILE* f;
+	char path[PATH_MAX], *rpc;
+	size_t len, off, n;
+	unsigned int i;
+
+	snprintf(path, sizeof(path), "%s/messages", ctx->dir);
+	if ((f = fopen(path, "w")) == NULL) {
+		return (-1);
+	}
+	fprintf(f, "<hello xmlns=\"%s\"><capabilities><capability>urn:ietf:params:netconf:base:1.0</capability>%s"
+			"</capabilities></hello>" MICRO_EOM, MICRO_NS_BASE,
+			(ctx->param == -1) ? "" : "<capability>urn:ietf:params:netconf:base:1.1</capability>");
+	for (i = 0; i < ctx->iterations; i++) {
+		if ((rpc = gen_rpc(ctx->size, i + 1)) == NULL) {
+			fclose(f);
+			return (-1);
+		}
+		len = strlen(rpc);
+		if (ctx->param == -1) {
+			fprintf(f, "%s" MICRO_EOM, rpc);
+		} else {
+			for (off = 0; off < len; off += n) {
+				n = (ctx->param == 0 || len - off < (size_t)ctx->param) ? len - off : (size_t)ctx->param;
+				fprintf(f, "\n#%zu\n", n);
+				fwrite(rpc + off, 1, n, f);
+			}
+			fprintf(f, "\n##\n");
+		}
+		free(rpc);
+	}
+	fclose(f);
+
+	if ((ctx->fd_in = open(path, O_RDONLY)) == -1) {
+		return (-1);
+	}
+	if ((ctx->fd_out = open("/dev/null", O_WRONLY)) == -1) {
+		close(ctx->fd_in);
+		return (-1);
+	}
+	if ((ctx->session = nc_session_accept_inout(NULL, "bench", ctx->fd_in, ctx->fd_out)) == NULL) {
+		close(ctx->fd_in);
+		close(ctx->fd_out);
+		return (-1);
+	}
+	return (0);
+}
+
+static int run_recv(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	return ((nc_session_recv_rpc(ctx->session, -1, &ctx->rpc) == NC_MSG_RPC) ? 0 : -1);
+}
+
+static void finish_rpc(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	nc_rpc_free(ctx->rpc);
+	ctx->rpc = NULL;
+}
+
+static void cleanup_recv(struct micro_ctx* ctx)
+{
+	nc_session_free(ctx->session);
+	ctx->session = NULL;
+	close(ctx->fd_in);
+	close(ctx->fd_out);
+}
+
+/* parsing without the framing, to tell them apart */
+static int setup_rpc_build(struct micro_ctx* ctx)
+{
+	return (((ctx->text = gen_rpc(ctx->size, 1)) == NULL) ? -1 : 0);
+}
+
+static int run_rpc_build(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	return (((ctx->rpc = nc_rpc_build(ctx->text, NULL)) == NULL) ? 1 : 0);
+}
+
+static int setup_find_element_equiv(struct micro_ctx* ctx)
+{
+	xmlNodePtr* nodes;
+	unsigned int i;
+
+	ctx->data = gen_data(ctx->size, 0, 0);
+	ctx->work = gen_data(ctx->size, 0, 0);
+	if (pick_entries(ctx, ctx->work) != 0) {
+		return (-1);
+	}
+	/* look for the entries of another document, as the edit-config does */
+	nodes = ctx->nodes;
+	for (i = 0; i < ctx->iterations; i++) {
+		nodes[i] = nodes[i]->children;
+	}
+	/* all the iterations search the same data as a single edit-config, so
+	 * they share the key index, it is built by the first one */
+	edit_index_start(ctx->data);
+	return (0);
+}
+
+static int run_find_element_equiv(struct micro_ctx* ctx, unsigned int i)
+{
+	return ((find_element_equiv(ctx->data, ctx->nodes[i], ctx->model, ctx->keys) == NULL) ? 1 : 0);
+}
+
+static void cleanup_find_element_equiv(struct micro_ctx* UNUSED(ctx))
+{
+	edit_index_stop();
+}
+
+static int setup_data(struct micro_ctx* ctx)
+{
+	ctx->data = gen_data(ctx->size, 0, ctx->param == NCWD_MODE_TRIM);
+	return (0);
+}
+
+/* every iteration changes the values of all the entries */
+static int prepare_edit_merge(struct micro_ctx* ctx, unsigned int i)
+{
+	ctx->work = gen_data(ctx->size, i + 1, 0);
+	return (0);
+}
+
+static int run_edit_merge(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	struct nc_err* err = NULL;
+	int ret = 0;
+
+	/* the key index lives for a single edit-config */
+	edit_index_start(ctx->data);
+	if (edit_merge(ctx->data, ctx->work->children, NC_EDIT_DEFOP_MERGE, ctx->model, ctx->keys, NULL, &err) != EXIT_SUCCESS) {
+		nc_err_free(err);
+		ret = 1;
+	}
+	edit_index_stop();
+	return (ret);
+}
+
+static void finish_work(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	xmlFreeDoc(ctx->work);
+	ctx->work = NULL;
+}
+
+/* the parameter selects the filter - 0 for a single entry by the key, 1 for a leaf of all entries */
+static int setup_filter(struct micro_ctx* ctx)
+{
+	char filter[256];
+
+	ctx->data = gen_data(ctx->size, 0, 0);
+	if (ctx->param == 0) {
+		snprintf(filter, sizeof(filter), "<bench xmlns=\"%s\"><entry><name>e%07u</name></entry></bench>", MICRO_NS, ctx->size / 2);
+	} else {
+		snprintf(filter, sizeof(filter), "<bench xmlns=\"%s\"><entry><value/></entry></bench>", MICRO_NS);
+	}
+	return (((ctx->filter = nc_filter_new(NC_FILTER_SUBTREE, filter)) == NULL) ? -1 : 0);
+}
+
+static int run_filter(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	return ((ncxml_filter(ctx->data->children, ctx->filter, &ctx->result, ctx->model) != 0) ? 1 : 0);
+}
+
+static void finish_filter(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	xmlFreeNodeList(ctx->result);
+	ctx->result = NULL;
+}
+
+static void cleanup_filter(struct micro_ctx* ctx)
+{
+	nc_filter_free(ctx->filter);
+	ctx->filter = NULL;
+}
+
+/* every other entry differs in its value */
+static int setup_xmldiff(struct micro_ctx* ctx)
+{
+	xmlNodePtr node;
+	unsigned int i;
+
+	if (ctx->tree == NULL && (ctx->tree = yinmodel_parse(ctx->model, micro_ns_mapping)) == NULL) {
+		return (-1);
+	}
+	ctx->data = gen_data(ctx->size, 0, 0);
+	ctx->work = gen_data(ctx->size, 0, 0);
+	for (i = 0, node = ctx->work->children->children; node != NULL; node = node->next, i++) {
+		if (i % 2) {
+			xmlNodeSetContent(node->children->next, BAD_CAST "1");
+		}
+	}
+	return (0);
+}
+
+static int run_xmldiff(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	return ((xmldiff_diff(&ctx->diff, ctx->data, ctx->work, ctx->tree, NULL) == XMLDIFF_ERR) ? 1 : 0);
+}
+
+static void finish_xmldiff(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	xmldiff_free(ctx->diff);
+	ctx->diff = NULL;
+}
+
+/*
+ * NACM - the rules are provided by a minimal replacement of the NACM
+ * datastore, so the benchmark does not touch the configuration of the
+ * installed library.
+ */
+static struct ncds_ds micro_nacm_ds;
+static unsigned int micro_nacm_size;
+
+static int micro_nacm_changed(struct ncds_ds* UNUSED(ds))
+{
+	return (1);
+}
+
+static char* micro_nacm_getconfig(struct ncds_ds* UNUSED(ds), const struct nc_session* UNUSED(session), NC_DATASTORE UNUSED(target), struct nc_err** UNUSED(error))
+{
+	FILE* config;
+	char* content = NULL;
+	size_t len;
+	unsigned int i;
+
+	if ((config = open_memstream(&content, &len)) == NULL) {
+		return (NULL);
+	}
+	fprintf(config, "<nacm xmlns=\"%s\"><enable-nacm>true</enable-nacm><read-default>permit</read-default>"
+			"<write-default>permit</write-default><exec-default>permit</exec-default><enable-external-groups>false</enable-external-groups>"
+			"<groups><group><name>bench</name><user-name>bench</user-name></group></groups>"
+			"<rule-list><name>bench</name><group>bench</group>", NC_NS_NACM);
+	for (i = 0; i < MICRO_NACM_RULES; i++) {
+		fprintf(config, "<rule><name>r%u</name><module-name>bench</module-name>"
+				"<path xmlns:b=\"%s\">/b:bench/b:entry[b:name='e%07u']</path>"
+				"<access-operations>read</access-operations><action>deny</action></rule>",
+				i, MICRO_NS, (i * 2 + 1) * micro_nacm_size / (MICRO_NACM_RULES * 2));
+	}
+	fprintf(config, "</rule-list></nacm>");
+	fclose(config);
+
+	return (content);
+}
+
+static int setup_nacm(struct micro_ctx* ctx)
+{
+	struct nc_cpblts* cpblts;
+
+	/* the configuration contains all the values, no model is needed for their defaults */
+	memset(&micro_nacm_ds, 0, sizeof(micro_nacm_ds));
+	micro_nacm_ds.func.was_changed = micro_nacm_changed;
+	micro_nacm_ds.func.getconfig = micro_nacm_getconfig;
+	micro_nacm_size = ctx->size;
+	ctx->nacm_saved = nacm_ds;
+	nacm_ds = &micro_nacm_ds;
+	if (nacm_init() != EXIT_SUCCESS) {
+		nacm_ds = ctx->nacm_saved;
+		return (-1);
+	}
+	ctx->nacm_active = 1;
+
+	ctx->data = gen_data(ctx->size, 0, 0);
+	if (pick_entries(ctx, ctx->data) != 0) {
+		return (-1);
+	}
+	ctx->session = nc_session_dummy("1", "bench", "localhost", cpblts = nc_session_get_cpblts_default());
+	nc_cpblts_free(cpblts);
+	if (ctx->session == NULL || (ctx->rpc = nc_rpc_getconfig(NC_DATASTORE_RUNNING, NULL)) == NULL
+			|| nacm_start(ctx->rpc, ctx->session) != EXIT_SUCCESS || ctx->rpc->nacm == NULL) {
+		return (-1);
+	}
+	return (0);
+}
+
+static int run_nacm(struct micro_ctx* ctx, unsigned int i)
+{
+	return ((nacm_check_data(ctx->nodes[i], NACM_ACCESS_READ, ctx->rpc->nacm) == -1) ? 1 : 0);
+}
+
+static void cleanup_nacm(struct micro_ctx* ctx)
+{
+	nc_rpc_free(ctx->rpc);
+	ctx->rpc = NULL;
+	nc_session_free(ctx->session);
+	ctx->session = NULL;
+	if (ctx->nacm_active) {
+		nacm_close();
+		nacm_ds = ctx->nacm_saved;
+		ctx->nacm_active = 0;
+	}
+}
+
+/* the parameter is the with-defaults mode */
+static int prepare_defaults(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	return (((ctx->work = xmlCopyDoc(ctx->data, 1)) == NULL) ? -1 : 0);
+}
+
+static int run_defaults(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	return ((ncdflt_default_values(ctx->work, ctx->model, ctx->param) != 0) ? 1 : 0);
+}
+
+#ifndef DISABLE_NOTIFICATIONS
+
+/* each size replays its own stream of the given number of events */
+static int setup_stream(struct micro_ctx* ctx)
+{
+	char event[32], content[160];
+	unsigned int i;
+
+	snprintf(ctx->stream, sizeof(ctx->stream), "bench-%u", ctx->size);
+	snprintf(event, sizeof(event), "event-%u", ctx->size);
+	if (!ncntf_stream_isavailable(ctx->stream) && (ncntf_stream_new(ctx->stream, "lncmicro events", 1) != EXIT_SUCCESS
+			|| ncntf_stream_allow_events(ctx->stream, event) != EXIT_SUCCESS)) {
+		return (-1);
+	}
+	for (i = 0; i < ctx->size; i++) {
+		snprintf(content, sizeof(content), "<%s xmlns=\"%s\"><seq>%u</seq></%s>", event, MICRO_NS, i, event);
+		if (ncntf_event_new(-1, NCNTF_GENERIC, content) != EXIT_SUCCESS) {
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+static int run_stream(struct micro_ctx* ctx, unsigned int UNUSED(i))
+{
+	unsigned int count = 0;
+	char* event;
+
+	ncntf_stream_iter_start(ctx->stream);
+	while ((event = ncntf_stream_iter_next(ctx->stream, 0, -1, NULL)) != NULL) {
+		free(event);
+		count++;
+	}
+	ncntf_stream_iter_finish(ctx->stream);
+
+	/* the replayComplete notification is included */
+	return ((count < ctx->size) ? 1 : 0);
+}
+
+#endif /* not DISABLE_NOTIFICATIONS */
+
+static struct micro_test tests[] = {
+	{"recv-eom", -1, setup_recv, NULL, run_recv, finish_rpc, cleanup_recv},
+	{"recv-chunked", 0, setup_recv, NULL, run_recv, finish_rpc, cleanup_recv},
+	{"recv-chunked-4096", 4096, setup_recv, NULL, run_recv, finish_rpc, cleanup_recv},
+	{"recv-chunked-64", 64, setup_recv, NULL, run_recv, finish_rpc, cleanup_recv},
+	{"rpc-build", 0, setup_rpc_build, NULL, run_rpc_build, finish_rpc, NULL},
+	{"find_element_equiv", 0, setup_find_element_equiv, NULL, run_find_element_equiv, NULL, cleanup_find_element_equiv},
+	{"edit_merge", 0, setup_data, prepare_edit_merge, run_edit_merge, finish_work, NULL},
+	{"ncxml_filter-key", 0, setup_filter, NULL, run_filter, finish_filter, cleanup_filter},
+	{"ncxml_filter-leaf", 1, setup_filter, NULL, run_filter, finish_filter, cleanup_filter},
+	{"xmldiff_diff", 0, setup_xmldiff, NULL, run_xmldiff, finish_xmldiff, NULL},
+	{"nacm_check_data", 0, setup_nacm, NULL, run_nacm, NULL, cleanup_nacm},
+	{"ncdflt_default_values-all", NCWD_MODE_ALL, setup_data, prepare_defaults, run_defaults, finish_work, NULL},
+	{"ncdflt_default_values-trim", NCWD_MODE_TRIM, setup_data, prepare_defaults, run_defaults, finish_work, NULL},
+#ifndef DISABLE_NOTIFICATIONS
+	{"ncntf_stream_iter_next", 0, setup_stream, NULL, run_stream, NULL, NULL},
+#endif
+	{NULL, 0, NULL, NULL, NULL, NULL, NULL}
+};
+
+static int cmp_u64(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+
+	return ((x > y) - (x < y));
+}
+
+static double percentile_us(uint64_t* lat, unsigned int count, unsigned int p)
+{
+	unsigned int idx;
+
+	if (count == 0) {
+		return (0);
+	}
+	/* nearest-rank method */
+	idx = (count * p + 99) / 100;
+	return (lat[(idx > 0) ? idx - 1 : 0] / 1000.0);
+}
+
+static void report(struct micro_ctx* ctx, const char* name, uint64_t* lat, unsigned int ops, unsigned int errors)
+{
+	uint64_t total = 0;
+	unsigned int i;
+
+	for (i = 0; i < ops; i++) {
+		total += lat[i];
+	}
+	qsort(lat, ops, sizeof(uint64_t), cmp_u64);
+
+	/* the time per list entry stays flat unless the kernel is superlinear */
+	fprintf(ctx->out, "{\"bench\":\"%s\",\"size\":%u,\"ops\":%u,\"errors\":%u,"
+			"\"mean_us\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f,\"ns_per_item\":%.1f}\n",
+			name, ctx->size, ops, errors,
+			(ops > 0) ? total / 1000.0 / ops : 0.0,
+			percentile_us(lat, ops, 50), percentile_us(lat, ops, 99),
+			(ops > 0) ? lat[ops - 1] / 1000.0 : 0.0,
+			(ops > 0) ? (double)total / ops / ctx->size : 0.0);
+	fflush(ctx->out);
+}
+
+static int micro_run(struct micro_ctx* ctx, struct micro_test* test, uint64_t* lat)
+{
+	unsigned int i, errors = 0;
+	uint64_t start;
+	int r = 0;
+
+	ctx->param = test->param;
+	if (test->setup != NULL && test->setup(ctx) != 0) {
+		fprintf(stderr, "Setting up the %s benchmark of size %u failed.\n", test->name, ctx->size);
+		if (test->cleanup != NULL) {
+			test->cleanup(ctx);
+		}
+		cleanup_state(ctx);
+		return (EXIT_FAILURE);
+	}
+
+	for (i = 0; i < ctx->iterations; i++) {
+		if (test->prepare != NULL && (r = test->prepare(ctx, i)) == -1) {
+			break;
+		}
+		start = now_ns();
+		r = test->run(ctx, i);
+		lat[i] = now_ns() - start;
+		if (r == -1) {
+			break;
+		} else if (r != 0) {
+			errors++;
+		}
+		if (test->finish != NULL) {
+			test->finish(ctx, i);
+		}
+	}
+
+	if (test->cleanup != NULL) {
+		test->cleanup(ctx);
+	}
+	cleanup_state(ctx);
+
+	report(ctx, test->name, lat, i, errors);
+	if (r == -1) {
+		fprintf(stderr, "The %s benchmark of size %u was interrupted.\n", test->name, ctx->size);
+		return (EXIT_FAILURE);
+	}
+	return (EXIT_SUCCESS);
+}
+
+static int write_file(const char* path, const char* content)
+{
+	FILE* f;
+
+	if ((f = fopen(path, "w")) == NULL) {
+		fprintf(stderr, "Creating \"%s\" failed (%s).\n", path, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	fputs(content, f);
+	fclose(f);
+	return (EXIT_SUCCESS);
+}
+
+static int remove_item(const char* path, const struct stat* UNUSED(sb), int UNUSED(flag), struct FTW* UNUSED(ftw))
+{
+	return (remove(path));
+}
+
+void usage(char* progname)
+{
+	int i;
+
+	printf("Micro-benchmarks of the libnetconf hot kernels.\n\n");
+	printf("Usage: %s [-hv] [-n <sizes>] [-i <iterations>] [-t <tests>] [-o <output>]\n", progname);
+	printf("-h                Show this help\n");
+	printf("-i <iterations>   Number of operations of each benchmark and size, %d is default\n", MICRO_ITERATIONS);
+	printf("-n <sizes>        Comma-separated list of the input sizes (list entries), %s is default\n", MICRO_SIZES);
+	printf("-o <output>       Append results to the file instead of printing them to stdout\n");
+	printf("-t <tests>        Comma-separated list of benchmarks to run, all are run by default\n");
+	printf("-v                Verbose mode\n\n");
+	printf("Available benchmarks:");
+	for (i = 0; tests[i].name != NULL; i++) {
+		printf(" %s", tests[i].name);
+	}
+	printf("\n\nResults are printed as one JSON object per line.\n\n");
+}
+
+static int selected(const char* list, const char* name)
+{
+	const char* p;
+	size_t len = strlen(name);
+
+	if (list == NULL) {
+		return (1);
+	}
+	for (p = list; (p = strstr(p, name)) != NULL; p += len) {
+		if ((p == list || p[-1] == ',') && (p[len] == '\0' || p[len] == ',')) {
+			return (1);
+		}
+	}
+	return (0);
+}
+
+int main(int argc, char* argv[])
+{
+	int ret = EXIT_SUCCESS, c, i, flags;
+	NC_VERB_LEVEL verbose = NC_VERB_ERROR;
+	struct micro_ctx ctx;
+	struct ncds_ds* ds;
+	char dir[] = "/tmp/lncmicro-XXXXXX";
+	char path[PATH_MAX], *list = NULL, *output = NULL, *end;
+	const char *sizes = MICRO_SIZES, *size;
+	unsigned long n;
+	uint64_t *lat = NULL;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.iterations = MICRO_ITERATIONS;
+	ctx.dir = dir;
+
+	while ((c = getopt(argc, argv, ARGUMENTS)) != -1) {
+		switch (c) {
+		case 'h': /* Show help */
+			usage(argv[0]);
+			return (EXIT_SUCCESS);
+
+		case 'i': /* iterations */
+			ctx.iterations = (unsigned int) atoi(optarg);
+			break;
+
+		case 'n': /* sizes */
+			sizes = optarg;
+			break;
+
+		case 'o': /* output file */
+			output = optarg;
+			break;
+
+		case 't': /* tests */
+			list = optarg;
+			break;
+
+		case 'v': /* Verbose operation */
+			verbose = NC_VERB_VERBOSE;
+			break;
+
+		default:
+			fprintf(stderr, "unknown argument -%c", optopt);
+			break;
+		}
+	}
+	for (size = sizes; *size != '\0'; size = (*end == ',') ? end + 1 : end) {
+		n = strtoul(size, &end, 10);
+		if (end == size || n == 0 || n > UINT_MAX || (*end != ',' && *end != '\0')) {
+			fprintf(stderr, "Invalid list of sizes \"%s\".\n", sizes);
+			return (EXIT_FAILURE);
+		}
+	}
+	if (ctx.iterations == 0) {
+		fprintf(stderr, "The number of iterations must be positive.\n");
+		return (EXIT_FAILURE);
+	}
+
+	if (output == NULL) {
+		ctx.out = stdout;
+	} else if ((ctx.out = fopen(output, "a")) == NULL) {
+		fprintf(stderr, "Opening \"%s\" failed (%s).\n", output, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	if ((lat = malloc(ctx.iterations * sizeof(uint64_t))) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	nc_verbosity(verbose);
+	nc_callback_print(clb_print);
+
+	/* everything the benchmark creates is kept in a temporary directory */
+	if (mkdtemp(dir) == NULL) {
+		fprintf(stderr, "Creating the working directory failed (%s).\n", strerror(errno));
+		free(lat);
+		return (EXIT_FAILURE);
+	}
+	flags = NC_INIT_SINGLELAYER | NC_INIT_DATASTORES | NC_INIT_MONITORING;
+#ifndef DISABLE_NOTIFICATIONS
+	if (selected(list, "ncntf_stream_iter_next")) {
+		setenv("LIBNETCONF_STREAMS", dir, 1);
+		flags |= NC_INIT_NOTIF;
+	}
+#endif
+	if (nc_init(flags) == -1) {
+		fprintf(stderr, "libnetconf initialization failed.\n");
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	/* the datastore makes the model known to the library (NACM looks it up) */
+	snprintf(path, sizeof(path), "%s/bench.yin", dir);
+	if (write_file(path, micro_model) != EXIT_SUCCESS || (ds = ncds_new(NCDS_TYPE_EMPTY, path, NULL)) == NULL) {
+		ret = EXIT_FAILURE;
+		goto close;
+	}
+	if (ncds_init(ds) <= 0 || ncds_consolidate() != EXIT_SUCCESS) {
+		fprintf(stderr, "Initiating the datastore failed.\n");
+		ncds_free(ds);
+		ret = EXIT_FAILURE;
+		goto close;
+	}
+	/* index the model as the datastore does on its first access */
+	ctx.model = ds->ext_model;
+	if (!ds->ext_model_indexed) {
+		ds->ext_model_indexed = 1;
+		model_index_build(ctx.model);
+	}
+	ctx.keys = get_keynode_list(ctx.model);
+
+#ifdef RCSID
+	fprintf(ctx.out, "{\"libnetconf\":\"%s\",\"sizes\":\"%s\",\"iterations\":%u}\n", RCSID, sizes, ctx.iterations);
+#endif
+
+	for (i = 0; ret == EXIT_SUCCESS && tests[i].name != NULL; i++) {
+		if (!selected(list, tests[i].name)) {
+			continue;
+		}
+		for (size = sizes; ret == EXIT_SUCCESS && *size != '\0'; size = (*end == ',') ? end + 1 : end) {
+			ctx.size = (unsigned int) strtoul(size, &end, 10);
+			ctx.seed = 1;
+			ret = micro_run(&ctx, &tests[i], lat);
+		}
+	}
+
+	keyListFree(ctx.keys);
+	yinmodel_free(ctx.tree);
+
+close:
+	nc_close();
+
+cleanup:
+	free(lat);
+	nftw(dir, remove_item, 16, FTW_DEPTH | FTW_PHYS);
+	if (ctx.out != stdout) {
+		fclose(ctx.out);
+	}
+
+	return (ret);
+}
@@ -3,12 +3,20 @@
 #include <unistd.h>
 #include <string.h>
 #include <libnetconf.h>
-#include "../../src/netconf_internal.h"
 
 #include <libxml/tree.h>
 #include <libxml/parser.h>
 
-#define ARGUMENTS "hls:e:v:"
+#define ARGUMENTS "hlcn:s:e:v:"
+
+/* maximal number of the -n options */
+#define MAX_EVENTS 32
+
+struct summary {
+	int records;
+	int corrupted;
+	int headers;
+};
 
 void clb_print(NC_VERB_LEVEL level, const char* msg)
 {
@@ -30,24 +38,53 @@ void clb_print(NC_VERB_LEVEL level, const char* msg)
 
 void usage(char* progname)
 {
-	printf("Usage: %s [-hl] [-s time] [-e time] [-v level] stream\n", progname);
+	printf("Usage: %s [-hlc] [-n event]... [-s time] [-e time] [-v level] stream\n", progname);
 	printf("-h         Show this help\n");
 	printf("-l         List available streams\n");
+	printf("-c         Print only the time, name and namespace of the events\n");
+	printf("-n event   Print only the events of the given name, can be repeated\n");
 	printf("-s time    Start time of the events time range\n");
 	printf("-e time    End time of the events time range\n");
 	printf("-v level   Set verbose level (0-3)\n\n");
 	printf("Note: time is accepted in a form printed by the -l option.\n\n");
 }
 
+int clb_record(const struct ncntf_record* record, void* arg)
+{
+	struct summary *sum = (struct summary*)arg;
+	xmlDocPtr eventDoc;
+	char* t;
+
+	if (sum->headers) {
+		t = nc_time2datetime(record->time, NULL);
+		fprintf(stdout, "%s %s %s\n", t, record->name, record->ns);
+		free(t);
+		sum->records++;
+		return (0);
+	}
+
+	if ((eventDoc = xmlReadMemory(record->text, strlen(record->text), NULL, NULL, 0)) != NULL) {
+		fprintf(stdout, "Event:\n");
+		xmlDocFormatDump(stdout, eventDoc, 1);
+		xmlFreeDoc(eventDoc);
+		sum->records++;
+	} else {
+		fprintf(stdout, "Invalid event format.\n");
+		sum->corrupted = 1;
+	}
+	return (0);
+}
+
 int main(int argc, char* argv[])
 {
-	char* event, *stream, **list, *desc, *start;
-	int i, c;
+	char *stream, **list, *desc, *start;
+	const char* events[MAX_EVENTS + 1] = {NULL};
+	int i, c, n = 0;
 	int verbosity = NC_VERB_ERROR;
 	int listing = 0;
-	int corrupted = 0;
-	int time_start = 0, time_end = -1;
-	xmlDocPtr eventDoc;
+	int time_start = -1, time_end = -1;
+	long long int count;
+	struct summary sum = {0, 0, 0};
 
 	while ((c = getopt(argc, argv, ARGUMENTS)) != -1) {
 		switch (c) {
@@ -59,6 +96,18 @@ int main(int argc, char* argv[])
 			listing = 1;
 			break;
 
+		case 'c': /* print only the record headers */
+			sum.headers = 1;
+			break;
+
+		case 'n': /* event name filter */
+			if (n == MAX_EVENTS) {
+				fprintf(stderr, "Too many event names, only %d are allowed\n", MAX_EVENTS);
+				return (EXIT_FAILURE);
+			}
+			events[n++] = optarg;
+			break;
+
 		case 's': /* time range - start */
 			time_start = nc_datetime2time(optarg);
 			break;
@@ -96,7 +145,7 @@ int main(int argc, char* argv[])
 	nc_verbosity(verbosity);
 	nc_callback_print(clb_print);
 
-	c = nc_init(NC_INIT_NOTIF);
+	c = nc_init(NC_INIT_SINGLELAYER | NC_INIT_NOTIF);
 	if (c == -1) {
 		fprintf(stderr, "libnetconf initiation failed.");
 		return (EXIT_FAILURE);
@@ -123,29 +172,19 @@ int main(int argc, char* argv[])
 		return(EXIT_SUCCESS);
 	}
 
-	i = 0;
-	ncntf_stream_iter_start(stream);
-	while((event = ncntf_stream_iter_next(stream, time_start, time_end, NULL)) != NULL) {
-		if ((eventDoc = xmlReadMemory(event, strlen(event), NULL, NULL, 0)) != NULL) {
-			fprintf(stdout, "Event:\n");
-			xmlDocFormatDump(stdout, eventDoc, 1);
-			xmlFreeDoc(eventDoc);
-			i++;
-		} else {
-			fprintf(stdout, "Invalid event format.\n");
-			corrupted = 1;
-		}
-		free(event);
+	count = ncntf_stream_scan(stream, time_start, time_end, (n == 0) ? NULL : events, !sum.headers, clb_record, &sum);
+	if (count == -1) {
+		fprintf(stderr, "Reading the stream \"%s\" failed.\n", stream);
+		sum.corrupted = 1;
 	}
-	ncntf_stream_iter_finish(stream);
 
 	/* print summary */
-	fprintf(stdout, "\nSummary:\n\tNumber of records: %d\n", i);
-	if (corrupted) {
+	fprintf(stdout, "\nSummary:\n\tNumber of records: %d\n", sum.records);
+	if (sum.corrupted) {
 		fprintf(stdout, "\tSTREAM FILE IS CORRUPTED!\n");
 	}
 
-	ncntf_close();
+	nc_close();
 
 	return (EXIT_SUCCESS);
 }
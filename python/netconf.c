@@ -7,6 +7,7 @@
 #include "netconf.h"
 
 extern PyTypeObject ncSessionType;
+extern PyTypeObject ncReplyDataType;
 
 PyObject *libnetconfError;
 PyObject *libnetconfWarning;
@@ -17,6 +18,9 @@ PyObject *datastores = NULL; /* dictionary */
 static int syslogEnabled = 1;
 static void clb_print(NC_VERB_LEVEL level, const char* msg)
 {
+	/* libnetconf functions are called also without holding the GIL */
+	PyGILState_STATE gstate = PyGILState_Ensure();
+
 	switch (level) {
 	case NC_VERB_ERROR:
 		PyErr_SetString(libnetconfError, msg);
@@ -33,6 +37,8 @@ static void clb_print(NC_VERB_LEVEL level, const char* msg)
 		if (syslogEnabled) {syslog(LOG_DEBUG, "%s", msg);}
 		break;
 	}
+
+	PyGILState_Release(gstate);
 }
 
 static PyObject *setSyslog(PyObject *self, PyObject *args, PyObject *keywds)
@@ -346,6 +352,11 @@ PyMODINIT_FUNC PyInit_netconf(void)
 {
 	PyObject *nc;
 
+#if PY_VERSION_HEX < 0x03070000
+	/* the GIL is released around the network communication */
+	PyEval_InitThreads();
+#endif
+
 	/* initiate libnetconf - all subsystems */
 	nc_init(NC_INIT_ALL);
 
@@ -359,6 +370,9 @@ PyMODINIT_FUNC PyInit_netconf(void)
 	if (PyType_Ready(&ncSessionType) < 0) {
 	    return NULL;
 	}
+	if (PyType_Ready(&ncReplyDataType) < 0) {
+	    return NULL;
+	}
 
 	/* create netconf as the Python module */
 	nc = PyModule_Create(&ncModule);
@@ -8,8 +8,20 @@
 typedef struct {
 	PyObject_HEAD
 	struct nc_session* session;
+	int busy;                      /* number of threads using the session without the GIL */
+	struct nc_session* closed;     /* session to free when the last such thread finishes */
 } ncSessionObject;
 
+/*
+ * read-only buffer with the reply data taken over from libnetconf, it is
+ * exported to Python via memoryview without copying the data
+ */
+typedef struct {
+	PyObject_HEAD
+	char* data;
+	Py_ssize_t len;
+} ncReplyDataObject;
+
 /* from netconf.c */
 extern PyObject *libnetconfError;
 
@@ -21,6 +33,105 @@ static PyMemberDef ncSessionMembers[] = {
 
 #define SESSION_CHECK(self) if(!(self->session)){PyErr_SetString(libnetconfError,"Session closed.");return NULL;}
 
+static int ncReplyDataGetBuffer(ncReplyDataObject *self, Py_buffer *view, int flags)
+{
+	return (PyBuffer_FillInfo(view, (PyObject*)self, self->data, self->len, 1, flags));
+}
+
+static void ncReplyDataFree(ncReplyDataObject *self)
+{
+	free(self->data);
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyBufferProcs ncReplyDataBuffer = {
+		(getbufferproc) ncReplyDataGetBuffer, /* bf_getbuffer */
+		NULL, /* bf_releasebuffer */
+};
+
+PyTypeObject ncReplyDataType = {
+		PyVarObject_HEAD_INIT(NULL, 0)
+		"netconf.ReplyData", /* tp_name */
+		sizeof(ncReplyDataObject), /* tp_basicsize */
+		0, /* tp_itemsize */
+		(destructor) ncReplyDataFree, /* tp_dealloc */
+		0, /* tp_print */
+		0, /* tp_getattr */
+		0, /* tp_setattr */
+		0, /* tp_reserved */
+		0, /* tp_repr */
+		0, /* tp_as_number */
+		0, /* tp_as_sequence */
+		0, /* tp_as_mapping */
+		0, /* tp_hash  */
+		0, /* tp_call */
+		0, /* tp_str */
+		0, /* tp_getattro */
+		0, /* tp_setattro */
+		&ncReplyDataBuffer, /* tp_as_buffer */
+		Py_TPFLAGS_DEFAULT, /* tp_flags */
+		"Data of the NETCONF reply.", /* tp_doc */
+};
+
+/* data are taken over (and freed) in any case */
+static PyObject *reply_data_result(char *data, int raw)
+{
+	ncReplyDataObject *obj;
+	PyObject *result;
+
+	if (!raw) {
+		result = PyUnicode_FromString(data);
+		free(data);
+		return (result);
+	}
+
+	if ((obj = PyObject_New(ncReplyDataObject, &ncReplyDataType)) == NULL) {
+		free(data);
+		return (NULL);
+	}
+	obj->data = data;
+	obj->len = strlen(data);
+
+	result = PyMemoryView_FromObject((PyObject*)obj);
+	Py_DECREF(obj);
+
+	return (result);
+}
+
+/*
+ * The session can be used by several Python threads at once since the GIL
+ * is released during the network communication. Functions releasing the GIL
+ * must mark the session as busy, so it is not freed under their hands.
+ */
+static struct nc_session *session_acquire(ncSessionObject *self)
+{
+	self->busy++;
+	return (self->session);
+}
+
+static void session_release(ncSessionObject *self)
+{
+	if (--self->busy == 0 && self->closed != NULL) {
+		nc_session_free(self->closed);
+		self->closed = NULL;
+	}
+}
+
+static void session_close(ncSessionObject *self)
+{
+	if (self->session == NULL) {
+		return;
+	}
+
+	if (self->busy > 0 && self->closed == NULL) {
+		/* postpone to the session_release() of the last thread */
+		self->closed = self->session;
+	} else {
+		nc_session_free(self->session);
+	}
+	self->session = NULL;
+}
+
 static void ncSessionFree(ncSessionObject *self)
 {
 	PyObject *err_type, *err_value, *err_traceback;
@@ -29,6 +140,7 @@ static void ncSessionFree(ncSessionObject *self)
 	PyErr_Fetch(&err_type, &err_value, &err_traceback);
 
 	nc_session_free(self->session);
+	nc_session_free(self->closed);
 
 	/* restore the saved exception state */
 	PyErr_Restore(err_type, err_value, err_traceback);
@@ -40,16 +152,25 @@ static void ncSessionFree(ncSessionObject *self)
 static int op_send_recv(ncSessionObject *self, nc_rpc* rpc, char **data)
 {
 	nc_reply *reply = NULL;
+	struct nc_session *session;
+	NC_MSG_TYPE msgtype;
+	NC_SESSION_STATUS status;
 	int ret = EXIT_SUCCESS;
 
-	/* send the request and get the reply */
-	switch (nc_session_send_recv(self->session, rpc, &reply)) {
+	/* send the request and get the reply, let other threads run meanwhile */
+	session = session_acquire(self);
+	Py_BEGIN_ALLOW_THREADS
+	msgtype = nc_session_send_recv(session, rpc, &reply);
+	status = nc_session_get_status(session);
+	Py_END_ALLOW_THREADS
+	session_release(self);
+
+	switch (msgtype) {
 	case NC_MSG_UNKNOWN:
-		if (nc_session_get_status(self->session) != NC_SESSION_STATUS_WORKING) {
+		if (status != NC_SESSION_STATUS_WORKING && self->session == session) {
 			PyErr_SetString(libnetconfError, "Session damaged, closing.");
 			/* free the Session */
-			nc_session_free(self->session);
-			self->session = NULL;
+			session_close(self);
 		}
 		ret = EXIT_FAILURE;
 		break;
@@ -85,7 +206,7 @@ static int op_send_recv(ncSessionObject *self, nc_rpc* rpc, char **data)
 	return (ret);
 }
 
-static PyObject *get_common(ncSessionObject *self, const char *filter, int wdmode, int datastore)
+static PyObject *get_common(ncSessionObject *self, const char *filter, int wdmode, int datastore, int raw)
 {
 	char *data = NULL;
 	struct nc_filter *st_filter = NULL;
@@ -137,8 +258,7 @@ static PyObject *get_common(ncSessionObject *self, const char *filter, int wdmod
 	/* send request ... */
 	if (op_send_recv(self, rpc, &data) == EXIT_SUCCESS && data != NULL) {
 		/* ... and prepare the result */
-		result = PyUnicode_FromString(data);
-		free(data);
+		result = reply_data_result(data, raw);
 	}
 
 	return (result);
@@ -148,16 +268,17 @@ static PyObject *ncOpGet(ncSessionObject *self, PyObject *args, PyObject *keywor
 {
 	const char *filter = NULL;
 	int wdmode = NCWD_MODE_NOTSET;
-	char *kwlist[] = {"filter", "wd", NULL};
+	int raw = 0;
+	char *kwlist[] = {"filter", "wd", "raw", NULL};
 
 	SESSION_CHECK(self);
 
 	/* Get input parameters */
-	if (! PyArg_ParseTupleAndKeywords(args, keywords, "|zi", kwlist, &filter, &wdmode)) {
+	if (! PyArg_ParseTupleAndKeywords(args, keywords, "|zip", kwlist, &filter, &wdmode, &raw)) {
 		return (NULL);
 	}
 
-	return (get_common(self, filter, wdmode, NC_DATASTORE_ERROR));
+	return (get_common(self, filter, wdmode, NC_DATASTORE_ERROR, raw));
 }
 
 static PyObject *ncOpGetConfig(ncSessionObject *self, PyObject *args, PyObject *keywords)
@@ -165,12 +286,13 @@ static PyObject *ncOpGetConfig(ncSessionObject *self, PyObject *args, PyObject *
 	const char *filter = NULL;
 	int wdmode = NCWD_MODE_NOTSET;
 	int source = NC_DATASTORE_ERROR;
-	char *kwlist[] = {"source", "filter", "wd", NULL};
+	int raw = 0;
+	char *kwlist[] = {"source", "filter", "wd", "raw", NULL};
 
 	SESSION_CHECK(self);
 
 	/* Get input parameters */
-	if (! PyArg_ParseTupleAndKeywords(args, keywords, "i|zi", kwlist, &source, &filter, &wdmode)) {
+	if (! PyArg_ParseTupleAndKeywords(args, keywords, "i|zip", kwlist, &source, &filter, &wdmode, &raw)) {
 		return (NULL);
 	}
 
@@ -181,7 +303,7 @@ static PyObject *ncOpGetConfig(ncSessionObject *self, PyObject *args, PyObject *
 		return (NULL);
 	}
 
-	return (get_common(self, filter, wdmode, source));
+	return (get_common(self, filter, wdmode, source, raw));
 }
 
 static PyObject *ncOpDeleteConfig(ncSessionObject *self, PyObject *args, PyObject *keywords)
@@ -445,6 +567,135 @@ static PyObject *ncOpUnlock(ncSessionObject *self, PyObject *args, PyObject *key
 	return (lock_common(self, args, keywords, nc_rpc_unlock));
 }
 
+static PyObject *ncOpBatch(ncSessionObject *self, PyObject *args, PyObject *keywords)
+{
+	PyObject *PyRequests, *PySeq, *PyItem, *result = NULL;
+	Py_ssize_t count, i;
+	nc_rpc **rpcs = NULL;
+	nc_reply **replies = NULL;
+	NC_MSG_TYPE *msgtypes = NULL;
+	struct nc_session *session;
+	NC_SESSION_STATUS status;
+	const nc_msgid msgid;
+	const char *op;
+	char *data;
+	int raw = 0;
+	char *kwlist[] = {"requests", "raw", NULL};
+
+	SESSION_CHECK(self);
+
+	/* Get input parameters */
+	if (! PyArg_ParseTupleAndKeywords(args, keywords, "O|p", kwlist, &PyRequests, &raw)) {
+		return (NULL);
+	}
+	if ((PySeq = PySequence_Fast(PyRequests, "Requests argument is expected to be a list of strings.")) == NULL) {
+		return (NULL);
+	}
+	count = PySequence_Fast_GET_SIZE(PySeq);
+
+	rpcs = calloc(count + 1, sizeof *rpcs);
+	replies = calloc(count + 1, sizeof *replies);
+	msgtypes = calloc(count + 1, sizeof *msgtypes);
+	if (rpcs == NULL || replies == NULL || msgtypes == NULL) {
+		PyErr_NoMemory();
+		goto cleanup;
+	}
+
+	/* create all RPCs */
+	for (i = 0; i < count; i++) {
+		PyItem = PySequence_Fast_GET_ITEM(PySeq, i);
+		if (!PyUnicode_Check(PyItem)) {
+			PyErr_SetString(PyExc_TypeError, "Requests list must contain strings.");
+			goto cleanup;
+		}
+		if ((op = PyUnicode_AsUTF8(PyItem)) == NULL) {
+			goto cleanup;
+		}
+		if ((rpcs[i] = nc_rpc_generic(op)) == NULL) {
+			if (!PyErr_Occurred()) {
+				PyErr_SetString(PyExc_ValueError, "Invalid request.");
+			}
+			goto cleanup;
+		}
+	}
+
+	/*
+	 * pipeline the requests - send all of them first and then collect the
+	 * replies, all without holding the GIL
+	 */
+	session = session_acquire(self);
+	Py_BEGIN_ALLOW_THREADS
+	for (i = 0; i < count; i++) {
+		msgtypes[i] = (nc_session_send_rpc_async(session, rpcs[i]) == NULL) ? NC_MSG_UNKNOWN : NC_MSG_RPC;
+	}
+	for (i = 0; i < count; i++) {
+		if (msgtypes[i] == NC_MSG_RPC) {
+			msgid = nc_rpc_get_msgid(rpcs[i]);
+			msgtypes[i] = nc_session_recv_reply_async(session, msgid, -1, &replies[i]);
+		}
+	}
+	status = nc_session_get_status(session);
+	Py_END_ALLOW_THREADS
+	session_release(self);
+
+	if (status != NC_SESSION_STATUS_WORKING && self->session == session) {
+		PyErr_SetString(libnetconfError, "Session damaged, closing.");
+		session_close(self);
+		goto cleanup;
+	}
+
+	/* prepare the results */
+	result = PyList_New(count);
+	for (i = 0; result != NULL && i < count; i++) {
+		if (msgtypes[i] != NC_MSG_REPLY) {
+			Py_INCREF(Py_False);
+			PyItem = Py_False;
+		} else {
+			switch (nc_reply_get_type(replies[i])) {
+			case NC_REPLY_OK:
+				Py_INCREF(Py_True);
+				PyItem = Py_True;
+				break;
+			case NC_REPLY_DATA:
+				if ((data = nc_reply_get_data(replies[i])) != NULL) {
+					PyItem = reply_data_result(data, raw);
+				} else {
+					Py_INCREF(Py_None);
+					PyItem = Py_None;
+				}
+				break;
+			default:
+				Py_INCREF(Py_False);
+				PyItem = Py_False;
+				break;
+			}
+		}
+		if (PyItem == NULL) {
+			Py_CLEAR(result);
+			break;
+		}
+		PyList_SET_ITEM(result, i, PyItem);
+	}
+	if (result != NULL) {
+		/* failures of the particular requests are reported as False items */
+		PyErr_Clear();
+	}
+
+cleanup:
+	for (i = 0; rpcs != NULL && i < count; i++) {
+		nc_rpc_free(rpcs[i]);
+		if (replies != NULL) {
+			nc_reply_free(replies[i]);
+		}
+	}
+	free(rpcs);
+	free(replies);
+	free(msgtypes);
+	Py_DECREF(PySeq);
+
+	return (result);
+}
+
 static PyObject *ncProcessRPC(ncSessionObject *self)
 {
 	NC_MSG_TYPE ret;
@@ -453,20 +704,30 @@ static PyObject *ncProcessRPC(ncSessionObject *self)
 	nc_rpc *rpc = NULL;
 	nc_reply *reply = NULL;
 	struct nc_err* e = NULL;
+	struct nc_session *session;
+	NC_SESSION_STATUS status;
 
 	SESSION_CHECK(self);
 
-	/* receive incoming message */
-	ret = nc_session_recv_rpc(self->session, -1, &rpc);
+	/* receive incoming message, let other threads run while waiting */
+	session = session_acquire(self);
+	Py_BEGIN_ALLOW_THREADS
+	ret = nc_session_recv_rpc(session, -1, &rpc);
+	status = nc_session_get_status(session);
+	Py_END_ALLOW_THREADS
+	session_release(self);
 	if (ret != NC_MSG_RPC) {
-		if (nc_session_get_status(self->session) != NC_SESSION_STATUS_WORKING) {
+		if (status != NC_SESSION_STATUS_WORKING && self->session == session) {
 			/* something really bad happend, and communication is not possible anymore */
-			nc_session_free(self->session);
-			self->session = NULL;
+			session_close(self);
 		}
 		Py_RETURN_NONE;
 	}
 
+	/* the request processing does not touch any Python object */
+	session = session_acquire(self);
+	Py_BEGIN_ALLOW_THREADS
+
 	/* process it */
 	req_type = nc_rpc_get_type(rpc);
 	req_op = nc_rpc_get_op(rpc);
@@ -490,7 +751,7 @@ static PyObject *ncProcessRPC(ncSessionObject *self)
 		switch (req_op) {
 		case NC_OP_GET:
 		case NC_OP_GETCONFIG:
-			reply = ncds_apply_rpc2all(self->session, rpc,  NULL);
+			reply = ncds_apply_rpc2all(session, rpc,  NULL);
 			break;
 		default:
 			reply = nc_reply_error(nc_err_new(NC_ERR_OP_NOT_SUPPORTED));
@@ -504,7 +765,7 @@ static PyObject *ncProcessRPC(ncSessionObject *self)
 		case NC_OP_COPYCONFIG:
 		case NC_OP_DELETECONFIG:
 		case NC_OP_EDITCONFIG:
-			reply = ncds_apply_rpc2all(self->session, rpc, NULL);
+			reply = ncds_apply_rpc2all(session, rpc, NULL);
 			break;
 		default:
 			reply = nc_reply_error(nc_err_new(NC_ERR_OP_NOT_SUPPORTED));
@@ -512,7 +773,7 @@ static PyObject *ncProcessRPC(ncSessionObject *self)
 		}
 	} else {
 		/* process other operations */
-		reply = ncds_apply_rpc2all(self->session, rpc, NULL);
+		reply = ncds_apply_rpc2all(session, rpc, NULL);
 	}
 
 	/* create reply */
@@ -525,14 +786,15 @@ static PyObject *ncProcessRPC(ncSessionObject *self)
 	}
 
 	/* and send the reply to the client */
-	nc_session_send_reply(self->session, rpc, reply);
+	nc_session_send_reply(session, rpc, reply);
 	nc_rpc_free(rpc);
 	nc_reply_free(reply);
+	Py_END_ALLOW_THREADS
+	session_release(self);
 
-	if (req_op == NC_OP_CLOSESESSION) {
+	if (req_op == NC_OP_CLOSESESSION && self->session == session) {
 		/* free the Session */
-		nc_session_free(self->session);
-		self->session = NULL;
+		session_close(self);
 	}
 
 	Py_RETURN_NONE;
@@ -690,10 +952,19 @@ static int ncSessionInit(ncSessionObject *self, PyObject *args, PyObject *keywor
 	if (cpblts == NULL) {
 		/* use global capabilities, that are, by default, same as libnetconf's
 		 * default capabilities
+		 * - work with a copy, the global list can be changed by another
+		 * thread while the GIL is released
 		 */
-		cpblts = global_cpblts;
+		cpblts = nc_cpblts_new(NULL);
+		cpblts_free_flag = 1;
+		nc_cpblts_iter_start(global_cpblts);
+		while ((item = (char*) nc_cpblts_iter_next(global_cpblts)) != NULL) {
+			nc_cpblts_add(cpblts, item);
+		}
 	}
 
+	/* do not block other threads during the connection and handshake */
+	Py_BEGIN_ALLOW_THREADS
 	if (host != NULL) {
 		/* Client side */
 		if (fd_in != -1 && fd_out != -1) {
@@ -711,6 +982,7 @@ static int ncSessionInit(ncSessionObject *self, PyObject *args, PyObject *keywor
 		/* add to the list of monitored sessions */
 		nc_session_monitor(session);
 	}
+	Py_END_ALLOW_THREADS
 
 	if (cpblts_free_flag) {
 		nc_cpblts_free(cpblts);
@@ -720,7 +992,7 @@ static int ncSessionInit(ncSessionObject *self, PyObject *args, PyObject *keywor
 		return -1;
 	}
 
-	nc_session_free(self->session);
+	session_close(self);
 	self->session = session;
 
 	return 0;
@@ -835,10 +1107,10 @@ static PyMethodDef ncSessionMethods[] = {
 		PyDoc_STR("Create NETCONF session accepting connection from a NETCONF client.")},
 	{"get", (PyCFunction)ncOpGet,
 		METH_VARARGS | METH_KEYWORDS,
-		PyDoc_STR("Execute NETCONF <get> RPC.")},
+		PyDoc_STR("Execute NETCONF <get> RPC. With raw set, the data are returned as memoryview.")},
 	{"getConfig", (PyCFunction)ncOpGetConfig,
 		METH_VARARGS | METH_KEYWORDS,
-		PyDoc_STR("Execute NETCONF <get-config> RPC.")},
+		PyDoc_STR("Execute NETCONF <get-config> RPC. With raw set, the data are returned as memoryview.")},
 	{"lock", (PyCFunction)ncOpLock,
 		METH_VARARGS | METH_KEYWORDS,
 		PyDoc_STR("Execute NETCONF <lock> RPC.")},
@@ -857,6 +1129,12 @@ static PyMethodDef ncSessionMethods[] = {
 	{"killSession", (PyCFunction)ncOpKillSession,
 		METH_VARARGS | METH_KEYWORDS,
 		PyDoc_STR("Execute NETCONF <kill-session> RPC.")},
+	{"batch", (PyCFunction)ncOpBatch,
+		METH_VARARGS | METH_KEYWORDS,
+		PyDoc_STR("batch(requests, raw=False) -> list\n\n"
+				"Send all the NETCONF operations (XML strings) from the requests list at once and\n"
+				"then collect their replies. The result contains data (memoryview if raw is set),\n"
+				"True or False for each request.")},
 	{"processRequest", (PyCFunction)ncProcessRPC,
 		METH_NOARGS,
 		PyDoc_STR("Process a client request.")},
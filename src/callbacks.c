@@ -77,6 +77,7 @@ static int callback_ssh_hostkey_check_default (const char* hostname, ssh_session
 struct callbacks callbacks = {
 		NULL, /* message printing callback */
 		NULL, /* process_error_reply callback */
+		NULL, /* rpc_trace callback */
 #ifndef DISABLE_LIBSSH
 		callback_sshauth_interactive_default, /* default keyboard_interactive callback */
 		callback_sshauth_password_default, /* default password callback */
@@ -107,6 +108,11 @@ API void nc_callback_error_reply(void (*func)(const char* tag,
 	callbacks.process_error_reply = func;
 }
 
+API void nc_callback_rpc_trace(void (*func)(const struct nc_rpc_trace* trace))
+{
+	callbacks.rpc_trace = func;
+}
+
 #ifndef DISABLE_LIBSSH
 API void nc_callback_sshauth_interactive(char* (*func)(const char* name,
 		const char* instruction,
@@ -87,6 +87,60 @@ void nc_callback_error_reply(void (*func)(const char* tag,
 		const char* ns,
 		const char* sid));
 
+/**
+ * @brief Processing phases of a NETCONF RPC measured by the RPC tracing.
+ * @ingroup genAPI
+ */
+typedef enum {
+	NC_TRACE_RECEIVE, /**< reading the message from the transport and its framing, with the chunked framing (NETCONF 1.1) it includes also the XML parsing done chunk by chunk */
+	NC_TRACE_PARSE, /**< XML parsing of the whole message (NETCONF 1.0) and recognizing the message type and message-id */
+	NC_TRACE_NACM, /**< NACM initialization of the request and the operation access check */
+	NC_TRACE_EDIT, /**< applying the edit-config content to the datastore data */
+	NC_TRACE_VALIDATE, /**< validation of the datastore content */
+	NC_TRACE_TRANSAPI, /**< TransAPI callbacks reflecting the changes of the running datastore */
+	NC_TRACE_SYNC, /**< writing the modified file datastore to the disk */
+	NC_TRACE_REPLY, /**< serialization and sending of the \<rpc-reply\> */
+	NC_TRACE_PHASES /**< number of the phases, not a phase */
+} NC_TRACE_PHASE;
+
+/**
+ * @brief Latency breakdown of a single RPC processed by the server.
+ * @ingroup genAPI
+ *
+ * All the times are in nanoseconds of CLOCK_MONOTONIC. A phase entered
+ * repeatedly (e.g. validation of several datastores) is summed up, phases not
+ * entered are 0. The difference between the total and the sum of the phases
+ * is the time spent by the server application itself (and by the datastore
+ * operations without their own phase).
+ */
+struct nc_rpc_trace {
+	const char* session_id; /**< ID of the session which received the RPC */
+	const char* msgid; /**< message-id of the RPC, NULL if missing */
+	NC_OP op; /**< NETCONF operation of the RPC */
+	uint64_t start; /**< time when the data of the RPC started to be read */
+	uint64_t total; /**< time since the start until the reply was sent */
+	uint64_t phases[NC_TRACE_PHASES]; /**< time spent in the particular phases, indexed by NC_TRACE_PHASE */
+};
+
+/**
+ * @brief Set a callback function receiving the latency breakdown of the
+ * processed RPCs.
+ * @ingroup genAPI
+ *
+ * The callback is called on the server side from nc_session_send_reply() when
+ * the reply to the RPC received by nc_session_recv_rpc() is sent. The
+ * structure is valid only during the callback. If no callback is set, the RPCs
+ * are not traced (unless libnetconf is compiled with ENABLE_USDT, then the
+ * same information is provided by the libnetconf:rpc_phase and
+ * libnetconf:rpc_done USDT probes).
+ *
+ * If the func parameter is NULL, the callback is set back to the default (no)
+ * function.
+ *
+ * @param[in] func Callback function to use.
+ */
+void nc_callback_rpc_trace(void (*func)(const struct nc_rpc_trace* trace));
+
 #ifdef __cplusplus
 }
 #endif
@@ -184,17 +184,25 @@ struct nc_session* nc_callhome_accept(const char *username, const struct nc_cpbl
  * a connection is established, then the function returns. It's up to the caller
  * to reconnect if the session goes down. It can be detected using returned PID.
  *
+ * All the management servers (and all their addresses of both IPv4 and IPv6
+ * families) are tried concurrently - the connection attempts are started
+ * shortly one after another in the order of the list and the first established
+ * connection is used, so an unreachable server does not delay the connection
+ * to the others.
+ *
  * To make this function available, you have to include libnetconf_ssh.h or
  * libnetconf_tls.h.
  *
  * @param[in] host_list List of management servers descriptions where the
  * function will try to connect to.
- * @param[in] reconnect_secs Time delay in seconds between connection attempts
- * (even to the same server but it depends on reconnect_count). See
+ * @param[in] reconnect_secs Time in seconds for a round of the connection
+ * attempts to all the servers, the next round starts after it. 0 to wait for
+ * the result of all the attempts of the round. See
  * /netconf/ssh/call-home/applications/application/reconnect-strategy/interval-secs
  * value in ietf-netconf-server YANG data model.
- * @param[in] reconnect_count Number times the function tries to connect to a
- * single server before moving on to the next server in the host_list. See
+ * @param[in] reconnect_count Number of rounds of the connection attempts. If
+ * the host_list is a ring list, the function tries to connect until it
+ * succeeds. See
  * /netconf/ssh/call-home/applications/application/reconnect-strategy/count-max
  * value in ietf-netconf-server YANG data model.
  * @param[in] server_path Optional parameter to specify path to the transport server.
@@ -50,6 +50,8 @@
 #include <dlfcn.h>
 #include <dirent.h>
 #include <stdio.h>
+#include <time.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -81,6 +83,7 @@
 #include "datastore/edit_config.h"
 #include "datastore/datastore_internal.h"
 #include "datastore/file/datastore_file.h"
+#include "datastore/kv/datastore_kv.h"
 #include "datastore/empty/datastore_empty.h"
 #include "datastore/custom/datastore_custom_private.h"
 #include "transapi/transapi_internal.h"
@@ -118,7 +121,8 @@ extern struct nc_shared_info *nc_info;
 API char error_area;
 #define ERROR_POINTER ((void*)(&error_area))
 
-char* server_capabilities = NULL;
+/* capabilities of the session performing <get>, see get_state_monitoring() */
+static struct nc_cpblts* server_cpblts = NULL;
 
 struct ncds_ds_list {
 	struct ncds_ds *datastore;
@@ -140,10 +144,15 @@ struct ncds {
 struct ncds_ds *nacm_ds = NULL; /* for NACM subsystem */
 static struct ncds ncds = {NULL, NULL, 0, 0};
 static struct model_list *models_list = NULL;
+static unsigned int models_version = 0; /* changed whenever models_list changes */
 static struct transapi_list* augment_tapi_list = NULL;
 static char** models_dirs = NULL;
+static char* models_cache_dir = NULL;
 
 static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, const nc_rpc* rpc);
+static void ncds_ds_prepare(struct ncds_ds* ds);
+static xmlDocPtr read_datastore_data(ncds_id id, const char *data);
+static void candidate_changes_reset(struct ncds_ds* ds, int valid);
 static char* get_state_nacm(const char* UNUSED(model), const char* UNUSED(running), struct nc_err ** UNUSED(e));
 static char* get_state_monitoring(const char* UNUSED(model), const char* UNUSED(running), struct nc_err ** UNUSED(e));
 static int get_model_info(xmlXPathContextPtr model_ctxt, char **name, char **version, char **ns, char **prefix, char ***rpcs, char ***notifs);
@@ -153,6 +162,7 @@ static int ncds_update_uses_groupings(struct data_model* model);
 static int ncds_update_uses_augments(struct data_model* model);
 static void ncds_ds_model_free(struct data_model* model);
 static xmlDocPtr ncxml_merge(const xmlDocPtr first, const xmlDocPtr second, const xmlDocPtr data_model);
+static void models_index_cleanup(void);
 extern int first_after_close;
 
 #ifndef DISABLE_NOTIFICATIONS
@@ -160,6 +170,7 @@ static char* get_state_notifications(const char* UNUSED(model), const char* UNUS
 #endif
 
 static struct ncds_ds *datastores_get_ds(ncds_id id);
+static int state_filter_selects(const char* ns, const char* top, const char* child);
 
 #ifndef DISABLE_YANGFORMAT
 /* XSL stylesheet for transformation from YIN to YANG format */
@@ -202,10 +213,29 @@ static struct ncds_ds* ncds_fill_func(NCDS_TYPE type)
 		ds->func.lock = ncds_file_lock;
 		ds->func.unlock = ncds_file_unlock;
 		ds->func.getconfig = ncds_file_getconfig;
+		ds->func.getconfig_xml = ncds_file_getconfig_xml;
 		ds->func.copyconfig = ncds_file_copyconfig;
 		ds->func.deleteconfig = ncds_file_deleteconfig;
 		ds->func.editconfig = ncds_file_editconfig;
 		break;
+	case NCDS_TYPE_KV:
+		if ((ds = (struct ncds_ds*) calloc(1, sizeof(struct ncds_ds_kv))) == NULL ) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (NULL );
+		}
+		ds->func.init = ncds_kv_init;
+		ds->func.free = ncds_kv_free;
+		ds->func.was_changed = ncds_kv_changed;
+		ds->func.rollback = ncds_kv_rollback;
+		ds->func.get_lockinfo = ncds_kv_lockinfo;
+		ds->func.lock = ncds_kv_lock;
+		ds->func.unlock = ncds_kv_unlock;
+		ds->func.getconfig = ncds_kv_getconfig;
+		ds->func.getconfig_xml = ncds_kv_getconfig_xml;
+		ds->func.copyconfig = ncds_kv_copyconfig;
+		ds->func.deleteconfig = ncds_kv_deleteconfig;
+		ds->func.editconfig = ncds_kv_editconfig;
+		break;
 	case NCDS_TYPE_EMPTY:
 		if ((ds = (struct ncds_ds*) calloc(1, sizeof(struct ncds_ds_empty))) == NULL ) {
 			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
@@ -437,6 +467,7 @@ int ncds_sysinit(int flags)
 		list_item->model = ds->data_model;
 		list_item->next = models_list;
 		models_list = list_item;
+		models_version++;
 
 #ifndef DISABLE_VALIDATION
 		/* set validation */
@@ -689,6 +720,21 @@ static int fmon_backup_file(const char* source)
 }
 
 #define INOT_BUFLEN (10 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+/*
+ * Debounce window (in milliseconds) - a modified file is synchronized only
+ * after no other event on the monitored files came for this time, so bursts
+ * of writes are coalesced into a single update. To avoid starving on files
+ * rewritten continuously, pending updates are processed at latest after
+ * NC_FMON_DEBOUNCE_MAX milliseconds since the first of the coalesced events.
+ */
+#ifndef NC_FMON_DEBOUNCE
+#  define NC_FMON_DEBOUNCE 200
+#endif
+#ifndef NC_FMON_DEBOUNCE_MAX
+#  define NC_FMON_DEBOUNCE_MAX (10 * NC_FMON_DEBOUNCE)
+#endif
+
 struct fmon {
 	int wd;
 	char flags;
@@ -701,26 +747,203 @@ struct fmon_arg {
 	struct transapi_file_callbacks *fclbks;
 	struct ncds_ds *ds;
 };
+
+static long long fmon_time_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((long long)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/**
+ * @brief Remove top-level subtrees of the configuration data produced by a
+ * FMON callback which are identical to the current content of the running
+ * datastore.
+ *
+ * @param[in] ds Datastore to compare with.
+ * @param[in] config Configuration data root (the \<config\> element).
+ * @param[in] buf Auxiliary buffer for serializing the subtrees.
+ * @return Number of the remaining (changed) subtrees, -1 when the running
+ * datastore cannot be read and thus nothing was removed.
+ */
+static int fmon_prune_unchanged(struct ncds_ds *ds, xmlNodePtr config, xmlBufferPtr buf)
+{
+	char *data, **running_dump = NULL;
+	xmlDocPtr running;
+	xmlNodePtr node, next;
+	struct nc_err *err = NULL;
+	int count = 0, i, dumps = 0, changed = 0;
+
+	if ((data = ds->func.getconfig(ds, NULL, NC_DATASTORE_RUNNING, &err)) == NULL) {
+		nc_err_free(err);
+		return (-1);
+	}
+	running = read_datastore_data(ds->id, data);
+	free(data);
+	if (running == NULL) {
+		return (-1);
+	}
+
+	/* serialize current top-level subtrees of the running datastore */
+	for (node = running->children; node != NULL; node = node->next) {
+		count++;
+	}
+	if (count) {
+		running_dump = malloc(count * sizeof(char*));
+		for (node = running->children; node != NULL && running_dump != NULL; node = node->next) {
+			xmlNodeDump(buf, running, node, 0, 0);
+			running_dump[dumps++] = strdup((char*)xmlBufferContent(buf));
+			xmlBufferEmpty(buf);
+		}
+	}
+	xmlFreeDoc(running);
+
+	for (node = config->children; node != NULL; node = next) {
+		next = node->next;
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		xmlNodeDump(buf, node->doc, node, 0, 0);
+		for (i = 0; i < dumps; i++) {
+			if (running_dump[i] != NULL && strcmp(running_dump[i], (char*)xmlBufferContent(buf)) == 0) {
+				break;
+			}
+		}
+		xmlBufferEmpty(buf);
+
+		if (i < dumps) {
+			/* the subtree is not changed, do not apply it again */
+			xmlUnlinkNode(node);
+			xmlFreeNode(node);
+		} else {
+			changed++;
+		}
+	}
+
+	for (i = 0; i < dumps; i++) {
+		free(running_dump[i]);
+	}
+	free(running_dump);
+
+	return (changed);
+}
+
+/**
+ * @brief Synchronize the running datastore with the monitored file after its
+ * (coalesced) modifications.
+ */
+static void fmon_update(struct ncds_ds *ds, struct transapi_file_callbacks *fclbks, int i, struct fmon *wds, struct nc_session* dummy_session, xmlBufferPtr running_buf)
+{
+	char* config;
+	xmlDocPtr config_doc = NULL;
+	xmlNodePtr node;
+	struct nc_err *err = NULL;
+	int execflag = 0, ret;
+	nc_rpc* rpc;
+	nc_reply *reply;
+	const struct ncds_lockinfo *lockinfo;
+
+	if (wds[i].flags & FMON_FLAG_IGNORED) {
+		/* ignore our own backup restore */
+		wds[i].flags = 0;
+		return;
+	}
+	wds[i].flags = 0;
+
+	/* check that datastore is not locked */
+	lockinfo = ds->func.get_lockinfo(ds, NC_DATASTORE_RUNNING);
+	if (lockinfo && lockinfo->sid) {
+		VERB("FMON: Running datastore is locked by \"%s\"", lockinfo->sid);
+		WARN("FMON: Replacing changed \"%s\" with the backup file.", fclbks->callbacks[i].path);
+
+		/* note that next update notification of this file should be ignored */
+		wds[i].flags = FMON_FLAG_IGNORED;
+
+		/* restore original content */
+		fmon_restore_file(fclbks->callbacks[i].path);
+		return;
+	}
+
+	fclbks->callbacks[i].func(fclbks->callbacks[i].path, &config_doc, &execflag);
+	if (config_doc == NULL) {
+		return;
+	}
+
+	/* check returned data format */
+	if (config_doc->children == NULL) {
+		ERROR("Invalid configuration data returned from transAPI FMON callback.");
+		xmlFreeDoc(config_doc);
+		return;
+	}
+
+	/* apply only the subtrees differing from the running datastore */
+	if (fmon_prune_unchanged(ds, config_doc->children, running_buf) == 0) {
+		VERB("FMON: Changes of \"%s\" do not affect the running datastore.", fclbks->callbacks[i].path);
+		xmlFreeDoc(config_doc);
+		fmon_backup_file(fclbks->callbacks[i].path);
+		return;
+	}
+
+	/* perform changes in datastore (and on device if set so) */
+	if (execflag) {
+		/* update running datastore including execution of the transAPI callbacks */
+		rpc = ncxml_rpc_editconfig(NC_DATASTORE_RUNNING,
+				NC_DATASTORE_CONFIG, NC_EDIT_DEFOP_NOTSET,
+				NC_EDIT_ERROPT_ROLLBACK, NC_EDIT_TESTOPT_NOTSET,
+				config_doc->children->children);
+		xmlFreeDoc(config_doc);
+		if (rpc == NULL) {
+			ERROR("FMON: Preparing edit-config RPC failed.");
+			return;
+		}
+
+		reply = ncds_apply_rpc2all(dummy_session, rpc, NULL);
+		nc_rpc_free(rpc);
+		if (reply == NULL || nc_reply_get_type(reply) != NC_REPLY_OK) {
+			ERROR("FMON: Performing edit-config RPC failed.");
+		}
+		nc_reply_free(reply);
+
+	} else {
+		/* do not execute transAPI callbacks, only update running datastore */
+		for (node = config_doc->children; node != NULL; node = node->next) {
+			xmlNodeDump(running_buf, config_doc, node, 0, 0);
+		}
+		xmlFreeDoc(config_doc);
+		config = strdup((char*)xmlBufferContent(running_buf));
+		xmlBufferEmpty(running_buf);
+
+		ret = ds->func.editconfig(ds, NULL, NULL,
+				NC_DATASTORE_RUNNING, config,
+				NC_EDIT_DEFOP_NOTSET, NC_EDIT_ERROPT_ROLLBACK, &err);
+		free(config);
+
+		if (ret != 0 && ret != EXIT_RPC_NOT_APPLICABLE) {
+			ERROR("Failed to update running configuration (%s).", err ? err->message : "unknown error");
+			nc_err_free(err);
+		}
+	}
+
+	/* update backup file */
+	fmon_backup_file(fclbks->callbacks[i].path);
+}
+
 static void* transapi_fmon(void *arg)
 {
 	struct fmon_arg *fmon_arg = (struct fmon_arg*)arg;
 	struct transapi_file_callbacks *fclbks = fmon_arg->fclbks;
 	struct ncds_ds *ds = fmon_arg->ds;
-	int inotify, i, r, ret;
+	int inotify, i, r, timeout;
+	long long first = 0, last = 0, now;
 	struct fmon *wds;
 	char buf[INOT_BUFLEN], *p;
 	struct inotify_event *e;
-	char* config;
-	xmlDocPtr config_doc;
-	xmlNodePtr node;
+	struct pollfd fds;
 	xmlBufferPtr running_buf = NULL;
-	struct nc_err *err;
-	int execflag;
 	struct nc_session* dummy_session;
-	nc_rpc* rpc;
-	nc_reply *reply;
 	struct nc_cpblts* cpblts;
-	const struct ncds_lockinfo *lockinfo;
 
 	/* note thread creator that we stored passed arguments and the original
 	 * fmon_arg structure can be rewritten.
@@ -752,17 +975,55 @@ static void* transapi_fmon(void *arg)
 		wds[i].flags = 0;
 	}
 
+	fds.fd = inotify;
+	fds.events = POLLIN;
 	for (;;) {
+		/* wait for events, with pending updates only until the debounce window expires */
+		if (first) {
+			now = fmon_time_ms();
+			timeout = (int)(last + NC_FMON_DEBOUNCE - now);
+			if (first + NC_FMON_DEBOUNCE_MAX - now < timeout) {
+				timeout = (int)(first + NC_FMON_DEBOUNCE_MAX - now);
+			}
+			if (timeout < 0) {
+				timeout = 0;
+			}
+		} else {
+			timeout = -1;
+		}
+
+		fds.revents = 0;
+		r = poll(&fds, 1, timeout);
+		if (r == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ERROR("Inotify failed (%s).", strerror(errno));
+			break;
+		} else if (r == 0) {
+			/* debounce window expired, process all the coalesced changes */
+			first = last = 0;
+			for (i = 0; i < fclbks->callbacks_count; i++) {
+				if (wds[i].flags & FMON_FLAG_UPDATE) {
+					fmon_update(ds, fclbks, i, wds, dummy_session, running_buf);
+				}
+			}
+			continue;
+		}
+
 		r = read(inotify, buf, INOT_BUFLEN);
 		if (r == 0) {
 			ERROR("Inotify failed (EOF).");
 			break;
 		} else if (r == -1) {
+			if (errno == EINTR || errno == EAGAIN) {
+				continue;
+			}
 			ERROR("Inotify failed (%s).", strerror(errno));
 			break;
 		}
 
-		for (p = buf; p < buf + r;) {
+		for (p = buf; p < buf + r; p += sizeof(struct inotify_event) + e->len) {
 			e = (struct inotify_event*)p;
 
 			/* get index of the modified file */
@@ -771,6 +1032,10 @@ static void* transapi_fmon(void *arg)
 					break;
 				}
 			}
+			if (i == fclbks->callbacks_count) {
+				/* event of an already removed watch */
+				continue;
+			}
 
 			if (e->mask & IN_IGNORED) {
 				/* the file was removed or replaced */
@@ -782,6 +1047,8 @@ static void* transapi_fmon(void *arg)
 						/* the file was replaced, but we cannot access the new file */
 						ERROR("Unable to continue in monitoring \"%s\" file (%s)", fclbks->callbacks[i].path, strerror(errno));
 					}
+					/* nothing to synchronize from */
+					wds[i].flags &= ~(FMON_FLAG_MODIFIED | FMON_FLAG_UPDATE);
 				} else {
 					/* file was replaced and we now monitor the newly created file */
 					/* set its modified flag to 2 to execute callback */
@@ -796,92 +1063,13 @@ static void* transapi_fmon(void *arg)
 				}
 			}
 
-			if (wds[i].flags & FMON_FLAG_UPDATE) {
-
-				if (wds[i].flags & FMON_FLAG_IGNORED) {
-					/* ignore our own backup restore */
-					wds[i].flags = 0;
-					goto next_event;
-				}
-
-				/* null the variables */
-				wds[i].flags = 0;
-				config_doc = NULL;
-				execflag = 0;
-
-				/* check that datastore is not locked */
-				lockinfo = ds->func.get_lockinfo(ds, NC_DATASTORE_RUNNING);
-				if (lockinfo && lockinfo->sid) {
-					VERB("FMON: Running datastore is locked by \"%s\"", lockinfo->sid);
-					WARN("FMON: Replacing changed \"%s\" with the backup file.", fclbks->callbacks[i].path);
-
-					/* note that next update notification of this file should be ignored */
-					wds[i].flags = FMON_FLAG_IGNORED;
-
-					/* restore original content */
-					fmon_restore_file(fclbks->callbacks[i].path);
-
-					goto next_event;
-				}
-
-				fclbks->callbacks[i].func(fclbks->callbacks[i].path, &config_doc, &execflag);
-				if (config_doc != NULL) {
-					/*
-					 * store running to the datastore
-					 */
-
-					/* check returned data format */
-					if (config_doc->children == NULL) {
-						ERROR("Invalid configuration data returned from transAPI FMON callback.");
-						goto next_event;
-					}
-
-					/* perform changes in datastore (and on device if set so) */
-					if (execflag) {
-						/* update running datastore including execution of the transAPI callbacks */
-						rpc = ncxml_rpc_editconfig(NC_DATASTORE_RUNNING,
-								NC_DATASTORE_CONFIG, NC_EDIT_DEFOP_NOTSET,
-								NC_EDIT_ERROPT_ROLLBACK, NC_EDIT_TESTOPT_NOTSET,
-								config_doc->children->children);
-						xmlFreeDoc(config_doc);
-						if (rpc == NULL) {
-							ERROR("FMON: Preparing edit-config RPC failed.");
-							goto next_event;
-						}
-
-						reply = ncds_apply_rpc2all(dummy_session, rpc, NULL);
-						nc_rpc_free(rpc);
-						if (reply == NULL || nc_reply_get_type(reply) != NC_REPLY_OK) {
-							ERROR("FMON: Performing edit-config RPC failed.");
-						}
-						nc_reply_free(reply);
-
-					} else {
-						/* do not execute transAPI callbacks, only update running datastore */
-						for (node = config_doc->children; node != NULL; node = node->next) {
-							xmlNodeDump(running_buf, config_doc, node, 0, 0);
-						}
-						xmlFreeDoc(config_doc);
-						config = strdup((char*)xmlBufferContent(running_buf));
-						xmlBufferEmpty(running_buf);
-
-						ret = ds->func.editconfig(ds, NULL, NULL,
-								NC_DATASTORE_RUNNING, config,
-								NC_EDIT_DEFOP_NOTSET, NC_EDIT_ERROPT_ROLLBACK, &err);
-						free(config);
-
-						if (ret != 0 && ret != EXIT_RPC_NOT_APPLICABLE) {
-							ERROR("Failed to update running configuration (%s).", err ? err->message : "unknown error");
-							nc_err_free(err);
-						}
-					}
-
-					/* update backup file */
-					fmon_backup_file(fclbks->callbacks[i].path);
+			/* (re)start the debounce window */
+			if (wds[i].flags & (FMON_FLAG_MODIFIED | FMON_FLAG_UPDATE)) {
+				last = fmon_time_ms();
+				if (!first) {
+					first = last;
 				}
 			}
-next_event:
-			p += sizeof(struct inotify_event) + e->len;
 		}
 	}
 
@@ -1135,7 +1323,7 @@ static int get_model_info(xmlXPathContextPtr model_ctxt, char **name, char **ver
 
 	/* get name of the schema */
 	if (name != NULL ) {
-		result = xmlXPathEvalExpression (BAD_CAST "/yin:module", model_ctxt);
+		result = nc_xpath_eval("/yin:module", model_ctxt);
 		if (result != NULL ) {
 			if (result->nodesetval->nodeNr < 1) {
 				xmlXPathFreeObject (result);
@@ -1152,7 +1340,7 @@ static int get_model_info(xmlXPathContextPtr model_ctxt, char **name, char **ver
 
 	/* get version */
 	if (version != NULL ) {
-		result = xmlXPathEvalExpression (BAD_CAST "/yin:module/yin:revision", model_ctxt);
+		result = nc_xpath_eval("/yin:module/yin:revision", model_ctxt);
 		if (result != NULL ) {
 			if (result->nodesetval->nodeNr < 1) {
 				*version = strdup("");
@@ -1192,7 +1380,7 @@ static int get_model_info(xmlXPathContextPtr model_ctxt, char **name, char **ver
 
 	/* get namespace of the schema */
 	if (ns != NULL ) {
-		result = xmlXPathEvalExpression (BAD_CAST "/yin:module/yin:namespace", model_ctxt);
+		result = nc_xpath_eval("/yin:module/yin:namespace", model_ctxt);
 		if (result != NULL ) {
 			if (result->nodesetval->nodeNr < 1) {
 				xmlXPathFreeObject (result);
@@ -1209,7 +1397,7 @@ static int get_model_info(xmlXPathContextPtr model_ctxt, char **name, char **ver
 
 	/* get prefix of the schema */
 	if (ns != NULL ) {
-		result = xmlXPathEvalExpression (BAD_CAST "/yin:module/yin:prefix", model_ctxt);
+		result = nc_xpath_eval("/yin:module/yin:prefix", model_ctxt);
 		if (result != NULL ) {
 			if (result->nodesetval->nodeNr < 1) {
 				*prefix = strdup("");
@@ -1224,7 +1412,7 @@ static int get_model_info(xmlXPathContextPtr model_ctxt, char **name, char **ver
 	}
 
 	if (rpcs != NULL ) {
-		result = xmlXPathEvalExpression (BAD_CAST "/yin:module/yin:rpc", model_ctxt);
+		result = nc_xpath_eval("/yin:module/yin:rpc", model_ctxt);
 		if (result != NULL ) {
 			if (!xmlXPathNodeSetIsEmpty(result->nodesetval)) {
 				*rpcs = malloc((result->nodesetval->nodeNr + 1) * sizeof(char*));
@@ -1246,7 +1434,7 @@ static int get_model_info(xmlXPathContextPtr model_ctxt, char **name, char **ver
 	}
 
 	if (notifs != NULL ) {
-		result = xmlXPathEvalExpression (BAD_CAST "/yin:module/yin:notification", model_ctxt);
+		result = nc_xpath_eval("/yin:module/yin:notification", model_ctxt);
 		if (result != NULL ) {
 			if (!xmlXPathNodeSetIsEmpty(result->nodesetval)) {
 				*notifs = malloc((result->nodesetval->nodeNr + 1) * sizeof(char*));
@@ -1298,6 +1486,11 @@ errorcleanup:
 	return (EXIT_FAILURE);
 }
 
+unsigned int ncds_models_version(void)
+{
+	return (models_version);
+}
+
 /* used in ssh.c and session.c */
 char** get_schemas_capabilities(struct nc_cpblts *cpblts)
 {
@@ -1398,7 +1591,12 @@ static char* get_schemas_str(const char* name, const char* version, const char*
 	return (retval);
 }
 
-static char* get_schemas(void)
+/* pre-rendered <schemas> element of the netconf-state, see get_schemas() */
+static pthread_mutex_t schemas_mut = PTHREAD_MUTEX_INITIALIZER;
+static char* schemas_cache = NULL;
+static unsigned int schemas_version = 0;
+
+static char* get_schemas_render(void)
 {
 	char *schema = NULL, *schemas = NULL, *aux = NULL;
 	struct model_list* listitem;
@@ -1434,6 +1632,28 @@ static char* get_schemas(void)
 	return (schemas);
 }
 
+/*
+ * @brief Get the <schemas> element, it is rendered again only when the list
+ * of models changes.
+ */
+static char* get_schemas(void)
+{
+	char* retval = NULL;
+
+	pthread_mutex_lock(&schemas_mut);
+	if (schemas_cache == NULL || schemas_version != models_version) {
+		free(schemas_cache);
+		schemas_cache = get_schemas_render();
+		schemas_version = models_version;
+	}
+	if (schemas_cache != NULL) {
+		retval = strdup(schemas_cache);
+	}
+	pthread_mutex_unlock(&schemas_mut);
+
+	return (retval);
+}
+
 #ifndef DISABLE_NOTIFICATIONS
 static char* get_state_notifications(const char* UNUSED(model), const char* UNUSED(running), struct nc_err ** UNUSED(e))
 {
@@ -1454,16 +1674,26 @@ static char* get_state_notifications(const char* UNUSED(model), const char* UNUS
 static char* get_state_monitoring(const char* UNUSED(model), const char* UNUSED(running), struct nc_err** UNUSED(e))
 {
 	char *schemas = NULL, *sessions = NULL, *retval = NULL, *ds_stats = NULL, *ds_startup = NULL, *ds_cand = NULL, *stats = NULL, *aux = NULL;
+	const char *cpblts = NULL;
 	struct ncds_ds_list* ds = NULL;
 	const struct ncds_lockinfo *info;
 
+	/*
+	 * capabilities
+	 */
+	if (state_filter_selects(NC_NS_MONITORING, "netconf-state", "capabilities")) {
+		cpblts = nc_cpblts_xml(server_cpblts);
+	}
+
 	/*
 	 * datastores
 	 */
 	/* find non-empty datastore implementation */
-	for (ds = ncds.datastores; ds != NULL ; ds = ds->next) {
-		if (ds->datastore && ds->datastore->type == NCDS_TYPE_FILE) {
-			break;
+	if (state_filter_selects(NC_NS_MONITORING, "netconf-state", "datastores")) {
+		for (ds = ncds.datastores; ds != NULL ; ds = ds->next) {
+			if (ds->datastore && ds->datastore->type == NCDS_TYPE_FILE) {
+				break;
+			}
 		}
 	}
 
@@ -1526,18 +1756,21 @@ static char* get_state_monitoring(const char* UNUSED(model), const char* UNUSED(
 	/*
 	 * schemas
 	 */
-	schemas = get_schemas();
+	if (state_filter_selects(NC_NS_MONITORING, "netconf-state", "schemas")) {
+		schemas = get_schemas();
+	}
 
 	/*
 	 * sessions
 	 */
-	sessions = nc_session_stats();
+	if (state_filter_selects(NC_NS_MONITORING, "netconf-state", "sessions")) {
+		sessions = nc_session_stats();
+	}
 
 	/*
 	 * statistics
 	 */
-	if (nc_info != NULL) {
-		pthread_rwlock_rdlock(&(nc_info->lock));
+	if (nc_info != NULL && state_filter_selects(NC_NS_MONITORING, "netconf-state", "statistics")) {
 		if (asprintf(&stats, "<statistics><netconf-start-time>%s</netconf-start-time>"
 				"<in-bad-hellos>%u</in-bad-hellos>"
 				"<in-sessions>%u</in-sessions>"
@@ -1547,22 +1780,21 @@ static char* get_state_monitoring(const char* UNUSED(model), const char* UNUSED(
 				"<out-rpc-errors>%u</out-rpc-errors>"
 				"<out-notifications>%u</out-notifications></statistics>",
 				nc_info->stats.start_time,
-				nc_info->stats.bad_hellos,
-				nc_info->stats.sessions_in,
-				nc_info->stats.sessions_dropped,
-				nc_info->stats.counters.in_rpcs,
-				nc_info->stats.counters.in_bad_rpcs,
-				nc_info->stats.counters.out_rpc_errors,
-				nc_info->stats.counters.out_notifications) == -1) {
+				NC_STAT_GET(nc_info->stats.bad_hellos),
+				NC_STAT_GET(nc_info->stats.sessions_in),
+				NC_STAT_GET(nc_info->stats.sessions_dropped),
+				NC_STAT_GET(nc_info->stats.counters.in_rpcs),
+				NC_STAT_GET(nc_info->stats.counters.in_bad_rpcs),
+				NC_STAT_GET(nc_info->stats.counters.out_rpc_errors),
+				NC_STAT_GET(nc_info->stats.counters.out_notifications)) == -1) {
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 			stats = NULL;
 		}
-		pthread_rwlock_unlock(&(nc_info->lock));
 	}
 
 	/* get it all together */
 	if (asprintf(&retval, "<netconf-state xmlns=\"%s\">%s%s%s%s%s</netconf-state>", NC_NS_MONITORING,
-			(server_capabilities != NULL) ? server_capabilities : "",
+			(cpblts != NULL) ? cpblts : "",
 			(ds_stats != NULL) ? ds_stats : "",
 			(sessions != NULL) ? sessions : "",
 			(schemas != NULL) ? schemas : "",
@@ -1587,20 +1819,18 @@ static char* get_state_nacm(const char* UNUSED(model), const char* UNUSED(runnin
 	char* retval = NULL;
 
 	if (nc_info != NULL ) {
-		pthread_rwlock_rdlock(&(nc_info->lock));
 		if (asprintf(&retval, "<nacm xmlns=\"%s\">"
 				"<denied-operations>%u</denied-operations>"
 				"<denied-data-writes>%u</denied-data-writes>"
 				"<denied-notifications>%u</denied-notifications>"
 				"</nacm>",
 				NC_NS_NACM,
-				nc_info->stats_nacm.denied_ops,
-				nc_info->stats_nacm.denied_data,
-				nc_info->stats_nacm.denied_notifs) == -1) {
+				NC_STAT_GET(nc_info->stats_nacm.denied_ops),
+				NC_STAT_GET(nc_info->stats_nacm.denied_data),
+				NC_STAT_GET(nc_info->stats_nacm.denied_notifs)) == -1) {
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 			retval = NULL;
 		}
-		pthread_rwlock_unlock(&(nc_info->lock));
 	}
 	if (retval == NULL) {
 		retval = strdup("");
@@ -1643,7 +1873,7 @@ static char* get_schema(const nc_rpc* rpc, struct nc_err** e)
 	struct model_list* listitem;
 
 	/* get name of the schema */
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_MONITORING_ID":get-schema/"NC_NS_MONITORING_ID":identifier", rpc->ctxt)) != NULL &&
+	if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/"NC_NS_MONITORING_ID":get-schema/"NC_NS_MONITORING_ID":identifier", rpc->ctxt)) != NULL &&
 			!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 		if (query_result->nodesetval->nodeNr > 1) {
 			ERROR("%s: multiple identifier elements found", __func__);
@@ -1667,7 +1897,7 @@ static char* get_schema(const nc_rpc* rpc, struct nc_err** e)
 	}
 
 	/* get version of the schema */
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_MONITORING_ID":get-schema/"NC_NS_MONITORING_ID":version", rpc->ctxt)) != NULL) {
+	if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/"NC_NS_MONITORING_ID":get-schema/"NC_NS_MONITORING_ID":version", rpc->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
 				ERROR("%s: multiple version elements found", __func__);
@@ -1683,7 +1913,7 @@ static char* get_schema(const nc_rpc* rpc, struct nc_err** e)
 	}
 
 	/* get format of the schema */
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_MONITORING_ID":get-schema/"NC_NS_MONITORING_ID":format", rpc->ctxt)) != NULL) {
+	if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/"NC_NS_MONITORING_ID":get-schema/"NC_NS_MONITORING_ID":format", rpc->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
 				ERROR("%s: multiple version elements found", __func__);
@@ -1810,6 +2040,7 @@ static struct transapi_internal* transapi_new_shared(const char* callbacks_path)
 	struct transapi_data_callbacks *data_clbks = NULL;
 	struct transapi_rpc_callbacks *rpc_clbks = NULL;
 	struct transapi_file_callbacks *file_clbks = NULL;
+	struct transapi_batch_callbacks *batch_clbks = NULL;
 	int *ver, ver_default = 1;
 	int *modified;
 	NC_EDIT_ERROPT_TYPE *erropt;
@@ -1873,6 +2104,10 @@ static struct transapi_internal* transapi_new_shared(const char* callbacks_path)
 		VERB("No FMON callback in %s transAPI module.", callbacks_path);
 	}
 
+	if ((batch_clbks = dlsym (transapi_module, "batch_clbks")) == NULL) {
+		VERB("No batch callbacks in %s transAPI module.", callbacks_path);
+	}
+
 	/* callbacks work with configuration data */
 	/* get clbks structure */
 	if ((data_clbks = dlsym (transapi_module, "clbks")) == NULL) {
@@ -1902,6 +2137,7 @@ static struct transapi_internal* transapi_new_shared(const char* callbacks_path)
 	transapi->data_clbks = data_clbks;
 	transapi->rpc_clbks = rpc_clbks;
 	transapi->file_clbks = file_clbks;
+	transapi->batch_clbks = batch_clbks;
 	/* Convert clbks_order to enum */
 	transapi->clbks_order = TRANSAPI_CLBCKS_ORDER_DEFAULT;
 	if (clbks_order != NULL)
@@ -1909,6 +2145,7 @@ static struct transapi_internal* transapi_new_shared(const char* callbacks_path)
 	transapi->init = init_func;
 	transapi->close = close_func;
 	transapi->get_state = get_state;
+	transapi->pid = getpid();
 
 	return (transapi);
 }
@@ -2029,6 +2266,7 @@ API struct ncds_ds* ncds_new_transapi_static(NCDS_TYPE type, const char* model_p
 	 * linked transAPI module
 	 */
 	ds->transapis->tapi->module = &error_area;
+	ds->transapis->tapi->pid = getpid();
 
 
 
@@ -2131,6 +2369,7 @@ static int data_model_enlink(struct data_model** model)
 	listitem->model = *model;
 	listitem->next = models_list;
 	models_list = listitem;
+	models_version++;
 
 	return (EXIT_SUCCESS);
 }
@@ -2368,6 +2607,7 @@ static struct data_model* get_model(const char* module, const char* version)
  */
 static int import_groupings(const char* module_name, xmlXPathContextPtr model_ctxt)
 {
+	xmlXPathContextPtr import_ctxt;
 	xmlXPathObjectPtr imports, groupings;
 	xmlNodePtr node, node_aux;
 	xmlNsPtr ns;
@@ -2383,7 +2623,7 @@ static int import_groupings(const char* module_name, xmlXPathContextPtr model_ct
 	}
 
 	/* copy grouping definitions from imported models */
-	if ((imports = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_YIN_ID":module/"NC_NS_YIN_ID":import", model_ctxt)) == NULL ) {
+	if ((imports = nc_xpath_eval("/"NC_NS_YIN_ID":module/"NC_NS_YIN_ID":import", model_ctxt)) == NULL ) {
 		ERROR("%s: Evaluating XPath expression failed.", __func__);
 		return (EXIT_FAILURE);
 	}else if (!xmlXPathNodeSetIsEmpty(imports->nodesetval)) {
@@ -2436,8 +2676,23 @@ static int import_groupings(const char* module_name, xmlXPathContextPtr model_ct
 			}
 			free(module);
 
+			/*
+			 * the imported model can be read by several threads at once
+			 * (see ncds_update_uses_all()), so do not share its context
+			 */
+			if ((import_ctxt = xmlXPathNewContext(model->xml)) == NULL ||
+					xmlXPathRegisterNs(import_ctxt, BAD_CAST NC_NS_YIN_ID, BAD_CAST NC_NS_YIN) != 0) {
+				ERROR("%s: Creating XPath context failed.", __func__);
+				xmlXPathFreeContext(import_ctxt);
+				free(prefix);
+				xmlXPathFreeObject(imports);
+				return (EXIT_FAILURE);
+			}
+
 			/* import grouping definitions */
-			if ((groupings = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_YIN_ID":module//"NC_NS_YIN_ID":grouping", model->ctxt)) != NULL ) {
+			groupings = nc_xpath_eval("/"NC_NS_YIN_ID":module//"NC_NS_YIN_ID":grouping", import_ctxt);
+			xmlXPathFreeContext(import_ctxt);
+			if (groupings != NULL) {
 				/* add prefix into the grouping names and add imported grouping into the overall data model */
 				r = 0;
 				for (j = 0; (r != -1) && (j < groupings->nodesetval->nodeNr); j++) {
@@ -2473,7 +2728,7 @@ static int import_groupings(const char* module_name, xmlXPathContextPtr model_ct
 	xmlXPathFreeObject(imports);
 
 	/* get all grouping statements in the document and remove unneeded nodes */
-	if ((groupings = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_YIN_ID":module//"NC_NS_YIN_ID":grouping", model_ctxt)) == NULL ) {
+	if ((groupings = nc_xpath_eval("/"NC_NS_YIN_ID":module//"NC_NS_YIN_ID":grouping", model_ctxt)) == NULL ) {
 		ERROR("%s: Evaluating XPath expression failed.", __func__);
 		return (EXIT_FAILURE);
 	}
@@ -2546,7 +2801,7 @@ static int ncds_update_uses(const char *module_name, const char *prefix,
 		return (EXIT_FAILURE);
 	}
 
-	if ((groupings = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_YIN_ID":module//"NC_NS_YIN_ID":grouping", *model_ctxt)) == NULL ) {
+	if ((groupings = nc_xpath_eval("/"NC_NS_YIN_ID":module//"NC_NS_YIN_ID":grouping", *model_ctxt)) == NULL ) {
 		ERROR("%s: Evaluating XPath expression failed.", __func__);
 		return (EXIT_FAILURE);
 	}
@@ -2672,10 +2927,162 @@ static int ncds_update_uses_augments(struct data_model* model)
 	return(ncds_update_uses(model->name, model->prefix, &(model->ctxt), query));
 }
 
+/* check that the line is present in the list of lines (each ended by a newline) */
+static int models_cache_sources_contain(const char* sources, const char* line)
+{
+	size_t len = strlen(line);
+
+	while (sources != NULL && *sources != '\0') {
+		if (strncmp(sources, line, len) == 0 && sources[len] == '\n') {
+			return (1);
+		}
+		if ((sources = strchr(sources, '\n')) != NULL) {
+			sources++;
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Append the identification of the model file and of the files of all the
+ * models it (transitively) imports to the sources string. The uses statements
+ * resolved in the model depend only on these files.
+ */
+static int models_cache_sources(struct data_model* model, char** sources)
+{
+	struct stat st;
+	xmlNodePtr node, child;
+	struct data_model* imported;
+	char *module, *revision, *line, *aux;
+	int r, ret = EXIT_SUCCESS;
+
+	if (model->path == NULL || stat(model->path, &st) == -1) {
+		/* internal model, it is not changed while the library is not */
+		r = asprintf(&line, "%s@%s", model->name, model->version);
+	} else {
+		r = asprintf(&line, "%s %lld %lld.%09ld", model->path, (long long)st.st_size,
+				(long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+	}
+	if (r == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	if (models_cache_sources_contain(*sources, line)) {
+		/* already there */
+		free(line);
+		return (EXIT_SUCCESS);
+	}
+	if (asprintf(&aux, "%s%s\n", (*sources == NULL) ? "" : *sources, line) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		free(line);
+		return (EXIT_FAILURE);
+	}
+	free(line);
+	free(*sources);
+	*sources = aux;
+
+	for (node = xmlDocGetRootElement(model->xml)->children; ret == EXIT_SUCCESS && node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE || xmlStrcmp(node->name, BAD_CAST "import") != 0 ||
+				(module = (char*) xmlGetProp(node, BAD_CAST "module")) == NULL) {
+			continue;
+		}
+		revision = NULL;
+		for (child = node->children; child != NULL; child = child->next) {
+			if (child->type == XML_ELEMENT_NODE && xmlStrcmp(child->name, BAD_CAST "revision-date") == 0) {
+				revision = (char*) xmlGetProp(child, BAD_CAST "value");
+				break;
+			}
+		}
+		/* the same way as import_groupings() gets the imported model */
+		if ((imported = get_model(module, revision)) == NULL) {
+			/* the resolution is not complete, do not cache it */
+			ret = EXIT_FAILURE;
+		} else if (imported != model) {
+			ret = models_cache_sources(imported, sources);
+		}
+		free(module);
+		free(revision);
+	}
+
+	return (ret);
+}
+
+static char* models_cache_path(struct data_model* model)
+{
+	char* path;
+
+	if (asprintf(&path, "%s/%s@%s.yin", models_cache_dir, model->name, model->version) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	return (path);
+}
+
+/* get the model with resolved uses statements from the cache, NULL if not available */
+static xmlDocPtr models_cache_load(struct data_model* model, const char* sources)
+{
+	xmlDocPtr doc;
+	xmlNodePtr pi;
+	char* path;
+
+	if ((path = models_cache_path(model)) == NULL) {
+		return (NULL);
+	}
+	if (eaccess(path, R_OK) == -1 || (doc = xmlReadFile(path, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
+		free(path);
+		return (NULL);
+	}
+	free(path);
+
+	/* the model sources are noted in the processing instruction preceding the module */
+	pi = doc->children;
+	if (pi == NULL || pi->type != XML_PI_NODE || xmlStrcmp(pi->name, BAD_CAST "libnetconf-sources") != 0 ||
+			xmlStrcmp(pi->content, BAD_CAST sources) != 0) {
+		VERB("Cached data model \"%s\" is out of date.", model->name);
+		xmlFreeDoc(doc);
+		return (NULL);
+	}
+	xmlUnlinkNode(pi);
+	xmlFreeNode(pi);
+
+	return (doc);
+}
+
+static void models_cache_store(struct data_model* model, xmlDocPtr doc, const char* sources)
+{
+	xmlNodePtr pi;
+	char *path, *tmp_path;
+
+	if ((path = models_cache_path(model)) == NULL) {
+		return;
+	}
+	if (asprintf(&tmp_path, "%s.%d", path, getpid()) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		free(path);
+		return;
+	}
+
+	pi = xmlAddPrevSibling(xmlDocGetRootElement(doc), xmlNewDocPI(doc, BAD_CAST "libnetconf-sources", BAD_CAST sources));
+	/* other processes may read the cache, so replace the file at once */
+	if (xmlSaveFile(tmp_path, doc) == -1 || rename(tmp_path, path) == -1) {
+		WARN("Unable to store data model \"%s\" into the cache (%s).", model->name, strerror(errno));
+		unlink(tmp_path);
+	}
+	if (pi != NULL) {
+		xmlUnlinkNode(pi);
+		xmlFreeNode(pi);
+	}
+
+	free(tmp_path);
+	free(path);
+}
+
 static int ncds_update_uses_ds(struct ncds_ds* datastore)
 {
 	xmlXPathContextPtr model_ctxt;
-	char* query;
+	char* query, *sources = NULL;
 	int ret;
 
 	if (datastore == NULL) {
@@ -2688,6 +3095,16 @@ static int ncds_update_uses_ds(struct ncds_ds* datastore)
 	 * base model
 	 */
 	if (datastore->ext_model == datastore->data_model->xml) {
+		if (models_cache_dir != NULL && datastore->data_model->path != NULL &&
+				models_cache_sources(datastore->data_model, &sources) == EXIT_SUCCESS) {
+			if ((datastore->ext_model = models_cache_load(datastore->data_model, sources)) != NULL) {
+				free(sources);
+				return (EXIT_SUCCESS);
+			}
+		} else {
+			free(sources);
+			sources = NULL;
+		}
 		datastore->ext_model = xmlCopyDoc(datastore->data_model->xml, 1);
 	}
 
@@ -2706,12 +3123,115 @@ static int ncds_update_uses_ds(struct ncds_ds* datastore)
 			               datastore->data_model->prefix, &model_ctxt, query);
 	xmlXPathFreeContext(model_ctxt);
 
+	if (ret == EXIT_SUCCESS && sources != NULL) {
+		models_cache_store(datastore->data_model, datastore->ext_model, sources);
+	}
+	free(sources);
+
 	return (ret);
 }
 
-/*
- *  1 - remove the node
- *  0 - do not remove the node
+struct uses_jobs {
+	pthread_mutex_t lock;
+	struct ncds_ds** list;
+	int count, next, ret;
+};
+
+static void* ncds_update_uses_worker(void* arg)
+{
+	struct uses_jobs* jobs = (struct uses_jobs*)arg;
+	int i;
+
+	while (1) {
+		pthread_mutex_lock(&jobs->lock);
+		i = jobs->next++;
+		pthread_mutex_unlock(&jobs->lock);
+		if (i >= jobs->count) {
+			break;
+		}
+		if (ncds_update_uses_ds(jobs->list[i]) != EXIT_SUCCESS) {
+			pthread_mutex_lock(&jobs->lock);
+			jobs->ret = EXIT_FAILURE;
+			pthread_mutex_unlock(&jobs->lock);
+		}
+	}
+
+	return (NULL);
+}
+
+/**
+ * @brief Resolve uses statements in the extended models of all the datastores.
+ *
+ * Each datastore has its own copy of the extended model, the imported models
+ * are only read, so the datastores are processed by the worker threads when
+ * more CPUs are available. All the imported models must be loaded before,
+ * datastores with some import missing are processed in this thread.
+ */
+static int ncds_update_uses_all(void)
+{
+	struct uses_jobs jobs;
+	struct ncds_ds_list *ds_iter;
+	pthread_t *threads = NULL;
+	char* sources;
+	long cpus;
+	int i, n = 0, nthreads;
+
+	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+		n++;
+	}
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 2 || cpus < 2 || (jobs.list = malloc(n * sizeof(struct ncds_ds*))) == NULL) {
+		for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+			if (ncds_update_uses_ds(ds_iter->datastore) != EXIT_SUCCESS) {
+				return (EXIT_FAILURE);
+			}
+		}
+		return (EXIT_SUCCESS);
+	}
+
+	jobs.count = 0;
+	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+		/* walk the imports the same way as the resolution to load all the models */
+		sources = NULL;
+		i = models_cache_sources(ds_iter->datastore->data_model, &sources);
+		free(sources);
+		if (i == EXIT_SUCCESS) {
+			jobs.list[jobs.count++] = ds_iter->datastore;
+		} else if (ncds_update_uses_ds(ds_iter->datastore) != EXIT_SUCCESS) {
+			free(jobs.list);
+			return (EXIT_FAILURE);
+		}
+	}
+
+	nthreads = ((jobs.count < cpus) ? jobs.count : cpus) - 1;
+	if (nthreads > 0 && (threads = malloc(nthreads * sizeof(pthread_t))) == NULL) {
+		nthreads = 0;
+	}
+
+	pthread_mutex_init(&jobs.lock, NULL);
+	jobs.next = 0;
+	jobs.ret = EXIT_SUCCESS;
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, ncds_update_uses_worker, &jobs) != 0) {
+			break;
+		}
+	}
+	nthreads = i;
+	/* work in this thread too */
+	ncds_update_uses_worker(&jobs);
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&jobs.lock);
+	free(threads);
+	free(jobs.list);
+
+	return (jobs.ret);
+}
+
+/*
+ *  1 - remove the node
+ *  0 - do not remove the node
  * -1 - error
  */
 static int feature_check(xmlNodePtr node, struct model_feature **features)
@@ -3029,10 +3549,10 @@ static int _update_model(int type, xmlXPathContextPtr model_ctxt, const char* mo
 	/* get all definitions of nodes to modify */
 	switch (type) {
 	case 1: /* augment */
-		nodes = xmlXPathEvalExpression(BAD_CAST "//"NC_NS_YIN_ID":augment", model_ctxt);
+		nodes = nc_xpath_eval("//"NC_NS_YIN_ID":augment", model_ctxt);
 		break;
 	case 2: /* refine */
-		nodes = xmlXPathEvalExpression(BAD_CAST "//"NC_NS_YIN_ID":refine", model_ctxt);
+		nodes = nc_xpath_eval("//"NC_NS_YIN_ID":refine", model_ctxt);
 		break;
 	default: /* wtf */
 		return (-1);
@@ -3050,7 +3570,7 @@ static int _update_model(int type, xmlXPathContextPtr model_ctxt, const char* mo
 	}
 
 	/* get all <import> nodes for their prefix specification to be used with augment statement */
-	if ((imports = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_YIN_ID":module/"NC_NS_YIN_ID":import", model_ctxt)) == NULL ) {
+	if ((imports = nc_xpath_eval("/"NC_NS_YIN_ID":module/"NC_NS_YIN_ID":import", model_ctxt)) == NULL ) {
 		ERROR("%s: Evaluating XPath expression failed.", __func__);
 		return (-1);
 	}
@@ -3243,7 +3763,7 @@ static int ncds_update_augment_cleanup(struct ncds_ds *ds)
 	}
 
 	/* get all augment definitions */
-	if ((augments = xmlXPathEvalExpression(BAD_CAST "//"NC_NS_YIN_ID":augment", ext_model_ctxt)) != NULL ) {
+	if ((augments = nc_xpath_eval("//"NC_NS_YIN_ID":augment", ext_model_ctxt)) != NULL ) {
 		if (xmlXPathNodeSetIsEmpty(augments->nodesetval)) {
 			/* there is no <augment> part so we have nothing to do */
 			xmlXPathFreeObject(augments);
@@ -3318,6 +3838,27 @@ API int ncds_add_models_path(const char* path)
 	return (EXIT_SUCCESS);
 }
 
+API int ncds_set_models_cache(const char* path)
+{
+	char* dir = NULL;
+
+	if (path != NULL) {
+		if (access(path, R_OK | W_OK | X_OK) != 0) {
+			ERROR("Data models cache directory \'%s\' is not accessible (%s).", path, strerror(errno));
+			return (EXIT_FAILURE);
+		}
+		if ((dir = strdup(path)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (EXIT_FAILURE);
+		}
+	}
+
+	free(models_cache_dir);
+	models_cache_dir = dir;
+
+	return (EXIT_SUCCESS);
+}
+
 API int ncds_add_augment_transapi(const char* model_path, const char* callbacks_path)
 {
 	struct data_model *model;
@@ -3433,6 +3974,7 @@ API int ncds_add_augment_transapi_static(const char* model_path, const struct tr
 		 * linked transAPI module
 		 */
 		model->transapi->module = &error_area;
+		model->transapi->pid = getpid();
 
 		/* link created transapi with the model */
 		model->transapi->model = model;
@@ -3472,7 +4014,7 @@ static int ncds_features_parse(struct data_model* model)
 	}
 
 	/* get all top-level's augment definitions */
-	if ((features = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_YIN_ID":module/"NC_NS_YIN_ID":feature", model->ctxt)) != NULL ) {
+	if ((features = nc_xpath_eval("/"NC_NS_YIN_ID":module/"NC_NS_YIN_ID":feature", model->ctxt)) != NULL ) {
 		if (xmlXPathNodeSetIsEmpty(features->nodesetval)) {
 			/* there is no <feature> part so feature list will be empty */
 			model->features = NULL;
@@ -3558,6 +4100,7 @@ static inline int _feature_switch(const char* module, const char* feature, int v
 		for (i = 0; model->features[i] != NULL; i++) {
 			if (strcmp(model->features[i]->name, feature) == 0) {
 				model->features[i]->enabled = value;
+				models_version++;
 				return (EXIT_SUCCESS);
 			}
 		}
@@ -3594,6 +4137,7 @@ static inline int _features_switchall(const char* module, int value)
 		for (i = 0; model->features[i] != NULL; i++) {
 			model->features[i]->enabled = value;
 		}
+		models_version++;
 	}
 
 	return (EXIT_SUCCESS);
@@ -3719,6 +4263,8 @@ static int ncds_update_callbacks(struct ncds_ds* ds)
 		free(ds->tapi_callbacks);
 		ds->tapi_callbacks = NULL;
 	}
+	free(ds->tapi_batch_callbacks);
+	ds->tapi_batch_callbacks = NULL;
 	/* create list of callbacks */
 	ds->tapi_callbacks_count = clbk_count;
 	if (clbk_count > 0) {
@@ -3729,6 +4275,20 @@ static int ncds_update_callbacks(struct ncds_ds* ds)
 	for (i = 0, tapi_iter = ds->transapis; tapi_iter != NULL; tapi_iter = tapi_iter->next) {
 		for (j = 0; j < tapi_iter->tapi->data_clbks->callbacks_count; j++) {
 			ds->tapi_callbacks[i].func = tapi_iter->tapi->data_clbks->callbacks[j].func;
+			/* connect the batch callback of the same path */
+			for (k = 0; tapi_iter->tapi->batch_clbks != NULL && k < tapi_iter->tapi->batch_clbks->callbacks_count; k++) {
+				if (strcmp(tapi_iter->tapi->batch_clbks->callbacks[k].path, tapi_iter->tapi->data_clbks->callbacks[j].path) == 0) {
+					if (ds->tapi_batch_callbacks == NULL) {
+						ds->tapi_batch_callbacks = calloc(clbk_count, sizeof *ds->tapi_batch_callbacks);
+						if (ds->tapi_batch_callbacks == NULL) {
+							ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+							return (EXIT_FAILURE);
+						}
+					}
+					ds->tapi_batch_callbacks[i] = tapi_iter->tapi->batch_clbks->callbacks[k].func;
+					break;
+				}
+			}
 			/* correct prefixes in path */
 			path = strdup(tapi_iter->tapi->data_clbks->callbacks[j].path);
 			for (k = 0; tapi_iter->tapi->ns_mapping[k].href != NULL; k++) {
@@ -3781,6 +4341,14 @@ static int ncds_update_callbacks(struct ncds_ds* ds)
 
 static void transapi_unload(struct transapi_internal* tapi)
 {
+	if (tapi->pid != getpid()) {
+		/* inherited from the parent process, which still runs the module */
+		if (tapi->module != &error_area && dlclose(tapi->module)) {
+			ERROR("%s: Unloading transAPI module failed: %s:", __func__, dlerror());
+		}
+		return;
+	}
+
 	/* stop the thread monitoring the files */
 	if (tapi->file_clbks != NULL && tapi->file_clbks->callbacks_count > 0) {
 		VERB("Stopping FMON thread.");
@@ -3839,6 +4407,7 @@ API int ncds_consolidate(void)
 	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
 		transapis_cleanup(&(ds_iter->datastore->transapis), 0);
 
+		model_index_free(ds_iter->datastore->ext_model);
 		if (ds_iter->datastore->ext_model != ds_iter->datastore->data_model->xml) {
 			xmlFreeDoc(ds_iter->datastore->ext_model);
 			ds_iter->datastore->ext_model = ds_iter->datastore->data_model->xml;
@@ -3853,11 +4422,9 @@ API int ncds_consolidate(void)
 	}
 
 	/* process uses statements in the configuration datastores */
-	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
-		if (ds_iter->datastore != NULL && ncds_update_uses_ds(ds_iter->datastore) != EXIT_SUCCESS) {
-			ERROR("Preparing configuration data models failed.");
-			return (EXIT_FAILURE);
-		}
+	if (ncds_update_uses_all() != EXIT_SUCCESS) {
+		ERROR("Preparing configuration data models failed.");
+		return (EXIT_FAILURE);
 	}
 
 	/* augment statement processing - absolute paths to modify other (datastore's extended models) data models */
@@ -3905,6 +4472,18 @@ API int ncds_consolidate(void)
 		}
 	}
 
+	/*
+	 * the models are complete now, index them for the edit-config and
+	 * with-defaults processing - the internal datastores are used by the
+	 * library itself, the others are indexed when they are accessed
+	 */
+	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+		ds_iter->datastore->ext_model_indexed = 0;
+		if (ds_iter->datastore->id < internal_ds_count) {
+			ncds_ds_prepare(ds_iter->datastore);
+		}
+	}
+
 	transapis_cleanup(&(augment_tapi_list), 0);
 	return (EXIT_SUCCESS);
 }
@@ -3995,6 +4574,46 @@ static xmlDocPtr read_datastore_data(ncds_id id, const char *data)
 	}
 }
 
+/**
+ * @brief Get the configuration data of the datastore as a XML document, directly
+ * if the datastore implementation supports it. The filter is passed to the
+ * implementation as a hint to skip unrelated data, the caller still has to
+ * apply it on the result.
+ *
+ * @return NULL on error with the error structure filled, data otherwise.
+ */
+static xmlDocPtr getconfig_datastore_data(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, const struct nc_filter* filter, struct nc_err** e)
+{
+	xmlDocPtr doc;
+	char* data;
+
+	if (ds->func.getconfig_xml != NULL) {
+		if ((doc = ds->func.getconfig_xml(ds, session, source, filter, e)) == NULL && *e == NULL) {
+			ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
+			*e = nc_err_new(NC_ERR_OP_FAILED);
+		}
+		return (doc);
+	}
+
+	if ((data = ds->func.getconfig(ds, session, source, e)) == NULL) {
+		if (*e == NULL) {
+			ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
+			*e = nc_err_new(NC_ERR_OP_FAILED);
+		}
+		return (NULL);
+	}
+	doc = read_datastore_data(ds->id, data);
+	free(data);
+
+	if (doc == NULL) {
+		ERROR("Reading the configuration datastore failed.");
+		*e = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*e, NC_ERR_PARAM_MSG, "Invalid datastore content.");
+	}
+
+	return (doc);
+}
+
 #ifndef DISABLE_VALIDATION
 static void relaxng_error_callback(void *error, const char * msg, ...)
 {
@@ -4041,12 +4660,51 @@ static void relaxng_error_callback(void *error, const char * msg, ...)
 	}
 }
 
+/**
+ * @brief Compile the validators found with the datastore's data model, if
+ * not done yet.
+ */
+static void validators_load(struct ncds_ds *ds)
+{
+	xmlRelaxNGParserCtxtPtr rng_ctxt;
+
+	if (ds->validators.rng_path != NULL) {
+		rng_ctxt = xmlRelaxNGNewParserCtxt(ds->validators.rng_path);
+		if ((ds->validators.rng_schema = xmlRelaxNGParse(rng_ctxt)) == NULL) {
+			WARN("Failed to parse Relax NG schema (%s)", ds->validators.rng_path);
+		} else if ((ds->validators.rng = xmlRelaxNGNewValidCtxt(ds->validators.rng_schema)) == NULL) {
+			WARN("Failed to create validation context (%s)", ds->validators.rng_path);
+			xmlRelaxNGFree(ds->validators.rng_schema);
+			ds->validators.rng_schema = NULL;
+		} else {
+			DBG("%s: Relax NG validator set (%s)", __func__, ds->validators.rng_path);
+		}
+		xmlRelaxNGFreeParserCtxt(rng_ctxt);
+		free(ds->validators.rng_path);
+		ds->validators.rng_path = NULL;
+	}
+
+	if (ds->validators.schematron_path != NULL) {
+		if ((ds->validators.schematron = xsltParseStylesheetFile(BAD_CAST ds->validators.schematron_path)) == NULL) {
+			WARN("Failed to parse Schematron stylesheet (%s)", ds->validators.schematron_path);
+		} else {
+			DBG("%s: Schematron validator set (%s)", __func__, ds->validators.schematron_path);
+		}
+		free(ds->validators.schematron_path);
+		ds->validators.schematron_path = NULL;
+	}
+}
+
 /*
+ * Validate the datastore content. If grammar is 0, the content was already
+ * validated by the Relax NG and Schematron validators, so only the
+ * datastore-specific callback is called.
+ *
  * EXIT_SUCCESS - validation ok
  * EXIT_FAILURE - validation failed
  * EXIT_RPC_NOT_APPLICABLE - RelaxNG scheme not defined
  */
-static int validate_ds(struct ncds_ds *ds, xmlDocPtr doc, struct nc_err **error)
+static int validate_ds(struct ncds_ds *ds, xmlDocPtr doc, int grammar, struct nc_err **error)
 {
 	int ret = 0;
 	int retval = EXIT_RPC_NOT_APPLICABLE;
@@ -4064,7 +4722,12 @@ static int validate_ds(struct ncds_ds *ds, xmlDocPtr doc, struct nc_err **error)
 		return (EXIT_FAILURE);
 	}
 
-	if (ds->validators.rng) {
+	if (!grammar) {
+		DBG("Datastore %d content validated already", ds->id);
+		retval = EXIT_SUCCESS;
+	}
+
+	if (grammar && ds->validators.rng) {
 		/* RelaxNG validation */
 		DBG("RelaxNG validation on subdatastore %d", ds->id);
 
@@ -4093,7 +4756,7 @@ static int validate_ds(struct ncds_ds *ds, xmlDocPtr doc, struct nc_err **error)
 		}
 	}
 
-	if (ds->validators.schematron) {
+	if (grammar && ds->validators.schematron) {
 		/* schematron */
 		DBG("Schematron validation on subdatastore %d", ds->id);
 
@@ -4119,7 +4782,7 @@ static int validate_ds(struct ncds_ds *ds, xmlDocPtr doc, struct nc_err **error)
 			*error = nc_err_new(NC_ERR_OP_FAILED);
 			return (EXIT_FAILURE);
 		}
-		if ((result = xmlXPathEvalExpression(BAD_CAST "/svrl:schematron-output/svrl:failed-assert/svrl:text | /svrl:schematron-output/svrl:successful-report/svrl:text", ctxt)) != NULL) {
+		if ((result = nc_xpath_eval("/svrl:schematron-output/svrl:failed-assert/svrl:text | /svrl:schematron-output/svrl:successful-report/svrl:text", ctxt)) != NULL) {
 			if (!xmlXPathNodeSetIsEmpty(result->nodesetval)) {
 				for (i = 0; i < result->nodesetval->nodeNr; i++) {
 					schematron_error = (char*)xmlNodeGetContent(result->nodesetval->nodeTab[i]);
@@ -4178,8 +4841,9 @@ static int validate_ds(struct ncds_ds *ds, xmlDocPtr doc, struct nc_err **error)
 
 static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, const char* config, struct nc_err** e)
 {
-	int ret = EXIT_FAILURE;
-	char *data_cfg = NULL;
+	int ret = EXIT_FAILURE, grammar = 1;
+	uint64_t trace_start;
+	char *data_cfg = NULL, *valid_data = NULL;
 	xmlDocPtr doc = NULL;
 	xmlNodePtr root, node;
 	xmlNsPtr ns;
@@ -4218,7 +4882,22 @@ static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* sess
 		return (EXIT_FAILURE);
 	}
 
-	doc = read_datastore_data(ds->id, data_cfg);
+	/*
+	 * validating the grammar is expensive, so it is skipped for the content
+	 * that was already successfully validated
+	 */
+	if (data_cfg == NULL) {
+		/* nothing to remember */
+	} else if (ds->validators.valid_data != NULL && strcmp(ds->validators.valid_data, data_cfg) == 0) {
+		grammar = 0;
+	} else if (source != NC_DATASTORE_CONFIG) {
+		valid_data = data_cfg;
+		data_cfg = NULL;
+	} else {
+		valid_data = strdup(data_cfg);
+	}
+
+	doc = read_datastore_data(ds->id, (data_cfg != NULL) ? data_cfg : valid_data);
 	if (doc == NULL || doc->children == NULL) {
 		/* config is empty */
 		xmlFreeDoc(doc);
@@ -4255,11 +4934,21 @@ static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* sess
 		}
 		xmlDocSetRootElement(doc, root);
 
-		ret = validate_ds(ds, doc, e);
+		trace_start = nc_trace_begin();
+		ret = validate_ds(ds, doc, grammar, e);
+		nc_trace_end(NC_TRACE_VALIDATE, trace_start);
 
 		xmlFreeDoc(doc);
 	}
 
+	if (grammar && ret == EXIT_SUCCESS && valid_data != NULL) {
+		/* remember the valid content to skip its validation next time */
+		free(ds->validators.valid_data);
+		ds->validators.valid_data = valid_data;
+		valid_data = NULL;
+	}
+	free(valid_data);
+
 	return (ret);
 
 }
@@ -4323,6 +5012,9 @@ API int ncds_set_validation(struct ncds_ds* ds, int enable, const char* relaxng,
 		xmlRelaxNGFreeValidCtxt(ds->validators.rng);
 		xmlRelaxNGFree(ds->validators.rng_schema);
 		xsltFreeStylesheet(ds->validators.schematron);
+		free(ds->validators.valid_data);
+		free(ds->validators.rng_path);
+		free(ds->validators.schematron_path);
 		memset(&(ds->validators), 0, sizeof(struct model_validators));
 	} else if (nc_init_flags & NC_INIT_VALIDATE) { /* && enable == 1 */
 		/* enable and reset validators */
@@ -4364,6 +5056,11 @@ API int ncds_set_validation(struct ncds_ds* ds, int enable, const char* relaxng,
 		}
 
 		/* replace previous validators */
+		if ((rng_schema && rng) || schxsl) {
+			/* the content must be validated again by the new validators */
+			free(ds->validators.valid_data);
+			ds->validators.valid_data = NULL;
+		}
 		if (rng_schema && rng) {
 			xmlRelaxNGFree(ds->validators.rng_schema);
 			ds->validators.rng_schema = rng_schema;
@@ -4371,12 +5068,16 @@ API int ncds_set_validation(struct ncds_ds* ds, int enable, const char* relaxng,
 			xmlRelaxNGFreeValidCtxt(ds->validators.rng);
 			ds->validators.rng = rng;
 			rng = NULL;
+			free(ds->validators.rng_path);
+			ds->validators.rng_path = NULL;
 			DBG("%s: Relax NG validator set (%s)", __func__, relaxng);
 		}
 		if (schxsl) {
 			xsltFreeStylesheet(ds->validators.schematron);
 			ds->validators.schematron = schxsl;
 			schxsl = NULL;
+			free(ds->validators.schematron_path);
+			ds->validators.schematron_path = NULL;
 			DBG("%s: Schematron validator set (%s)", __func__, schematron);
 		}
 
@@ -4418,6 +5119,48 @@ API int ncds_set_validation2(struct ncds_ds* ds, int enable, const char* relaxng
 }
 #endif
 
+API int ncds_set_state_cache(struct ncds_ds* ds, unsigned int ttl)
+{
+	if (ds == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&ds->lock);
+	ds->state_cache_ttl = ttl;
+	xmlFreeDoc(ds->state_cache);
+	ds->state_cache = NULL;
+	pthread_mutex_unlock(&ds->lock);
+
+	return (EXIT_SUCCESS);
+}
+
+API int ncds_set_transapi_workers(struct ncds_ds* ds, unsigned int workers)
+{
+	if (ds == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&ds->lock);
+	ds->tapi_workers = workers;
+	pthread_mutex_unlock(&ds->lock);
+
+	return (EXIT_SUCCESS);
+}
+
+API int ncds_state_cache_bypass(struct nc_session* session, int bypass)
+{
+	if (session == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	session->state_nocache = bypass ? 1 : 0;
+
+	return (EXIT_SUCCESS);
+}
+
 static struct ncds_ds* ncds_new_internal(NCDS_TYPE type, const char * model_path)
 {
 	int ret;
@@ -4427,7 +5170,6 @@ static struct ncds_ds* ncds_new_internal(NCDS_TYPE type, const char * model_path
 
 #ifndef DISABLE_VALIDATION
 	char *path_rng = NULL, *path_sch = NULL;
-	xmlRelaxNGParserCtxtPtr rng_ctxt;
 #endif
 
 	if (model_path == NULL) {
@@ -4492,32 +5234,18 @@ static struct ncds_ds* ncds_new_internal(NCDS_TYPE type, const char * model_path
 
 #ifndef DISABLE_VALIDATION
 	if (nc_init_flags & NC_INIT_VALIDATE) {
-		/* prepare validation - Relax NG */
+		/* validators are compiled when the datastore is validated for the first time */
 		if (eaccess(path_rng, R_OK) == -1) {
 			WARN("Missing RelaxNG schema for validation (%s - %s).", path_rng, strerror(errno));
 		} else {
-			rng_ctxt = xmlRelaxNGNewParserCtxt(path_rng);
-			if ((ds->validators.rng_schema = xmlRelaxNGParse(rng_ctxt)) == NULL) {
-				WARN("Failed to parse Relax NG schema (%s)", path_rng);
-			} else if ((ds->validators.rng = xmlRelaxNGNewValidCtxt(ds->validators.rng_schema)) == NULL) {
-				WARN("Failed to create validation context (%s)", path_rng);
-				xmlRelaxNGFree(ds->validators.rng_schema);
-				ds->validators.rng_schema = NULL;
-			} else {
-				DBG("%s: Relax NG validator set (%s)", __func__, path_rng);
-			}
-			xmlRelaxNGFreeParserCtxt(rng_ctxt);
+			ds->validators.rng_path = path_rng;
+			path_rng = NULL;
 		}
-
-		/* prepare validation - Schematron */
 		if (eaccess(path_sch, R_OK) == -1) {
 			WARN("Missing Schematron stylesheet for validation (%s - %s).", path_sch, strerror(errno));
 		} else {
-			if ((ds->validators.schematron = xsltParseStylesheetFile(BAD_CAST path_sch)) == NULL) {
-				WARN("Failed to parse Schematron stylesheet (%s)", path_sch);
-			} else {
-				DBG("%s: Schematron validator set (%s)", __func__, path_sch);
-			}
+			ds->validators.schematron_path = path_sch;
+			path_sch = NULL;
 		}
 	}
 #endif /* not DISABLE_VALIDATION */
@@ -4605,6 +5333,7 @@ static void ncds_ds_model_free(struct data_model* model)
 				models_list = listitem->next;
 			}
 			free(listitem);
+			models_version++;
 			break;
 		}
 		listprev = listitem;
@@ -4628,6 +5357,7 @@ static void ncds_ds_model_free(struct data_model* model)
 		free(model->notifs);
 	}
 	if (model->xml != NULL) {
+		model_index_free(model->xml);
 		xmlFreeDoc(model->xml);
 	}
 	if (model->ctxt != NULL) {
@@ -4722,9 +5452,15 @@ void ncds_cleanall()
 	}
 	free(models_dirs);
 	models_dirs = NULL;
+	free(models_cache_dir);
+	models_cache_dir = NULL;
 
 	transapis_cleanup(&(augment_tapi_list), 1);
 
+	free(schemas_cache);
+	schemas_cache = NULL;
+	models_index_cleanup();
+
 #ifndef DISABLE_YANGFORMAT
 	xsltFreeStylesheet(yin2yang_xsl);
 	yin2yang_xsl = NULL;
@@ -4772,6 +5508,7 @@ API void ncds_free(struct ncds_ds* datastore)
 				}
 				free(ds->tapi_callbacks);
 			}
+			free(ds->tapi_batch_callbacks);
 		}
 
 #ifndef DISABLE_VALIDATION
@@ -4779,11 +5516,17 @@ API void ncds_free(struct ncds_ds* datastore)
 		xmlRelaxNGFreeValidCtxt(ds->validators.rng);
 		xmlRelaxNGFree(ds->validators.rng_schema);
 		xsltFreeStylesheet(ds->validators.schematron);
+		free(ds->validators.valid_data);
+		free(ds->validators.rng_path);
+		free(ds->validators.schematron_path);
 #endif
 		/* free all implementation specific resources */
+		candidate_changes_reset(ds, 0);
 		ds->func.free(ds);
+		xmlFreeDoc(ds->state_cache);
 
 		/* free models */
+		model_index_free(ds->ext_model);
 		if (ds->data_model == NULL || (ds->data_model->xml != ds->ext_model)) {
 			xmlFreeDoc(ds->ext_model);
 		}
@@ -5256,12 +5999,161 @@ filter:
 	return filter_in;
 }
 
+/* minimal number of data nodes to filter in parallel */
+#define FILTER_PARALLEL_NODES 1024
+
+/*
+ * Top-level subtree filter items are independent, each of them is applied on
+ * its own copy of the data, so they can be processed in parallel.
+ */
+struct filter_job {
+	xmlNodePtr filter;   /* filter item, a private copy in case of parallel processing */
+	xmlDocPtr result;
+};
+
+struct filter_jobs {
+	pthread_mutex_t lock;
+	struct filter_job* list;
+	int count, next;
+	xmlNodePtr old;
+	keyList keys;
+};
+
+static void ncxml_filter_job(struct filter_job* job, xmlNodePtr old, keyList keys)
+{
+	job->result = xmlNewDoc(BAD_CAST "1.0");
+	xmlAddChildList((xmlNodePtr)(job->result), xmlCopyNodeList(old));
+	ncxml_subtree_filter(job->result->children, job->filter, keys);
+}
+
+static void* ncxml_filter_worker(void* arg)
+{
+	struct filter_jobs* jobs = (struct filter_jobs*)arg;
+	int i;
+
+	while (1) {
+		pthread_mutex_lock(&jobs->lock);
+		i = jobs->next++;
+		pthread_mutex_unlock(&jobs->lock);
+		if (i >= jobs->count) {
+			break;
+		}
+		ncxml_filter_job(&jobs->list[i], jobs->old, jobs->keys);
+	}
+
+	return (NULL);
+}
+
+/**
+ * @brief Check if the data are big enough to be filtered in parallel.
+ */
+static int ncxml_filter_parallel(xmlNodePtr old)
+{
+	xmlNodePtr node = old;
+	int count = 0;
+
+	/* preorder walk through the sibling list, stopped at the limit */
+	while (node != NULL && count < FILTER_PARALLEL_NODES) {
+		count++;
+		if (node->children != NULL) {
+			node = node->children;
+			continue;
+		}
+		while (node != NULL && node->next == NULL) {
+			node = node->parent;
+			if (node == old->parent) {
+				node = NULL;
+			}
+		}
+		if (node != NULL) {
+			node = node->next;
+		}
+	}
+
+	return (count >= FILTER_PARALLEL_NODES);
+}
+
+/**
+ * @brief Prepare the jobs for all the top-level subtree filter items. When there
+ * are more of them and the data are big enough, the jobs are done by the worker
+ * threads, otherwise they are left with the filter item to be done one by one.
+ * @return Filter jobs in the filter items order, NULL if there is nothing to do.
+ */
+static struct filter_job* ncxml_filter_jobs(xmlNodePtr old, xmlNodePtr filter, keyList keys, int* count)
+{
+	struct filter_jobs jobs;
+	struct filter_job* list;
+	pthread_t *threads;
+	xmlNodePtr item;
+	long cpus;
+	int i, n = 0, nthreads;
+
+	*count = 0;
+	for (item = filter; item != NULL; item = item->next) {
+		if (item->type == XML_ELEMENT_NODE) {
+			n++;
+		}
+	}
+	if (n == 0 || (list = calloc(n, sizeof(struct filter_job))) == NULL) {
+		return (NULL);
+	}
+	for (i = 0, item = filter; item != NULL; item = item->next) {
+		/* other nodes would be removed by ncxml_subtree_filter() with an empty result */
+		if (item->type == XML_ELEMENT_NODE) {
+			list[i++].filter = item;
+		}
+	}
+	*count = n;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 2 || cpus < 2 || !ncxml_filter_parallel(old)) {
+		return (list);
+	}
+	nthreads = ((n < cpus) ? n : cpus) - 1;
+	if ((threads = malloc(nthreads * sizeof(pthread_t))) == NULL) {
+		return (list);
+	}
+
+	/* ncxml_subtree_filter() modifies the filter, so each worker needs its own copy */
+	for (i = 0; i < n; i++) {
+		list[i].filter = xmlCopyNode(list[i].filter, 1);
+	}
+
+	pthread_mutex_init(&jobs.lock, NULL);
+	jobs.list = list;
+	jobs.count = n;
+	jobs.next = 0;
+	jobs.old = old;
+	jobs.keys = keys;
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, ncxml_filter_worker, &jobs) != 0) {
+			break;
+		}
+	}
+	nthreads = i;
+	/* work in this thread too */
+	ncxml_filter_worker(&jobs);
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&jobs.lock);
+	free(threads);
+
+	for (i = 0; i < n; i++) {
+		xmlFreeNode(list[i].filter);
+		list[i].filter = NULL;
+	}
+
+	return (list);
+}
+
 int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new, const xmlDocPtr data_model)
 {
 	xmlDocPtr result, data_filtered[2] = {NULL, NULL};
-	xmlNodePtr filter_item, node;
+	xmlNodePtr node;
+	struct filter_job* jobs;
 	keyList keys;
-	int ret = EXIT_FAILURE;
+	int i, count, ret = EXIT_FAILURE;
 
 	if (new == NULL || old == NULL || filter == NULL) {
 		return EXIT_FAILURE;
@@ -5277,28 +6169,36 @@ int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new
 		/* get all keys from data model */
 		keys = get_keynode_list(data_model);
 
-		data_filtered[0] = xmlNewDoc(BAD_CAST "1.0");
-		data_filtered[1] = xmlNewDoc(BAD_CAST "1.0");
-		for (filter_item = filter->subtree_filter->children; filter_item != NULL; filter_item = filter_item->next) {
-			xmlAddChildList((xmlNodePtr)(data_filtered[0]), xmlCopyNodeList(old));
+		/* apply separately each top-level filter item, siblings on this
+		 * level are meaningless for ncxml_subtree_filter()
+		 */
+		jobs = ncxml_filter_jobs(old, filter->subtree_filter->children, keys, &count);
 
-			/* modify filter doc to deny ncxml_subtree_filter processing
-			 * siblings that are (on this top level) meaningless and they
-			 * will be processed separatelly in the next run of the loop.
-			 */
-			node = filter_item->next;
-			filter_item->next = NULL;
-			ncxml_subtree_filter(data_filtered[0]->children, filter_item, keys);
-			/* revert change made to the filter doc */
-			filter_item->next = node;
+		/* and put the results together in the filter items order */
+		data_filtered[1] = xmlNewDoc(BAD_CAST "1.0");
+		for (i = 0; i < count; i++) {
+			if (jobs[i].filter != NULL) {
+				/* not done by a worker, modify filter doc to deny
+				 * ncxml_subtree_filter processing the item's siblings
+				 */
+				node = jobs[i].filter->next;
+				jobs[i].filter->next = NULL;
+				ncxml_filter_job(&jobs[i], old, keys);
+				/* revert change made to the filter doc */
+				jobs[i].filter->next = node;
+			}
+			if ((data_filtered[0] = jobs[i].result) == NULL) {
+				continue;
+			}
 
 			if (data_filtered[1]->children == NULL) {
 				/* there are no data so far */
 				if (data_filtered[0]->children != NULL) {
 					/* we have some result, move it to [1] */
-					node = data_filtered[0]->children;
-					xmlUnlinkNode(node);
-					xmlDocSetRootElement(data_filtered[1], node);
+					while ((node = data_filtered[0]->children) != NULL) {
+						xmlUnlinkNode(node);
+						xmlAddChild((xmlNodePtr)(data_filtered[1]), node);
+					}
 				}
 			} else if (data_filtered[0]-> children != NULL) {
 				/* there are some data already filtered */
@@ -5317,7 +6217,10 @@ int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new
 				xmlFreeDoc(data_filtered[1]);
 				data_filtered[1] = result;
 			}
+			xmlFreeDoc(data_filtered[0]);
 		}
+		data_filtered[0] = NULL;
+		free(jobs);
 
 		if (keys != NULL) {
 			keyListFree(keys);
@@ -5352,6 +6255,7 @@ API int ncds_rollback(ncds_id id)
 		return (EXIT_FAILURE);
 	}
 
+	candidate_changes_reset(datastore, 0);
 	return (datastore->func.rollback(datastore));
 }
 
@@ -5381,8 +6285,8 @@ static int ncds_is_conflict(const nc_rpc * rpc, const struct nc_session * sessio
 #ifndef DISABLE_URL
 		/* if they are URLs, check if both URLs point to a single resource */
 		if (source == NC_DATASTORE_URL && nc_cpblts_enabled(session, NC_CAP_URL_ID)) {
-			query_source = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/*/"NC_NS_BASE10_ID":source/"NC_NS_BASE10_ID":url", rpc->ctxt);
-			query_target = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/*/"NC_NS_BASE10_ID":target/"NC_NS_BASE10_ID":url", rpc->ctxt);
+			query_source = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/*/"NC_NS_BASE10_ID":source/"NC_NS_BASE10_ID":url", rpc->ctxt);
+			query_target = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/*/"NC_NS_BASE10_ID":target/"NC_NS_BASE10_ID":url", rpc->ctxt);
 			if ((query_source == NULL || query_target == NULL )) {
 				return 1;
 			}
@@ -5414,30 +6318,155 @@ static int ncds_is_conflict(const nc_rpc * rpc, const struct nc_session * sessio
 	return 0;
 }
 
+/*
+ * Maximum number of the edit-configs recorded as candidate changes. If the
+ * candidate is edited more times before commit, the whole candidate is copied
+ * into the running datastore instead of applying the recorded changes.
+ */
+#ifndef NC_CANDIDATE_CHANGES_MAX
+#  define NC_CANDIDATE_CHANGES_MAX 64
+#endif
+
+/* candidate changes are not recorded for the internal datastores */
+#define CANDIDATE_TRACKED(ds) ((ds)->id >= internal_ds_count && (ds)->type != NCDS_TYPE_EMPTY)
+
 /**
- * \return NULL on success, error reply with error info else
+ * @brief Forget the recorded candidate changes.
+ *
+ * @param[in] ds Datastore to reset.
+ * @param[in] valid 1 if the candidate is the same as the running datastore,
+ * 0 if the difference is not known.
  */
-static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session* session, xmlDocPtr old, NC_EDIT_ERROPT_TYPE erropt, nc_reply *reply)
+static void candidate_changes_reset(struct ncds_ds* ds, int valid)
 {
-	char *new_data;
-	xmlDocPtr new;
-	xmlChar *config;
-	int ret;
-	struct nc_err *e = NULL, *e_new;
-	nc_reply *new_reply = NULL;
-	int modified;
-	struct transapi_list* tapi_iter;
+	struct candidate_changes* changes = &ds->candidate_changes;
+	int i;
 
-	if (reply != NULL && nc_reply_get_type(reply) == NC_REPLY_ERROR) {
-		/* use some reply to add new error messages */
-		new_reply = reply;
+	for (i = 0; i < changes->count; i++) {
+		free(changes->edits[i]);
 	}
+	free(changes->edits);
+	free(changes->defops);
+	changes->edits = NULL;
+	changes->defops = NULL;
+	changes->count = 0;
+	changes->valid = valid;
+}
+
+/**
+ * @brief Record the edit-config successfully applied to the candidate.
+ */
+static void candidate_changes_add(struct ncds_ds* ds, const char* config, NC_EDIT_DEFOP_TYPE defop)
+{
+	struct candidate_changes* changes = &ds->candidate_changes;
+	char** edits;
+	NC_EDIT_DEFOP_TYPE* defops;
+
+	if (!changes->valid) {
+		return;
+	}
+	if (defop == NC_EDIT_DEFOP_REPLACE) {
+		/* the previous changes are overwritten */
+		candidate_changes_reset(ds, 1);
+	}
+	if (changes->count >= NC_CANDIDATE_CHANGES_MAX) {
+		candidate_changes_reset(ds, 0);
+		return;
+	}
+
+	edits = realloc(changes->edits, (changes->count + 1) * sizeof(char*));
+	if (edits != NULL) {
+		changes->edits = edits;
+	}
+	defops = realloc(changes->defops, (changes->count + 1) * sizeof(NC_EDIT_DEFOP_TYPE));
+	if (defops != NULL) {
+		changes->defops = defops;
+	}
+	if (edits == NULL || defops == NULL || (changes->edits[changes->count] = strdup(config)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		candidate_changes_reset(ds, 0);
+		return;
+	}
+	changes->defops[changes->count++] = defop;
+}
+
+/**
+ * @brief Prepare a single edit-config applying the recorded candidate changes
+ * to the running datastore.
+ *
+ * Several edits are joined into one only if they merge their content without
+ * any operation or insert attribute, since edit_config() applies the
+ * operations before merging the rest of the content.
+ *
+ * @param[in] ds Datastore to commit.
+ * @param[out] edit Content of the edit-config, the caller is supposed to free it.
+ * @param[out] defop Default operation of the edit-config.
+ * @return 0 if the candidate is the same as the running datastore, 1 if the
+ * edit is prepared, -1 if the whole candidate must be copied.
+ */
+static int candidate_changes_edit(struct ncds_ds* ds, char** edit, NC_EDIT_DEFOP_TYPE* defop)
+{
+	struct candidate_changes* changes = &ds->candidate_changes;
+	size_t len = 1;
+	int i;
+
+	if (!changes->valid) {
+		return (-1);
+	} else if (changes->count == 0) {
+		return (0);
+	} else if (changes->count == 1) {
+		*defop = changes->defops[0];
+		return ((*edit = strdup(changes->edits[0])) == NULL ? -1 : 1);
+	}
+
+	for (i = 0; i < changes->count; i++) {
+		if ((changes->defops[i] != NC_EDIT_DEFOP_MERGE && changes->defops[i] != NC_EDIT_DEFOP_NOTSET)
+				|| strstr(changes->edits[i], NC_NS_BASE10) != NULL || strstr(changes->edits[i], NC_NS_YANG) != NULL) {
+			return (-1);
+		}
+		len += strlen(changes->edits[i]);
+	}
+
+	if ((*edit = malloc(len)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (-1);
+	}
+	for ((*edit)[0] = '\0', len = 0, i = 0; i < changes->count; i++) {
+		strcpy(*edit + len, changes->edits[i]);
+		len += strlen(changes->edits[i]);
+	}
+	*defop = NC_EDIT_DEFOP_MERGE;
+
+	return (1);
+}
+
+/**
+ * \param[in] edit Applied edit-config content limiting the changed parts of
+ * the configuration, NULL to compare the whole configurations.
+ * \return NULL on success, error reply with error info else
+ */
+static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session* session, xmlDocPtr old, xmlDocPtr edit, NC_EDIT_ERROPT_TYPE erropt, nc_reply *reply)
+{
+	char *new_data;
+	xmlDocPtr new;
+	xmlChar *config;
+	int ret;
+	struct nc_err *e = NULL, *e_new;
+	nc_reply *new_reply = NULL;
+	int modified;
+	uint64_t trace_start;
+	struct transapi_list* tapi_iter;
+
+	if (reply != NULL && nc_reply_get_type(reply) == NC_REPLY_ERROR) {
+		/* use some reply to add new error messages */
+		new_reply = reply;
+	}
+
+	/* find differences and call functions */
+	new_data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e);
+	new = read_datastore_data(ds->id, new_data);
+	free(new_data);
 
-	/* find differences and call functions */
-	new_data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e);
-	new = read_datastore_data(ds->id, new_data);
-	free(new_data);
-
 	/* add default values */
 	ncdflt_default_values(new, ds->ext_model, NCWD_MODE_ALL_TAGGED);
 
@@ -5461,7 +6490,9 @@ static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session
 		ncdflt_default_values(old, ds->ext_model, NCWD_MODE_ALL_TAGGED);
 
 		/* perform TransAPI transactions */
-		ret = transapi_running_changed(ds, old, new, erropt, &e);
+		trace_start = nc_trace_begin();
+		ret = transapi_running_changed(ds, old, new, edit, erropt, &e);
+		nc_trace_end(NC_TRACE_TRANSAPI, trace_start);
 		if (ret) {
 			e_new = nc_err_new(NC_ERR_OP_FAILED);
 			if (e != NULL) {
@@ -5494,14 +6525,16 @@ static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session
 		}
 		if (ret || modified) {
 			DBG("Updating XML tree after TransAPI callbacks");
+			/* running is not the base of the candidate changes anymore */
+			candidate_changes_reset(ds, 0);
 			if (ret) {
 				/* remove default nodes */
-				ncdflt_default_clear(old);
+				ncdflt_default_clear(old, ds->ext_model);
 				/* revert changes */
 				xmlDocDumpMemory(old, &config, NULL);
 			} else { /* modified != 0 */
 				/* remove default nodes */
-				ncdflt_default_clear(new);
+				ncdflt_default_clear(new, ds->ext_model);
 				/* update config data according to changes made by transAPI module */
 				xmlDocDumpMemory(new, &config, NULL);
 			}
@@ -5521,6 +6554,178 @@ static struct rpc2all_data_s {
 	struct nc_filter *filter;
 } rpc2all_data = {NULL};
 
+/**
+ * @brief Check if the filter node can select a node from the namespace.
+ *
+ * XML namespace wildcard mechanism:
+ * 1) no namespace defined and namespace is inherited from message so it
+ *    is NETCONF base namespace
+ * 2) namespace is empty: xmlns=""
+ *
+ * @return 2 for a wildcard, 1 if the namespace matches, 0 otherwise.
+ */
+static int filter_ns_match(const xmlNodePtr filter_node, const char* ns)
+{
+	char* s = NULL;
+
+	if (filter_node->ns == NULL || filter_node->ns->href == NULL ||
+			strcmp((char *)filter_node->ns->href, NC_NS_BASE10) == 0 ||
+			strlen(s = nc_clrwspace((char*)(filter_node->ns->href))) == 0) {
+		free(s);
+		return (2);
+	}
+	free(s);
+
+	return (ns != NULL && xmlStrcmp(BAD_CAST ns, filter_node->ns->href) == 0);
+}
+
+/**
+ * @brief Check if the data model can contain a top-level data node of the name.
+ * Choice, case and augment statements are transparent as for the edit-config.
+ */
+static int model_top_node(xmlNodePtr model_node, const xmlChar* name)
+{
+	xmlNodePtr aux;
+	xmlChar* aux_name;
+	int ret = 0;
+
+	for (aux = model_node->children; aux != NULL && ret == 0; aux = aux->next) {
+		if (aux->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (xmlStrcmp(aux->name, BAD_CAST "choice") == 0 ||
+				xmlStrcmp(aux->name, BAD_CAST "case") == 0 ||
+				xmlStrcmp(aux->name, BAD_CAST "augment") == 0) {
+			ret = model_top_node(aux, name);
+		} else if (xmlStrcmp(aux->name, BAD_CAST "uses") == 0) {
+			/* not resolved, anything can be there */
+			ret = 1;
+		} else if (xmlStrcmp(aux->name, BAD_CAST "container") == 0 ||
+				xmlStrcmp(aux->name, BAD_CAST "list") == 0 ||
+				xmlStrcmp(aux->name, BAD_CAST "leaf") == 0 ||
+				xmlStrcmp(aux->name, BAD_CAST "leaf-list") == 0 ||
+				xmlStrcmp(aux->name, BAD_CAST "anyxml") == 0) {
+			aux_name = xmlGetProp(aux, BAD_CAST "name");
+			ret = (xmlStrcmp(aux_name, name) == 0);
+			xmlFree(aux_name);
+		}
+	}
+
+	return (ret);
+}
+
+/* subtree filter of the <get> being processed, for the state data callbacks */
+static pthread_key_t state_filter_key;
+static pthread_once_t state_filter_once = PTHREAD_ONCE_INIT;
+
+static void state_filter_init(void)
+{
+	pthread_key_create(&state_filter_key, NULL);
+}
+
+static void state_filter_set(const struct nc_filter* filter)
+{
+	pthread_once(&state_filter_once, state_filter_init);
+	if (filter != NULL && filter->type == NC_FILTER_SUBTREE && filter->subtree_filter != NULL) {
+		pthread_setspecific(state_filter_key, filter->subtree_filter->children);
+	} else {
+		pthread_setspecific(state_filter_key, NULL);
+	}
+}
+
+API xmlNodePtr ncds_get_state_filter(void)
+{
+	pthread_once(&state_filter_once, state_filter_init);
+	return ((xmlNodePtr)pthread_getspecific(state_filter_key));
+}
+
+/**
+ * @brief Get a copy of the cached status data of the datastore, if they are
+ * still valid. The caller must hold the datastore lock.
+ *
+ * @param[out] state Copy of the cached status data, NULL if they are empty.
+ * @return 1 if the cached data were used, 0 if the callback must be called.
+ */
+static int state_cache_get(struct ncds_ds* ds, const struct nc_session* session, xmlDocPtr* state)
+{
+	struct timespec now;
+	long long age;
+
+	if (ds->state_cache == NULL || (session != NULL && session->state_nocache)) {
+		return (0);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	age = (now.tv_sec - ds->state_cache_time.tv_sec) * 1000LL + (now.tv_nsec - ds->state_cache_time.tv_nsec) / 1000000;
+	if (age >= ds->state_cache_ttl) {
+		/* expired */
+		xmlFreeDoc(ds->state_cache);
+		ds->state_cache = NULL;
+		return (0);
+	}
+
+	*state = (ds->state_cache->children == NULL) ? NULL : xmlCopyDoc(ds->state_cache, 1);
+	return (1);
+}
+
+/**
+ * @brief Remember the just retrieved status data of the datastore (if the
+ * cache is enabled). The caller must hold the datastore lock.
+ */
+static void state_cache_store(struct ncds_ds* ds, const xmlDocPtr state)
+{
+	if (ds->state_cache_ttl == 0) {
+		return;
+	}
+
+	xmlFreeDoc(ds->state_cache);
+	ds->state_cache = (state == NULL) ? xmlNewDoc(BAD_CAST "1.0") : xmlCopyDoc(state, 1);
+	clock_gettime(CLOCK_MONOTONIC, &ds->state_cache_time);
+}
+
+/**
+ * @brief Check if the current state data filter (if any) can select the child
+ * of the top-level node. It is only an estimation to generate as few state data
+ * as possible, the result is filtered properly anyway.
+ */
+static int state_filter_selects(const char* ns, const char* top, const char* child)
+{
+	xmlNodePtr filter_node, filter_child;
+
+	if ((filter_node = ncds_get_state_filter()) == NULL) {
+		return (1);
+	}
+
+	for (; filter_node != NULL; filter_node = filter_node->next) {
+		if (filter_node->type != XML_ELEMENT_NODE || !filter_ns_match(filter_node, ns) ||
+				xmlStrcmp(filter_node->name, BAD_CAST top) != 0) {
+			continue;
+		}
+		for (filter_child = filter_node->children; filter_child != NULL; filter_child = filter_child->next) {
+			if (filter_child->type == XML_TEXT_NODE && !xmlIsBlankNode(filter_child)) {
+				/* content match node */
+				return (1);
+			} else if (filter_child->type != XML_ELEMENT_NODE) {
+				continue;
+			}
+			if (filter_child->children != NULL && filter_child->children->type == XML_TEXT_NODE &&
+					!xmlIsBlankNode(filter_child->children)) {
+				/* content match node selects all its siblings */
+				return (1);
+			}
+			if (filter_ns_match(filter_child, ns) && xmlStrcmp(filter_child->name, BAD_CAST child) == 0) {
+				return (1);
+			}
+		}
+		if (xmlChildElementCount(filter_node) == 0) {
+			/* selection node */
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
 /*
  * returns:
  *  0 - filter removes data from this datastore, do not continue
@@ -5528,9 +6733,8 @@ static struct rpc2all_data_s {
  */
 static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds, const nc_rpc* rpc)
 {
-	xmlNodePtr filter_node;
+	xmlNodePtr filter_node, root;
 	int retval = 1;
-	char* s;
 
 	/* get filter if specified for this request */
 	if (rpc2all_data.filter == NULL) {
@@ -5543,23 +6747,19 @@ static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds
 	if (*filter != NULL && (*filter)->type == NC_FILTER_SUBTREE &&
 			ds->data_model && ds->data_model->ns) {
 		retval = 0;
+		root = (ds->ext_model != NULL) ? xmlDocGetRootElement(ds->ext_model) : NULL;
 		for (filter_node = (*filter)->subtree_filter->children; filter_node != NULL; filter_node = filter_node->next) {
-			/* XML namespace wildcard mechanism:
-			 * 1) no namespace defined and namespace is inherited from message so it
-			 *    is NETCONF base namespace
-			 * 2) namespace is empty: xmlns=""
-			 */
-			s = NULL;
-			if (filter_node->ns == NULL || filter_node->ns->href == NULL ||
-					strcmp((char *)filter_node->ns->href, NC_NS_BASE10) == 0 ||
-					strlen(s = nc_clrwspace((char*)(filter_node->ns->href))) == 0) {
-				free(s);
-				return (1);
-			}
-			free(s);
-
-			if (filter_node->ns && xmlStrcmp(BAD_CAST ds->data_model->ns, filter_node->ns->href) == 0) {
+			switch (filter_ns_match(filter_node, ds->data_model->ns)) {
+			case 2:
 				return (1);
+			case 1:
+				/* the datastore can contribute only with the data model's top-level nodes */
+				if (root == NULL || filter_node->type != XML_ELEMENT_NODE || model_top_node(root, filter_node->name)) {
+					return (1);
+				}
+				break;
+			default:
+				break;
 			}
 		}
 	}
@@ -5573,6 +6773,89 @@ static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds
 	return (retval);
 }
 
+/*
+ * @brief Get the namespaces of the top-level elements in the \<config\>
+ * parameter of \<edit-config\> or \<copy-config\>.
+ *
+ * @return Set of the namespaces. NULL if the applicable datastores cannot be
+ * recognized according to the namespaces (configuration data are not directly
+ * in the request or there are none).
+ */
+static xmlHashTablePtr rpc_config_namespaces(const nc_rpc* rpc)
+{
+	xmlXPathObjectPtr query_result;
+	xmlNodePtr node;
+	xmlHashTablePtr set = NULL;
+	const char* query;
+
+	switch (nc_rpc_get_op(rpc)) {
+	case NC_OP_EDITCONFIG:
+		query = "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":edit-config/"NC_NS_BASE10_ID":config";
+		break;
+	case NC_OP_COPYCONFIG:
+		query = "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":copy-config/"NC_NS_BASE10_ID":source/"NC_NS_BASE10_ID":config";
+		break;
+	default:
+		return (NULL);
+	}
+
+	if ((query_result = nc_xpath_eval(query, rpc->ctxt)) == NULL) {
+		return (NULL);
+	}
+	if (query_result->nodesetval != NULL && query_result->nodesetval->nodeNr == 1) {
+		for (node = query_result->nodesetval->nodeTab[0]->children; node != NULL; node = node->next) {
+			if (node->type != XML_ELEMENT_NODE) {
+				continue;
+			}
+			if (set == NULL && (set = xmlHashCreate(4)) == NULL) {
+				break;
+			}
+			if (node->ns != NULL) {
+				/* duplicities are ignored */
+				xmlHashAddEntry(set, node->ns->href, set);
+			}
+		}
+	}
+	xmlXPathFreeObject(query_result);
+
+	return (set);
+}
+
+/*
+ * @brief Decide whether the RPC can be applicable to the datastore.
+ *
+ * @param[in] ds Datastore to check.
+ * @param[in] config_ns Namespaces of the configuration data in the RPC, see
+ * rpc_config_namespaces().
+ * @param[in] op_model Model defining the RPC implemented by a transAPI module.
+ * @return 0 if the datastore is not supposed to process the RPC, 1 otherwise.
+ */
+static int rpc_route(const struct ncds_ds* ds, xmlHashTablePtr config_ns, const struct data_model* op_model)
+{
+	struct transapi_list* tapi_iter;
+
+	if (config_ns != NULL) {
+		/* the datastore processes only the data in its namespace */
+		return (ds->data_model != NULL && ds->data_model->ns != NULL &&
+				xmlHashLookup(config_ns, BAD_CAST ds->data_model->ns) != NULL);
+	}
+
+	if (op_model != NULL) {
+		/* the RPC is implemented by the transAPI module of the model base or augmenting the datastore */
+		if (ds->data_model == op_model) {
+			return (1);
+		}
+		for (tapi_iter = ds->transapis; op_model->transapi != NULL && tapi_iter != NULL; tapi_iter = tapi_iter->next) {
+			if (tapi_iter->tapi == op_model->transapi) {
+				return (1);
+			}
+		}
+		return (0);
+	}
+
+	return (1);
+}
+
 /**
  * @ingroup store
  * @brief Perform the requested RPC operation on the datastore.
@@ -5589,6 +6872,24 @@ static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds
  * datastore (e.g. the namespace does not match), NCDS_RPC_NOT_APPLICABLE
  * is returned.
  */
+/**
+ * @brief Finish the preparation of the datastore postponed until it is
+ * accessed. The datastore must be locked.
+ */
+static void ncds_ds_prepare(struct ncds_ds* ds)
+{
+	if (!ds->ext_model_indexed) {
+		ds->ext_model_indexed = 1;
+		if (model_index_build(ds->ext_model) != EXIT_SUCCESS) {
+			WARN("Indexing the configuration data model \"%s\" failed.", ds->data_model->name);
+		}
+	}
+
+#ifndef DISABLE_VALIDATION
+	validators_load(ds);
+#endif
+}
+
 static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, const nc_rpc* rpc)
 {
 	struct nc_err* e = NULL;
@@ -5596,13 +6897,13 @@ static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, co
 	struct nc_filter *filter = NULL;
 	char* data = NULL, *config, *model = NULL, *data2, *op_name;
 	xmlDocPtr doc1, doc2, doc_merged = NULL;
-	int len, dsid, i;
+	int len, dsid, i, cached;
 	int ret = EXIT_FAILURE;
 	nc_reply* reply = NULL, *old_reply = NULL, *new_reply;
 	xmlBufferPtr resultbuffer;
 	xmlNodePtr aux_node, node;
 	NC_OP op;
-	xmlDocPtr old = NULL;
+	xmlDocPtr old = NULL, edit_doc = NULL;
 	char * old_data = NULL;
 	NC_DATASTORE source_ds = 0, target_ds = 0;
 	struct nacm_rpc *nacm_aux;
@@ -5614,6 +6915,10 @@ static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, co
 	const char *data_ns = NULL;
 	char *aux = NULL;
 	NC_EDIT_ERROPT_TYPE erropt;
+	char *commit_edit = NULL;
+	NC_EDIT_DEFOP_TYPE commit_defop = NC_EDIT_DEFOP_NOTSET;
+	int tracked, commit_changes, rolled_back;
+	const struct ncds_lockinfo* lockinfo;
 #ifndef DISABLE_VALIDATION
 	NC_EDIT_TESTOPT_TYPE testopt;
 #endif
@@ -5622,8 +6927,7 @@ static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, co
 	xmlXPathObjectPtr url_path = NULL;
 	xmlNodePtr root;
 	xmlChar *url;
-	char url_test_empty;
-	int url_tmpfile;
+	size_t url_received;
 	xmlNsPtr ns;
 	NC_URL_PROTOCOLS protocol;
 #endif /* DISABLE_URL */
@@ -5650,8 +6954,20 @@ process_datastore:
 		ERROR("Failed to lock datastore (%s).", strerror(errno));
 		return (NULL);
 	}
+	ncds_ds_prepare(ds);
+
+	tracked = CANDIDATE_TRACKED(ds) && nc_rpc_get_type(rpc) == NC_RPC_DATASTORE_WRITE;
+	if (tracked && ds->func.was_changed(ds)) {
+		/* someone else (e.g. another process) changed the datastore */
+		candidate_changes_reset(ds, 0);
+	}
+	commit_changes = -1;
+	rolled_back = 0;
+	if (tracked && op == NC_OP_COMMIT) {
+		commit_changes = candidate_changes_edit(ds, &commit_edit, &commit_defop);
+	}
 
-	if (ds->transapis != NULL
+	if (ds->transapis != NULL && commit_changes != 0
 		&& (op == NC_OP_COMMIT || op == NC_OP_COPYCONFIG || (op == NC_OP_EDITCONFIG && (nc_rpc_get_testopt(rpc) != NC_EDIT_TESTOPT_TEST))) &&
 		(nc_rpc_get_target(rpc) == NC_DATASTORE_RUNNING)) {
 
@@ -5659,6 +6975,7 @@ process_datastore:
 		old = read_datastore_data(ds->id, old_data);
 		if (old == NULL) {/* cannot get or parse data */
 			pthread_mutex_unlock(&ds->lock);
+			free(commit_edit);
 			if (e == NULL) { /* error not set */
 				e = nc_err_new(NC_ERR_OP_FAILED);
 				nc_err_set(e, NC_ERR_PARAM_MSG, "TransAPI: Failed to get data from RUNNING datastore.");
@@ -5720,48 +7037,71 @@ process_datastore:
 			break;
 		}
 
-		if ((data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e)) == NULL ) {
-			if (e == NULL ) {
-				ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
-				e = nc_err_new(NC_ERR_OP_FAILED);
+		/* status data may be still cached from a previous request */
+		doc2 = NULL;
+		cached = (ds->get_state_xml != NULL || ds->get_state != NULL) && state_cache_get(ds, session, &doc2);
+
+		if (!cached && ds->get_state_xml == NULL && ds->get_state != NULL) {
+			/* the status data callback needs the configuration as a string */
+			if ((data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e)) == NULL ) {
+				if (e == NULL ) {
+					ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
+					e = nc_err_new(NC_ERR_OP_FAILED);
+				}
+				break;
 			}
+			/* convert configuration data into XML structure */
+			doc1 = read_datastore_data(ds->id, data);
+		} else if ((doc1 = getconfig_datastore_data(ds, session, NC_DATASTORE_RUNNING, NULL, &e)) == NULL) {
+			xmlFreeDoc(doc2);
 			break;
 		}
 
 		if (ds->get_state_xml != NULL || ds->get_state != NULL) {
 			/* caller provided callback function to retrieve status data */
-
-			/* convert configuration data into XML structure */
-			doc1 = read_datastore_data(ds->id, data);
 			if (doc1 == NULL || doc1->children == NULL) {
 				/* empty */
 				xmlFreeDoc(doc1);
 				doc1 = NULL;
 			}
 
-			if (ds->get_state_xml != NULL) {
-				/* status data are directly in XML format */
-				doc2 = ds->get_state_xml(ds->ext_model, doc1, &e);
-			} else if (ds->get_state != NULL) {
-				/* status data are provided as string, convert it into XML structure */
-				xmlDocDumpMemory(ds->ext_model, (xmlChar**) (&model), &len);
-				data2 = ds->get_state(model, data, &e);
-				doc2 = read_datastore_data(ds->id, data2);
-				if (doc2 == NULL || doc2->children == NULL) {
-					/* empty */
-					xmlFreeDoc(doc2);
-					doc2 = NULL;
-				}
-				free(model);
-				free(data2);
+			if (cached) {
+				/* doc2 already contains the cached status data */
 			} else {
-				/* we have no status data */
-				doc2 = NULL;
+				/*
+				 * let the callbacks know what is requested, but the status
+				 * data going to the cache must be complete
+				 */
+				state_filter_set(ds->state_cache_ttl == 0 ? filter : NULL);
+				if (ds->get_state_xml != NULL) {
+					/* status data are directly in XML format */
+					doc2 = ds->get_state_xml(ds->ext_model, doc1, &e);
+				} else {
+					/* status data are provided as string, convert it into XML structure */
+					xmlDocDumpMemory(ds->ext_model, (xmlChar**) (&model), &len);
+					data2 = ds->get_state(model, data, &e);
+					doc2 = read_datastore_data(ds->id, data2);
+					if (doc2 == NULL || doc2->children == NULL) {
+						/* empty */
+						xmlFreeDoc(doc2);
+						doc2 = NULL;
+					}
+					free(model);
+					free(data2);
+				}
+				state_filter_set(NULL);
+
+				if (e == NULL) {
+					state_cache_store(ds, doc2);
+				}
 			}
 
 			if (e != NULL) {
 				/* state data retrieval error */
 				free(data);
+				data = NULL;
+				xmlFreeDoc(doc1);
+				xmlFreeDoc(doc2);
 				break;
 			}
 
@@ -5788,9 +7128,10 @@ process_datastore:
 				xmlFreeDoc(doc2);
 			}
 		} else {
-			doc_merged = read_datastore_data(ds->id, data);
+			doc_merged = doc1;
 		}
 		free(data);
+		data = NULL;
 
 		if (doc_merged == NULL) {
 			ERROR("Reading the configuration datastore failed.");
@@ -5837,20 +7178,7 @@ process_datastore:
 			break;
 		}
 
-		if ((data = ds->func.getconfig(ds, session, nc_rpc_get_source(rpc), &e)) == NULL) {
-			if (e == NULL) {
-				ERROR ("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
-				e = nc_err_new(NC_ERR_OP_FAILED);
-			}
-			break;
-		}
-		doc_merged = read_datastore_data(ds->id, data);
-		free(data);
-
-		if (doc_merged == NULL) {
-			ERROR("Reading configuration datastore failed.");
-			e = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(e, NC_ERR_PARAM_MSG, "Invalid datastore content.");
+		if ((doc_merged = getconfig_datastore_data(ds, session, nc_rpc_get_source(rpc), filter, &e)) == NULL) {
 			break;
 		}
 
@@ -6013,7 +7341,14 @@ process_datastore:
 apply_editcopyconfig:
 		/* perform the operation */
 		if (op == NC_OP_EDITCONFIG) {
+			if (old != NULL) {
+				/* the changes made by the edit are needed for transAPI */
+				edit_changes_start();
+			}
 			ret = ds->func.editconfig(ds, session, rpc, target_ds, config, nc_rpc_get_defop(rpc), nc_rpc_get_erropt(rpc), &e);
+			if (old != NULL) {
+				edit_doc = edit_changes_stop();
+			}
 #ifndef DISABLE_VALIDATION
 			if (ret == EXIT_SUCCESS && (nc_cpblts_enabled(session, NC_CAP_VALIDATE11_ID) || nc_cpblts_enabled(session, NC_CAP_VALIDATE10_ID))) {
 				/* process test option if set */
@@ -6046,6 +7381,7 @@ apply_editcopyconfig:
 						 * only test was required or error occurred
 						 */
 						ds->func.rollback(ds);
+						rolled_back = 1;
 					}
 
 					break;
@@ -6055,6 +7391,9 @@ apply_editcopyconfig:
 				}
 			}
 #endif
+			if (tracked && ret == EXIT_SUCCESS && !rolled_back && target_ds == NC_DATASTORE_CANDIDATE) {
+				candidate_changes_add(ds, config, nc_rpc_get_defop(rpc));
+			}
 		} else if (op == NC_OP_COPYCONFIG) {
 #ifndef DISABLE_URL
 			if (source_ds == NC_DATASTORE_URL) {
@@ -6076,7 +7415,7 @@ apply_editcopyconfig:
 			}
 			if (target_ds == NC_DATASTORE_URL && nc_cpblts_enabled(session, NC_CAP_URL_ID)) {
 				/* get target url */
-				url_path = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/*/"NC_NS_BASE10_ID":target/"NC_NS_BASE10_ID":url", rpc->ctxt);
+				url_path = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/*/"NC_NS_BASE10_ID":target/"NC_NS_BASE10_ID":url", rpc->ctxt);
 				if (url_path == NULL || xmlXPathNodeSetIsEmpty(url_path->nodesetval)) {
 					ERROR("%s: unable to get URL path from <copy-config> request.", __func__);
 					e = nc_err_new(NC_ERR_BAD_ELEM);
@@ -6113,19 +7452,9 @@ apply_editcopyconfig:
 					 * Then data would merge and we will have merged wanted data with non-wanted data from remote file before editing.
 					 * Thats FEATURE, not bug!!!. I recommend to call ncds_apply_rpc2all and before that use delete-config on remote file.
 					 */
-					url_tmpfile = -1;
-					if (nc_url_check((char*)url) == 0) {
-						url_tmpfile = nc_url_open((char*) url);
-						/* check that the file has some content */
-						if (read(url_tmpfile, &url_test_empty, 1) <= 0) {
-							close(url_tmpfile);
-							url_tmpfile = -1;
-						} else {
-							/* go back to the beginning of the file */
-							lseek(url_tmpfile, 0, SEEK_SET);
-						}
-					}
-					if (url_tmpfile == -1) {
+					/* the remote file is parsed while it is being downloaded */
+					doc1 = nc_url_read_doc((char*) url, &url_received);
+					if (doc1 == NULL && url_received == 0) {
 						/*
 						 * remote file is empty or does not exists,
 						 * so create empty document with <config> root element
@@ -6136,20 +7465,19 @@ apply_editcopyconfig:
 						xmlSetNs(root, ns);
 						xmlDocSetRootElement(doc1, root);
 					} else {
-						/* read content of the remote file */
-						if ((doc1 = xmlReadFd(url_tmpfile, NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
-							close(url_tmpfile);
+						/* check content of the remote file */
+						if (doc1 == NULL) {
 							ERROR("%s: error reading XML data from the URL file", __func__);
 							e = nc_err_new(NC_ERR_OP_FAILED);
 							nc_err_set(e, NC_ERR_PARAM_MSG, "libnetconf internal server error, see error log.");
 							break;
 						}
-						close(url_tmpfile);
 						root = xmlDocGetRootElement(doc1);
-						if (xmlStrcmp(BAD_CAST "config", root->name) != 0) {
+						if (root == NULL || xmlStrcmp(BAD_CAST "config", root->name) != 0) {
 							ERROR("%s: no config data in remote file (%s)", __func__, url);
 							e = nc_err_new(NC_ERR_OP_FAILED);
 							nc_err_set(e, NC_ERR_PARAM_MSG, "Invalid remote configuration file, missing top level <config> element.");
+							xmlFreeDoc(doc1);
 							break;
 						}
 
@@ -6186,14 +7514,21 @@ apply_editcopyconfig:
 						break;
 					}
 
-					/* copy local data to "remote" document */
-					xmlAddChildList(root, xmlCopyNodeList(doc2->children));
+					/* move local data to "remote" document */
+					for (node = doc2->children; node != NULL; node = aux_node) {
+						aux_node = node->next;
+						xmlUnlinkNode(node);
+						if (xmlDOMWrapAdoptNode(NULL, doc2, node, doc1, root, 0) != 0) {
+							ERROR("xmlDOMWrapAdoptNode failed (%s:%d).", __FILE__, __LINE__);
+							xmlFreeNode(node);
+							continue;
+						}
+						xmlAddChild(root, node);
+					}
+					xmlFreeDoc(doc2);
 
-					xmlDocDumpFormatMemory(doc1, (xmlChar**) (&data), NULL, 1);
-					nc_url_upload(data, (char*) url, &e);
-					free(data);
+					nc_url_upload_doc(doc1, (char*) url, &e);
 					xmlFreeDoc(doc1);
-					xmlFreeDoc(doc2);
 					break;
 				default:
 					ERROR("%s: invalid source datastore for URL target", __func__);
@@ -6238,7 +7573,7 @@ apply_editcopyconfig:
 		target_ds  = nc_rpc_get_target(rpc);
 #ifndef DISABLE_URL
 		if (target_ds == NC_DATASTORE_URL && nc_cpblts_enabled(session, NC_CAP_URL_ID)) {
-			url_path = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":delete-config/"NC_NS_BASE10_ID":target/"NC_NS_BASE10_ID":url", rpc->ctxt);
+			url_path = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":delete-config/"NC_NS_BASE10_ID":target/"NC_NS_BASE10_ID":url", rpc->ctxt);
 			if (url_path == NULL || xmlXPathNodeSetIsEmpty(url_path->nodesetval)) {
 				ERROR("%s: unable to get URL path from <delete-config> request.", __func__);
 				e = nc_err_new(NC_ERR_BAD_ELEM);
@@ -6277,11 +7612,41 @@ apply_editcopyconfig:
 			break;
 		}
 
-		if (nc_cpblts_enabled (session, NC_CAP_CANDIDATE_ID)) {
-			ret = ds->func.copyconfig (ds, session, rpc, NC_DATASTORE_RUNNING, NC_DATASTORE_CANDIDATE, NULL, &e);
-		} else {
+		if (!nc_cpblts_enabled (session, NC_CAP_CANDIDATE_ID)) {
 			e = nc_err_new (NC_ERR_OP_NOT_SUPPORTED);
 			ret = EXIT_FAILURE;
+		} else if (commit_changes == 0) {
+			/* candidate is the same as running, there is nothing to commit */
+			ret = EXIT_SUCCESS;
+		} else if (commit_changes == 1) {
+			/* apply only the changes made in candidate since it was the same
+			 * as running - the candidate must not be locked by someone else */
+			lockinfo = ds->func.get_lockinfo(ds, NC_DATASTORE_CANDIDATE);
+			if (lockinfo != NULL && lockinfo->sid != NULL && strcmp(lockinfo->sid, session->session_id) != 0) {
+				e = nc_err_new(NC_ERR_IN_USE);
+				ret = EXIT_FAILURE;
+				break;
+			}
+
+			DBG("Committing %d recorded change(s) of the candidate datastore.", ds->candidate_changes.count);
+			if (old != NULL) {
+				edit_changes_start();
+			}
+			ret = ds->func.editconfig(ds, session, rpc, NC_DATASTORE_RUNNING, commit_edit, commit_defop, NC_EDIT_ERROPT_ROLLBACK, &e);
+			if (old != NULL) {
+				edit_doc = edit_changes_stop();
+			}
+			if (ret == EXIT_FAILURE && (e == NULL || (strcmp(e->tag, "access-denied") && strcmp(e->tag, "in-use")))) {
+				/* running does not match the recorded changes, copy the whole candidate */
+				VERB("Commit of the candidate changes failed, copying the whole candidate.");
+				nc_err_free(e);
+				e = NULL;
+				xmlFreeDoc(edit_doc);
+				edit_doc = NULL;
+				ret = ds->func.copyconfig(ds, session, rpc, NC_DATASTORE_RUNNING, NC_DATASTORE_CANDIDATE, NULL, &e);
+			}
+		} else {
+			ret = ds->func.copyconfig (ds, session, rpc, NC_DATASTORE_RUNNING, NC_DATASTORE_CANDIDATE, NULL, &e);
 		}
 		break;
 	case NC_OP_DISCARDCHANGES:
@@ -6409,12 +7774,48 @@ apply_editcopyconfig:
 		}
 	}
 
+	/* keep track of the difference between candidate and running */
+	if (tracked && reply != NCDS_RPC_NOT_APPLICABLE && nc_reply_get_type(reply) == NC_REPLY_OK) {
+		switch (op) {
+		case NC_OP_COMMIT:
+		case NC_OP_DISCARDCHANGES:
+			candidate_changes_reset(ds, 1);
+			break;
+		case NC_OP_COPYCONFIG:
+			if (nc_rpc_get_target(rpc) == NC_DATASTORE_CANDIDATE) {
+				candidate_changes_reset(ds, nc_rpc_get_source(rpc) == NC_DATASTORE_RUNNING);
+			} else if (nc_rpc_get_target(rpc) == NC_DATASTORE_RUNNING) {
+				candidate_changes_reset(ds, 0);
+			}
+			break;
+		case NC_OP_EDITCONFIG:
+			/* changes of candidate are recorded when applied */
+			if (nc_rpc_get_target(rpc) == NC_DATASTORE_RUNNING) {
+				candidate_changes_reset(ds, 0);
+			}
+			break;
+		case NC_OP_DELETECONFIG:
+			if (nc_rpc_get_target(rpc) == NC_DATASTORE_CANDIDATE) {
+				candidate_changes_reset(ds, 0);
+			}
+			break;
+		case NC_OP_UNLOCK:
+			if (nc_rpc_get_target(rpc) == NC_DATASTORE_CANDIDATE) {
+				/* libnetconf's datastores discard the candidate changes on unlock */
+				candidate_changes_reset(ds, ds->type == NCDS_TYPE_FILE || ds->type == NCDS_TYPE_KV);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
 	/* if transapi used, rpc affected running and succeeded get its actual content */
 	/*
 	 * skip transapi if <edit-config> was performed with test-option set
 	 * to test-only value
 	 */
-	if (ds->transapis != NULL && ds->tapi_callbacks_count
+	if (ds->transapis != NULL && ds->tapi_callbacks_count && old != NULL
 		&& (op == NC_OP_COMMIT || op == NC_OP_COPYCONFIG || (op == NC_OP_EDITCONFIG && (nc_rpc_get_testopt(rpc) != NC_EDIT_TESTOPT_TEST))) &&
 		(nc_rpc_get_target(rpc) == NC_DATASTORE_RUNNING && nc_reply_get_type(reply) == NC_REPLY_OK)) {
 
@@ -6425,13 +7826,30 @@ apply_editcopyconfig:
 			erropt = NC_EDIT_ERROPT_ROLLBACK;
 		}
 
-		if ((new_reply = ncds_apply_transapi(ds, session, old, erropt, NULL)) != NULL) {
+		if ((new_reply = ncds_apply_transapi(ds, session, old, edit_doc, erropt, NULL)) != NULL) {
 			nc_reply_free(reply);
 			reply = new_reply;
 		}
 	}
+
+	/* the cached status data may depend on the changed running configuration */
+	if (ds->state_cache != NULL && reply != NCDS_RPC_NOT_APPLICABLE
+			&& (op == NC_OP_COMMIT || op == NC_OP_COPYCONFIG || op == NC_OP_EDITCONFIG || op == NC_OP_DELETECONFIG)
+			&& nc_rpc_get_target(rpc) == NC_DATASTORE_RUNNING) {
+		xmlFreeDoc(ds->state_cache);
+		ds->state_cache = NULL;
+	}
 	xmlFreeDoc (old);
 	old = NULL;
+	xmlFreeDoc(edit_doc);
+	edit_doc = NULL;
+	free(commit_edit);
+	commit_edit = NULL;
+
+	if (tracked) {
+		/* the changes made by this request are already known */
+		ds->func.was_changed(ds);
+	}
 
 	pthread_mutex_unlock(&ds->lock);
 
@@ -6461,34 +7879,6 @@ apply_editcopyconfig:
 	return (reply);
 }
 
-static char* serialize_cpblts(const struct nc_cpblts *capabilities)
-{
-	char *aux = NULL, *retval = NULL;
-	int i;
-
-	if (capabilities == NULL) {
-		return (NULL);
-	}
-
-	for (i = 0; i < capabilities->items; i++) {
-		if (asprintf(&retval, "%s<capability>%s</capability>",
-				(aux == NULL) ? "" : aux,
-				capabilities->list[i]) == -1) {
-			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
-			continue;
-		}
-		free(aux);
-		aux = retval;
-		retval = NULL;
-	}
-	if (asprintf(&retval, "<capabilities>%s</capabilities>", aux) == -1) {
-		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
-		retval = NULL;
-	}
-	free(aux);
-	return(retval);
-}
-
 API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc, ncds_id* ids[])
 {
 	struct ncds_ds_list* ds, *ds_rollback;
@@ -6501,6 +7891,8 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 	NC_EDIT_ERROPT_TYPE erropt = NC_EDIT_ERROPT_NOTSET;
 	NC_RPC_TYPE req_type;
 	struct nc_err *e = NULL;
+	const struct data_model *op_model;
+	xmlHashTablePtr config_ns = NULL;
 
 	if (rpc == NULL || session == NULL) {
 		ERROR("%s: invalid parameter %s", __func__, (rpc==NULL)?"rpc":"session");
@@ -6510,7 +7902,7 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 	/* check that we have a valid definition of the requested RPC */
 	op_name = nc_rpc_get_op_name(rpc);
 	op_namespace = nc_rpc_get_op_namespace(rpc);
-	if (ncds_get_model_operation(op_name, op_namespace) == NULL) {
+	if ((op_model = ncds_get_model_operation(op_name, op_namespace)) == NULL) {
 		/* rpc operation is not defined in any known module */
 		ERROR("%s: unsupported NETCONF operation (%s) requested.", __func__, op_name);
 		free(op_name);
@@ -6532,7 +7924,7 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 		erropt = nc_rpc_get_erropt(rpc);
 		break;
 	case NC_OP_GET:
-		server_capabilities = serialize_cpblts(session->capabilities);
+		server_cpblts = session->capabilities;
 		/* no break */
 	case NC_OP_GETCONFIG:
 		rpc2all_data.filter = nc_rpc_get_filter(rpc);
@@ -6542,6 +7934,28 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 		break;
 	}
 
+	/*
+	 * select the datastores the request is intended for - according to the
+	 * namespaces of the configuration data or the datastores implementing
+	 * the RPC
+	 */
+	if (op == NC_OP_EDITCONFIG || op == NC_OP_COPYCONFIG) {
+		config_ns = rpc_config_namespaces(rpc);
+	}
+	if (op == NC_OP_UNKNOWN) {
+		for (ds = ncds.datastores; ds != NULL; ds = ds->next) {
+			if (ds->datastore->id >= internal_ds_count && rpc_route(ds->datastore, NULL, op_model)) {
+				break;
+			}
+		}
+		if (ds == NULL) {
+			/* no particular datastore found, offer the RPC to all of them */
+			op_model = NULL;
+		}
+	} else {
+		op_model = NULL;
+	}
+
 	for (ds = ncds.datastores; ds != NULL; ds = ds->next) {
 		/* skip internal datastores */
 		if (ds->datastore->id > 0 && ds->datastore->id < internal_ds_count) {
@@ -6549,7 +7963,14 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 		}
 
 		/* apply RPC on a single datastore */
-		reply = ncds_apply_rpc(ds->datastore->id, session, rpc);
+		if (ds->datastore->id != NCDS_INTERNAL_ID && !rpc_route(ds->datastore, config_ns, op_model)) {
+			reply = NCDS_RPC_NOT_APPLICABLE;
+		} else {
+			/* let the datastore code add the phases to the rpc's trace */
+			nc_trace_attach(rpc->trace);
+			reply = ncds_apply_rpc(ds->datastore->id, session, rpc);
+			nc_trace_attach(NULL);
+		}
 		if (ids != NULL && reply != NCDS_RPC_NOT_APPLICABLE) {
 			ncds.datastores_ids[id_i] = ds->datastore->id;
 			id_i++;
@@ -6563,8 +7984,8 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 			if ((new_reply = nc_reply_merge(2, old_reply, reply)) == NULL) {
 				nc_filter_free(rpc2all_data.filter);
 				rpc2all_data.filter = NULL;
-				free(server_capabilities);
-				server_capabilities = NULL;
+				server_cpblts = NULL;
+				xmlHashFree(config_ns, NULL);
 
 				if (nc_reply_get_type(old_reply) == NC_REPLY_ERROR) {
 					return (old_reply);
@@ -6580,6 +8001,7 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 		if (reply != NCDS_RPC_NOT_APPLICABLE && nc_reply_get_type(reply) == NC_REPLY_ERROR) {
 			if (req_type == NC_RPC_DATASTORE_WRITE) {
 				if (erropt == NC_EDIT_ERROPT_NOTSET || erropt == NC_EDIT_ERROPT_STOP) {
+					xmlHashFree(config_ns, NULL);
 					return (reply);
 				} else if (erropt == NC_EDIT_ERROPT_ROLLBACK) {
 					/* rollback previously changed datastores */
@@ -6605,10 +8027,11 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 						}
 
 						ds_rollback->datastore->func.rollback(ds_rollback->datastore);
+						candidate_changes_reset(ds_rollback->datastore, 0);
 
 						/* transAPI rollback */
 						if (transapi) {
-							reply = ncds_apply_transapi(ds_rollback->datastore, session, old, erropt, reply);
+							reply = ncds_apply_transapi(ds_rollback->datastore, session, old, NULL, erropt, reply);
 							xmlFreeDoc(old);
 						}
 
@@ -6637,9 +8060,9 @@ cleanup:
 	/* clean up the common data for calling nc_apply_rpc() */
 	nc_filter_free(rpc2all_data.filter);
 	rpc2all_data.filter = NULL;
+	xmlHashFree(config_ns, NULL);
 
-	free(server_capabilities);
-	server_capabilities = NULL;
+	server_cpblts = NULL;
 
 	return (reply);
 }
@@ -6702,6 +8125,12 @@ API void ncds_break_locks(const struct nc_session* session)
 				for (j=0; j<3; j++) {
 					/* try to unlock datastore */
 					ds->datastore->func.unlock(ds->datastore, sessions[i], ds_type[j], &e);
+					if (e == NULL && ds_type[j] == NC_DATASTORE_CANDIDATE) {
+						/* the candidate changes were discarded */
+						pthread_mutex_lock(&ds->datastore->lock);
+						candidate_changes_reset(ds->datastore, 0);
+						pthread_mutex_unlock(&ds->datastore->lock);
+					}
 					if (e) {
 						nc_err_free(e);
 						e = NULL;
@@ -6761,53 +8190,92 @@ API void ncds_break_locks(const struct nc_session* session)
 	return;
 }
 
-const struct data_model* ncds_get_model_data(const char* namespace)
+/*
+ * index of the models_list, the data models are indexed by their namespace and
+ * their RPCs by the namespace and the operation name
+ */
+static pthread_rwlock_t models_index_lock = PTHREAD_RWLOCK_INITIALIZER;
+static xmlHashTablePtr models_index = NULL;
+static unsigned int models_index_version = 0;
+
+/*
+ * @brief Build the models index again. Only the first model of the
+ * models_list with the specific namespace is reachable, as it was by the
+ * linear search of the list.
+ *
+ * models_index_lock is supposed to be write-locked.
+ */
+static void models_index_update(void)
 {
 	struct model_list* listitem;
-	struct data_model *model = NULL;
+	int i;
 
-	if (namespace == NULL) {
-		return (NULL);
+	xmlHashFree(models_index, NULL);
+	models_index = xmlHashCreate(0);
+	models_index_version = models_version;
+	if (models_index == NULL) {
+		return;
 	}
 
 	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
-		if (listitem->model->ns != NULL && strcmp(listitem->model->ns, namespace) == 0) {
-			/* namespace matches */
-			model = listitem->model;
-			break;
+		if (listitem->model->ns == NULL ||
+				xmlHashAddEntry2(models_index, BAD_CAST listitem->model->ns, NULL, listitem->model) != 0) {
+			/* no namespace or the namespace is already covered */
+			continue;
+		}
+		for (i = 0; listitem->model->rpcs != NULL && listitem->model->rpcs[i] != NULL; i++) {
+			xmlHashAddEntry2(models_index, BAD_CAST listitem->model->ns, BAD_CAST listitem->model->rpcs[i], listitem->model);
 		}
 	}
+}
 
-	if (model != NULL) {
-		/* model found */
-		return (model);
+/*
+ * @brief Find the model according to its namespace or the operation name
+ * (if not NULL) and the namespace.
+ */
+static const struct data_model* models_index_lookup(const char* namespace, const char* operation)
+{
+	const struct data_model *model;
+
+	pthread_rwlock_rdlock(&models_index_lock);
+	if (models_index == NULL || models_index_version != models_version) {
+		/* the models_list changed, rebuild the index */
+		pthread_rwlock_unlock(&models_index_lock);
+		pthread_rwlock_wrlock(&models_index_lock);
+		if (models_index == NULL || models_index_version != models_version) {
+			models_index_update();
+		}
 	}
+	model = (models_index == NULL) ? NULL : xmlHashLookup2(models_index, BAD_CAST namespace, BAD_CAST operation);
+	pthread_rwlock_unlock(&models_index_lock);
 
-	/* model not found */
-	return (NULL);
+	return (model);
 }
 
-const struct data_model* ncds_get_model_operation(const char* operation, const char* namespace)
+static void models_index_cleanup(void)
 {
-	const struct data_model *model = NULL;
-	int i;
+	pthread_rwlock_wrlock(&models_index_lock);
+	xmlHashFree(models_index, NULL);
+	models_index = NULL;
+	pthread_rwlock_unlock(&models_index_lock);
+}
 
-	if (operation == NULL || namespace == NULL) {
+const struct data_model* ncds_get_model_data(const char* namespace)
+{
+	if (namespace == NULL) {
 		return (NULL);
 	}
 
-	model = ncds_get_model_data(namespace);
-	if (model != NULL && model->rpcs != NULL ) {
-		for (i = 0; model->rpcs[i] != NULL ; i++) {
-			if (strcmp(model->rpcs[i], operation) == 0) {
-				/* operation definition found */
-				return (model);
-			}
-		}
+	return (models_index_lookup(namespace, NULL));
+}
+
+const struct data_model* ncds_get_model_operation(const char* operation, const char* namespace)
+{
+	if (operation == NULL || namespace == NULL) {
+		return (NULL);
 	}
 
-	/* oepration definition not found */
-	return (NULL);
+	return (models_index_lookup(namespace, operation));
 }
 
 const struct data_model* ncds_get_model_notification(const char* notification, const char* namespace)
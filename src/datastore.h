@@ -55,7 +55,8 @@ typedef enum {
 	NCDS_TYPE_ERROR = -1, /**< virtual enum value for internal purposes */
 	NCDS_TYPE_EMPTY, /**< No real datastore. For read-only devices. */
 	NCDS_TYPE_FILE, /**< Datastores implemented as files */
-	NCDS_TYPE_CUSTOM /**< User-defined datastore */
+	NCDS_TYPE_CUSTOM, /**< User-defined datastore */
+	NCDS_TYPE_KV /**< Datastores implemented as an embedded key-value store */
 } NCDS_TYPE;
 
 /**
@@ -139,7 +140,13 @@ extern char error_area;
  *
  * - \ref fileds (*NCDS_TYPE_FILE*)
  *
- *   ncds_file_set_path() to set file to store datastore content.
+ *   ncds_file_set_path() to set file to store datastore content,
+ *   ncds_file_set_split() to store each configuration datastore in a separate
+ *   file.
+ *
+ * - \ref kvds (*NCDS_TYPE_KV*)
+ *
+ *   ncds_kv_set_path() to set file to store datastore content.
  *
  * - \ref customds (*NCDS_TYPE_CUSTOM*)
  *
@@ -372,6 +379,61 @@ int ncds_add_augment_transapi(const char* model_path, const char* callbacks_path
  */
 int ncds_set_validation(struct ncds_ds* ds, int enable, const char* relaxng, const char* schematron);
 
+/**
+ * @ingroup store
+ * @brief Cache the status data of the specified datastore.
+ *
+ * Status data returned by the datastore's get_state() callback (or the
+ * transAPI get_state_data() function) are reused by all \<get\> requests
+ * received within the specified time. The cache is dropped whenever the
+ * running configuration of the datastore is changed. By default, the cache
+ * is disabled and the callback is called for every \<get\> request.
+ *
+ * When the cache is enabled, the callback is expected to return the complete
+ * status data regardless of ncds_get_state_filter().
+ *
+ * @param[in] ds Datastore structure to be configured.
+ * @param[in] ttl Time (in milliseconds) for which the retrieved status data
+ * are valid, 0 to disable the cache.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_set_state_cache(struct ncds_ds* ds, unsigned int ttl);
+
+/**
+ * @ingroup transapi
+ * @brief Allow calling the transAPI callbacks of the datastore concurrently.
+ *
+ * Sibling subtrees of the configuration changes whose callbacks are not
+ * ordered by their priorities (typically the instances of the same list, e.g.
+ * interfaces) are then applied by up to the specified number of threads. The
+ * callbacks inside a subtree are still called one by one in the usual order
+ * and the following changes are applied only after all the concurrent ones
+ * are finished. All the changes of a concurrently applied group are tried even
+ * if some of them fail, the reverting of the changes on failure is not
+ * affected. Changes are always applied one by one with the
+ * continue-on-error \<edit-config\> error option.
+ *
+ * The transAPI module callbacks must be thread safe to enable this.
+ *
+ * @param[in] ds Datastore structure to be configured.
+ * @param[in] workers Maximum number of concurrently working threads, 0 (the
+ * default) or 1 to call the callbacks one by one.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_set_transapi_workers(struct ncds_ds* ds, unsigned int workers);
+
+/**
+ * @ingroup store
+ * @brief Make the \<get\> requests of the session always call the status data
+ * callbacks instead of using the datastores' caches set by
+ * ncds_set_state_cache().
+ *
+ * @param[in] session NETCONF session to be configured.
+ * @param[in] bypass 1 to bypass the status data caches, 0 to use them.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_state_cache_bypass(struct nc_session* session, int bypass);
+
 /**
  * @defgroup fileds File Datastore
  * @ingroup store
@@ -395,6 +457,54 @@ int ncds_set_validation(struct ncds_ds* ds, int enable, const char* relaxng, con
  */
 int ncds_file_set_path(struct ncds_ds* datastore, const char* path);
 
+/**
+ * @ingroup fileds
+ * @brief Store each configuration datastore (running, startup and candidate)
+ * in a separate file with its own lock.
+ *
+ * The files are named according to the path set by ncds_file_set_path() with
+ * the *.running*, *.startup* and *.candidate* suffix. If some of the files
+ * does not exist, it is created from the content of the file set by
+ * ncds_file_set_path(). Operations on different configuration datastores
+ * then do not block each other and each change rewrites only the file of the
+ * affected configuration datastore.
+ *
+ * The function must be called before ncds_init().
+ *
+ * @param[in] datastore Datastore structure to be configured.
+ * @param[in] split Non-zero to store the configuration datastores separately,
+ * zero (default) to store them all in the single file.
+ * @return 0 on success, non-zero on error.
+ */
+int ncds_file_set_split(struct ncds_ds* datastore, int split);
+
+/**
+ * @defgroup kvds Key-Value Datastore
+ * @ingroup store
+ * @brief Specific functions for NCDS_TYPE_KV type of datastore implementation.
+ *
+ * All the configuration datastores are stored in a single file as sorted
+ * records of the configuration data nodes. Each change writes a new version
+ * of the file and atomically replaces the previous one, so the readers work
+ * with a consistent snapshot of the file without any locking.
+ */
+
+/**
+ * @ingroup kvds
+ * @brief Assign the path of the datastore file into the datastore structure.
+ *
+ * If the file does not exist, it is created. Besides the datastore file,
+ * the *.lock* file is created next to it to serialize the writers.
+ *
+ * @param[in] datastore Datastore structure to be configured.
+ * @param[in] path File path to the file storing configuration datastores.
+ * @return
+ * - 0 on success
+ * - -1 Invalid datastore
+ * - -2 Invalid path ((does not exist && can not be created) || insufficient rights)
+ */
+int ncds_kv_set_path(struct ncds_ds* datastore, const char* path);
+
 /**
  * @ingroup store
  * @brief Activate datastore structure for use.
@@ -524,6 +634,24 @@ const char* ncds_get_model_path(ncds_id id);
  */
 int ncds_add_models_path(const char* path);
 
+/**
+ * @ingroup store
+ * @brief Specify a directory where the data models prepared by
+ * ncds_consolidate() are cached for the following starts of the server.
+ *
+ * The cache stores the datastores' data models with the resolved uses
+ * statements. A cached data model is used only if neither its file nor the
+ * files of the models it imports have changed. Augments, refines and features
+ * are still processed by every ncds_consolidate() call.
+ *
+ * The directory must be writable by the server. Several server processes can
+ * share it.
+ *
+ * @param[in] path Directory path, NULL to stop using the cache.
+ * @return 0 on success, non-zero on error.
+ */
+int ncds_set_models_cache(const char* path);
+
 /**
  * @ingroup store
  * @brief Add an configuration data model to the internal list of models. Such
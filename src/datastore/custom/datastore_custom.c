@@ -58,6 +58,8 @@
 #include "datastore_custom_private.h"
 #include "datastore_custom.h"
 #include "../edit_config.h"
+#include "../../transapi/yinparser.h"
+#include "../../transapi/xmldiff.h"
 
 static struct ncds_lockinfo lockinfo_running = {NC_DATASTORE_RUNNING, NULL, NULL};
 static struct ncds_lockinfo lockinfo_startup = {NC_DATASTORE_STARTUP, NULL, NULL};
@@ -93,6 +95,9 @@ API void ncds_custom_set_data(struct ncds_ds* ds, void *custom_data, const struc
 
 	c_ds->data = custom_data;
 	c_ds->callbacks = callbacks;
+
+	/* let the library get the data directly as a document if possible */
+	ds->func.getconfig_xml = (callbacks->getconfig_xml != NULL) ? ncds_custom_getconfig_xml : NULL;
 }
 
 int ncds_custom_was_changed(struct ncds_ds* ds) {
@@ -126,6 +131,9 @@ void ncds_custom_free(struct ncds_ds* ds) {
 	//call user's free callback
 	c_ds->callbacks->free(c_ds->data);
 
+	yinmodel_free(c_ds->model_tree);
+	c_ds->model_tree = NULL;
+
 	pthread_mutex_lock(&lockinfo_running_mut);
 	free(lockinfo_running.sid);
 	free(lockinfo_running.time);
@@ -363,18 +371,155 @@ int ncds_custom_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_
 	return (retval);
 }
 
+/**
+ * @brief Parse serialized configuration data into a document with the
+ * top-level elements as the root element and its siblings.
+ *
+ * @return NULL on error, document (possibly empty) otherwise.
+ */
+static xmlDocPtr custom_read_config(const char* config, struct nc_err** error)
+{
+	char *aux;
+	const char *configp = config;
+	xmlDocPtr doc, ret;
+	xmlNodePtr node;
+
+	ret = xmlNewDoc(BAD_CAST "1.0");
+	if (config == NULL) {
+		return (ret);
+	}
+
+	if (strncmp(configp, "<?xml", 5) == 0) {
+		/* skip the XML declaration */
+		if ((configp = index(configp, '>')) == NULL) {
+			xmlFreeDoc(ret);
+			*error = nc_err_new(NC_ERR_BAD_ELEM);
+			nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
+			return (NULL);
+		}
+		++configp;
+	}
+	while (*configp == ' ' || *configp == '\n' || *configp == '\t') {
+		++configp;
+	}
+	if (*configp == '\0') {
+		return (ret);
+	}
+
+	if (asprintf(&aux, "<config>%s</config>", configp) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		xmlFreeDoc(ret);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		return (NULL);
+	}
+	doc = xmlReadMemory(aux, strlen(aux), NULL, NULL, NC_XMLREAD_OPTIONS);
+	free(aux);
+	if (doc == NULL || doc->children == NULL) {
+		ERROR("%s: Reading xml data failed!", __func__);
+		xmlFreeDoc(doc);
+		xmlFreeDoc(ret);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Invalid configuration data.");
+		return (NULL);
+	}
+
+	/* move the top-level elements out of the <config> wrapper */
+	for (node = doc->children->children; node != NULL; node = doc->children->children) {
+		xmlUnlinkNode(node);
+		if (node->type != XML_ELEMENT_NODE) {
+			xmlFreeNode(node);
+			continue;
+		}
+		xmlDOMWrapAdoptNode(NULL, doc, node, ret, NULL, 0);
+		if (ret->children == NULL) {
+			xmlDocSetRootElement(ret, node);
+		} else {
+			xmlAddNextSibling(ret->last, node);
+		}
+	}
+	xmlFreeDoc(doc);
+
+	return (ret);
+}
+
+/**
+ * @brief Get the current content of the datastore as a document, using
+ * getconfig_xml() if implemented.
+ */
+static xmlDocPtr custom_getconfig_doc(struct ncds_ds_custom *c_ds, NC_DATASTORE source, const struct nc_filter* filter, struct nc_err** error)
+{
+	char *data;
+	xmlDocPtr doc;
+
+	if (c_ds->callbacks->getconfig_xml != NULL) {
+		return c_ds->callbacks->getconfig_xml(c_ds->data, source,
+				(filter != NULL && filter->type == NC_FILTER_SUBTREE) ? filter->subtree_filter : NULL, error);
+	}
+
+	if ((data = c_ds->callbacks->getconfig(c_ds->data, source, error)) == NULL) {
+		return (NULL);
+	}
+	doc = custom_read_config(data, error);
+	free(data);
+
+	return (doc);
+}
+
 char* ncds_custom_getconfig(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, struct nc_err** error) {
 	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
+	xmlDocPtr doc;
+	xmlNodePtr node;
+	xmlBufferPtr buf;
+	char *data;
+
+	if (c_ds->callbacks->getconfig != NULL) {
+		return c_ds->callbacks->getconfig(c_ds->data, source, error);
+	}
+
+	/* only getconfig_xml() is implemented */
+	if ((doc = c_ds->callbacks->getconfig_xml(c_ds->data, source, NULL, error)) == NULL) {
+		return (NULL);
+	}
+	if ((buf = xmlBufferCreate()) == NULL) {
+		ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		xmlFreeDoc(doc);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		return (NULL);
+	}
+	for (node = doc->children; node != NULL; node = node->next) {
+		xmlNodeDump(buf, doc, node, 2, 1);
+	}
+	data = strdup((char*) xmlBufferContent(buf));
+	xmlBufferFree(buf);
+	xmlFreeDoc(doc);
+
+	return (data);
+}
+
+xmlDocPtr ncds_custom_getconfig_xml(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, const struct nc_filter* filter, struct nc_err** error) {
+	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
 
-	return c_ds->callbacks->getconfig(c_ds->data, source, error);
+	return custom_getconfig_doc(c_ds, source, filter, error);
 }
 
 int ncds_custom_copyconfig(struct ncds_ds *ds, const struct nc_session* UNUSED(session), const nc_rpc* UNUSED(rpc), NC_DATASTORE target, NC_DATASTORE source, char * config, struct nc_err **error) {
 	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
+	xmlDocPtr doc = NULL;
+	int ret;
 
 	/* TODO - check locks */
 
-	return c_ds->callbacks->copyconfig(c_ds->data, target, source, config, error);
+	if (c_ds->callbacks->copyconfig_xml == NULL) {
+		return c_ds->callbacks->copyconfig(c_ds->data, target, source, config, error);
+	}
+
+	if (source == NC_DATASTORE_CONFIG && (doc = custom_read_config(config, error)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	ret = c_ds->callbacks->copyconfig_xml(c_ds->data, target, source, doc, error);
+	xmlFreeDoc(doc);
+
+	return (ret);
 }
 
 int ncds_custom_deleteconfig(struct ncds_ds * ds, const struct nc_session* UNUSED(session), NC_DATASTORE target, struct nc_err **error) {
@@ -385,10 +530,140 @@ int ncds_custom_deleteconfig(struct ncds_ds * ds, const struct nc_session* UNUSE
 	return c_ds->callbacks->deleteconfig(c_ds->data, target, error);
 }
 
+/**
+ * @brief Flatten the xmldiff tree into the list of changes for
+ * editconfig_changes().
+ *
+ * @return 0 on success, 1 on memory allocation failure.
+ */
+static int custom_diff_changes(struct xmldiff_tree* diff, struct transapi_change** changes, int* count, int* size)
+{
+	struct transapi_change *aux;
+
+	for (; diff != NULL; diff = diff->next) {
+		if (diff->op & (XMLDIFF_ADD | XMLDIFF_REM | XMLDIFF_MOD | XMLDIFF_SIBLING | XMLDIFF_REORDER)) {
+			if (*count == *size) {
+				*size = (*size) ? 2 * (*size) : 16;
+				if ((aux = realloc(*changes, (*size) * sizeof(struct transapi_change))) == NULL) {
+					ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+					return (1);
+				}
+				*changes = aux;
+			}
+			(*changes)[*count].op = diff->op;
+			(*changes)[*count].old_node = diff->old_node;
+			(*changes)[*count].new_node = diff->new_node;
+			(*count)++;
+		}
+
+		/* whole added or removed subtree is a single change */
+		if ((diff->op & XMLDIFF_CHAIN) && !(diff->op & (XMLDIFF_ADD | XMLDIFF_REM))) {
+			if (custom_diff_changes(diff->children, changes, count, size)) {
+				return (1);
+			}
+		}
+	}
+
+	return (0);
+}
+
+/**
+ * @brief Get the parsed data model to compare the datastore content.
+ */
+static struct model_tree* custom_model_tree(struct ncds_ds_custom *c_ds)
+{
+	struct ns_pair ns_mapping[2] = {{NULL, NULL}, {NULL, NULL}};
+
+	if (c_ds->ds.ext_model_tree != NULL) {
+		/* the model is already parsed for the transAPI module */
+		return (c_ds->ds.ext_model_tree);
+	}
+
+	if (c_ds->model_tree == NULL && c_ds->ds.ext_model != NULL && c_ds->ds.data_model->ns != NULL) {
+		ns_mapping[0].prefix = (c_ds->ds.data_model->prefix != NULL) ? c_ds->ds.data_model->prefix : "m";
+		ns_mapping[0].href = c_ds->ds.data_model->ns;
+		if ((c_ds->model_tree = yinmodel_parse(c_ds->ds.ext_model, ns_mapping)) == NULL) {
+			ERROR("Failed to parse the model \"%s\" for the custom datastore.", c_ds->ds.data_model->name);
+		}
+	}
+
+	return (c_ds->model_tree);
+}
+
+/**
+ * @brief Perform edit-config in the library and pass only the resulting
+ * changes to the custom datastore.
+ */
+static int custom_editconfig_changes(struct ncds_ds_custom *c_ds, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error)
+{
+	xmlDocPtr old = NULL, new = NULL, edit = NULL, hint = NULL;
+	struct xmldiff_tree* diff = NULL;
+	struct transapi_change *changes = NULL;
+	struct model_tree *model;
+	int count = 0, size = 0, ret = EXIT_FAILURE;
+
+	if ((model = custom_model_tree(c_ds)) == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Unable to get the data model of the custom datastore.");
+		return (EXIT_FAILURE);
+	}
+
+	if ((edit = custom_read_config(config, error)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	if ((old = custom_getconfig_doc(c_ds, target, NULL, error)) == NULL) {
+		if (*error == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+		}
+		goto cleanup;
+	}
+	new = xmlCopyDoc(old, 1);
+
+	/* the edit limits the compared subtrees, unless the whole content is replaced */
+	if (defop != NC_EDIT_DEFOP_REPLACE) {
+		hint = xmlCopyDoc(edit, 1);
+	}
+
+	if (edit_config(new, edit, (struct ncds_ds*)c_ds, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error)) {
+		goto cleanup;
+	}
+
+	if (xmldiff_diff(&diff, old, new, model, hint) == XMLDIFF_ERR) {
+		ERROR("%s: Failed to get the changes of the custom datastore.", __func__);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		goto cleanup;
+	}
+	if (custom_diff_changes(diff, &changes, &count, &size)) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		goto cleanup;
+	}
+
+	if (count == 0) {
+		/* nothing changed */
+		ret = EXIT_SUCCESS;
+	} else {
+		ret = c_ds->callbacks->editconfig_changes(c_ds->data, rpc, target, new, changes, count, error);
+	}
+
+cleanup:
+	free(changes);
+	xmldiff_free(diff);
+	xmlFreeDoc(hint);
+	xmlFreeDoc(edit);
+	xmlFreeDoc(new);
+	xmlFreeDoc(old);
+
+	return (ret);
+}
+
 int ncds_custom_editconfig(struct ncds_ds *ds, const struct nc_session* UNUSED(session), const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error) {
 	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
 
 	/* TODO - check locks */
 
+	if (c_ds->callbacks->editconfig_changes != NULL) {
+		return custom_editconfig_changes(c_ds, rpc, target, config, defop, errop, error);
+	}
+
 	return c_ds->callbacks->editconfig(c_ds->data, rpc, target, config, defop, errop, error);
 }
@@ -39,8 +39,11 @@
 #ifndef NC_DATASTORE_CUSTOM_H
 #define NC_DATASTORE_CUSTOM_H
 
+#include <libxml/tree.h>
+
 struct ncds_ds;
 struct nc_err;
+struct transapi_change;
 
 /**
  * \defgroup customds Custom Datastore
@@ -186,6 +189,68 @@ struct ncds_custom_funcs {
 	 * \return EXIT_SUCCESS or EXIT_FAILURE.
 	 */
 	int (*editconfig)(void *data, const nc_rpc* rpc, NC_DATASTORE target, const char *config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
+	/**
+	 * \brief Get content of the config as a XML document.
+	 *
+	 * Optional, if set, it is used instead of getconfig() and the data are
+	 * not serialized and parsed again. In such a case, getconfig() can be
+	 * NULL. The ownership of the returned document is passed onto the caller.
+	 *
+	 * \param[in] data The user data.
+	 * \param[in] target Where to read data from.
+	 * \param[in] filter The \<filter\> element of the get-config's subtree
+	 * filter, NULL if all the data are requested. It can be used to read only
+	 * the selected parts of the datastore. The library applies the filter on
+	 * the returned data anyway, so returning more data than selected is
+	 * correct.
+	 * \param[out] error Set this in case of error, to indicate what went wrong.
+	 * \return Document with the top-level configuration elements as the root
+	 * element and its siblings (no root element for empty content), NULL on
+	 * error.
+	 */
+	xmlDocPtr (*getconfig_xml)(void *data, NC_DATASTORE target, const xmlNodePtr filter, struct nc_err **error);
+	/**
+	 * \brief Copy config from one data store to another, the copied
+	 * configuration data are passed as a XML document.
+	 *
+	 * Optional, if set, it is used instead of copyconfig().
+	 *
+	 * \param[in] data The user data.
+	 * \param[in] target Where to copy.
+	 * \param[in] source From where to copy.
+	 * \param[in] config Custom data if source parameter is NC_DATASTORE_CONFIG,
+	 * the top-level configuration elements are the root element and its
+	 * siblings. The document is freed by the library after the call.
+	 * \param[out] error Set this in case of EXIT_FAILURE, to indicate what went wrong.
+	 * \return EXIT_SUCCESS or EXIT_FAILURE.
+	 */
+	int (*copyconfig_xml)(void *data, NC_DATASTORE target, NC_DATASTORE source, xmlDocPtr config, struct nc_err** error);
+	/**
+	 * \brief Store the changes made by the editconfig operation.
+	 *
+	 * Optional, if set, it is used instead of editconfig(). The library
+	 * applies the edit on the current content of the target datastore
+	 * (obtained using getconfig_xml() or getconfig()) itself and passes
+	 * only the list of the changes, so the datastore can update only the
+	 * affected data. Added and removed subtrees are reported as a single
+	 * change, modified subtrees are not reported themselves, only their
+	 * changed descendants are. The callback is not called if the edit does not
+	 * change anything.
+	 *
+	 * \param[in] data The user data.
+	 * \param[in] rpc RPC message with the request, NULL if the request does
+	 * not come from a NETCONF session.
+	 * \param[in] target What datastore part is going to be modified.
+	 * \param[in] config Complete content of the target datastore after the
+	 * edit.
+	 * \param[in] changes Array of the changes, old_node points into the former
+	 * content of the datastore (NULL for additions) and new_node into the
+	 * config (NULL for removals).
+	 * \param[in] count Number of the items in the changes array.
+	 * \param[out] error Set this in case of EXIT_FAILURE, to indicate what went wrong.
+	 * \return EXIT_SUCCESS or EXIT_FAILURE.
+	 */
+	int (*editconfig_changes)(void *data, const nc_rpc* rpc, NC_DATASTORE target, xmlDocPtr config, const struct transapi_change* changes, int count, struct nc_err **error);
 };
 
 /**
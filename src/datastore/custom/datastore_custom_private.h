@@ -52,6 +52,12 @@ struct ncds_ds_custom {
 	 */
 	void *data;
 	const struct ncds_custom_funcs *callbacks;
+	/**
+	 * @brief Parsed data model used to get changes for editconfig_changes(),
+	 * created on its first use if the datastore does not have a transAPI
+	 * module providing it.
+	 */
+	struct model_tree *model_tree;
 };
 
 /**
@@ -91,6 +97,21 @@ int ncds_custom_rollback(struct ncds_ds* ds);
  */
 char* ncds_custom_getconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error);
 
+/**
+ * @brief Perform get-config on the specified repository and return the data
+ * as a XML document. Used only if the custom datastore implements the
+ * getconfig_xml() callback.
+ *
+ * @param[in] ds Custom datastore structure (struct ncds_ds_custom) from which
+ * the data will be obtained.
+ * @param[in] session Session originating the request.
+ * @param[in] source Datastore (running, startup, candidate) to get the data from.
+ * @param[in] filter Filter of the request passed to the callback.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return NULL on error, resulting data on success.
+ */
+xmlDocPtr ncds_custom_getconfig_xml(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, const struct nc_filter* filter, struct nc_err** error);
+
 /**
  * @brief Get lock information about the specified NETCONF datastore
  * @param[in] ds Custom datastore structure that will be checked.
@@ -40,6 +40,8 @@
 #ifndef NC_DATASTORE_INTERNAL_H_
 #define NC_DATASTORE_INTERNAL_H_
 
+#include <time.h>
+
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
 
@@ -125,6 +127,21 @@ struct ncds_funcs {
 	 * @return NULL on error, resulting data on success.
 	*/
 	char* (*getconfig)(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+	/**
+	 * @brief Get configuration data stored in target datastore as a XML
+	 * document. Optional, getconfig() and parsing its result is used if not
+	 * implemented.
+	 *
+	 * @param[in] ds Datastore structure from which the data will be obtained.
+	 * @param[in] session Session originating the request.
+	 * @param[in] source Datastore (runnign, startup, candidate) to get the data from.
+	 * @param[in] filter NETCONF filter of the request, NULL if all the data are
+	 * requested. It is only a hint, the caller applies the filter on the
+	 * resulting data anyway.
+	 * @param[out] error NETCONF error structure describing the experienced error.
+	 * @return NULL on error, resulting data (owned by the caller) on success.
+	*/
+	xmlDocPtr (*getconfig_xml)(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, const struct nc_filter* filter, struct nc_err** error);
 	/**
 	 * @brief Copy the content of source datastore or externally sent configuration to target datastore
 	 *
@@ -180,6 +197,11 @@ struct model_validators {
 	xmlRelaxNGPtr rng_schema;
 	xsltStylesheetPtr schematron;
 	int (*callback)(const xmlDocPtr, struct nc_err **);
+	/* content successfully validated by the rng and schematron validators */
+	char *valid_data;
+	/* validators found with the data model, compiled on the first validation */
+	char *rng_path;
+	char *schematron_path;
 };
 #endif
 
@@ -291,6 +313,10 @@ struct transapi_internal {
 	 * @brief Transapi file monitoring structure.
 	 */
 	struct transapi_file_callbacks* file_clbks;
+	/**
+	 * @brief Transapi batch callbacks mapping structure.
+	 */
+	struct transapi_batch_callbacks* batch_clbks;
 
 	/* internal specific part */
 	/**
@@ -305,6 +331,11 @@ struct transapi_internal {
 	 * @brief File monitoring thread, connected with the file_clbks.
 	 */
 	pthread_t fmon_thread;
+	/**
+	 * @brief Process which loaded the module, it owns the module's state and
+	 * its file monitoring thread (children forked from it do not).
+	 */
+	pid_t pid;
 };
 
 struct model_list {
@@ -312,6 +343,27 @@ struct model_list {
 	struct model_list* next;
 };
 
+/**
+ * @brief Edit-configs applied to the candidate datastore since it was the
+ * same as the running datastore.
+ */
+struct candidate_changes {
+	/**
+	 * @brief 1 if the candidate differs from the running datastore only by
+	 * the recorded edits, 0 if the difference is not known.
+	 */
+	int valid;
+	/**
+	 * @brief Content of the edit-configs in the order they were applied.
+	 */
+	char** edits;
+	/**
+	 * @brief Default operations of the edits.
+	 */
+	NC_EDIT_DEFOP_TYPE* defops;
+	int count;
+};
+
 struct ncds_ds {
 	/**
 	 * @brief Datastore implementation type
@@ -339,6 +391,19 @@ struct ncds_ds {
 	 * retrieval of the device status data.
 	 */
 	xmlDocPtr (*get_state_xml)(const xmlDocPtr model, const xmlDocPtr running, struct nc_err **e);
+	/**
+	 * @brief Lifetime of the cached status data in milliseconds, 0 disables
+	 * the cache.
+	 */
+	unsigned int state_cache_ttl;
+	/**
+	 * @brief Status data returned by the last get_state or get_state_xml call.
+	 */
+	xmlDocPtr state_cache;
+	/**
+	 * @brief Time (CLOCK_MONOTONIC) when the state_cache was retrieved.
+	 */
+	struct timespec state_cache_time;
 	/**
 	 * @brief Datastore implementation functions.
 	 */
@@ -352,6 +417,11 @@ struct ncds_ds {
 	 * @brief Parsed extended data model structure.
 	 */
 	struct model_tree* ext_model_tree;
+	/**
+	 * @brief Flag if the ext_model was already indexed. Datastores of the
+	 * data models not accessed since the last ncds_consolidate() are not.
+	 */
+	int ext_model_indexed;
 
 #ifndef DISABLE_VALIDATION
 	/**
@@ -373,6 +443,22 @@ struct ncds_ds {
 	 */
 	struct clbk *tapi_callbacks;
 	int tapi_callbacks_count;
+	/**
+	 * @brief Batch callbacks of the tapi_callbacks items (with the same
+	 * index), NULL if the datastore has no batch callbacks
+	 */
+	int (**tapi_batch_callbacks)(void**, const struct transapi_change*, int, struct nc_err**);
+	/**
+	 * @brief Maximum number of threads applying independent transAPI
+	 * callbacks concurrently, 0 or 1 to call them one by one.
+	 */
+	unsigned int tapi_workers;
+	/**
+	 * @brief Changes of the candidate to apply on commit instead of copying
+	 * the whole candidate into the running datastore. Changes made outside
+	 * ncds_apply_rpc() are detected by func.was_changed().
+	 */
+	struct candidate_changes candidate_changes;
 };
 
 #endif /* NC_DATASTORE_INTERNAL_H_ */
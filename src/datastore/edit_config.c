@@ -43,12 +43,15 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <ctype.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
+#include <libxml/hash.h>
 
 #include "edit_config.h"
 #include "datastore_internal.h"
@@ -75,6 +78,33 @@ struct key_predicate {
 	char* value;
 };
 
+/*
+ * Precompiled information about the configuration data model built by
+ * model_index_build() once the model is complete. The index is connected to
+ * the YIN document and the node records to the model nodes via their _private
+ * pointers, so the functions below working with the model document use it
+ * when available instead of searching the model.
+ */
+struct model_index_node {
+	xmlNodePtr node;
+	xmlHashTablePtr children;  /* name -> child statement, see find_element_model() */
+	xmlNodePtr key;            /* key statement of a list */
+	xmlNodePtr choice;         /* is_partof_choice() result */
+	int ordered;               /* is_user_ordered_list() result */
+	xmlChar* dflt;             /* default value */
+	struct model_index_node* next;
+};
+
+struct model_index {
+	keyList keys;              /* get_keynode_list() result */
+	xmlHashTablePtr keypaths;  /* path of the names of the list -> key statement */
+	struct model_index_node* nodes;
+	struct ncdflt_defaults* defaults; /* ncdflt_defaults_build() result */
+};
+
+#define MODEL_INDEX(doc) ((struct model_index*)((doc)->_private))
+#define MODEL_INDEX_NODE(node) ((struct model_index_node*)((node)->_private))
+
 typedef enum {
 	NC_CHECK_EDIT_DELETE = NC_EDIT_OP_DELETE,
 	NC_CHECK_EDIT_CREATE = NC_EDIT_OP_CREATE
@@ -85,32 +115,29 @@ int is_key(xmlNodePtr parent, xmlNodePtr child, keyList keys);
 
 int nc_nscmp(xmlNodePtr reference, xmlNodePtr node)
 {
-	int in_ns = 1;
-	char* s = NULL;
+	const xmlChar* s;
 
-	if (reference->ns != NULL && reference->ns->href != NULL) {
+	if (reference->ns == NULL || reference->ns->href == NULL || node->ns == reference->ns) {
+		return 0;
+	}
 
-		/* XML namespace wildcard mechanism:
-		 * 1) no namespace defined and namespace is inherited from message so it
-		 *    is NETCONF base namespace
-		 * 2) namespace is empty: xmlns=""
-		 */
-		if (!strcmp((char *)reference->ns->href, NC_NS_BASE10) ||
-				!(s = nc_clrwspace((char*)(reference->ns->href))) ||
-				strlen(s) == 0) {
-			free(s);
-			return 0;
-		}
-		free(s);
+	/* XML namespace wildcard mechanism:
+	 * 1) no namespace defined and namespace is inherited from message so it
+	 *    is NETCONF base namespace
+	 * 2) namespace is empty: xmlns=""
+	 */
+	if (!strcmp((char *)reference->ns->href, NC_NS_BASE10)) {
+		return 0;
+	}
+	for (s = reference->ns->href; *s != '\0' && isspace(*s); s++);
+	if (*s == '\0') {
+		return 0;
+	}
 
-		in_ns = 0;
-		if (node->ns != NULL) {
-			if (!strcmp((char *)reference->ns->href, (char *)node->ns->href)) {
-				in_ns = 1;
-			}
-		}
+	if (node->ns == NULL || node->ns->href == NULL) {
+		return 1;
 	}
-	return (in_ns == 1 ? 0 : 1);
+	return ((node->ns->href == reference->ns->href || !strcmp((char *)reference->ns->href, (char *)node->ns->href)) ? 0 : 1);
 }
 
 /**
@@ -167,6 +194,8 @@ static NC_EDIT_OP_TYPE get_operation(xmlNodePtr node, NC_EDIT_DEFOP_TYPE defop,
  * \param model         XML form (YIN) of the configuration data model.
  *
  * \return              keyList with references to all the keys in the data model.
+ *                      The list of an indexed model is shared, free it
+ *                      by keyListFree() anyway.
  */
 keyList get_keynode_list(xmlDocPtr model)
 {
@@ -177,6 +206,10 @@ keyList get_keynode_list(xmlDocPtr model)
 		return (NULL);
 	}
 
+	if (MODEL_INDEX(model) != NULL) {
+		return (MODEL_INDEX(model)->keys);
+	}
+
 	/* create xpath evaluation context */
 	model_ctxt = xmlXPathNewContext(model);
 	if (model_ctxt == NULL) {
@@ -188,7 +221,7 @@ keyList get_keynode_list(xmlDocPtr model)
 		return (NULL);
 	}
 
-	result = xmlXPathEvalExpression(BAD_CAST "//" NC_NS_YIN_ID ":key", model_ctxt);
+	result = nc_xpath_eval("//" NC_NS_YIN_ID ":key", model_ctxt);
 	if (result != NULL) {
 		if (xmlXPathNodeSetIsEmpty(result->nodesetval)) {
 			xmlXPathFreeObject(result);
@@ -200,6 +233,23 @@ keyList get_keynode_list(xmlDocPtr model)
 	return ((keyList)result);
 }
 
+void keyListFree(keyList keys)
+{
+	xmlDocPtr model;
+
+	if (keys == NULL) {
+		return;
+	}
+	/* the list shared from the model index is freed with the index */
+	if (keys->nodesetval != NULL && keys->nodesetval->nodeNr > 0) {
+		model = keys->nodesetval->nodeTab[0]->doc;
+		if (MODEL_INDEX(model) != NULL && MODEL_INDEX(model)->keys == keys) {
+			return;
+		}
+	}
+	xmlXPathFreeObject(keys);
+}
+
 /* get the key nodes from the xml document */
 static int find_key_elems(xmlNodePtr modelnode, xmlNodePtr node, int all, xmlNodePtr **result)
 {
@@ -255,6 +305,35 @@ static int find_key_elems(xmlNodePtr modelnode, xmlNodePtr node, int all, xmlNod
 	return EXIT_SUCCESS;
 }
 
+/**
+ * @brief Get the path of the element names from the document root to the node,
+ * used to find the key statement of the list instance in the model index.
+ * @return Path in the "/name/name" form (call free()), NULL if the node is not
+ * connected to a document.
+ */
+static char* model_data_path(xmlNodePtr node)
+{
+	xmlNodePtr aux;
+	size_t len = 0, l;
+	char* path;
+
+	for (aux = node; aux != NULL && aux->type != XML_DOCUMENT_NODE; aux = aux->parent) {
+		len += strlen((char*)aux->name) + 1;
+	}
+	if (aux == NULL || (path = malloc(len + 1)) == NULL) {
+		return (NULL);
+	}
+	path[len] = '\0';
+	for (aux = node; aux->type != XML_DOCUMENT_NODE; aux = aux->parent) {
+		l = strlen((char*)aux->name);
+		len -= l;
+		memcpy(&path[len], aux->name, l);
+		path[--len] = '/';
+	}
+
+	return (path);
+}
+
 /**
  * \brief Get all the key nodes for the specific element.
  *
@@ -277,6 +356,18 @@ static int get_keys(keyList keys, xmlNodePtr node, int all, xmlNodePtr **result)
 
 	*result = NULL;
 
+	if (keys->nodesetval->nodeNr > 0 && MODEL_INDEX(keys->nodesetval->nodeTab[0]->doc) != NULL) {
+		if ((str = (xmlChar*)model_data_path(node)) == NULL) {
+			return (EXIT_SUCCESS);
+		}
+		key_parent = xmlHashLookup(MODEL_INDEX(keys->nodesetval->nodeTab[0]->doc)->keypaths, str);
+		free(str);
+		if (key_parent == NULL) {
+			return (EXIT_SUCCESS);
+		}
+		return find_key_elems(key_parent, node, all, result);
+	}
+
 	for (j = 0; j < keys->nodesetval->nodeNr; j++) {
 		/* get corresponding key definition from the data model */
 		// name = xmlGetNsProp (keys->nodesetval->nodeTab[i]->parent, BAD_CAST "name", BAD_CAST NC_NS_YIN);
@@ -342,6 +433,10 @@ static xmlNodePtr is_partof_choice(xmlNodePtr node)
 		return (NULL);
 	}
 
+	if (MODEL_INDEX(node->doc) != NULL && MODEL_INDEX_NODE(node) != NULL) {
+		return (MODEL_INDEX_NODE(node)->choice);
+	}
+
 	for (aux = node; aux->parent != NULL && aux->parent->type == XML_ELEMENT_NODE; aux = aux->parent) {
 		if (xmlStrcmp(aux->parent->name, BAD_CAST "choice") == 0) {
 			return (aux);
@@ -370,6 +465,10 @@ static int is_user_ordered_list(xmlNodePtr node)
 		return (0);
 	}
 
+	if (MODEL_INDEX(node->doc) != NULL && MODEL_INDEX_NODE(node) != NULL) {
+		return (MODEL_INDEX_NODE(node)->ordered);
+	}
+
 	if (xmlStrcmp(node->name, BAD_CAST "list") == 0) {
 		ret = 1;
 	} else if (xmlStrcmp(node->name, BAD_CAST "leaf-list") == 0) {
@@ -489,136 +588,1188 @@ int matching_elements(xmlNodePtr node1, xmlNodePtr node2, keyList keys, int leaf
 						key_value2 = (xmlChar*)nc_clrwspace((char*)key_value);
 						xmlFree(key_value);
 
-						keynode_value = xmlNodeGetContent(keynode);
-						keynode_value2 = (xmlChar*)nc_clrwspace((char*)keynode_value);
-						xmlFree(keynode_value);
-						if (xmlStrcmp(keynode_value2, key_value2) == 0) {
-							/* value matches, go for next key if any */
-							break; /* while loop */
-						} else {
-							/* key value does not match, this is always bad */
-							xmlFree(key_value2);
-							xmlFree(keynode_value2);
-							free(keynode_list);
-							return 0;
-						}
-					} else {
-						/* this was not the key element, try the next one */
-						key = key->next;
-					}
-				}
+						keynode_value = xmlNodeGetContent(keynode);
+						keynode_value2 = (xmlChar*)nc_clrwspace((char*)keynode_value);
+						xmlFree(keynode_value);
+						if (xmlStrcmp(keynode_value2, key_value2) == 0) {
+							/* value matches, go for next key if any */
+							break; /* while loop */
+						} else {
+							/* key value does not match, this is always bad */
+							xmlFree(key_value2);
+							xmlFree(keynode_value2);
+							free(keynode_list);
+							return 0;
+						}
+					} else {
+						/* this was not the key element, try the next one */
+						key = key->next;
+					}
+				}
+
+				/* cleanup for next round */
+				xmlFree(key_value2);
+				xmlFree(keynode_value2);
+
+				if (key == NULL) {
+					/* there is no matching node */
+					free(keynode_list);
+					return 0;
+				}
+
+				/* go to the next key if any */
+				keynode = keynode_list[i];
+			}
+			free(keynode_list);
+		}
+	}
+
+	return 1;
+}
+
+static xmlNodePtr find_element_model_compare(xmlNodePtr node, xmlNodePtr model_node)
+{
+	xmlNodePtr aux, retval;
+	xmlChar* name;
+
+	if (xmlStrcmp(model_node->name, BAD_CAST "choice") == 0 ||
+	    xmlStrcmp(model_node->name, BAD_CAST "case") == 0 ||
+	    xmlStrcmp(model_node->name, BAD_CAST "augment") == 0) {
+		for (aux = model_node->children; aux != NULL; aux = aux->next) {
+			retval = find_element_model_compare(node, aux);
+			if (retval != NULL) {
+				return (retval);
+			}
+		}
+	} else {
+		name = xmlGetProp(model_node, BAD_CAST "name");
+		if (name == NULL) {
+			return (NULL);
+		}
+
+		if (xmlStrcmp(node->name, name) == 0) {
+			xmlFree(name);
+			return (model_node);
+		}
+		xmlFree(name);
+	}
+
+	return (NULL);
+}
+
+/**
+ * @brief Go recursively in the YIN model and find model's equivalent of the node
+ * @param[in] node XML element which we want to find in the model
+ * @param[in] model Configuration data model (YIN format)
+ * @return model's equivalent of the node, NULL if no such element is found.
+ */
+xmlNodePtr find_element_model(xmlNodePtr node, xmlDocPtr model)
+{
+	xmlNodePtr mparent, aux, retval;
+
+	if (node == NULL || node->parent == NULL) {
+		return (NULL);
+	}
+
+	if (node->parent->type != XML_DOCUMENT_NODE) {
+		mparent = find_element_model(node->parent, model);
+	} else {
+		mparent = xmlDocGetRootElement(model);
+	}
+	if (mparent == NULL) {
+		return (NULL);
+	}
+
+	if (MODEL_INDEX(model) != NULL && MODEL_INDEX_NODE(mparent) != NULL) {
+		if (MODEL_INDEX_NODE(mparent)->children == NULL) {
+			return (NULL);
+		}
+		return (xmlHashLookup(MODEL_INDEX_NODE(mparent)->children, node->name));
+	}
+
+	for (aux = mparent->children; aux != NULL; aux = aux->next) {
+		retval = find_element_model_compare(node, aux);
+		if (retval != NULL) {
+			return (retval);
+		}
+	}
+
+	return (NULL);
+}
+
+/**
+ * @brief Get the default value of the node if a default value is defined in the model
+ * @param[in] node XML element whose default value we want to get
+ * @param[in] model Configuration data model for the document of the given node.
+ * @return Default value of the node, NULL if no default value is defined or found.
+ */
+static xmlChar* get_default_value(xmlNodePtr node, xmlDocPtr model)
+{
+	xmlNodePtr mnode, aux;
+	xmlChar* value = NULL;
+
+	mnode = find_element_model(node, model);
+	if (mnode == NULL) {
+		return (NULL);
+	}
+
+	if (MODEL_INDEX(model) != NULL && MODEL_INDEX_NODE(mnode) != NULL) {
+		return (xmlStrdup(MODEL_INDEX_NODE(mnode)->dflt));
+	}
+
+	for (aux = mnode->children; aux != NULL; aux = aux->next) {
+		if (xmlStrcmp(aux->name, BAD_CAST "default") == 0) {
+			value = xmlGetNsProp(aux, BAD_CAST "value", BAD_CAST NC_NS_YIN);
+			break;
+		}
+	}
+
+	return (value);
+}
+
+/* fill the children table as find_element_model_compare() searches the model */
+static int model_index_children(xmlHashTablePtr children, xmlNodePtr model_node)
+{
+	xmlNodePtr aux;
+	xmlChar* name;
+
+	for (aux = model_node->children; aux != NULL; aux = aux->next) {
+		if (aux->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (xmlStrcmp(aux->name, BAD_CAST "choice") == 0 ||
+		    xmlStrcmp(aux->name, BAD_CAST "case") == 0 ||
+		    xmlStrcmp(aux->name, BAD_CAST "augment") == 0) {
+			if (model_index_children(children, aux) != EXIT_SUCCESS) {
+				return (EXIT_FAILURE);
+			}
+		} else if ((name = xmlGetProp(aux, BAD_CAST "name")) != NULL) {
+			/* the first statement with the name wins, the others are kept out */
+			if (xmlHashLookup(children, name) == NULL && xmlHashAddEntry(children, name, aux) != 0) {
+				xmlFree(name);
+				return (EXIT_FAILURE);
+			}
+			xmlFree(name);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static int model_index_nodes(struct model_index* index, xmlNodePtr model_node)
+{
+	struct model_index_node* info;
+	xmlNodePtr aux;
+
+	for (; model_node != NULL; model_node = model_node->next) {
+		if (model_node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		if ((info = calloc(1, sizeof(struct model_index_node))) == NULL) {
+			return (EXIT_FAILURE);
+		}
+		info->node = model_node;
+		info->next = index->nodes;
+		index->nodes = info;
+		model_node->_private = info;
+
+		info->ordered = is_user_ordered_list(model_node);
+		info->choice = is_partof_choice(model_node);
+		for (aux = model_node->children; aux != NULL; aux = aux->next) {
+			if (xmlStrcmp(aux->name, BAD_CAST "default") == 0) {
+				info->dflt = xmlGetNsProp(aux, BAD_CAST "value", BAD_CAST NC_NS_YIN);
+				break;
+			}
+		}
+		for (aux = model_node->children; aux != NULL; aux = aux->next) {
+			if (aux->type == XML_ELEMENT_NODE && xmlStrcmp(aux->name, BAD_CAST "key") == 0 &&
+					aux->ns != NULL && xmlStrcmp(aux->ns->href, BAD_CAST NC_NS_YIN) == 0) {
+				info->key = aux;
+				break;
+			}
+		}
+
+		if ((info->children = xmlHashCreate(16)) == NULL ||
+				model_index_children(info->children, model_node) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+		if (xmlHashSize(info->children) == 0) {
+			xmlHashFree(info->children, NULL);
+			info->children = NULL;
+		}
+
+		if (model_index_nodes(index, model_node->children) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/* path of the list names as get_keys() compares it with the data nodes */
+static char* model_key_path(xmlNodePtr key)
+{
+	xmlNodePtr aux;
+	xmlChar* name;
+	char *path = NULL, *aux_path;
+
+	for (aux = key->parent; aux != NULL; ) {
+		if ((name = xmlGetProp(aux, BAD_CAST "name")) == NULL) {
+			free(path);
+			return (NULL);
+		}
+		if (asprintf(&aux_path, "/%s%s", (char*)name, (path == NULL) ? "" : path) == -1) {
+			xmlFree(name);
+			free(path);
+			return (NULL);
+		}
+		xmlFree(name);
+		free(path);
+		path = aux_path;
+
+		do {
+			aux = aux->parent;
+		} while (aux && ((xmlStrcmp(aux->name, BAD_CAST "augment") == 0)
+				|| (xmlStrcmp(aux->name, BAD_CAST "choice") == 0)
+				|| (xmlStrcmp(aux->name, BAD_CAST "case") == 0)));
+
+		if (aux != NULL && aux->type == XML_ELEMENT_NODE && xmlStrcmp(aux->name, BAD_CAST "module") == 0) {
+			return (path);
+		}
+	}
+
+	free(path);
+	return (NULL);
+}
+
+void model_index_free(xmlDocPtr model)
+{
+	struct model_index* index;
+	struct model_index_node* info;
+
+	if (model == NULL || (index = MODEL_INDEX(model)) == NULL) {
+		return;
+	}
+
+	while ((info = index->nodes) != NULL) {
+		index->nodes = info->next;
+		info->node->_private = NULL;
+		xmlHashFree(info->children, NULL);
+		xmlFree(info->dflt);
+		free(info);
+	}
+	ncdflt_defaults_free(index->defaults);
+	xmlHashFree(index->keypaths, NULL);
+	if (index->keys != NULL) {
+		xmlXPathFreeObject(index->keys);
+	}
+	free(index);
+	model->_private = NULL;
+}
+
+int model_index_build(xmlDocPtr model)
+{
+	struct model_index* index;
+	char* path;
+	int i;
+
+	if (model == NULL) {
+		return (EXIT_FAILURE);
+	}
+	model_index_free(model);
+
+	if ((index = calloc(1, sizeof(struct model_index))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	/* the model is searched in the usual way while building the index */
+	index->keys = get_keynode_list(model);
+	if ((index->keypaths = xmlHashCreate(64)) == NULL) {
+		goto error;
+	}
+	for (i = 0; index->keys != NULL && i < index->keys->nodesetval->nodeNr; i++) {
+		if ((path = model_key_path(index->keys->nodesetval->nodeTab[i])) == NULL) {
+			continue;
+		}
+		/* as in get_keys(), the first matching key wins */
+		if (xmlHashLookup(index->keypaths, BAD_CAST path) == NULL &&
+				xmlHashAddEntry(index->keypaths, BAD_CAST path, index->keys->nodesetval->nodeTab[i]) != 0) {
+			free(path);
+			goto error;
+		}
+		free(path);
+	}
+	if (model_index_nodes(index, model->children) != EXIT_SUCCESS) {
+		goto error;
+	}
+	/* with-defaults are processed without the index in case of failure */
+	index->defaults = ncdflt_defaults_build(model);
+
+	model->_private = index;
+	return (EXIT_SUCCESS);
+
+error:
+	ERROR("Building the index of the configuration data model failed.");
+	model->_private = index;
+	model_index_free(model);
+	return (EXIT_FAILURE);
+}
+
+struct ncdflt_defaults* model_index_defaults(xmlDocPtr model)
+{
+	if (model == NULL || MODEL_INDEX(model) == NULL) {
+		return (NULL);
+	}
+
+	return (MODEL_INDEX(model)->defaults);
+}
+
+/*
+ * Undo record of the changes made in the original document by edit_config(),
+ * so the caller can apply the edit directly to its data instead of a copy and
+ * still return to the previous content. The changes are recorded by the same
+ * hooks as keep the edit index up to date, the removed nodes are not freed,
+ * but kept in the record with their original position.
+ */
+#define EDIT_UNDO_LINK   0 /* new node was linked */
+#define EDIT_UNDO_MOVE   1 /* unlinked node was linked elsewhere */
+#define EDIT_UNDO_UNLINK 2 /* node was unlinked */
+#define EDIT_UNDO_DROP   3 /* node was unlinked to be freed, the record owns it */
+
+struct edit_undo_entry {
+	int type;
+	xmlNodePtr node;
+	xmlNodePtr parent;     /* original position of the unlinked nodes */
+	xmlNodePtr prev;
+};
+
+struct edit_undo {
+	xmlDocPtr doc;
+	struct edit_undo_entry* entries;
+	size_t count, size;
+	int failed;            /* some change was not recorded, the record cannot be reverted */
+};
+
+static pthread_key_t edit_undo_key;
+static pthread_once_t edit_undo_key_once = PTHREAD_ONCE_INIT;
+
+static void edit_undo_key_init(void)
+{
+	pthread_key_create(&edit_undo_key, NULL);
+}
+
+static struct edit_undo* edit_undo_get(xmlDocPtr doc)
+{
+	struct edit_undo* undo;
+
+	pthread_once(&edit_undo_key_once, edit_undo_key_init);
+	undo = (struct edit_undo*)pthread_getspecific(edit_undo_key);
+	if (undo == NULL || doc == NULL || undo->doc != doc) {
+		return (NULL);
+	}
+	return (undo);
+}
+
+/**
+ * @brief Record the change of the original document, the unlinked node is
+ * expected to be still linked.
+ */
+static void edit_undo_record(xmlNodePtr node, int type)
+{
+	struct edit_undo* undo;
+	struct edit_undo_entry* entry;
+	size_t size;
+
+	if (node == NULL || (undo = edit_undo_get(node->doc)) == NULL || undo->failed) {
+		return;
+	}
+
+	if (undo->count == undo->size) {
+		size = (undo->size == 0) ? 64 : undo->size * 2;
+		if ((entry = realloc(undo->entries, size * sizeof(struct edit_undo_entry))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			undo->failed = 1;
+			return;
+		}
+		undo->entries = entry;
+		undo->size = size;
+	}
+
+	if (type == EDIT_UNDO_LINK && undo->count > 0) {
+		entry = &(undo->entries[undo->count - 1]);
+		if (entry->type == EDIT_UNDO_UNLINK && entry->node == node) {
+			/* the node is just being moved */
+			type = EDIT_UNDO_MOVE;
+		}
+	}
+
+	entry = &(undo->entries[undo->count++]);
+	entry->type = type;
+	entry->node = node;
+	entry->parent = (type == EDIT_UNDO_UNLINK) ? node->parent : NULL;
+	entry->prev = (type == EDIT_UNDO_UNLINK) ? node->prev : NULL;
+}
+
+/**
+ * @brief Free the node already unlinked from its document, the node of the
+ * original document is kept in the undo record instead, if it is recorded.
+ */
+static void edit_node_free(xmlNodePtr node)
+{
+	struct edit_undo* undo;
+	size_t i;
+
+	if (node == NULL) {
+		return;
+	}
+
+	if ((undo = edit_undo_get(node->doc)) != NULL && !undo->failed) {
+		/* the node was unlinked just now, so search from the end */
+		for (i = undo->count; i > 0; i--) {
+			if (undo->entries[i - 1].node == node && undo->entries[i - 1].type == EDIT_UNDO_UNLINK) {
+				undo->entries[i - 1].type = EDIT_UNDO_DROP;
+				return;
+			}
+		}
+	}
+
+	xmlFreeNode(node);
+}
+
+int edit_undo_start(xmlDocPtr doc)
+{
+	struct edit_undo* undo;
+
+	pthread_once(&edit_undo_key_once, edit_undo_key_init);
+	if ((undo = calloc(1, sizeof(struct edit_undo))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	undo->doc = doc;
+	pthread_setspecific(edit_undo_key, undo);
+
+	return (EXIT_SUCCESS);
+}
+
+struct edit_undo* edit_undo_stop(void)
+{
+	struct edit_undo* undo;
+
+	pthread_once(&edit_undo_key_once, edit_undo_key_init);
+	if ((undo = (struct edit_undo*)pthread_getspecific(edit_undo_key)) == NULL) {
+		return (NULL);
+	}
+	pthread_setspecific(edit_undo_key, NULL);
+
+	return (undo);
+}
+
+int edit_undo_revert(struct edit_undo* undo)
+{
+	struct edit_undo_entry* entry;
+	xmlNodePtr node;
+	size_t i;
+
+	if (undo == NULL) {
+		return (EXIT_SUCCESS);
+	}
+	if (undo->failed) {
+		edit_undo_free(undo);
+		return (EXIT_FAILURE);
+	}
+
+	/* go back through the changes */
+	for (i = undo->count; i > 0; i--) {
+		entry = &(undo->entries[i - 1]);
+		node = entry->node;
+		switch (entry->type) {
+		case EDIT_UNDO_LINK:
+			xmlUnlinkNode(node);
+			xmlFreeNode(node);
+			break;
+		case EDIT_UNDO_MOVE:
+			/* relinked back by the preceding EDIT_UNDO_UNLINK */
+			xmlUnlinkNode(node);
+			break;
+		default:
+			/* link the node back directly, xmlAdd*() could merge text nodes */
+			node->parent = entry->parent;
+			node->prev = entry->prev;
+			node->next = (entry->prev != NULL) ? entry->prev->next : entry->parent->children;
+			if (node->next != NULL) {
+				node->next->prev = node;
+			} else {
+				entry->parent->last = node;
+			}
+			if (entry->prev != NULL) {
+				entry->prev->next = node;
+			} else {
+				entry->parent->children = node;
+			}
+			break;
+		}
+	}
+
+	free(undo->entries);
+	free(undo);
+
+	return (EXIT_SUCCESS);
+}
+
+void edit_undo_free(struct edit_undo* undo)
+{
+	size_t i;
+
+	if (undo == NULL) {
+		return;
+	}
+
+	/* the changes are kept, so release the nodes removed by them */
+	for (i = 0; i < undo->count; i++) {
+		if (undo->entries[i].type == EDIT_UNDO_DROP) {
+			xmlFreeNode(undo->entries[i].node);
+		}
+	}
+	free(undo->entries);
+	free(undo);
+}
+
+/*
+ * Index of the list (and leaf-list) instances in the original document used
+ * by find_element_equiv() during a single edit_config() call. The children of
+ * a parent node with the same name are indexed by the values of their keys
+ * (text value for leaf-list items) and by their namespace. The index is built
+ * lazily when the children are searched for the first time and it is kept up
+ * to date by the edit_index_add() and edit_index_remove() hooks called from
+ * the places changing the original document. The index entry of a node is
+ * referenced from the node's _private pointer.
+ */
+struct edit_index_entry {
+	xmlNodePtr node;
+	xmlChar* key;
+	struct edit_index_scope* scope;
+	struct edit_index_entry *prev, *next;
+};
+
+struct edit_index_scope {
+	xmlChar* name;         /* name of the indexed children */
+	int leaf;              /* leaf-list items are indexed by their value */
+	char** keynames;       /* names of the key elements, NULL for leaf-lists */
+	xmlHashTablePtr entries;
+	struct edit_index_entry* list;
+	xmlNodePtr* pending;   /* children not indexed (yet) - without keys or duplicates */
+	int pending_count, pending_size;
+	struct edit_index_scope* next;
+};
+
+struct edit_index_parent {
+	xmlNodePtr node;
+	char id[24];
+	struct edit_index_scope* scopes;
+	struct edit_index_parent *prev, *next;
+};
+
+struct edit_index {
+	xmlDocPtr doc;
+	xmlHashTablePtr parents;
+	struct edit_index_parent* list;
+	int adopt;             /* move the edit nodes into doc instead of copying them */
+	struct nc_arena arena; /* entries and their keys, released by edit_index_stop() */
+	struct edit_index_entry* spare; /* freed entries to be reused */
+	char* keybuf;          /* edit_index_keystr() result */
+	size_t keybuf_size;
+};
+
+static pthread_key_t edit_index_key;
+static pthread_once_t edit_index_key_once = PTHREAD_ONCE_INIT;
+
+static void edit_index_key_init(void)
+{
+	pthread_key_create(&edit_index_key, NULL);
+}
+
+static struct edit_index* edit_index_get(xmlDocPtr doc)
+{
+	struct edit_index* index;
+
+	pthread_once(&edit_index_key_once, edit_index_key_init);
+	index = (struct edit_index*)pthread_getspecific(edit_index_key);
+	if (index == NULL || doc == NULL || index->doc != doc) {
+		return (NULL);
+	}
+	return (index);
+}
+
+static void edit_index_entry_free(struct edit_index* index, struct edit_index_entry* entry)
+{
+	struct edit_index_scope* scope = entry->scope;
+
+	xmlHashRemoveEntry(scope->entries, entry->key, NULL);
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	} else {
+		scope->list = entry->next;
+	}
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	}
+	entry->node->_private = NULL;
+	/* the key stays in the arena */
+	entry->next = index->spare;
+	index->spare = entry;
+}
+
+static void edit_index_scope_free(struct edit_index_scope* scope)
+{
+	struct edit_index_entry* entry;
+	int i;
+
+	/* the entries themselves are released with the arena */
+	for (entry = scope->list; entry != NULL; entry = entry->next) {
+		entry->node->_private = NULL;
+	}
+
+	xmlHashFree(scope->entries, NULL);
+	for (i = 0; scope->keynames != NULL && scope->keynames[i] != NULL; i++) {
+		free(scope->keynames[i]);
+	}
+	free(scope->keynames);
+	free(scope->pending);
+	xmlFree(scope->name);
+	free(scope);
+}
+
+static void edit_index_parent_free(struct edit_index* index, struct edit_index_parent* parent)
+{
+	struct edit_index_scope* scope;
+
+	xmlHashRemoveEntry(index->parents, BAD_CAST parent->id, NULL);
+	if (parent->prev != NULL) {
+		parent->prev->next = parent->next;
+	} else {
+		index->list = parent->next;
+	}
+	if (parent->next != NULL) {
+		parent->next->prev = parent->prev;
+	}
+	while ((scope = parent->scopes) != NULL) {
+		parent->scopes = scope->next;
+		edit_index_scope_free(scope);
+	}
+	free(parent);
+}
+
+static struct edit_index_parent* edit_index_parent_get(struct edit_index* index, xmlNodePtr node, int create)
+{
+	struct edit_index_parent* parent;
+	char id[24];
+
+	snprintf(id, sizeof(id), "%p", (void*)node);
+	if ((parent = xmlHashLookup(index->parents, BAD_CAST id)) != NULL || !create) {
+		return (parent);
+	}
+
+	if ((parent = calloc(1, sizeof(struct edit_index_parent))) == NULL) {
+		return (NULL);
+	}
+	parent->node = node;
+	strcpy(parent->id, id);
+	if (xmlHashAddEntry(index->parents, BAD_CAST parent->id, parent) != 0) {
+		free(parent);
+		return (NULL);
+	}
+	parent->next = index->list;
+	if (index->list != NULL) {
+		index->list->prev = parent;
+	}
+	index->list = parent;
+
+	return (parent);
+}
+
+/* append the value normalized as by nc_clrwspace() and prefixed by its length */
+static int edit_index_keystr_append(struct edit_index* index, size_t* len, const char* value)
+{
+	char prefix[16], *aux;
+	size_t value_len, prefix_len, i;
+	int clear;
+
+	if (value == NULL) {
+		value = "";
+	}
+	if ((clear = isspace(value[0])) != 0) {
+		for (i = 0, value_len = 0; value[i] != '\0'; i++) {
+			if (!isspace(value[i])) {
+				value_len++;
+			}
+		}
+	} else {
+		value_len = strlen(value);
+	}
+
+	/* length prefixed values are unambiguous */
+	prefix_len = snprintf(prefix, sizeof(prefix), "\n%u:", (unsigned int)value_len);
+	if (*len + prefix_len + value_len + 1 > index->keybuf_size) {
+		if ((aux = realloc(index->keybuf, 2 * (*len + prefix_len + value_len + 1))) == NULL) {
+			return (EXIT_FAILURE);
+		}
+		index->keybuf = aux;
+		index->keybuf_size = 2 * (*len + prefix_len + value_len + 1);
+	}
+
+	memcpy(index->keybuf + *len, prefix, prefix_len);
+	*len += prefix_len;
+	if (clear) {
+		for (i = 0; value[i] != '\0'; i++) {
+			if (!isspace(value[i])) {
+				index->keybuf[(*len)++] = value[i];
+			}
+		}
+	} else {
+		memcpy(index->keybuf + *len, value, value_len);
+		*len += value_len;
+	}
+	index->keybuf[*len] = '\0';
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Get the string identifying the node in the index scope - the
+ * namespace and the value of the keys (or the leaf-list value).
+ * @param[out] key_len Length of the returned key string. Can be NULL.
+ * @return Key string in the index buffer, valid until the next call, NULL if
+ * the node cannot be indexed.
+ */
+static const xmlChar* edit_index_keystr(struct edit_index* index, xmlNodePtr node, struct edit_index_scope* scope, size_t* key_len)
+{
+	xmlNodePtr child;
+	xmlChar *content;
+	const char* ns;
+	size_t len;
+	int i, ret;
+
+	ns = (node->ns != NULL && node->ns->href != NULL) ? (char*)node->ns->href : "";
+	len = strlen(ns);
+	if (len + 1 > index->keybuf_size) {
+		free(index->keybuf);
+		index->keybuf_size = 0;
+		if ((index->keybuf = malloc(2 * (len + 1))) == NULL) {
+			return (NULL);
+		}
+		index->keybuf_size = 2 * (len + 1);
+	}
+	memcpy(index->keybuf, ns, len + 1);
+
+	for (i = 0; scope->leaf || scope->keynames[i] != NULL; i++) {
+		if (scope->leaf) {
+			if (node->children == NULL || node->children->type != XML_TEXT_NODE) {
+				return (NULL);
+			}
+			ret = edit_index_keystr_append(index, &len, (char*)(node->children->content));
+		} else {
+			/* the first child with the key name, as in matching_elements() */
+			for (child = node->children; child != NULL && strcmp(scope->keynames[i], (char*)child->name); child = child->next);
+			if (child == NULL) {
+				return (NULL);
+			}
+			if (child->children != NULL && child->children->type == XML_TEXT_NODE && child->children->next == NULL) {
+				/* the usual case, the content is the text node itself */
+				ret = edit_index_keystr_append(index, &len, (char*)(child->children->content));
+			} else {
+				content = xmlNodeGetContent(child);
+				ret = edit_index_keystr_append(index, &len, (char*)content);
+				xmlFree(content);
+			}
+		}
+		if (ret != EXIT_SUCCESS) {
+			return (NULL);
+		}
+
+		if (scope->leaf) {
+			break;
+		}
+	}
+
+	if (key_len != NULL) {
+		*key_len = len;
+	}
+	return (BAD_CAST index->keybuf);
+}
+
+static void edit_index_pending_add(struct edit_index_scope* scope, xmlNodePtr node)
+{
+	xmlNodePtr* aux;
+
+	if (scope->pending_count == scope->pending_size) {
+		if ((aux = realloc(scope->pending, (scope->pending_size + 16) * sizeof(xmlNodePtr))) == NULL) {
+			return;
+		}
+		scope->pending = aux;
+		scope->pending_size += 16;
+	}
+	scope->pending[scope->pending_count++] = node;
+}
+
+static void edit_index_pending_remove(struct edit_index_scope* scope, xmlNodePtr node)
+{
+	int i;
+
+	for (i = 0; i < scope->pending_count; ) {
+		if (scope->pending[i] == node) {
+			scope->pending[i] = scope->pending[--scope->pending_count];
+		} else {
+			i++;
+		}
+	}
+}
+
+/**
+ * @brief Put the node into the index scope, nodes that cannot be indexed are
+ * remembered as pending.
+ */
+static void edit_index_insert(struct edit_index* index, struct edit_index_scope* scope, xmlNodePtr node)
+{
+	struct edit_index_entry* entry;
+	const xmlChar* keystr;
+	xmlChar* key;
+	size_t len;
+
+	if (node->_private != NULL) {
+		/* already indexed */
+		return;
+	}
+
+	if ((keystr = edit_index_keystr(index, node, scope, &len)) == NULL) {
+		edit_index_pending_add(scope, node);
+		return;
+	}
+	if (xmlHashLookup(scope->entries, keystr) != NULL) {
+		/* duplicate key */
+		edit_index_pending_add(scope, node);
+		return;
+	}
+	if (index->spare != NULL) {
+		entry = index->spare;
+		index->spare = entry->next;
+	} else if ((entry = nc_arena_alloc(&index->arena, sizeof(struct edit_index_entry))) == NULL) {
+		edit_index_pending_add(scope, node);
+		return;
+	}
+	if ((key = BAD_CAST nc_arena_strndup(&index->arena, (char*)keystr, len)) == NULL ||
+			xmlHashAddEntry(scope->entries, key, entry) != 0) {
+		entry->next = index->spare;
+		index->spare = entry;
+		edit_index_pending_add(scope, node);
+		return;
+	}
+	entry->node = node;
+	entry->key = key;
+	entry->scope = scope;
+	entry->prev = NULL;
+	entry->next = scope->list;
+	if (scope->list != NULL) {
+		scope->list->prev = entry;
+	}
+	scope->list = entry;
+	node->_private = entry;
+}
+
+/**
+ * @brief The node can change its key, move it from the index into the pending
+ * nodes of its scope.
+ */
+static void edit_index_touch(struct edit_index* index, xmlNodePtr node)
+{
+	struct edit_index_entry* entry;
+	struct edit_index_scope* scope;
+
+	if (node == NULL || node->type != XML_ELEMENT_NODE || (entry = (struct edit_index_entry*)node->_private) == NULL) {
+		return;
+	}
+	scope = entry->scope;
+	edit_index_entry_free(index, entry);
+	edit_index_pending_add(scope, node);
+}
+
+/**
+ * @brief Update the index (and the undo record) of the original document after
+ * adding the node.
+ * @param[in] node Node just added into the original document.
+ */
+static void edit_index_add(xmlNodePtr node)
+{
+	struct edit_index* index;
+	struct edit_index_parent* parent;
+	struct edit_index_scope* scope;
+
+	edit_undo_record(node, EDIT_UNDO_LINK);
+	if (node == NULL || node->parent == NULL || (index = edit_index_get(node->doc)) == NULL) {
+		return;
+	}
+
+	edit_index_touch(index, node->parent);
+
+	if (node->type != XML_ELEMENT_NODE || (parent = edit_index_parent_get(index, node->parent, 0)) == NULL) {
+		return;
+	}
+	for (scope = parent->scopes; scope != NULL; scope = scope->next) {
+		if (xmlStrcmp(scope->name, node->name) == 0) {
+			edit_index_pending_add(scope, node);
+		}
+	}
+}
+
+/* drop the index parts related to the subtree of the node being removed */
+static void edit_index_remove_subtree(struct edit_index* index, xmlNodePtr node)
+{
+	struct edit_index_parent* parent;
+	xmlNodePtr child;
+
+	if (node->type != XML_ELEMENT_NODE) {
+		return;
+	}
+	if (node->_private != NULL) {
+		edit_index_entry_free(index, (struct edit_index_entry*)node->_private);
+	}
+	if ((parent = edit_index_parent_get(index, node, 0)) != NULL) {
+		edit_index_parent_free(index, parent);
+	}
+	if (index->list == NULL) {
+		/* nothing more to drop */
+		return;
+	}
+	for (child = node->children; child != NULL; child = child->next) {
+		edit_index_remove_subtree(index, child);
+	}
+}
+
+/**
+ * @brief Update the index (and the undo record) of the original document
+ * before removing the node.
+ * @param[in] node Node to be unlinked from the original document.
+ */
+static void edit_index_remove(xmlNodePtr node)
+{
+	struct edit_index* index;
+	struct edit_index_parent* parent;
+	struct edit_index_scope* scope;
 
-				/* cleanup for next round */
-				xmlFree(key_value2);
-				xmlFree(keynode_value2);
+	if (node != NULL && node->parent != NULL) {
+		edit_undo_record(node, EDIT_UNDO_UNLINK);
+	}
+	if (node == NULL || node->parent == NULL || (index = edit_index_get(node->doc)) == NULL) {
+		return;
+	}
 
-				if (key == NULL) {
-					/* there is no matching node */
-					free(keynode_list);
-					return 0;
-				}
+	edit_index_touch(index, node->parent);
 
-				/* go to the next key if any */
-				keynode = keynode_list[i];
-			}
-			free(keynode_list);
+	if ((parent = edit_index_parent_get(index, node->parent, 0)) != NULL) {
+		for (scope = parent->scopes; scope != NULL; scope = scope->next) {
+			edit_index_pending_remove(scope, node);
 		}
 	}
+	edit_index_remove_subtree(index, node);
+}
+
+void edit_node_drop(xmlNodePtr node)
+{
+	if (node == NULL) {
+		return;
+	}
 
-	return 1;
+	edit_index_remove(node);
+	xmlUnlinkNode(node);
+	edit_node_free(node);
 }
 
-static xmlNodePtr find_element_model_compare(xmlNodePtr node, xmlNodePtr model_node)
+void edit_index_start(xmlDocPtr doc)
 {
-	xmlNodePtr aux, retval;
-	xmlChar* name;
+	struct edit_index* index;
 
-	if (xmlStrcmp(model_node->name, BAD_CAST "choice") == 0 ||
-	    xmlStrcmp(model_node->name, BAD_CAST "case") == 0 ||
-	    xmlStrcmp(model_node->name, BAD_CAST "augment") == 0) {
-		for (aux = model_node->children; aux != NULL; aux = aux->next) {
-			retval = find_element_model_compare(node, aux);
-			if (retval != NULL) {
-				return (retval);
-			}
-		}
-	} else {
-		name = xmlGetProp(model_node, BAD_CAST "name");
-		if (name == NULL) {
-			return (NULL);
-		}
+	pthread_once(&edit_index_key_once, edit_index_key_init);
+	if ((index = calloc(1, sizeof(struct edit_index))) == NULL) {
+		/* work without the index */
+		return;
+	}
+	if ((index->parents = xmlHashCreate(64)) == NULL) {
+		free(index);
+		return;
+	}
+	index->doc = doc;
+	pthread_setspecific(edit_index_key, index);
+}
 
-		if (xmlStrcmp(node->name, name) == 0) {
-			xmlFree(name);
-			return (model_node);
-		}
-		xmlFree(name);
+void edit_index_stop(void)
+{
+	struct edit_index* index;
+
+	pthread_once(&edit_index_key_once, edit_index_key_init);
+	if ((index = (struct edit_index*)pthread_getspecific(edit_index_key)) == NULL) {
+		return;
 	}
+	pthread_setspecific(edit_index_key, NULL);
 
-	return (NULL);
+	while (index->list != NULL) {
+		edit_index_parent_free(index, index->list);
+	}
+	xmlHashFree(index->parents, NULL);
+	nc_arena_free(&index->arena);
+	free(index->keybuf);
+	free(index);
 }
 
 /**
- * @brief Go recursively in the YIN model and find model's equivalent of the node
- * @param[in] node XML element which we want to find in the model
- * @param[in] model Configuration data model (YIN format)
- * @return model's equivalent of the node, NULL if no such element is found.
+ * @brief Get the index scope for the children of the parent named as the edit
+ * node, create it if needed.
+ * @return The scope, NULL if the edit node cannot be searched via the index.
  */
-xmlNodePtr find_element_model(xmlNodePtr node, xmlDocPtr model)
+static struct edit_index_scope* edit_index_scope_get(struct edit_index* index, xmlNodePtr parent_node, xmlNodePtr edit, keyList keys, int leaf)
 {
-	xmlNodePtr mparent, aux, retval;
+	struct edit_index_parent* parent;
+	struct edit_index_scope* scope;
+	xmlNodePtr *keynodes = NULL, child;
+	const xmlChar* s;
+	int i;
 
-	if (node == NULL || node->parent == NULL) {
+	/* namespace wildcards (see nc_nscmp()) are not indexed */
+	if (edit->ns == NULL || edit->ns->href == NULL || !strcmp((char*)edit->ns->href, NC_NS_BASE10)) {
+		return (NULL);
+	}
+	for (s = edit->ns->href; *s != '\0' && isspace(*s); s++);
+	if (*s == '\0') {
+		/* empty after removing the whitespaces */
 		return (NULL);
 	}
 
-	if (node->parent->type != XML_DOCUMENT_NODE) {
-		mparent = find_element_model(node->parent, model);
-	} else {
-		mparent = xmlDocGetRootElement(model);
+	if ((parent = edit_index_parent_get(index, parent_node, 1)) == NULL) {
+		return (NULL);
 	}
-	if (mparent == NULL) {
+	for (scope = parent->scopes; scope != NULL; scope = scope->next) {
+		if (scope->leaf == leaf && xmlStrcmp(scope->name, edit->name) == 0) {
+			return (scope);
+		}
+	}
+
+	if (!leaf) {
+		/* only list instances with all their keys */
+		if (keys == NULL || get_keys(keys, edit, 1, &keynodes) != EXIT_SUCCESS || keynodes == NULL) {
+			return (NULL);
+		}
+		if (keynodes[0] == NULL) {
+			free(keynodes);
+			return (NULL);
+		}
+	} else if (edit->children == NULL || edit->children->type != XML_TEXT_NODE) {
 		return (NULL);
 	}
 
-	for (aux = mparent->children; aux != NULL; aux = aux->next) {
-		retval = find_element_model_compare(node, aux);
-		if (retval != NULL) {
-			return (retval);
+	if ((scope = calloc(1, sizeof(struct edit_index_scope))) == NULL) {
+		free(keynodes);
+		return (NULL);
+	}
+	scope->name = xmlStrdup(edit->name);
+	scope->leaf = leaf;
+	if (keynodes != NULL) {
+		for (i = 0; keynodes[i] != NULL; i++);
+		scope->keynames = calloc(i + 1, sizeof(char*));
+		for (i = 0; scope->keynames != NULL && keynodes[i] != NULL; i++) {
+			scope->keynames[i] = strdup((char*)keynodes[i]->name);
+		}
+		free(keynodes);
+		if (scope->keynames == NULL) {
+			edit_index_scope_free(scope);
+			return (NULL);
 		}
 	}
+	if ((scope->entries = xmlHashCreate(256)) == NULL) {
+		edit_index_scope_free(scope);
+		return (NULL);
+	}
+	scope->next = parent->scopes;
+	parent->scopes = scope;
 
-	return (NULL);
+	/* initial fill */
+	for (child = parent_node->children; child != NULL; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE && xmlStrcmp(child->name, scope->name) == 0) {
+			edit_index_insert(index, scope, child);
+		}
+	}
+
+	return (scope);
 }
 
 /**
- * @brief Get the default value of the node if a default value is defined in the model
- * @param[in] node XML element whose default value we want to get
- * @param[in] model Configuration data model for the document of the given node.
- * @return Default value of the node, NULL if no default value is defined or found.
+ * @brief Find the first child of the parent node matching the edit node (see
+ * matching_elements()), using the index of the original document if available.
+ * @param[in] parent Parent node whose children are searched.
+ * @param[in] edit Node whose equivalent is searched.
+ * @param[in] keys List of the key elements from the configuration data model.
+ * @param[in] leaf Leaf-list flag for matching_elements().
+ * @param[out] indexed Set to 1 if the index was used, the returned node is then
+ * the only matching node. Can be NULL.
+ * @return Found equivalent element, NULL if no such element exists.
  */
-static xmlChar* get_default_value(xmlNodePtr node, xmlDocPtr model)
+static xmlNodePtr find_child_equiv(xmlNodePtr parent, xmlNodePtr edit, keyList keys, int leaf, int* indexed)
 {
-	xmlNodePtr mnode, aux;
-	xmlChar* value = NULL;
+	struct edit_index* index;
+	struct edit_index_scope* scope = NULL;
+	struct edit_index_entry* entry;
+	xmlNodePtr node, *pending;
+	const xmlChar* key;
+	int i, count;
+
+	if (indexed != NULL) {
+		*indexed = 0;
+	}
 
-	mnode = find_element_model(node, model);
-	if (mnode == NULL) {
-		return (NULL);
+	if (edit->type == XML_ELEMENT_NODE && (index = edit_index_get(parent->doc)) != NULL) {
+		scope = edit_index_scope_get(index, parent, edit, keys, leaf);
+	}
+	if (scope != NULL && scope->pending_count > 0) {
+		/* try to index the nodes added or changed since the last search */
+		pending = scope->pending;
+		count = scope->pending_count;
+		scope->pending = NULL;
+		scope->pending_count = scope->pending_size = 0;
+		for (i = 0; i < count; i++) {
+			edit_index_insert(index, scope, pending[i]);
+		}
+		free(pending);
+	}
+	if (scope != NULL && (key = edit_index_keystr(index, edit, scope, NULL)) != NULL) {
+		entry = (struct edit_index_entry*)xmlHashLookup(scope->entries, key);
+		if (entry != NULL && entry->node->parent == parent && matching_elements(edit, entry->node, keys, leaf) == 1) {
+			if (indexed != NULL) {
+				*indexed = 1;
+			}
+			return (entry->node);
+		} else if (entry == NULL) {
+			for (i = 0; i < scope->pending_count; i++) {
+				if (scope->pending[i]->parent == parent && matching_elements(edit, scope->pending[i], keys, leaf) == 1) {
+					return (scope->pending[i]);
+				}
+			}
+			if (indexed != NULL) {
+				*indexed = 1;
+			}
+			return (NULL);
+		}
+		/* inconsistent index, use the full search */
 	}
 
-	for (aux = mnode->children; aux != NULL; aux = aux->next) {
-		if (xmlStrcmp(aux->name, BAD_CAST "default") == 0) {
-			value = xmlGetNsProp(aux, BAD_CAST "value", BAD_CAST NC_NS_YIN);
-			break;
+	for (node = parent->children; node != NULL; node = node->next) {
+		if (matching_elements(edit, node, keys, leaf) != 0) {
+			return (node);
 		}
 	}
 
-	return (value);
+	return (NULL);
 }
 
 /**
- * \brief Find an equivalent of the given edit node on orig_doc document.
+ * \\brief Find an equivalent of the given edit node on orig_doc document.
  *
  * \param[in] orig_doc Original configuration document to edit.
  * \param[in] edit Element from the edit-config's \<config\>. Its equivalent in
@@ -628,7 +1779,7 @@ static xmlChar* get_default_value(xmlNodePtr node, xmlDocPtr model)
  */
 xmlNodePtr find_element_equiv(xmlDocPtr orig_doc, xmlNodePtr edit, xmlDocPtr model, keyList keys)
 {
-	xmlNodePtr orig_parent, node, model_def;
+	xmlNodePtr orig_parent, model_def;
 	int leaf = 0;
 
 	if (edit == NULL || orig_doc == NULL) {
@@ -656,21 +1807,7 @@ xmlNodePtr find_element_equiv(xmlDocPtr orig_doc, xmlNodePtr edit, xmlDocPtr mod
 	}
 
 	/* element check */
-	node = orig_parent->children;
-	while (node != NULL) {
-		/* compare edit and node */
-		if (matching_elements(edit, node, keys, leaf) == 0) {
-			/* non matching nodes */
-			node = node->next;
-			continue;
-		} else {
-			/* matching nodes found */
-			return (node);
-		}
-	}
-
-	/* no corresponding node found */
-	return (NULL);
+	return (find_child_equiv(orig_parent, edit, keys, leaf, NULL));
 }
 
 /**
@@ -732,7 +1869,7 @@ static xmlXPathObjectPtr get_operation_elements(NC_EDIT_OP_TYPE op, xmlDocPtr ed
 		ERROR("Preparing the XPath query failed (%s:%d).", __FILE__, __LINE__);
 		return (NULL);
 	}
-	operation_nodes = xmlXPathEvalExpression(BAD_CAST xpath, edit_ctxt);
+	operation_nodes = nc_xpath_eval((char*) xpath, edit_ctxt);
 
 	/* clean up */
 	xmlXPathFreeContext(edit_ctxt);
@@ -963,8 +2100,7 @@ static int check_edit_ops(NC_CHECK_EDIT_OP op, NC_EDIT_DEFOP_TYPE defop, xmlDocP
 					 * allow recreate it by the new one with
 					 * the default value
 					 */
-					xmlUnlinkNode(n);
-					xmlFreeNode(n);
+					edit_node_drop(n);
 				}
 				xmlFree(defval);
 				defval = NULL;
@@ -1009,8 +2145,7 @@ static int edit_delete(xmlNodePtr node)
 
 	VERB("Deleting the node %s (%s:%d)", (char*)node->name, __FILE__, __LINE__);
 	if (node != NULL) {
-		xmlUnlinkNode(node);
-		xmlFreeNode(node);
+		edit_node_drop(node);
 	}
 
 	return EXIT_SUCCESS;
@@ -1480,11 +2615,39 @@ static void nc_clear_namespaces(xmlNodePtr node)
 	}
 }
 
+/**
+ * @brief Get the edit node to be placed into the configuration data under the
+ * parent. In the bulk merge (see edit_merge_only()), the edit element is moved
+ * from the edit document, otherwise its copy is returned.
+ * @return Node to link into the configuration data, NULL on error.
+ */
+static xmlNodePtr edit_node_take(xmlNodePtr parent, xmlNodePtr edit_node)
+{
+	struct edit_index* index;
+
+	index = edit_index_get(parent->doc);
+	if (index == NULL || !index->adopt || edit_node->type != XML_ELEMENT_NODE) {
+		return (xmlCopyNode(edit_node, 1));
+	}
+
+	xmlUnlinkNode(edit_node);
+	if (xmlDOMWrapAdoptNode(NULL, edit_node->doc, edit_node, parent->doc,
+			(parent->type == XML_ELEMENT_NODE) ? parent : NULL, 0) != 0) {
+		ERROR("Moving the edit node %s failed (%s:%d).", (char*)edit_node->name, __FILE__, __LINE__);
+		xmlFreeNode(edit_node);
+		return (NULL);
+	}
+
+	return (edit_node);
+}
+
 /**
  * Common routine to create a node
  */
 static int edit_create_routine(xmlNodePtr parent, xmlNodePtr edit_node)
 {
+	xmlNodePtr created;
+
 	if (parent == NULL || edit_node == NULL) {
 		ERROR("%s: invalid input parameter.", __func__);
 		return (EXIT_FAILURE);
@@ -1494,17 +2657,18 @@ static int edit_create_routine(xmlNodePtr parent, xmlNodePtr edit_node)
 	VERB("Creating the node %s (%s:%d)", (char*)edit_node->name, __FILE__, __LINE__);
 	if (parent->type == XML_DOCUMENT_NODE) {
 		if (parent->children == NULL) {
-			xmlDocSetRootElement(parent->doc, xmlCopyNode(edit_node, 1));
+			xmlDocSetRootElement(parent->doc, created = edit_node_take(parent, edit_node));
 		} else {
 			/* adding root's sibling! */
-			xmlAddChild(parent, xmlCopyNode(edit_node, 1));
+			created = xmlAddChild(parent, edit_node_take(parent, edit_node));
 		}
 	} else {
-		if (xmlAddChild(parent, xmlCopyNode(edit_node, 1)) == NULL) {
+		if ((created = xmlAddChild(parent, edit_node_take(parent, edit_node))) == NULL) {
 			ERROR("%s: Creating new node (%s) failed (%s:%d)", __func__, (char*)(edit_node->name), __FILE__, __LINE__);
 			return (EXIT_FAILURE);
 		}
 	}
+	edit_index_add(created);
 
 	return (EXIT_SUCCESS);
 }
@@ -1536,12 +2700,12 @@ static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
 
 	/* switch according to the insert value */
 	if (insert == NULL || xmlStrcmp(insert, BAD_CAST "last") == 0) {
-		if ((created = xmlAddChild(parent, xmlCopyNode(edit_node, 1))) == NULL) {
+		if ((created = xmlAddChild(parent, edit_node_take(parent, edit_node))) == NULL) {
 			goto error;
 		}
 	} else if (xmlStrcmp(insert, BAD_CAST "first") == 0) {
 		if (parent->children == NULL) {
-			if ((created = xmlAddChild(parent, xmlCopyNode(edit_node, 1))) == NULL) {
+			if ((created = xmlAddChild(parent, edit_node_take(parent, edit_node))) == NULL) {
 				goto error;
 			}
 		} else {
@@ -1560,18 +2724,18 @@ static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
 				}
 				if (node != NULL) {
 					/* put the new node before the currently first instance of the list */
-					if ((created = xmlAddPrevSibling(node, xmlCopyNode(edit_node, 1))) == NULL) {
+					if ((created = xmlAddPrevSibling(node, edit_node_take(parent, edit_node))) == NULL) {
 						goto error;
 					}
 				} else {
 					/* put it as last node since there is currently no instance of the list */
-					if ((created = xmlAddChild(parent, xmlCopyNode(edit_node, 1))) == NULL) {
+					if ((created = xmlAddChild(parent, edit_node_take(parent, edit_node))) == NULL) {
 						goto error;
 					}
 				}
 			} else {
 				/* it is not a list, so simply place it as the first child */
-				if ((created = xmlAddPrevSibling(parent->children, xmlCopyNode(edit_node, 1))) == NULL) {
+				if ((created = xmlAddPrevSibling(parent->children, edit_node_take(parent, edit_node))) == NULL) {
 					goto error;
 				}
 			}
@@ -1605,13 +2769,13 @@ static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
 				if (before_flag == 1) {
 					/* place the node before its reference */
 					xmlRemoveProp(xmlHasNsProp(edit_node, BAD_CAST "key", BAD_CAST NC_NS_YANG));
-					if ((created = xmlAddPrevSibling(node, xmlCopyNode(edit_node, 1))) == NULL) {
+					if ((created = xmlAddPrevSibling(node, edit_node_take(parent, edit_node))) == NULL) {
 						goto error;
 					}
 				} else if (before_flag == 0) {
 					/* place the node after its reference */
 					xmlRemoveProp(xmlHasNsProp(edit_node, BAD_CAST "key", BAD_CAST NC_NS_YANG));
-					if ((created = xmlAddNextSibling(node, xmlCopyNode(edit_node, 1))) == NULL) {
+					if ((created = xmlAddNextSibling(node, edit_node_take(parent, edit_node))) == NULL) {
 						goto error;
 					}
 				} /* else nonsence */
@@ -1620,6 +2784,7 @@ static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
 	}
 
 	xmlFree(insert);
+	edit_index_add(created);
 	nc_clear_namespaces(created);
 
 	return (EXIT_SUCCESS);
@@ -1770,14 +2935,20 @@ static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_no
 		}
 
 		if (edit_node->parent->type == XML_DOCUMENT_NODE) {
-			/* original document is empty */
+			/* the top-level element is missing in the original document */
 			VERB("Creating the parent %s (%s:%d)", (char*)edit_node->name, __FILE__, __LINE__);
 			retval = xmlCopyNode(edit_node, 0);
 			if (edit_node->ns) {
 				ns_aux = xmlNewNs(retval, edit_node->ns->href, NULL);
 				xmlSetNs(retval, ns_aux);
 			}
-			xmlDocSetRootElement(orig_doc, retval);
+			if (orig_doc->children == NULL) {
+				xmlDocSetRootElement(orig_doc, retval);
+			} else {
+				/* adding root's sibling, do not replace the present root */
+				xmlAddChild((xmlNodePtr)orig_doc, retval);
+			}
+			edit_index_add(retval);
 			return (retval);
 		}
 
@@ -1787,6 +2958,7 @@ static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_no
 		}
 		VERB("Creating the parent %s (%s:%d)", (char*)edit_node->name, __FILE__, __LINE__);
 		retval = xmlAddChild(parent, xmlCopyNode(edit_node, 0));
+		edit_index_add(retval);
 		if (edit_node->ns && parent->ns && xmlStrcmp(edit_node->ns->href, parent->ns->href) == 0) {
 			xmlSetNs(retval, parent->ns);
 		} else if (edit_node->ns) {
@@ -1867,8 +3039,10 @@ static int edit_create(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_T
 		}
 	}
 
-	/* remove the node from the edit document */
-	edit_delete(edit_node);
+	/* remove the node from the edit document, unless it was moved */
+	if (edit_node->doc != orig_doc) {
+		edit_delete(edit_node);
+	}
 
 	return EXIT_SUCCESS;
 }
@@ -1985,8 +3159,7 @@ static int edit_replace(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_
 		 * "moving" of the instance of the list/leaf-list using YANG's insert
 		 * attribute
 		 */
-		xmlUnlinkNode(old);
-		xmlFreeNode(old);
+		edit_node_drop(old);
 		return edit_create(orig_doc, edit_node, defop, model, keys, nacm, error);
 	}
 }
@@ -2017,12 +3190,14 @@ static int edit_merge_lists(xmlNodePtr merged_node, xmlNodePtr edit_node, xmlDoc
 			if (insert == NULL || strcmp(insert, "last") == 0) {
 				/* move aux to the end of the children list */
 				if (merged_node->next != NULL) {
+					edit_index_remove(merged_node);
 					xmlUnlinkNode(merged_node);
-					xmlAddChild(parent, merged_node);
+					edit_index_add(xmlAddChild(parent, merged_node));
 				}
 			} else if (strcmp(insert, "first") == 0) {
 				/* move it to the beginning of the children list */
 				if (merged_node->prev != NULL) {
+					edit_index_remove(merged_node);
 					xmlUnlinkNode(merged_node);
 					if (is_user_ordered_list(find_element_model(parent, model)) != 0) {
 						/* we are in the list, so the first nodes must be the keys and
@@ -2038,14 +3213,14 @@ static int edit_merge_lists(xmlNodePtr merged_node, xmlNodePtr edit_node, xmlDoc
 						}
 						if (refnode != NULL) {
 							/* relink th node before the currently first instance of the list */
-							xmlAddPrevSibling(refnode, xmlCopyNode(merged_node, 1));
+							edit_index_add(xmlAddPrevSibling(refnode, xmlCopyNode(merged_node, 1)));
 						} else {
 							/* re-link the node as last node since there is currently no instance of the list */
-							xmlAddChild(parent, xmlCopyNode(merged_node, 1));
+							edit_index_add(xmlAddChild(parent, xmlCopyNode(merged_node, 1)));
 						}
 					} else {
 						/* it is not a list, so simply place it as the first child */
-						xmlAddPrevSibling(parent->children, merged_node);
+						edit_index_add(xmlAddPrevSibling(parent->children, merged_node));
 					}
 				}
 			} else {
@@ -2078,12 +3253,14 @@ static int edit_merge_lists(xmlNodePtr merged_node, xmlNodePtr edit_node, xmlDoc
 					if (!matching_elements(merged_node, refnode, keys, (list_type == 2) ? 1 : 0)) {
 						if (before_flag == 1) {
 							/* place the node before its reference */
+							edit_index_remove(merged_node);
 							xmlUnlinkNode(merged_node);
-							xmlAddPrevSibling(refnode, merged_node);
+							edit_index_add(xmlAddPrevSibling(refnode, merged_node));
 						} else if (before_flag == 0) {
 							/* place the node after its reference */
+							edit_index_remove(merged_node);
 							xmlUnlinkNode(merged_node);
-							xmlAddNextSibling(refnode, merged_node);
+							edit_index_add(xmlAddNextSibling(refnode, merged_node));
 						} /* else nonsense */
 					} /* else we are referencing the same node as being merged */
 				}
@@ -2130,7 +3307,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 {
 	xmlNodePtr children, aux, next, nextchild, parent;
 	int r, access, duplicates;
-	int leaf_list;
+	int leaf_list, indexed = 0;
 	char *msg = NULL;
 
 	/* process leaf text nodes - even if we are merging, leaf text nodes are
@@ -2176,11 +3353,13 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 			}
 
 			if (access == NACM_ACCESS_UPDATE) {
+				edit_index_remove(orig_node);
 				if (xmlReplaceNode(orig_node, aux = xmlCopyNode(edit_node, 1)) == NULL) {
 					ERROR("Replacing text nodes when merging failed (%s:%d)", __FILE__, __LINE__);
 					return EXIT_FAILURE;
 				}
-				xmlFreeNode(orig_node);
+				edit_index_add(aux);
+				edit_node_free(orig_node);
 				nc_clear_namespaces(aux);
 			} else { /* access == NACM_ACCESS_CREATE */
 				duplicates = 0;
@@ -2201,6 +3380,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 						ERROR("Adding leaf-list node when merging failed (%s:%d)", __FILE__, __LINE__);
 						return EXIT_FAILURE;
 					}
+					edit_index_add(aux);
 					nc_clear_namespaces(aux);
 				}
 			}
@@ -2212,6 +3392,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 		/* skip checks if the node is text */
 		if (children->type == XML_TEXT_NODE) {
 			/* find text element to children */
+			indexed = 0;
 			aux = orig_node->children;
 			while (aux != NULL && aux->type != XML_TEXT_NODE) {
 				aux = aux->next;
@@ -2230,10 +3411,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 
 			/* find matching element to children */
 			leaf_list = is_leaf_list(children, model);
-			aux = orig_node->children;
-			while (aux != NULL && matching_elements(children, aux, keys, leaf_list) == 0) {
-				aux = aux->next;
-			}
+			aux = find_child_equiv(orig_node, children, keys, leaf_list, &indexed);
 		}
 
 		nextchild = children->next;
@@ -2302,6 +3480,10 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 						if (edit_choice_clean(parent, children, model, nacm, error) == EXIT_FAILURE) {
 							return (EXIT_FAILURE);
 						}
+						if (indexed) {
+							/* found via the index, there is no other matching sibling */
+							next = NULL;
+						}
 					}
 					aux = next;
 				}
@@ -2317,7 +3499,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr orig_node;
-	xmlNodePtr aux, children;
+	xmlNodePtr aux, children, nextchild;
 	int r;
 	char *msg = NULL;
 
@@ -2343,6 +3525,7 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 			continue;
 		}
 
+		nextchild = children->next;
 		aux = find_element_equiv(orig_doc, children, model, keys);
 		if (aux == NULL) {
 			/*
@@ -2370,10 +3553,11 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 				}
 			}
 
-			if ((aux = xmlAddChild(orig_node, xmlCopyNode(children, 1))) == NULL) {
+			if ((aux = xmlAddChild(orig_node, edit_node_take(orig_node, children))) == NULL) {
 				ERROR("Adding missing nodes when merging failed (%s:%d)", __FILE__, __LINE__);
 				return EXIT_FAILURE;
 			}
+			edit_index_add(aux);
 		} else {
 			/* go recursive */
 			VERB("Merging the node %s (%s:%d)", (char*)children->name, __FILE__, __LINE__);
@@ -2390,7 +3574,7 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 			return (EXIT_FAILURE);
 		}
 
-		children = children->next;
+		children = nextchild;
 	}
 	/* remove the node from the edit document */
 	edit_delete(edit_node);
@@ -2576,6 +3760,76 @@ error:
 	return EXIT_FAILURE;
 }
 
+/**
+ * \brief Check that the edit-config's data contain no other operation than "merge".
+ *
+ * \param[in] node First of the sibling nodes to check recursively.
+ * \return 1 if only the "merge" operations are specified, 0 otherwise (including
+ * invalid operation values).
+ */
+static int edit_merge_only(xmlNodePtr node)
+{
+	for (; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (xmlHasNsProp(node, BAD_CAST NC_EDIT_ATTR_OP, BAD_CAST NC_NS_BASE) != NULL &&
+				get_operation(node, NC_EDIT_DEFOP_NOTSET, NULL) != NC_EDIT_OP_MERGE) {
+			return (0);
+		}
+		if (edit_merge_only(node->children) == 0) {
+			return (0);
+		}
+	}
+
+	return (1);
+}
+
+/**
+ * \brief Merge the whole edit_doc into orig_doc in a single pass.
+ *
+ * The edit-config's data must be checked by edit_merge_only() and compacted
+ * with the "merge" default operation. Since there is nothing else to do with
+ * the edit document, the missing elements are moved from it into orig_doc
+ * instead of copying them.
+ *
+ * Parameters are the same as for edit_operations().
+ */
+static int edit_bulk_merge(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, const struct nacm_rpc* nacm, struct nc_err **error)
+{
+	struct edit_index* index;
+	keyList keys;
+	int ret = EXIT_SUCCESS;
+
+	if (error != NULL) {
+		*error = NULL;
+	}
+
+	keys = get_keynode_list(model);
+	if ((index = edit_index_get(orig_doc)) != NULL) {
+		index->adopt = 1;
+	}
+
+	while (edit_doc->children != NULL) {
+		if (edit_merge(orig_doc, edit_doc->children, defop, model, keys, nacm, error) != EXIT_SUCCESS) {
+			ret = EXIT_FAILURE;
+			break;
+		}
+	}
+
+	if (index != NULL) {
+		index->adopt = 0;
+	}
+	if (keys != NULL) {
+		keyListFree(keys);
+	}
+	if (ret != EXIT_SUCCESS && error != NULL && *error == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+	}
+
+	return (ret);
+}
+
 static int compact_edit_operations_recursively(xmlNodePtr node, NC_EDIT_OP_TYPE supreme_op)
 {
 	NC_EDIT_OP_TYPE op;
@@ -2655,7 +3909,7 @@ static int compact_edit_operations(xmlDocPtr edit_doc, NC_EDIT_DEFOP_TYPE defop)
 
 static int check_list_keys(xmlDocPtr edit, xmlDocPtr model, struct nc_err **error)
 {
-	xmlNodePtr listdef;
+	xmlNodePtr listdef, keynode;
 	xmlNodePtr *keys = NULL;
 	xmlNodePtr node, next;
 	keyList modelkeys;
@@ -2671,15 +3925,20 @@ static int check_list_keys(xmlDocPtr edit, xmlDocPtr model, struct nc_err **erro
 	node = xmlDocGetRootElement(edit);
 	while (node) {
 		if ((listdef = is_list(node, model)) != NULL) {
-			for (i = 0; i < modelkeys->nodesetval->nodeNr; i++) {
-				if (modelkeys->nodesetval->nodeTab[i]->parent == listdef) {
-					break;
+			if (MODEL_INDEX(model) != NULL && MODEL_INDEX_NODE(listdef) != NULL) {
+				keynode = MODEL_INDEX_NODE(listdef)->key;
+			} else {
+				for (i = 0, keynode = NULL; i < modelkeys->nodesetval->nodeNr; i++) {
+					if (modelkeys->nodesetval->nodeTab[i]->parent == listdef) {
+						keynode = modelkeys->nodesetval->nodeTab[i];
+						break;
+					}
 				}
 			}
 
-			if (i < modelkeys->nodesetval->nodeNr) {
+			if (keynode != NULL) {
 				/* find out if all the keys are present in edit data */
-				if (find_key_elems(modelkeys->nodesetval->nodeTab[i], node, 1, &keys)) {
+				if (find_key_elems(keynode, node, 1, &keys)) {
 					ret = EXIT_FAILURE;
 					goto cleanup;
 				}
@@ -2737,6 +3996,73 @@ cleanup:
 	return ret;
 }
 
+/* copy of the edit content processed by edit_config() for the caller */
+struct edit_changes {
+	xmlDocPtr edit;
+	int calls;
+};
+
+static pthread_key_t edit_changes_key;
+static pthread_once_t edit_changes_key_once = PTHREAD_ONCE_INIT;
+
+static void edit_changes_key_init(void)
+{
+	pthread_key_create(&edit_changes_key, NULL);
+}
+
+void edit_changes_start(void)
+{
+	struct edit_changes* changes;
+
+	pthread_once(&edit_changes_key_once, edit_changes_key_init);
+	if ((changes = calloc(1, sizeof(struct edit_changes))) == NULL) {
+		/* nothing will be recorded */
+		return;
+	}
+	pthread_setspecific(edit_changes_key, changes);
+}
+
+xmlDocPtr edit_changes_stop(void)
+{
+	struct edit_changes* changes;
+	xmlDocPtr edit;
+
+	pthread_once(&edit_changes_key_once, edit_changes_key_init);
+	if ((changes = (struct edit_changes*)pthread_getspecific(edit_changes_key)) == NULL) {
+		return (NULL);
+	}
+	pthread_setspecific(edit_changes_key, NULL);
+
+	edit = changes->edit;
+	free(changes);
+
+	return (edit);
+}
+
+/**
+ * @brief Remember the edit content for edit_changes_stop(), if requested.
+ */
+static void edit_changes_record(xmlDocPtr edit, NC_EDIT_DEFOP_TYPE defop)
+{
+	struct edit_changes* changes;
+
+	pthread_once(&edit_changes_key_once, edit_changes_key_init);
+	if ((changes = (struct edit_changes*)pthread_getspecific(edit_changes_key)) == NULL) {
+		return;
+	}
+
+	xmlFreeDoc(changes->edit);
+	if (defop == NC_EDIT_DEFOP_REPLACE || changes->calls++) {
+		/* the whole datastore is replaced or several edits were applied,
+		 * a single edit does not limit the changes */
+		changes->edit = NULL;
+	} else {
+		/* the edit document is modified (and its nodes can be moved into
+		 * the repo) while it is applied, so keep a copy */
+		changes->edit = xmlCopyDoc(edit, 1);
+	}
+}
+
 /**
  * \brief Perform edit-config changes according to the given parameters
  *
@@ -2753,19 +4079,32 @@ cleanup:
  */
 int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE UNUSED(errop), const struct nacm_rpc* nacm, struct nc_err **error)
 {
+	int bulk;
+	uint64_t trace_start;
+
 	if (repo == NULL || edit == NULL) {
 		return (EXIT_FAILURE);
 	}
+	trace_start = nc_trace_begin();
+
+	/* index the list instances in repo for the time of this edit-config */
+	edit_index_start(repo);
 
 	/* check validity - for list instances, all keys must be present */
 	if (check_list_keys(edit, ds->ext_model, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
+	edit_changes_record(edit, defop);
+
+	/* with nothing but merging, there are no operations to check and
+	 * the edit can be merged at once */
+	bulk = (defop == NC_EDIT_DEFOP_MERGE || defop == NC_EDIT_DEFOP_NOTSET) && edit_merge_only(edit->children);
+
 	/* check operations */
-	if (check_edit_ops(NC_CHECK_EDIT_DELETE, defop, repo, edit, ds->ext_model, error) != EXIT_SUCCESS) {
+	if (!bulk && check_edit_ops(NC_CHECK_EDIT_DELETE, defop, repo, edit, ds->ext_model, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
-	if (check_edit_ops(NC_CHECK_EDIT_CREATE, defop, repo, edit, ds->ext_model, error) != EXIT_SUCCESS) {
+	if (!bulk && check_edit_ops(NC_CHECK_EDIT_CREATE, defop, repo, edit, ds->ext_model, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
 
@@ -2778,9 +4117,14 @@ int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFO
 	}
 
 	/* perform operations */
-	if (edit_operations(repo, edit, defop, ds->ext_model, nacm, error) != EXIT_SUCCESS) {
+	if (bulk) {
+		if (edit_bulk_merge(repo, edit, defop, ds->ext_model, nacm, error) != EXIT_SUCCESS) {
+			goto error_cleanup;
+		}
+	} else if (edit_operations(repo, edit, defop, ds->ext_model, nacm, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
+	edit_index_stop();
 
 	/* with defaults capability */
 	if (ncdflt_get_basic_mode() == NCWD_MODE_TRIM) {
@@ -2789,10 +4133,13 @@ int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFO
 		 */
 		ncdflt_default_values(repo, ds->ext_model, NCWD_MODE_TRIM);
 	}
+	nc_trace_end(NC_TRACE_EDIT, trace_start);
 
 	return EXIT_SUCCESS;
 
 error_cleanup:
+	edit_index_stop();
+	nc_trace_end(NC_TRACE_EDIT, trace_start);
 
 	return EXIT_FAILURE;
 }
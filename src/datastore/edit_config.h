@@ -49,10 +49,42 @@
 #define NC_EDIT_CONFIG_H_
 
 typedef xmlXPathObjectPtr keyList;
-#define keyListFree(x) xmlXPathFreeObject((xmlXPathObjectPtr)x)
 
 keyList get_keynode_list(xmlDocPtr model);
 
+/**
+ * @brief Free the list returned by get_keynode_list(). The list shared from
+ * the index of the model is kept untouched.
+ * @param[in] keys List to free, NULL is accepted.
+ */
+void keyListFree(keyList keys);
+
+/**
+ * @brief Build the index of the configuration data model (YIN format) used to
+ * speed up searching in the model by the edit-config and with-defaults
+ * functions. The model must not be changed while the index exists.
+ * @param[in] model Complete configuration data model.
+ * @return EXIT_SUCCESS or EXIT_FAILURE, the model is searched without the
+ * index in case of failure.
+ */
+int model_index_build(xmlDocPtr model);
+
+/**
+ * @brief Free the index of the configuration data model built by
+ * model_index_build(), if any. Must be called before changing or freeing the
+ * model.
+ * @param[in] model Configuration data model.
+ */
+void model_index_free(xmlDocPtr model);
+
+/**
+ * @brief Get the default values of the configuration data model precomputed
+ * while building its index by model_index_build().
+ * @param[in] model Configuration data model.
+ * @return Precomputed defaults, NULL if the model is not indexed.
+ */
+struct ncdflt_defaults* model_index_defaults(xmlDocPtr model);
+
 /**
  * \brief Compare 2 elements and decide if they are equal for NETCONF.
  *
@@ -104,6 +136,78 @@ xmlNodePtr find_element_model(xmlNodePtr node, xmlDocPtr model);
  */
 int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE UNUSED(errop), const struct nacm_rpc* nacm, struct nc_err **error);
 
+/**
+ * \brief Start indexing the list instances of the original document for
+ * the following find_element_equiv() calls of the thread. edit_config() does
+ * it for the time of its call.
+ *
+ * \param[in] doc Original configuration document, it must be changed only by
+ * the edit-config functions until edit_index_stop() is called.
+ */
+void edit_index_start(xmlDocPtr doc);
+
+/**
+ * \brief Stop indexing started by edit_index_start().
+ */
+void edit_index_stop(void);
+
+/**
+ * \brief Start recording the changes made by the following edit_config()
+ * call of the thread.
+ */
+void edit_changes_start(void);
+
+/**
+ * \brief Stop recording the changes started by edit_changes_start().
+ *
+ * \return Copy of the edit content applied by edit_config(), the changed data
+ * are limited to the subtrees it describes. NULL if edit_config() was not
+ * called or if the edit can change any data (default operation replace).
+ * The caller is supposed to free the document.
+ */
+xmlDocPtr edit_changes_stop(void);
+
+struct edit_undo;
+
+/**
+ * \brief Start recording the undo record of the changes made in the document
+ * by the following edit_config() calls of the thread. The nodes removed from
+ * the document are kept in the record instead of being freed.
+ * \param[in] doc Original configuration document, it must be changed only by
+ * the edit-config functions until edit_undo_stop() is called.
+ * \return EXIT_SUCCESS or EXIT_FAILURE if the recording cannot be started.
+ */
+int edit_undo_start(xmlDocPtr doc);
+
+/**
+ * \brief Stop recording started by edit_undo_start().
+ * \return The undo record of the changes, to be passed to edit_undo_revert()
+ * or edit_undo_free().
+ */
+struct edit_undo* edit_undo_stop(void);
+
+/**
+ * \brief Revert the recorded changes, the document must not be changed since
+ * the recording, except by other already reverted records. The record is freed.
+ * \param[in] undo Undo record from edit_undo_stop().
+ * \return EXIT_SUCCESS or EXIT_FAILURE if some change was not recorded and the
+ * document was left unchanged.
+ */
+int edit_undo_revert(struct edit_undo* undo);
+
+/**
+ * \brief Free the undo record and so keep the recorded changes.
+ * \param[in] undo Undo record from edit_undo_stop().
+ */
+void edit_undo_free(struct edit_undo* undo);
+
+/**
+ * \brief Remove the node from the original document, it is kept in the undo
+ * record if the document changes are recorded, freed otherwise.
+ * \param[in] node Node to remove.
+ */
+void edit_node_drop(xmlNodePtr node);
+
 int edit_replace_nacmcheck(xmlNodePtr orig_node, xmlDocPtr edit_doc, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error);
 int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error);
 
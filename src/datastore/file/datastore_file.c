@@ -44,6 +44,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
@@ -67,33 +68,168 @@ static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
 #define FILEDSFRAME "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\
 <datastores xmlns=\"urn:cesnet:tmc:datastores:file\">\
-  <running lock=\"\"/>\
-  <startup lock=\"\"/>\
-  <candidate modified=\"false\" lock=\"\"/>\
+  <running/>\
+  <startup/>\
+  <candidate modified=\"false\"/>\
 </datastores>"
 
 static struct timespec tv_timeout;
 static sigset_t fullsigset;
 
-#define LOCK(file_ds, ret) {\
+/* names of the datastore parts used as the suffixes of their files */
+static const char* file_part_names[NCDS_FILE_PARTS] = {"running", "startup", "candidate"};
+
+/**
+ * @brief Get the mask of the datastore part.
+ * @param[in] target Datastore type.
+ * @return Mask of the datastore part, all the parts for an invalid value.
+ */
+static int file_part_mask(NC_DATASTORE target)
+{
+	switch (target) {
+	case NC_DATASTORE_RUNNING:
+		return (1 << NCDS_FILE_RUNNING);
+	case NC_DATASTORE_STARTUP:
+		return (1 << NCDS_FILE_STARTUP);
+	case NC_DATASTORE_CANDIDATE:
+		return (1 << NCDS_FILE_CANDIDATE);
+	default:
+		return (NCDS_FILE_ALL);
+	}
+}
+
+static int file_part_index(NC_DATASTORE target)
+{
+	switch (target) {
+	case NC_DATASTORE_RUNNING:
+		return (NCDS_FILE_RUNNING);
+	case NC_DATASTORE_STARTUP:
+		return (NCDS_FILE_STARTUP);
+	case NC_DATASTORE_CANDIDATE:
+		return (NCDS_FILE_CANDIDATE);
+	default:
+		return (-1);
+	}
+}
+
+/**
+ * @brief Release all the locks held by the process.
+ * @param[in] file_ds File datastore structure.
+ */
+static void file_ds_unlock(struct ncds_ds_file* file_ds)
+{
+	int i;
+
+	if (!file_ds->ds_lock.holding_lock) {
+		return;
+	}
+
+	for (i = NCDS_FILE_PARTS - 1; i >= 0; i--) {
+		if (file_ds->ds_lock.holding_lock & (1 << i)) {
+			pthread_rwlock_unlock(&(file_ds->ds_lock.lock[i]->lock));
+		}
+	}
+	file_ds->ds_lock.holding_lock = 0;
+	nc_metrics_since(NC_METRIC_HIST_FILE_LOCK_HOLD, 0, file_ds->ds_lock.locked_at);
+	pthread_mutex_unlock(&(file_ds->ds_lock.thread_lock));
+}
+
+/**
+ * @brief Get the locks of the specified datastore parts. To avoid deadlocks,
+ * the locks are always taken in the same order. Use the LOCK or RDLOCK macro
+ * instead of the direct call.
+ * @param[in] file_ds File datastore structure.
+ * @param[in] parts Mask of the datastore parts to lock.
+ * @param[in] write Flag if the datastore is going to be modified, otherwise
+ * the lock is shared with other readers.
+ * @return 0 on success, 1 on timeout.
+ */
+static int file_ds_lock(struct ncds_ds_file* file_ds, int parts, int write)
+{
+	int i, r;
+	uint64_t start = nc_metrics_now();
+
+	if (!file_ds->split) {
+		/* single lock for all the parts */
+		parts = 1;
+	}
+
+	if (pthread_mutex_timedlock(&(file_ds->ds_lock.thread_lock), &tv_timeout) != 0) {
+		return (1);
+	}
+	/* mark the lock as held to release the thread lock in any case */
+	file_ds->ds_lock.holding_lock = 1 << NCDS_FILE_PARTS;
+
+	for (i = 0; i < NCDS_FILE_PARTS; i++) {
+		if (!(parts & (1 << i))) {
+			continue;
+		}
+		if (write) {
+			r = pthread_rwlock_timedwrlock(&(file_ds->ds_lock.lock[i]->lock), &tv_timeout);
+		} else {
+			r = pthread_rwlock_timedrdlock(&(file_ds->ds_lock.lock[i]->lock), &tv_timeout);
+		}
+		if (r != 0) {
+			ERROR("Locking the file datastore failed (%s).", strerror(r));
+			file_ds_unlock(file_ds);
+			return (1);
+		}
+		file_ds->ds_lock.holding_lock |= (1 << i);
+	}
+	if (start != 0) {
+		file_ds->ds_lock.locked_at = nc_metrics_now();
+		nc_metrics_observe(NC_METRIC_HIST_FILE_LOCK_WAIT, 0, file_ds->ds_lock.locked_at - start);
+	}
+
+	return (0);
+}
+
+#define DS_LOCK(file_ds, parts, write, ret) {\
 	sigfillset(&fullsigset);\
 	sigprocmask(SIG_SETMASK, &fullsigset, &(file_ds->ds_lock.sigset));\
 	clock_gettime(CLOCK_REALTIME, &tv_timeout);\
 	tv_timeout.tv_sec += NCDS_LOCK_TIMEOUT;\
-	if (sem_timedwait(file_ds->ds_lock.lock, &tv_timeout) == -1 && errno == ETIMEDOUT) {\
-		ret = 1;\
+	if ((ret = file_ds_lock(file_ds, parts, write)) != 0) {\
 		sigprocmask(SIG_SETMASK, &(file_ds->ds_lock.sigset), NULL);\
-	} else {\
-		ret = 0;\
-		file_ds->ds_lock.holding_lock = 1;\
 	}\
 }
+/* lock for modification of the datastore */
+#define LOCK(file_ds, parts, ret) DS_LOCK(file_ds, parts, 1, ret)
+/* lock for reading the datastore, shared with other readers */
+#define RDLOCK(file_ds, parts, ret) DS_LOCK(file_ds, parts, 0, ret)
 #define UNLOCK(file_ds) {\
-	sem_post(file_ds->ds_lock.lock);\
-	file_ds->ds_lock.holding_lock = 0;\
+	file_ds_unlock(file_ds);\
 	sigprocmask(SIG_SETMASK, &(file_ds->ds_lock.sigset), NULL);\
 }
 
+/**
+ * @brief Get the NETCONF lock of the datastore part in the shared memory. The
+ * lock of the part (LOCK or RDLOCK macro) must be held while accessing it.
+ * @param[in] file_ds File datastore structure.
+ * @param[in] target Datastore type.
+ * @return NETCONF lock of the part, NULL for an invalid target.
+ */
+static struct ds_nclock* file_nclock(struct ncds_ds_file* file_ds, NC_DATASTORE target)
+{
+	int part;
+
+	switch (target) {
+	case NC_DATASTORE_RUNNING:
+		part = NCDS_FILE_RUNNING;
+		break;
+	case NC_DATASTORE_STARTUP:
+		part = NCDS_FILE_STARTUP;
+		break;
+	case NC_DATASTORE_CANDIDATE:
+		part = NCDS_FILE_CANDIDATE;
+		break;
+	default:
+		return (NULL);
+	}
+
+	return (&(file_ds->ds_lock.lock[file_ds->split ? part : 0]->nclock[part]));
+}
+
 /**
  * @brief Determine if the datastore is accessible (is not NETCONF locked) for the
  * specified session. This function MUST be called between LOCK and UNLOCK
@@ -108,42 +244,25 @@ static sigset_t fullsigset;
  */
 static int file_ds_access(struct ncds_ds_file* file_ds, NC_DATASTORE target, const struct nc_session* session)
 {
-	xmlChar * lock;
-	xmlNodePtr target_ds;
-	int retval;
+	struct ds_nclock *nclock;
 
 	if (file_ds == NULL) {
 		ERROR("%s: invalid datastore structure.", __func__);
 		return (EXIT_FAILURE);
 	}
 
-	switch(target) {
-	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
-		break;
-	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
-		break;
-	default:
+	if ((nclock = file_nclock(file_ds, target)) == NULL) {
 		ERROR("%s: invalid target.", __func__);
 		return (EXIT_FAILURE);
-		break;
 	}
 
-	lock = xmlGetProp (target_ds, BAD_CAST "lock");
-	if (xmlStrEqual (lock, BAD_CAST "")) {
-		retval = EXIT_SUCCESS;
-	} else if (session != NULL && xmlStrEqual (lock, BAD_CAST session->session_id)) {
-		retval = EXIT_SUCCESS;
+	if (nclock->sid[0] == '\0') {
+		return (EXIT_SUCCESS);
+	} else if (session != NULL && strncmp(nclock->sid, session->session_id, SID_SIZE) == 0) {
+		return (EXIT_SUCCESS);
 	} else {
-		retval = EXIT_FAILURE;
+		return (EXIT_FAILURE);
 	}
-
-	xmlFree (lock);
-	return retval;
 }
 
 API int ncds_file_set_path(struct ncds_ds* datastore, const char* path)
@@ -308,28 +427,386 @@ invalid_ds:
 	return (EXIT_FAILURE);
 }
 
-int ncds_file_changed(struct ncds_ds* ds)
+/**
+ * @brief Get the version identification of the file from its stat information.
+ * @param[in] statbuf Stat information of the file.
+ * @param[out] stamp Version of the file.
+ */
+static void file_stamp_get(const struct stat* statbuf, struct file_stamp* stamp)
 {
-	time_t t;
-	struct stat statbuf;
+	/* zero the padding too, stamps are compared by memcmp() */
+	memset(stamp, 0, sizeof(struct file_stamp));
+	stamp->dev = statbuf->st_dev;
+	stamp->ino = statbuf->st_ino;
+	stamp->size = statbuf->st_size;
+	stamp->mtime = statbuf->st_mtim;
+	stamp->ctime = statbuf->st_ctim;
+}
 
-	/* get current time */
-	if ((t = time(NULL)) == ((time_t)(-1))) {
-		ERROR("time() failed (%s)", strerror(errno));
-		/* we do not know, so answer that file was changed */
-		return (1);
-	}
+/**
+ * @brief Invalidate the parsed content of the datastore file, so it is read
+ * from the file on the next access.
+ * @param[out] stamp Version of the file to reset.
+ */
+static void file_stamp_reset(struct file_stamp* stamp)
+{
+	memset(stamp, 0, sizeof(struct file_stamp));
+}
 
-	/* check when the file was modified */
-	if (stat(((struct ncds_ds_file*)ds)->path, &statbuf) == 0) {
-		if (statbuf.st_mtime < ds->last_access) {
+/**
+ * @brief Check if the file was changed since the recorded version and record
+ * the current version.
+ * @param[in] path Path to the file.
+ * @param[in,out] stamp Recorded version of the file.
+ * @return 0 if the file was not changed, 1 otherwise.
+ */
+static int file_stamp_update(const char* path, struct file_stamp* stamp)
+{
+	struct stat statbuf;
+	struct file_stamp current;
+
+	if (stat(path, &statbuf) == 0) {
+		file_stamp_get(&statbuf, &current);
+		if (memcmp(&current, stamp, sizeof(struct file_stamp)) == 0) {
 			/* file was not modified */
 			return (0);
 		}
+		memcpy(stamp, &current, sizeof(struct file_stamp));
 	}
+
+	/* we do not know, so answer that file was changed */
 	return (1);
 }
 
+/**
+ * @brief Get the node of the datastore part in the datastore document.
+ * @param[in] file_ds File datastore structure.
+ * @param[in] part Index of the datastore part.
+ * @return Pointer to the node pointer in the datastore structure.
+ */
+static xmlNodePtr* file_part_node(struct ncds_ds_file* file_ds, int part)
+{
+	switch (part) {
+	case NCDS_FILE_RUNNING:
+		return (&(file_ds->running));
+	case NCDS_FILE_STARTUP:
+		return (&(file_ds->startup));
+	default:
+		return (&(file_ds->candidate));
+	}
+}
+
+/**
+ * @brief Replace the node of the datastore part with a copy of the given node.
+ * @param[in] file_ds File datastore structure.
+ * @param[in] part Index of the datastore part.
+ * @param[in] node Node with the new content of the datastore part.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int file_part_replace(struct ncds_ds_file* file_ds, int part, xmlNodePtr node)
+{
+	xmlNodePtr *old, new;
+
+	old = file_part_node(file_ds, part);
+	if ((new = xmlDocCopyNode(node, file_ds->xml, 1)) == NULL) {
+		ERROR("%s: copying the %s datastore failed.", __func__, file_part_names[part]);
+		return (EXIT_FAILURE);
+	}
+	/* the part files do not declare the namespace of the datastores frame */
+	new->ns = (*old)->ns;
+	xmlReplaceNode(*old, new);
+	xmlFreeNode(*old);
+	*old = new;
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Make the content of the datastore part the top-level content of the
+ * datastore document, so edit_config() can change it in place instead of its
+ * copy. Only the top-level nodes are relinked, file_part_conceal() puts them
+ * back. Nothing else is supposed to access the document meanwhile.
+ * @param[in] file_ds File datastore structure.
+ * @param[in] part Index of the datastore part.
+ * @param[out] frame Top-level nodes of the document (the first and the last).
+ */
+static void file_part_expose(struct ncds_ds_file* file_ds, int part, xmlNodePtr frame[2])
+{
+	xmlNodePtr node, child;
+
+	node = *file_part_node(file_ds, part);
+	frame[0] = file_ds->xml->children;
+	frame[1] = file_ds->xml->last;
+	file_ds->xml->children = node->children;
+	file_ds->xml->last = node->last;
+	node->children = node->last = NULL;
+	for (child = file_ds->xml->children; child != NULL; child = child->next) {
+		child->parent = (xmlNodePtr)file_ds->xml;
+	}
+}
+
+static void file_part_conceal(struct ncds_ds_file* file_ds, int part, xmlNodePtr frame[2])
+{
+	xmlNodePtr node, child;
+
+	node = *file_part_node(file_ds, part);
+	node->children = file_ds->xml->children;
+	node->last = file_ds->xml->last;
+	file_ds->xml->children = frame[0];
+	file_ds->xml->last = frame[1];
+	for (child = node->children; child != NULL; child = child->next) {
+		child->parent = node;
+	}
+}
+
+/**
+ * @brief Write the datastore content into the file.
+ * @param[in] file File to write into.
+ * @param[in] doc Datastore document.
+ * @param[in] node Datastore part to write instead of the whole document, NULL
+ * to write the whole document.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int file_write_content(FILE* file, xmlDocPtr doc, xmlNodePtr node)
+{
+	xmlOutputBufferPtr out;
+
+	/* no formatting, it only increases the amount of data to write and parse */
+	if (node == NULL) {
+		return ((xmlDocFormatDump(file, doc, 0) == -1) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	if ((out = xmlOutputBufferCreateFile(file, NULL)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	xmlOutputBufferWriteString(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	xmlNodeDumpOutput(out, doc, node, 0, 0, NULL);
+	xmlOutputBufferWriteString(out, "\n");
+
+	return ((xmlOutputBufferClose(out) < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+int ncds_file_changed(struct ncds_ds* ds)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	int i, ret = 0;
+
+	if (!file_ds->split) {
+		return (file_stamp_update(file_ds->path, &(file_ds->changed_stamp)));
+	}
+
+	/* check all the files to record their current versions */
+	for (i = 0; i < NCDS_FILE_PARTS; i++) {
+		ret |= file_stamp_update(file_ds->parts[i].path, &(file_ds->parts[i].changed_stamp));
+	}
+	return (ret);
+}
+
+API int ncds_file_set_split(struct ncds_ds* datastore, int split)
+{
+	struct ncds_ds_file * file_ds = (struct ncds_ds_file*)datastore;
+
+	if (datastore == NULL || datastore->type != NCDS_TYPE_FILE) {
+		ERROR ("Invalid datastore.");
+		return (EXIT_FAILURE);
+	}
+
+	if (datastore->id != -1) {
+		ERROR ("%s: the datastore is already initiated.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	file_ds->split = split ? 1 : 0;
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Open (and eventually create) the shared memory lock of the file. The
+ * shared memory object left by a different version of the library (with a
+ * different layout of the structure) is removed and created again.
+ * @param[in] path Path to the file.
+ * @return Lock structure mapped into the process memory, NULL on error.
+ */
+static struct ds_rwlock_shm* file_rwlock_open(const char* path)
+{
+	char *shmpath;
+	struct ds_rwlock_shm *shm = NULL;
+	struct stat st;
+	pthread_rwlockattr_t rwlockattr;
+	mode_t mask;
+	int fd, first, i, r, stale = 0;
+
+	/* first - prepare the path, there must be a separate lock for each
+	 * datastore(set), so name it according to the filepath with a special prefix.
+	 * Slashes in the path are replaced with underscores.
+	 * Sequences of slashes are treated as a single slash character.
+	 */
+	if (asprintf(&shmpath, "%s/%s", NCDS_LOCK, path) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	nc_clip_occurences_with(shmpath, '/', '_');
+	/* recreate initial backslash in the shared memory object name */
+	shmpath[0] = '/';
+
+	while (shm == NULL) {
+		if (stale) {
+			if (stale > 1) {
+				ERROR("Datastore lock %s is used by an incompatible version of the library.", shmpath);
+				free(shmpath);
+				return (NULL);
+			}
+			WARN("Recreating the datastore lock %s left by another version of the library.", shmpath);
+			shm_unlink(shmpath);
+		}
+
+		/* and then create the shared memory object, or open the existing one */
+		first = 1;
+		mask = umask(0000);
+		if ((fd = shm_open(shmpath, O_RDWR | O_CREAT | O_EXCL, FILE_PERM)) == -1 && errno == EEXIST) {
+			first = 0;
+			fd = shm_open(shmpath, O_RDWR, FILE_PERM);
+		}
+		umask(mask);
+		if (fd == -1) {
+			ERROR("Unable to open the datastore lock %s (%s).", shmpath, strerror(errno));
+			free(shmpath);
+			return (NULL);
+		}
+
+		if (first) {
+			if (ftruncate(fd, sizeof(struct ds_rwlock_shm)) == -1) {
+				ERROR("Unable to prepare the datastore lock %s (%s).", shmpath, strerror(errno));
+				close(fd);
+				shm_unlink(shmpath);
+				free(shmpath);
+				return (NULL);
+			}
+		} else {
+			/* wait for the creator to set the size */
+			for (i = 0; (r = fstat(fd, &st)) == 0 && st.st_size == 0; i++) {
+				if (i == NCDS_LOCK_TIMEOUT * 1000) {
+					break;
+				}
+				usleep(1000);
+			}
+			if (r == -1 || st.st_size == 0) {
+				ERROR("Datastore lock %s is not initialized.", shmpath);
+				close(fd);
+				free(shmpath);
+				return (NULL);
+			} else if (st.st_size != (off_t) sizeof(struct ds_rwlock_shm)) {
+				close(fd);
+				stale++;
+				continue;
+			}
+		}
+
+		shm = mmap(NULL, sizeof(struct ds_rwlock_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (shm == MAP_FAILED) {
+			ERROR("Accessing the datastore lock %s failed (%s).", shmpath, strerror(errno));
+			free(shmpath);
+			return (NULL);
+		}
+
+		if (first) {
+			pthread_rwlockattr_init(&rwlockattr);
+			pthread_rwlockattr_setpshared(&rwlockattr, PTHREAD_PROCESS_SHARED);
+			/* do not let a stream of readers starve the writers */
+			pthread_rwlockattr_setkind_np(&rwlockattr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+			pthread_rwlock_init(&(shm->lock), &rwlockattr);
+			pthread_rwlockattr_destroy(&rwlockattr);
+			shm->version = NCDS_LOCK_VERSION;
+			__sync_synchronize();
+			shm->ready = 1;
+		} else {
+			for (i = 0; !shm->ready; i++) {
+				if (i == NCDS_LOCK_TIMEOUT * 1000) {
+					ERROR("Datastore lock %s is not initialized.", shmpath);
+					munmap(shm, sizeof(struct ds_rwlock_shm));
+					free(shmpath);
+					return (NULL);
+				}
+				usleep(1000);
+			}
+			if (shm->version != NCDS_LOCK_VERSION) {
+				munmap(shm, sizeof(struct ds_rwlock_shm));
+				shm = NULL;
+				stale++;
+			}
+		}
+	}
+	free(shmpath);
+
+	return (shm);
+}
+
+/**
+ * @brief Prepare the separate file of the datastore part. If the file does not
+ * exist, it is created from the content of the main datastore file, otherwise
+ * its content replaces the part in the datastore document.
+ * @param[in] file_ds File datastore structure.
+ * @param[in] part Index of the datastore part.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int file_part_init(struct ncds_ds_file* file_ds, int part)
+{
+	struct file_part *fpart = &(file_ds->parts[part]);
+	struct stat st;
+	xmlDocPtr doc;
+	xmlNodePtr root;
+	mode_t mask;
+
+	if (asprintf(&(fpart->path), "%s.%s", file_ds->path, file_part_names[part]) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		fpart->path = NULL;
+		return (EXIT_FAILURE);
+	}
+
+	if (stat(fpart->path, &st) == 0 && st.st_size > 0) {
+		doc = xmlReadFile(fpart->path, NULL, NC_XMLREAD_OPTIONS);
+		root = xmlDocGetRootElement(doc);
+		if (root == NULL || !xmlStrEqual(root->name, BAD_CAST file_part_names[part])) {
+			ERROR("Invalid content of the datastore file %s.", fpart->path);
+			xmlFreeDoc(doc);
+			return (EXIT_FAILURE);
+		}
+		if (file_part_replace(file_ds, part, root) != EXIT_SUCCESS) {
+			xmlFreeDoc(doc);
+			return (EXIT_FAILURE);
+		}
+		xmlFreeDoc(doc);
+		/* drop the lock attributes stored by the older versions */
+		xmlUnsetProp(*file_part_node(file_ds, part), BAD_CAST "lock");
+		xmlUnsetProp(*file_part_node(file_ds, part), BAD_CAST "locktime");
+
+		if ((fpart->file = fopen(fpart->path, "r+")) == NULL) {
+			ERROR("Datastore file %s cannot be opened (%s).", fpart->path, strerror(errno));
+			return (EXIT_FAILURE);
+		}
+	} else {
+		mask = umask(MASK_PERM);
+		fpart->file = fopen(fpart->path, "w+");
+		umask(mask);
+		if (fpart->file == NULL) {
+			ERROR("Datastore file %s cannot be created (%s).", fpart->path, strerror(errno));
+			return (EXIT_FAILURE);
+		}
+		if (file_write_content(fpart->file, file_ds->xml, *file_part_node(file_ds, part)) != EXIT_SUCCESS || fflush(fpart->file) != 0) {
+			ERROR("Storing the %s datastore into the file %s failed.", file_part_names[part], fpart->path);
+			return (EXIT_FAILURE);
+		}
+		VERB("Datastore file %s was created.", fpart->path);
+	}
+
+	if ((file_ds->ds_lock.lock[part] = file_rwlock_open(fpart->path)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
 /**
  * @ingroup store
  * @brief Initialization of the file datastore
@@ -341,11 +818,11 @@ int ncds_file_changed(struct ncds_ds* ds)
 int ncds_file_init(struct ncds_ds* ds)
 {
 	struct stat st;
-	char* new_path = NULL, *sempath, *dir_name, *file_name, *dup_path;
+	char* new_path = NULL, *dir_name, *file_name, *dup_path;
 	struct dirent * file_info;
 	DIR * dir;
-	int fd;
-	mode_t mask;
+	int fd, i, ret;
+	struct ds_nclock *nclock;
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
 
 	file_ds->xml = xmlReadFile(file_ds->path, NULL, NC_XMLREAD_OPTIONS);
@@ -476,40 +953,56 @@ int ncds_file_init(struct ncds_ds* ds)
 
 	/* init value */
 	file_ds->xml_rollback = NULL;
+	file_ds->rollback_parts = 0;
 
 	/* get pointers to running, startup and candidate nodes in xml */
 	if (file_fill_dsnodes(file_ds) != EXIT_SUCCESS) {
 		return (EXIT_FAILURE);
 	}
 
-	/* unlock forgotten locks if any */
-	xmlSetProp (file_ds->running, BAD_CAST "lock", BAD_CAST "");
-	xmlSetProp (file_ds->startup, BAD_CAST "lock", BAD_CAST "");
-	xmlSetProp (file_ds->candidate, BAD_CAST "lock", BAD_CAST "");
+	/* the NETCONF locks are kept in the shared memory, drop the lock
+	 * attributes stored by the older versions */
+	for (i = 0; i < NCDS_FILE_PARTS; i++) {
+		xmlUnsetProp(*file_part_node(file_ds, i), BAD_CAST "lock");
+		xmlUnsetProp(*file_part_node(file_ds, i), BAD_CAST "locktime");
+	}
 
-	/*
-	 * open and eventually create a lock
-	 */
-	/* first - prepare the path, there must be a separate lock for each
-	 * datastore(set), so name it according to the filepath with a special prefix.
-	 * Slashes in the path are replaced with underscores.
-	 * Sequences of slashes are treated as a single slash character.
-	 */
-	if (asprintf(&sempath, "%s/%s", NCDS_LOCK, file_ds->path) == -1) {
-		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+	if ((errno = pthread_mutex_init(&(file_ds->ds_lock.thread_lock), NULL)) != 0) {
+		ERROR("Initialization of a mutex failed (%s).", strerror(errno));
 		return (EXIT_FAILURE);
 	}
-	nc_clip_occurences_with(sempath, '/', '_');
-	/* recreate initial backslash in the semaphore name */
-	sempath[0] = '/';
-	/* and then create the lock (actually it is a semaphore) */
-	mask = umask(0000);
-	if ((file_ds->ds_lock.lock = sem_open (sempath, O_CREAT, FILE_PERM, 1)) == SEM_FAILED) {
-		umask(mask);
+
+	if (file_ds->split) {
+		/* each part has its own file and lock */
+		for (i = 0; i < NCDS_FILE_PARTS; i++) {
+			if (file_part_init(file_ds, i) != EXIT_SUCCESS) {
+				return (EXIT_FAILURE);
+			}
+		}
+	} else {
+		/*
+		 * open and eventually create a lock
+		 */
+		if ((file_ds->ds_lock.lock[0] = file_rwlock_open(file_ds->path)) == NULL) {
+			return (EXIT_FAILURE);
+		}
+	}
+
+	/* unlock forgotten locks if any, the shared memory survives the crash
+	 * or restart of the server holding them */
+	LOCK(file_ds, NCDS_FILE_ALL, ret);
+	if (ret) {
+		ERROR("%s: locking the datastore failed.", __func__);
 		return (EXIT_FAILURE);
 	}
-	umask(mask);
-	free (sempath);
+	for (i = 0; i < NCDS_FILE_PARTS; i++) {
+		nclock = &(file_ds->ds_lock.lock[file_ds->split ? i : 0]->nclock[i]);
+		if (nclock->sid[0] != '\0') {
+			VERB("Dropping the forgotten lock of the %s datastore (session %.*s).", file_part_names[i], SID_SIZE, nclock->sid);
+		}
+		memset(nclock, 0, sizeof(struct ds_nclock));
+	}
+	UNLOCK(file_ds);
 
 	return (EXIT_SUCCESS);
 }
@@ -517,6 +1010,7 @@ int ncds_file_init(struct ncds_ds* ds)
 void ncds_file_free(struct ncds_ds* ds)
 {
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	int i;
 
 	if (file_ds != NULL) {
 		/* ncds_ds_file specific part */
@@ -524,17 +1018,151 @@ void ncds_file_free(struct ncds_ds* ds)
 			fclose(file_ds->file);
 		}
 		free(file_ds->path);
+		/* the undo record can keep the nodes of the document */
+		edit_undo_free(file_ds->rollback_edit);
 		xmlFreeDoc(file_ds->xml);
 		xmlFreeDoc(file_ds->xml_rollback);
-		if (file_ds->ds_lock.lock != NULL) {
-			if (file_ds->ds_lock.holding_lock) {
-				sem_post (file_ds->ds_lock.lock);
+		file_ds_unlock(file_ds);
+		for (i = 0; i < NCDS_FILE_PARTS; i++) {
+			if (file_ds->parts[i].file != NULL) {
+				fclose(file_ds->parts[i].file);
+			}
+			free(file_ds->parts[i].path);
+			if (file_ds->ds_lock.lock[i] != NULL) {
+				munmap(file_ds->ds_lock.lock[i], sizeof(struct ds_rwlock_shm));
 			}
-			sem_close(file_ds->ds_lock.lock);
 		}
+		pthread_mutex_destroy(&(file_ds->ds_lock.thread_lock));
 	}
 }
 
+/**
+ * @brief Revert the edit-config applied directly to the datastore part, the
+ * datastore is expected to be locked.
+ * @param[in] file_ds File datastore structure.
+ * @param[in] part Index of the datastore part.
+ * @param[in] undo Undo record of the edit, it is freed.
+ * @return EXIT_SUCCESS or EXIT_FAILURE if the part was left unchanged.
+ */
+static int file_edit_revert(struct ncds_ds_file* file_ds, int part, struct edit_undo* undo)
+{
+	xmlNodePtr frame[2];
+	int ret;
+
+	file_part_expose(file_ds, part, frame);
+	ret = edit_undo_revert(undo);
+	file_part_conceal(file_ds, part, frame);
+
+	if (ret != EXIT_SUCCESS) {
+		ERROR("Reverting the edit of the %s datastore failed, it was not recorded completely.", file_part_names[part]);
+		/* the content does not match the file anymore, read it again */
+		file_stamp_reset(file_ds->split ? &(file_ds->parts[part].xml_stamp) : &(file_ds->xml_stamp));
+	}
+	return (ret);
+}
+
+/**
+ * @brief The content of the datastore part is going to be replaced by its
+ * reload, so revert the last edit-config applied to it and move the original
+ * content into its holder in the undo record, as file_rollback_store() does.
+ * @param[in] file_ds File datastore structure.
+ * @param[in] part Index of the datastore part being reloaded.
+ */
+static void file_rollback_settle(struct ncds_ds_file* file_ds, int part)
+{
+	struct edit_undo* undo;
+	xmlNodePtr node, holder, content;
+
+	if ((undo = file_ds->rollback_edit) == NULL || file_ds->rollback_edit_part != part) {
+		return;
+	}
+	file_ds->rollback_edit = NULL;
+	holder = file_ds->rollback_nodes[part];
+
+	if (file_edit_revert(file_ds, part, undo) != EXIT_SUCCESS) {
+		/* the original content is not available */
+		xmlUnlinkNode(holder);
+		xmlFreeNode(holder);
+		file_ds->rollback_nodes[part] = NULL;
+		file_ds->rollback_parts &= ~(1 << part);
+		return;
+	}
+
+	node = *file_part_node(file_ds, part);
+	content = node->children;
+	node->children = node->last = NULL;
+	if (content != NULL) {
+		xmlAddChildList(holder, content);
+	}
+}
+
+/**
+ * @brief Reloads the datastore parts from their separate files. This function
+ * MUST be called ONLY between file_ds_lock() and file_ds_unlock().
+ *
+ * @param file_ds Pointer to the datastorage structure
+ * @param parts Mask of the datastore parts to reload.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_reload_parts(struct ncds_ds_file* file_ds, int parts, time_t t)
+{
+	struct file_part *fpart;
+	struct stat statbuf;
+	struct file_stamp stamp;
+	xmlDocPtr doc;
+	xmlNodePtr root;
+	int i;
+
+	for (i = 0; i < NCDS_FILE_PARTS; i++) {
+		if (!(parts & (1 << i))) {
+			continue;
+		}
+		fpart = &(file_ds->parts[i]);
+
+		/* check if the file was modified since it was parsed */
+		if (stat(fpart->path, &statbuf) == 0) {
+			file_stamp_get(&statbuf, &stamp);
+			if (memcmp(&stamp, &(fpart->xml_stamp), sizeof(struct file_stamp)) == 0) {
+				/* file was not modified */
+				continue;
+			}
+		} else {
+			file_stamp_reset(&stamp);
+		}
+
+		/* file was modified, it may be necessary to reopen it */
+		fclose(fpart->file);
+		fpart->file = fopen(fpart->path, "r+");
+		if (fpart->file == NULL) {
+			ERROR("%s: reopenening the file %s failed (%s)", __func__, fpart->path, strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		doc = xmlReadFile(fpart->path, NULL, NC_XMLREAD_OPTIONS);
+		root = xmlDocGetRootElement(doc);
+		if (root == NULL || !xmlStrEqual(root->name, BAD_CAST file_part_names[i])) {
+			ERROR("%s: invalid content of the datastore file %s.", __func__, fpart->path);
+			xmlFreeDoc(doc);
+			return EXIT_FAILURE;
+		}
+		file_rollback_settle(file_ds, i);
+		if (file_part_replace(file_ds, i, root) != EXIT_SUCCESS) {
+			xmlFreeDoc(doc);
+			return EXIT_FAILURE;
+		}
+		xmlFreeDoc(doc);
+
+		/* update access time and remember the version of the parsed content */
+		file_ds->ds.last_access = t;
+		memcpy(&(fpart->xml_stamp), &stamp, sizeof(struct file_stamp));
+		nc_metrics_add(NC_METRIC_FILE_RELOADS, 1);
+		nc_metrics_add(NC_METRIC_FILE_RELOAD_BYTES, stamp.size);
+	}
+
+	return EXIT_SUCCESS;
+}
+
 /**
  * @brief Reloads xml configuration from the datastorage file. This function MUST be
  * called ONLY between file_ds_lock() and file_ds_unlock().
@@ -544,16 +1172,20 @@ void ncds_file_free(struct ncds_ds* ds)
  * If it fails, the structure is preserved as it was.
  *
  * @param file_ds Pointer to the datastorage structure
+ * @param parts Mask of the datastore parts to reload, all the parts are
+ * reloaded unless they are stored separately.
  *
  * @return EXIT_SUCCESS or EXIT_FAILURE
  */
-static int file_reload(struct ncds_ds_file* file_ds)
+static int file_reload(struct ncds_ds_file* file_ds, int parts)
 {
 	struct ncds_ds_file new;
 	struct stat statbuf;
+	struct file_stamp stamp;
 	time_t t;
 
-	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
+	if (file_ds == NULL || !file_ds->ds_lock.holding_lock ||
+			(file_ds->split && (file_ds->ds_lock.holding_lock & parts) != parts)) {
 		ERROR("%s: invalid parameter.", __func__);
 		return EXIT_FAILURE;
 	}
@@ -564,12 +1196,19 @@ static int file_reload(struct ncds_ds_file* file_ds)
 		WARN("Setting datastore access time failed (%s)", strerror(errno));
 	}
 
-	/* check when the file was modified */
+	if (file_ds->split) {
+		return (file_reload_parts(file_ds, parts, t));
+	}
+
+	/* check if the file was modified since it was parsed */
 	if (stat(file_ds->path, &statbuf) == 0) {
-		if (statbuf.st_mtime < file_ds->ds.last_access) {
+		file_stamp_get(&statbuf, &stamp);
+		if (memcmp(&stamp, &(file_ds->xml_stamp), sizeof(struct file_stamp)) == 0) {
 			/* file was not modified */
 			return (EXIT_SUCCESS);
 		}
+	} else {
+		file_stamp_reset(&stamp);
 	}
 
 	/* file was modified, it may be necessary to reopen it */
@@ -591,14 +1230,167 @@ static int file_reload(struct ncds_ds_file* file_ds)
 		return EXIT_FAILURE;
 	}
 
-	/* update access time */
+	/* update access time and remember the version of the parsed content */
 	new.ds.last_access = t;
+	memcpy(&(new.xml_stamp), &stamp, sizeof(struct file_stamp));
 
+	if (file_ds->rollback_edit != NULL) {
+		/* the undo record was copied into new before */
+		file_rollback_settle(file_ds, file_ds->rollback_edit_part);
+		new.rollback_edit = file_ds->rollback_edit;
+		new.rollback_parts = file_ds->rollback_parts;
+		memcpy(new.rollback_nodes, file_ds->rollback_nodes, sizeof(new.rollback_nodes));
+	}
 	xmlFreeDoc (file_ds->xml);
 	memcpy (file_ds, &new, sizeof (struct ncds_ds_file));
+	nc_metrics_add(NC_METRIC_FILE_RELOADS, 1);
+	nc_metrics_add(NC_METRIC_FILE_RELOAD_BYTES, stamp.size);
+
+	return EXIT_SUCCESS;
+
+}
+
+/**
+ * @brief Write the configuration into a new file and atomically replace the
+ * datastore file with it, so the datastore file always contains a complete
+ * datastore even if the process crashes while writing.
+ *
+ * @param path Path to the datastore file.
+ * @param file Opened datastore file, replaced by the new file.
+ * @param doc Datastore document.
+ * @param node Datastore part to write, NULL for the whole document.
+ * @param stamp Version of the written file content.
+ *
+ * @return EXIT_SUCCESS, EXIT_FAILURE or 1 if the temporary file cannot be
+ * created (e.g. the directory is not writable) and nothing was changed.
+ */
+static int file_write_replace(const char* path, FILE** file, xmlDocPtr doc, xmlNodePtr node, struct file_stamp* stamp)
+{
+	struct stat statbuf;
+	char *dup_path, *dup_name, *tmp_path;
+	FILE* new_file;
+	int fd;
+
+	/* renaming would replace the symbolic link instead of the file itself */
+	if (lstat(path, &statbuf) == 0 && S_ISLNK(statbuf.st_mode)) {
+		return (1);
+	}
+
+	/* dot prefix hides the file from the search for backup datastores */
+	dup_path = strdup(path);
+	dup_name = strdup(path);
+	if (asprintf(&tmp_path, "%s/.%s.XXXXXX", dirname(dup_path), basename(dup_name)) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		free(dup_path);
+		free(dup_name);
+		return (EXIT_FAILURE);
+	}
+	free(dup_path);
+	free(dup_name);
+
+	if ((fd = mkstemp(tmp_path)) == -1) {
+		VERB("%s: unable to create temporary file %s (%s).", __func__, tmp_path, strerror(errno));
+		free(tmp_path);
+		return (1);
+	}
+
+	/* keep the access rights of the original file */
+	if (fstat(fileno(*file), &statbuf) == 0) {
+		if (fchmod(fd, statbuf.st_mode & 07777) == -1 || (fchown(fd, statbuf.st_uid, statbuf.st_gid) == -1 && errno != EPERM)) {
+			WARN("%s: unable to set access rights of the file %s (%s).", __func__, tmp_path, strerror(errno));
+		}
+	}
+
+	if ((new_file = fdopen(fd, "r+")) == NULL) {
+		ERROR("%s: fdopen() failed (%s).", __func__, strerror(errno));
+		close(fd);
+		goto error;
+	}
+
+	if (file_write_content(new_file, doc, node) != EXIT_SUCCESS || fflush(new_file) != 0 || fsync(fd) == -1) {
+		ERROR("%s: storing repository into the file %s failed.", __func__, tmp_path);
+		fclose(new_file);
+		goto error;
+	}
+
+	if (rename(tmp_path, path) == -1) {
+		ERROR("%s: replacing the file %s failed (%s).", __func__, path, strerror(errno));
+		fclose(new_file);
+		goto error;
+	}
+	free(tmp_path);
+
+	fclose(*file);
+	*file = new_file;
+
+	/* the parsed content now matches the file, no need to reread it */
+	if (fstat(fd, &statbuf) == 0) {
+		file_stamp_get(&statbuf, stamp);
+	} else {
+		file_stamp_reset(stamp);
+	}
+
+	return (EXIT_SUCCESS);
+
+error:
+	unlink(tmp_path);
+	free(tmp_path);
+	file_stamp_reset(stamp);
+	return (EXIT_FAILURE);
+}
+
+/**
+ * @brief Write the configuration directly into the opened datastore file.
+ *
+ * @param path Path to the datastore file.
+ * @param file Opened datastore file.
+ * @param doc Datastore document.
+ * @param node Datastore part to write, NULL for the whole document.
+ * @param stamp Version of the written file content.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_write_inplace(const char* path, FILE* file, xmlDocPtr doc, xmlNodePtr node, struct file_stamp* stamp)
+{
+	struct stat statbuf;
+
+	/* erase actual config */
+	if (ftruncate (fileno(file), 0) == -1) {
+		ERROR ("%s: truncate() of file %s failed (%s)", __func__, path, strerror(errno));
+		file_stamp_reset(stamp);
+		return EXIT_FAILURE;
+	}
+	rewind (file);
+
+	if (file_write_content(file, doc, node) != EXIT_SUCCESS || fflush(file) != 0) {
+		ERROR("%s: storing repository into the file %s failed.", __func__, path);
+		file_stamp_reset(stamp);
+		return (EXIT_FAILURE);
+	}
+
+	/* the parsed content now matches the file, no need to reread it */
+	if (fstat(fileno(file), &statbuf) == 0) {
+		file_stamp_get(&statbuf, stamp);
+	} else {
+		file_stamp_reset(stamp);
+	}
 
 	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Write the datastore (part) into its file.
+ */
+static int file_write(const char* path, FILE** file, xmlDocPtr doc, xmlNodePtr node, struct file_stamp* stamp)
+{
+	int ret;
+
+	if ((ret = file_write_replace(path, file, doc, node, stamp)) == 1) {
+		/* it is not possible to create a new file, so rewrite the current one */
+		ret = file_write_inplace(path, *file, doc, node, stamp);
+	}
 
+	return (ret);
 }
 
 /**
@@ -606,27 +1398,44 @@ static int file_reload(struct ncds_ds_file* file_ds)
  * called ONLY between file_ds_lock() and file_ds_unlock().
  *
  * @param file_ds Datastore to sync.
+ * @param parts Mask of the modified datastore parts, the whole datastore is
+ * written unless the parts are stored separately.
  *
  * @return EXIT_SUCCESS or EXIT_FAILURE
  */
-static int file_sync(struct ncds_ds_file* file_ds)
+static int file_sync(struct ncds_ds_file* file_ds, int parts)
 {
 	time_t t;
+	int i, ret = EXIT_SUCCESS;
+	uint64_t trace_start;
 
-	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
+	if (file_ds == NULL || !file_ds->ds_lock.holding_lock ||
+			(file_ds->split && (file_ds->ds_lock.holding_lock & parts) != parts)) {
 		ERROR("%s: invalid parameter.", __func__);
 		return EXIT_FAILURE;
 	}
 
-	/* erase actual config */
-	if (ftruncate (fileno(file_ds->file), 0) == -1) {
-		ERROR ("%s: truncate() of file %s failed (%s)", __func__, file_ds->path, strerror(errno));
-		return EXIT_FAILURE;
+	trace_start = nc_trace_begin();
+	if (!file_ds->split) {
+		ret = file_write(file_ds->path, &(file_ds->file), file_ds->xml, NULL, &(file_ds->xml_stamp));
+		if (ret == EXIT_SUCCESS) {
+			nc_metrics_add(NC_METRIC_FILE_SYNCS, 1);
+			nc_metrics_add(NC_METRIC_FILE_SYNC_BYTES, file_ds->xml_stamp.size);
+		}
+	} else {
+		for (i = 0; ret == EXIT_SUCCESS && i < NCDS_FILE_PARTS; i++) {
+			if (parts & (1 << i)) {
+				ret = file_write(file_ds->parts[i].path, &(file_ds->parts[i].file),
+						file_ds->xml, *file_part_node(file_ds, i), &(file_ds->parts[i].xml_stamp));
+				if (ret == EXIT_SUCCESS) {
+					nc_metrics_add(NC_METRIC_FILE_SYNCS, 1);
+					nc_metrics_add(NC_METRIC_FILE_SYNC_BYTES, file_ds->parts[i].xml_stamp.size);
+				}
+			}
+		}
 	}
-	rewind (file_ds->file);
-
-	if(xmlDocFormatDump(file_ds->file, file_ds->xml, 1) == -1) {
-		ERROR("%s: storing repository into the file %s failed.", __func__, file_ds->path);
+	nc_trace_end(NC_TRACE_SYNC, trace_start);
+	if (ret != EXIT_SUCCESS) {
 		return (EXIT_FAILURE);
 	}
 
@@ -640,21 +1449,134 @@ static int file_sync(struct ncds_ds_file* file_ds)
 	return EXIT_SUCCESS;
 }
 
-static int file_rollback_store(struct ncds_ds_file* file_ds)
+/**
+ * @brief Start a new undo record for the operation being performed, the
+ * previous one is dropped.
+ * @param[in] file_ds File datastore structure.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int file_rollback_reset(struct ncds_ds_file* file_ds)
 {
+	int i;
+
 	if (file_ds == NULL) {
 		ERROR("%s: invalid parameter.", __func__);
 		return (EXIT_FAILURE);
 	}
 
+	edit_undo_free(file_ds->rollback_edit);
+	file_ds->rollback_edit = NULL;
 	xmlFreeDoc(file_ds->xml_rollback);
-	file_ds->xml_rollback = xmlCopyDoc(file_ds->xml, 1);
+	file_ds->rollback_parts = 0;
+	for (i = 0; i < NCDS_FILE_PARTS; i++) {
+		file_ds->rollback_nodes[i] = NULL;
+	}
+
+	if ((file_ds->xml_rollback = xmlNewDoc(BAD_CAST "1.0")) == NULL) {
+		ERROR("%s: creating the rollback document failed.", __func__);
+		return (EXIT_FAILURE);
+	}
+	/* share the dictionary so the original nodes can be moved without copying */
+	if (file_ds->xml->dict != NULL) {
+		file_ds->xml_rollback->dict = file_ds->xml->dict;
+		xmlDictReference(file_ds->xml_rollback->dict);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Create the holder of the datastore part in the undo record, it keeps
+ * the attributes (e.g. modified) of the part.
+ * @param[in] file_ds File datastore structure.
+ * @param[in] part Index of the datastore part.
+ * @return The holder, NULL on error.
+ */
+static xmlNodePtr file_rollback_hold(struct ncds_ds_file* file_ds, int part)
+{
+	xmlNodePtr holder;
+
+	if ((holder = xmlDocCopyNode(*file_part_node(file_ds, part), file_ds->xml_rollback, 2)) == NULL) {
+		ERROR("%s: storing the %s datastore for rollback failed.", __func__, file_part_names[part]);
+		return (NULL);
+	}
+	xmlAddChild((xmlNodePtr)file_ds->xml_rollback, holder);
+
+	file_ds->rollback_nodes[part] = holder;
+	file_ds->rollback_parts |= (1 << part);
+
+	return (holder);
+}
+
+/**
+ * @brief Move the current content of the datastore part into the undo record.
+ * The part is left empty and the caller is supposed to fill it with the new
+ * content, so the operation does not need to copy the whole datastore.
+ * @param[in] file_ds File datastore structure.
+ * @param[in] target Datastore type to be changed.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int file_rollback_store(struct ncds_ds_file* file_ds, NC_DATASTORE target)
+{
+	xmlNodePtr node, holder, content;
+	int part;
+
+	part = file_part_index(target);
+	if (file_ds == NULL || file_ds->xml_rollback == NULL || part == -1) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	node = *file_part_node(file_ds, part);
+	if (file_ds->rollback_nodes[part] != NULL) {
+		/* already stored by this operation, keep the original content */
+		while ((content = node->children) != NULL) {
+			xmlUnlinkNode(content);
+			xmlFreeNode(content);
+		}
+		return (EXIT_SUCCESS);
+	}
+
+	if ((holder = file_rollback_hold(file_ds, part)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	content = node->children;
+	node->children = node->last = NULL;
+	if (content != NULL) {
+		xmlAddChildList(holder, content);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Keep the undo record of the edit-config applied directly to the
+ * datastore part, instead of moving the original content into the holder.
+ * @param[in] file_ds File datastore structure.
+ * @param[in] part Index of the datastore part.
+ * @param[in] undo Undo record of the edit from edit_undo_stop().
+ * @return EXIT_SUCCESS or EXIT_FAILURE, the record is left to the caller then.
+ */
+static int file_rollback_edit(struct ncds_ds_file* file_ds, int part, struct edit_undo* undo)
+{
+	if (file_ds->xml_rollback == NULL || file_rollback_hold(file_ds, part) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	file_ds->rollback_edit = undo;
+	file_ds->rollback_edit_part = part;
 
 	return (EXIT_SUCCESS);
 }
 
 static int file_rollback_restore(struct ncds_ds_file* file_ds)
 {
+	xmlNodePtr node, holder, content;
+	xmlChar* modified;
+	int i, ret = EXIT_SUCCESS;
+	struct edit_undo* undo;
+
 	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
 		ERROR("%s: invalid parameter.", __func__);
 		return (EXIT_FAILURE);
@@ -665,12 +1587,61 @@ static int file_rollback_restore(struct ncds_ds_file* file_ds)
 		return (EXIT_FAILURE);
 	}
 
-	xmlFreeDoc(file_ds->xml);
-	file_ds->xml = file_ds->xml_rollback;
+	/* restore only the parts changed by the last operation, the others can
+	 * be already changed by another process */
+	for (i = 0; i < NCDS_FILE_PARTS; i++) {
+		if ((holder = file_ds->rollback_nodes[i]) == NULL) {
+			continue;
+		}
+		node = *file_part_node(file_ds, i);
+
+		if ((undo = file_ds->rollback_edit) != NULL && file_ds->rollback_edit_part == i) {
+			/* the edit-config was applied directly to the datastore */
+			file_ds->rollback_edit = NULL;
+			if (file_edit_revert(file_ds, i, undo) != EXIT_SUCCESS) {
+				ret = EXIT_FAILURE;
+				continue;
+			}
+		} else {
+			while ((content = node->children) != NULL) {
+				xmlUnlinkNode(content);
+				xmlFreeNode(content);
+			}
+			if (file_ds->xml->dict == file_ds->xml_rollback->dict) {
+				content = holder->children;
+				holder->children = holder->last = NULL;
+			} else {
+				/* the datastore was reloaded meanwhile, the nodes must be copied */
+				content = xmlDocCopyNodeList(file_ds->xml, holder->children);
+			}
+			if (content != NULL) {
+				xmlAddChildList(node, content);
+			}
+		}
+
+		if ((modified = xmlGetProp(holder, BAD_CAST "modified")) != NULL) {
+			xmlSetProp(node, BAD_CAST "modified", modified);
+			xmlFree(modified);
+		} else {
+			xmlUnsetProp(node, BAD_CAST "modified");
+		}
+	}
+	xmlFreeDoc(file_ds->xml_rollback);
 	file_ds->xml_rollback = NULL;
-	file_ds->ds.last_access = 0;
+	for (i = 0; i < NCDS_FILE_PARTS; i++) {
+		file_ds->rollback_nodes[i] = NULL;
+	}
+
+	if (file_ds->rollback_parts == 0) {
+		/* the last operation did not change anything */
+		return (ret);
+	}
+	if (file_sync(file_ds, file_ds->rollback_parts) != EXIT_SUCCESS) {
+		ret = EXIT_FAILURE;
+	}
+	file_ds->rollback_parts = 0;
 
-	return (file_sync(file_ds));
+	return (ret);
 }
 
 int ncds_file_rollback(struct ncds_ds* ds)
@@ -683,7 +1654,7 @@ int ncds_file_rollback(struct ncds_ds* ds)
 		return (EXIT_FAILURE);
 	}
 
-	LOCK(file_ds, ret);
+	LOCK(file_ds, file_ds->rollback_parts, ret);
 	if (ret) {
 		return (EXIT_FAILURE);
 	}
@@ -700,49 +1671,39 @@ const struct ncds_lockinfo *ncds_file_lockinfo(struct ncds_ds* ds, NC_DATASTORE
 {
 	int ret;
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-	xmlNodePtr target_ds;
+	struct ds_nclock *nclock;
 	struct ncds_lockinfo *info;
 
-	LOCK(file_ds, ret);
-	if (ret) {
-		return (NULL);
-	}
-
-	if (file_reload (file_ds)) {
-		UNLOCK(file_ds);
-		return (NULL);
-	}
-
 	/* check validity of function parameters */
 	switch(target) {
 	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
 		info = &lockinfo_running;
 		break;
 	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
 		info = &lockinfo_startup;
 		break;
 	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
 		info = &lockinfo_candidate;
 		break;
 	default:
-		UNLOCK(file_ds);
 		return (NULL);
 		break;
 	}
+
+	RDLOCK(file_ds, file_part_mask(target), ret);
+	if (ret) {
+		return (NULL);
+	}
+
+	nclock = file_nclock(file_ds, target);
 	free((*info).sid);
 	free((*info).time);
-	(*info).sid = (char*) xmlGetProp (target_ds, BAD_CAST "lock");
-	(*info).time = (char*) xmlGetProp (target_ds, BAD_CAST "locktime");
-	if ((*info).sid == NULL) {
-		WARN("%s: missing the \"lock\" attribute in the %s datastore.", __func__, file_ds->ds.data_model->name);
-	} else if (strisempty((*info).sid)) {
-		free((*info).sid);
-		free((*info).time);
+	if (nclock->sid[0] == '\0') {
 		(*info).sid = NULL;
 		(*info).time = NULL;
+	} else {
+		(*info).sid = strndup(nclock->sid, SID_SIZE);
+		(*info).time = nc_time2datetime(nclock->time, NULL);
 	}
 
 	UNLOCK(file_ds);
@@ -753,126 +1714,90 @@ const struct ncds_lockinfo *ncds_file_lockinfo(struct ncds_ds* ds, NC_DATASTORE
 int ncds_file_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
 {
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-	xmlChar* lock, *modified = NULL;
-	xmlNodePtr target_ds;
-	struct nc_session* no_session;
+	xmlChar *modified = NULL;
+	struct ds_nclock *nclock;
 	int retval = EXIT_SUCCESS, ret;
-	char* t;
 
 	assert(error);
 
-	LOCK(file_ds, ret);
+	/* check validity of function parameters */
+	if ((nclock = file_nclock(file_ds, target)) == NULL) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+
+	LOCK(file_ds, file_part_mask(target), ret);
 	if (ret) {
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
 		return EXIT_FAILURE;
 	}
 
-	if (file_reload (file_ds)) {
+	/* only the candidate needs its content, to check it is not modified */
+	if (target == NC_DATASTORE_CANDIDATE && file_reload (file_ds, file_part_mask(target))) {
 		UNLOCK(file_ds);
 		return EXIT_FAILURE;
 	}
 
-	/* check validity of function parameters */
-	switch(target) {
-	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
-		break;
-	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
-		break;
-	default:
-		UNLOCK(file_ds);
-		ERROR("%s: invalid target.", __func__);
-		*error = nc_err_new(NC_ERR_BAD_ELEM);
-		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
-		return (EXIT_FAILURE);
-		break;
-	}
-
 	/* check if repository is locked by anyone including me */
-	no_session = nc_session_dummy(INTERNAL_DUMMY_ID, session->username, session->hostname, session->capabilities);
-	if (file_ds_access (file_ds, target, no_session) != 0) {
+	if (nclock->sid[0] != '\0') {
 		/* someone is already holding the lock */
-		lock = xmlGetProp (target_ds, BAD_CAST "lock");
 		*error = nc_err_new(NC_ERR_LOCK_DENIED);
-		nc_err_set(*error, NC_ERR_PARAM_INFO_SID, (char*)lock);
-		xmlFree(lock);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_SID, nclock->sid);
+		nc_metrics_add(NC_METRIC_LOCKS_DENIED, 1);
+		retval = EXIT_FAILURE;
+	} else if (target == NC_DATASTORE_CANDIDATE &&
+			(modified = xmlGetProp(file_ds->candidate, BAD_CAST "modified")) != NULL &&
+			xmlStrcmp(modified, BAD_CAST "true") == 0) {
+		*error = nc_err_new(NC_ERR_LOCK_DENIED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Candidate datastore not locked but already modified.");
+		nc_metrics_add(NC_METRIC_LOCKS_DENIED, 1);
 		retval = EXIT_FAILURE;
 	} else {
-		if (target == NC_DATASTORE_CANDIDATE &&
-				(modified = xmlGetProp(target_ds, BAD_CAST "modified")) != NULL &&
-				xmlStrcmp(modified, BAD_CAST "true") == 0) {
-			*error = nc_err_new(NC_ERR_LOCK_DENIED);
-			nc_err_set(*error, NC_ERR_PARAM_MSG, "Candidate datastore not locked but already modified.");
-			retval = EXIT_FAILURE;
-		} else {
-			xmlSetProp (target_ds, BAD_CAST "lock", BAD_CAST session->session_id);
-			xmlSetProp (target_ds, BAD_CAST "locktime", BAD_CAST (t = nc_time2datetime(time(NULL), NULL)));
-			free(t);
-			if (file_sync(file_ds)) {
-				*error = nc_err_new(NC_ERR_OP_FAILED);
-				nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
-				retval = EXIT_FAILURE;
-			}
-		}
-		xmlFree(modified);
+		memcpy(nclock->sid, session->session_id, SID_SIZE);
+		nclock->time = time(NULL);
+		nc_metrics_add(NC_METRIC_LOCKS_GRANTED, 1);
 	}
+	xmlFree(modified);
 	UNLOCK(file_ds);
 
-	/* cleanup */
-	nc_session_free(no_session);
-
 	return (retval);
 }
 
 int ncds_file_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
 {
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-	xmlNodePtr target_ds, del;
-	struct nc_session* no_session;
-	int retval = EXIT_SUCCESS, ret;
+	xmlNodePtr del;
+	struct ds_nclock *nclock;
+	int retval = EXIT_SUCCESS, ret, parts;
 
 	assert(error);
 
-	LOCK(file_ds, ret);
-	if (ret) {
-		*error = nc_err_new(NC_ERR_OP_FAILED);
-		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
-		return EXIT_FAILURE;
-	}
-
-	if (file_reload (file_ds)) {
-		UNLOCK(file_ds);
-		return EXIT_FAILURE;
-	}
-
 	/* check validity of function parameters */
-	switch(target) {
-	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
-		break;
-	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
-		break;
-	default:
-		UNLOCK(file_ds);
+	if ((nclock = file_nclock(file_ds, target)) == NULL) {
 		ERROR("%s: invalid target.", __func__);
 		*error = nc_err_new(NC_ERR_BAD_ELEM);
 		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
 		return (EXIT_FAILURE);
-		break;
+	}
+
+	/* unlocking candidate discards its changes by copying running into it */
+	parts = file_part_mask(target);
+	if (target == NC_DATASTORE_CANDIDATE) {
+		parts |= file_part_mask(NC_DATASTORE_RUNNING);
+	}
+
+	LOCK(file_ds, parts, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return EXIT_FAILURE;
 	}
 
 	/* check if repository is locked */
-	no_session = nc_session_dummy(INTERNAL_DUMMY_ID, session->username, session->hostname, session->capabilities);
-	if (file_ds_access (file_ds, target, no_session) == 0) {
+	if (nclock->sid[0] == '\0') {
 		/* not locked */
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*error, NC_ERR_PARAM_MSG, "Target datastore is not locked.");
@@ -886,6 +1811,11 @@ int ncds_file_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DA
 		/* the datastore is locked by request originating session */
 
 		if (target == NC_DATASTORE_CANDIDATE) {
+			if (file_reload (file_ds, parts)) {
+				UNLOCK(file_ds);
+				return EXIT_FAILURE;
+			}
+
 			/* drop current candidate configuration */
 			while ((del = file_ds->candidate->children) != NULL) {
 				xmlUnlinkNode (file_ds->candidate->children);
@@ -896,26 +1826,26 @@ int ncds_file_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DA
 			xmlAddChildList(file_ds->candidate, xmlCopyNodeList(file_ds->running->children));
 
 			/* mark candidate as not modified */
-			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "false");
+			xmlSetProp (file_ds->candidate, BAD_CAST "modified", BAD_CAST "false");
+
+			if (file_sync(file_ds, file_part_mask(target))) {
+				*error = nc_err_new(NC_ERR_OP_FAILED);
+				nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+				retval = EXIT_FAILURE;
+			}
 		}
 
 		/* unlock datastore */
-		xmlSetProp (target_ds, BAD_CAST "lock", BAD_CAST "");
-		xmlSetProp (target_ds, BAD_CAST "locktime", BAD_CAST "");
-		if (file_sync(file_ds)) {
-			*error = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
-			retval = EXIT_FAILURE;
+		if (retval == EXIT_SUCCESS) {
+			if (nc_metrics_now() != 0 && time(NULL) >= nclock->time) {
+				nc_metrics_observe(NC_METRIC_HIST_NETCONF_LOCK_HOLD, 0, (uint64_t) (time(NULL) - nclock->time) * 1000000000);
+			}
+			memset(nclock, 0, sizeof *nclock);
 		}
 	}
 
 	UNLOCK(file_ds);
 
-	/* cleanup */
-	if (no_session != NULL) {
-		nc_session_free(no_session);
-	}
-
 	return (retval);
 }
 
@@ -929,14 +1859,14 @@ char* ncds_file_getconfig(struct ncds_ds* ds, const struct nc_session* UNUSED(se
 
 	assert(error);
 
-	LOCK(file_ds, ret);
+	RDLOCK(file_ds, file_part_mask(source), ret);
 	if (ret) {
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
 		return NULL;
 	}
 
-	if (file_reload (file_ds)) {
+	if (file_reload (file_ds, file_part_mask(source))) {
 		UNLOCK(file_ds);
 		return NULL;
 	}
@@ -978,6 +1908,64 @@ char* ncds_file_getconfig(struct ncds_ds* ds, const struct nc_session* UNUSED(se
 	return (data);
 }
 
+xmlDocPtr ncds_file_getconfig_xml(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, const struct nc_filter* UNUSED(filter), struct nc_err** error)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	xmlNodePtr target_ds, aux_node;
+	xmlDocPtr data;
+	int ret;
+
+	assert(error);
+
+	RDLOCK(file_ds, file_part_mask(source), ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return NULL;
+	}
+
+	if (file_reload (file_ds, file_part_mask(source))) {
+		UNLOCK(file_ds);
+		return NULL;
+	}
+
+	/* check validity of function parameters */
+	switch(source) {
+	case NC_DATASTORE_RUNNING:
+		target_ds = file_ds->running;
+		break;
+	case NC_DATASTORE_STARTUP:
+		target_ds = file_ds->startup;
+		break;
+	case NC_DATASTORE_CANDIDATE:
+		target_ds = file_ds->candidate;
+		break;
+	default:
+		UNLOCK(file_ds);
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return (NULL);
+		break;
+	}
+
+	if ((data = xmlNewDoc(BAD_CAST "1.0")) == NULL) {
+		UNLOCK(file_ds);
+		ERROR("%s: xmlNewDoc failed (%s:%d).", __func__, __FILE__, __LINE__);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		return (NULL);
+	}
+	/* only the elements, as if the data were serialized and read again */
+	for (aux_node = target_ds->children; aux_node != NULL; aux_node = aux_node->next) {
+		if (aux_node->type == XML_ELEMENT_NODE) {
+			xmlAddChild((xmlNodePtr)data, xmlDocCopyNode(aux_node, data, 1));
+		}
+	}
+
+	UNLOCK(file_ds);
+	return (data);
+}
+
 /**
  * @brief Copy the content of the datastore or externally send
  * the configuration to another datastore
@@ -1002,22 +1990,27 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 	xmlNodePtr target_ds, source_ds, aux_node, root;
 	keyList keys;
 	char *aux = NULL, *configp;
-	int r, ret = 0;
+	int r, ret = 0, parts;
 
 	assert(error);
 
-	LOCK(file_ds, ret);
+	parts = file_part_mask(target);
+	if (source == NC_DATASTORE_RUNNING || source == NC_DATASTORE_STARTUP || source == NC_DATASTORE_CANDIDATE) {
+		parts |= file_part_mask(source);
+	}
+
+	LOCK(file_ds, parts, ret);
 	if (ret) {
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
 		return EXIT_FAILURE;
 	}
 
-	if (file_reload (file_ds)) {
+	if (file_reload (file_ds, parts)) {
 		UNLOCK(file_ds);
 		return EXIT_FAILURE;
 	}
-	file_rollback_store(file_ds);
+	file_rollback_reset(file_ds);
 
 	switch(target) {
 	case NC_DATASTORE_RUNNING:
@@ -1116,6 +2109,8 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 	 */
 	if (source_ds == NULL && target_ds->children == NULL) {
 		ret = EXIT_RPC_NOT_APPLICABLE;
+		/* there is no content, but remember the attributes */
+		file_rollback_store(file_ds, target);
 		goto finish;
 	}
 
@@ -1180,14 +2175,20 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 		}
 	}
 
-	/* drop current target configuration */
-	while ((aux_node = target_ds->children) != NULL) {
-		xmlUnlinkNode (target_ds->children);
-		xmlFreeNode (aux_node);
+	/* move current target configuration into the undo record */
+	if (file_rollback_store(file_ds, target) != EXIT_SUCCESS) {
+		UNLOCK(file_ds);
+		xmlFreeDoc(aux_doc);
+		xmlFreeDoc(config_doc);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		return (EXIT_FAILURE);
 	}
 
-	/* copy new target configuration */
-	xmlAddChildList(target_ds, xmlCopyNodeList(aux_doc->children));
+	/* move new target configuration, aux_doc is only a temporary holder */
+	if ((aux_node = aux_doc->children) != NULL) {
+		aux_doc->children = aux_doc->last = NULL;
+		xmlAddChildList(target_ds, aux_node);
+	}
 	xmlFreeDoc(aux_doc);
 
 finish:
@@ -1204,7 +2205,7 @@ finish:
 		}
 	}
 
-	if (file_sync (file_ds)) {
+	if (file_sync (file_ds, file_part_mask(target))) {
 		UNLOCK(file_ds);
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
@@ -1229,23 +2230,23 @@ finish:
 int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * session, NC_DATASTORE target, struct nc_err **error)
 {
 	struct ncds_ds_file * file_ds = (struct ncds_ds_file*)ds;
-	xmlNodePtr target_ds, del;
+	xmlNodePtr target_ds;
 	int ret;
 
 	assert(error);
 
-	LOCK(file_ds, ret);
+	LOCK(file_ds, file_part_mask(target), ret);
 	if (ret) {
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
 		return EXIT_FAILURE;
 	}
 
-	if (file_reload(file_ds)) {
+	if (file_reload(file_ds, file_part_mask(target))) {
 		UNLOCK(file_ds);
 		return EXIT_FAILURE;
 	}
-	file_rollback_store(file_ds);
+	file_rollback_reset(file_ds);
 
 	switch(target) {
 	case NC_DATASTORE_RUNNING:
@@ -1275,9 +2276,11 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 		return EXIT_FAILURE;
 	}
 
-	while ((del = target_ds->children) != NULL) {
-		xmlUnlinkNode (target_ds->children);
-		xmlFreeNode (del);
+	/* the deleted content is kept in the undo record */
+	if (file_rollback_store(file_ds, target) != EXIT_SUCCESS) {
+		UNLOCK(file_ds);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		return EXIT_FAILURE;
 	}
 
 	/*
@@ -1289,7 +2292,7 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 		xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "true");
 	}
 
-	if (file_sync (file_ds)) {
+	if (file_sync (file_ds, file_part_mask(target))) {
 		UNLOCK(file_ds);
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
@@ -1316,16 +2319,17 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error)
 {
 	struct ncds_ds_file * file_ds = (struct ncds_ds_file *)ds;
-	xmlDocPtr config_doc, datastore_doc;
-	xmlNodePtr target_ds, aux_node, root;
-	int retval = EXIT_SUCCESS, ret;
+	xmlDocPtr config_doc;
+	xmlNodePtr target_ds, aux_node, root, frame[2];
+	struct edit_undo* undo;
+	int retval = EXIT_SUCCESS, ret, part;
 	char* aux = NULL;
 	const char* configp;
 
 	assert(error);
 
 	/* lock the datastore */
-	LOCK(file_ds, ret);
+	LOCK(file_ds, file_part_mask(target), ret);
 	if (ret) {
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
@@ -1333,11 +2337,11 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 	}
 
 	/* reload the datastore content */
-	if (file_reload (file_ds)) {
+	if (file_reload (file_ds, file_part_mask(target))) {
 		UNLOCK(file_ds);
 		return EXIT_FAILURE;
 	}
-	file_rollback_store(file_ds);
+	file_rollback_reset(file_ds);
 
 	switch(target) {
 	case NC_DATASTORE_RUNNING:
@@ -1404,27 +2408,30 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 	xmlUnlinkNode(root);
 	xmlFreeNode(root);
 
-	/* create an XML doc with a copy of the datastore configuration */
-	datastore_doc = xmlNewDoc (BAD_CAST "1.0");
-	xmlDocSetRootElement(datastore_doc, xmlCopyNode(target_ds->children, 1));
-	if (target_ds->children) {
-		for (root = target_ds->children->next; root != NULL; root = aux_node) {
-			aux_node = root->next;
-			xmlAddNextSibling(datastore_doc->last, xmlCopyNode(root, 1));
-		}
+	/* the edit is applied directly to the datastore part, not to its copy,
+	 * the undo record of the edit is used to revert it */
+	part = file_part_index(target);
+	if (edit_undo_start(file_ds->xml) != EXIT_SUCCESS) {
+		UNLOCK(file_ds);
+		xmlFreeDoc(config_doc);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		return EXIT_FAILURE;
 	}
 
 	/* preform edit config */
-	if (edit_config(datastore_doc, config_doc, (struct ncds_ds*)file_ds, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error)) {
+	file_part_expose(file_ds, part, frame);
+	ret = edit_config(file_ds->xml, config_doc, (struct ncds_ds*)file_ds, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error);
+	file_part_conceal(file_ds, part, frame);
+	undo = edit_undo_stop();
+
+	if (ret) {
+		file_edit_revert(file_ds, part, undo);
+		retval = EXIT_FAILURE;
+	} else if (file_rollback_edit(file_ds, part, undo) != EXIT_SUCCESS) {
+		file_edit_revert(file_ds, part, undo);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
 		retval = EXIT_FAILURE;
 	} else {
-		/* replace datastore by edited configuration */
-		while ((aux_node = target_ds->children) != NULL) {
-			xmlUnlinkNode(aux_node);
-			xmlFreeNode(aux_node);
-		}
-		xmlAddChildList(target_ds, xmlCopyNodeList(datastore_doc->children));
-
 		/*
 		 * if we are changing candidate, mark it as modified, since we need
 		 * this information for locking - according to RFC, candidate cannot
@@ -1435,7 +2442,7 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 		}
 
 		/* sync xml tree with file on the hdd */
-		if (file_sync(file_ds)) {
+		if (file_sync(file_ds, file_part_mask(target))) {
 			*error = nc_err_new(NC_ERR_OP_FAILED);
 			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
 			retval = EXIT_FAILURE;
@@ -1443,7 +2450,6 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 	}
 	UNLOCK(file_ds);
 
-	xmlFreeDoc(datastore_doc);
 	xmlFreeDoc(config_doc);
 
 	return retval;
@@ -42,16 +42,109 @@
 
 #include "../../netconf_internal.h"
 #include "../datastore_internal.h"
-#include <semaphore.h>
+#include <pthread.h>
 
-/* Unique name prefix of every semaphore created */
+/* Unique name prefix of every shared memory lock created */
 #define NCDS_LOCK "/NCDS_FLOCK"
 
-/* Number of seconds waiting for a semaphore increment before
+/* Number of seconds waiting for a lock before
  * giving up and cancelling the locking
  */
 #define NCDS_LOCK_TIMEOUT 5
 
+/* Version of the ds_rwlock_shm layout, change it with every modification of
+ * the structure so a shared memory object left by another version is
+ * recreated instead of used */
+#define NCDS_LOCK_VERSION 2
+
+/* Indexes of the datastore parts, it is also the order of locking them */
+#define NCDS_FILE_RUNNING 0
+#define NCDS_FILE_STARTUP 1
+#define NCDS_FILE_CANDIDATE 2
+#define NCDS_FILE_PARTS 3
+
+/* Mask of all the datastore parts */
+#define NCDS_FILE_ALL ((1 << NCDS_FILE_PARTS) - 1)
+
+/**
+ * @brief NETCONF lock of a datastore part, kept in the shared memory instead
+ * of the datastore document so taking, releasing and checking it does not
+ * need to read or write the file.
+ */
+struct ds_nclock {
+	/**
+	 * ID of the session holding the lock, empty string if not locked
+	 */
+	char sid[SID_SIZE];
+	/**
+	 * Time when the lock was taken
+	 */
+	time_t time;
+};
+
+/**
+ * @brief Content of the shared memory object with the lock of a datastore
+ * (part) file, shared by all the processes working with the file.
+ */
+struct ds_rwlock_shm {
+	/**
+	 * process-shared reader/writer lock
+	 */
+	pthread_rwlock_t lock;
+	/**
+	 * NETCONF locks of the datastore parts protected by the lock, only the
+	 * item of the part is used when the parts are stored separately
+	 */
+	struct ds_nclock nclock[NCDS_FILE_PARTS];
+	/**
+	 * version of the structure layout (NCDS_LOCK_VERSION)
+	 */
+	int version;
+	/**
+	 * flag set when the lock is initialized
+	 */
+	volatile int ready;
+};
+
+/**
+ * @brief Identification of a version of the datastore file content.
+ *
+ * The file is rewritten under the datastore lock, so any change done by any
+ * process changes the modification time (with nanosecond precision), the size
+ * or the inode of the file.
+ */
+struct file_stamp {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+};
+
+/**
+ * @brief Separate file of a datastore part (running, startup or candidate).
+ */
+struct file_part {
+	/**
+	 * @brief Path to the file containing the datastore part.
+	 */
+	char* path;
+	/**
+	 * @brief Opened file containing the datastore part.
+	 */
+	FILE* file;
+	/**
+	 * @brief Version of the file content currently parsed in the datastore
+	 * document, all zeros if the file is supposed to be reread.
+	 */
+	struct file_stamp xml_stamp;
+	/**
+	 * @brief Version of the file content seen by the last ncds_file_changed()
+	 * call.
+	 */
+	struct file_stamp changed_stamp;
+};
+
 /**
  * @brief File datastore implementation-specific ncds_ds structure.
  */
@@ -74,29 +167,74 @@ struct ncds_ds_file {
 	 */
 	xmlDocPtr xml;
 	/**
-	 * backup libxml2's document structure of the datastore for rollback
+	 * version of the file content currently parsed in xml, all zeros if the
+	 * file is supposed to be (re)read on the next access
+	 */
+	struct file_stamp xml_stamp;
+	/**
+	 * version of the file content seen by the last ncds_file_changed() call
+	 */
+	struct file_stamp changed_stamp;
+	/**
+	 * undo record of the last operation for rollback - the original content
+	 * of the changed datastore parts moved out of xml, NULL if there is no
+	 * operation to roll back
 	 */
 	xmlDocPtr xml_rollback;
+	/**
+	 * holders of the original content of the datastore parts in xml_rollback,
+	 * only of their attributes in case of rollback_edit
+	 */
+	xmlNodePtr rollback_nodes[NCDS_FILE_PARTS];
+	/**
+	 * mask of the datastore parts changed by the last operation, they are
+	 * restored from xml_rollback by ncds_file_rollback()
+	 */
+	int rollback_parts;
+	/**
+	 * undo record of the last edit-config, which is applied directly to the
+	 * datastore part rollback_edit_part, NULL if there is no such record
+	 */
+	struct edit_undo* rollback_edit;
+	int rollback_edit_part;
 	/**
 	 * libxml2 Node pointers providing access to individual datastores
 	 */
 	xmlNodePtr candidate, running, startup;
+	/**
+	 * flag if the datastore parts are stored in separate files
+	 */
+	int split;
+	/**
+	 * separate files of the datastore parts, used only if split is set
+	 */
+	struct file_part parts[NCDS_FILE_PARTS];
 	/**
 	 * locking structure
 	 */
 	struct ds_lock_s {
 		/**
-		 * semaphore pointer
+		 * shared reader/writer locks, there is a single lock (the first one)
+		 * for all the datastore parts unless they are stored separately
 		 */
-		sem_t * lock;
+		struct ds_rwlock_shm * lock[NCDS_FILE_PARTS];
+		/**
+		 * lock serializing access of the threads to the datastore structure,
+		 * since the in-memory document is updated even by the readers
+		 */
+		pthread_mutex_t thread_lock;
 		/**
 		 * signal set before locked
 	 	 */
 		sigset_t sigset;
 		/**
-		 * Am I holding the lock
+		 * Mask of the locks I am holding
 		 */
 		int holding_lock;
+		/**
+		 * Time (nc_metrics_now()) when the locks were acquired
+		 */
+		uint64_t locked_at;
 	} ds_lock;
 };
 
@@ -135,6 +273,20 @@ int ncds_file_rollback(struct ncds_ds* ds);
 */
 char* ncds_file_getconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error);
 
+/**
+ * @brief Perform get-config on the specified repository, the data are returned
+ * as a XML document with no need to serialize and parse them again.
+ *
+ * @param[in] ds File datastore structure from which the data will be obtained.
+ * @param[in] session Session originating the request.
+ * @param[in] source Datastore (running, startup, candidate) to get the data from.
+ * @param[in] filter Filter of the request, not used by the file datastore.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return NULL on error, copy of the data on success (empty document if there
+ * are no data).
+*/
+xmlDocPtr ncds_file_getconfig_xml(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, const struct nc_filter* filter, struct nc_err** error);
+
 /**
  * @brief Get lock information about the specified NETCONF datastore
  * @param[in] ds File datastore structure that will be checked.
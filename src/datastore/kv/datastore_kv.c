@@ -0,0 +1,1529 @@
+/**
+ * \file datastore_kv.c
+ * \brief NETCONF datastore handling functions for the key-value datastore
+ * implementation.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <libgen.h>
+#include <time.h>
+
+#include <libxml/tree.h>
+
+#include "../../netconf_internal.h"
+#include "../../error.h"
+#include "../../session.h"
+#include "../../nacm.h"
+#include "../../config.h"
+#include "../datastore_internal.h"
+#include "datastore_kv.h"
+#include "../edit_config.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+/* offsets in the file are aligned to this value */
+#define KV_ALIGN(x) (((x) + 7) & ~((uint64_t)7))
+
+/**
+ * @brief Content of a datastore part, either mapped from a snapshot or built
+ * in memory for a new version of the file.
+ */
+struct kv_part {
+	const struct kv_record* index;
+	uint32_t count;
+	const uint32_t* tops;
+	uint32_t tops_count;
+	const char* data;
+	uint64_t data_len;
+	const char* lock;
+	const char* locktime;
+	int modified;
+};
+
+/**
+ * @brief Records of a datastore part being built from a XML tree.
+ */
+struct kv_build {
+	struct kv_record* index;
+	uint64_t count;
+	uint64_t index_size;
+	uint32_t* tops;
+	uint64_t tops_count;
+	uint64_t tops_size;
+	char* data;
+	uint64_t data_len;
+	uint64_t data_size;
+	/* key of the currently processed record */
+	uint32_t* key;
+	uint64_t key_size;
+};
+
+/**
+ * @brief Get index of the datastore part.
+ * @param[in] target Datastore type.
+ * @return Index of the part, -1 for an invalid value.
+ */
+static int kv_part_index(NC_DATASTORE target)
+{
+	switch (target) {
+	case NC_DATASTORE_RUNNING:
+		return (NCDS_KV_RUNNING);
+	case NC_DATASTORE_STARTUP:
+		return (NCDS_KV_STARTUP);
+	case NC_DATASTORE_CANDIDATE:
+		return (NCDS_KV_CANDIDATE);
+	default:
+		return (-1);
+	}
+}
+
+/**
+ * @brief Check that the range lies inside the area of the given size.
+ */
+static int kv_range(uint64_t offset, uint64_t len, uint64_t size)
+{
+	return (offset <= size && len <= size - offset);
+}
+
+static int kv_string_valid(const char* map, size_t size, uint64_t offset)
+{
+	return (offset == 0 || (offset < size && memchr(map + offset, '\0', size - offset) != NULL));
+}
+
+static void kv_snapshot_free(struct kv_snapshot* snap)
+{
+	munmap((void*)snap->map, snap->size);
+	free(snap);
+}
+
+/**
+ * @brief Map the current version of the datastore file into memory.
+ * @return Snapshot with a single reference, NULL on error.
+ */
+static struct kv_snapshot* kv_snapshot_open(const char* path)
+{
+	struct kv_snapshot* snap;
+	const struct kv_header* header;
+	const struct kv_part_header* ph;
+	struct stat st;
+	void* map;
+	int fd, i;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+		ERROR("Unable to open the datastore file %s (%s).", path, strerror(errno));
+		return (NULL);
+	}
+	if (fstat(fd, &st) == -1) {
+		ERROR("Unable to get information about the datastore file %s (%s).", path, strerror(errno));
+		close(fd);
+		return (NULL);
+	}
+	if ((size_t)st.st_size < sizeof(struct kv_header)) {
+		ERROR("Invalid key-value datastore file %s.", path);
+		close(fd);
+		return (NULL);
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		ERROR("Unable to map the datastore file %s (%s).", path, strerror(errno));
+		return (NULL);
+	}
+
+	/* check the header so the parts can be accessed without further checks */
+	header = (const struct kv_header*)map;
+	if (memcmp(header->magic, NCDS_KV_MAGIC, 4) != 0 || header->version != NCDS_KV_VERSION) {
+		ERROR("Invalid key-value datastore file %s (unknown format).", path);
+		munmap(map, st.st_size);
+		return (NULL);
+	}
+	for (i = 0; i < NCDS_KV_PARTS; i++) {
+		ph = &header->parts[i];
+		if (!kv_range(ph->index, (uint64_t)ph->count * sizeof(struct kv_record), st.st_size) ||
+				!kv_range(ph->tops, (uint64_t)ph->tops_count * sizeof(uint32_t), st.st_size) ||
+				!kv_range(ph->data, ph->data_len, st.st_size) ||
+				(ph->index % 8) != 0 || (ph->tops % 4) != 0 ||
+				!kv_string_valid(map, st.st_size, ph->lock) || !kv_string_valid(map, st.st_size, ph->locktime)) {
+			ERROR("Invalid key-value datastore file %s (corrupted header).", path);
+			munmap(map, st.st_size);
+			return (NULL);
+		}
+	}
+
+	if ((snap = malloc(sizeof(struct kv_snapshot))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		munmap(map, st.st_size);
+		return (NULL);
+	}
+	snap->refs = 1;
+	snap->map = map;
+	snap->size = st.st_size;
+	snap->dev = st.st_dev;
+	snap->ino = st.st_ino;
+	snap->generation = header->generation;
+
+	return (snap);
+}
+
+/**
+ * @brief Get the latest version of the datastore file. The caller must
+ * release the snapshot by kv_snapshot_release().
+ */
+static struct kv_snapshot* kv_snapshot_get(struct ncds_ds_kv* kv_ds)
+{
+	struct kv_snapshot* snap;
+	struct stat st;
+
+	pthread_mutex_lock(&kv_ds->snap_lock);
+	if (stat(kv_ds->path, &st) == -1) {
+		pthread_mutex_unlock(&kv_ds->snap_lock);
+		ERROR("Unable to get information about the datastore file %s (%s).", kv_ds->path, strerror(errno));
+		return (NULL);
+	}
+	if (kv_ds->snapshot == NULL || kv_ds->snapshot->ino != st.st_ino || kv_ds->snapshot->dev != st.st_dev) {
+		/* the file was replaced by a new version */
+		if ((snap = kv_snapshot_open(kv_ds->path)) == NULL) {
+			pthread_mutex_unlock(&kv_ds->snap_lock);
+			return (NULL);
+		}
+		if (kv_ds->snapshot != NULL && --kv_ds->snapshot->refs == 0) {
+			kv_snapshot_free(kv_ds->snapshot);
+		}
+		kv_ds->snapshot = snap;
+	}
+	snap = kv_ds->snapshot;
+	snap->refs++;
+	pthread_mutex_unlock(&kv_ds->snap_lock);
+
+	return (snap);
+}
+
+static void kv_snapshot_release(struct ncds_ds_kv* kv_ds, struct kv_snapshot* snap)
+{
+	if (snap == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&kv_ds->snap_lock);
+	if (--snap->refs == 0) {
+		kv_snapshot_free(snap);
+	}
+	pthread_mutex_unlock(&kv_ds->snap_lock);
+}
+
+static void kv_part_get(const struct kv_snapshot* snap, int i, struct kv_part* part)
+{
+	const struct kv_part_header* ph = &((const struct kv_header*)snap->map)->parts[i];
+
+	part->index = (const struct kv_record*)(snap->map + ph->index);
+	part->count = ph->count;
+	part->tops = (const uint32_t*)(snap->map + ph->tops);
+	part->tops_count = ph->tops_count;
+	part->data = snap->map + ph->data;
+	part->data_len = ph->data_len;
+	part->lock = (ph->lock != 0) ? snap->map + ph->lock : NULL;
+	part->locktime = (ph->locktime != 0) ? snap->map + ph->locktime : NULL;
+	part->modified = ph->modified;
+}
+
+/**
+ * @brief Replace the content of the part, the lock information is kept.
+ */
+static void kv_part_content(struct kv_part* part, const struct kv_part* src)
+{
+	part->index = src->index;
+	part->count = src->count;
+	part->tops = src->tops;
+	part->tops_count = src->tops_count;
+	part->data = src->data;
+	part->data_len = src->data_len;
+}
+
+static void kv_part_clear(struct kv_part* part)
+{
+	part->index = NULL;
+	part->count = 0;
+	part->tops = NULL;
+	part->tops_count = 0;
+	part->data = NULL;
+	part->data_len = 0;
+}
+
+/**
+ * @brief Check that the session can change the datastore part.
+ */
+static int kv_access(const struct kv_part* part, const struct nc_session* session)
+{
+	if (part->lock == NULL || (session != NULL && strcmp(part->lock, session->session_id) == 0)) {
+		return (EXIT_SUCCESS);
+	}
+	return (EXIT_FAILURE);
+}
+
+/**
+ * @brief Get the exclusive right to create a new version of the datastore file.
+ */
+static int kv_write_lock(struct ncds_ds_kv* kv_ds, struct nc_err** error)
+{
+	struct flock fl;
+	int i;
+
+	pthread_mutex_lock(&kv_ds->write_lock);
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	for (i = 0; fcntl(kv_ds->lock_fd, F_SETLK, &fl) == -1; i++) {
+		if ((errno != EACCES && errno != EAGAIN && errno != EINTR) || i >= NCDS_KV_LOCK_TIMEOUT * 100) {
+			ERROR("Locking the datastore file %s failed (%s).", kv_ds->path, strerror(errno));
+			pthread_mutex_unlock(&kv_ds->write_lock);
+			if (error != NULL) {
+				*error = nc_err_new(NC_ERR_OP_FAILED);
+				nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+			}
+			return (EXIT_FAILURE);
+		}
+		usleep(10000);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static void kv_write_unlock(struct ncds_ds_kv* kv_ds)
+{
+	struct flock fl;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_UNLCK;
+	fl.l_whence = SEEK_SET;
+	fcntl(kv_ds->lock_fd, F_SETLK, &fl);
+
+	pthread_mutex_unlock(&kv_ds->write_lock);
+}
+
+static int kv_build_reserve(void** buf, uint64_t* size, uint64_t need, size_t item)
+{
+	uint64_t new_size;
+	void* aux;
+
+	if (need <= *size) {
+		return (EXIT_SUCCESS);
+	}
+
+	for (new_size = (*size) ? (*size) : 64; new_size < need; new_size *= 2);
+	if ((aux = realloc(*buf, new_size * item)) == NULL) {
+		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	*buf = aux;
+	*size = new_size;
+
+	return (EXIT_SUCCESS);
+}
+
+static int kv_build_data(struct kv_build* b, const void* data, size_t len, uint32_t* offset)
+{
+	if (b->data_len + len > UINT32_MAX) {
+		ERROR("%s: the datastore part is too big.", __func__);
+		return (EXIT_FAILURE);
+	}
+	if (kv_build_reserve((void**)&b->data, &b->data_size, b->data_len + len, 1)) {
+		return (EXIT_FAILURE);
+	}
+
+	memcpy(b->data + b->data_len, data, len);
+	*offset = (uint32_t)b->data_len;
+	b->data_len += len;
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Store the element and its descendants as records. The key of the
+ * element is already prepared in the first depth items of the b->key.
+ */
+static int kv_build_node(struct kv_build* b, xmlNodePtr node, uint32_t depth)
+{
+	xmlNodePtr child;
+	xmlChar* text = NULL;
+	struct kv_record rec;
+	const char* href;
+	uint32_t pos = 0, aux;
+	int ret = EXIT_FAILURE;
+
+	for (child = node->children; child != NULL; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE) {
+			break;
+		}
+	}
+	if (child == NULL) {
+		/* leaf, store its text content */
+		text = xmlNodeGetContent(node);
+	}
+	href = (node->ns != NULL && node->ns->href != NULL) ? (const char*)node->ns->href : "";
+
+	rec.depth = depth;
+	if (kv_build_data(b, b->key, depth * sizeof(uint32_t), &rec.key) ||
+			kv_build_data(b, node->name, xmlStrlen(node->name) + 1, &rec.value) ||
+			kv_build_data(b, href, strlen(href) + 1, &aux) ||
+			kv_build_data(b, (text != NULL) ? (const char*)text : "", (text != NULL) ? xmlStrlen(text) + 1 : 1, &aux)) {
+		goto cleanup;
+	}
+	rec.value_len = (uint32_t)(b->data_len - rec.value);
+
+	if (b->count == UINT32_MAX || kv_build_reserve((void**)&b->index, &b->index_size, b->count + 1, sizeof(struct kv_record))) {
+		goto cleanup;
+	}
+	b->index[b->count++] = rec;
+
+	for (child = node->children; child != NULL; child = child->next) {
+		if (child->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (kv_build_reserve((void**)&b->key, &b->key_size, depth + 1, sizeof(uint32_t))) {
+			goto cleanup;
+		}
+		b->key[depth] = htonl(++pos);
+		if (kv_build_node(b, child, depth + 1)) {
+			goto cleanup;
+		}
+	}
+	ret = EXIT_SUCCESS;
+
+cleanup:
+	xmlFree(text);
+	return (ret);
+}
+
+/**
+ * @brief Build records of the list of top-level elements.
+ */
+static int kv_build_part(struct kv_build* b, xmlNodePtr list, struct kv_part* part)
+{
+	xmlNodePtr node;
+	uint32_t pos = 0;
+
+	memset(b, 0, sizeof(struct kv_build));
+	for (node = list; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (kv_build_reserve((void**)&b->tops, &b->tops_size, b->tops_count + 1, sizeof(uint32_t)) ||
+				kv_build_reserve((void**)&b->key, &b->key_size, 1, sizeof(uint32_t))) {
+			return (EXIT_FAILURE);
+		}
+		b->tops[b->tops_count++] = (uint32_t)b->count;
+		b->key[0] = htonl(++pos);
+		if (kv_build_node(b, node, 1)) {
+			return (EXIT_FAILURE);
+		}
+	}
+
+	part->index = b->index;
+	part->count = (uint32_t)b->count;
+	part->tops = b->tops;
+	part->tops_count = (uint32_t)b->tops_count;
+	part->data = b->data;
+	part->data_len = b->data_len;
+
+	return (EXIT_SUCCESS);
+}
+
+static void kv_build_free(struct kv_build* b)
+{
+	free(b->index);
+	free(b->tops);
+	free(b->data);
+	free(b->key);
+	memset(b, 0, sizeof(struct kv_build));
+}
+
+/**
+ * @brief Create the elements of the records in the given range and append
+ * them to the document. The range must start with a top-level record.
+ */
+static int kv_decode_range(const struct kv_part* part, uint32_t first, uint32_t end, xmlDocPtr doc)
+{
+	const struct kv_record* rec;
+	const char *name, *href, *text, *value_end;
+	xmlNodePtr *stack = NULL, node, parent;
+	uint64_t stack_size = 0;
+	uint32_t i, depth = 0;
+	xmlNsPtr ns;
+
+	for (i = first; i < end && i < part->count; i++) {
+		rec = &part->index[i];
+		if (rec->depth == 0 || rec->depth > depth + 1 || (i == first && rec->depth != 1) ||
+				!kv_range(rec->value, rec->value_len, part->data_len) || rec->value_len < 3 ||
+				part->data[rec->value + rec->value_len - 1] != '\0') {
+			goto corrupted;
+		}
+		value_end = part->data + rec->value + rec->value_len;
+		name = part->data + rec->value;
+		href = name + strlen(name) + 1;
+		if (href >= value_end) {
+			goto corrupted;
+		}
+		text = href + strlen(href) + 1;
+		if (text >= value_end) {
+			goto corrupted;
+		}
+		depth = rec->depth;
+
+		parent = (depth > 1) ? stack[depth - 2] : NULL;
+		node = xmlNewDocNode(doc, NULL, BAD_CAST name, NULL);
+		if (parent != NULL) {
+			xmlAddChild(parent, node);
+		} else if (doc->children == NULL) {
+			xmlDocSetRootElement(doc, node);
+		} else {
+			xmlAddNextSibling(doc->last, node);
+		}
+		if (*href != '\0') {
+			if (parent == NULL || (ns = xmlSearchNsByHref(doc, parent, BAD_CAST href)) == NULL) {
+				ns = xmlNewNs(node, BAD_CAST href, NULL);
+			}
+			xmlSetNs(node, ns);
+		}
+		if (*text != '\0') {
+			xmlNodeAddContent(node, BAD_CAST text);
+		}
+
+		if (kv_build_reserve((void**)&stack, &stack_size, depth, sizeof(xmlNodePtr))) {
+			free(stack);
+			return (EXIT_FAILURE);
+		}
+		stack[depth - 1] = node;
+	}
+	free(stack);
+
+	return (EXIT_SUCCESS);
+
+corrupted:
+	ERROR("%s: corrupted record %u in the key-value datastore.", __func__, i);
+	free(stack);
+	return (EXIT_FAILURE);
+}
+
+/**
+ * @brief Check if the subtree filter can select the top-level element.
+ */
+static int kv_filter_selects(const struct nc_filter* filter, const struct kv_part* part, uint32_t top)
+{
+	const struct kv_record* rec;
+	const char *name, *href;
+	xmlNodePtr node;
+	int elements = 0;
+
+	if (filter == NULL || filter->type != NC_FILTER_SUBTREE || filter->subtree_filter == NULL || top >= part->count) {
+		return (1);
+	}
+
+	rec = &part->index[top];
+	if (!kv_range(rec->value, rec->value_len, part->data_len) || rec->value_len < 3 ||
+			part->data[rec->value + rec->value_len - 1] != '\0') {
+		/* let the decoder report it */
+		return (1);
+	}
+	name = part->data + rec->value;
+	href = name + strlen(name) + 1;
+
+	for (node = filter->subtree_filter->children; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		elements++;
+		if (xmlStrEqual(node->name, BAD_CAST name) &&
+				(node->ns == NULL || node->ns->href == NULL || xmlStrEqual(node->ns->href, BAD_CAST href))) {
+			return (1);
+		}
+	}
+
+	/* a filter without any element selects everything */
+	return (elements == 0);
+}
+
+/**
+ * @brief Create a document with the content of the datastore part.
+ */
+static xmlDocPtr kv_part_doc(const struct kv_part* part, const struct nc_filter* filter)
+{
+	xmlDocPtr doc;
+	uint32_t i;
+
+	if ((doc = xmlNewDoc(BAD_CAST "1.0")) == NULL) {
+		ERROR("%s: creating the document failed.", __func__);
+		return (NULL);
+	}
+
+	/* only the selected top-level subtrees are read */
+	for (i = 0; i < part->tops_count; i++) {
+		if (!kv_filter_selects(filter, part, part->tops[i])) {
+			continue;
+		}
+		if (kv_decode_range(part, part->tops[i], (i + 1 < part->tops_count) ? part->tops[i + 1] : part->count, doc)) {
+			xmlFreeDoc(doc);
+			return (NULL);
+		}
+	}
+
+	return (doc);
+}
+
+/**
+ * @brief Parse serialized configuration data into a document with the
+ * top-level elements as the root element and its siblings.
+ */
+static xmlDocPtr kv_read_config(const char* config, struct nc_err** error)
+{
+	xmlDocPtr doc, ret;
+	xmlNodePtr node;
+	const char *configp = config;
+	char *aux;
+
+	if (config == NULL) {
+		ERROR("%s: invalid config.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
+		return (NULL);
+	}
+	if (strncmp(configp, "<?xml", 5) == 0) {
+		if ((configp = strchr(configp, '>')) == NULL) {
+			ERROR("%s: invalid config.", __func__);
+			*error = nc_err_new(NC_ERR_BAD_ELEM);
+			nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
+			return (NULL);
+		}
+		++configp;
+	}
+
+	if (asprintf(&aux, "<config>%s</config>", configp) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		return (NULL);
+	}
+	doc = xmlReadMemory(aux, strlen(aux), NULL, NULL, NC_XMLREAD_OPTIONS);
+	free(aux);
+	if (doc == NULL || doc->children == NULL) {
+		ERROR("%s: Reading xml data failed!", __func__);
+		xmlFreeDoc(doc);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		return (NULL);
+	}
+
+	/* get off the root config element and move all children to the 1st level */
+	ret = xmlNewDoc(BAD_CAST "1.0");
+	for (node = doc->children->children; node != NULL; node = doc->children->children) {
+		xmlUnlinkNode(node);
+		if (node->type != XML_ELEMENT_NODE) {
+			xmlFreeNode(node);
+			continue;
+		}
+		xmlDOMWrapAdoptNode(NULL, doc, node, ret, NULL, 0);
+		if (ret->children == NULL) {
+			xmlDocSetRootElement(ret, node);
+		} else {
+			xmlAddNextSibling(ret->last, node);
+		}
+	}
+	xmlFreeDoc(doc);
+
+	return (ret);
+}
+
+static int kv_write_all(int fd, const void* buf, uint64_t len)
+{
+	const char* p = buf;
+	ssize_t r;
+
+	while (len > 0) {
+		if ((r = write(fd, p, len)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return (EXIT_FAILURE);
+		}
+		p += r;
+		len -= r;
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static int kv_write_pad(int fd, uint64_t* offset)
+{
+	static const char zeros[8] = {0};
+	uint64_t aligned = KV_ALIGN(*offset);
+
+	if (aligned != *offset && kv_write_all(fd, zeros, aligned - *offset)) {
+		return (EXIT_FAILURE);
+	}
+	*offset = aligned;
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Write the new version of the datastore file and atomically replace
+ * the previous one. Must be called with the writers' lock held.
+ *
+ * @param[in] kv_ds Key-value datastore.
+ * @param[in] base Snapshot the new version is based on, NULL when creating
+ * the datastore.
+ * @param[in] parts Content of the datastore parts in the new version.
+ * @param[in] changed Mask of the parts whose content is changed, base is kept
+ * for ncds_kv_rollback() if non-zero.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int kv_commit(struct ncds_ds_kv* kv_ds, struct kv_snapshot* base, const struct kv_part parts[NCDS_KV_PARTS], int changed)
+{
+	struct kv_header header;
+	struct kv_part_header* ph;
+	struct stat st;
+	char *dup_path, *dup_name, *tmp_path;
+	uint64_t offset;
+	int fd, i;
+
+	dup_path = strdup(kv_ds->path);
+	dup_name = strdup(kv_ds->path);
+	if (asprintf(&tmp_path, "%s/.%s.XXXXXX", dirname(dup_path), basename(dup_name)) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		free(dup_path);
+		free(dup_name);
+		return (EXIT_FAILURE);
+	}
+	free(dup_path);
+	free(dup_name);
+
+	if ((fd = mkstemp(tmp_path)) == -1) {
+		ERROR("%s: unable to create temporary file %s (%s).", __func__, tmp_path, strerror(errno));
+		free(tmp_path);
+		return (EXIT_FAILURE);
+	}
+
+	/* keep the access rights of the original file */
+	if (stat(kv_ds->path, &st) == 0) {
+		if (fchmod(fd, st.st_mode & 07777) == -1 || (fchown(fd, st.st_uid, st.st_gid) == -1 && errno != EPERM)) {
+			WARN("%s: unable to set access rights of the file %s (%s).", __func__, tmp_path, strerror(errno));
+		}
+	}
+
+	/* lay out the file */
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NCDS_KV_MAGIC, 4);
+	header.version = NCDS_KV_VERSION;
+	header.generation = (base != NULL) ? base->generation + 1 : 1;
+	offset = sizeof(header);
+	for (i = 0; i < NCDS_KV_PARTS; i++) {
+		ph = &header.parts[i];
+		if (parts[i].lock != NULL) {
+			ph->lock = offset;
+			offset += strlen(parts[i].lock) + 1;
+			ph->locktime = offset;
+			offset += ((parts[i].locktime != NULL) ? strlen(parts[i].locktime) : 0) + 1;
+		}
+	}
+	for (i = 0; i < NCDS_KV_PARTS; i++) {
+		ph = &header.parts[i];
+		offset = KV_ALIGN(offset);
+		ph->index = offset;
+		ph->count = parts[i].count;
+		offset += (uint64_t)parts[i].count * sizeof(struct kv_record);
+		ph->tops = offset;
+		ph->tops_count = parts[i].tops_count;
+		offset += (uint64_t)parts[i].tops_count * sizeof(uint32_t);
+		offset = KV_ALIGN(offset);
+		ph->data = offset;
+		ph->data_len = parts[i].data_len;
+		offset += parts[i].data_len;
+		ph->modified = parts[i].modified ? 1 : 0;
+	}
+
+	/* write it */
+	if (kv_write_all(fd, &header, sizeof(header))) {
+		goto error;
+	}
+	offset = sizeof(header);
+	for (i = 0; i < NCDS_KV_PARTS; i++) {
+		if (parts[i].lock != NULL) {
+			if (kv_write_all(fd, parts[i].lock, strlen(parts[i].lock) + 1) ||
+					kv_write_all(fd, (parts[i].locktime != NULL) ? parts[i].locktime : "",
+							((parts[i].locktime != NULL) ? strlen(parts[i].locktime) : 0) + 1)) {
+				goto error;
+			}
+			offset = header.parts[i].locktime + ((parts[i].locktime != NULL) ? strlen(parts[i].locktime) : 0) + 1;
+		}
+	}
+	for (i = 0; i < NCDS_KV_PARTS; i++) {
+		if (kv_write_pad(fd, &offset) ||
+				kv_write_all(fd, parts[i].index, (uint64_t)parts[i].count * sizeof(struct kv_record)) ||
+				kv_write_all(fd, parts[i].tops, (uint64_t)parts[i].tops_count * sizeof(uint32_t))) {
+			goto error;
+		}
+		offset += (uint64_t)parts[i].count * sizeof(struct kv_record) + (uint64_t)parts[i].tops_count * sizeof(uint32_t);
+		if (kv_write_pad(fd, &offset) || kv_write_all(fd, parts[i].data, parts[i].data_len)) {
+			goto error;
+		}
+		offset += parts[i].data_len;
+	}
+
+	if (fsync(fd) == -1) {
+		goto error;
+	}
+	close(fd);
+	fd = -1;
+
+	if (rename(tmp_path, kv_ds->path) == -1) {
+		ERROR("%s: replacing the file %s failed (%s).", __func__, kv_ds->path, strerror(errno));
+		goto error;
+	}
+	free(tmp_path);
+
+	/* remember the previous version to be able to undo the change */
+	if (changed) {
+		pthread_mutex_lock(&kv_ds->snap_lock);
+		if (kv_ds->rollback != NULL && --kv_ds->rollback->refs == 0) {
+			kv_snapshot_free(kv_ds->rollback);
+		}
+		kv_ds->rollback = base;
+		if (base != NULL) {
+			base->refs++;
+		}
+		kv_ds->rollback_parts = changed;
+		pthread_mutex_unlock(&kv_ds->snap_lock);
+	}
+
+	return (EXIT_SUCCESS);
+
+error:
+	if (fd != -1) {
+		ERROR("%s: storing repository into the file %s failed (%s).", __func__, tmp_path, strerror(errno));
+		close(fd);
+	}
+	unlink(tmp_path);
+	free(tmp_path);
+	return (EXIT_FAILURE);
+}
+
+static void kv_rollback_reset(struct ncds_ds_kv* kv_ds)
+{
+	pthread_mutex_lock(&kv_ds->snap_lock);
+	if (kv_ds->rollback != NULL && --kv_ds->rollback->refs == 0) {
+		kv_snapshot_free(kv_ds->rollback);
+	}
+	kv_ds->rollback = NULL;
+	kv_ds->rollback_parts = 0;
+	pthread_mutex_unlock(&kv_ds->snap_lock);
+}
+
+/**
+ * @brief Start a change of the datastore - get the writers' lock and the
+ * current content of the datastore parts.
+ */
+static struct kv_snapshot* kv_change_start(struct ncds_ds_kv* kv_ds, struct kv_part parts[NCDS_KV_PARTS], struct nc_err** error)
+{
+	struct kv_snapshot* snap;
+	int i;
+
+	if (kv_write_lock(kv_ds, error)) {
+		return (NULL);
+	}
+	if ((snap = kv_snapshot_get(kv_ds)) == NULL) {
+		kv_write_unlock(kv_ds);
+		if (error != NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(*error, NC_ERR_PARAM_MSG, "Unable to read the datastore file.");
+		}
+		return (NULL);
+	}
+	for (i = 0; i < NCDS_KV_PARTS; i++) {
+		kv_part_get(snap, i, &parts[i]);
+	}
+
+	return (snap);
+}
+
+static void kv_change_finish(struct ncds_ds_kv* kv_ds, struct kv_snapshot* snap)
+{
+	kv_snapshot_release(kv_ds, snap);
+	kv_write_unlock(kv_ds);
+}
+
+API int ncds_kv_set_path(struct ncds_ds* datastore, const char* path)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)datastore;
+	char* lock_path;
+	mode_t mask;
+	int fd;
+
+	if (datastore == NULL || datastore->type != NCDS_TYPE_KV) {
+		ERROR("Invalid datastore.");
+		return (-1);
+	}
+	if (path == NULL) {
+		ERROR("Invalid path.");
+		return (-2);
+	}
+	if (kv_ds->path != NULL) {
+		ERROR("%s: the datastore file is already set.", __func__);
+		return (-1);
+	}
+
+	mask = umask(MASK_PERM);
+	if (eaccess(path, F_OK) != 0) {
+		/* file does not exist, the content is created by ncds_kv_init() */
+		WARN("Datastore file %s does not exist, creating it.", path);
+		if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, FILE_PERM)) == -1) {
+			umask(mask);
+			ERROR("Datastore file %s cannot be created (%s).", path, strerror(errno));
+			return (-2);
+		}
+		close(fd);
+		VERB("Datastore file %s was created.", path);
+	} else if (eaccess(path, W_OK | R_OK) != 0) {
+		umask(mask);
+		ERROR("Insufficient rights for manipulation with the datastore file %s (%s).", path, strerror(errno));
+		return (-2);
+	}
+
+	if (asprintf(&lock_path, "%s.lock", path) == -1) {
+		umask(mask);
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (-2);
+	}
+	fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, FILE_PERM);
+	umask(mask);
+	if (fd == -1) {
+		ERROR("Lock file %s of the datastore cannot be opened (%s).", lock_path, strerror(errno));
+		free(lock_path);
+		return (-2);
+	}
+	free(lock_path);
+
+	kv_ds->lock_fd = fd;
+	pthread_mutex_init(&kv_ds->write_lock, NULL);
+	pthread_mutex_init(&kv_ds->snap_lock, NULL);
+	kv_ds->path = strdup(path);
+
+	return (0);
+}
+
+int ncds_kv_init(struct ncds_ds* ds)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)ds;
+	struct kv_snapshot* snap;
+	struct kv_part parts[NCDS_KV_PARTS];
+	struct stat st;
+	int i, ret, changed = 0;
+
+	if (kv_ds->path == NULL) {
+		ERROR("%s: the datastore file is not set (ncds_kv_set_path()).", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	if (stat(kv_ds->path, &st) == 0 && st.st_size == 0) {
+		/* create the empty datastore */
+		if (kv_write_lock(kv_ds, NULL)) {
+			return (EXIT_FAILURE);
+		}
+		ret = EXIT_SUCCESS;
+		if (stat(kv_ds->path, &st) == 0 && st.st_size == 0) {
+			memset(parts, 0, sizeof(parts));
+			ret = kv_commit(kv_ds, NULL, parts, 0);
+			VERB("File %s was empty. Basic structure created.", kv_ds->path);
+		}
+		kv_write_unlock(kv_ds);
+		if (ret) {
+			return (EXIT_FAILURE);
+		}
+	}
+
+	/* unlock forgotten locks if any, they are stored in the file and so
+	 * survive the crash or restart of the server holding them */
+	if ((snap = kv_change_start(kv_ds, parts, NULL)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	ret = EXIT_SUCCESS;
+	for (i = 0; i < NCDS_KV_PARTS; i++) {
+		if (parts[i].lock != NULL) {
+			VERB("Dropping the forgotten lock of the session %s in the datastore file %s.", parts[i].lock, kv_ds->path);
+			parts[i].lock = NULL;
+			parts[i].locktime = NULL;
+			changed = 1;
+		}
+	}
+	if (changed) {
+		ret = kv_commit(kv_ds, snap, parts, 0);
+	}
+	kv_change_finish(kv_ds, snap);
+	if (ret) {
+		return (EXIT_FAILURE);
+	}
+
+	/* check the content */
+	if ((snap = kv_snapshot_get(kv_ds)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	kv_ds->changed_generation = snap->generation;
+	kv_snapshot_release(kv_ds, snap);
+
+	return (EXIT_SUCCESS);
+}
+
+void ncds_kv_free(struct ncds_ds* ds)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)ds;
+	int i;
+
+	if (kv_ds->path == NULL) {
+		return;
+	}
+
+	kv_rollback_reset(kv_ds);
+	kv_snapshot_release(kv_ds, kv_ds->snapshot);
+	kv_ds->snapshot = NULL;
+	for (i = 0; i < NCDS_KV_PARTS; i++) {
+		free(kv_ds->lockinfo[i].sid);
+		free(kv_ds->lockinfo[i].time);
+	}
+	close(kv_ds->lock_fd);
+	pthread_mutex_destroy(&kv_ds->write_lock);
+	pthread_mutex_destroy(&kv_ds->snap_lock);
+	free(kv_ds->path);
+	kv_ds->path = NULL;
+}
+
+int ncds_kv_changed(struct ncds_ds* ds)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)ds;
+	struct kv_snapshot* snap;
+	int ret;
+
+	if ((snap = kv_snapshot_get(kv_ds)) == NULL) {
+		/* unable to check, so expect a change */
+		return (1);
+	}
+	ret = (snap->generation != kv_ds->changed_generation);
+	kv_ds->changed_generation = snap->generation;
+	kv_snapshot_release(kv_ds, snap);
+
+	return (ret);
+}
+
+int ncds_kv_rollback(struct ncds_ds* ds)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)ds;
+	struct kv_snapshot* snap;
+	struct kv_part parts[NCDS_KV_PARTS], old;
+	int i, ret;
+
+	if (kv_ds == NULL || kv_ds->ds.type != NCDS_TYPE_KV) {
+		return (EXIT_FAILURE);
+	}
+
+	if ((snap = kv_change_start(kv_ds, parts, NULL)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	if (kv_ds->rollback_parts == 0) {
+		kv_change_finish(kv_ds, snap);
+		if (kv_ds->rollback == NULL) {
+			ERROR("No backup repository for rollback operation (datastore %d).", kv_ds->ds.id);
+			return (EXIT_FAILURE);
+		}
+		/* the last operation did not change anything */
+		return (EXIT_SUCCESS);
+	}
+
+	/* restore only the parts changed by the last operation, the others can
+	 * be already changed by another process */
+	for (i = 0; i < NCDS_KV_PARTS; i++) {
+		if (kv_ds->rollback_parts & (1 << i)) {
+			kv_part_get(kv_ds->rollback, i, &old);
+			kv_part_content(&parts[i], &old);
+			parts[i].modified = old.modified;
+		}
+	}
+	ret = kv_commit(kv_ds, snap, parts, 0);
+	kv_rollback_reset(kv_ds);
+	kv_change_finish(kv_ds, snap);
+
+	return (ret);
+}
+
+const struct ncds_lockinfo *ncds_kv_lockinfo(struct ncds_ds* ds, NC_DATASTORE target)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)ds;
+	struct kv_snapshot* snap;
+	struct kv_part part;
+	struct ncds_lockinfo* info;
+	int p;
+
+	if ((p = kv_part_index(target)) == -1) {
+		return (NULL);
+	}
+	if ((snap = kv_snapshot_get(kv_ds)) == NULL) {
+		return (NULL);
+	}
+	kv_part_get(snap, p, &part);
+
+	info = &kv_ds->lockinfo[p];
+	info->datastore = target;
+	free(info->sid);
+	free(info->time);
+	info->sid = (part.lock != NULL) ? strdup(part.lock) : NULL;
+	info->time = (part.lock != NULL && part.locktime != NULL) ? strdup(part.locktime) : NULL;
+	kv_snapshot_release(kv_ds, snap);
+
+	return (info);
+}
+
+int ncds_kv_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)ds;
+	struct kv_snapshot* snap;
+	struct kv_part parts[NCDS_KV_PARTS];
+	int p, retval = EXIT_SUCCESS;
+	char* t;
+
+	assert(error);
+
+	if ((p = kv_part_index(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+	if ((snap = kv_change_start(kv_ds, parts, error)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	if (parts[p].lock != NULL) {
+		/* someone is already holding the lock */
+		*error = nc_err_new(NC_ERR_LOCK_DENIED);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_SID, parts[p].lock);
+		retval = EXIT_FAILURE;
+	} else if (p == NCDS_KV_CANDIDATE && parts[p].modified) {
+		*error = nc_err_new(NC_ERR_LOCK_DENIED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Candidate datastore not locked but already modified.");
+		retval = EXIT_FAILURE;
+	} else {
+		parts[p].lock = session->session_id;
+		parts[p].locktime = t = nc_time2datetime(time(NULL), NULL);
+		if (kv_commit(kv_ds, snap, parts, 0)) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+			retval = EXIT_FAILURE;
+		}
+		free(t);
+	}
+	kv_change_finish(kv_ds, snap);
+
+	return (retval);
+}
+
+int ncds_kv_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)ds;
+	struct kv_snapshot* snap;
+	struct kv_part parts[NCDS_KV_PARTS];
+	int p, retval = EXIT_SUCCESS;
+
+	assert(error);
+
+	if ((p = kv_part_index(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+	if ((snap = kv_change_start(kv_ds, parts, error)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	if (parts[p].lock == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Target datastore is not locked.");
+		retval = EXIT_FAILURE;
+	} else if (strcmp(parts[p].lock, session->session_id) != 0) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Target datastore is locked by another session.");
+		retval = EXIT_FAILURE;
+	} else {
+		if (p == NCDS_KV_CANDIDATE) {
+			/* drop current candidate configuration, copy running into it */
+			kv_part_content(&parts[p], &parts[NCDS_KV_RUNNING]);
+			parts[p].modified = 0;
+		}
+		parts[p].lock = NULL;
+		parts[p].locktime = NULL;
+		if (kv_commit(kv_ds, snap, parts, 0)) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+			retval = EXIT_FAILURE;
+		}
+	}
+	kv_change_finish(kv_ds, snap);
+
+	return (retval);
+}
+
+xmlDocPtr ncds_kv_getconfig_xml(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, const struct nc_filter* filter, struct nc_err** error)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)ds;
+	struct kv_snapshot* snap;
+	struct kv_part part;
+	xmlDocPtr doc;
+	int p;
+
+	assert(error);
+
+	if ((p = kv_part_index(source)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return (NULL);
+	}
+
+	/* readers work with the snapshot without any lock */
+	if ((snap = kv_snapshot_get(kv_ds)) == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Unable to read the datastore file.");
+		return (NULL);
+	}
+	kv_part_get(snap, p, &part);
+	if ((doc = kv_part_doc(&part, filter)) == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Invalid datastore content.");
+	}
+	kv_snapshot_release(kv_ds, snap);
+
+	return (doc);
+}
+
+char* ncds_kv_getconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error)
+{
+	xmlDocPtr doc;
+	xmlNodePtr node;
+	xmlBufferPtr resultbuffer;
+	char* data;
+
+	if ((doc = ncds_kv_getconfig_xml(ds, session, source, NULL, error)) == NULL) {
+		return (NULL);
+	}
+
+	if ((resultbuffer = xmlBufferCreate()) == NULL) {
+		ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		xmlFreeDoc(doc);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		return (NULL);
+	}
+	for (node = doc->children; node != NULL; node = node->next) {
+		xmlNodeDump(resultbuffer, doc, node, 2, 1);
+	}
+	data = nc_clrwspace((char *) xmlBufferContent(resultbuffer));
+	xmlBufferFree(resultbuffer);
+	xmlFreeDoc(doc);
+
+	return (data);
+}
+
+int ncds_kv_copyconfig(struct ncds_ds *ds, const struct nc_session *session, const nc_rpc* rpc, NC_DATASTORE target, NC_DATASTORE source, char * config, struct nc_err **error)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)ds;
+	struct kv_snapshot* snap;
+	struct kv_part parts[NCDS_KV_PARTS], new_part;
+	struct kv_build build;
+	xmlDocPtr source_doc = NULL, target_doc = NULL;
+	keyList keys;
+	int p, s = -1, r, ret = EXIT_SUCCESS, nacm;
+
+	assert(error);
+
+	if ((p = kv_part_index(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+	if (source != NC_DATASTORE_CONFIG && (s = kv_part_index(source)) == -1) {
+		ERROR("%s: invalid source.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return (EXIT_FAILURE);
+	}
+	if (source == NC_DATASTORE_CONFIG && (source_doc = kv_read_config(config, error)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	if ((snap = kv_change_start(kv_ds, parts, error)) == NULL) {
+		xmlFreeDoc(source_doc);
+		return (EXIT_FAILURE);
+	}
+	memset(&build, 0, sizeof(build));
+
+	/* isn't target locked? */
+	if (kv_access(&parts[p], session) != 0 ||
+			(source == NC_DATASTORE_CANDIDATE && target == NC_DATASTORE_RUNNING && kv_access(&parts[s], session) != 0)) {
+		*error = nc_err_new(NC_ERR_IN_USE);
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	/* RFC 6536, sec. 3.2.4., paragraph 2
+	 * If the source of the <copy-config> protocol operation is the running
+	 * configuration datastore and the target is the startup configuration
+	 * datastore, the client is only required to have permission to execute
+	 * the <copy-config> protocol operation.
+	 */
+	nacm = (rpc != NULL && rpc->nacm != NULL && !(source == NC_DATASTORE_RUNNING && target == NC_DATASTORE_STARTUP));
+
+	if (nacm && s != -1 && (source_doc = kv_part_doc(&parts[s], NULL)) == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (nacm) {
+		keys = get_keynode_list(kv_ds->ds.ext_model);
+		if (s != -1) {
+			/* RFC 6536, sec 3.2.4., paragraph 3
+			 * If the source of the <copy-config> operation is a datastore,
+			 * then data nodes to which the client does not have read access
+			 * are silently omitted
+			 */
+			nacm_check_data_read(source_doc, rpc->nacm);
+		}
+
+		/* RFC 6536, sec. 3.2.4., paragraph 4
+		 * If the target of the <copy-config> operation is a datastore,
+		 * the client needs access to the modified nodes according to
+		 * the effective access operation of the each modified node.
+		 */
+		if (parts[p].count == 0) {
+			/* creating a completely new configuration data */
+			r = nacm_check_data(source_doc->children, NACM_ACCESS_CREATE, rpc->nacm);
+		} else if ((target_doc = kv_part_doc(&parts[p], NULL)) == NULL) {
+			r = -1;
+		} else {
+			/* replacing an old configuration data */
+			r = edit_replace_nacmcheck(target_doc->children, source_doc, kv_ds->ds.ext_model, keys, rpc->nacm, error);
+		}
+		keyListFree(keys);
+
+		if (r != NACM_PERMIT) {
+			if (*error == NULL) {
+				*error = nc_err_new((r == NACM_DENY) ? NC_ERR_ACCESS_DENIED : NC_ERR_OP_FAILED);
+			}
+			ret = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	/* prepare the new content of the target */
+	if (source_doc != NULL) {
+		if (kv_build_part(&build, source_doc->children, &new_part)) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			ret = EXIT_FAILURE;
+			goto cleanup;
+		}
+	} else {
+		/* records of a datastore are copied as they are */
+		new_part = parts[s];
+	}
+
+	if (new_part.count == 0 && parts[p].count == 0) {
+		/* there is no content to change */
+		ret = EXIT_RPC_NOT_APPLICABLE;
+	}
+	kv_part_content(&parts[p], &new_part);
+
+	/*
+	 * if we are changing candidate, mark it as modified, since we need
+	 * this information for locking - according to RFC, candidate cannot
+	 * be locked since it has been modified and not committed.
+	 */
+	if (p == NCDS_KV_CANDIDATE) {
+		parts[p].modified = (source == NC_DATASTORE_RUNNING) ? 0 : 1;
+	}
+
+	if ((ret != EXIT_RPC_NOT_APPLICABLE || p == NCDS_KV_CANDIDATE) && kv_commit(kv_ds, snap, parts, 1 << p)) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+		ret = EXIT_FAILURE;
+	}
+
+cleanup:
+	kv_change_finish(kv_ds, snap);
+	kv_build_free(&build);
+	xmlFreeDoc(source_doc);
+	xmlFreeDoc(target_doc);
+
+	return (ret);
+}
+
+int ncds_kv_deleteconfig(struct ncds_ds * ds, const struct nc_session * session, NC_DATASTORE target, struct nc_err **error)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)ds;
+	struct kv_snapshot* snap;
+	struct kv_part parts[NCDS_KV_PARTS];
+	int p, ret = EXIT_SUCCESS;
+
+	assert(error);
+
+	switch (target) {
+	case NC_DATASTORE_RUNNING:
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Cannot delete a running datastore.");
+		return (EXIT_FAILURE);
+	case NC_DATASTORE_STARTUP:
+	case NC_DATASTORE_CANDIDATE:
+		p = kv_part_index(target);
+		break;
+	default:
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+
+	if ((snap = kv_change_start(kv_ds, parts, error)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	if (kv_access(&parts[p], session) != 0) {
+		*error = nc_err_new(NC_ERR_IN_USE);
+		ret = EXIT_FAILURE;
+	} else {
+		kv_part_clear(&parts[p]);
+		if (p == NCDS_KV_CANDIDATE) {
+			parts[p].modified = 1;
+		}
+		if (kv_commit(kv_ds, snap, parts, 1 << p)) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+			ret = EXIT_FAILURE;
+		}
+	}
+	kv_change_finish(kv_ds, snap);
+
+	return (ret);
+}
+
+int ncds_kv_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error)
+{
+	struct ncds_ds_kv* kv_ds = (struct ncds_ds_kv*)ds;
+	struct kv_snapshot* snap;
+	struct kv_part parts[NCDS_KV_PARTS], new_part;
+	struct kv_build build;
+	xmlDocPtr config_doc, datastore_doc = NULL;
+	int p, ret = EXIT_FAILURE;
+
+	assert(error);
+
+	if ((p = kv_part_index(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+	if ((config_doc = kv_read_config(config, error)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	if ((snap = kv_change_start(kv_ds, parts, error)) == NULL) {
+		xmlFreeDoc(config_doc);
+		return (EXIT_FAILURE);
+	}
+	memset(&build, 0, sizeof(build));
+
+	if (kv_access(&parts[p], session) != 0) {
+		*error = nc_err_new(NC_ERR_IN_USE);
+		goto cleanup;
+	}
+
+	if ((datastore_doc = kv_part_doc(&parts[p], NULL)) == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Invalid datastore content.");
+		goto cleanup;
+	}
+
+	/* preform edit config */
+	if (edit_config(datastore_doc, config_doc, (struct ncds_ds*)kv_ds, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error)) {
+		goto cleanup;
+	}
+
+	if (kv_build_part(&build, datastore_doc->children, &new_part)) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		goto cleanup;
+	}
+	kv_part_content(&parts[p], &new_part);
+
+	/*
+	 * if we are changing candidate, mark it as modified, since we need
+	 * this information for locking - according to RFC, candidate cannot
+	 * be locked since it has been modified and not committed.
+	 */
+	if (p == NCDS_KV_CANDIDATE) {
+		parts[p].modified = 1;
+	}
+
+	if (kv_commit(kv_ds, snap, parts, 1 << p)) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+		goto cleanup;
+	}
+	ret = EXIT_SUCCESS;
+
+cleanup:
+	kv_change_finish(kv_ds, snap);
+	kv_build_free(&build);
+	xmlFreeDoc(datastore_doc);
+	xmlFreeDoc(config_doc);
+
+	return (ret);
+}
@@ -0,0 +1,308 @@
+/**
+ * \file datastore_kv.h
+ * \brief NETCONF datastore handling function prototypes and structures for
+ * key-value datastore implementation.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef NC_DATASTORE_KV_H_
+#define NC_DATASTORE_KV_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "../../netconf_internal.h"
+#include "../datastore_internal.h"
+
+/* Number of seconds waiting for the writers' lock before giving up */
+#define NCDS_KV_LOCK_TIMEOUT 5
+
+/* Indexes of the datastore parts */
+#define NCDS_KV_RUNNING 0
+#define NCDS_KV_STARTUP 1
+#define NCDS_KV_CANDIDATE 2
+#define NCDS_KV_PARTS 3
+
+#define NCDS_KV_MAGIC "NCKV"
+#define NCDS_KV_VERSION 1
+
+/*
+ * The datastore file consists of a header followed by the lock strings and
+ * the datastore parts. Each part is a sorted index of records, the index of
+ * its top-level records and the data area with the keys and values of the
+ * records. The offsets inside the records are relative to the part's data
+ * area, so a part can be copied into a new file as is. The file is never
+ * modified in place, every change is written into a new file which atomically
+ * replaces the previous one.
+ *
+ * All numbers are stored in the host byte order except the key positions,
+ * which are big endian so the keys can be compared with memcmp().
+ */
+
+/**
+ * @brief Record of a single element of the configuration data.
+ *
+ * The key is the path of the element in the form of the positions (counted
+ * from 1) of the element and its ancestors among their sibling elements, so
+ * sorting the records by the keys gives the document order and all the
+ * records of a subtree are stored in a continuous range. The value contains
+ * NULL-terminated name, namespace and text content of the element (the text
+ * is empty for elements with child elements).
+ */
+struct kv_record {
+	uint32_t key;
+	uint32_t depth;
+	uint32_t value;
+	uint32_t value_len;
+};
+
+/**
+ * @brief Description of a datastore part in the file header.
+ */
+struct kv_part_header {
+	uint64_t index;
+	uint64_t tops;
+	uint64_t data;
+	uint64_t data_len;
+	uint32_t count;
+	uint32_t tops_count;
+	/* offsets of the NULL-terminated lock holder and lock time, 0 if not locked */
+	uint64_t lock;
+	uint64_t locktime;
+	uint32_t modified;
+	uint32_t reserved;
+};
+
+struct kv_header {
+	char magic[4];
+	uint32_t version;
+	/* number of the changes of the file, incremented by every commit */
+	uint64_t generation;
+	struct kv_part_header parts[NCDS_KV_PARTS];
+};
+
+/**
+ * @brief Immutable version of the datastore file mapped into memory.
+ *
+ * Readers keep a reference to the snapshot while they work with it, so
+ * they always see a consistent content and never block the writers.
+ */
+struct kv_snapshot {
+	unsigned int refs;
+	const char* map;
+	size_t size;
+	dev_t dev;
+	ino_t ino;
+	uint64_t generation;
+};
+
+/**
+ * @brief Key-value datastore implementation-specific ncds_ds structure.
+ */
+struct ncds_ds_kv {
+	/* common part from datastore_internal.h */
+	struct ncds_ds ds;
+
+	/* specific part */
+	/**
+	 * @brief Path to the file containing the configuration data.
+	 */
+	char* path;
+	/**
+	 * @brief File serializing writers of all the processes (fcntl() lock).
+	 */
+	int lock_fd;
+	/**
+	 * @brief Serialization of the writers inside the process, fcntl() locks
+	 * are held by the processes, not by the threads.
+	 */
+	pthread_mutex_t write_lock;
+	/**
+	 * @brief Protection of the snapshot pointers and their reference counts.
+	 */
+	pthread_mutex_t snap_lock;
+	/**
+	 * @brief The latest seen version of the datastore file.
+	 */
+	struct kv_snapshot* snapshot;
+	/**
+	 * @brief Version of the file before the last change made by this
+	 * process and the mask of the parts it changed, for ncds_kv_rollback().
+	 */
+	struct kv_snapshot* rollback;
+	int rollback_parts;
+	/**
+	 * @brief Generation of the file seen by the last ncds_kv_changed() call.
+	 */
+	uint64_t changed_generation;
+	/**
+	 * @brief Lock information returned by ncds_kv_lockinfo().
+	 */
+	struct ncds_lockinfo lockinfo[NCDS_KV_PARTS];
+};
+
+/**
+ * @brief Initialization of a key-value datastore
+ *
+ * Creates the empty datastore if the file is empty.
+ *
+ * @param[in] ds Key-value datastore structure
+ * @return 0 on success, non-zero else
+ */
+int ncds_kv_init(struct ncds_ds* ds);
+
+/**
+ * @brief Close the specified datastore and free all the resources.
+ * @param[in] ds Key-value datastore to be closed.
+ */
+void ncds_kv_free(struct ncds_ds* ds);
+
+/**
+ * @brief Test if configuration datastore was changed by another process since
+ * last access of the caller.
+ * @param[in] ds Key-value datastore structure which will be tested.
+ * @return 0 as false if the datastore was not updated, 1 if the datastore was
+ * changed.
+ */
+int ncds_kv_changed(struct ncds_ds* ds);
+
+/**
+ * @brief Revert the parts of the datastore changed by the last operation of
+ * this process.
+ * @param[in] ds Key-value datastore which will be rolled back.
+ * @return 0 on success, non-zero if the operation can not be performed.
+ */
+int ncds_kv_rollback(struct ncds_ds* ds);
+
+/**
+ * @brief Get lock information about the specified NETCONF datastore
+ * @param[in] ds Key-value datastore structure that will be checked.
+ * @param[in] target NETCONF datastore (running, startup, candidate) to be analyzed.
+ * @return NULL on error, filled lock information structure on success.
+ */
+const struct ncds_lockinfo *ncds_kv_lockinfo(struct ncds_ds* ds, NC_DATASTORE target);
+
+/**
+ * @brief Lock the specified datastore for the specified session.
+ *
+ * @param[in] ds Key-value datastore structure where the lock should be applied.
+ * @param[in] session Session originating the request.
+ * @param[in] target Datastore (running, startup, candidate) to lock.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return 0 on success, non-zero on error and error structure is filled.
+ */
+int ncds_kv_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+
+/**
+ * @brief Unlock the specified datastore for the specified session.
+ *
+ * @param[in] ds Key-value datastore structure where the unlock should be applied.
+ * @param[in] session Session originating the request.
+ * @param[in] target Datastore (running, startup, candidate) to unlock.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return 0 on success, non-zero on error and error structure is filled.
+ */
+int ncds_kv_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+
+/**
+ * @brief Perform get-config on the specified repository.
+ *
+ * @param[in] ds Key-value datastore structure from which the data will be obtained.
+ * @param[in] session Session originating the request.
+ * @param[in] source Datastore (running, startup, candidate) to get the data from.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return NULL on error, resulting data on success.
+ */
+char* ncds_kv_getconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error);
+
+/**
+ * @brief Perform get-config on the specified repository, the data are returned
+ * as a XML document. Only the top-level subtrees selected by the subtree
+ * filter are read from the datastore.
+ *
+ * @param[in] ds Key-value datastore structure from which the data will be obtained.
+ * @param[in] session Session originating the request.
+ * @param[in] source Datastore (running, startup, candidate) to get the data from.
+ * @param[in] filter Filter of the request, NULL to get all the data.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return NULL on error, the data on success (empty document if there are
+ * no data).
+ */
+xmlDocPtr ncds_kv_getconfig_xml(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, const struct nc_filter* filter, struct nc_err** error);
+
+/**
+ * @brief Copy the content of a datastore or externally sent configuration to the other datastore
+ *
+ * @param ds Key-value datastore structure where the changes will be applied.
+ * @param session Session originating the request.
+ * @param rpc RPC message with the request. RPC message is used only for access control. If rpc is NULL access control is skipped.
+ * @param target Target datastore
+ * @param source Source datastore, if the value is NC_DATASTORE_CONFIG then
+ * config parameter holds the configration to be copy into the target datastore.
+ * @param config Configuration in the form of a serialized XML. The config is
+ * used only in case of NC_DATASTORE_CONFIG value of source parameter.
+ * @param error NETCONF error structure describing the experienced error.
+ * @return 0 on success, non-zero on error and error structure is filled.
+ */
+int ncds_kv_copyconfig(struct ncds_ds *ds, const struct nc_session* session, const nc_rpc* rpc, NC_DATASTORE target, NC_DATASTORE source, char * config, struct nc_err **error);
+
+/**
+ * @brief Delete the target datastore
+ *
+ * @param[in] ds Key-value datastore to be deleted
+ * @param[in] session Session requesting the deletion
+ * @param[in] target Datastore type (startup, candidate)
+ * @param[out] error NETCONF error structure
+ * @return 0 on success, non-zero on error and error structure is filled.
+ */
+int ncds_kv_deleteconfig(struct ncds_ds * ds, const struct nc_session * session, NC_DATASTORE target, struct nc_err **error);
+
+/**
+ * @brief Perform the edit-config operation
+ *
+ * @param[in] ds Key-value datastore to edit
+ * @param[in] session Session sending the edit request
+ * @param[in] rpc RPC message with the request. RPC message is used only for access control. If rpc is NULL access control is skipped.
+ * @param[in] target Datastore type
+ * @param[in] config Edit configuration.
+ * @param[in] defop Default edit operation.
+ * @param[in] errop Error-option.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return 0 on success, non-zero on error and error structure is filled.
+ */
+int ncds_kv_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
+
+#endif /* NC_DATASTORE_KV_H_ */
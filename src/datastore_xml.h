@@ -72,6 +72,22 @@ extern "C" {
  */
 struct ncds_ds* ncds_new2(NCDS_TYPE type, const char * model_path, xmlDocPtr (*get_state)(const xmlDocPtr model, const xmlDocPtr running, struct nc_err **e));
 
+/**
+ * @ingroup store
+ * @brief Get the subtree filter of the \<get\> request being processed.
+ *
+ * To make this function available, you have to include libnetconf_xml.h.
+ *
+ * The function is supposed to be used from the get_state() callbacks to
+ * generate only the state data that can be selected by the filter. Generating
+ * more data than requested is not an error, the result is filtered afterwards.
+ *
+ * @return The first of the filter's top-level nodes (read only, valid only
+ * during the callback), NULL if all the state data are requested or when
+ * called out of a get_state() callback.
+ */
+xmlNodePtr ncds_get_state_filter(void);
+
 /**
  * @ingroup transapi
  * @brief Create new datastore structure with transaction API support
@@ -391,7 +391,7 @@ struct nc_err* nc_err_parse(nc_reply* reply)
 	}
 
 	/* find all <rpc-error>s */
-	result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc-reply/"NC_NS_BASE10_ID":rpc-error", reply->ctxt);
+	result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc-reply/"NC_NS_BASE10_ID":rpc-error", reply->ctxt);
 	if (result != NULL) {
 		for (i = 0; i < result->nodesetval->nodeNr; i++) {
 			/* error structure is not yet created */
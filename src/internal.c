@@ -65,6 +65,10 @@
 #	include <sys/shm.h>
 #endif
 
+#ifdef ENABLE_USDT
+#	include <sys/sdt.h>
+#endif
+
 #include <libxslt/xslt.h>
 #include <libxml/parser.h>
 
@@ -78,6 +82,8 @@ static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 int ncds_sysinit(int flags);
 void ncds_startup_internal(void);
 
+static void nc_xpath_cleanup(void);
+
 volatile uint8_t verbose_level = 0;
 
 /* this instance is running as first after reboot or system-wide nc_close */
@@ -89,18 +95,164 @@ API void nc_verbosity(NC_VERB_LEVEL level)
 	verbose_level = level;
 }
 
+#define PRV_MSG_SIZE 4096
+
+/* message waiting in the ring to be printed */
+struct verb_slot {
+	NC_VERB_LEVEL level;
+	char msg[PRV_MSG_SIZE];
+};
+
+/* ring of the messages printed asynchronously, see nc_verb_async() */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	struct verb_slot* slots; /* NULL if the messages are printed synchronously */
+	unsigned int size;
+	unsigned int head;
+	unsigned int count;
+	unsigned int dropped; /* messages not fitting into the full ring */
+	int stop;
+} verb_ring = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, NULL, 0, 0, 0, 0, 0};
+
+/*
+ * Store the message into the ring, the caller prints it synchronously if the
+ * asynchronous printing is not running.
+ */
+static int verb_async_push(NC_VERB_LEVEL level, const char *format, va_list args)
+{
+	struct verb_slot* slot;
+
+	pthread_mutex_lock(&verb_ring.lock);
+	if (verb_ring.slots == NULL || verb_ring.stop) {
+		pthread_mutex_unlock(&verb_ring.lock);
+		return (EXIT_FAILURE);
+	}
+
+	if (verb_ring.count == verb_ring.size) {
+		verb_ring.dropped++;
+	} else {
+		slot = &(verb_ring.slots[(verb_ring.head + verb_ring.count) % verb_ring.size]);
+		slot->level = level;
+		vsnprintf(slot->msg, PRV_MSG_SIZE, format, args);
+		verb_ring.count++;
+		pthread_cond_signal(&verb_ring.cond);
+	}
+	pthread_mutex_unlock(&verb_ring.lock);
+
+	return (EXIT_SUCCESS);
+}
+
+static void* verb_async_thread(void* UNUSED(arg))
+{
+	struct verb_slot slot;
+	unsigned int dropped;
+	int msg;
+	void (*print)(NC_VERB_LEVEL level, const char* msg);
+
+	pthread_mutex_lock(&verb_ring.lock);
+	while (1) {
+		while (verb_ring.count == 0 && verb_ring.dropped == 0 && !verb_ring.stop) {
+			pthread_cond_wait(&verb_ring.cond, &verb_ring.lock);
+		}
+		if (verb_ring.count == 0 && verb_ring.dropped == 0) {
+			/* stopped and everything printed */
+			break;
+		}
+
+		/* the dropped messages are reported after the ones stored before them */
+		dropped = 0;
+		if ((msg = (verb_ring.count > 0))) {
+			slot.level = verb_ring.slots[verb_ring.head].level;
+			strcpy(slot.msg, verb_ring.slots[verb_ring.head].msg);
+			verb_ring.head = (verb_ring.head + 1) % verb_ring.size;
+			verb_ring.count--;
+		} else {
+			dropped = verb_ring.dropped;
+			verb_ring.dropped = 0;
+		}
+		pthread_mutex_unlock(&verb_ring.lock);
+
+		/* the callback may be changed meanwhile */
+		if ((print = callbacks.print) != NULL) {
+			if (msg) {
+				print(slot.level, slot.msg);
+			}
+			if (dropped) {
+				snprintf(slot.msg, PRV_MSG_SIZE, "%u messages dropped, the ring of the asynchronous printing was full.", dropped);
+				print(NC_VERB_WARNING, slot.msg);
+			}
+		}
+
+		pthread_mutex_lock(&verb_ring.lock);
+	}
+	pthread_mutex_unlock(&verb_ring.lock);
+
+	return (NULL);
+}
+
+API int nc_verb_async(unsigned int slots)
+{
+	struct verb_slot* ring;
+	int r;
+
+	/* stop the current printing thread, it prints all the waiting messages */
+	pthread_mutex_lock(&verb_ring.lock);
+	if (verb_ring.slots != NULL && !verb_ring.stop) {
+		verb_ring.stop = 1;
+		pthread_cond_signal(&verb_ring.cond);
+		pthread_mutex_unlock(&verb_ring.lock);
+
+		pthread_join(verb_ring.thread, NULL);
+
+		pthread_mutex_lock(&verb_ring.lock);
+		free(verb_ring.slots);
+		verb_ring.slots = NULL;
+		verb_ring.stop = 0;
+	}
+	pthread_mutex_unlock(&verb_ring.lock);
+
+	if (slots == 0) {
+		return (EXIT_SUCCESS);
+	}
+
+	if ((ring = malloc(slots * sizeof(struct verb_slot))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&verb_ring.lock);
+	verb_ring.size = slots;
+	verb_ring.head = verb_ring.count = verb_ring.dropped = 0;
+	if ((r = pthread_create(&verb_ring.thread, NULL, verb_async_thread, NULL)) != 0) {
+		pthread_mutex_unlock(&verb_ring.lock);
+		free(ring);
+		ERROR("Creating the thread printing the messages failed (%s).", strerror(r));
+		return (EXIT_FAILURE);
+	}
+	verb_ring.slots = ring;
+	pthread_mutex_unlock(&verb_ring.lock);
+
+	return (EXIT_SUCCESS);
+}
+
 static void prv_vprintf(NC_VERB_LEVEL level, const char *format, va_list args)
 {
-#define PRV_MSG_SIZE 4096
 	char prv_msg[PRV_MSG_SIZE];
 
-	if (callbacks.print != NULL) {
-		vsnprintf(prv_msg, PRV_MSG_SIZE - 1, format, args);
-		prv_msg[PRV_MSG_SIZE - 1] = '\0';
-		callbacks.print(level, prv_msg);
+	if (callbacks.print == NULL) {
+		return;
+	}
 
+	/* unlocked check, the ring is rechecked when the message is stored */
+	if (verb_ring.slots != NULL && verb_async_push(level, format, args) == EXIT_SUCCESS) {
+		return;
 	}
-#undef PRV_MSG_SIZE
+
+	vsnprintf(prv_msg, PRV_MSG_SIZE - 1, format, args);
+	prv_msg[PRV_MSG_SIZE - 1] = '\0';
+	callbacks.print(level, prv_msg);
 }
 
 void prv_printf(NC_VERB_LEVEL level, const char *format, ...)
@@ -149,6 +301,127 @@ static int shmid = -1;
 
 int nc_init_flags = 0;
 
+/* trace of the RPC processed by the thread, see nc_trace_attach() */
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+static void trace_key_init(void)
+{
+	pthread_key_create(&trace_key, NULL);
+}
+
+uint64_t nc_trace_now(void)
+{
+	struct timespec ts;
+
+#ifndef ENABLE_USDT
+	if (callbacks.rpc_trace == NULL && !(nc_init_flags & NC_INIT_METRICS)) {
+		return (0);
+	}
+#endif
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+struct nc_rpc_trace* nc_trace_new(uint64_t start)
+{
+	struct nc_rpc_trace* trace;
+
+	if ((trace = calloc(1, sizeof(struct nc_rpc_trace))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	trace->start = start;
+
+	return (trace);
+}
+
+void nc_trace_add(struct nc_rpc_trace* trace, NC_TRACE_PHASE phase, uint64_t since)
+{
+	uint64_t now;
+
+	if (trace == NULL || since == 0 || (now = nc_trace_now()) == 0) {
+		return;
+	}
+
+	trace->phases[phase] += now - since;
+#ifdef ENABLE_USDT
+	DTRACE_PROBE3(libnetconf, rpc_phase, trace->session_id, phase, now - since);
+#endif
+}
+
+void nc_trace_attach(struct nc_rpc_trace* trace)
+{
+	pthread_once(&trace_key_once, trace_key_init);
+	pthread_setspecific(trace_key, trace);
+}
+
+uint64_t nc_trace_begin(void)
+{
+	pthread_once(&trace_key_once, trace_key_init);
+	if (pthread_getspecific(trace_key) == NULL) {
+		return (0);
+	}
+
+	return (nc_trace_now());
+}
+
+void nc_trace_end(NC_TRACE_PHASE phase, uint64_t since)
+{
+	if (since == 0) {
+		return;
+	}
+
+	nc_trace_add(pthread_getspecific(trace_key), phase, since);
+}
+
+void nc_trace_finish(struct nc_rpc_trace* trace, const struct nc_msg* rpc, uint64_t since)
+{
+	uint64_t now;
+
+	if (trace == NULL || trace->total != 0 || (now = nc_trace_now()) == 0) {
+		/* not traced or already reported (the rpc replied repeatedly) */
+		return;
+	}
+
+	nc_trace_add(trace, NC_TRACE_REPLY, since);
+	trace->msgid = rpc->msgid;
+	trace->op = rpc->op;
+	trace->total = now - trace->start;
+
+#ifdef ENABLE_USDT
+	DTRACE_PROBE4(libnetconf, rpc_done, trace->session_id, trace->msgid, trace->op, trace->total);
+#endif
+	nc_metrics_rpc(trace);
+	if (callbacks.rpc_trace != NULL) {
+		callbacks.rpc_trace(trace);
+	}
+}
+
+/*
+ * Get the command name of the calling process, the comm buffer must have
+ * at least NC_APPS_COMM_MAX+1 bytes. Empty string is returned on error.
+ */
+static void nc_apps_comm(char* comm)
+{
+	int fd, r;
+
+	comm[0] = '\0';
+	fd = open("/proc/self/comm", O_RDONLY);
+	if (fd != -1) {
+		r = read(fd, comm, NC_APPS_COMM_MAX);
+		close(fd);
+		if (r > 0) {
+			if (comm[r-1] == '\n') {
+				comm[r-1] = '\0';
+			} else {
+				comm[r] = '\0';
+			}
+		}
+	}
+}
+
 static void nc_apps_add(const char* comm, struct nc_apps* apps) {
 	int i;
 
@@ -267,7 +540,9 @@ static int nc_shared_cleanup(int del_shm) {
 		DBG("Failed to open semaphore directory \"/dev/shm\" (%s).", strerror(errno));
 	} else {
 		while ((dr = readdir(dir))) {
-			if (strncmp(dr->d_name, lock_prefix, strlen(lock_prefix)) == 0) {
+			/* semaphores and shared memory locks of the file datastores */
+			if (strncmp(dr->d_name, lock_prefix, strlen(lock_prefix)) == 0 ||
+					strncmp(dr->d_name, NCDS_LOCK + 1, strlen(NCDS_LOCK) - 1) == 0) {
 				sprintf(path, "/dev/shm/%s", dr->d_name);
 				if (unlink(path) == -1) {
 					DBG("Failed to remove semaphore \"%s\" (%s).", path, strerror(errno));
@@ -301,12 +576,14 @@ static int nc_shared_cleanup(int del_shm) {
 
 API int nc_init(int flags)
 {
-	int retval = 0, r, init_shm = 1, fd;
+	int retval = 0, r, init_shm = 1;
 	char* t, my_comm[NC_APPS_COMM_MAX+1];
 	pthread_rwlockattr_t rwlockattr;
 	mode_t mask;
 #ifndef POSIX_SHM
 	key_t key = -4;
+#else
+	int fd;
 #endif
 
 	if (nc_init_flags & NC_INIT_DONE) {
@@ -322,8 +599,8 @@ API int nc_init(int flags)
 	}
 #endif
 
-	if (flags == NC_INIT_CLIENT) {
-		nc_init_flags |= NC_INIT_CLIENT;
+	if ((flags & ~NC_INIT_DEFLATE) == NC_INIT_CLIENT) {
+		nc_init_flags |= flags;
 		return (retval);
 	}
 
@@ -402,19 +679,7 @@ API int nc_init(int flags)
 #endif /* #ifndef POSIX_SHM */
 
 		/* get my comm */
-		my_comm[0] = '\0';
-		fd = open("/proc/self/comm", O_RDONLY);
-		if (fd != -1) {
-			r = read(fd, my_comm, NC_APPS_COMM_MAX);
-			close(fd);
-			if (r > 0) {
-				if (my_comm[r-1] == '\n') {
-					my_comm[r-1] = '\0';
-				} else {
-					my_comm[r] = '\0';
-				}
-			}
-		}
+		nc_apps_comm(my_comm);
 
 		if (init_shm) {
 			/* we created the shared memory, consider first even for single-layer */
@@ -526,6 +791,12 @@ API int nc_init(int flags)
 	if (flags & NC_INIT_KEEPALIVECHECK) {
 		nc_init_flags |= NC_INIT_KEEPALIVECHECK;
 	}
+	if (flags & NC_INIT_METRICS) {
+		nc_init_flags |= NC_INIT_METRICS;
+	}
+	if (flags & NC_INIT_DEFLATE) {
+		nc_init_flags |= NC_INIT_DEFLATE;
+	}
 
 	if (nc_init_flags & NC_INIT_DATASTORES) {
 		/*
@@ -603,33 +874,26 @@ API int nc_init(int flags)
 
 API int nc_close(void)
 {
-	int retval = 0, i, fd;
+	int retval = 0;
 	char my_comm[NC_APPS_COMM_MAX+1];
 
+	/* print the messages waiting in the ring */
+	nc_verb_async(0);
+
 #ifndef DISABLE_LIBSSH
 	if (nc_init_flags & NC_INIT_LIBSSH_PTHREAD) {
 		ssh_finalize();
 	}
 #endif
 
+	nc_session_pool_cleanup();
+
 	if (nc_init_flags & NC_INIT_CLIENT) {
 		return (retval);
 	}
 
 	/* get my comm */
-	my_comm[0] = '\0';
-	fd = open("/proc/self/comm", O_RDONLY);
-	if (fd != -1) {
-		i = read(fd, my_comm, NC_APPS_COMM_MAX);
-		close(fd);
-		if (i > 0) {
-			if (my_comm[i-1] == '\n') {
-				my_comm[i-1] = '\0';
-			} else {
-				my_comm[i] = '\0';
-			}
-		}
-	}
+	nc_apps_comm(my_comm);
 
 	nc_init_flags |= NC_INIT_CLOSING;
 
@@ -666,6 +930,9 @@ API int nc_close(void)
 		nc_session_monitoring_close();
 	}
 
+	/* forget server capabilities, they are computed from the datastores */
+	nc_server_hello_cleanup();
+
 	/* close all remaining datastores */
 	if (nc_init_flags & NC_INIT_DATASTORES) {
 		ncds_cleanall();
@@ -682,6 +949,8 @@ API int nc_close(void)
 		nacm_close();
 	}
 
+	nc_msg_pool_cleanup();
+	nc_xpath_cleanup();
 	xsltCleanupGlobals();
 	xmlCleanupParser();
 
@@ -689,6 +958,192 @@ API int nc_close(void)
 	return (retval);
 }
 
+API int nc_init_forked(void)
+{
+	char my_comm[NC_APPS_COMM_MAX+1];
+
+	if (!(nc_init_flags & NC_INIT_DONE) || (nc_init_flags & NC_INIT_CLIENT)) {
+		ERROR("%s: libnetconf server is not initiated.", __func__);
+		return (-1);
+	}
+
+	/* register this process as another participant */
+	if (nc_info != NULL) {
+		nc_apps_comm(my_comm);
+
+		/* LOCK */
+		pthread_rwlock_wrlock(&(nc_info->lock));
+		nc_info->stats.participants++;
+		nc_apps_add(my_comm, &(nc_info->apps));
+		/* UNLOCK */
+		pthread_rwlock_unlock(&(nc_info->lock));
+	}
+
+#ifndef DISABLE_NOTIFICATIONS
+	/*
+	 * the stream files are accessed via the descriptors (and so the file
+	 * offsets) shared with the parent, open the streams again
+	 */
+	if (nc_init_flags & NC_INIT_NOTIF) {
+		ncntf_close();
+		if (ncntf_init() != EXIT_SUCCESS) {
+			nc_init_flags &= ~NC_INIT_NOTIF;
+			return (-1);
+		}
+	}
+#endif
+
+	return (0);
+}
+
+/**
+ * @brief Number of the hash chains of the interned strings.
+ */
+#define NC_INTERN_BUCKETS 1024
+
+struct nc_intern_item {
+	struct nc_intern_item *next;
+	unsigned int hash;
+	size_t len;
+	char str[1];
+};
+
+static struct nc_intern_item *intern_table[NC_INTERN_BUCKETS];
+static pthread_mutex_t intern_mut = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* nc_str_intern_find(const char* str, size_t len, int add)
+{
+	struct nc_intern_item *item;
+	unsigned int hash = 5381;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash = hash * 33 + (unsigned char) str[i];
+	}
+
+	pthread_mutex_lock(&intern_mut);
+	for (item = intern_table[hash % NC_INTERN_BUCKETS]; item != NULL; item = item->next) {
+		if (item->hash == hash && item->len == len && memcmp(item->str, str, len) == 0) {
+			break;
+		}
+	}
+	if (item == NULL && add) {
+		if ((item = malloc(sizeof(struct nc_intern_item) + len)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		} else {
+			item->hash = hash;
+			item->len = len;
+			memcpy(item->str, str, len);
+			item->str[len] = '\0';
+			item->next = intern_table[hash % NC_INTERN_BUCKETS];
+			intern_table[hash % NC_INTERN_BUCKETS] = item;
+		}
+	}
+	pthread_mutex_unlock(&intern_mut);
+
+	return ((item == NULL) ? NULL : item->str);
+}
+
+const char* nc_str_intern(const char* str, size_t len)
+{
+	return (nc_str_intern_find(str, len, 1));
+}
+
+const char* nc_str_interned(const char* str, size_t len)
+{
+	return (nc_str_intern_find(str, len, 0));
+}
+
+/**
+ * @brief Number of the hash chains of the compiled XPath expressions.
+ */
+#define NC_XPATH_BUCKETS 256
+
+struct nc_xpath_item {
+	struct nc_xpath_item *next;
+	unsigned int hash;
+	xmlXPathCompExprPtr comp;
+	char expr[1];
+};
+
+static struct nc_xpath_item *xpath_table[NC_XPATH_BUCKETS];
+static pthread_rwlock_t xpath_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static struct nc_xpath_item* nc_xpath_find(const char* expr, unsigned int hash)
+{
+	struct nc_xpath_item *item;
+
+	for (item = xpath_table[hash % NC_XPATH_BUCKETS]; item != NULL; item = item->next) {
+		if (item->hash == hash && strcmp(item->expr, expr) == 0) {
+			break;
+		}
+	}
+
+	return (item);
+}
+
+xmlXPathObjectPtr nc_xpath_eval(const char* expr, xmlXPathContextPtr ctxt)
+{
+	struct nc_xpath_item *item;
+	unsigned int hash = 5381;
+	const char* c;
+	size_t len;
+
+	for (c = expr; *c != '\0'; c++) {
+		hash = hash * 33 + (unsigned char) *c;
+	}
+	len = c - expr;
+
+	pthread_rwlock_rdlock(&xpath_lock);
+	item = nc_xpath_find(expr, hash);
+	pthread_rwlock_unlock(&xpath_lock);
+
+	if (item == NULL) {
+		pthread_rwlock_wrlock(&xpath_lock);
+		if ((item = nc_xpath_find(expr, hash)) == NULL) {
+			if ((item = malloc(sizeof(struct nc_xpath_item) + len)) == NULL) {
+				ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			} else if ((item->comp = xmlXPathCompile(BAD_CAST expr)) == NULL) {
+				/* invalid expression, let libxml2 report the error below */
+				free(item);
+				item = NULL;
+			} else {
+				item->hash = hash;
+				memcpy(item->expr, expr, len + 1);
+				item->next = xpath_table[hash % NC_XPATH_BUCKETS];
+				xpath_table[hash % NC_XPATH_BUCKETS] = item;
+			}
+		}
+		pthread_rwlock_unlock(&xpath_lock);
+
+		if (item == NULL) {
+			return (xmlXPathEvalExpression(BAD_CAST expr, ctxt));
+		}
+	}
+
+	/* compiled expressions are not modified by the evaluation */
+	return (xmlXPathCompiledEval(item->comp, ctxt));
+}
+
+/**
+ * @brief Free all the compiled XPath expressions.
+ */
+static void nc_xpath_cleanup(void)
+{
+	struct nc_xpath_item *item;
+	int i;
+
+	pthread_rwlock_wrlock(&xpath_lock);
+	for (i = 0; i < NC_XPATH_BUCKETS; i++) {
+		while ((item = xpath_table[i]) != NULL) {
+			xpath_table[i] = item->next;
+			xmlXPathFreeCompExpr(item->comp);
+			free(item);
+		}
+	}
+	pthread_rwlock_unlock(&xpath_lock);
+}
+
 char* nc_clrwspace (const char* in)
 {
 	int i, j = 0, len = strlen(in);
@@ -756,6 +1211,73 @@ void nc_clip_occurences_with(char *str, char sought, char replacement)
 	}
 }
 
+#define NC_ARENA_BLOCK_SIZE 8192
+
+struct nc_arena_block {
+	struct nc_arena_block* next;
+	size_t size;
+	size_t used;
+	/* keep the data aligned for any type */
+	union {
+		long double ld;
+		void* p;
+		long long ll;
+	} data[];
+};
+
+void* nc_arena_alloc(struct nc_arena* arena, size_t size)
+{
+	struct nc_arena_block* block;
+	size_t align = sizeof(block->data[0]), block_size;
+	void* retval;
+
+	size = (size + align - 1) / align * align;
+	if ((block = arena->blocks) == NULL || block->size - block->used < size) {
+		/* oversized requests get their own block */
+		block_size = (size > NC_ARENA_BLOCK_SIZE) ? size : NC_ARENA_BLOCK_SIZE;
+		if ((block = malloc(sizeof(struct nc_arena_block) + block_size)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (NULL);
+		}
+		block->size = block_size;
+		block->used = 0;
+		if (arena->blocks != NULL && size > NC_ARENA_BLOCK_SIZE) {
+			/* do not waste the rest of the current block */
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		} else {
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+	}
+
+	retval = (char*)block->data + block->used;
+	block->used += size;
+	return (retval);
+}
+
+char* nc_arena_strndup(struct nc_arena* arena, const char* str, size_t len)
+{
+	char* retval;
+
+	if ((retval = nc_arena_alloc(arena, len + 1)) == NULL) {
+		return (NULL);
+	}
+	memcpy(retval, str, len);
+	retval[len] = '\0';
+	return (retval);
+}
+
+void nc_arena_free(struct nc_arena* arena)
+{
+	struct nc_arena_block* block;
+
+	while ((block = arena->blocks) != NULL) {
+		arena->blocks = block->next;
+		free(block);
+	}
+}
+
 char** nc_get_grouplist(const char* username)
 {
 	struct passwd* p;
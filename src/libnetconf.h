@@ -428,7 +428,17 @@
  * When the NETCONF rpc is sent, use nc_session_recv_reply() to receive the
  * reply. To learn when the reply is coming, a file descriptor of the
  * communication channel can be checked by poll(), select(), ... This descriptor
- * can be obtained via nc_session_get_eventfd() function.
+ * can be obtained via nc_session_get_eventfd() function.\n
+ * Several threads can share one session with many requests in flight - send
+ * them by nc_session_send_rpc_async() and receive each reply by
+ * nc_session_recv_reply_async() with the message-id of its request. The
+ * incoming messages are read by one of the waiting threads or by the reader
+ * thread started with nc_session_reader_start().
+ * Instead of waiting, the controllers driving many sessions from an event
+ * loop send the requests by nc_session_send_rpc_clb() and call
+ * nc_session_process() when the session's file descriptor is readable, which
+ * calls the completion callback with the reply of each request (and the
+ * callback set by nc_session_notif_clb() with each notification).
  * -# **Close the NETCONF session**.\n
  * When the communication is done, the NETCONF session should be freed (session
  * is also properly closed) via  nc_session_free() function.
@@ -585,6 +595,11 @@
  * -# **Close the libnetconf instance**\n
  * Close internal libnetconf structures and subsystems by the nc_close() call.
  *
+ * Server spawning a process for each NETCONF session can avoid repeating the
+ * initiation steps in every process. It prepares libnetconf and all the
+ * datastores once and forks its children, which just call nc_init_forked()
+ * and continue with accepting the session.
+ *
  */
 
 /**
@@ -626,6 +641,12 @@
  * again, but the changed parameters will be applied only to the newly created
  * NETCONF sessions.
  *
+ * The TLS context remembers the TLS session of each server it connected to and
+ * resumes it on the next connection to the same host, which saves the full
+ * handshake when reconnecting. On the server side, prepare the SSL context by
+ * nc_tls_server_ctx_setup() to allow it. The ciphers and curves can be tuned
+ * by nc_tls_set_preferences().
+ *
  * To properly clean all resources, call nc_tls_destroy(). It will destroy
  * TLS connection context. This function can be called despite the running
  * NETCONF session, but creating a new NETCONF session over TLS is not allowed
@@ -1323,6 +1344,12 @@
  * \brief libnetconf's implementation of transaction-based partial device reconfiguration.
  */
 
+/**
+ * \defgroup metrics Metrics
+ * \brief libnetconf's registry of the server side processing metrics for the
+ * capacity planning, enabled by the NC_INIT_METRICS flag of nc_init().
+ */
+
 /**
  * \internal
  * \defgroup internalAPI Internal API
@@ -1340,6 +1367,7 @@
 #include "datastore/custom/datastore_custom.h"
 #include "with_defaults.h"
 #include "transport.h"
+#include "metrics.h"
 
 #ifndef DISABLE_NOTIFICATIONS
 #  include "notifications.h"
@@ -114,6 +114,44 @@ struct nc_session *nc_session_accept_tls(const struct nc_cpblts* capabilities, c
  */
 void nc_tls_destroy(void);
 
+/**
+ * @ingroup tls
+ * @brief Set the cipher and curve preferences of the TLS connections.
+ *
+ * The preferences are used by the TLS contexts created by nc_tls_init()
+ * (including the current thread's one) and by nc_tls_server_ctx_setup(). By
+ * default, the AES-GCM and ChaCha20-Poly1305 ciphers with ECDHE key exchange
+ * are preferred.
+ *
+ * @param[in] ciphers Cipher list in the OpenSSL format (see
+ * SSL_CTX_set_cipher_list()). NULL to use the default list.
+ * @param[in] curves Colon separated list of the curves for ECDHE (e.g.
+ * "X25519:P-256"), requires OpenSSL 1.0.2 or later. NULL to use the default
+ * list.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int nc_tls_set_preferences(const char* ciphers, const char* curves);
+
+/**
+ * @ingroup tls
+ * @brief Prepare server's SSL context for resuming the TLS sessions.
+ *
+ * The clients reconnecting to the server can then resume their previous TLS
+ * session (using the session ID or the session ticket) instead of the full
+ * handshake. The client side caches the sessions of its servers automatically
+ * (per the server host in each thread's TLS context created by nc_tls_init()).
+ *
+ * The function also applies the preferences set by nc_tls_set_preferences()
+ * and makes the server choose the cipher according to them. Call it before
+ * creating SSL structures for nc_session_accept_tls() from the context.
+ *
+ * @param[in] tls_ctx Server's SSL context.
+ * @param[in] session_timeout Lifetime of the resumable sessions in seconds, 0
+ * to keep the OpenSSL default.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int nc_tls_server_ctx_setup(SSL_CTX* tls_ctx, long session_timeout);
+
 #ifdef __cplusplus
 }
 #endif
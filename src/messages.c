@@ -67,6 +67,80 @@
 
 static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
+/* maximal number of the freed message structures kept for reuse */
+#define NC_MSG_POOL_SIZE 64
+
+/* freed message structures with their XPath contexts, linked via next */
+static struct nc_msg* msg_pool = NULL;
+static int msg_pool_count = 0;
+static pthread_mutex_t msg_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct nc_msg* nc_msg_new(xmlDocPtr doc)
+{
+	struct nc_msg* msg;
+	xmlXPathContextPtr ctxt;
+
+	pthread_mutex_lock(&msg_pool_lock);
+	if ((msg = msg_pool) != NULL) {
+		msg_pool = msg->next;
+		msg_pool_count--;
+	}
+	pthread_mutex_unlock(&msg_pool_lock);
+
+	if (msg != NULL) {
+		/* reuse the context with the namespaces already registered */
+		ctxt = msg->ctxt;
+		memset(msg, 0, sizeof(struct nc_msg));
+		ctxt->doc = doc;
+		ctxt->node = NULL;
+		ctxt->namespaces = NULL;
+		ctxt->nsNr = 0;
+		msg->ctxt = ctxt;
+		msg->doc = doc;
+		msg->with_defaults = NCWD_MODE_NOTSET;
+		return (msg);
+	}
+
+	if ((msg = calloc(1, sizeof(struct nc_msg))) == NULL) {
+		ERROR("Memory allocation failed - %s (%s:%d).", strerror (errno), __FILE__, __LINE__);
+		return (NULL);
+	}
+	msg->doc = doc;
+	msg->with_defaults = NCWD_MODE_NOTSET;
+
+	/* create xpath evaluation context */
+	if ((msg->ctxt = xmlXPathNewContext(doc)) == NULL) {
+		ERROR("%s: rpc message XPath context cannot be created.", __func__);
+		free(msg);
+		return (NULL);
+	}
+
+	/* register base namespace for the rpc */
+	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_BASE10_ID, BAD_CAST NC_NS_BASE10) != 0) {
+		ERROR("Registering base namespace for the message xpath context failed.");
+		goto error;
+	}
+	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_NOTIFICATIONS_ID, BAD_CAST NC_NS_NOTIFICATIONS) != 0) {
+		ERROR("Registering notifications namespace for the message xpath context failed.");
+		goto error;
+	}
+	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_WITHDEFAULTS_ID, BAD_CAST NC_NS_WITHDEFAULTS) != 0) {
+		ERROR("Registering with-defaults namespace for the message xpath context failed.");
+		goto error;
+	}
+	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_MONITORING_ID, BAD_CAST NC_NS_MONITORING) != 0) {
+		ERROR("Registering monitoring namespace for the message xpath context failed.");
+		goto error;
+	}
+
+	return (msg);
+
+error:
+	xmlXPathFreeContext(msg->ctxt);
+	free(msg);
+	return (NULL);
+}
+
 /**
  * @brief Skip XML declaration in the beginning of an XML document
  *
@@ -271,59 +345,25 @@ API xmlDocPtr ncxml_rpc_dump(const nc_rpc* rpc)
 static struct nc_msg* nc_msg_build (const char* msg_dump)
 {
 	struct nc_msg * msg;
+	xmlDocPtr doc;
 	const char* id;
 
-	if ((msg = calloc (1, sizeof(struct nc_msg))) == NULL) {
-		ERROR("Memory allocation failed - %s (%s:%d).", strerror (errno), __FILE__, __LINE__);
-		return NULL;
-	}
-
-	if ((msg->doc = xmlReadMemory (msg_dump, strlen(msg_dump), NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
+	if ((doc = xmlReadMemory (msg_dump, strlen(msg_dump), NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
 		ERROR("%s: parsing message dump failed.", __func__);
-		free (msg);
 		return NULL;
 	}
 
-	/* create xpath evaluation context */
-	if ((msg->ctxt = xmlXPathNewContext(msg->doc)) == NULL) {
-		ERROR("%s: rpc message XPath context cannot be created.", __func__);
-		nc_msg_free(msg);
-		return NULL;
-	}
-	
-	/* register base namespace for the rpc */
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_BASE10_ID, BAD_CAST NC_NS_BASE10) != 0) {
-		ERROR("Registering base namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_NOTIFICATIONS_ID, BAD_CAST NC_NS_NOTIFICATIONS) != 0) {
-		ERROR("Registering notifications namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_WITHDEFAULTS_ID, BAD_CAST NC_NS_WITHDEFAULTS) != 0) {
-		ERROR("Registering with-defaults namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_MONITORING_ID, BAD_CAST NC_NS_MONITORING) != 0) {
-		ERROR("Registering monitoring namespace for the message xpath context failed.");
-		nc_msg_free(msg);
+	if ((msg = nc_msg_new(doc)) == NULL) {
+		xmlFreeDoc(doc);
 		return NULL;
 	}
 
 	if ((id = nc_msg_parse_msgid (msg)) != NULL) {
 		msg->msgid = strdup(id);
-	} else {
-		msg->msgid = NULL;
 	}
-	msg->error = NULL;
-	msg->with_defaults = NCWD_MODE_NOTSET;
 
 	/* NACM is set to NULL by default, if it is needed, caller (such as
 	 * nc_rpc_build() should store fresh NACM information */
-	msg->nacm = NULL;
 
 	return msg;
 }
@@ -333,49 +373,12 @@ static struct nc_msg* ncxml_msg_build(xmlDocPtr msg_dump)
 	struct nc_msg* msg;
 	const char* id;
 
-	if ((msg = malloc(sizeof(struct nc_msg))) == NULL) {
+	if ((msg = nc_msg_new(msg_dump)) == NULL) {
 		return NULL;
 	}
 
-	msg->doc = msg_dump;
-	msg->next = NULL;
-	msg->error = NULL;
-	msg->with_defaults = NCWD_MODE_NOTSET;
-	msg->type.rpc = 0;
-
 	if ((id = nc_msg_parse_msgid (msg)) != NULL) {
 		msg->msgid = strdup(id);
-	} else {
-		msg->msgid = NULL;
-	}
-
-	/* create xpath evaluation context */
-	if ((msg->ctxt = xmlXPathNewContext(msg->doc)) == NULL) {
-		ERROR("%s: rpc message XPath context cannot be created.", __func__);
-		nc_msg_free(msg);
-		return NULL;
-	}
-
-	/* register base namespace for the rpc */
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_BASE10_ID, BAD_CAST NC_NS_BASE10) != 0) {
-		ERROR("Registering base namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_NOTIFICATIONS_ID, BAD_CAST NC_NS_NOTIFICATIONS) != 0) {
-		ERROR("Registering notifications namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_WITHDEFAULTS_ID, BAD_CAST NC_NS_WITHDEFAULTS) != 0) {
-		ERROR("Registering with-defaults namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_MONITORING_ID, BAD_CAST NC_NS_MONITORING) != 0) {
-		ERROR("Registering monitoring namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
 	}
 
 	return (msg);
@@ -410,7 +413,7 @@ NCWD_MODE nc_rpc_parse_withdefaults(nc_rpc* rpc, const struct nc_session* sessio
 	}
 
 	/* set with-defaults if any */
-	if ((result = xmlXPathEvalExpression(BAD_CAST "//wd:with-defaults", rpc_ctxt)) != NULL) {
+	if ((result = nc_xpath_eval("//wd:with-defaults", rpc_ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(result->nodesetval)) {
 			switch (result->nodesetval->nodeNr) {
 			case 0:
@@ -566,13 +569,13 @@ NC_REPLY_TYPE nc_reply_parse_type(nc_reply* reply)
 	reply->type.reply = NC_REPLY_UNKNOWN;
 
 	/* try to detect the type from the message body */
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc-reply/"NC_NS_BASE10_ID":ok", reply->ctxt)) != NULL) {
+	if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc-reply/"NC_NS_BASE10_ID":ok", reply->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval) && query_result->nodesetval->nodeNr == 1) {
 			reply->type.reply = NC_REPLY_OK;
 		}
 		xmlXPathFreeObject(query_result);
 	}
-	if (reply->type.reply == NC_REPLY_UNKNOWN && (query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc-reply/"NC_NS_BASE10_ID":rpc-error", reply->ctxt)) != NULL) {
+	if (reply->type.reply == NC_REPLY_UNKNOWN && (query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc-reply/"NC_NS_BASE10_ID":rpc-error", reply->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			reply->type.reply = NC_REPLY_ERROR;
 			nc_err_parse(reply);
@@ -580,7 +583,7 @@ NC_REPLY_TYPE nc_reply_parse_type(nc_reply* reply)
 		xmlXPathFreeObject(query_result);
 	}
 	/* NOTE: data element's namespace can vary (e.g. for get-schema) */
-	if (reply->type.reply == NC_REPLY_UNKNOWN && (query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc-reply", reply->ctxt)) != NULL) {
+	if (reply->type.reply == NC_REPLY_UNKNOWN && (query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc-reply", reply->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval) && query_result->nodesetval->nodeNr == 1) {
 			for (node = query_result->nodesetval->nodeTab[0]->children; node != NULL; node = node->next) {
 				if (node->type != XML_ELEMENT_NODE) {
@@ -846,7 +849,7 @@ API char* nc_rpc_get_op_content(const nc_rpc* rpc)
 		return NULL;
 	}
 
-	if ((result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/*", rpc->ctxt)) != NULL) {
+	if ((result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/*", rpc->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(result->nodesetval)) {
 			buffer = xmlBufferCreate();
 			if (buffer == NULL) {
@@ -950,7 +953,7 @@ NC_DATASTORE nc_rpc_assign_ds(nc_rpc* rpc, const char* ds_type)
 	}
 
 	for (i = 0; i < nc_rpc_get_ds_RETVALS_COUNT; i++) {
-		if ((query_result = xmlXPathEvalExpression(BAD_CAST queries[i], rpc->ctxt)) != NULL) {
+		if ((query_result = nc_xpath_eval(queries[i], rpc->ctxt)) != NULL) {
 			if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval) && query_result->nodesetval->nodeNr == 1) {
 				retval = retvals[i];
 				xmlXPathFreeObject(query_result);
@@ -1000,11 +1003,10 @@ static xmlNodePtr ncxml_rpc_get_cfg_common(const nc_rpc* rpc, xmlChar* query, ch
 #ifndef DISABLE_URL
 	NC_URL_PROTOCOLS protocol;
 	xmlChar* url_string;
-	int url_buff_fd;
 	xmlDocPtr url_doc = NULL;
 #endif
 
-	if ((query_result = xmlXPathEvalExpression(query, rpc->ctxt)) != NULL) {
+	if ((query_result = nc_xpath_eval((char*) query, rpc->ctxt)) != NULL) {
 		if (xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			//ERROR("%s: no source config data in the %s request", __func__, operation);
 			xmlXPathFreeObject(query_result);
@@ -1032,24 +1034,19 @@ static xmlNodePtr ncxml_rpc_get_cfg_common(const nc_rpc* rpc, xmlChar* query, ch
 				return (NULL);
 			}
 
-			/* get data from URL */
-			if ((url_buff_fd = nc_url_open((char*) (url_string = xmlNodeGetContent(config)))) < 0) {
-				xmlFree(url_string);
-				return (NULL);
-			}
+			/* get data from URL, they are parsed while being downloaded */
+			url_doc = nc_url_read_doc((char*) (url_string = xmlNodeGetContent(config)), NULL);
 			xmlFree(url_string);
-			if ((url_doc = xmlReadFd(url_buff_fd, NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL ) {
-				close(url_buff_fd);
-				ERROR("%s: error reading from downloaded URL file", __func__);
+			if (url_doc == NULL) {
+				ERROR("%s: error reading from the URL file", __func__);
 				return (NULL);
 			}
-			close(url_buff_fd);
 
 			/* config pointer is now silently moving from rpc->doc into url_doc! */
 			config = xmlDocGetRootElement(url_doc);
 
 			/* just check that content follows :url specification in RFC 6241 */
-			if (xmlStrcmp(BAD_CAST "config", config->name) != 0) {
+			if (config == NULL || xmlStrcmp(BAD_CAST "config", config->name) != 0) {
 				/* \todo check also namespace */
 				ERROR("%s: no config data in the downloaded URL file", __func__);
 				xmlFreeDoc(url_doc);
@@ -1342,7 +1339,7 @@ API NC_EDIT_DEFOP_TYPE nc_rpc_get_defop(const nc_rpc* rpc)
 	xmlNodePtr defop = NULL;
 	NC_EDIT_DEFOP_TYPE retval = NC_EDIT_DEFOP_NOTSET;
 
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":edit-config/"NC_NS_BASE10_ID":default-operation", rpc->ctxt)) != NULL) {
+	if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":edit-config/"NC_NS_BASE10_ID":default-operation", rpc->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
 				ERROR("%s: multiple default-operation elements found in edit-config request", __func__);
@@ -1379,7 +1376,7 @@ API NC_EDIT_ERROPT_TYPE nc_rpc_get_erropt(const nc_rpc* rpc)
 	xmlNodePtr erropt = NULL;
 	NC_EDIT_ERROPT_TYPE retval = NC_EDIT_ERROPT_NOTSET;
 
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":edit-config/"NC_NS_BASE10_ID":error-option", rpc->ctxt)) != NULL) {
+	if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":edit-config/"NC_NS_BASE10_ID":error-option", rpc->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
 				ERROR("%s: multiple error-option elements found in the edit-config request", __func__);
@@ -1416,7 +1413,7 @@ API NC_EDIT_TESTOPT_TYPE nc_rpc_get_testopt(const nc_rpc* rpc)
 	xmlNodePtr testopt = NULL;
 	NC_EDIT_TESTOPT_TYPE retval = NC_EDIT_TESTOPT_NOTSET;
 
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":edit-config/"NC_NS_BASE10_ID":test-option", rpc->ctxt)) != NULL) {
+	if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":edit-config/"NC_NS_BASE10_ID":test-option", rpc->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
 				ERROR("%s: multiple test-option elements found in the edit-config request", __func__);
@@ -1458,7 +1455,7 @@ API struct nc_filter* nc_rpc_get_filter(const nc_rpc* rpc)
 	query = "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":get/"NC_NS_BASE10_ID":filter | /"
 			NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":get-config/"NC_NS_BASE10_ID":filter | /"
 			NC_NS_BASE10_ID":rpc/"NC_NS_NOTIFICATIONS_ID":create-subscription/"NC_NS_NOTIFICATIONS_ID":filter";
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST query, rpc->ctxt)) != NULL) {
+	if ((query_result = nc_xpath_eval(query, rpc->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
 				ERROR("%s: multiple filter elements found", __func__);
@@ -1506,7 +1503,7 @@ API const char* nc_reply_get_data_ns(const nc_reply* reply)
 	const char* retval = NULL;
 
 	/* NOTE: <data> in rpc-reply can be in various namespaces (e.g. for get-schema) */
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc-reply", reply->ctxt)) != NULL) {
+	if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc-reply", reply->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
 				ERROR("%s: multiple rpc-reply elements found", __func__);
@@ -1546,7 +1543,7 @@ API char* nc_reply_get_data(const nc_reply* reply)
 	int gotdata = 0;
 
 	/* NOTE: <data> in rpc-reply can be in various namespaces (e.g. for get-schema) */
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc-reply", reply->ctxt)) != NULL) {
+	if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc-reply", reply->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
 				ERROR("%s: multiple rpc-reply elements found", __func__);
@@ -1609,7 +1606,7 @@ API xmlNodePtr ncxml_reply_get_data(const nc_reply *reply)
 	xmlXPathObjectPtr query_result = NULL;
 	xmlNodePtr data = NULL;
 
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc-reply/"NC_NS_BASE10_ID":data", reply->ctxt)) != NULL) {
+	if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc-reply/"NC_NS_BASE10_ID":data", reply->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
 				ERROR("%s: multiple data elements found", __func__);
@@ -1638,17 +1635,61 @@ API const char* nc_reply_get_errormsg(const nc_reply* reply)
 	return ((reply->error == NULL) ? NULL : reply->error->message);
 }
 
+/**
+ * @brief Drop the message's reference to its XML document, the document is
+ * freed with its last holder.
+ */
+static void nc_msg_doc_release(struct nc_msg* msg)
+{
+	if (msg->doc_refs == NULL) {
+		xmlFreeDoc(msg->doc);
+	} else if (__sync_sub_and_fetch(msg->doc_refs, 1) == 0) {
+		xmlFreeDoc(msg->doc);
+		free(msg->doc_refs);
+	}
+	msg->doc = NULL;
+	msg->doc_refs = NULL;
+}
+
+int nc_msg_doc_own(struct nc_msg* msg)
+{
+	xmlDocPtr doc;
+
+	if (msg->doc_refs == NULL) {
+		/* not shared */
+		return (EXIT_SUCCESS);
+	}
+
+	if (NC_STAT_GET(*(msg->doc_refs)) == 1) {
+		/* all the other holders are already gone */
+		free(msg->doc_refs);
+		msg->doc_refs = NULL;
+		return (EXIT_SUCCESS);
+	}
+
+	if ((doc = xmlCopyDoc(msg->doc, 1)) == NULL) {
+		ERROR("xmlCopyDoc failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	nc_msg_doc_release(msg);
+	msg->doc = doc;
+
+	/* keep the registered namespaces, just move the context to the copy */
+	if (msg->ctxt != NULL) {
+		msg->ctxt->doc = doc;
+		msg->ctxt->node = NULL;
+	}
+
+	return (EXIT_SUCCESS);
+}
+
 void nc_msg_free(struct nc_msg* msg)
 {
 	struct nc_err* e, *efree;
-	int i;
 
 	if (msg != NULL && msg != NCDS_RPC_NOT_APPLICABLE) {
 		if (msg->doc != NULL) {
-			xmlFreeDoc(msg->doc);
-		}
-		if (msg->ctxt != NULL) {
-			xmlXPathFreeContext(msg->ctxt);
+			nc_msg_doc_release(msg);
 		}
 		if ((e = msg->error) != NULL) {
 			while(e != NULL) {
@@ -1660,17 +1701,44 @@ void nc_msg_free(struct nc_msg* msg)
 		if (msg->msgid != NULL) {
 			free(msg->msgid);
 		}
-		if (msg->nacm != NULL) {
-			for (i = 0; msg->nacm->rule_lists != NULL && msg->nacm->rule_lists[i] != NULL; i++) {
-				nacm_rule_list_free(msg->nacm->rule_lists[i]);
+		nacm_rpc_free(msg->nacm);
+		free(msg->trace);
+
+		if (msg->ctxt != NULL) {
+			/* keep the structure with its context for the next message */
+			msg->ctxt->doc = NULL;
+			msg->ctxt->node = NULL;
+			pthread_mutex_lock(&msg_pool_lock);
+			if (msg_pool_count < NC_MSG_POOL_SIZE) {
+				msg->next = msg_pool;
+				msg_pool = msg;
+				msg_pool_count++;
+				msg = NULL;
+			}
+			pthread_mutex_unlock(&msg_pool_lock);
+			if (msg == NULL) {
+				return;
 			}
-			free(msg->nacm->rule_lists);
-			free(msg->nacm);
+			xmlXPathFreeContext(msg->ctxt);
 		}
 		free(msg);
 	}
 }
 
+void nc_msg_pool_cleanup(void)
+{
+	struct nc_msg* msg;
+
+	pthread_mutex_lock(&msg_pool_lock);
+	while ((msg = msg_pool) != NULL) {
+		msg_pool = msg->next;
+		xmlXPathFreeContext(msg->ctxt);
+		free(msg);
+	}
+	msg_pool_count = 0;
+	pthread_mutex_unlock(&msg_pool_lock);
+}
+
 API void nc_rpc_free(nc_rpc *rpc)
 {
 	nc_msg_free((struct nc_msg*) rpc);
@@ -1684,65 +1752,43 @@ API void nc_reply_free(nc_reply *reply)
 struct nc_msg *nc_msg_dup(struct nc_msg *msg)
 {
 	struct nc_msg *dupmsg;
+	unsigned int *refs;
 
 	if (msg == NULL || msg == NCDS_RPC_NOT_APPLICABLE || msg->doc == NULL) {
 		return (NULL);
 	}
 
-	dupmsg = calloc(1, sizeof(struct nc_msg));
-	dupmsg->doc = xmlCopyDoc(msg->doc, 1);
+	if ((dupmsg = nc_msg_new(NULL)) == NULL) {
+		return (NULL);
+	}
+
+	/*
+	 * share the document, the holders counter is created with the first
+	 * duplicate and it is set atomically since the duplicated message can be
+	 * a const one used by several threads
+	 */
+	if (msg->doc_refs == NULL) {
+		refs = malloc(sizeof(unsigned int));
+		*refs = 1;
+		if (!__sync_bool_compare_and_swap(&(msg->doc_refs), NULL, refs)) {
+			free(refs);
+		}
+	}
+	NC_STAT_INC(*(msg->doc_refs));
+	dupmsg->doc = msg->doc;
+	dupmsg->ctxt->doc = msg->doc;
+	dupmsg->doc_refs = msg->doc_refs;
 	dupmsg->type = msg->type;
 	dupmsg->with_defaults = msg->with_defaults;
 	dupmsg->op = msg->op;
 	dupmsg->source = msg->source;
 	dupmsg->target = msg->target;
-	if (msg->nacm != NULL) {
-		dupmsg->nacm = malloc(sizeof(struct nacm_rpc));
-		dupmsg->nacm->default_exec = msg->nacm->default_exec;
-		dupmsg->nacm->default_read = msg->nacm->default_read;
-		dupmsg->nacm->default_write = msg->nacm->default_write;
-		dupmsg->nacm->rule_lists = nacm_rule_lists_dup(msg->nacm->rule_lists);
-	} else {
-		dupmsg->nacm = NULL;
-	}
+	dupmsg->nacm = nacm_rpc_ref(msg->nacm);
 	if (msg->msgid != NULL) {
 		dupmsg->msgid = strdup(msg->msgid);
-	} else {
-		dupmsg->msgid = NULL;
 	}
 	if (msg->error != NULL) {
 		dupmsg->error = nc_err_dup(msg->error);
-	} else {
-		dupmsg->error = NULL;
-	}
-
-	/* create xpath evaluation context */
-	if ((dupmsg->ctxt = xmlXPathNewContext(dupmsg->doc)) == NULL) {
-		ERROR("%s: rpc message XPath context cannot be created.", __func__);
-		nc_msg_free(dupmsg);
-		return NULL;
-	}
-
-	/* register base namespace for the rpc */
-	if (xmlXPathRegisterNs(dupmsg->ctxt, BAD_CAST NC_NS_BASE10_ID, BAD_CAST NC_NS_BASE10) != 0) {
-		ERROR("Registering base namespace for the message xpath context failed.");
-		nc_msg_free(dupmsg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(dupmsg->ctxt, BAD_CAST NC_NS_NOTIFICATIONS_ID, BAD_CAST NC_NS_NOTIFICATIONS) != 0) {
-		ERROR("Registering notifications namespace for the message xpath context failed.");
-		nc_msg_free(dupmsg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(dupmsg->ctxt, BAD_CAST NC_NS_WITHDEFAULTS_ID, BAD_CAST NC_NS_WITHDEFAULTS) != 0) {
-		ERROR("Registering with-defaults namespace for the message xpath context failed.");
-		nc_msg_free(dupmsg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(dupmsg->ctxt, BAD_CAST NC_NS_MONITORING_ID, BAD_CAST NC_NS_MONITORING) != 0) {
-		ERROR("Registering monitoring namespace for the message xpath context failed.");
-		nc_msg_free(dupmsg);
-		return NULL;
 	}
 
 	return (dupmsg);
@@ -1801,45 +1847,10 @@ static struct nc_msg* nc_msg_create(const xmlNodePtr content, char* msgtype)
 		return NULL;
 	}
 
-	msg = calloc(1, sizeof(nc_rpc));
-	if (msg == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+	if ((msg = nc_msg_new(xmlmsg)) == NULL) {
+		xmlFreeDoc(xmlmsg);
 		return (NULL);
 	}
-	msg->doc = xmlmsg;
-	msg->msgid = NULL;
-	msg->error = NULL;
-	msg->with_defaults = NCWD_MODE_NOTSET;
-	msg->nacm = NULL;
-
-	/* create xpath evaluation context */
-	if ((msg->ctxt = xmlXPathNewContext(msg->doc)) == NULL) {
-		ERROR("%s: rpc message XPath context cannot be created.", __func__);
-		nc_msg_free(msg);
-		return NULL;
-	}
-
-	/* register base namespace for the rpc */
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_BASE10_ID, BAD_CAST NC_NS_BASE10) != 0) {
-		ERROR("Registering base namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_NOTIFICATIONS_ID, BAD_CAST NC_NS_NOTIFICATIONS) != 0) {
-		ERROR("Registering notifications namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_WITHDEFAULTS_ID, BAD_CAST NC_NS_WITHDEFAULTS) != 0) {
-		ERROR("Registering with-defaults namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
-	}
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_MONITORING_ID, BAD_CAST NC_NS_MONITORING) != 0) {
-		ERROR("Registering monitoring namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
-	}
 
 #ifdef HAVE_XMLDOMWRAPRECONCILENAMESPACE
 	/* remove duplicated namespace definitions */
@@ -1849,7 +1860,7 @@ static struct nc_msg* nc_msg_create(const xmlNodePtr content, char* msgtype)
 	return (msg);
 }
 
-API nc_reply* nc_reply_ok(void)
+static nc_reply* nc_reply_ok_create(void)
 {
 	nc_reply *reply;
 	xmlNodePtr content;
@@ -1865,12 +1876,129 @@ API nc_reply* nc_reply_ok(void)
 	xmlSetNs(content, ns);
 
 	reply = (nc_reply*)nc_msg_create(content,"rpc-reply");
-	reply->type.reply = NC_REPLY_OK;
+	if (reply != NULL) {
+		reply->type.reply = NC_REPLY_OK;
+	}
 	xmlFreeNode(content);
 
 	return (reply);
 }
 
+/*
+ * Immutable <ok/> reply shared by all the nc_reply_ok() results for the
+ * lifetime of the process. The reply_ok_text is its serialization split at
+ * the place of the message-id attribute value.
+ */
+static nc_reply* reply_ok_template = NULL;
+static char* reply_ok_text = NULL;
+static size_t reply_ok_text_head, reply_ok_text_tail;
+static pthread_once_t reply_ok_once = PTHREAD_ONCE_INIT;
+
+static int reply_ok_text_write(void* context, const char* buffer, int len)
+{
+	char** text = (char**)context;
+	size_t size = (*text == NULL) ? 0 : strlen(*text);
+	char* aux;
+
+	if ((aux = realloc(*text, size + len + 1)) == NULL) {
+		return (-1);
+	}
+	memcpy(aux + size, buffer, len);
+	aux[size + len] = '\0';
+	*text = aux;
+	return (len);
+}
+
+static void reply_ok_template_init(void)
+{
+	xmlDocPtr doc;
+	xmlOutputBufferPtr out;
+	char *text = NULL, *mark;
+
+	if ((reply_ok_template = nc_reply_ok_create()) == NULL) {
+		return;
+	}
+
+	/* serialize the reply the same way nc_session_send() does */
+	if ((doc = xmlCopyDoc(reply_ok_template->doc, 1)) == NULL) {
+		return;
+	}
+	xmlNewProp(xmlDocGetRootElement(doc), BAD_CAST "message-id", BAD_CAST "%");
+	if ((out = xmlOutputBufferCreateIO(reply_ok_text_write, NULL, &text, NULL)) == NULL) {
+		xmlFreeDoc(doc);
+		return;
+	}
+	if (xmlSaveFormatFileTo(out, doc, NULL, NC_CONTENT_FORMATTED) < 0 || text == NULL ||
+			(mark = strstr(text, "message-id=\"%\"")) == NULL) {
+		xmlFreeDoc(doc);
+		free(text);
+		return;
+	}
+	xmlFreeDoc(doc);
+
+	reply_ok_text_head = (mark - text) + strlen("message-id=\"");
+	reply_ok_text_tail = reply_ok_text_head + 1;
+	reply_ok_text = text;
+}
+
+API nc_reply* nc_reply_ok(void)
+{
+	pthread_once(&reply_ok_once, reply_ok_template_init);
+	if (reply_ok_template == NULL) {
+		return (nc_reply_ok_create());
+	}
+
+	/* share the document of the template, it is copied before any change */
+	return (nc_msg_dup(reply_ok_template));
+}
+
+char* nc_reply_ok_dump(const nc_reply* reply, const nc_rpc* rpc, size_t* len)
+{
+	xmlNodePtr rpc_root;
+	xmlAttrPtr attr;
+	xmlNsPtr ns;
+	const char* msgid, *c;
+	size_t msgid_len, tail_len;
+	char* text;
+
+	if (reply == NULL || rpc == NULL || reply_ok_text == NULL || reply->doc != reply_ok_template->doc ||
+			(rpc_root = xmlDocGetRootElement(rpc->doc)) == NULL) {
+		return (NULL);
+	}
+
+	/* only the message-id is copied from the rpc */
+	attr = rpc_root->properties;
+	if (attr == NULL || attr->next != NULL || attr->ns != NULL || !xmlStrEqual(attr->name, BAD_CAST "message-id") ||
+			attr->children == NULL || attr->children->type != XML_TEXT_NODE || attr->children->next != NULL) {
+		return (NULL);
+	}
+	for (ns = rpc_root->nsDef; ns != NULL; ns = ns->next) {
+		if (ns->prefix != NULL) {
+			return (NULL);
+		}
+	}
+
+	/* values needing escaping are serialized by libxml2 */
+	msgid = (const char*)attr->children->content;
+	for (c = msgid; *c != '\0'; c++) {
+		if (*c < 0x20 || *c > 0x7e || *c == '&' || *c == '<' || *c == '>' || *c == '"') {
+			return (NULL);
+		}
+	}
+
+	msgid_len = c - msgid;
+	tail_len = strlen(reply_ok_text + reply_ok_text_tail);
+	if ((text = malloc(reply_ok_text_head + msgid_len + tail_len + 1)) == NULL) {
+		return (NULL);
+	}
+	memcpy(text, reply_ok_text, reply_ok_text_head);
+	memcpy(text + reply_ok_text_head, msgid, msgid_len);
+	memcpy(text + reply_ok_text_head + msgid_len, reply_ok_text + reply_ok_text_tail, tail_len + 1);
+	*len = reply_ok_text_head + msgid_len + tail_len;
+
+	return (text);
+}
+
 API nc_reply *nc_reply_data(const char* data)
 {
 	return (nc_reply_data_ns(data, NC_NS_BASE10));
@@ -2098,6 +2226,9 @@ API int nc_reply_error_add(nc_reply *reply, struct nc_err* error)
 	if (reply->doc == NULL || reply->doc->children == NULL) {
 		return (EXIT_FAILURE);
 	}
+	if (nc_msg_doc_own(reply) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
 
 	/* prepare new <rpc-error> part */
 	if ((content = new_reply_error_content(error)) == NULL) {
@@ -2125,6 +2256,30 @@ API int nc_reply_error_add(nc_reply *reply, struct nc_err* error)
 	return (EXIT_SUCCESS);
 }
 
+/**
+ * @brief Get the \<data\> element of the data reply.
+ */
+static xmlNodePtr nc_reply_data_node(const nc_reply* reply)
+{
+	xmlNodePtr root, data;
+
+	/* NOTE: <data> in rpc-reply can be in various namespaces (e.g. for get-schema) */
+	root = xmlDocGetRootElement(reply->doc);
+	if (root == NULL || !xmlStrEqual(root->name, BAD_CAST "rpc-reply") ||
+			root->ns == NULL || !xmlStrEqual(root->ns->href, BAD_CAST NC_NS_BASE10)) {
+		ERROR("%s: no rpc-reply element found", __func__);
+		return (NULL);
+	}
+	for (data = root->children; data != NULL; data = data->next) {
+		if (data->type == XML_ELEMENT_NODE && xmlStrcmp(data->name, BAD_CAST "data") == 0) {
+			return (data);
+		}
+	}
+
+	ERROR("%s: no data element found", __func__);
+	return (NULL);
+}
+
 API nc_reply* nc_reply_merge(int count, ...)
 {
 	nc_reply *merged_reply = NULL;
@@ -2132,9 +2287,8 @@ API nc_reply* nc_reply_merge(int count, ...)
 	NC_REPLY_TYPE type = NC_REPLY_UNKNOWN, type_aux;
 	va_list ap;
 	struct nc_err *err;
-	int i, j, t, len = 0;
-	char * tmp, * data = NULL, *new_str;
-	const char* data_ns = NULL;
+	int i, j, t;
+	xmlNodePtr data, node, next;
 
 	/* params check */
 	if (count < 2) {
@@ -2208,39 +2362,55 @@ API nc_reply* nc_reply_merge(int count, ...)
 		merged_reply = nc_reply_ok();
 		break;
 	case NC_REPLY_DATA:
-		data_ns = nc_reply_get_data_ns(to_merge[0]);
-		/* join <data/> */
-		for (i = 0; i < count; i++) {
-			tmp = nc_reply_get_data(to_merge[i]);
-			if (data == NULL) {
-				len = strlen(tmp);
-				data = strdup(tmp);
-			} else {
-				len += strlen(tmp);
-				new_str = realloc(data, sizeof(char) * (len + 1));
-				if (new_str == NULL) {
-					ERROR("Memory allocation failed - %s (%s:%d).", strerror (errno), __FILE__, __LINE__);
-					free(data);
-					free(tmp);
-					free(to_merge);
-					va_end(ap);
-					return (NULL);
+		/*
+		 * join <data/> - the first reply is reused and the content of the
+		 * other replies is moved into it, so the data are not serialized
+		 * and parsed again
+		 */
+		merged_reply = to_merge[0];
+		to_merge[0] = NCDS_RPC_NOT_APPLICABLE; /* taken, do not free it */
+		if (nc_msg_doc_own(merged_reply) != EXIT_SUCCESS || (data = nc_reply_data_node(merged_reply)) == NULL) {
+			nc_reply_free(merged_reply);
+			merged_reply = NULL;
+		}
+		for (i = 1; merged_reply != NULL && i < count; i++) {
+			if (nc_msg_doc_own(to_merge[i]) != EXIT_SUCCESS || (node = nc_reply_data_node(to_merge[i])) == NULL) {
+				nc_reply_free(merged_reply);
+				merged_reply = NULL;
+				break;
+			}
+			for (node = node->children; node != NULL; node = next) {
+				next = node->next;
+				xmlUnlinkNode(node);
+				if (xmlDOMWrapAdoptNode(NULL, to_merge[i]->doc, node, merged_reply->doc, data, 0) != 0) {
+					ERROR("xmlDOMWrapAdoptNode failed (%s:%d).", __FILE__, __LINE__);
+					xmlFreeNode(node);
+					continue;
+				}
+				/* a text node can be merged into the previous one and freed */
+				if (xmlAddChild(data, node) == node && node->type == XML_ELEMENT_NODE) {
+#ifdef HAVE_XMLDOMWRAPRECONCILENAMESPACE
+					/* remove duplicated namespace definitions */
+					xmlDOMWrapReconcileNamespaces(NULL, node, 1);
+#endif
 				}
-				data = new_str;
-				strcat(data, tmp);
 			}
-			free(tmp);
 		}
-		merged_reply = nc_reply_data_ns(data, data_ns);
-		free(data);
+		if (merged_reply == NULL) {
+			/* the replies are consumed, so they cannot be returned instead */
+			err = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(err, NC_ERR_PARAM_MSG, "Unable to prepare final operation result.");
+			merged_reply = nc_reply_error(err);
+		}
 		break;
 	case NC_REPLY_ERROR:
 		/* join all errors */
 		for (i = 0; i < count; i++) {
 			if (nc_reply_get_type(to_merge[i]) == NC_REPLY_ERROR) {
 				if (merged_reply == NULL) {
-					/* first error reply found */
-					merged_reply = nc_reply_dup(to_merge[i]);
+					/* first error reply found, reuse it */
+					merged_reply = to_merge[i];
+					to_merge[i] = NCDS_RPC_NOT_APPLICABLE; /* taken, do not free it */
 				} else {
 					/* another error reply found - add error description to previous */
 					nc_reply_error_add(merged_reply, to_merge[i]->error);
@@ -2361,6 +2531,9 @@ API int nc_rpc_capability_attr(nc_rpc* rpc, NC_CAP_ATTR attr, ...)
 		ERROR("%s: invalid RPC to modify.", __func__);
 		return (EXIT_FAILURE);
 	}
+	if (nc_msg_doc_own(rpc) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
 
 	va_start(argp, attr);
 
@@ -2403,7 +2576,7 @@ API int nc_rpc_capability_attr(nc_rpc* rpc, NC_CAP_ATTR attr, ...)
 				break;
 			}
 
-			if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_WITHDEFAULTS_ID":with-defaults", rpc->ctxt)) != NULL) {
+			if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/"NC_NS_WITHDEFAULTS_ID":with-defaults", rpc->ctxt)) != NULL) {
 				if (xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 					/* there is currently no with-defaults element */
 					xmlXPathFreeObject(query_result);
@@ -2437,7 +2610,7 @@ nc_rpc_capability_attr_new_elem:
 			}
 		} else {
 			/* requested NCWD_MODE_NOTSET -> remove \<with-defaults\> element if exists */
-			if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_WITHDEFAULTS_ID":with-defaults", rpc->ctxt)) != NULL) {
+			if ((query_result = nc_xpath_eval("/"NC_NS_BASE10_ID":rpc/"NC_NS_WITHDEFAULTS_ID":with-defaults", rpc->ctxt)) != NULL) {
 				if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 					WARN("%s: removing with-defaults elements from the rpc", __func__);
 					for (i = 0; i < query_result->nodesetval->nodeNr; i++) {
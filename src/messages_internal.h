@@ -102,6 +102,27 @@ NCWD_MODE nc_rpc_parse_withdefaults(nc_rpc* rpc, const struct nc_session* sessio
  */
 nc_rpc *nc_rpc_closesession();
 
+/**
+ * @brief Get a new message structure with the XPath context (and the common
+ * namespaces registered) for the given document. The structures freed by
+ * nc_msg_free() are reused.
+ * @param[in] doc Document of the message, it is taken by the message.
+ * @return New message with the rest zeroed, NULL on error (doc is not freed).
+ */
+struct nc_msg *nc_msg_new(xmlDocPtr doc);
+
+/**
+ * @brief Serialize the reply shared from the \<ok/\> template as the reply to
+ * the rpc without building its document. Applicable only if the message-id is
+ * the only attribute of the rpc to be copied into the reply.
+ * @param[in] reply Reply to send.
+ * @param[in] rpc Rpc being replied.
+ * @param[out] len Length of the returned text.
+ * @return Serialized reply to free, NULL if the reply must be built the usual
+ * way.
+ */
+char *nc_reply_ok_dump(const nc_reply *reply, const nc_rpc *rpc, size_t *len);
+
 /**
  * @brief Free a generic message.
  * @param[in] msg Message to free.
@@ -110,9 +131,27 @@ void nc_msg_free(struct nc_msg *msg);
 
 /**
  * @brief Duplicate a message.
+ *
+ * The XML document of the message is not copied, the duplicate only takes
+ * another reference to it. The shared document must not be changed, use
+ * nc_msg_doc_own() before modifying it.
+ *
  * @param[in] msg Message to duplicate.
  * @return The copy of the given NETCONF message.
  */
 struct nc_msg *nc_msg_dup(struct nc_msg *msg);
 
+/**
+ * @brief Make the message's XML document private before it is modified.
+ *
+ * If the document is shared with other duplicates of the message, the message
+ * gets its own copy of it and drops the reference to the shared one. The nodes
+ * previously obtained from the message's document are not valid for
+ * modifications afterwards.
+ *
+ * @param[in] msg Message to be modified.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int nc_msg_doc_own(struct nc_msg *msg);
+
 #endif /* NC_MESSAGES_INTERNAL_H_ */
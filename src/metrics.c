@@ -0,0 +1,374 @@
+/**
+ * \file metrics.c
+ * \brief Registry of the server side processing metrics.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "netconf_internal.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+extern int nc_init_flags;
+
+#define METRICS_ENABLED (nc_init_flags & NC_INIT_METRICS)
+#define METRICS_GET(value) (*(volatile uint64_t*) &(value))
+
+/* number of the NC_OP values */
+#define METRICS_OPS (NC_OP_VALIDATE + 1)
+
+/* upper bounds of the histogram buckets in nanoseconds and as printed */
+static const uint64_t bucket_bounds[NC_METRICS_BUCKETS] = {
+		10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+		100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL
+};
+static const char* bucket_names[NC_METRICS_BUCKETS] = {"1e-05", "0.0001", "0.001", "0.01", "0.1", "1", "10", "100"};
+
+static const char* op_names[METRICS_OPS] = {
+		"other", "get-config", "get", "edit-config", "close-session",
+		"kill-session", "copy-config", "delete-config", "lock", "unlock",
+		"commit", "discard-changes", "create-subscription", "get-schema", "validate"
+};
+
+static const char* phase_names[NC_TRACE_PHASES] = {"receive", "parse", "nacm", "edit", "validate", "transapi", "sync", "reply"};
+
+/* description of the counters, the samples of the same name must follow each other */
+static const struct {
+	const char* name;
+	const char* label;
+	const char* type;
+	const char* help;
+} counters_desc[NC_METRIC_COUNTERS] = {
+		{"libnetconf_file_reloads_total", NULL, "counter", "File datastores re-parsed since modified by another process."},
+		{"libnetconf_file_reload_bytes_total", NULL, "counter", "Size of the re-parsed file datastores."},
+		{"libnetconf_file_syncs_total", NULL, "counter", "File datastores written to the disk."},
+		{"libnetconf_file_sync_bytes_total", NULL, "counter", "Size of the written file datastores."},
+		{"libnetconf_netconf_locks_total", "result=\"granted\"", "counter", "NETCONF lock operations on the file datastores."},
+		{"libnetconf_netconf_locks_total", "result=\"denied\"", "counter", NULL},
+		{"libnetconf_notifications_stored_total", NULL, "counter", "Events written into the stream files."},
+		{"libnetconf_notifications_stored_bytes_total", NULL, "counter", "Size of the events written into the stream files."},
+		{"libnetconf_notifications_dispatched_total", NULL, "counter", "Notifications sent to the subscribers."},
+		{"libnetconf_notifications_queued", NULL, "gauge", "Notifications queued in the sessions' batches."},
+		{"libnetconf_nacm_cache_hits_total", "cache=\"session\"", "counter", "NACM structures and decisions reused from the caches."},
+		{"libnetconf_nacm_cache_hits_total", "cache=\"notification\"", "counter", NULL},
+		{"libnetconf_nacm_cache_misses_total", "cache=\"session\"", "counter", "NACM structures and decisions not found in the caches."},
+		{"libnetconf_nacm_cache_misses_total", "cache=\"notification\"", "counter", NULL}
+};
+
+static const struct {
+	const char* name;
+	const char* help;
+} hists_desc[NC_METRIC_HISTS] = {
+		{"libnetconf_rpc_duration_seconds", "Processing of the RPCs since receiving until the reply is sent."},
+		{"libnetconf_file_lock_wait_seconds", "Waiting for the locks of the file datastores."},
+		{"libnetconf_file_lock_hold_seconds", "Holding the locks of the file datastores."},
+		{"libnetconf_netconf_lock_hold_seconds", "Holding the NETCONF locks of the file datastores."},
+		{"libnetconf_transapi_callback_seconds", "TransAPI callbacks."}
+};
+
+/* histogram with the observations counted only in their own bucket */
+struct metrics_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t buckets[NC_METRICS_BUCKETS];
+};
+
+/* metrics of the process, updated atomically */
+static struct {
+	uint64_t counters[NC_METRIC_COUNTERS];
+	uint64_t phases[NC_TRACE_PHASES];
+	struct metrics_hist rpc[METRICS_OPS];
+	struct metrics_hist hists[NC_METRIC_HISTS]; /* NC_METRIC_HIST_RPC is stored in rpc */
+} metrics;
+
+static struct metrics_hist* metrics_hist_get(NC_METRIC_HIST hist, int label)
+{
+	if (hist == NC_METRIC_HIST_RPC) {
+		return (&(metrics.rpc[(label > 0 && label < METRICS_OPS) ? label : 0]));
+	}
+	return (&(metrics.hists[hist]));
+}
+
+uint64_t nc_metrics_now(void)
+{
+	struct timespec ts;
+
+	if (!METRICS_ENABLED) {
+		return (0);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+void nc_metrics_add(NC_METRIC metric, int64_t n)
+{
+	if (METRICS_ENABLED) {
+		NC_STAT_ADD(metrics.counters[metric], (uint64_t) n);
+	}
+}
+
+void nc_metrics_observe(NC_METRIC_HIST hist, int label, uint64_t ns)
+{
+	struct metrics_hist* h;
+	int i;
+
+	if (!METRICS_ENABLED) {
+		return;
+	}
+
+	h = metrics_hist_get(hist, label);
+	for (i = 0; i < NC_METRICS_BUCKETS && ns > bucket_bounds[i]; i++);
+	if (i < NC_METRICS_BUCKETS) {
+		NC_STAT_INC(h->buckets[i]);
+	}
+	NC_STAT_ADD(h->sum, ns);
+	NC_STAT_INC(h->count);
+}
+
+void nc_metrics_since(NC_METRIC_HIST hist, int label, uint64_t since)
+{
+	uint64_t now;
+
+	if (since != 0 && (now = nc_metrics_now()) != 0) {
+		nc_metrics_observe(hist, label, now - since);
+	}
+}
+
+void nc_metrics_rpc(const struct nc_rpc_trace* trace)
+{
+	int i;
+
+	if (!METRICS_ENABLED) {
+		return;
+	}
+
+	nc_metrics_observe(NC_METRIC_HIST_RPC, trace->op, trace->total);
+	for (i = 0; i < NC_TRACE_PHASES; i++) {
+		if (trace->phases[i] != 0) {
+			NC_STAT_ADD(metrics.phases[i], trace->phases[i]);
+		}
+	}
+}
+
+API uint64_t nc_metrics_counter(NC_METRIC metric)
+{
+	if (metric < 0 || metric >= NC_METRIC_COUNTERS) {
+		return (0);
+	}
+	return (METRICS_GET(metrics.counters[metric]));
+}
+
+API int nc_metrics_histogram(NC_METRIC_HIST hist, NC_OP op, struct nc_metrics_hist* h)
+{
+	struct metrics_hist* m;
+	uint64_t cumulative = 0;
+	int i;
+
+	if (hist < 0 || hist >= NC_METRIC_HISTS || h == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	m = metrics_hist_get(hist, op);
+	for (i = 0; i < NC_METRICS_BUCKETS; i++) {
+		cumulative += METRICS_GET(m->buckets[i]);
+		h->buckets[i] = cumulative;
+	}
+	h->sum = METRICS_GET(m->sum);
+	h->count = METRICS_GET(m->count);
+
+	return (EXIT_SUCCESS);
+}
+
+API uint64_t nc_metrics_phase(NC_TRACE_PHASE phase)
+{
+	if (phase < 0 || phase >= NC_TRACE_PHASES) {
+		return (0);
+	}
+	return (METRICS_GET(metrics.phases[phase]));
+}
+
+API void nc_metrics_reset(void)
+{
+	int i;
+
+	/* the updates running concurrently may survive (partially) */
+	for (i = 0; i < NC_METRIC_COUNTERS; i++) {
+		if (strcmp(counters_desc[i].type, "gauge") != 0) {
+			metrics.counters[i] = 0;
+		}
+	}
+	memset(metrics.phases, 0, sizeof(metrics.phases));
+	memset(metrics.rpc, 0, sizeof(metrics.rpc));
+	memset(metrics.hists, 0, sizeof(metrics.hists));
+}
+
+static void metrics_print_hist(FILE* out, const char* name, const char* label, struct metrics_hist* m)
+{
+	uint64_t cumulative = 0, count;
+	int i;
+
+	/* the count first, so the buckets do not exceed it */
+	count = METRICS_GET(m->count);
+	for (i = 0; i < NC_METRICS_BUCKETS; i++) {
+		cumulative += METRICS_GET(m->buckets[i]);
+		fprintf(out, "%s_bucket{%s%sle=\"%s\"} %llu\n", name, label ? label : "", label ? "," : "",
+				bucket_names[i], (unsigned long long) cumulative);
+	}
+	if (count < cumulative) {
+		count = cumulative;
+	}
+	fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, label ? label : "", label ? "," : "", (unsigned long long) count);
+	fprintf(out, "%s_sum%s%s%s %.9f\n", name, label ? "{" : "", label ? label : "", label ? "}" : "", METRICS_GET(m->sum) / 1e9);
+	fprintf(out, "%s_count%s%s%s %llu\n", name, label ? "{" : "", label ? label : "", label ? "}" : "", (unsigned long long) count);
+}
+
+API char* nc_metrics_text(void)
+{
+	FILE* out;
+	char* text = NULL, label[64];
+	size_t len;
+	int i, op;
+
+	if ((out = open_memstream(&text, &len)) == NULL) {
+		ERROR("%s: open_memstream() failed (%s).", __func__, strerror(errno));
+		return (NULL);
+	}
+
+	for (i = 0; i < NC_METRIC_COUNTERS; i++) {
+		if (counters_desc[i].help != NULL) {
+			fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", counters_desc[i].name, counters_desc[i].help,
+					counters_desc[i].name, counters_desc[i].type);
+		}
+		fprintf(out, "%s%s%s%s %llu\n", counters_desc[i].name, counters_desc[i].label ? "{" : "",
+				counters_desc[i].label ? counters_desc[i].label : "", counters_desc[i].label ? "}" : "",
+				(unsigned long long) METRICS_GET(metrics.counters[i]));
+	}
+
+	fprintf(out, "# HELP libnetconf_rpc_phase_seconds_total Time spent in the phases of the RPC processing.\n"
+			"# TYPE libnetconf_rpc_phase_seconds_total counter\n");
+	for (i = 0; i < NC_TRACE_PHASES; i++) {
+		fprintf(out, "libnetconf_rpc_phase_seconds_total{phase=\"%s\"} %.9f\n", phase_names[i], METRICS_GET(metrics.phases[i]) / 1e9);
+	}
+
+	for (i = 0; i < NC_METRIC_HISTS; i++) {
+		fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", hists_desc[i].name, hists_desc[i].help, hists_desc[i].name);
+		if (i != NC_METRIC_HIST_RPC) {
+			metrics_print_hist(out, hists_desc[i].name, NULL, &(metrics.hists[i]));
+			continue;
+		}
+		/* the operations not requested are skipped */
+		for (op = 0; op < METRICS_OPS; op++) {
+			if (METRICS_GET(metrics.rpc[op].count) != 0) {
+				snprintf(label, sizeof(label), "op=\"%s\"", op_names[op]);
+				metrics_print_hist(out, hists_desc[i].name, label, &(metrics.rpc[op]));
+			}
+		}
+	}
+
+	if (fclose(out) != 0) {
+		ERROR("%s: printing the metrics failed (%s).", __func__, strerror(errno));
+		free(text);
+		return (NULL);
+	}
+
+	return (text);
+}
+
+API int nc_metrics_write(const char* path)
+{
+	char *text, *tmp_path;
+	size_t len, done;
+	ssize_t r;
+	int fd;
+
+	if (path == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	if ((text = nc_metrics_text()) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	if (asprintf(&tmp_path, "%s.XXXXXX", path) == -1) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(text);
+		return (EXIT_FAILURE);
+	}
+
+	/* the scrapers never see a partially written file */
+	if ((fd = mkstemp(tmp_path)) == -1) {
+		ERROR("%s: creating the file \"%s\" failed (%s).", __func__, tmp_path, strerror(errno));
+		goto error;
+	}
+	fchmod(fd, 0644);
+	len = strlen(text);
+	for (done = 0; done < len; done += r) {
+		if ((r = write(fd, text + done, len - done)) == -1) {
+			if (errno == EINTR) {
+				r = 0;
+				continue;
+			}
+			ERROR("%s: writing the file \"%s\" failed (%s).", __func__, tmp_path, strerror(errno));
+			close(fd);
+			unlink(tmp_path);
+			goto error;
+		}
+	}
+	close(fd);
+	if (rename(tmp_path, path) == -1) {
+		ERROR("%s: replacing the file \"%s\" failed (%s).", __func__, path, strerror(errno));
+		unlink(tmp_path);
+		goto error;
+	}
+
+	free(tmp_path);
+	free(text);
+	return (EXIT_SUCCESS);
+
+error:
+	free(tmp_path);
+	free(text);
+	return (EXIT_FAILURE);
+}
@@ -0,0 +1,168 @@
+/**
+ * \file metrics.h
+ * \brief libnetconf's metrics of the server side processing.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef NC_METRICS_H_
+#define NC_METRICS_H_
+
+#include <stdint.h>
+
+#include "netconf.h"
+#include "callbacks.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @ingroup metrics
+ * @brief Counters of the metrics registry.
+ */
+typedef enum {
+	NC_METRIC_FILE_RELOADS, /**< file datastore (part) re-parsed since modified by another process */
+	NC_METRIC_FILE_RELOAD_BYTES, /**< size of the re-parsed file datastores */
+	NC_METRIC_FILE_SYNCS, /**< file datastore (part) written to the disk */
+	NC_METRIC_FILE_SYNC_BYTES, /**< size of the written file datastores */
+	NC_METRIC_LOCKS_GRANTED, /**< NETCONF \<lock\> operations granted by the file datastores */
+	NC_METRIC_LOCKS_DENIED, /**< NETCONF \<lock\> operations denied by the file datastores */
+	NC_METRIC_NTF_STORED, /**< events written into the stream files */
+	NC_METRIC_NTF_STORED_BYTES, /**< size of the events written into the stream files */
+	NC_METRIC_NTF_DISPATCHED, /**< notifications sent to the subscribers */
+	NC_METRIC_NTF_QUEUED, /**< gauge of the notifications queued in the sessions' batches */
+	NC_METRIC_NACM_SESSION_HITS, /**< NACM structure of the session reused by the next RPC */
+	NC_METRIC_NACM_NTF_HITS, /**< NACM decision on the notification found in the session's cache */
+	NC_METRIC_NACM_SESSION_MISSES, /**< NACM structure of the session (re)built */
+	NC_METRIC_NACM_NTF_MISSES, /**< NACM decision on the notification evaluated */
+	NC_METRIC_COUNTERS /**< number of the counters, not a counter */
+} NC_METRIC;
+
+/**
+ * @ingroup metrics
+ * @brief Latency histograms of the metrics registry.
+ */
+typedef enum {
+	NC_METRIC_HIST_RPC, /**< RPC processing since receiving until the reply is sent, by the NETCONF operation */
+	NC_METRIC_HIST_FILE_LOCK_WAIT, /**< waiting for the (inter-process) lock of a file datastore */
+	NC_METRIC_HIST_FILE_LOCK_HOLD, /**< holding the lock of a file datastore */
+	NC_METRIC_HIST_NETCONF_LOCK_HOLD, /**< holding the NETCONF lock of a file datastore (in seconds resolution) */
+	NC_METRIC_HIST_TRANSAPI, /**< single TransAPI callback */
+	NC_METRIC_HISTS /**< number of the histograms, not a histogram */
+} NC_METRIC_HIST;
+
+/**
+ * @ingroup metrics
+ * @brief Number of the histogram buckets, their upper bounds are 10us, 100us,
+ * 1ms, 10ms, 100ms, 1s, 10s and 100s.
+ */
+#define NC_METRICS_BUCKETS 8
+
+/**
+ * @ingroup metrics
+ * @brief Snapshot of a latency histogram.
+ */
+struct nc_metrics_hist {
+	uint64_t count; /**< number of the observations */
+	uint64_t sum; /**< sum of the observations in nanoseconds */
+	uint64_t buckets[NC_METRICS_BUCKETS]; /**< cumulative number of the observations up to the bucket's upper bound */
+};
+
+/**
+ * @ingroup metrics
+ * @brief Get the value of a counter.
+ *
+ * The metrics are collected (in the calling process) only if libnetconf was
+ * initiated with the NC_INIT_METRICS flag.
+ *
+ * @param[in] metric Counter to get.
+ * @return Value of the counter.
+ */
+uint64_t nc_metrics_counter(NC_METRIC metric);
+
+/**
+ * @ingroup metrics
+ * @brief Get the snapshot of a latency histogram.
+ *
+ * @param[in] hist Histogram to get.
+ * @param[in] op NETCONF operation of NC_METRIC_HIST_RPC, ignored for the
+ * other histograms. NC_OP_UNKNOWN covers all the other operations.
+ * @param[out] h Snapshot of the histogram.
+ * @return EXIT_SUCCESS or EXIT_FAILURE on invalid parameters.
+ */
+int nc_metrics_histogram(NC_METRIC_HIST hist, NC_OP op, struct nc_metrics_hist* h);
+
+/**
+ * @ingroup metrics
+ * @brief Get the total time spent in a phase of the RPC processing.
+ *
+ * @param[in] phase Phase of the RPC processing as in nc_callback_rpc_trace().
+ * @return Time in nanoseconds.
+ */
+uint64_t nc_metrics_phase(NC_TRACE_PHASE phase);
+
+/**
+ * @ingroup metrics
+ * @brief Reset all the metrics (except the gauges) to zero.
+ */
+void nc_metrics_reset(void);
+
+/**
+ * @ingroup metrics
+ * @brief Print all the metrics in the Prometheus text exposition format.
+ *
+ * @return Text to be freed by the caller, NULL on error.
+ */
+char* nc_metrics_text(void);
+
+/**
+ * @ingroup metrics
+ * @brief Atomically replace the file with the current metrics in the
+ * Prometheus text exposition format.
+ *
+ * The file can serve as the text endpoint for the node exporter's textfile
+ * collector or any other scraper, the server only calls the function
+ * periodically.
+ *
+ * @param[in] path Path of the file.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int nc_metrics_write(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NC_METRICS_H_ */
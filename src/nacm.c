@@ -83,6 +83,7 @@ struct nacm_ns {
 
 struct nacm_path {
 	char* path;
+	xmlXPathCompExprPtr comp; /* compiled path, NULL if the path is invalid, shared by the RPCs of the session */
 	struct nacm_ns* ns_list;
 };
 
@@ -109,7 +110,7 @@ struct rule_list {
 	struct nacm_rule** rules;
 };
 
-static struct nacm_config {
+struct nacm_config {
 	bool enabled;
 	bool default_read; /* false (0) for permit, true (1) for deny */
 	bool default_write; /* false (0) for permit, true (1) for deny */
@@ -117,7 +118,23 @@ static struct nacm_config {
 	bool external_groups;
 	struct nacm_group** groups;
 	struct rule_list** rule_lists;
-} nacm_config = {false, false, true, false, true, NULL, NULL};
+	unsigned int generation; /* identification of the configuration version */
+	unsigned int refs; /* number of holders of the structure */
+};
+
+/*
+ * Current NACM configuration. The structure is never modified once it is
+ * published, a refresh builds a new one and replaces the pointer. Readers
+ * hold a reference to the structure they use, so they never wait for
+ * a refresh to finish.
+ */
+static struct nacm_config* nacm_config = NULL;
+static unsigned int nacm_generation = 0;
+
+/* serializes the refreshes of the NACM configuration */
+static pthread_mutex_t nacm_refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+/* protects the publication of nacm_config and the sharing of the nacm_config and nacm_rpc structures */
+static pthread_mutex_t nacm_rpc_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* access to the NACM statistics */
 extern struct nc_shared_info *nc_info;
@@ -130,6 +147,9 @@ static void nacm_path_free(struct nacm_path* path)
 
 	if (path != NULL) {
 		free(path->path);
+		if (path->comp != NULL) {
+			xmlXPathFreeCompExpr(path->comp);
+		}
 		for (aux = path->ns_list; aux!= NULL; aux = path->ns_list) {
 			path->ns_list = aux->next;
 			free(aux->prefix);
@@ -163,6 +183,7 @@ static struct nacm_path* nacm_path_parse(xmlNodePtr node)
 		free(retval);
 		return (NULL);
 	}
+	retval->comp = xmlXPathCompile(BAD_CAST retval->path);
 	ns = xmlGetNsList(node->doc, node);
 
 	for(i = 0; ns != NULL && ns[i] != NULL; i++) {
@@ -212,6 +233,7 @@ static struct nacm_path* nacm_path_dup(struct nacm_path* orig)
 		return (NULL);
 	}
 	new->path = strdup(orig->path);
+	new->comp = xmlXPathCompile(BAD_CAST new->path);
 	new->ns_list = NULL;
 
 	for(ns = orig->ns_list; ns != NULL; ns = ns->next) {
@@ -449,7 +471,7 @@ static struct nacm_rule* nacm_get_rule(xmlNodePtr rulenode)
 						/* empty string (double delimiter) */
 						continue;
 					}
-					if (c == l) {
+					if (c + 1 >= l) {
 						l += 10;
 						new_strlist = realloc(rule->type_data.rpc_names, l * sizeof(char*));
 						if (new_strlist == NULL) {
@@ -477,7 +499,7 @@ static struct nacm_rule* nacm_get_rule(xmlNodePtr rulenode)
 						/* empty string (double delimiter) */
 						continue;
 					}
-					if (c == l) {
+					if (c + 1 >= l) {
 						l += 10;
 						new_strlist = realloc(rule->type_data.ntf_names, l * sizeof(char*));
 						if (new_strlist == NULL) {
@@ -543,6 +565,86 @@ static struct nacm_rule* nacm_get_rule(xmlNodePtr rulenode)
 	return (rule);
 }
 
+static void nacm_config_free(struct nacm_config* conf)
+{
+	int i;
+
+	if (conf == NULL) {
+		return;
+	}
+
+	if (conf->groups != NULL) {
+		for (i = 0; conf->groups[i] != NULL; i++) {
+			nacm_group_free(conf->groups[i]);
+		}
+		free(conf->groups);
+	}
+	if (conf->rule_lists != NULL) {
+		for (i = 0; conf->rule_lists[i] != NULL; i++) {
+			nacm_rule_list_free(conf->rule_lists[i]);
+		}
+		free(conf->rule_lists);
+	}
+	free(conf);
+}
+
+/**
+ * @brief Get reference to the current NACM configuration.
+ * @return NACM configuration to be released by nacm_config_put(), NULL if
+ * there is no configuration.
+ */
+static struct nacm_config* nacm_config_get(void)
+{
+	struct nacm_config* conf;
+
+	pthread_mutex_lock(&nacm_rpc_lock);
+	if ((conf = nacm_config) != NULL) {
+		conf->refs++;
+	}
+	pthread_mutex_unlock(&nacm_rpc_lock);
+
+	return (conf);
+}
+
+static void nacm_config_put(struct nacm_config* conf)
+{
+	int last;
+
+	if (conf == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&nacm_rpc_lock);
+	last = (--conf->refs == 0);
+	pthread_mutex_unlock(&nacm_rpc_lock);
+
+	if (last) {
+		nacm_config_free(conf);
+	}
+}
+
+/**
+ * @brief Replace the current NACM configuration.
+ * @param[in] conf New configuration, NULL to remove the current one.
+ */
+static void nacm_config_publish(struct nacm_config* conf)
+{
+	struct nacm_config* old;
+
+	pthread_mutex_lock(&nacm_rpc_lock);
+	old = nacm_config;
+	/* invalidate the structures cached in the sessions */
+	nacm_generation++;
+	if (conf != NULL) {
+		conf->generation = nacm_generation;
+		conf->refs = 1;
+	}
+	nacm_config = conf;
+	pthread_mutex_unlock(&nacm_rpc_lock);
+
+	nacm_config_put(old);
+}
+
 int nacm_init(void)
 {
 	if (nacm_initiated == 1) {
@@ -560,26 +662,11 @@ int nacm_init(void)
 
 void nacm_close(void)
 {
-	int i;
-
 	if (nacm_initiated == 0) {
 		return;
 	}
 
-	if (nacm_config.groups != NULL) {
-		for (i = 0; nacm_config.groups[i] != NULL; i++) {
-			nacm_group_free(nacm_config.groups[i]);
-		}
-		free(nacm_config.groups);
-		nacm_config.groups = NULL;
-	}
-	if (nacm_config.rule_lists != NULL) {
-		for (i = 0; nacm_config.rule_lists[i] != NULL; i++) {
-			nacm_rule_list_free(nacm_config.rule_lists[i]);
-		}
-		free(nacm_config.rule_lists);
-		nacm_config.rule_lists = NULL;
-	}
+	nacm_config_publish(NULL);
 	nacm_initiated = 0;
 }
 
@@ -605,58 +692,29 @@ static int check_query_result(xmlXPathObjectPtr query_result, const char* object
 }
 
 /**
- * @brief Refresh internal structures according to the NACM configuration data.
- * @return 0 on success, -1 on error
+ * @brief Build NACM configuration structure from the NACM configuration data.
+ * @return NACM configuration structure, NULL on error.
  */
-static int nacm_config_refresh(void)
+static struct nacm_config* nacm_config_load(xmlDocPtr data_doc)
 {
 	xmlXPathContextPtr data_ctxt = NULL;
 	xmlXPathObjectPtr query_result = NULL;
-	char* data;
 	char** new_strlist;
 	xmlNodePtr node;
 	xmlChar* content = NULL;
-	xmlDocPtr data_doc = NULL;
 	int i, j, gl, rl, gc, rc;
 	bool allgroups;
 	struct nacm_group* gr;
 	struct rule_list* rlist;
 	struct nacm_rule** new_rules;
-	struct nc_err *e = NULL;
-
-	if (nacm_initiated == 0) {
-		ERROR("%s: NACM Subsystem not initialized.", __func__);
-		return (EXIT_FAILURE);
-	}
-
-	if (nacm_ds == NULL) {
-		ERROR("%s: NACM internal datastore not initialized.", __func__);
-		return (EXIT_FAILURE);
-	}
-
-	/* check if NACM  datastore was modified */
-	if (nacm_ds->func.was_changed(nacm_ds) == 0) {
-		/* it wasn't, we have up to date configuration data */
-		return (EXIT_SUCCESS);
-	}
-
-	data = nacm_ds->func.getconfig(nacm_ds, NULL, NC_DATASTORE_RUNNING, &e);
-	nc_err_free(e);
-	if (data == NULL) {
-		ERROR("%s: getting NACM configuration data from the datastore failed.", __func__);
-		return (EXIT_FAILURE);
-	}
-	if (strcmp(data, "") == 0) {
-		data_doc = xmlNewDoc(BAD_CAST "1.0");
-	} else {
-		data_doc = xmlReadDoc(BAD_CAST data, NULL, NULL, NC_XMLREAD_OPTIONS);
-	}
-	free(data);
+	struct nacm_config* conf;
 
-	if (data_doc == NULL) {
-		ERROR("%s: Reading configuration datastore failed.", __func__);
-		return (EXIT_FAILURE);
+	if ((conf = calloc(1, sizeof(struct nacm_config))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
 	}
+	conf->default_write = true;
+	conf->external_groups = true;
 
 	/* process default values */
 	ncdflt_default_values(data_doc, nacm_ds->ext_model, NCWD_MODE_ALL);
@@ -674,15 +732,15 @@ static int nacm_config_refresh(void)
 
 	/* fill the structure */
 	/* /nacm/enable-nacm */
-	query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":enable-nacm", data_ctxt);
+	query_result = nc_xpath_eval("/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":enable-nacm", data_ctxt);
 	if (check_query_result(query_result, "/nacm/enable-nacm", 0, 1) != 0) {
 		goto errorcleanup;
 	}
 	content = (xmlChar*) nc_clrwspace((char*)query_result->nodesetval->nodeTab[0]->children->content);
 	if (xmlStrcmp(content, BAD_CAST "true") == 0) {
-		nacm_config.enabled = true;
+		conf->enabled = true;
 	} else if (xmlStrcmp(BAD_CAST content, BAD_CAST "false") == 0) {
-		nacm_config.enabled = false;
+		conf->enabled = false;
 	} else {
 		ERROR("%s: Invalid /nacm/enable-nacm value (%s).", __func__, content);
 		goto errorcleanup;
@@ -692,15 +750,15 @@ static int nacm_config_refresh(void)
 	xmlXPathFreeObject(query_result);
 
 	/* /nacm/read-default */
-	query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":read-default", data_ctxt);
+	query_result = nc_xpath_eval("/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":read-default", data_ctxt);
 	if (check_query_result(query_result, "/nacm/read-default", 0, 1) != 0) {
 		goto errorcleanup;
 	}
 	content = (xmlChar*) nc_clrwspace((char*)query_result->nodesetval->nodeTab[0]->children->content);
 	if (xmlStrcmp(content, BAD_CAST "permit") == 0) {
-		nacm_config.default_read = NACM_PERMIT;
+		conf->default_read = NACM_PERMIT;
 	} else if (xmlStrcmp(BAD_CAST content, BAD_CAST "deny") == 0) {
-		nacm_config.default_read = NACM_DENY;
+		conf->default_read = NACM_DENY;
 	} else {
 		ERROR("%s: Invalid /nacm/read-default value (%s).", __func__, content);
 		goto errorcleanup;
@@ -710,15 +768,15 @@ static int nacm_config_refresh(void)
 	xmlXPathFreeObject(query_result);
 
 	/* /nacm/write-default */
-	query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":write-default", data_ctxt);
+	query_result = nc_xpath_eval("/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":write-default", data_ctxt);
 	if (check_query_result(query_result, "/nacm/write-default", 0 ,1) != 0) {
 		goto errorcleanup;
 	}
 	content = (xmlChar*) nc_clrwspace((char*)query_result->nodesetval->nodeTab[0]->children->content);
 	if (xmlStrcmp(content, BAD_CAST "permit") == 0) {
-		nacm_config.default_write = NACM_PERMIT;
+		conf->default_write = NACM_PERMIT;
 	} else if (xmlStrcmp(BAD_CAST content, BAD_CAST "deny") == 0) {
-		nacm_config.default_write = NACM_DENY;
+		conf->default_write = NACM_DENY;
 	} else {
 		ERROR("%s: Invalid /nacm/write-default value (%s).", __func__, content);
 		goto errorcleanup;
@@ -728,15 +786,15 @@ static int nacm_config_refresh(void)
 	xmlXPathFreeObject(query_result);
 
 	/* /nacm/exec-default */
-	query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":exec-default", data_ctxt);
+	query_result = nc_xpath_eval("/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":exec-default", data_ctxt);
 	if (check_query_result(query_result, "/nacm/exec-default", 0, 1) != 0) {
 		goto errorcleanup;
 	}
 	content = (xmlChar*) nc_clrwspace((char*)query_result->nodesetval->nodeTab[0]->children->content);
 	if (xmlStrcmp(content, BAD_CAST "permit") == 0) {
-		nacm_config.default_exec = NACM_PERMIT;
+		conf->default_exec = NACM_PERMIT;
 	} else if (xmlStrcmp(BAD_CAST content, BAD_CAST "deny") == 0) {
-		nacm_config.default_exec = NACM_DENY;
+		conf->default_exec = NACM_DENY;
 	} else {
 		ERROR("%s: Invalid /nacm/exec-default value (%s).", __func__, content);
 		goto errorcleanup;
@@ -746,15 +804,15 @@ static int nacm_config_refresh(void)
 	xmlXPathFreeObject(query_result);
 
 	/* /nacm/enable-external-groups */
-	query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":enable-external-groups", data_ctxt);
+	query_result = nc_xpath_eval("/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":enable-external-groups", data_ctxt);
 	if (check_query_result(query_result, "/nacm/enable-external-groups", 0, 1) != 0) {
 		goto errorcleanup;
 	}
 	content = (xmlChar*) nc_clrwspace((char*)query_result->nodesetval->nodeTab[0]->children->content);
 	if (xmlStrcmp(content, BAD_CAST "true") == 0) {
-		nacm_config.external_groups = true;
+		conf->external_groups = true;
 	} else if (xmlStrcmp(BAD_CAST content, BAD_CAST "false") == 0) {
-		nacm_config.external_groups = false;
+		conf->external_groups = false;
 	} else {
 		ERROR("%s: Invalid /nacm/enable-external-groups value (%s).", __func__, content);
 		goto errorcleanup;
@@ -764,24 +822,16 @@ static int nacm_config_refresh(void)
 	xmlXPathFreeObject(query_result);
 
 	/* /nacm/groups/group */
-	query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":groups/"NC_NS_NACM_ID":group", data_ctxt);
+	query_result = nc_xpath_eval("/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":groups/"NC_NS_NACM_ID":group", data_ctxt);
 	if (query_result != NULL) {
-		/* free previously parsed list of groups if any */
-		if (nacm_config.groups != NULL) {
-			for (i = 0; nacm_config.groups[i] != NULL; i++) {
-				nacm_group_free(nacm_config.groups[i]);
-			}
-			free(nacm_config.groups);
-			nacm_config.groups = NULL;
-		}
 		/* parse the currently set groups */
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
-			nacm_config.groups = malloc((query_result->nodesetval->nodeNr + 1) * sizeof(struct nacm_group*));
-			if (nacm_config.groups == NULL) {
+			conf->groups = malloc((query_result->nodesetval->nodeNr + 1) * sizeof(struct nacm_group*));
+			if (conf->groups == NULL) {
 				ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
 				goto errorcleanup;
 			}
-			nacm_config.groups[0] = NULL; /* list terminating NULL byte */
+			conf->groups[0] = NULL; /* list terminating NULL byte */
 			for (i = j = 0; i < query_result->nodesetval->nodeNr; i++) {
 				gr = malloc(sizeof(struct nacm_group));
 				if (gr == NULL) {
@@ -797,7 +847,7 @@ static int nacm_config_refresh(void)
 						if (xmlStrcmp(node->name, BAD_CAST "name") == 0) {
 							gr->name = nc_clrwspace((char*)node->children->content);
 						} else if (xmlStrcmp(node->name, BAD_CAST "user-name") == 0) {
-							if (gc == gl) {
+							if (gc + 1 >= gl) {
 								gl += 10;
 								new_strlist = realloc(gr->users, gl * sizeof(char*));
 								if (new_strlist == NULL) {
@@ -817,35 +867,27 @@ static int nacm_config_refresh(void)
 				if (gr->name == NULL || gr->users == NULL) {
 					nacm_group_free(gr);
 				} else {
-					nacm_config.groups[j++] = gr;
-					nacm_config.groups[j] = NULL; /* list terminating NULL */
+					conf->groups[j++] = gr;
+					conf->groups[j] = NULL; /* list terminating NULL */
 				}
 			}
 		}
 		xmlXPathFreeObject(query_result);
 	} else {
 		ERROR("%s: Unable to get information about NACM groups", __func__);
-		return (EXIT_FAILURE);
+		goto errorcleanup;
 	}
 
 	/* /nacm/rule-list */
-	query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":rule-list", data_ctxt);
+	query_result = nc_xpath_eval("/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":rule-list", data_ctxt);
 	if (query_result != NULL) {
-		/* free previously parsed list of rule-lists if any */
-		if (nacm_config.rule_lists != NULL) {
-			for (i = 0; nacm_config.rule_lists[i] != NULL; i++) {
-				nacm_rule_list_free(nacm_config.rule_lists[i]);
-			}
-			free(nacm_config.rule_lists);
-			nacm_config.rule_lists = NULL;
-		}
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
-			nacm_config.rule_lists = malloc((query_result->nodesetval->nodeNr + 1) * sizeof(struct rule_list*));
-			if (nacm_config.rule_lists == NULL) {
+			conf->rule_lists = malloc((query_result->nodesetval->nodeNr + 1) * sizeof(struct rule_list*));
+			if (conf->rule_lists == NULL) {
 				ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
 				goto errorcleanup;
 			}
-			nacm_config.rule_lists[0] = NULL; /* list terminating NULL byte */
+			conf->rule_lists[0] = NULL; /* list terminating NULL byte */
 			for (i = j = 0; i < query_result->nodesetval->nodeNr; i++) {
 				rlist = malloc(sizeof(struct rule_list));
 				if (rlist == NULL) {
@@ -859,7 +901,7 @@ static int nacm_config_refresh(void)
 				for (node = query_result->nodesetval->nodeTab[i]->children; node != NULL; node = node->next) {
 					if (node->type == XML_ELEMENT_NODE && node->ns != NULL && xmlStrcmp(node->ns->href, BAD_CAST NC_NS_NACM) == 0) {
 						if (!allgroups && node->children != NULL && node->children->type == XML_TEXT_NODE && xmlStrcmp(node->name, BAD_CAST "group") == 0) {
-							if (gc == gl) {
+							if (gc + 1 >= gl) {
 								gl += 10;
 								new_strlist = realloc(rlist->groups, gl * sizeof(char*));
 								if (new_strlist == NULL) {
@@ -884,7 +926,7 @@ static int nacm_config_refresh(void)
 								}
 							}
 						} else if (node->children != NULL && xmlStrcmp(node->name, BAD_CAST "rule") == 0) {
-							if (rc == rl) {
+							if (rc + 1 >= rl) {
 								rl += 10;
 								new_rules = realloc(rlist->rules, rl * sizeof(struct nacm_rule*));
 								if (new_rules == NULL) {
@@ -904,33 +946,100 @@ static int nacm_config_refresh(void)
 				if (rlist->groups == NULL || rlist->rules == NULL) {
 					nacm_rule_list_free(rlist);
 				} else {
-					nacm_config.rule_lists[j++] = rlist;
-					nacm_config.rule_lists[j] = NULL; /* list terminating NULL */
+					conf->rule_lists[j++] = rlist;
+					conf->rule_lists[j] = NULL; /* list terminating NULL */
 				}
 			}
 		}
 		xmlXPathFreeObject(query_result);
 	} else {
 		ERROR("%s: Unable to get information about NACM's lists of rules", __func__);
-		return (EXIT_FAILURE);
+		goto errorcleanup;
 	}
 
 	xmlXPathFreeContext(data_ctxt);
-	xmlFreeDoc(data_doc);
 
-	return (EXIT_SUCCESS);
+	return (conf);
 
 errorcleanup:
 
 	xmlXPathFreeObject(query_result);
 	xmlXPathFreeContext(data_ctxt);
-	xmlFreeDoc(data_doc);
 	xmlFree(content);
+	nacm_config_free(conf);
+
+	return (NULL);
+}
+
+/**
+ * @brief Refresh internal structures according to the NACM configuration data.
+ * @return 0 on success, -1 on error
+ */
+static int nacm_config_refresh(void)
+{
+	struct nacm_config* conf;
+	xmlDocPtr data_doc = NULL;
+	char* data;
+	struct nc_err *e = NULL;
+
+	if (nacm_initiated == 0) {
+		ERROR("%s: NACM Subsystem not initialized.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	if (nacm_ds == NULL) {
+		ERROR("%s: NACM internal datastore not initialized.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	if (pthread_mutex_trylock(&nacm_refresh_lock) != 0) {
+		/* another thread is refreshing, use the current configuration meanwhile */
+		return (EXIT_SUCCESS);
+	}
+
+	/* check if NACM  datastore was modified */
+	if (nacm_ds->func.was_changed(nacm_ds) == 0) {
+		/* it wasn't, we have up to date configuration data */
+		pthread_mutex_unlock(&nacm_refresh_lock);
+		return (EXIT_SUCCESS);
+	}
+
+	if (nacm_ds->func.getconfig_xml != NULL) {
+		/* get the data directly as a document, no need to parse them */
+		data_doc = nacm_ds->func.getconfig_xml(nacm_ds, NULL, NC_DATASTORE_RUNNING, NULL, &e);
+		nc_err_free(e);
+	} else if ((data = nacm_ds->func.getconfig(nacm_ds, NULL, NC_DATASTORE_RUNNING, &e)) != NULL) {
+		if (strcmp(data, "") == 0) {
+			data_doc = xmlNewDoc(BAD_CAST "1.0");
+		} else {
+			data_doc = xmlReadDoc(BAD_CAST data, NULL, NULL, NC_XMLREAD_OPTIONS);
+		}
+		free(data);
+		nc_err_free(e);
+	} else {
+		nc_err_free(e);
+		ERROR("%s: getting NACM configuration data from the datastore failed.", __func__);
+		pthread_mutex_unlock(&nacm_refresh_lock);
+		return (EXIT_FAILURE);
+	}
+
+	if (data_doc == NULL) {
+		ERROR("%s: Reading configuration datastore failed.", __func__);
+		pthread_mutex_unlock(&nacm_refresh_lock);
+		return (EXIT_FAILURE);
+	}
+
+	conf = nacm_config_load(data_doc);
+	xmlFreeDoc(data_doc);
+	if (conf != NULL) {
+		nacm_config_publish(conf);
+	}
+	pthread_mutex_unlock(&nacm_refresh_lock);
 
-	return (EXIT_FAILURE);
+	return ((conf != NULL) ? EXIT_SUCCESS : EXIT_FAILURE);
 }
 
-static struct nacm_rpc* nacm_rpc_struct(const struct nc_session* session)
+static struct nacm_rpc* nacm_rpc_struct(const struct nacm_config* conf, const struct nc_session* session)
 {
 	struct nacm_rpc* nacm_rpc;
 	struct rule_list** new_rulelist;
@@ -947,16 +1056,20 @@ static struct nacm_rpc* nacm_rpc_struct(const struct nc_session* session)
 		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
 		return (NULL);
 	}
-	nacm_rpc->default_exec = nacm_config.default_exec;
-	nacm_rpc->default_read = nacm_config.default_read;
-	nacm_rpc->default_write = nacm_config.default_write;
+	nacm_rpc->default_exec = conf->default_exec;
+	nacm_rpc->default_read = conf->default_read;
+	nacm_rpc->default_write = conf->default_write;
 	nacm_rpc->rule_lists = NULL;
+	nacm_rpc->refs = 1;
+	nacm_rpc->generation = conf->generation;
+	nacm_rpc->ntf_cache = NULL;
+	pthread_mutex_init(&(nacm_rpc->ntf_lock), NULL);
 
 	l = c = 0;
 	/* get list of user's groups specified in NACM configuration */
-	for (i = 0; nacm_config.groups != NULL && nacm_config.groups[i] != NULL; i++) {
-		for (j = 0; nacm_config.groups[i]->users != NULL && nacm_config.groups[i]->users[j] != NULL; j++) {
-			if (strcmp(nacm_config.groups[i]->users[j], session->username) == 0) {
+	for (i = 0; conf->groups != NULL && conf->groups[i] != NULL; i++) {
+		for (j = 0; conf->groups[i]->users != NULL && conf->groups[i]->users[j] != NULL; j++) {
+			if (strcmp(conf->groups[i]->users[j], session->username) == 0) {
 				if (c+1 >= l) {
 					l += 10;
 					new_groups = realloc(groups, l * sizeof(char*));
@@ -967,13 +1080,13 @@ static struct nacm_rpc* nacm_rpc_struct(const struct nc_session* session)
 					}
 					groups = new_groups;
 				}
-				groups[c] = strdup(nacm_config.groups[i]->name);
+				groups[c] = strdup(conf->groups[i]->name);
 				c++;
 			}
 		}
 	}
 	/* if enabled, add a list of system groups for the user */
-	if (nacm_config.external_groups == true && session->groups != NULL) {
+	if (conf->external_groups == true && session->groups != NULL) {
 		for (i = 0; session->groups[i] != NULL; i++) {
 			if (c+1 >= l) {
 				l += 10;
@@ -994,11 +1107,11 @@ static struct nacm_rpc* nacm_rpc_struct(const struct nc_session* session)
 
 		l = c = 0;
 		/* select rules for the groups associated with the user */
-		for (i = 0; nacm_config.rule_lists != NULL && nacm_config.rule_lists[i] != NULL; i++) {
-			for (j = 0; nacm_config.rule_lists[i]->groups != NULL && nacm_config.rule_lists[i]->groups[j] != NULL; j++) {
+		for (i = 0; conf->rule_lists != NULL && conf->rule_lists[i] != NULL; i++) {
+			for (j = 0; conf->rule_lists[i]->groups != NULL && conf->rule_lists[i]->groups[j] != NULL; j++) {
 				for (k = 0; groups[k] != NULL; k++) {
-					if (strcmp(nacm_config.rule_lists[i]->groups[j], groups[k]) == 0 ||
-							strcmp(nacm_config.rule_lists[i]->groups[j], "*") == 0) {
+					if (strcmp(conf->rule_lists[i]->groups[j], groups[k]) == 0 ||
+							strcmp(conf->rule_lists[i]->groups[j], "*") == 0) {
 						break;
 					}
 				}
@@ -1018,7 +1131,7 @@ static struct nacm_rpc* nacm_rpc_struct(const struct nc_session* session)
 						}
 						nacm_rpc->rule_lists = new_rulelist;
 					}
-					nacm_rpc->rule_lists[c] = nacm_rule_list_dup(nacm_config.rule_lists[i]);
+					nacm_rpc->rule_lists[c] = nacm_rule_list_dup(conf->rule_lists[i]);
 					if (nacm_rpc->rule_lists[c] != NULL) {
 						c++;
 						nacm_rpc->rule_lists[c] = NULL;  /* list terminating NULL */
@@ -1038,8 +1151,76 @@ static struct nacm_rpc* nacm_rpc_struct(const struct nc_session* session)
 	return (nacm_rpc);
 }
 
+static void nacm_rpc_unref(struct nacm_rpc* nacm)
+{
+	int i;
+
+	if (nacm == NULL || --nacm->refs > 0) {
+		return;
+	}
+
+	for (i = 0; nacm->rule_lists != NULL && nacm->rule_lists[i] != NULL; i++) {
+		nacm_rule_list_free(nacm->rule_lists[i]);
+	}
+	free(nacm->rule_lists);
+	if (nacm->ntf_cache != NULL) {
+		xmlHashFree(nacm->ntf_cache, NULL);
+	}
+	pthread_mutex_destroy(&(nacm->ntf_lock));
+	free(nacm);
+}
+
+struct nacm_rpc* nacm_rpc_ref(struct nacm_rpc* nacm)
+{
+	if (nacm != NULL) {
+		pthread_mutex_lock(&nacm_rpc_lock);
+		nacm->refs++;
+		pthread_mutex_unlock(&nacm_rpc_lock);
+	}
+
+	return (nacm);
+}
+
+void nacm_rpc_free(struct nacm_rpc* nacm)
+{
+	if (nacm != NULL) {
+		pthread_mutex_lock(&nacm_rpc_lock);
+		nacm_rpc_unref(nacm);
+		pthread_mutex_unlock(&nacm_rpc_lock);
+	}
+}
+
+/**
+ * @brief Get the NACM structure of the session for the given configuration.
+ * The session's structure is reused until the NACM configuration changes.
+ * @return NACM structure to be released by nacm_rpc_free().
+ */
+static struct nacm_rpc* nacm_session_struct(const struct nacm_config* conf, const struct nc_session* session)
+{
+	/* the cached NACM structure is not a part of the session's state */
+	struct nc_session* cache = (struct nc_session*)session;
+	struct nacm_rpc* nacm;
+
+	pthread_mutex_lock(&nacm_rpc_lock);
+	if (cache->nacm == NULL || cache->nacm->generation != conf->generation) {
+		nacm_rpc_unref(cache->nacm);
+		cache->nacm = nacm_rpc_struct(conf, session);
+		nc_metrics_add(NC_METRIC_NACM_SESSION_MISSES, 1);
+	} else {
+		nc_metrics_add(NC_METRIC_NACM_SESSION_HITS, 1);
+	}
+	if ((nacm = cache->nacm) != NULL) {
+		nacm->refs++;
+	}
+	pthread_mutex_unlock(&nacm_rpc_lock);
+
+	return (nacm);
+}
+
 int nacm_start(nc_rpc* rpc, const struct nc_session* session)
 {
+	struct nacm_config* conf;
+
 	if (rpc == NULL || session == NULL) {
 		return (EXIT_FAILURE);
 	}
@@ -1061,52 +1242,15 @@ int nacm_start(nc_rpc* rpc, const struct nc_session* session)
 
 	nacm_config_refresh();
 
-	if (nacm_config.enabled == false) {
+	if ((conf = nacm_config_get()) == NULL || conf->enabled == false) {
 		/* NACM subsystem is switched off */
+		nacm_config_put(conf);
 		return (EXIT_SUCCESS);
 	}
 
 	/* connect NACM structure with RPC */
-	rpc->nacm = nacm_rpc_struct(session);
-
-	return (EXIT_SUCCESS);
-}
-
-static void nacm_check_data_read_recursion(xmlNodePtr subtree, const struct nacm_rpc* nacm)
-{
-	xmlNodePtr node, next;
-
-	if (nacm_check_data(subtree, NACM_ACCESS_READ, nacm) == NACM_DENY) {
-		xmlUnlinkNode(subtree);
-		xmlFreeNode(subtree);
-	} else {
-		for (node = subtree->children; node != NULL; node = next) {
-			next = node->next;
-			if (node->type == XML_ELEMENT_NODE) {
-				nacm_check_data_read_recursion(node, nacm);
-			}
-		}
-	}
-}
-
-int nacm_check_data_read(xmlDocPtr doc, const struct nacm_rpc* nacm)
-{
-	xmlNodePtr node, next;
-
-	if (doc == NULL) {
-		return (EXIT_FAILURE);
-	}
-
-	if (nacm == NULL) {
-		return (EXIT_SUCCESS);
-	}
-
-	for (node = doc->children; node != NULL; node = next) {
-		next = node->next;
-		if (node->type == XML_ELEMENT_NODE) {
-			nacm_check_data_read_recursion(node, nacm);
-		}
-	}
+	rpc->nacm = nacm_session_struct(conf, session);
+	nacm_config_put(conf);
 
 	return (EXIT_SUCCESS);
 }
@@ -1118,19 +1262,26 @@ int nacm_check_data_read(xmlDocPtr doc, const struct nacm_rpc* nacm)
 static int compare_node_to_model(const xmlNodePtr node, const xmlNodePtr model_node, const char* model_namespace)
 {
 	xmlChar* name;
+	xmlAttrPtr attr;
 	xmlNodePtr model_parent;
+	int ret;
 
 	/* \todo Add support for augment models */
 
-	if ((name = xmlGetProp (model_node, BAD_CAST "name")) == NULL) {
+	if ((attr = xmlHasProp(model_node, BAD_CAST "name")) == NULL) {
 		return (0);
 	}
-
-	if (xmlStrcmp(node->name, name) != 0) {
+	if (attr->children != NULL && attr->children->type == XML_TEXT_NODE && attr->children->next == NULL) {
+		/* compare the value in place, this is called for many data nodes */
+		ret = xmlStrcmp(node->name, attr->children->content);
+	} else {
+		name = xmlNodeListGetString(model_node->doc, attr->children, 1);
+		ret = xmlStrcmp(node->name, name);
 		xmlFree(name);
+	}
+	if (ret != 0) {
 		return (0);
 	}
-	xmlFree(name);
 
 	if (node->ns == NULL || node->ns->href == NULL ||
 	    xmlStrcmp(node->ns->href, BAD_CAST model_namespace) != 0) {
@@ -1160,50 +1311,152 @@ static int compare_node_to_model(const xmlNodePtr node, const xmlNodePtr model_n
 	}
 }
 
-int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_rpc* nacm)
+/**
+ * @brief Evaluate the path of the NACM data rule in the given document.
+ *
+ * @param[in] path Rule's path.
+ * @param[in] doc Document where the path is evaluated.
+ * @param[out] result Evaluation result, NULL if the path cannot be evaluated.
+ * @return EXIT_SUCCESS or EXIT_FAILURE in case of an internal error.
+ */
+static int nacm_path_eval(const struct nacm_path* path, xmlDocPtr doc, xmlXPathObjectPtr* result)
 {
-	xmlXPathObjectPtr defdeny;
-	xmlXPathContextPtr model_ctxt = NULL;
-	xmlXPathContextPtr ctxt = NULL;
-	xmlXPathObjectPtr xpath_result = NULL;
+	xmlXPathContextPtr ctxt;
 	struct nacm_ns *ns;
-	struct nacm_rule* rule;
-	const struct data_model* module;
-	int i, j, k;
-	int retval = -1;
 
-	if (access == 0 || node == NULL || node->doc == NULL) {
-		/* invalid input parameter */
-		return (-1);
+	*result = NULL;
+
+	/* create xPath context for search in node's document */
+	if ((ctxt = xmlXPathNewContext(doc)) == NULL) {
+		ERROR("%s: Creating XPath context failed.", __func__);
+		return (EXIT_FAILURE);
 	}
 
-	if (nacm == NULL) {
-		/* NACM will not affect this request */
-		return (NACM_PERMIT);
+	/* register namespaces from the rule's path */
+	for (ns = path->ns_list; ns != NULL; ns = ns->next) {
+		if (xmlXPathRegisterNs(ctxt, BAD_CAST ns->prefix, BAD_CAST ns->href) != 0) {
+			ERROR("Registering NACM rule path namespace for the xpath context failed.");
+			xmlXPathFreeContext(ctxt);
+			return (EXIT_FAILURE);
+		}
 	}
 
-	if (node->type != XML_ELEMENT_NODE) {
-		/* skip comments or other elements not covered by NACM rules */
-		return (NACM_PERMIT);
+	/* compiled expressions are not modified by the evaluation, so the RPCs
+	 * of the session can evaluate them concurrently, each in its own context */
+	if (path->comp == NULL || (*result = xmlXPathCompiledEval(path->comp, ctxt)) == NULL) {
+		WARN("%s: Unable to evaluate path \"%s\"", __func__, path->path);
 	}
+	xmlXPathFreeContext(ctxt);
 
-	/* get module name where the data node is defined */
-	module = ncds_get_model_data((node->ns != NULL) ? (char*)(node->ns->href) : NULL);
+	return (EXIT_SUCCESS);
+}
 
-	if (module != NULL) {
-		for (i = 0; nacm->rule_lists != NULL && nacm->rule_lists[i] != NULL; i++) {
-			for (j = 0; nacm->rule_lists[i]->rules != NULL && nacm->rule_lists[i]->rules[j] != NULL; j++) {
-				/*
-				 * check rules (all must be met):
-				 * - module-name matches "*" or the name of the module where the data node is defined
-				 * - type is NACM_RULE_NOTSET or type is NACM_RULE_DATA and data contain "*" or the operation name
-				 * - access has set NACM_ACCESS_EXEC bit
-				 */
-				rule = nacm->rule_lists[i]->rules[j]; /* shortcut */
+/**
+ * @brief Get the model nodes marked by the given NACM extension.
+ *
+ * @param[in] module Data model to search in.
+ * @param[in] ext Name of the extension (default-deny-all or default-deny-write).
+ * @param[out] count Number of the returned nodes.
+ * @return Array of the model nodes or NULL if there is no such node.
+ */
+static xmlNodePtr* nacm_default_deny_nodes(const struct data_model* module, const char* ext, int* count)
+{
+	xmlXPathContextPtr model_ctxt;
+	xmlXPathObjectPtr defdeny;
+	xmlNodePtr* nodes = NULL;
+	char* query;
+	int i;
 
-				/* 1) module name */
-				if (!(strcmp(rule->module, "*") == 0 ||
-				    strcmp(rule->module, module->name) == 0)) {
+	*count = 0;
+	if (asprintf(&query, "/yin:module//nacm:%s", ext) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	if ((model_ctxt = xmlXPathNewContext(module->xml)) != NULL &&
+	    xmlXPathRegisterNs(model_ctxt, BAD_CAST "yin", BAD_CAST NC_NS_YIN) == 0 &&
+	    xmlXPathRegisterNs(model_ctxt, BAD_CAST "nacm", BAD_CAST NC_NS_NACM) == 0) {
+		if ((defdeny = nc_xpath_eval(query, model_ctxt)) != NULL) {
+			if (!xmlXPathNodeSetIsEmpty(defdeny->nodesetval) &&
+			    (nodes = malloc(defdeny->nodesetval->nodeNr * sizeof(xmlNodePtr))) != NULL) {
+				for (i = 0; i < defdeny->nodesetval->nodeNr; i++) {
+					nodes[i] = defdeny->nodesetval->nodeTab[i]->parent;
+				}
+				*count = i;
+			}
+			xmlXPathFreeObject(defdeny);
+		}
+	}
+	xmlXPathFreeContext(model_ctxt);
+	free(query);
+
+	return (nodes);
+}
+
+/**
+ * @return 1 if the node is defined by one of the model nodes, 0 otherwise
+ */
+static int nacm_default_deny(const xmlNodePtr node, xmlNodePtr* model_nodes, int count, const char* model_namespace)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (compare_node_to_model(node, model_nodes[i], model_namespace) == 1) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+static void nacm_stats_denied_data(void)
+{
+	if (nc_info) {
+		NC_STAT_INC(nc_info->stats_nacm.denied_data);
+	}
+}
+
+int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_rpc* nacm)
+{
+	xmlXPathObjectPtr xpath_result = NULL;
+	xmlNodePtr* defdeny;
+	struct nacm_rule* rule;
+	const struct data_model* module;
+	int i, j, k, count, deny;
+	int retval = -1;
+
+	if (access == 0 || node == NULL || node->doc == NULL) {
+		/* invalid input parameter */
+		return (-1);
+	}
+
+	if (nacm == NULL) {
+		/* NACM will not affect this request */
+		return (NACM_PERMIT);
+	}
+
+	if (node->type != XML_ELEMENT_NODE) {
+		/* skip comments or other elements not covered by NACM rules */
+		return (NACM_PERMIT);
+	}
+
+	/* get module name where the data node is defined */
+	module = ncds_get_model_data((node->ns != NULL) ? (char*)(node->ns->href) : NULL);
+
+	if (module != NULL) {
+		for (i = 0; nacm->rule_lists != NULL && nacm->rule_lists[i] != NULL; i++) {
+			for (j = 0; nacm->rule_lists[i]->rules != NULL && nacm->rule_lists[i]->rules[j] != NULL; j++) {
+				/*
+				 * check rules (all must be met):
+				 * - module-name matches "*" or the name of the module where the data node is defined
+				 * - type is NACM_RULE_NOTSET or type is NACM_RULE_DATA and data contain "*" or the operation name
+				 * - access has set NACM_ACCESS_EXEC bit
+				 */
+				rule = nacm->rule_lists[i]->rules[j]; /* shortcut */
+
+				/* 1) module name */
+				if (!(strcmp(rule->module, "*") == 0 ||
+				    strcmp(rule->module, module->name) == 0)) {
 					/* rule does not match */
 					continue;
 				}
@@ -1218,27 +1471,14 @@ int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_r
 				if (rule->type != NACM_RULE_NOTSET) {
 					if (rule->type == NACM_RULE_DATA &&
 					    rule->type_data.path != NULL) {
-						/* create xPath context for search in node's document */
-						if ((ctxt = xmlXPathNewContext(node->doc)) == NULL) {
-							ERROR("%s: Creating XPath context failed.", __func__);
+						/* query the rule's path in the node's document and compare results with the node */
+						if (nacm_path_eval(rule->type_data.path, node->doc, &xpath_result) != EXIT_SUCCESS) {
 							return (-1);
 						}
-
-						/* register namespaces from the rule's path */
-						for (ns = rule->type_data.path->ns_list; ns != NULL; ns = ns->next) {
-							if (xmlXPathRegisterNs(ctxt, BAD_CAST ns->prefix, BAD_CAST ns->href) != 0) {
-								ERROR("Registering NACM rule path namespace for the xpath context failed.");
-								xmlXPathFreeContext(ctxt);
-								return (-1);
-							}
-						}
-
-						/* query the rule's path in the node's document and compare results with the node */
-						if ((xpath_result = xmlXPathEvalExpression(BAD_CAST rule->type_data.path->path, ctxt)) != NULL) {
+						if (xpath_result != NULL) {
 							if (xmlXPathNodeSetIsEmpty(xpath_result->nodesetval)) {
 								/* rule does not match - path does not exist in document */
 								xmlXPathFreeObject(xpath_result);
-								xmlXPathFreeContext(ctxt);
 								continue;
 							}
 							for (k = 0; k < xpath_result->nodesetval->nodeNr; k++) {
@@ -1251,17 +1491,11 @@ int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_r
 							if (k == xpath_result->nodesetval->nodeNr) {
 								/* rule does not match */
 								xmlXPathFreeObject(xpath_result);
-								xmlXPathFreeContext(ctxt);
 								continue;
 							}
 
 							xmlXPathFreeObject(xpath_result);
-						} else {
-							WARN("%s: Unable to evaluate path \"%s\"", __func__, rule->type_data.path->path);
 						}
-
-						/* cleanup */
-						xmlXPathFreeContext(ctxt);
 					} else {
 						/* rule does not match - another type of rule */
 						continue;
@@ -1276,42 +1510,19 @@ int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_r
 		/* no matching rule found */
 
 		/* check nacm:default-deny-all and nacm:default-deny-write */
-		if ((model_ctxt = xmlXPathNewContext(module->xml)) != NULL &&
-		    xmlXPathRegisterNs(model_ctxt, BAD_CAST "yin", BAD_CAST NC_NS_YIN) == 0 &&
-		    xmlXPathRegisterNs(model_ctxt, BAD_CAST "nacm", BAD_CAST NC_NS_NACM) == 0) {
-			if ((defdeny = xmlXPathEvalExpression(BAD_CAST "/yin:module//nacm:default-deny-all", model_ctxt)) != NULL) {
-				if (!xmlXPathNodeSetIsEmpty(defdeny->nodesetval)) {
-					/* process all default-deny-all elements */
-					for (i = 0; i < defdeny->nodesetval->nodeNr; i++) {
-						if (compare_node_to_model(node, defdeny->nodesetval->nodeTab[i]->parent, module->ns) == 1) {
-							xmlXPathFreeObject(defdeny);
-							xmlXPathFreeContext(model_ctxt);
-							retval = NACM_DENY;
-							goto result;
-						}
-					}
-				}
-				xmlXPathFreeObject(defdeny);
-			}
-			if ((access & (NACM_ACCESS_CREATE | NACM_ACCESS_DELETE | NACM_ACCESS_UPDATE)) != 0) {
-				/* check default-deny-write */
-				if ((defdeny = xmlXPathEvalExpression(BAD_CAST "/yin:module//nacm:default-deny-write", model_ctxt)) != NULL ) {
-					if (!xmlXPathNodeSetIsEmpty(defdeny->nodesetval)) {
-						/* process all default-deny-all elements */
-						for (i = 0; i < defdeny->nodesetval->nodeNr; i++) {
-							if (compare_node_to_model(node, defdeny->nodesetval->nodeTab[i]->parent, module->ns) == 1) {
-								xmlXPathFreeObject(defdeny);
-								xmlXPathFreeContext(model_ctxt);
-								retval = NACM_DENY;
-								goto result;
-							}
-						}
-					}
-					xmlXPathFreeObject(defdeny);
-				}
-			}
+		defdeny = nacm_default_deny_nodes(module, "default-deny-all", &count);
+		deny = nacm_default_deny(node, defdeny, count, module->ns);
+		free(defdeny);
+		if (!deny && (access & (NACM_ACCESS_CREATE | NACM_ACCESS_DELETE | NACM_ACCESS_UPDATE)) != 0) {
+			/* check default-deny-write */
+			defdeny = nacm_default_deny_nodes(module, "default-deny-write", &count);
+			deny = nacm_default_deny(node, defdeny, count, module->ns);
+			free(defdeny);
+		}
+		if (deny) {
+			retval = NACM_DENY;
+			goto result;
 		}
-		xmlXPathFreeContext(model_ctxt);
 	}
 	/* no matching rule found */
 
@@ -1330,91 +1541,371 @@ int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_r
 
 result:
 	/* update stats */
-	if (retval == NACM_DENY && nc_info) {
-		pthread_rwlock_wrlock(&(nc_info->lock));
-		nc_info->stats_nacm.denied_data++;
-		pthread_rwlock_unlock(&(nc_info->lock));
+	if (retval == NACM_DENY) {
+		nacm_stats_denied_data();
 	}
 
 	return (retval);
 }
 
-#ifndef DISABLE_NOTIFICATIONS
+/*
+ * Decision index used to check the read access to all the nodes of a document.
+ * The rules' paths are evaluated only once for the whole document and the
+ * rules are preprocessed per data model, so the check of a node consists only
+ * of a few lookups.
+ */
 
-int nacm_check_notification(const nc_ntf* ntf, const struct nc_session* session)
+/* rule applicable to the read access with the nodes selected by its path */
+struct nacm_index_rule {
+	struct nacm_rule* rule;
+	bool all; /* the rule matches all the nodes of its module(s) */
+	xmlNodePtr* nodes; /* sorted nodes selected by the rule's path */
+	int count;
+};
+
+/* rules applicable to the data nodes of a specific data model */
+struct nacm_index_module {
+	const struct data_model* module;
+	struct nacm_index_rule** path_rules; /* NULL terminated, matching rules with path preceding the decision */
+	int decision; /* action of the first matching rule without path, -1 if there is no such rule */
+	xmlNodePtr* deny_all; /* model nodes with nacm:default-deny-all */
+	int deny_all_count;
+};
+
+struct nacm_index {
+	const struct nacm_rpc* nacm;
+	struct nacm_index_rule* rules;
+	int rules_count;
+	xmlNodePtr* targets; /* sorted nodes selected by any rule's path and all their ancestors */
+	int targets_count;
+	xmlHashTablePtr modules; /* namespace URI -> struct nacm_index_module */
+};
+
+static int nacm_index_ptrcmp(const void* a, const void* b)
 {
-	xmlXPathObjectPtr defdeny;
-	xmlXPathContextPtr model_ctxt = NULL;
-	xmlXPathObjectPtr query_result = NULL;
-	xmlNodePtr ntfnode;
-	const struct data_model* ntfmodule;
-	struct nacm_rpc *nacm;
-	int i, j, k;
-	int retval;
-	NCNTF_EVENT event;
+	uintptr_t x = (uintptr_t)(*(const xmlNodePtr*)a), y = (uintptr_t)(*(const xmlNodePtr*)b);
 
-	if (ntf == NULL || session == NULL) {
-		/* invalid input parameter */
-		return (-1);
+	return ((x > y) - (x < y));
+}
+
+static int nacm_index_contains(xmlNodePtr* nodes, int count, xmlNodePtr node)
+{
+	return (count > 0 && bsearch(&node, nodes, count, sizeof(xmlNodePtr), nacm_index_ptrcmp) != NULL);
+}
+
+static void nacm_index_module_free(void* payload, const xmlChar* UNUSED(name))
+{
+	struct nacm_index_module* m = (struct nacm_index_module*)payload;
+
+	free(m->path_rules);
+	free(m->deny_all);
+	free(m);
+}
+
+static void nacm_index_free(struct nacm_index* idx)
+{
+	int i;
+
+	if (idx == NULL) {
+		return;
 	}
 
-	/* recovery session */
-	if (session->nacm_recovery) {
-		/* ignore NACM in recovery session */
-		return (NACM_PERMIT);
+	for (i = 0; i < idx->rules_count; i++) {
+		free(idx->rules[i].nodes);
 	}
+	free(idx->rules);
+	free(idx->targets);
+	xmlHashFree(idx->modules, nacm_index_module_free);
+	free(idx);
+}
 
-	nacm_config_refresh();
+/**
+ * @brief Build the read access decision index for the given document.
+ * @return Created index or NULL on error.
+ */
+static struct nacm_index* nacm_index_new(xmlDocPtr doc, const struct nacm_rpc* nacm)
+{
+	struct nacm_index* idx;
+	struct nacm_index_rule* irule;
+	struct nacm_rule* rule;
+	xmlXPathObjectPtr xpath_result;
+	xmlNodePtr node, *new_targets;
+	int i, j, k, count = 0;
 
-	if (nacm_initiated == 0 || nacm_config.enabled == false) {
-		/* NACM subsystem not initiated or switched off */
-		/*
-		 * do not add NACM structure to the RPC, which means that
-		 * NACM is not applied to the RPC
-		 */
+	if ((idx = calloc(1, sizeof(struct nacm_index))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	idx->nacm = nacm;
+	if ((idx->modules = xmlHashCreate(8)) == NULL) {
+		goto error;
+	}
+
+	for (i = 0; nacm->rule_lists != NULL && nacm->rule_lists[i] != NULL; i++) {
+		for (j = 0; nacm->rule_lists[i]->rules != NULL && nacm->rule_lists[i]->rules[j] != NULL; j++) {
+			count++;
+		}
+	}
+	if (count && (idx->rules = calloc(count, sizeof(struct nacm_index_rule))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		goto error;
+	}
+
+	/* keep only the rules applicable to the read access, in their order */
+	for (i = 0; nacm->rule_lists != NULL && nacm->rule_lists[i] != NULL; i++) {
+		for (j = 0; nacm->rule_lists[i]->rules != NULL && nacm->rule_lists[i]->rules[j] != NULL; j++) {
+			rule = nacm->rule_lists[i]->rules[j];
+			if ((rule->access & NACM_ACCESS_READ) == 0) {
+				continue;
+			}
+			if (rule->type != NACM_RULE_NOTSET && (rule->type != NACM_RULE_DATA || rule->type_data.path == NULL)) {
+				/* another type of rule */
+				continue;
+			}
+
+			irule = &(idx->rules[idx->rules_count++]);
+			irule->rule = rule;
+			if (rule->type == NACM_RULE_NOTSET) {
+				irule->all = true;
+				continue;
+			}
+
+			if (nacm_path_eval(rule->type_data.path, doc, &xpath_result) != EXIT_SUCCESS) {
+				goto error;
+			}
+			if (xpath_result == NULL) {
+				/* the path cannot be evaluated, the rule matches as in nacm_check_data() */
+				irule->all = true;
+				continue;
+			}
+			if (!xmlXPathNodeSetIsEmpty(xpath_result->nodesetval)) {
+				irule->count = xpath_result->nodesetval->nodeNr;
+				if ((irule->nodes = malloc(irule->count * sizeof(xmlNodePtr))) == NULL) {
+					ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+					xmlXPathFreeObject(xpath_result);
+					goto error;
+				}
+				memcpy(irule->nodes, xpath_result->nodesetval->nodeTab, irule->count * sizeof(xmlNodePtr));
+				qsort(irule->nodes, irule->count, sizeof(xmlNodePtr), nacm_index_ptrcmp);
+
+				/* remember the selected nodes and their ancestors */
+				for (k = 0; k < irule->count; k++) {
+					if (irule->nodes[k]->type == XML_NAMESPACE_DECL) {
+						/* namespace nodes are not linked into the tree */
+						continue;
+					}
+					for (node = irule->nodes[k]; node != NULL && node->type != XML_DOCUMENT_NODE; node = node->parent) {
+						if ((idx->targets_count & 0x3f) == 0) {
+							new_targets = realloc(idx->targets, (idx->targets_count + 0x40) * sizeof(xmlNodePtr));
+							if (new_targets == NULL) {
+								ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+								xmlXPathFreeObject(xpath_result);
+								goto error;
+							}
+							idx->targets = new_targets;
+						}
+						idx->targets[idx->targets_count++] = node;
+					}
+				}
+			}
+			xmlXPathFreeObject(xpath_result);
+		}
+	}
+	if (idx->targets_count) {
+		qsort(idx->targets, idx->targets_count, sizeof(xmlNodePtr), nacm_index_ptrcmp);
+	}
+
+	return (idx);
+
+error:
+	nacm_index_free(idx);
+	return (NULL);
+}
+
+/**
+ * @brief Get the rules applicable to the nodes of the given namespace.
+ * @return The module's part of the index or NULL on error.
+ */
+static struct nacm_index_module* nacm_index_module(struct nacm_index* idx, const xmlChar* ns)
+{
+	struct nacm_index_module* m;
+	const xmlChar* key = (ns != NULL) ? ns : BAD_CAST "";
+	int i, c = 0;
+
+	if ((m = xmlHashLookup(idx->modules, key)) != NULL) {
+		return (m);
+	}
+
+	if ((m = calloc(1, sizeof(struct nacm_index_module))) == NULL ||
+	    (m->path_rules = calloc(idx->rules_count + 1, sizeof(struct nacm_index_rule*))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(m);
+		return (NULL);
+	}
+	m->decision = -1;
+
+	/* get module name where the data nodes are defined */
+	if ((m->module = ncds_get_model_data((char*)ns)) != NULL) {
+		for (i = 0; i < idx->rules_count; i++) {
+			if (!(strcmp(idx->rules[i].rule->module, "*") == 0 ||
+			    strcmp(idx->rules[i].rule->module, m->module->name) == 0)) {
+				continue;
+			}
+			if (idx->rules[i].all) {
+				/* no following rule can be applied */
+				m->decision = idx->rules[i].rule->action;
+				break;
+			}
+			m->path_rules[c++] = &(idx->rules[i]);
+		}
+		if (m->decision == -1) {
+			m->deny_all = nacm_default_deny_nodes(m->module, "default-deny-all", &(m->deny_all_count));
+		}
+	}
+
+	if (xmlHashAddEntry(idx->modules, key, m) != 0) {
+		nacm_index_module_free(m, NULL);
+		return (NULL);
+	}
+
+	return (m);
+}
+
+/**
+ * @brief Check the read access to the node using the index, the same way as
+ * nacm_check_data() does.
+ *
+ * @param[out] uniform Set to 1 if the same decision applies to all the
+ * descendants of the node from the same namespace.
+ */
+static int nacm_index_check_read(struct nacm_index* idx, const xmlNodePtr node, int* uniform)
+{
+	struct nacm_index_module* m;
+	int i, retval;
+
+	*uniform = 0;
+	if (node->type != XML_ELEMENT_NODE) {
+		/* skip comments or other elements not covered by NACM rules */
 		return (NACM_PERMIT);
 	}
 
-	/* connect NACM structure with RPC */
-	nacm = nacm_rpc_struct(session);
+	if ((m = nacm_index_module(idx, (node->ns != NULL) ? node->ns->href : NULL)) == NULL) {
+		return (nacm_check_data(node, NACM_ACCESS_READ, idx->nacm));
+	}
 
-	if (nacm == NULL) {
-		/* NACM will not affect this notification */
-		retval = NACM_PERMIT;
-		goto nacmfree;
+	if (m->module == NULL) {
+		/* default action */
+		retval = idx->nacm->default_read;
+		goto result;
 	}
 
-	event = ncntf_notif_get_type(ntf);
-	if (event == NCNTF_REPLAY_COMPLETE || event == NCNTF_NTF_COMPLETE) {
-		/* NACM will not affect this notification */
-		retval = NACM_PERMIT;
-		goto nacmfree;
+	if (!nacm_index_contains(idx->targets, idx->targets_count, node)) {
+		/* no rule targets the node's subtree, only the module matters */
+		*uniform = (m->decision != -1 || m->deny_all_count == 0);
+	} else {
+		for (i = 0; m->path_rules[i] != NULL; i++) {
+			if (nacm_index_contains(m->path_rules[i]->nodes, m->path_rules[i]->count, node)) {
+				/* rule matches */
+				retval = m->path_rules[i]->rule->action;
+				goto result;
+			}
+		}
 	}
 
-	/* get the notification name from the message */
-	query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_NOTIFICATIONS_ID":notification", ntf->ctxt);
-	if (check_query_result(query_result, "/notification", 0, 0) != 0) {
-		retval = -1;
-		goto nacmfree;
+	if (m->decision != -1) {
+		retval = m->decision;
+	} else if (nacm_default_deny(node, m->deny_all, m->deny_all_count, m->module->ns)) {
+		retval = NACM_DENY;
+	} else {
+		/* default action */
+		retval = idx->nacm->default_read;
 	}
-	ntfnode = query_result->nodesetval->nodeTab[0]->children;
-	while(ntfnode != NULL) {
-		if (ntfnode->type != XML_ELEMENT_NODE || xmlStrcmp(ntfnode->name, BAD_CAST "eventTime") == 0) {
-			/* skip comments and eventTime element */
-			ntfnode = ntfnode->next;
-			continue;
+
+result:
+	/* update stats */
+	if (retval == NACM_DENY) {
+		nacm_stats_denied_data();
+	}
+
+	return (retval);
+}
+
+/**
+ * @param[in] inherit Permit the node without checking it if it is from the
+ * namespace of its parent, which was uniformly permitted.
+ */
+static void nacm_check_data_read_recursion(xmlNodePtr subtree, const struct nacm_rpc* nacm, struct nacm_index* idx, int inherit)
+{
+	xmlNodePtr node, next;
+	int ret, uniform = 0;
+
+	if (inherit && subtree->ns == subtree->parent->ns) {
+		/* the parent's decision applies */
+		ret = NACM_PERMIT;
+		uniform = 1;
+	} else if (idx != NULL) {
+		ret = nacm_index_check_read(idx, subtree, &uniform);
+	} else {
+		ret = nacm_check_data(subtree, NACM_ACCESS_READ, nacm);
+	}
+
+	if (ret == NACM_DENY) {
+		xmlUnlinkNode(subtree);
+		xmlFreeNode(subtree);
+	} else {
+		for (node = subtree->children; node != NULL; node = next) {
+			next = node->next;
+			if (node->type == XML_ELEMENT_NODE) {
+				nacm_check_data_read_recursion(node, nacm, idx, uniform);
+			}
 		}
-		break;
 	}
-	xmlXPathFreeObject(query_result);
-	query_result = NULL;
+}
 
-	if (ntfnode == NULL) {
-		/* invalid message with missing notification */
-		retval = -1;
-		goto nacmfree;
+int nacm_check_data_read(xmlDocPtr doc, const struct nacm_rpc* nacm)
+{
+	xmlNodePtr node, next;
+	struct nacm_index* idx;
+
+	if (doc == NULL) {
+		return (EXIT_FAILURE);
 	}
 
+	if (nacm == NULL) {
+		return (EXIT_SUCCESS);
+	}
+
+	/* without the index, each node is checked separately */
+	idx = nacm_index_new(doc, nacm);
+
+	for (node = doc->children; node != NULL; node = next) {
+		next = node->next;
+		if (node->type == XML_ELEMENT_NODE) {
+			nacm_check_data_read_recursion(node, nacm, idx, 0);
+		}
+	}
+
+	nacm_index_free(idx);
+
+	return (EXIT_SUCCESS);
+}
+
+#ifndef DISABLE_NOTIFICATIONS
+
+/**
+ * @brief Decide if the notification is permitted by the NACM rules.
+ * @param[in] nacm NACM structure of the session.
+ * @param[in] ntfnode Element describing the event in the notification.
+ * @return NACM_PERMIT or NACM_DENY.
+ */
+static int nacm_notification_decide(const struct nacm_rpc* nacm, const xmlNodePtr ntfnode)
+{
+	xmlXPathObjectPtr defdeny;
+	xmlXPathContextPtr model_ctxt = NULL;
+	const struct data_model* ntfmodule;
+	int i, j, k;
+	int retval;
+
 	/* get module name where the notification is defined */
 	ntfmodule = ncds_get_model_notification((char*)(ntfnode->name), (ntfnode->ns != NULL) ? (char*)(ntfnode->ns->href) : NULL);
 
@@ -1461,24 +1952,23 @@ int nacm_check_notification(const nc_ntf* ntf, const struct nc_session* session)
 					continue;
 				}
 				/* rule matches */
-				retval = nacm->rule_lists[i]->rules[j]->action;
-				goto nacmfree;
+				return (nacm->rule_lists[i]->rules[j]->action);
 			}
 		}
 		/* no matching rule found */
 
 		/* check nacm:default-deny-all */
+		retval = NACM_PERMIT;
 		if ((model_ctxt = xmlXPathNewContext(ntfmodule->xml)) != NULL &&
 		    xmlXPathRegisterNs(model_ctxt, BAD_CAST "yin", BAD_CAST NC_NS_YIN) == 0 &&
 		    xmlXPathRegisterNs(model_ctxt, BAD_CAST "nacm", BAD_CAST NC_NS_NACM) == 0) {
-			if ((defdeny = xmlXPathEvalExpression(BAD_CAST "/yin:module/yin:notification//nacm:default-deny-all", model_ctxt)) != NULL) {
+			if ((defdeny = nc_xpath_eval("/yin:module/yin:notification//nacm:default-deny-all", model_ctxt)) != NULL) {
 				if (!xmlXPathNodeSetIsEmpty(defdeny->nodesetval)) {
 					/* process all default-deny-all elements */
 					for (i = 0; i < defdeny->nodesetval->nodeNr; i++) {
 						if (compare_node_to_model(ntfnode, defdeny->nodesetval->nodeTab[i]->parent, ntfmodule->ns) == 1) {
-							xmlXPathFreeObject(defdeny);
-							xmlXPathFreeContext(model_ctxt);
-							return(NACM_DENY);
+							retval = NACM_DENY;
+							break;
 						}
 					}
 				}
@@ -1486,22 +1976,117 @@ int nacm_check_notification(const nc_ntf* ntf, const struct nc_session* session)
 			}
 		}
 		xmlXPathFreeContext(model_ctxt);
+		if (retval == NACM_DENY) {
+			return (NACM_DENY);
+		}
 	}
 	/* no matching rule found */
 
 	/* default action */
-	retval = nacm->default_read;
+	return (nacm->default_read);
+}
 
-nacmfree:
-	if (query_result != NULL) {
-		xmlXPathFreeObject(query_result);
+int nacm_check_notification(const nc_ntf* ntf, const struct nc_session* session)
+{
+	xmlNodePtr ntfnode;
+	struct nacm_rpc *nacm;
+	struct nacm_config* conf = NULL;
+	xmlChar* key;
+	void* cached;
+	int retval;
+	NCNTF_EVENT event;
+
+	if (ntf == NULL || session == NULL) {
+		/* invalid input parameter */
+		return (-1);
 	}
-	/* free NACM structure */
-	for (i = 0; nacm->rule_lists != NULL && nacm->rule_lists[i] != NULL; i++) {
-		nacm_rule_list_free(nacm->rule_lists[i]);
+
+	/* recovery session */
+	if (session->nacm_recovery) {
+		/* ignore NACM in recovery session */
+		return (NACM_PERMIT);
 	}
-	free(nacm->rule_lists);
-	free(nacm);
+
+	nacm_config_refresh();
+
+	if (nacm_initiated == 0 || (conf = nacm_config_get()) == NULL || conf->enabled == false) {
+		/* NACM subsystem not initiated or switched off */
+		/*
+		 * do not add NACM structure to the RPC, which means that
+		 * NACM is not applied to the RPC
+		 */
+		nacm_config_put(conf);
+		return (NACM_PERMIT);
+	}
+
+	/* use the NACM structure of the session, it holds the decisions cache */
+	nacm = nacm_session_struct(conf, session);
+	nacm_config_put(conf);
+
+	if (nacm == NULL) {
+		/* NACM will not affect this notification */
+		return (NACM_PERMIT);
+	}
+
+	event = ncntf_notif_get_type(ntf);
+	if (event == NCNTF_REPLAY_COMPLETE || event == NCNTF_NTF_COMPLETE) {
+		/* NACM will not affect this notification */
+		retval = NACM_PERMIT;
+		goto nacmfree;
+	}
+
+	/* get the notification name from the message */
+	ntfnode = xmlDocGetRootElement(ntf->doc);
+	if (ntfnode == NULL || !xmlStrEqual(ntfnode->name, BAD_CAST "notification") ||
+			ntfnode->ns == NULL || !xmlStrEqual(ntfnode->ns->href, BAD_CAST NC_NS_NOTIFICATIONS)) {
+		ERROR("%s: Invalid Notification message - missing <notification> element.", __func__);
+		retval = -1;
+		goto nacmfree;
+	}
+	for (ntfnode = ntfnode->children; ntfnode != NULL; ntfnode = ntfnode->next) {
+		if (ntfnode->type != XML_ELEMENT_NODE || xmlStrcmp(ntfnode->name, BAD_CAST "eventTime") == 0) {
+			/* skip comments and eventTime element */
+			continue;
+		}
+		break;
+	}
+
+	if (ntfnode == NULL) {
+		/* invalid message with missing notification */
+		retval = -1;
+		goto nacmfree;
+	}
+
+	/* repeated events of the same type get the cached decision */
+	key = xmlStrncatNew(ntfnode->name, BAD_CAST " ", -1);
+	key = xmlStrcat(key, (ntfnode->ns != NULL) ? ntfnode->ns->href : BAD_CAST "");
+	pthread_mutex_lock(&(nacm->ntf_lock));
+	cached = (nacm->ntf_cache != NULL && key != NULL) ? xmlHashLookup(nacm->ntf_cache, key) : NULL;
+	pthread_mutex_unlock(&(nacm->ntf_lock));
+
+	if (cached != NULL) {
+		/* the decision is stored increased by one to distinguish it from NULL */
+		retval = (int)((intptr_t)cached - 1);
+		nc_metrics_add(NC_METRIC_NACM_NTF_HITS, 1);
+	} else {
+		retval = nacm_notification_decide(nacm, ntfnode);
+		nc_metrics_add(NC_METRIC_NACM_NTF_MISSES, 1);
+		if (key != NULL) {
+			pthread_mutex_lock(&(nacm->ntf_lock));
+			if (nacm->ntf_cache == NULL) {
+				nacm->ntf_cache = xmlHashCreate(0);
+			}
+			if (nacm->ntf_cache != NULL) {
+				xmlHashAddEntry(nacm->ntf_cache, key, (void*)((intptr_t)retval + 1));
+			}
+			pthread_mutex_unlock(&(nacm->ntf_lock));
+		}
+	}
+	xmlFree(key);
+
+nacmfree:
+	/* release NACM structure */
+	nacm_rpc_free(nacm);
 
 	return (retval);
 }
@@ -1528,7 +2113,7 @@ int nacm_check_operation(const nc_rpc* rpc)
 	}
 
 	/* get the operation name from the rpc */
-	query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE_ID":rpc", rpc->ctxt);
+	query_result = nc_xpath_eval("/"NC_NS_BASE_ID":rpc", rpc->ctxt);
 	if (check_query_result(query_result, "/rpc", 0, 0) != 0) {
 		return (-1);
 	}
@@ -1597,7 +2182,7 @@ int nacm_check_operation(const nc_rpc* rpc)
 		if ((model_ctxt = xmlXPathNewContext(opmodule->xml)) != NULL &&
 		    xmlXPathRegisterNs(model_ctxt, BAD_CAST "yin", BAD_CAST NC_NS_YIN) == 0 &&
 		    xmlXPathRegisterNs(model_ctxt, BAD_CAST "nacm", BAD_CAST NC_NS_NACM) == 0) {
-			if ((defdeny = xmlXPathEvalExpression(BAD_CAST "/yin:module/yin:rpc//nacm:default-deny-all", model_ctxt)) != NULL) {
+			if ((defdeny = nc_xpath_eval("/yin:module/yin:rpc//nacm:default-deny-all", model_ctxt)) != NULL) {
 				if (!xmlXPathNodeSetIsEmpty(defdeny->nodesetval)) {
 					/* process all default-deny-all elements */
 					for (i = 0; i < defdeny->nodesetval->nodeNr; i++) {
@@ -77,6 +77,25 @@ void nacm_close(void);
  */
 int nacm_start(nc_rpc* rpc, const struct nc_session* session);
 
+/**
+ * @brief Get another reference to the NACM structure of an RPC.
+ *
+ * The NACM structure is not modified after its creation, so it is shared
+ * by the RPCs of a session while the NACM configuration is not changed.
+ *
+ * @param[in] nacm NACM structure to share.
+ * @return The given NACM structure.
+ */
+struct nacm_rpc* nacm_rpc_ref(struct nacm_rpc* nacm);
+
+/**
+ * @brief Release a reference to the NACM structure, the structure is freed
+ * when its last reference is released.
+ *
+ * @param[in] nacm NACM structure to release.
+ */
+void nacm_rpc_free(struct nacm_rpc* nacm);
+
 /**
  * @brief Check if there is a permission to invoke requested protocol operation.
  *
@@ -371,6 +371,23 @@ typedef enum NC_VERB_LEVEL {
  */
 void nc_verbosity(NC_VERB_LEVEL level);
 
+/**
+ * @brief Pass libnetconf's messages to the print callback asynchronously.
+ * @ingroup genAPI
+ *
+ * The messages are passed to the callback set by nc_callback_print() from a
+ * separate thread, so the callback (e.g. writing into a log file) does not
+ * delay the processing of the requests. The messages wait for the thread in a
+ * ring of the given number of slots (4 KB each). When it is full, the new
+ * messages are dropped and their number is reported by a warning. The waiting
+ * messages are printed when the asynchronous printing is stopped, which is
+ * also done by nc_close().
+ *
+ * @param[in] slots Size of the ring, 0 to stop the asynchronous printing.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int nc_verb_async(unsigned int slots);
+
 /**
  * @brief Function for logging error messages.
  * @param[in] format	printf's format string
@@ -425,6 +442,8 @@ typedef enum NC_TRANSPORT {
  *    - *NC_INIT_WD* Enable With-default capability
  *    - *NC_INIT_NOTIF* Enable Notification subsystem
  *    - *NC_INIT_NACM* Enable NETCONF Access Control subsystem
+ *    - *NC_INIT_METRICS* Enable the metrics registry
+ *    - *NC_INIT_DEFLATE* Announce the compact (deflate) encoding of the messages
  *
  * Clients call init just for libssh initialization, if it is used.
  * The difference between the multi-layer and single-layer flag is strictly in
@@ -470,6 +489,16 @@ int nc_init(int flags);
  */
 #define NC_INIT_DATASTORES 0x00000100 /**< nc_init()'s flag to use internal datastores */
 #define NC_INIT_LIBSSH_PTHREAD 0x00000200 /**< nc_init()'s flag to initialize libssh pthread callbacks */
+#define NC_INIT_METRICS    0x00000400 /**< nc_init()'s flag to collect the metrics of the server side processing, see nc_metrics_text() */
+#define NC_INIT_DEFLATE    0x00000800 /**< nc_init()'s flag to announce the compact encoding of the messages.
+ * The urn:cesnet:params:netconf:capability:deflate:1.0 capability is added into
+ * the default capabilities (it can be also added into a custom list). When both
+ * sides of a NETCONF 1.1 session announce it, the messages longer than 64 KiB
+ * (typically the bulk replies) are compressed by zlib and sent in the chunks of
+ * the message. Shorter messages and all the messages of the sessions with the
+ * peers not announcing the capability are sent as plain XML. The flag can be
+ * used also with NC_INIT_CLIENT.
+ */
 
 #define NC_INITRET_NOTFIRST 0x00000001 /**< nc_init()'s return flag for this process not calling nc_init() first */
 #define NC_INITRET_RECOVERY 0x00000002 /**< nc_init()'s return flag for this process crashing before (not calling nc_close()) */
@@ -488,6 +517,30 @@ int nc_init(int flags);
  */
 int nc_close(void);
 
+/**
+ * @ingroup genAPI
+ * @brief Prepare libnetconf inherited from the parent process for use in the
+ * child created by fork().
+ *
+ * This allows a pre-forking server: the parent process calls nc_init(),
+ * creates and initiates the datastores (including ncds_consolidate() and
+ * ncds_device_init()) once and then forks a child for each NETCONF session.
+ * The children share the parsed data models with the parent (and with each
+ * other) instead of loading them again. The child must call this function
+ * right after the fork() and before any other libnetconf function. It is
+ * registered as another libnetconf participant and the subsystems keeping
+ * process-specific resources reopen them. The transAPI modules stay owned by
+ * the parent, so the child does not run their transapi_close() functions nor
+ * their file monitoring.
+ *
+ * The fork() must be made when no other thread of the parent process is
+ * inside a libnetconf function. The child releases libnetconf by nc_close()
+ * as usual.
+ *
+ * @return -1 on error\n 0 on success
+ */
+int nc_init_forked(void);
+
 /**
  * @ingroup genAPI
  * @brief Transform given time_t (seconds since the epoch) into the RFC 3339 format
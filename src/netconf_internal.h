@@ -57,10 +57,12 @@
 
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
+#include <libxml/hash.h>
 
 #include "config.h"
 #include "netconf.h"
 #include "callbacks.h"
+#include "metrics.h"
 #include "with_defaults.h"
 
 /* number of characters to store short number */
@@ -115,6 +117,7 @@
 #define NC_CAP_MONITORING_ID    "urn:ietf:params:xml:ns:yang:ietf-netconf-monitoring"
 #define NC_CAP_WITHDEFAULTS_ID  "urn:ietf:params:netconf:capability:with-defaults:1.0"
 #define NC_CAP_URL_ID           "urn:ietf:params:netconf:capability:url:1.0"
+#define NC_CAP_DEFLATE_ID       "urn:cesnet:params:netconf:capability:deflate:1.0"
 
 #define NC_NS_WITHDEFAULTS      "urn:ietf:params:xml:ns:yang:ietf-netconf-with-defaults"
 #define NC_NS_WITHDEFAULTS_ID   "wd"
@@ -211,10 +214,12 @@
 /* libnetconf's message printing */
 void prv_printf(NC_VERB_LEVEL level, const char *format, ...);
 extern volatile uint8_t verbose_level;
-#define ERROR(format,args...) prv_printf(NC_VERB_ERROR,format,##args)
-#define WARN(format,args...) if(verbose_level>=NC_VERB_WARNING){prv_printf(NC_VERB_WARNING,format,##args);}
-#define VERB(format,args...) if(verbose_level>=NC_VERB_VERBOSE){prv_printf(NC_VERB_VERBOSE,format,##args);}
-#define DBG(format,args...) if(verbose_level>=NC_VERB_DEBUG){prv_printf(NC_VERB_DEBUG,format,##args);}
+/* the message is going to be printed, so its arguments are worth evaluating and formatting */
+#define NC_VERB_ON(level) (verbose_level>=(level) && callbacks.print!=NULL)
+#define ERROR(format,args...) do{if(NC_VERB_ON(NC_VERB_ERROR)){prv_printf(NC_VERB_ERROR,format,##args);}}while(0)
+#define WARN(format,args...) do{if(NC_VERB_ON(NC_VERB_WARNING)){prv_printf(NC_VERB_WARNING,format,##args);}}while(0)
+#define VERB(format,args...) do{if(NC_VERB_ON(NC_VERB_VERBOSE)){prv_printf(NC_VERB_VERBOSE,format,##args);}}while(0)
+#define DBG(format,args...) do{if(NC_VERB_ON(NC_VERB_DEBUG)){prv_printf(NC_VERB_DEBUG,format,##args);}}while(0)
 #ifdef DEBUG_THREADS
 #define DBG_UNLOCK(name) DBG("Unlocking %s in thread %lu (%s:%d)", name, pthread_self(), __FILE__, __LINE__)
 #define DBG_LOCK(name) DBG("Locking %s in thread %lu (%s:%d)", name, pthread_self(), __FILE__, __LINE__)
@@ -245,6 +250,8 @@ struct callbacks {
 			const char* element,
 			const char* ns,
 			const char* sid);
+	/**< @brief Function receiving the latency breakdown of the processed RPCs, if not set, the RPCs are not traced */
+	void (*rpc_trace)(const struct nc_rpc_trace* trace);
 #ifndef DISABLE_LIBSSH
 	/**< @brief Callback for libssh's 'keyboard-interactive' authentication method */
 	char* (*sshauth_interactive)(const char* name,
@@ -275,6 +282,106 @@ struct callbacks {
  */
 extern struct callbacks callbacks;
 
+/**
+ * @ingroup internalAPI
+ * @brief Get the current CLOCK_MONOTONIC time for the RPC tracing.
+ * @return Time in nanoseconds, 0 if the RPCs are not traced.
+ */
+uint64_t nc_trace_now(void);
+
+/**
+ * @ingroup internalAPI
+ * @brief Create the trace of a received RPC.
+ * @param[in] start Time (nc_trace_now()) when the RPC started to be read.
+ * @return Created trace, NULL on error.
+ */
+struct nc_rpc_trace* nc_trace_new(uint64_t start);
+
+/**
+ * @ingroup internalAPI
+ * @brief Add the time since the given time to the phase of the trace.
+ * @param[in] trace Trace to update, nothing is done if NULL.
+ * @param[in] phase Finished phase.
+ * @param[in] since Start of the phase (nc_trace_now()), nothing is done if 0.
+ */
+void nc_trace_add(struct nc_rpc_trace* trace, NC_TRACE_PHASE phase, uint64_t since);
+
+/**
+ * @ingroup internalAPI
+ * @brief Set the trace of the RPC processed by the current thread, so the
+ * phases deep in the datastore code (without access to the RPC) can be
+ * measured by nc_trace_begin() and nc_trace_end().
+ * @param[in] trace Trace of the processed RPC, NULL when the processing is
+ * done.
+ */
+void nc_trace_attach(struct nc_rpc_trace* trace);
+
+/**
+ * @ingroup internalAPI
+ * @brief Start a phase of the RPC processed by the current thread.
+ * @return Start of the phase for nc_trace_end(), 0 if no traced RPC is
+ * processed by the thread.
+ */
+uint64_t nc_trace_begin(void);
+
+/**
+ * @ingroup internalAPI
+ * @brief Finish a phase of the RPC processed by the current thread.
+ * @param[in] phase Finished phase.
+ * @param[in] since Return value of nc_trace_begin().
+ */
+void nc_trace_end(NC_TRACE_PHASE phase, uint64_t since);
+
+/**
+ * @ingroup internalAPI
+ * @brief Finish the trace when the reply is sent and report it.
+ * @param[in] trace Trace of the replied RPC.
+ * @param[in] rpc The replied RPC.
+ * @param[in] since Time when the reply started to be sent.
+ */
+void nc_trace_finish(struct nc_rpc_trace* trace, const struct nc_msg* rpc, uint64_t since);
+
+/**
+ * @ingroup internalAPI
+ * @brief Get the current CLOCK_MONOTONIC time for the metrics.
+ * @return Time in nanoseconds, 0 if the metrics are not collected.
+ */
+uint64_t nc_metrics_now(void);
+
+/**
+ * @ingroup internalAPI
+ * @brief Add to a counter (or a gauge) of the metrics registry.
+ * @param[in] metric Counter to update.
+ * @param[in] n Value to add, negative only for the gauges.
+ */
+void nc_metrics_add(NC_METRIC metric, int64_t n);
+
+/**
+ * @ingroup internalAPI
+ * @brief Record an observation of the histogram.
+ * @param[in] hist Histogram to update.
+ * @param[in] label NC_OP of NC_METRIC_HIST_RPC, 0 for the others.
+ * @param[in] ns Observed time in nanoseconds.
+ */
+void nc_metrics_observe(NC_METRIC_HIST hist, int label, uint64_t ns);
+
+/**
+ * @ingroup internalAPI
+ * @brief Record the time since the given time into the histogram.
+ * @param[in] hist Histogram to update.
+ * @param[in] label NC_OP of NC_METRIC_HIST_RPC, 0 for the others.
+ * @param[in] since Start of the measured interval (nc_metrics_now()),
+ * nothing is recorded if 0.
+ */
+void nc_metrics_since(NC_METRIC_HIST hist, int label, uint64_t since);
+
+/**
+ * @ingroup internalAPI
+ * @brief Record the finished trace of an RPC.
+ * @param[in] trace Trace of the replied RPC.
+ */
+void nc_metrics_rpc(const struct nc_rpc_trace* trace);
+
 /**
  * @ingroup internalAPI
  * @brief NETCONF session statistics as defined in RFC 6022 (as common-counters)
@@ -286,6 +393,22 @@ struct nc_session_stats {
 	unsigned int out_notifications;
 };
 
+/**
+ * @ingroup internalAPI
+ * @brief Update the statistics counter shared among processes.
+ *
+ * Counters are updated atomically without any lock, so reading the statistics
+ * never blocks the processing of RPCs in other processes.
+ */
+#define NC_STAT_ADD(counter, n) ((void) __sync_fetch_and_add(&(counter), (n)))
+#define NC_STAT_INC(counter) NC_STAT_ADD(counter, 1)
+
+/**
+ * @ingroup internalAPI
+ * @brief Read the statistics counter shared among processes.
+ */
+#define NC_STAT_GET(counter) (*(volatile unsigned int*) &(counter))
+
 /**
  * @ingroup internalAPI
  * @brief NETCONF statistics section as defined in RFC 6022
@@ -390,8 +513,52 @@ struct nc_session {
 	pthread_mutex_t mut_session;
 	/**< @brief thread lock for communication channel */
 	pthread_mutex_t *mut_channel;
-	/**< @brief flag for mut_channel, partially it works as conditional variable */
+	/**< @brief flag for mut_channel, set by a thread waiting to send data */
 	volatile uint8_t mut_channel_flag;
+	/**< @brief conditional variable (used with mut_channel) signalling that the sending thread released the channel */
+	pthread_cond_t cond_channel;
+	/**< @brief receive buffer for data read from the communication channel, but not yet processed */
+	char *rbuf;
+	/**< @brief allocated size of the receive buffer */
+	size_t rbuf_size;
+	/**< @brief offset of the first unprocessed byte in the receive buffer */
+	size_t rbuf_start;
+	/**< @brief offset behind the last valid byte in the receive buffer */
+	size_t rbuf_end;
+	/**< @brief state of receiving the current message: 0 - in progress, 1 - the whole message was read, -1 - invalid message */
+	int rstate;
+	/**< @brief push parser context of the :base:1.1 message being received, kept between the non-blocking reads of the session loop */
+	xmlParserCtxtPtr rctxt;
+	/**< @brief number of bytes of the current :base:1.1 chunk not read yet */
+	size_t rchunk;
+	/**< @brief number of bytes behind rbuf_start already searched for the :base:1.0 end of message */
+	size_t rscanned;
+	/**< @brief send buffer used to frame the serialized message before writing it into the communication channel */
+	char *wbuf;
+	/**< @brief number of message bytes in the send buffer */
+	size_t wbuf_len;
+	/**< @brief flag signalling error while writing the send buffer */
+	int wbuf_error;
+	/**< @brief flag if both sides announced the deflate compression of the messages (NC_CAP_DEFLATE_ID) */
+	int deflate;
+	/**< @brief deflate stream of the message being sent, created with the first compressed message */
+	struct z_stream_s *zout;
+	/**< @brief flag if the message being sent is compressed */
+	int zout_active;
+	/**< @brief buffer of the compressed data, framed the same way as the send buffer */
+	char *zbuf;
+	/**< @brief inflate stream of the message being received, created with the first compressed message */
+	struct z_stream_s *zin;
+	/**< @brief flag if the message being received is compressed */
+	int zin_active;
+	/**< @brief buffer of the framed notifications waiting for a batched write */
+	char *nbuf;
+	/**< @brief number of bytes in the notification buffer */
+	size_t nbuf_len;
+	/**< @brief allocated size of the notification buffer */
+	size_t nbuf_size;
+	/**< @brief number of notifications in the notification buffer */
+	unsigned int nbuf_count;
 	/**< @brief thread lock for accessing queue_event */
 	pthread_mutex_t mut_equeue;
 	/**< @brief thread lock for accessing queue_msg */
@@ -400,6 +567,8 @@ struct nc_session {
 	struct nc_msg* queue_msg;
 	/**< @brief queue for received, but not processed, NETCONF Event Notifications */
 	struct nc_msg* queue_event;
+	/**< @brief dispatching of the received replies to their waiters (client side), created on demand, accessed with mut_mqueue */
+	struct nc_session_async* async;
 	/**< @brief flag for active notification subscription on the session */
 	int ntf_active;
 	/**< @brief flag for stopping notification subscription on the session */
@@ -410,12 +579,18 @@ struct nc_session {
 	int nacm_recovery;
 	/**< @brief Flag if the session is monitored and connected to the shared memory segment */
 	int monitored;
+	/**< @brief flag for bypassing the datastores' status data caches */
+	int state_nocache;
+	/**< @brief NACM structure for the session's RPCs, valid for NACM configuration generation it was created from */
+	struct nacm_rpc *nacm;
 	/**< @brief NETCONF session statistics as defined in RFC 6022 */
 	struct nc_session_stats *stats;
 	/**< @brief pointer to the next NETCONF session on the shared SSH session, but different SSH channel */
 	struct nc_session *next;
 	/**< @brief pointer to the previous NETCONF session on the shared SSH session, but different SSH channel */
 	struct nc_session *prev;
+	/**< @brief key of the SSH connection in the pool, if the session was created by nc_session_connect_pooled() */
+	char *pool_key;
 };
 
 /**
@@ -500,7 +675,11 @@ struct nacm_rpc {
 	bool default_read; /* false (0) for permit, true (1) for deny */
 	bool default_write; /* false (0) for permit, true (1) for deny */
 	bool default_exec; /* false (0) for permit, true (1) for deny */
-	struct rule_list** rule_lists;
+	struct rule_list** rule_lists; /* read only, shared by the RPCs of the session */
+	unsigned int refs; /* number of holders (RPCs and the session cache) */
+	unsigned int generation; /* NACM configuration generation the structure was created from */
+	xmlHashTablePtr ntf_cache; /* decisions on the notifications indexed by their name and namespace */
+	pthread_mutex_t ntf_lock; /* protects ntf_cache */
 };
 
 /**
@@ -509,6 +688,7 @@ struct nacm_rpc {
  */
 struct nc_msg {
 	xmlDocPtr doc;
+	unsigned int *doc_refs; /* holders of the doc shared by nc_msg_dup(), NULL if the doc is not shared */
 	xmlXPathContextPtr ctxt;
 	char* msgid;
 	union {
@@ -525,6 +705,7 @@ struct nc_msg {
 	NC_OP op;
 	NC_DATASTORE source;
 	NC_DATASTORE target;
+	struct nc_rpc_trace* trace; /* latency breakdown of a received rpc, NULL if not traced */
 };
 
 struct nc_filter {
@@ -536,9 +717,57 @@ struct nc_cpblts {
 	int iter;
 	int list_size;
 	int items;
-	char **list;
+	char **list; /* interned capability strings, see nc_str_intern() */
+	const char **base; /* interned capability identifiers (without parameters) of the list items */
+	char *xml; /* cached <capabilities> element, see nc_cpblts_xml() */
 };
 
+/**
+ * @brief Get the \<capabilities\> element of the ietf-netconf-monitoring's
+ * netconf-state with the capabilities from the list.
+ *
+ * The element is rendered only once and kept until the list changes.
+ *
+ * @param[in] c Capabilities list.
+ * @return Serialized \<capabilities\> element, it must not be freed by
+ * the caller. NULL on error.
+ */
+const char* nc_cpblts_xml(struct nc_cpblts* c);
+
+/**
+ * @brief Get the interned copy of the string.
+ *
+ * Interned strings are shared by the whole process and never freed, so equal
+ * interned strings can be compared as pointers.
+ *
+ * @param[in] str String to intern.
+ * @param[in] len Length of the string to intern.
+ * @return Interned string, NULL on memory allocation failure.
+ */
+const char* nc_str_intern(const char* str, size_t len);
+
+/**
+ * @brief Find the interned copy of the string without interning it.
+ *
+ * @param[in] str String to find.
+ * @param[in] len Length of the string.
+ * @return Interned string, NULL if the string was never interned.
+ */
+const char* nc_str_interned(const char* str, size_t len);
+
+/**
+ * @brief Evaluate the XPath expression in the given context.
+ *
+ * The expression is compiled when it is used for the first time and the
+ * compiled form is kept until nc_close(), so only fixed expressions (or
+ * expressions from a small fixed set) are supposed to be evaluated this way.
+ *
+ * @param[in] expr XPath expression.
+ * @param[in] ctxt XPath context to evaluate the expression in.
+ * @return Result of the evaluation as xmlXPathEvalExpression() provides it.
+ */
+xmlXPathObjectPtr nc_xpath_eval(const char* expr, xmlXPathContextPtr ctxt);
+
 /**
  * @brief Get a copy of the given string without whitespaces.
  *
@@ -561,6 +790,55 @@ char* nc_clrwspace (const char* in);
  */
 void nc_clip_occurences_with(char *str, char sought, char replacement);
 
+/**
+ * @brief Scoped allocator for the temporary objects of a single request. The
+ * memory is taken from larger blocks and it is released all at once by
+ * nc_arena_free(), particular allocations are never freed separately.
+ * The structure is initiated by zeroing it.
+ */
+struct nc_arena {
+	struct nc_arena_block* blocks;
+};
+
+/**
+ * @brief Allocate memory from the arena.
+ * @param[in] arena Arena to allocate from.
+ * @param[in] size Size of the requested memory.
+ * @return Memory aligned for any type, valid until nc_arena_free(), NULL on
+ * error.
+ */
+void* nc_arena_alloc(struct nc_arena* arena, size_t size);
+
+/**
+ * @brief Copy the first len bytes of the string into the arena.
+ * @return Null-terminated copy, NULL on error.
+ */
+char* nc_arena_strndup(struct nc_arena* arena, const char* str, size_t len);
+
+/**
+ * @brief Release all the memory allocated from the arena, the arena can be
+ * used again afterwards.
+ * @param[in] arena Arena to clean.
+ */
+void nc_arena_free(struct nc_arena* arena);
+
+struct ncdflt_defaults;
+
+/**
+ * @brief Precompute the default values (and the choices and presence containers
+ * affecting them) defined in the configuration data model.
+ * @param[in] model Configuration data model (YIN format).
+ * @return Precomputed defaults to be freed by ncdflt_defaults_free(), NULL on
+ * error.
+ */
+struct ncdflt_defaults* ncdflt_defaults_build(const xmlDocPtr model);
+
+/**
+ * @brief Free the defaults precomputed by ncdflt_defaults_build().
+ * @param[in] defaults Precomputed defaults, NULL is accepted.
+ */
+void ncdflt_defaults_free(struct ncdflt_defaults* defaults);
+
 /**
  * @brief Process config data according to with-defaults' mode and data model
  * @param[in] config XML configuration data document in which the default values will
@@ -578,9 +856,12 @@ int ncdflt_default_values(xmlDocPtr config, const xmlDocPtr model, NCWD_MODE mod
  *
  * @param[in] config XML configuration data document from which the default nodes
  * will removed
+ * @param[in] model Configuration data model for the data given in the config
+ * parameter. If its defaults are precomputed, only the nodes where the model
+ * defines default values are searched, otherwise the whole document is.
  * @return 0 on success, non-zero else.
  */
-int ncdflt_default_clear(xmlDocPtr config);
+int ncdflt_default_clear(xmlDocPtr config, const xmlDocPtr model);
 
 /**
  * @brief Replace tagged default values in edit-config's configuration data with
@@ -666,6 +947,48 @@ void ncntf_dispatch_stop(struct nc_session *session);
 
 #endif /* DISABLE_NOTIFICATIONS */
 
+/**
+ * @brief Send the already serialized \<notification\> message.
+ *
+ * @param[in] session Session to send the notification.
+ * @param[in] text Serialized XML document of the notification.
+ * @param[in] len Length of the text.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int nc_session_send_notif_text(struct nc_session* session, const char* text, size_t len);
+
+/**
+ * @brief Send the already serialized message.
+ *
+ * @param[in] session Session to send the message.
+ * @param[in] text Serialized XML document of the message.
+ * @param[in] len Length of the text.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int nc_session_send_text(struct nc_session* session, const char* text, size_t len);
+
+/**
+ * @brief Frame the already serialized \<notification\> message and keep it in
+ * the session's notification buffer until nc_session_flush_notif() is called.
+ * A message too large to be buffered is sent immediately after the buffered
+ * ones.
+ *
+ * @param[in] session Session to send the notification.
+ * @param[in] text Serialized XML document of the notification.
+ * @param[in] len Length of the text.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int nc_session_queue_notif_text(struct nc_session* session, const char* text, size_t len);
+
+/**
+ * @brief Write all the notifications buffered by nc_session_queue_notif_text()
+ * at once.
+ *
+ * @param[in] session Session to flush.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int nc_session_flush_notif(struct nc_session* session);
+
 /**
  * @brief internal values for nc_init_flags variable
  */
@@ -680,6 +1003,40 @@ void ncds_cleanall();
 int nc_session_monitoring_init(void);
 void nc_session_monitoring_close(void);
 
+/**
+ * @brief Forget the server capabilities and \<hello\> shared by the accepted sessions.
+ */
+void nc_server_hello_cleanup(void);
+
+/**
+ * @brief Release the freed message structures kept for reuse.
+ */
+void nc_msg_pool_cleanup(void);
+
+/**
+ * @brief Remove the session from the pool of the SSH connections before
+ * closing it. If the session was pooled, the pool stays locked until
+ * nc_session_pool_release() is called.
+ * @return 1 if the session was pooled, 0 otherwise.
+ */
+int nc_session_pool_leave(struct nc_session* session);
+
+/**
+ * @brief Unlock the pool of the SSH connections locked by nc_session_pool_leave().
+ */
+void nc_session_pool_release(void);
+
+/**
+ * @brief Forget the pool of the client's SSH connections.
+ */
+void nc_session_pool_cleanup(void);
+
+/**
+ * @brief Get the number changed whenever the set of data models or their enabled
+ * features changes.
+ */
+unsigned int ncds_models_version(void);
+
 const struct data_model* ncds_get_model_data(const char* namespace);
 const struct data_model* ncds_get_model_operation(const char* operation, const char* namespace);
 const struct data_model* ncds_get_model_notification(const char* notification, const char* namespace);
@@ -42,9 +42,12 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <assert.h>
@@ -56,6 +59,8 @@
 #include <poll.h>
 #include <pthread.h>
 
+#include <zlib.h>
+
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
@@ -76,6 +81,13 @@ static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 /* sleep time in dispatch loops in microseconds */
 #define NCNTF_DISPATCH_SLEEP 10000
 
+/* maximal time in seconds the dispatcher waits for a new event */
+#define NCNTF_DISPATCH_WAIT 1
+
+/* batching of the sent notifications, disabled by default */
+static size_t dispatch_batch_size = 0;
+static unsigned int dispatch_batch_latency = 0;
+
 /* path to the Event stream files, the default path is defined in config.h */
 static char* streams_path = NULL;
 
@@ -84,11 +96,16 @@ extern struct nc_shared_info *nc_info;
 
 struct stream_offset {
 	const char* stream;
+	uint32_t eof_seq;
 	off_t eof_offset;
+	uint32_t cur_seq;
 	off_t cur_offset;
+	struct stream *segment; /* opened older segment of the stream */
 	struct stream_offset* next;
 };
 
+static void ncntf_stream_free(struct stream *s);
+
 static pthread_key_t ncntf_replay_ends;
 static pthread_once_t ncntf_replay_ends_once = PTHREAD_ONCE_INIT;
 static void ncntf_replay_ends_init(void)
@@ -103,6 +120,7 @@ static void ncntf_replay_ends_free(void* data)
 	while (list != NULL) {
 		item = list;
 		list = list->next;
+		ncntf_stream_free(item->segment);
 		free(item);
 	}
 }
@@ -117,24 +135,120 @@ static void ncntf_replay_ends_free(void* data)
  * char[len2] description;
  * uint8_t replay;
  * uint64_t (time_t meaning) created;
+ * uint32_t seq; - sequence number of the segment (since 0xff02)
+ * uint32_t first; - sequence number of the oldest kept segment (since 0xff02)
+ * uint64_t (time_t meaning) aged; - the latest event dropped from the log (since 0xff02)
+ * uint64_t (time_t meaning) started; - start of the segment (since 0xff02)
  * char[] records;
  *
+ * The stream file <name>.events is the current segment of the log. When
+ * a retention is set for the stream, the current segment is rotated to
+ * <name>.events.<seq> file and a new one is started. The old segments are
+ * dropped (or moved into the archive directory) when they exceed the size or
+ * age limits. The values of first and aged are kept up-to-date only in the
+ * current segment.
+ *
+ * RECORD FORMAT
+ * int32_t len; - length of the notification text including its terminating
+ *                null byte, the negated length of the record data for
+ *                the compact record
+ * uint64_t (time_t meaning) time; - the event time
+ * char[len] text; - the notification text
+ *
+ * or the compact record (see ncntf_stream_set_format()):
+ * int32_t -len;
+ * uint64_t (time_t meaning) time;
+ * uint32_t size; - length of the notification text including its terminating null byte
+ * uint16_t flags; - RECORD_DEFLATE if the text is compressed by zlib
+ * uint16_t len1;
+ * uint16_t len2;
+ * char[len1] name; - name of the event (the root element of its content)
+ * char[len2] namespace; - namespace of the event, empty if not known
+ * char[] text; - the rest of the len bytes of the record data
+ *
+ * The length and time make the same prefix of both record types, so the
+ * records can be skipped and filtered by time without knowing their type.
+ * The older libnetconf versions stop reading at the first compact record.
  */
 
 /* magic bytes to recognize libnetconf's stream files */
 #define MAGIC_NAME "NCSTREAM"
-#define MAGIC_VERSION 0xFF01
+#define MAGIC_VERSION 0xFF02
+
+/* size of the seq, first, aged and started header tail and of its variable part */
+#define HEADER_TAIL_SIZE (2 * sizeof(uint32_t) + 2 * sizeof(uint64_t))
+#define HEADER_TAIL_VAR_OFFSET (sizeof(uint32_t))
+#define HEADER_TAIL_VAR_SIZE (sizeof(uint32_t) + sizeof(uint64_t))
+
+/* size of the length and time prefix of every record */
+#define RECORD_PREFIX_SIZE (sizeof(int32_t) + sizeof(uint64_t))
+/* size of the fixed part of the compact record data (size, flags, len1 and len2) */
+#define RECORD_COMPACT_SIZE (sizeof(uint32_t) + 3 * sizeof(uint16_t))
+/* compact record flags */
+#define RECORD_DEFLATE 0x0001
+/* the shorter notification texts are not worth compressing */
+#define RECORD_DEFLATE_MIN 256
+
+/* size of the blocks of the stream file read by ncntf_stream_scan() */
+#define NCNTF_SCAN_BLOCK (64*1024)
+
+/* number of segments the retention limits are divided into */
+#define NCNTF_SEGMENTS 4
+
+/*
+ * STREAM INDEX FILE FORMAT
+ * uint64_t (time_t meaning) created; - this must correspond with the stream file
+ * uint64_t (time_t meaning) max; - the latest event time of the stored records
+ * uint64_t last; - offset of the last indexed record
+ * struct stream_index_entry[] entries;
+ *
+ * The entry is added for the first record stored at least NCNTF_INDEX_GAP bytes
+ * after the previously indexed record. The entry's time is the latest event
+ * time of all the records preceding the entry's offset, so the entries are
+ * sorted by both members even if the events are not stored chronologically.
+ * The index file shorter than its header is invalid and it is not used.
+ */
+#define NCNTF_INDEX_GAP (64*1024)
+
+struct stream_index_header {
+	uint64_t created;
+	uint64_t max;
+	uint64_t last;
+};
+
+struct stream_index_entry {
+	uint64_t time;
+	uint64_t offset;
+};
 
 struct stream {
 	int fd_events;
 	int fd_rules;
+	int fd_index;
 	char* name;
 	char* desc;
 	uint8_t replay;
 	time_t created;
 	int locked;
+	pthread_mutex_t lock;
 	char* rules;
 	unsigned int data;
+	uint16_t version;
+	ino_t ino;
+	uint32_t seq;
+	uint32_t first;
+	time_t aged;
+	time_t started;
+	/* retention limits, 0 for unlimited */
+	off_t max_size;
+	time_t max_age;
+	char* archive;
+	time_t checked;
+	/* format of the stored records */
+	NCNTF_RECORD_FORMAT format;
+	/* notification of the subscribers about the new events */
+	pthread_cond_t notify;
+	unsigned int generation;
 	struct stream *next;
 };
 
@@ -145,8 +259,22 @@ static xmlDocPtr ncntf_config = NULL;
 static struct stream *streams = NULL;
 static pthread_mutex_t *streams_mut = NULL;
 
+/* mutex for the streams' notify conditions and generations */
+static pthread_mutex_t notify_mut = PTHREAD_MUTEX_INITIALIZER;
+
+/* watcher of the stream files modified by other processes */
+static pthread_mutex_t watch_mut = PTHREAD_MUTEX_INITIALIZER;
+static int watch_fd = -1;
+static pid_t watch_pid = 0;
+static pthread_t watch_thread;
+
 /* local function declaration */
 static int ncntf_event_isallowed(const char* stream, const char* event);
+static int ncntf_stream_lock(struct stream *s);
+static int ncntf_stream_unlock(struct stream *s);
+static void shared_events_free(void);
+static char* ncntf_event_name(const char* content);
+static char* ncntf_event_ns(const char* content);
 
 /*
  * Modify the given list of files in the specified directory to keep only
@@ -307,6 +435,11 @@ static xmlDocPtr streams_to_xml(void)
 			time = nc_time2datetime(s->created, NULL);
 			xmlNewChild(node_stream, NULL, BAD_CAST "replayLogCreationTime", BAD_CAST time);
 			free (time);
+			if (s->aged != 0) {
+				time = nc_time2datetime(s->aged, NULL);
+				xmlNewChild(node_stream, NULL, BAD_CAST "replayLogAgedTime", BAD_CAST time);
+				free (time);
+			}
 		}
 	}
 
@@ -374,57 +507,360 @@ static int map_rules(struct stream *s)
 }
 
 /*
- * Create a new stream file and write the header corresponding to the given
- * stream structure. If the file is already opened (the stream structure has a file
- * descriptor), it only rewrites the header of the file. All data from the
- * existing file are lost!
+ * Get the path of the stream file with the given suffix ("events" or "index").
+ * For a negative seq, the path of the current segment is returned, otherwise
+ * the path of the rotated segment with the sequence number seq.
+ */
+static char* stream_filepath(const char* name, const char* suffix, long seq)
+{
+	char* filepath = NULL;
+	int r;
+
+	if (seq < 0) {
+		r = asprintf(&filepath, "%s/%s.%s", streams_path, name, suffix);
+	} else {
+		r = asprintf(&filepath, "%s/%s.%s.%ld", streams_path, name, suffix, seq);
+	}
+	if (r == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	return (filepath);
+}
+
+/*
+ * Stop using the stream index file after a failed write, the index is possibly
+ * inconsistent. Truncating the file makes it invalid also for other processes.
+ */
+/* the fixed part of the compact record data */
+struct record_compact {
+	uint32_t size;
+	uint16_t flags;
+	uint16_t name_len;
+	uint16_t ns_len;
+	size_t text_offset; /* offset of the (compressed) text in the record data */
+	size_t text_len; /* length of the (compressed) text */
+};
+
+/*
+ * Get the length of the record data following the record prefix with the
+ * given len member.
  *
- * returns 0 on success, non-zero value else
+ * returns the length, -1 if the len is invalid
  */
-static int write_fileheader(struct stream *s)
+static int32_t record_datalen(int32_t len)
 {
-	char* filepath = NULL, *header;
-	uint16_t len, version = MAGIC_VERSION;
-	mode_t mask;
-	uint64_t t;
+	if (len == INT32_MIN) {
+		return (-1);
+	}
+	return ((len < 0) ? -len : len);
+}
+
+/*
+ * Parse the fixed part of the compact record data of the given length, only
+ * its first RECORD_COMPACT_SIZE bytes are accessed.
+ *
+ * returns 0 on success, non-zero value if the record is corrupted
+ */
+static int record_compact_header(const char* data, size_t len, struct record_compact *rec)
+{
+	if (len < RECORD_COMPACT_SIZE) {
+		return (EXIT_FAILURE);
+	}
+	memcpy(&(rec->size), data, sizeof(uint32_t));
+	memcpy(&(rec->flags), data + sizeof(uint32_t), sizeof(uint16_t));
+	memcpy(&(rec->name_len), data + sizeof(uint32_t) + sizeof(uint16_t), sizeof(uint16_t));
+	memcpy(&(rec->ns_len), data + sizeof(uint32_t) + 2 * sizeof(uint16_t), sizeof(uint16_t));
+	rec->text_offset = RECORD_COMPACT_SIZE + rec->name_len + rec->ns_len;
+	if (rec->size == 0 || rec->text_offset > len) {
+		ERROR("Corrupted event record in the stream file.");
+		return (EXIT_FAILURE);
+	}
+	rec->text_len = len - rec->text_offset;
+
+	return (EXIT_SUCCESS);
+}
+
+/*
+ * Get the notification text of the compact record from its whole record data.
+ *
+ * returns the text that is supposed to be freed by the caller, NULL if the
+ * record is corrupted
+ */
+static char* record_compact_text(const char* data, const struct record_compact *rec)
+{
+	char* text;
+	uLongf size = rec->size;
+
+	if ((text = malloc(rec->size)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	if (rec->flags & RECORD_DEFLATE) {
+		if (uncompress((Bytef*)text, &size, (const Bytef*)(data + rec->text_offset), rec->text_len) != Z_OK) {
+			size = 0;
+		}
+	} else if (rec->text_len == rec->size) {
+		memcpy(text, data + rec->text_offset, rec->size);
+	} else {
+		size = 0;
+	}
+	if (size != rec->size || text[size - 1] != '\0') {
+		ERROR("Corrupted event record in the stream file.");
+		free(text);
+		return (NULL);
+	}
+
+	return (text);
+}
+
+/*
+ * Create the whole compact record of the event. If deflate is set, the
+ * notification text is compressed unless it is too short or the compression
+ * does not pay off.
+ *
+ * returns the record that is supposed to be freed by the caller, NULL on error
+ */
+static char* record_compact_new(uint64_t etime, const char* text, uint32_t size, const char* name, const char* ns,
+		int deflate, size_t *reclen)
+{
+	char *record, *data;
+	uint16_t name_len, ns_len, flags = 0;
+	uLongf zlen;
+	size_t offset, len;
+	int32_t rlen;
+
+	name_len = (uint16_t)strlen(name);
+	ns_len = (uint16_t)strlen(ns);
+	offset = RECORD_PREFIX_SIZE + RECORD_COMPACT_SIZE + name_len + ns_len;
+	zlen = deflate ? compressBound(size) : 0;
+	if ((record = malloc(offset + ((zlen > size) ? zlen : size))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	if (deflate && size >= RECORD_DEFLATE_MIN &&
+			compress2((Bytef*)(record + offset), &zlen, (const Bytef*)text, size, Z_DEFAULT_COMPRESSION) == Z_OK &&
+			zlen < size) {
+		flags |= RECORD_DEFLATE;
+		len = zlen;
+	} else {
+		memcpy(record + offset, text, size);
+		len = size;
+	}
+
+	rlen = -(int32_t)(offset - RECORD_PREFIX_SIZE + len);
+	memcpy(record, &rlen, sizeof(int32_t));
+	memcpy(record + sizeof(int32_t), &etime, sizeof(uint64_t));
+	data = record + RECORD_PREFIX_SIZE;
+	memcpy(data, &size, sizeof(uint32_t));
+	memcpy(data + sizeof(uint32_t), &flags, sizeof(uint16_t));
+	memcpy(data + sizeof(uint32_t) + sizeof(uint16_t), &name_len, sizeof(uint16_t));
+	memcpy(data + sizeof(uint32_t) + 2 * sizeof(uint16_t), &ns_len, sizeof(uint16_t));
+	memcpy(data + RECORD_COMPACT_SIZE, name, name_len);
+	memcpy(data + RECORD_COMPACT_SIZE + name_len, ns, ns_len);
+
+	*reclen = offset + len;
+	return (record);
+}
+
+static void index_invalidate(struct stream *s)
+{
+	WARN("Writing the Events stream index file of \'%s\' failed (%s).", s->name, strerror(errno));
+	if (ftruncate(s->fd_index, 0) == -1) {
+		ERROR("ftruncate() on the stream index file \'%s\' failed (%s).", s->name, strerror(errno));
+	}
+}
+
+/*
+ * Update the stream index according to the record stored at the offset of the
+ * stream file. The stream file must be locked.
+ */
+static void index_add(struct stream *s, off_t offset, uint64_t etime)
+{
+	struct stream_index_header h;
+	struct stream_index_entry e;
+	int changed = 0;
 	ssize_t r;
-	size_t hlen = 0, offset = 0;
 
-	/* check used variables */
-	assert(s != NULL);
-	assert(s->name != NULL);
+	if (s->fd_index == -1 || pread(s->fd_index, &h, sizeof(h), 0) != sizeof(h)) {
+		/* the index is not available */
+		return;
+	}
 
-	if (streams_path == NULL) {
-		return (EXIT_FAILURE);
+	if (h.last == 0) {
+		/* the first record, there is nothing to skip before it */
+		h.last = (uint64_t)offset;
+		changed = 1;
+	} else if ((uint64_t)offset >= h.last + NCNTF_INDEX_GAP) {
+		e.time = h.max;
+		e.offset = (uint64_t)offset;
+		lseek(s->fd_index, 0, SEEK_END);
+		while (((r = write(s->fd_index, &e, sizeof(e))) == -1) && (errno == EAGAIN ||errno == EINTR));
+		if (r != sizeof(e)) {
+			index_invalidate(s);
+			return;
+		}
+		h.last = (uint64_t)offset;
+		changed = 1;
+	}
+	if (etime > h.max) {
+		h.max = etime;
+		changed = 1;
 	}
 
-	/* check if the corresponding file is already opened */
-	if (s->fd_events == -1) {
-		/* open and create/truncate the file */
-		if (asprintf(&filepath, "%s/%s.events", streams_path, s->name) == -1) {
-			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
-			return (EXIT_FAILURE);
+	if (changed && pwrite(s->fd_index, &h, sizeof(h), 0) != sizeof(h)) {
+		index_invalidate(s);
+	}
+}
+
+/*
+ * Open the index file of the stream segment seq (the current segment for
+ * a negative seq). If the index does not correspond with the segment file (or
+ * the create flag is set), it is built again from the records of the segment.
+ * The stream is still usable without the index, only the replay is slower.
+ */
+static void index_open(struct stream *s, long seq, int create)
+{
+	char* filepath = NULL;
+	mode_t mask;
+	struct stream_index_header h;
+	struct stat st;
+	int32_t len;
+	uint64_t t;
+	off_t offset, end;
+	int locked;
+
+	if (s->fd_index == -1) {
+		if ((filepath = stream_filepath(s->name, "index", seq)) == NULL) {
+			return;
 		}
 		mask = umask(0000);
-		s->fd_events = open(filepath, O_RDWR | O_CREAT | O_TRUNC, FILE_PERM);
+		s->fd_index = open(filepath, O_RDWR | O_CREAT, FILE_PERM);
 		umask(mask);
-		if (s->fd_events == -1) {
-			ERROR("Unable to create the Events stream file %s (%s)", filepath, strerror(errno));
+		if (s->fd_index == -1) {
+			WARN("Unable to open the Events stream index file %s (%s).", filepath, strerror(errno));
 			free(filepath);
-			return (EXIT_FAILURE);
+			return;
 		}
 		free(filepath);
-	} else {
-		/* truncate the file */
-		if (ftruncate(s->fd_events, 0) == -1) {
-			ERROR("ftruncate() on the stream file \'%s\' failed (%s).", s->name, strerror(errno));
-			return (EXIT_FAILURE);
+		filepath = NULL;
+	}
+
+	if (!create && pread(s->fd_index, &h, sizeof(h), 0) == sizeof(h) && h.created == (uint64_t)s->created &&
+			fstat(s->fd_index, &st) == 0 && (st.st_size - sizeof(h)) % sizeof(struct stream_index_entry) == 0) {
+		/* the index corresponds with the stream file */
+		return;
+	}
+
+	/* the caller can already hold the stream file lock */
+	if ((locked = s->locked) == 0 && ncntf_stream_lock(s) != 0) {
+		close(s->fd_index);
+		s->fd_index = -1;
+		return;
+	}
+	if (seq < 0 && !create && ((filepath = stream_filepath(s->name, "events", -1)) == NULL ||
+			stat(filepath, &st) == -1 || st.st_ino != s->ino)) {
+		/* the segment was rotated meanwhile, its index is not ours */
+		free(filepath);
+		close(s->fd_index);
+		s->fd_index = -1;
+		if (!locked) {
+			ncntf_stream_unlock(s);
+		}
+		return;
+	}
+	free(filepath);
+	h.created = (uint64_t)s->created;
+	h.max = 0;
+	h.last = 0;
+	if (ftruncate(s->fd_index, 0) == -1 || pwrite(s->fd_index, &h, sizeof(h), 0) != sizeof(h)) {
+		index_invalidate(s);
+		if (!locked) {
+			ncntf_stream_unlock(s);
+		}
+		return;
+	}
+	if (!create) {
+		VERB("Building the Events stream index file of \'%s\'.", s->name);
+		end = lseek(s->fd_events, 0, SEEK_END);
+		for (offset = s->data; offset + (off_t)RECORD_PREFIX_SIZE <= end; offset += RECORD_PREFIX_SIZE + len) {
+			if (pread(s->fd_events, &len, sizeof(int32_t), offset) != sizeof(int32_t) ||
+					pread(s->fd_events, &t, sizeof(uint64_t), offset + sizeof(int32_t)) != sizeof(uint64_t) ||
+					(len = record_datalen(len)) < 0) {
+				break;
+			}
+			index_add(s, offset, t);
+		}
+	}
+	if (!locked) {
+		ncntf_stream_unlock(s);
+	}
+}
+
+/*
+ * Get the offset of the stream file where the records with the event time not
+ * older than start can appear, using the stream index. Only the records before
+ * the end offset are considered and the returned offset is never lower than
+ * from. The stream file must be locked.
+ */
+static off_t index_seek(struct stream *s, time_t start, off_t from, off_t end)
+{
+	struct stream_index_header h;
+	struct stream_index_entry e;
+	off_t size, ret = from;
+	uint64_t lo, hi, mid;
+
+	if (s->fd_index == -1 || start <= 0) {
+		return (from);
+	}
+	size = lseek(s->fd_index, 0, SEEK_END);
+	if (size < (off_t)sizeof(h) || (size - sizeof(h)) % sizeof(e) != 0 ||
+			pread(s->fd_index, &h, sizeof(h), 0) != sizeof(h)) {
+		/* invalid index */
+		return (from);
+	}
+	if (h.max < (uint64_t)start) {
+		/* all the records are older */
+		return ((end > from) ? end : from);
+	}
+
+	/* find the last entry preceded only by the records older than start */
+	lo = 0;
+	hi = (size - sizeof(struct stream_index_header)) / sizeof(e);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (pread(s->fd_index, &e, sizeof(e), sizeof(struct stream_index_header) + mid * sizeof(e)) != sizeof(e)) {
+			return (from);
+		}
+		if (e.time < (uint64_t)start && e.offset < (uint64_t)end) {
+			ret = (off_t)e.offset;
+			lo = mid + 1;
+		} else {
+			hi = mid;
 		}
-		lseek(s->fd_events, 0, SEEK_SET);
 	}
 
+	return ((ret > from) ? ret : from);
+}
+
+/*
+ * Write the file header corresponding to the given stream structure into the
+ * (empty) stream file fd.
+ *
+ * returns 0 on success, non-zero value else
+ */
+static int write_header(int fd, const struct stream *s)
+{
+	char *header;
+	uint16_t len, version = MAGIC_VERSION;
+	uint32_t seq;
+	uint64_t t;
+	ssize_t r;
+	size_t hlen = 0, offset = 0;
+
 	/* prepare the header */
-	hlen = strlen(MAGIC_NAME) + ((s->desc == NULL) ? 0 : strlen(s->desc)) + strlen(s->name) + sizeof(uint8_t) + (3 * sizeof(uint16_t)) + sizeof(uint64_t) + 2;
+	hlen = strlen(MAGIC_NAME) + ((s->desc == NULL) ? 0 : strlen(s->desc)) + strlen(s->name) + sizeof(uint8_t) + (3 * sizeof(uint16_t)) + sizeof(uint64_t) + HEADER_TAIL_SIZE + 2;
 	header = malloc(hlen);
 
 	/* magic bytes */
@@ -466,16 +902,30 @@ static int write_fileheader(struct stream *s)
 	memcpy(header + offset, &t, sizeof(uint64_t));
 	offset += sizeof(uint64_t);
 
+	/* segments */
+	seq = s->seq;
+	memcpy(header + offset, &seq, sizeof(uint32_t));
+	offset += sizeof(uint32_t);
+	seq = s->first;
+	memcpy(header + offset, &seq, sizeof(uint32_t));
+	offset += sizeof(uint32_t);
+	t = (uint64_t) s->aged;
+	memcpy(header + offset, &t, sizeof(uint64_t));
+	offset += sizeof(uint64_t);
+	t = (uint64_t) s->started;
+	memcpy(header + offset, &t, sizeof(uint64_t));
+	offset += sizeof(uint64_t);
+
 	/* check expected and prepared length */
 	if (offset != hlen) {
 		WARN("%s: prepared stream file header length differs from the expected length (%zd:%zd)", __func__, offset, hlen);
 	}
 
 	/* write the header */
-	while (((r = write(s->fd_events, header, offset)) == -1) && (errno == EAGAIN ||errno == EINTR));
+	while (((r = write(fd, header, offset)) == -1) && (errno == EAGAIN ||errno == EINTR));
 	if (r == -1) {
 		WARN("Writing a stream event file header failed (%s).", strerror(errno));
-		if (ftruncate(s->fd_events, 0) == -1) {
+		if (ftruncate(fd, 0) == -1) {
 			ERROR("ftruncate() on stream file \'%s\' failed (%s).", s->name, strerror(errno));
 		}
 		free(header);
@@ -483,8 +933,68 @@ static int write_fileheader(struct stream *s)
 	}
 	free(header);
 
+	return (EXIT_SUCCESS);
+}
+
+/*
+ * Create a new stream file and write the header corresponding to the given
+ * stream structure. If the file is already opened (the stream structure has a file
+ * descriptor), it only rewrites the header of the file. All data from the
+ * existing file are lost!
+ *
+ * returns 0 on success, non-zero value else
+ */
+static int write_fileheader(struct stream *s)
+{
+	char* filepath = NULL;
+	mode_t mask;
+	struct stat st;
+
+	/* check used variables */
+	assert(s != NULL);
+	assert(s->name != NULL);
+
+	if (streams_path == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	/* check if the corresponding file is already opened */
+	if (s->fd_events == -1) {
+		/* open and create/truncate the file */
+		if ((filepath = stream_filepath(s->name, "events", -1)) == NULL) {
+			return (EXIT_FAILURE);
+		}
+		mask = umask(0000);
+		s->fd_events = open(filepath, O_RDWR | O_CREAT | O_TRUNC, FILE_PERM);
+		umask(mask);
+		if (s->fd_events == -1) {
+			ERROR("Unable to create the Events stream file %s (%s)", filepath, strerror(errno));
+			free(filepath);
+			return (EXIT_FAILURE);
+		}
+		free(filepath);
+	} else {
+		/* truncate the file */
+		if (ftruncate(s->fd_events, 0) == -1) {
+			ERROR("ftruncate() on the stream file \'%s\' failed (%s).", s->name, strerror(errno));
+			return (EXIT_FAILURE);
+		}
+		lseek(s->fd_events, 0, SEEK_SET);
+	}
+
+	if (write_header(s->fd_events, s) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
 	/* set where the data starts */
 	s->data = lseek(s->fd_events, 0, SEEK_CUR);
+	s->version = MAGIC_VERSION;
+	if (fstat(s->fd_events, &st) == 0) {
+		s->ino = st.st_ino;
+	}
+
+	/* start a new index of the records */
+	index_open(s, -1, 1);
 
 	return (EXIT_SUCCESS);
 }
@@ -501,7 +1011,9 @@ static struct stream *read_fileheader(const char* filepath)
 	char magic_name[strlen(MAGIC_NAME)];
 	uint16_t magic_number;
 	uint16_t len;
+	uint32_t seq;
 	uint64_t t;
+	struct stat st;
 	int r;
 
 	/* open the file */
@@ -520,6 +1032,7 @@ static struct stream *read_fileheader(const char* filepath)
 	}
 	if (strncmp(magic_name, MAGIC_NAME, strlen(MAGIC_NAME)) != 0) {
 		/* file is not of libnetconf's stream file format */
+		close(fd);
 		free(s);
 		return (NULL);
 	}
@@ -554,9 +1067,44 @@ static struct stream *read_fileheader(const char* filepath)
 	}
 	s->created = (time_t)t;
 
+	s->version = magic_number;
+	s->seq = 0;
+	s->first = 0;
+	s->aged = 0;
+	s->started = s->created;
+	if (magic_number == MAGIC_VERSION) {
+		/* read the segments information */
+		if ((r = read(s->fd_events, &seq, sizeof(uint32_t))) <= 0) {
+			goto read_fail;
+		}
+		s->seq = seq;
+		if ((r = read(s->fd_events, &seq, sizeof(uint32_t))) <= 0) {
+			goto read_fail;
+		}
+		s->first = seq;
+		if ((r = read(s->fd_events, &(t), sizeof(uint64_t))) <= 0) {
+			goto read_fail;
+		}
+		s->aged = (time_t)t;
+		if ((r = read(s->fd_events, &(t), sizeof(uint64_t))) <= 0) {
+			goto read_fail;
+		}
+		s->started = (time_t)t;
+	}
+	s->ino = (fstat(s->fd_events, &st) == 0) ? st.st_ino : 0;
+
 	s->locked = 0;
+	pthread_mutex_init(&(s->lock), NULL);
+	pthread_cond_init(&(s->notify), NULL);
+	s->generation = 0;
 	s->rules = NULL;
 	s->fd_rules = -1;
+	s->fd_index = -1;
+	s->max_size = 0;
+	s->max_age = 0;
+	s->archive = NULL;
+	s->checked = 0;
+	s->format = NCNTF_RECORD_XML;
 	s->next = NULL;
 
 	/* move to the end of the file */
@@ -589,6 +1137,12 @@ static void ncntf_stream_free(struct stream *s)
 	if (s->fd_events != -1) {
 		close(s->fd_events);
 	}
+	if (s->fd_index != -1) {
+		close(s->fd_index);
+	}
+	free(s->archive);
+	pthread_mutex_destroy(&(s->lock));
+	pthread_cond_destroy(&(s->notify));
 	free(s);
 }
 
@@ -623,6 +1177,8 @@ static struct stream* ncntf_stream_get(const char* stream)
 			return (NULL);
 		}
 		if (((s = read_fileheader(filepath)) != NULL) && (map_rules(s) == 0)) {
+			/* open (or build) the index of the records */
+			index_open(s, -1, 0);
 			/* add the stream file into the stream list */
 			s->next = streams;
 			streams = s;
@@ -638,50 +1194,583 @@ static struct stream* ncntf_stream_get(const char* stream)
 }
 
 /*
- * Lock the stream file to avoid concurrent writing/reading from different
- * processes.
+ * Lock (cmd F_LOCK) or unlock (cmd F_ULOCK) the whole stream file to avoid
+ * concurrent writing/reading from different processes.
  */
-static int ncntf_stream_lock(struct stream *s)
+static int stream_file_lock(int fd, int cmd)
 {
 	off_t offset;
+	int ret = EXIT_SUCCESS;
 
 	/* this will be blocking, but all these locks should be short-term */
-	offset = lseek(s->fd_events, 0, SEEK_CUR);
-	lseek(s->fd_events, 0, SEEK_SET);
-	if (lockf(s->fd_events, F_LOCK, 0) == -1) {
-		lseek(s->fd_events, offset, SEEK_SET);
-		ERROR("Stream file locking failed (%s).", strerror(errno));
+	offset = lseek(fd, 0, SEEK_CUR);
+	lseek(fd, 0, SEEK_SET);
+	if (lockf(fd, cmd, 0) == -1) {
+		ERROR("Stream file %s failed (%s).", (cmd == F_ULOCK) ? "unlocking" : "locking", strerror(errno));
+		ret = EXIT_FAILURE;
+	}
+	lseek(fd, offset, SEEK_SET);
+	return (ret);
+}
+
+/*
+ * Lock the stream to avoid concurrent writing/reading from different threads
+ * and processes.
+ */
+static int ncntf_stream_lock(struct stream *s)
+{
+	pthread_mutex_lock(&(s->lock));
+	if (stream_file_lock(s->fd_events, F_LOCK) != EXIT_SUCCESS) {
+		pthread_mutex_unlock(&(s->lock));
 		return (EXIT_FAILURE);
 	}
-	lseek(s->fd_events, offset, SEEK_SET);
 	s->locked = 1;
 	return (EXIT_SUCCESS);
 }
 
 /*
- * Unlock the stream file after reading/writing
+ * Unlock the stream after reading/writing
  */
 static int ncntf_stream_unlock(struct stream *s)
 {
-	off_t offset;
+	int ret;
 
 	if (s->locked == 0) {
 		/* nothing to do */
 		return (EXIT_SUCCESS);
 	}
 
-	offset = lseek(s->fd_events, 0, SEEK_CUR);
-	lseek(s->fd_events, 0, SEEK_SET);
-	if (lockf(s->fd_events, F_ULOCK, 0) == -1) {
-		lseek(s->fd_events, offset, SEEK_SET);
-		ERROR("Stream file unlocking failed (%s).", strerror(errno));
-		return (EXIT_FAILURE);
-	}
-	lseek(s->fd_events, offset, SEEK_SET);
+	ret = stream_file_lock(s->fd_events, F_ULOCK);
 	s->locked = 0;
+	pthread_mutex_unlock(&(s->lock));
+	return (ret);
+}
+
+/*
+ * Wake up all the subscribers waiting for a new event in the stream.
+ */
+static void stream_notify(struct stream *s)
+{
+	pthread_mutex_lock(&notify_mut);
+	s->generation++;
+	pthread_cond_broadcast(&(s->notify));
+	pthread_mutex_unlock(&notify_mut);
+}
+
+/*
+ * Get the current generation of the stream used by stream_wait() to detect
+ * events stored meanwhile. It must be obtained before reading the stream.
+ */
+static unsigned int stream_generation(struct stream *s)
+{
+	unsigned int generation;
+
+	pthread_mutex_lock(&notify_mut);
+	generation = s->generation;
+	pthread_mutex_unlock(&notify_mut);
+
+	return (generation);
+}
+
+/*
+ * Wait until a new event is stored into the stream (the stream generation
+ * differs from the given one), until the given time (-1 for no limit) or at
+ * most NCNTF_DISPATCH_WAIT seconds. If the stream files are not watched,
+ * events stored by other processes are not notified, so the wait is cut to
+ * NCNTF_DISPATCH_SLEEP.
+ */
+static void stream_wait(struct stream *s, unsigned int generation, time_t until)
+{
+	struct timespec ts;
+	int watched;
+
+	pthread_mutex_lock(&watch_mut);
+	watched = (watch_fd != -1 && watch_pid == getpid());
+	pthread_mutex_unlock(&watch_mut);
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	if (watched) {
+		ts.tv_sec += NCNTF_DISPATCH_WAIT;
+		if (until != -1 && until < ts.tv_sec) {
+			ts.tv_sec = until;
+			ts.tv_nsec = 0;
+		}
+	} else {
+		ts.tv_nsec += NCNTF_DISPATCH_SLEEP * 1000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock(&notify_mut);
+	while (s->generation == generation) {
+		if (pthread_cond_timedwait(&(s->notify), &notify_mut, &ts) != 0) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&notify_mut);
+}
+
+/*
+ * Wake up the subscribers of all the streams, e.g. to let them notice
+ * the request to stop the dispatching.
+ */
+static void streams_notify(void)
+{
+	struct stream *s;
+
+	if (streams_mut == NULL) {
+		return;
+	}
+
+	DBG_LOCK("streams_mut");
+	pthread_mutex_lock(streams_mut);
+	for (s = streams; s != NULL; s = s->next) {
+		stream_notify(s);
+	}
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+}
+
+/*
+ * Thread reading the inotify events of the streams directory and waking up
+ * the subscribers of the streams modified by any process.
+ */
+static void* watch_loop(void* UNUSED(arg))
+{
+	char buf[sizeof(struct inotify_event) + NAME_MAX + 1] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	struct stream *s;
+	ssize_t r, i;
+	size_t len;
+
+	while (1) {
+		if ((r = read(watch_fd, buf, sizeof(buf))) <= 0) {
+			if (r == -1 && errno == EINTR) {
+				continue;
+			}
+			ERROR("Reading the Events streams directory changes failed (%s).", (r == -1) ? strerror(errno) : "Unexpected end of file");
+			break;
+		}
+
+		/* streams_mut must not be left locked by the cancelation */
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		DBG_LOCK("streams_mut");
+		pthread_mutex_lock(streams_mut);
+		for (i = 0; i < r; i += sizeof(struct inotify_event) + ev->len) {
+			ev = (struct inotify_event*)(buf + i);
+			if (ev->len == 0 || (len = strlen(ev->name)) <= strlen(".events") ||
+					strcmp(ev->name + len - strlen(".events"), ".events") != 0) {
+				/* not the current segment of a stream */
+				continue;
+			}
+			for (s = streams; s != NULL; s = s->next) {
+				if (strncmp(s->name, ev->name, len - strlen(".events")) == 0 && s->name[len - strlen(".events")] == '\0') {
+					stream_notify(s);
+					break;
+				}
+			}
+		}
+		DBG_UNLOCK("streams_mut");
+		pthread_mutex_unlock(streams_mut);
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Start watching the stream files for the events stored by other processes,
+ * the watch is shared by all the subscribers of the process.
+ */
+static int streams_watch_start(void)
+{
+	int ret = EXIT_SUCCESS;
+	int fd;
+
+	pthread_mutex_lock(&watch_mut);
+	if (watch_fd != -1 && watch_pid == getpid()) {
+		/* already watching */
+		goto cleanup;
+	}
+	if (watch_fd != -1) {
+		/* inherited from the parent process, the thread is not running */
+		close(watch_fd);
+		watch_fd = -1;
+	}
+
+	if ((fd = inotify_init1(IN_CLOEXEC)) == -1) {
+		WARN("Unable to watch the Events streams directory (%s).", strerror(errno));
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (inotify_add_watch(fd, streams_path, IN_MODIFY | IN_MOVED_TO) == -1) {
+		WARN("Unable to watch the Events streams directory %s (%s).", streams_path, strerror(errno));
+		close(fd);
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+	watch_fd = fd;
+	if ((errno = pthread_create(&watch_thread, NULL, watch_loop, NULL)) != 0) {
+		WARN("Unable to watch the Events streams directory (%s).", strerror(errno));
+		close(fd);
+		watch_fd = -1;
+		ret = EXIT_FAILURE;
+		goto cleanup;
+	}
+	watch_pid = getpid();
+
+cleanup:
+	pthread_mutex_unlock(&watch_mut);
+	return (ret);
+}
+
+/*
+ * Stop watching the stream files.
+ */
+static void streams_watch_stop(void)
+{
+	pthread_mutex_lock(&watch_mut);
+	if (watch_fd != -1 && watch_pid == getpid()) {
+		pthread_cancel(watch_thread);
+		pthread_join(watch_thread, NULL);
+	}
+	if (watch_fd != -1) {
+		close(watch_fd);
+		watch_fd = -1;
+	}
+	watch_pid = 0;
+	pthread_mutex_unlock(&watch_mut);
+}
+
+/*
+ * Update the status information of the streams after a change of a stream.
+ */
+static void streams_config_update(void)
+{
+	xmlDocPtr config;
+
+	DBG_LOCK("streams_mut");
+	pthread_mutex_lock(streams_mut);
+	if ((config = streams_to_xml()) != NULL) {
+		xmlFreeDoc(ncntf_config);
+		ncntf_config = config;
+	}
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+}
+
+/*
+ * Follow the rotation of the stream file made by another process. The stream
+ * file must be locked, the lock is moved to the new current segment.
+ */
+static void ncntf_stream_sync(struct stream *s)
+{
+	char* filepath;
+	struct stat st;
+	struct stream *cur;
+	char tail[HEADER_TAIL_VAR_SIZE];
+	uint32_t first;
+	uint64_t aged;
+
+	if ((filepath = stream_filepath(s->name, "events", -1)) == NULL) {
+		return;
+	}
+	while (stat(filepath, &st) == 0 && st.st_ino != s->ino) {
+		if ((cur = read_fileheader(filepath)) == NULL) {
+			break;
+		}
+		if (stream_file_lock(cur->fd_events, F_LOCK) != EXIT_SUCCESS) {
+			ncntf_stream_free(cur);
+			break;
+		}
+		/* switch to the new current segment */
+		stream_file_lock(s->fd_events, F_ULOCK);
+		close(s->fd_events);
+		s->fd_events = cur->fd_events;
+		s->data = cur->data;
+		s->version = cur->version;
+		s->ino = cur->ino;
+		s->seq = cur->seq;
+		s->started = cur->started;
+		cur->fd_events = -1;
+		ncntf_stream_free(cur);
+
+		if (s->fd_index != -1) {
+			close(s->fd_index);
+			s->fd_index = -1;
+		}
+		index_open(s, -1, 0);
+	}
+	free(filepath);
+
+	if (s->version == MAGIC_VERSION &&
+			pread(s->fd_events, tail, HEADER_TAIL_VAR_SIZE, s->data - HEADER_TAIL_SIZE + HEADER_TAIL_VAR_OFFSET) == HEADER_TAIL_VAR_SIZE) {
+		/* refresh the information about the kept segments */
+		memcpy(&first, tail, sizeof(uint32_t));
+		memcpy(&aged, tail + sizeof(uint32_t), sizeof(uint64_t));
+		s->first = first;
+		if (s->aged != (time_t)aged) {
+			s->aged = (time_t)aged;
+			streams_config_update();
+		}
+	}
+}
+
+/*
+ * Start a new segment of the stream if the current one reached the retention
+ * limits. The stream file must be locked, the lock is moved to the new current
+ * segment. Parameter reclen is the length of the record to be stored.
+ *
+ * returns 1 if the stream was rotated, 0 else
+ */
+static int ncntf_stream_rotate(struct stream *s, time_t now, size_t reclen)
+{
+	char *filepath = NULL, *segpath = NULL, *newpath = NULL, *idxpath = NULL, *idxsegpath = NULL;
+	struct stat st;
+	off_t end, data;
+	time_t started;
+	mode_t mask;
+	int fd, ret = 0;
+
+	end = lseek(s->fd_events, 0, SEEK_END);
+	if (end <= (off_t)s->data) {
+		/* nothing to rotate */
+		return (0);
+	}
+	if (!(s->max_size != 0 && end + (off_t)reclen > s->max_size / NCNTF_SEGMENTS) &&
+			!(s->max_age != 0 && s->started + s->max_age / NCNTF_SEGMENTS < now)) {
+		/* the current segment is still within the limits */
+		return (0);
+	}
+
+	if ((filepath = stream_filepath(s->name, "events", -1)) == NULL ||
+			(segpath = stream_filepath(s->name, "events", s->seq)) == NULL ||
+			(newpath = stream_filepath(s->name, "events.new", -1)) == NULL ||
+			(idxpath = stream_filepath(s->name, "index", -1)) == NULL ||
+			(idxsegpath = stream_filepath(s->name, "index", s->seq)) == NULL) {
+		goto cleanup;
+	}
+
+	/* keep the current segment under its sequence number */
+	if (link(filepath, segpath) == -1) {
+		WARN("Unable to rotate the Events stream file %s (%s).", filepath, strerror(errno));
+		goto cleanup;
+	}
+
+	/* prepare the new current segment, it is locked before it appears */
+	s->seq++;
+	started = s->started;
+	s->started = now;
+	mask = umask(0000);
+	fd = open(newpath, O_RDWR | O_CREAT | O_TRUNC, FILE_PERM);
+	umask(mask);
+	if (fd == -1 || write_header(fd, s) != EXIT_SUCCESS || (data = lseek(fd, 0, SEEK_CUR)) == -1 ||
+			fstat(fd, &st) == -1 || stream_file_lock(fd, F_LOCK) != EXIT_SUCCESS) {
+		WARN("Unable to create a new segment of the Events stream \'%s\' (%s).", s->name, strerror(errno));
+		goto revert;
+	}
+
+	/* keep the index with the segment, the new segment gets a new one */
+	if (s->fd_index != -1) {
+		if (link(idxpath, idxsegpath) == -1) {
+			WARN("Unable to keep the index of the Events stream segment %s (%s).", segpath, strerror(errno));
+		}
+		close(s->fd_index);
+		s->fd_index = -1;
+	}
+	unlink(idxpath);
+
+	if (rename(newpath, filepath) == -1) {
+		WARN("Unable to rotate the Events stream file %s (%s).", filepath, strerror(errno));
+		unlink(idxsegpath);
+		goto revert;
+	}
+
+	/* switch to the new current segment */
+	stream_file_lock(s->fd_events, F_ULOCK);
+	close(s->fd_events);
+	s->fd_events = fd;
+	s->data = data;
+	s->version = MAGIC_VERSION;
+	s->ino = st.st_ino;
+	lseek(s->fd_events, data, SEEK_SET);
+	index_open(s, -1, 1);
+
+	VERB("Events stream \'%s\' continues in the segment %u.", s->name, s->seq);
+	ret = 1;
+	goto cleanup;
+
+revert:
+	if (fd != -1) {
+		close(fd);
+		unlink(newpath);
+	}
+	unlink(segpath);
+	s->seq--;
+	s->started = started;
+	if (s->fd_index == -1) {
+		index_open(s, -1, 0);
+	}
+
+cleanup:
+	free(filepath);
+	free(segpath);
+	free(newpath);
+	free(idxpath);
+	free(idxsegpath);
+
+	return (ret);
+}
+
+/*
+ * Get the size and the latest event time of the rotated stream segment.
+ *
+ * returns 0 on success, non-zero value if the segment does not exist
+ */
+static int segment_info(const struct stream *s, uint32_t seq, off_t *size, time_t *last)
+{
+	char* filepath;
+	struct stat st;
+	struct stream_index_header h;
+	int fd, r;
+
+	if ((filepath = stream_filepath(s->name, "events", seq)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	r = stat(filepath, &st);
+	free(filepath);
+	if (r == -1) {
+		return (EXIT_FAILURE);
+	}
+	*size = st.st_size;
+
+	/* the last modification is close to the latest event, but ask the index */
+	*last = st.st_mtime;
+	if ((filepath = stream_filepath(s->name, "index", seq)) != NULL) {
+		if ((fd = open(filepath, O_RDONLY)) != -1) {
+			if (pread(fd, &h, sizeof(h), 0) == sizeof(h) && h.max != 0) {
+				*last = (time_t)h.max;
+			}
+			close(fd);
+		}
+		free(filepath);
+	}
+
 	return (EXIT_SUCCESS);
 }
 
+/*
+ * Remove the rotated stream segment or move it into the archive directory.
+ */
+static void segment_drop(const struct stream *s, uint32_t seq)
+{
+	const char* suffix[] = {"events", "index", NULL};
+	char *filepath, *archpath;
+	int i;
+
+	for (i = 0; suffix[i] != NULL; i++) {
+		if ((filepath = stream_filepath(s->name, suffix[i], seq)) == NULL) {
+			continue;
+		}
+		if (s->archive != NULL) {
+			if (asprintf(&archpath, "%s/%s.%s.%u", s->archive, s->name, suffix[i], seq) == -1) {
+				ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+			} else {
+				if (rename(filepath, archpath) == 0) {
+					free(archpath);
+					free(filepath);
+					continue;
+				}
+				if (errno != ENOENT) {
+					WARN("Unable to archive the Events stream segment %s (%s).", filepath, strerror(errno));
+				}
+				free(archpath);
+			}
+		}
+		if (unlink(filepath) == -1 && errno != ENOENT) {
+			WARN("Unable to remove the Events stream segment %s (%s).", filepath, strerror(errno));
+		}
+		free(filepath);
+	}
+}
+
+/*
+ * Drop the oldest rotated segments of the stream exceeding the retention
+ * limits. The stream file must be locked.
+ */
+static void ncntf_stream_retention(struct stream *s, time_t now)
+{
+	char tail[HEADER_TAIL_VAR_SIZE];
+	off_t size, total = 0;
+	time_t last;
+	uint32_t seq;
+	uint64_t aged;
+	int changed = 0;
+
+	if (s->first >= s->seq || s->version != MAGIC_VERSION) {
+		/* there are no rotated segments */
+		return;
+	}
+
+	if (s->max_size != 0) {
+		total = lseek(s->fd_events, 0, SEEK_END);
+		for (seq = s->first; seq < s->seq; seq++) {
+			if (segment_info(s, seq, &size, &last) == EXIT_SUCCESS) {
+				total += size;
+			}
+		}
+	}
+
+	for (; s->first < s->seq; s->first++) {
+		if (segment_info(s, s->first, &size, &last) == EXIT_SUCCESS) {
+			if ((s->max_size == 0 || total <= s->max_size) && (s->max_age == 0 || last + s->max_age >= now)) {
+				/* the oldest segment is within the limits */
+				break;
+			}
+			segment_drop(s, s->first);
+			total -= size;
+			if (last > s->aged) {
+				s->aged = last;
+			}
+		} /* else already dropped */
+		changed = 1;
+	}
+
+	if (changed) {
+		seq = s->first;
+		aged = (uint64_t)s->aged;
+		memcpy(tail, &seq, sizeof(uint32_t));
+		memcpy(tail + sizeof(uint32_t), &aged, sizeof(uint64_t));
+		if (pwrite(s->fd_events, tail, HEADER_TAIL_VAR_SIZE, s->data - HEADER_TAIL_SIZE + HEADER_TAIL_VAR_OFFSET) != HEADER_TAIL_VAR_SIZE) {
+			WARN("Updating the Events stream file header of \'%s\' failed (%s).", s->name, strerror(errno));
+		}
+		streams_config_update();
+	}
+}
+
+/*
+ * Open the rotated segment of the stream for reading.
+ *
+ * returns NULL if the segment does not exist (anymore)
+ */
+static struct stream* segment_open(const struct stream *s, uint32_t seq)
+{
+	char* filepath;
+	struct stream *seg = NULL;
+
+	if ((filepath = stream_filepath(s->name, "events", seq)) == NULL) {
+		return (NULL);
+	}
+	if (access(filepath, F_OK) == 0 && (seg = read_fileheader(filepath)) != NULL) {
+		index_open(seg, seq, 0);
+	}
+	free(filepath);
+
+	return (seg);
+}
+
 /*
  * Initiate the list of the available streams. It opens all the accessible stream files
  * from the stream directory.
@@ -693,6 +1782,7 @@ static int ncntf_stream_unlock(struct stream *s)
 static int ncntf_streams_init(void)
 {
 	int n;
+	size_t len;
 	struct dirent **filelist;
 	struct stream *s = NULL;
 	char* filepath;
@@ -729,6 +1819,12 @@ static int ncntf_streams_init(void)
 		if (filelist[n] == NULL) { /* was not a regular file */
 			continue;
 		}
+		len = strlen(filelist[n]->d_name);
+		if (len <= strlen(".events") || strcmp(filelist[n]->d_name + len - strlen(".events"), ".events") != 0) {
+			/* rotated segment or another file of the stream */
+			free(filelist[n]);
+			continue;
+		}
 
 		if (asprintf(&filepath, "%s/%s", streams_path, filelist[n]->d_name) == -1) {
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
@@ -736,6 +1832,8 @@ static int ncntf_streams_init(void)
 			continue;
 		}
 		if ((s = read_fileheader(filepath)) != NULL && (map_rules(s) == 0)) {
+			/* open (or build) the index of the records */
+			index_open(s, -1, 0);
 			/* add the stream file into the stream list */
 			s->next = streams;
 			streams = s;
@@ -844,7 +1942,9 @@ void ncntf_close(void)
 		xmlFreeDoc(ncntf_config);
 		ncntf_config = NULL;
 
+		streams_watch_stop();
 		ncntf_streams_close();
+		shared_events_free();
 		pthread_mutex_destroy(streams_mut);
 		free(streams_mut);
 		streams_mut = NULL;
@@ -854,7 +1954,6 @@ void ncntf_close(void)
 API int ncntf_stream_new(const char* name, const char* desc, int replay)
 {
 	struct stream *s;
-	xmlDocPtr oldconfig;
 
 	if (ncntf_config == NULL) {
 		return (EXIT_FAILURE);
@@ -885,10 +1984,23 @@ API int ncntf_stream_new(const char* name, const char* desc, int replay)
 	s->replay = replay;
 	s->created = time(NULL);
 	s->locked = 0;
+	pthread_mutex_init(&(s->lock), NULL);
+	pthread_cond_init(&(s->notify), NULL);
+	s->generation = 0;
 	s->next = NULL;
 	s->rules = NULL;
 	s->fd_events = -1;
 	s->fd_rules = -1;
+	s->fd_index = -1;
+	s->seq = 0;
+	s->first = 0;
+	s->aged = 0;
+	s->started = s->created;
+	s->max_size = 0;
+	s->max_age = 0;
+	s->archive = NULL;
+	s->checked = 0;
+	s->format = NCNTF_RECORD_XML;
 	if (write_fileheader(s) != 0 || map_rules(s) != 0) {
 		ncntf_stream_free(s);
 		DBG_UNLOCK("streams_mut");
@@ -900,9 +2012,7 @@ API int ncntf_stream_new(const char* name, const char* desc, int replay)
 		streams = s;
 		DBG_UNLOCK("streams_mut");
 		pthread_mutex_unlock(streams_mut);
-		oldconfig = ncntf_config;
-		ncntf_config = streams_to_xml();
-		xmlFreeDoc(oldconfig);
+		streams_config_update();
 		return (EXIT_SUCCESS);
 	}
 }
@@ -920,7 +2030,12 @@ API int ncntf_stream_allow_events(const char* stream, const char* event)
 		return (EXIT_SUCCESS);
 	}
 
-	if ((s = ncntf_stream_get(stream)) == NULL) {
+	DBG_LOCK("stream_mut");
+	pthread_mutex_lock(streams_mut);
+	s = ncntf_stream_get(stream);
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+	if (s == NULL) {
 		/* stream does not exist or some error occurred */
 		return (EXIT_FAILURE);
 	}
@@ -939,23 +2054,75 @@ API int ncntf_stream_allow_events(const char* stream, const char* event)
 	return (EXIT_SUCCESS);
 }
 
-API char** ncntf_stream_list(void)
+API int ncntf_stream_set_retention(const char* stream, size_t size, time_t age, const char* archive)
 {
-	char** list;
-	struct stream *s;
-	int i;
+	struct stream* s;
 
-	if (ncntf_config == NULL) {
-		return (NULL);
+	if (ncntf_config == NULL || stream == NULL || age < 0) {
+		return (EXIT_FAILURE);
 	}
 
 	DBG_LOCK("stream_mut");
 	pthread_mutex_lock(streams_mut);
+	s = ncntf_stream_get(stream);
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+	if (s == NULL) {
+		return (EXIT_FAILURE);
+	}
 
-	for (s = streams, i = 0; s != NULL; s = s->next, i++);
-	list = calloc(i + 1, sizeof(char*));
-	if (list == NULL) {
-		ERROR("Memory allocation failed - %s (%s:%d).", strerror (errno), __FILE__, __LINE__);
+	pthread_mutex_lock(&(s->lock));
+	s->max_size = (off_t)size;
+	s->max_age = age;
+	free(s->archive);
+	s->archive = (archive == NULL) ? NULL : strdup(archive);
+	s->checked = 0;
+	pthread_mutex_unlock(&(s->lock));
+
+	return (EXIT_SUCCESS);
+}
+
+API int ncntf_stream_set_format(const char* stream, NCNTF_RECORD_FORMAT format)
+{
+	struct stream* s;
+
+	if (ncntf_config == NULL || stream == NULL || format < NCNTF_RECORD_XML || format > NCNTF_RECORD_DEFLATE) {
+		return (EXIT_FAILURE);
+	}
+
+	DBG_LOCK("stream_mut");
+	pthread_mutex_lock(streams_mut);
+	s = ncntf_stream_get(stream);
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+	if (s == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&(s->lock));
+	s->format = format;
+	pthread_mutex_unlock(&(s->lock));
+
+	return (EXIT_SUCCESS);
+}
+
+API char** ncntf_stream_list(void)
+{
+	char** list;
+	struct stream *s;
+	int i;
+
+	if (ncntf_config == NULL) {
+		return (NULL);
+	}
+
+	DBG_LOCK("stream_mut");
+	pthread_mutex_lock(streams_mut);
+
+	for (s = streams, i = 0; s != NULL; s = s->next, i++);
+	list = calloc(i + 1, sizeof(char*));
+	if (list == NULL) {
+		ERROR("Memory allocation failed - %s (%s:%d).", strerror (errno), __FILE__, __LINE__);
 		DBG_UNLOCK("streams_mut");
 		pthread_mutex_unlock(streams_mut);
 		return (NULL);
@@ -1044,23 +2211,31 @@ API void ncntf_stream_iter_start(const char* stream)
 		/* the list of opened streams is empty */
 		str_off = malloc(sizeof(struct stream_offset));
 		str_off->stream = stream;
+		str_off->eof_seq = str_off->cur_seq = 0;
+		str_off->eof_offset = str_off->cur_offset = 0;
+		str_off->segment = NULL;
 		str_off->next = off_list;
 		pthread_setspecific(ncntf_replay_ends, (void*)str_off);
 	}
 
 	DBG_LOCK("stream_mut");
 	pthread_mutex_lock(streams_mut);
-	if ((s = ncntf_stream_get(stream)) == NULL) {
-		DBG_UNLOCK("streams_mut");
-		pthread_mutex_unlock(streams_mut);
+	s = ncntf_stream_get(stream);
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+	if (s == NULL || ncntf_stream_lock(s) != 0) {
 		return;
 	}
+	ncntf_stream_sync(s);
 	/* remember the current end of file position */
+	str_off->eof_seq = s->seq;
 	str_off->eof_offset = lseek(s->fd_events, 0, SEEK_END);
-	/* and the thread's specific position in the file (start of stream file records section) */
-	str_off->cur_offset = s->data;
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
+	/* and the thread's specific position in the file (start of the oldest segment) */
+	ncntf_stream_free(str_off->segment);
+	str_off->segment = NULL;
+	str_off->cur_seq = s->first;
+	str_off->cur_offset = 0;
+	ncntf_stream_unlock(s);
 }
 
 API void ncntf_stream_iter_finish(const char* stream)
@@ -1072,6 +2247,8 @@ API void ncntf_stream_iter_finish(const char* stream)
 	if (str_off) {
 		str_off->eof_offset = 0;
 		str_off->cur_offset = 0;
+		ncntf_stream_free(str_off->segment);
+		str_off->segment = NULL;
 	}
 }
 
@@ -1081,16 +2258,16 @@ API void ncntf_stream_iter_finish(const char* stream)
  */
 API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop, time_t *event_time)
 {
-	struct stream *s;
+	struct stream *s, *seg;
 	int32_t len;
 	uint64_t t;
-	off_t aux;
-	char* text = NULL;
+	off_t offset, end;
+	char* text = NULL, *data;
+	struct record_compact rec;
 	off_t* replay_end;
 	char* time_s;
 	time_t tnow;
-	int r;
-	struct stream_offset *str_off, *off_list;
+	struct stream_offset *str_off;
 
 	if (ncntf_config == NULL) {
 		return (NULL);
@@ -1103,22 +2280,20 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 
 	DBG_LOCK("stream_mut");
 	pthread_mutex_lock(streams_mut);
-	if ((s = ncntf_stream_get(stream)) == NULL) {
-		DBG_UNLOCK("streams_mut");
-		pthread_mutex_unlock(streams_mut);
+	s = ncntf_stream_get(stream);
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+	if (s == NULL) {
 		return (NULL);
 	}
 
 	pthread_once(&ncntf_replay_ends_once, ncntf_replay_ends_init);
-	off_list = (struct stream_offset*)pthread_getspecific(ncntf_replay_ends);
-	str_off = get_stream_offset_struct(stream, off_list);
+	str_off = get_stream_offset_struct(stream, (struct stream_offset*)pthread_getspecific(ncntf_replay_ends));
 	if (str_off == NULL) {
 		ncntf_stream_iter_start(stream);
-		str_off = get_stream_offset_struct(stream, off_list);
+		str_off = get_stream_offset_struct(stream, (struct stream_offset*)pthread_getspecific(ncntf_replay_ends));
 		if (str_off == NULL) {
 			ERROR("Unable to start iteration on stream \"%s\".", stream);
-			DBG_UNLOCK("streams_mut");
-			pthread_mutex_unlock(streams_mut);
 			return (NULL);
 		}
 	}
@@ -1130,6 +2305,11 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 		 * according to RFC 5277, sec 2.1.1, this is not a replay subscription
 		 * so skip to the end of the file and mark replay as done
 		 */
+		if (str_off->cur_seq != str_off->eof_seq) {
+			ncntf_stream_free(str_off->segment);
+			str_off->segment = NULL;
+		}
+		str_off->cur_seq = str_off->eof_seq;
 		str_off->cur_offset = str_off->eof_offset;
 		*replay_end = 0;
 	}
@@ -1142,11 +2322,10 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 		 */
 		if ((start != -1) && (s->replay == 1) && (*replay_end != 0)) {
 			/* replay part */
-			if (str_off->cur_offset >= *replay_end) {
+			if (str_off->cur_seq > str_off->eof_seq ||
+					(str_off->cur_seq == str_off->eof_seq && str_off->cur_offset >= *replay_end)) {
 				/* we are getting out of replay */
 
-				DBG_UNLOCK("streams_mut");
-				pthread_mutex_unlock(streams_mut);
 
 				/* send replayComplete notification */
 				if (asprintf(&text, "<notification xmlns=\"urn:ietf:params:xml:ns:netconf:notification:1.0\">"
@@ -1166,77 +2345,118 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 			}
 		}
 
-		/* check that we have something to read */
-		if (str_off->cur_offset == (aux = lseek(s->fd_events, 0, SEEK_END))) {
-			/* nothing to read */
-			DBG_UNLOCK("streams_mut");
-			pthread_mutex_unlock(streams_mut);
-			return(NULL);
+		if (ncntf_stream_lock(s) != 0) {
+			ERROR("Unable to read an event from the stream file %s (locking failed).", s->name);
+			ncntf_stream_iter_finish(stream);
+			return (NULL);
+		}
+		ncntf_stream_sync(s);
+
+		/* get the segment to read from */
+		if (str_off->cur_seq >= s->seq) {
+			seg = s;
+		} else if ((seg = str_off->segment) == NULL && (seg = str_off->segment = segment_open(s, str_off->cur_seq)) == NULL) {
+			/* the segment was dropped meanwhile, continue with the next one */
+			str_off->cur_seq++;
+			str_off->cur_offset = 0;
+			ncntf_stream_unlock(s);
+			continue;
 		}
-		/* move file offset to the read position */
-		lseek(s->fd_events, str_off->cur_offset, SEEK_SET);
 
-		if (ncntf_stream_lock(s) == 0) {
-			if ((r = read(s->fd_events, &len, sizeof(int32_t))) <= 0) {
-				ERROR("Reading the stream file failed (%s).", (r < 0) ? strerror(errno) : "Unexpected end of file");
-				DBG_UNLOCK("streams_mut");
-				ncntf_stream_iter_finish(stream);
-				pthread_mutex_unlock(streams_mut);
-				return (NULL);
-			}
-			str_off->cur_offset += r;
-			if ((r = read(s->fd_events, &t, sizeof(uint64_t))) <= 0) {
-				ERROR("Reading the stream file failed (%s).", (r < 0) ? strerror(errno) : "Unexpected end of file");
-				DBG_UNLOCK("streams_mut");
-				ncntf_stream_iter_finish(stream);
-				pthread_mutex_unlock(streams_mut);
-				return (NULL);
+		if (str_off->cur_offset < (off_t)seg->data) {
+			/* start of the segment */
+			str_off->cur_offset = seg->data;
+			if ((start != -1) && (s->replay == 1) && (*replay_end != 0)) {
+				/* skip the records older than startTime without reading them */
+				str_off->cur_offset = index_seek(seg, start, str_off->cur_offset,
+						(str_off->cur_seq == str_off->eof_seq) ? *replay_end : lseek(seg->fd_events, 0, SEEK_END));
+				ncntf_stream_unlock(s);
+				continue;
 			}
-			str_off->cur_offset += r;
-			str_off->cur_offset += len;
+		}
 
-			/* check boundaries */
-			if ((start != -1) && (start > (time_t)t)) {
-				/*
-				 * we're not interested in this event, it
-				 * happened before specified start time
-				 */
-				/* read another event */
-				ncntf_stream_unlock(s);
+		/* check that we have something to read */
+		if (str_off->cur_offset >= (end = lseek(seg->fd_events, 0, SEEK_END))) {
+			ncntf_stream_unlock(s);
+			if (seg != s) {
+				/* move to the next segment */
+				ncntf_stream_free(str_off->segment);
+				str_off->segment = NULL;
+				str_off->cur_seq++;
+				str_off->cur_offset = 0;
 				continue;
 			}
-			if ((stop != -1) && (stop < (time_t)t)) {
-				/*
-				 * we're not interested in this event, it
-				 * happened after specified stop time
-				 */
-				/* read another event */
+			/* nothing to read */
+			return(NULL);
+		}
+
+		offset = str_off->cur_offset;
+		errno = 0;
+		if (pread(seg->fd_events, &len, sizeof(int32_t), offset) != sizeof(int32_t) ||
+				pread(seg->fd_events, &t, sizeof(uint64_t), offset + sizeof(int32_t)) != sizeof(uint64_t) ||
+				record_datalen(len) < 0) {
+			ERROR("Reading the stream file failed (%s).", (errno != 0) ? strerror(errno) : "Unexpected end of file");
+			ncntf_stream_unlock(s);
+			ncntf_stream_iter_finish(stream);
+			return (NULL);
+		}
+		offset += RECORD_PREFIX_SIZE;
+		str_off->cur_offset = offset + record_datalen(len);
+
+		/* check boundaries */
+		if ((start != -1) && (start > (time_t)t)) {
+			/*
+			 * we're not interested in this event, it
+			 * happened before specified start time
+			 */
+			/* read another event */
+			ncntf_stream_unlock(s);
+			continue;
+		}
+		if ((stop != -1) && (stop < (time_t)t)) {
+			/*
+			 * we're not interested in this event, it
+			 * happened after specified stop time
+			 */
+			/* read another event */
+			ncntf_stream_unlock(s);
+			continue;
+		}
+
+		/* we're interested, read content */
+		if (len < 0) {
+			/* compact record, get the text from the whole record data */
+			len = record_datalen(len);
+			data = malloc(len * sizeof(char));
+			errno = 0;
+			if (pread(seg->fd_events, data, len, offset) != len) {
+				ERROR("Reading the stream file failed (%s).", (errno != 0) ? strerror(errno) : "Unexpected end of file");
+				text = NULL;
+			} else if (record_compact_header(data, len, &rec) != 0 || (text = record_compact_text(data, &rec)) == NULL) {
+				/* skip the corrupted record */
+				free(data);
 				ncntf_stream_unlock(s);
 				continue;
 			}
-
-			/* we're interested, read content */
+			free(data);
+		} else {
 			text = malloc(len * sizeof(char));
-			if ((r = read(s->fd_events, text, len)) <= 0) {
-				ERROR("Reading the stream file failed (%s).", (r < 0) ? strerror(errno) : "Unexpected end of file");
-				DBG_UNLOCK("streams_mut");
-				ncntf_stream_iter_finish(stream);
-				pthread_mutex_unlock(streams_mut);
-				return (NULL);
+			errno = 0;
+			if (pread(seg->fd_events, text, len, offset) != len) {
+				ERROR("Reading the stream file failed (%s).", (errno != 0) ? strerror(errno) : "Unexpected end of file");
+				free(text);
+				text = NULL;
 			}
+		}
+		if (text == NULL) {
 			ncntf_stream_unlock(s);
-			break; /* end the reading loop */
-		} else {
-			ERROR("Unable to read an event from the stream file %s (locking failed).", s->name);
-			DBG_UNLOCK("streams_mut");
 			ncntf_stream_iter_finish(stream);
-			pthread_mutex_unlock(streams_mut);
 			return (NULL);
 		}
+		ncntf_stream_unlock(s);
+		break; /* end the reading loop */
 	}
 
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
 
 	if (event_time != NULL) {
 		*event_time = (time_t)t;
@@ -1245,6 +2465,245 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 }
 
 
+/* state of the ncntf_stream_scan() reading the stream segment seq */
+struct stream_scan {
+	struct stream *s;
+	struct stream *seg; /* opened rotated segment, NULL for the current one */
+	uint32_t seq;
+	off_t end;
+	char* block; /* NCNTF_SCAN_BLOCK bytes of the segment from the offset start */
+	off_t start;
+	size_t len;
+	char* buf; /* data too big for the block */
+};
+
+/*
+ * Read from the scanned segment, the rotated segment is opened when it is
+ * read for the first time.
+ */
+static ssize_t scan_pread(struct stream_scan *sc, void* buf, size_t n, off_t offset)
+{
+	struct stream *cur;
+	ssize_t r = -1;
+
+	if (ncntf_stream_lock(sc->s) != 0) {
+		return (-1);
+	}
+	if ((cur = sc->seg) == NULL) {
+		cur = (sc->seq == sc->s->seq) ? sc->s : (sc->seg = segment_open(sc->s, sc->seq));
+	}
+	if (cur != NULL) {
+		r = pread(cur->fd_events, buf, n, offset);
+	}
+	ncntf_stream_unlock(sc->s);
+
+	return (r);
+}
+
+/*
+ * Get n bytes of the scanned segment at the offset. They are taken from the
+ * block if it contains them, otherwise the block is read again from the
+ * offset. The returned pointer is valid until the next call.
+ *
+ * returns pointer to the bytes, NULL if they cannot be read
+ */
+static const char* scan_get(struct stream_scan *sc, off_t offset, size_t n)
+{
+	ssize_t r;
+
+	if (offset >= sc->start && offset + (off_t)n <= sc->start + (off_t)sc->len) {
+		return (sc->block + (offset - sc->start));
+	}
+	if (offset + (off_t)n > sc->end) {
+		return (NULL);
+	}
+
+	if (n > NCNTF_SCAN_BLOCK) {
+		free(sc->buf);
+		if ((sc->buf = malloc(n)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (NULL);
+		}
+		return ((scan_pread(sc, sc->buf, n, offset) == (ssize_t)n) ? sc->buf : NULL);
+	}
+
+	r = scan_pread(sc, sc->block, (sc->end - offset > NCNTF_SCAN_BLOCK) ? NCNTF_SCAN_BLOCK : (size_t)(sc->end - offset), offset);
+	if (r < (ssize_t)n) {
+		sc->len = 0;
+		return (NULL);
+	}
+	sc->start = offset;
+	sc->len = r;
+
+	return (sc->block);
+}
+
+static int scan_match(const char* const* events, const char* name, size_t len)
+{
+	int i;
+
+	if (events == NULL) {
+		return (1);
+	}
+	for (i = 0; events[i] != NULL; i++) {
+		if (strlen(events[i]) == len && strncmp(events[i], name, len) == 0) {
+			return (1);
+		}
+	}
+	return (0);
+}
+
+API long long int ncntf_stream_scan(const char* stream, time_t start, time_t stop, const char* const* events, int text,
+		int (*clb)(const struct ncntf_record* record, void* arg), void* arg)
+{
+	struct stream *s, *cur;
+	struct stream_scan sc;
+	struct record_compact rec;
+	struct ncntf_record record;
+	uint32_t eof_seq, first;
+	off_t eof_offset, offset = 0, next;
+	const char *p, *body;
+	char *name = NULL, *ns = NULL, *data = NULL;
+	int32_t len, dlen;
+	uint64_t etime;
+	long long int count = 0;
+	int stopped = 0;
+
+	if (ncntf_config == NULL || stream == NULL || clb == NULL) {
+		return (-1);
+	}
+
+	/* check time boundaries */
+	if ((start != -1) && (stop != -1) && (stop < start)) {
+		return (0);
+	}
+
+	DBG_LOCK("stream_mut");
+	pthread_mutex_lock(streams_mut);
+	s = ncntf_stream_get(stream);
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+	if (s == NULL) {
+		return (-1);
+	}
+
+	/* the records stored since now are not scanned */
+	if (ncntf_stream_lock(s) != 0) {
+		ERROR("Unable to scan the stream file %s (locking failed).", s->name);
+		return (-1);
+	}
+	ncntf_stream_sync(s);
+	eof_seq = s->seq;
+	eof_offset = lseek(s->fd_events, 0, SEEK_END);
+	first = s->first;
+	ncntf_stream_unlock(s);
+
+	sc.s = s;
+	sc.buf = NULL;
+	if ((sc.block = malloc(NCNTF_SCAN_BLOCK)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (-1);
+	}
+
+	for (sc.seq = first; sc.seq <= eof_seq && !stopped && count != -1; sc.seq++) {
+		sc.seg = NULL;
+		sc.start = 0;
+		sc.len = 0;
+
+		/* skip the records older than start using the index of the segment */
+		if (ncntf_stream_lock(s) != 0) {
+			ERROR("Unable to scan the stream file %s (locking failed).", s->name);
+			count = -1;
+			break;
+		}
+		cur = (sc.seq == s->seq) ? s : (sc.seg = segment_open(s, sc.seq));
+		if (cur != NULL) {
+			sc.end = (sc.seq == eof_seq) ? eof_offset : lseek(cur->fd_events, 0, SEEK_END);
+			offset = index_seek(cur, start, cur->data, sc.end);
+		}
+		ncntf_stream_unlock(s);
+		if (cur == NULL) {
+			/* the segment was dropped meanwhile */
+			continue;
+		}
+
+		for (; offset < sc.end && !stopped; offset = next) {
+			free(name);
+			free(ns);
+			free(data);
+			name = ns = data = NULL;
+
+			errno = 0;
+			if ((p = scan_get(&sc, offset, RECORD_PREFIX_SIZE)) == NULL) {
+				ERROR("Reading the stream file failed (%s).", (errno != 0) ? strerror(errno) : "Unexpected end of file");
+				count = -1;
+				break;
+			}
+			memcpy(&len, p, sizeof(int32_t));
+			memcpy(&etime, p + sizeof(int32_t), sizeof(uint64_t));
+			if ((dlen = record_datalen(len)) < 0 || (next = offset + RECORD_PREFIX_SIZE + dlen) > sc.end) {
+				ERROR("Corrupted event record in the stream file.");
+				count = -1;
+				break;
+			}
+			if ((start != -1 && (time_t)etime < start) || (stop != -1 && (time_t)etime > stop)) {
+				continue;
+			}
+			offset += RECORD_PREFIX_SIZE;
+			record.time = (time_t)etime;
+			record.text = NULL;
+
+			if (len < 0) {
+				/* compact record, match its header only */
+				if ((p = scan_get(&sc, offset, RECORD_COMPACT_SIZE)) == NULL || record_compact_header(p, dlen, &rec) != 0 ||
+						(p = scan_get(&sc, offset, rec.text_offset)) == NULL) {
+					continue;
+				}
+				if (!scan_match(events, p + RECORD_COMPACT_SIZE, rec.name_len)) {
+					continue;
+				}
+				name = strndup(p + RECORD_COMPACT_SIZE, rec.name_len);
+				ns = strndup(p + RECORD_COMPACT_SIZE + rec.name_len, rec.ns_len);
+				record.size = rec.size;
+				if (text && ((p = scan_get(&sc, offset, dlen)) == NULL || (record.text = data = record_compact_text(p, &rec)) == NULL)) {
+					continue;
+				}
+			} else {
+				/* notification text, the event follows its eventTime */
+				if ((p = scan_get(&sc, offset, dlen)) == NULL || dlen == 0 || p[dlen - 1] != '\0') {
+					ERROR("Corrupted event record in the stream file.");
+					continue;
+				}
+				body = ((body = strstr(p, "</eventTime>")) != NULL) ? body + strlen("</eventTime>") : p;
+				if ((name = ncntf_event_name(body)) == NULL || !scan_match(events, name, strlen(name))) {
+					continue;
+				}
+				if ((ns = ncntf_event_ns(body)) == NULL) {
+					ns = strdup("");
+				}
+				record.size = dlen;
+				record.text = text ? p : NULL;
+			}
+			record.name = name;
+			record.ns = (ns != NULL) ? ns : "";
+
+			count++;
+			if (clb(&record, arg) != 0) {
+				stopped = 1;
+			}
+		}
+		ncntf_stream_free(sc.seg);
+	}
+
+	free(name);
+	free(ns);
+	free(data);
+	free(sc.block);
+	free(sc.buf);
+
+	return (count);
+}
+
 static void ncntf_event_stdoutprint (time_t eventtime, const char* content)
 {
 	char* t = NULL;
@@ -1255,53 +2714,215 @@ static void ncntf_event_stdoutprint (time_t eventtime, const char* content)
 	}
 }
 
+/*
+ * Check if the event is allowed to be logged into the stream.
+ */
+static int stream_isallowed(struct stream* s, const char* event)
+{
+	const char *rule, *end;
+	size_t len;
+
+	if (strcmp(s->name, NCNTF_STREAM_DEFAULT) == 0) {
+		/*
+		 * The default stream contains all NETCONF XML event notifications
+		 * supported by the NETCONF server.
+		 */
+		return (1);
+	}
+
+	/* rules are the event names separated by newlines */
+	len = strlen(event);
+	for (rule = s->rules; rule != NULL && *rule != '\0'; rule = end + 1) {
+		if ((end = strchr(rule, '\n')) == NULL) {
+			return (strcmp(rule, event) == 0);
+		}
+		if ((size_t)(end - rule) == len && strncmp(rule, event, len) == 0) {
+			return (1);
+		}
+	}
+
+	/* specified event is not allowed in the stream */
+	return (0);
+}
+
 static int ncntf_event_isallowed(const char* stream, const char* event)
 {
-	struct stream* s;
-	char* token;
-	char* rules;
+	struct stream* s;
+
+	if (stream == NULL || event == NULL) {
+		return (0);
+	}
+
+	if (strcmp(stream, NCNTF_STREAM_DEFAULT) == 0) {
+		/*
+		 * The default stream contains all NETCONF XML event notifications
+		 * supported by the NETCONF server.
+		 */
+		return (1);
+	}
+
+	DBG_LOCK("streams_mut");
+	pthread_mutex_lock(streams_mut);
+	s = ncntf_stream_get(stream);
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+	if (s == NULL) {
+		/* stream does not exist or some error occurred */
+		return (0);
+	}
+
+	return (stream_isallowed(s, event));
+}
+
+/*
+ * Find the start tag of the root element of the event content, skipping the
+ * XML declaration, processing instructions, comments and document type
+ * declaration preceding it.
+ *
+ * returns pointer to the '<' of the start tag, NULL if the content does not
+ * start with an element.
+ */
+static const char* ncntf_event_root(const char* content)
+{
+	const char *start = content, *end;
+
+	while (1) {
+		while (*start == ' ' || *start == '\t' || *start == '\n' || *start == '\r') {
+			start++;
+		}
+		if (start[0] != '<') {
+			return (NULL);
+		}
+		if (start[1] == '?') {
+			/* XML declaration or processing instruction */
+			end = strstr(start, "?>");
+		} else if (strncmp(start, "<!--", 4) == 0) {
+			end = strstr(start, "-->");
+		} else if (start[1] == '!') {
+			/* document type declaration */
+			end = strchr(start, '>');
+		} else {
+			return (start);
+		}
+		if (end == NULL) {
+			return (NULL);
+		}
+		start = strchr(end, '>') + 1;
+	}
+}
+
+/*
+ * Get the name of the root element of the event content without parsing the
+ * whole content. The namespace prefix is not part of the name.
+ *
+ * returns the name that is supposed to be freed by the caller, NULL if the
+ * content does not start with an element.
+ */
+static char* ncntf_event_name(const char* content)
+{
+	const char *start, *end;
+
+	if ((start = ncntf_event_root(content)) == NULL) {
+		return (NULL);
+	}
+
+	for (end = ++start; *end != '\0' && strchr(" \t\n\r/>", *end) == NULL; end++) {
+		if (*end == ':') {
+			/* skip the namespace prefix */
+			start = end + 1;
+		}
+	}
+	if (end == start) {
+		return (NULL);
+	}
+
+	return (strndup(start, end - start));
+}
+
+/*
+ * Get the namespace of the root element of the event content without parsing
+ * the whole content. Only the namespace declared directly in the start tag of
+ * the root element is found.
+ *
+ * returns the namespace that is supposed to be freed by the caller, NULL if
+ * it is not found.
+ */
+static char* ncntf_event_ns(const char* content)
+{
+	const char *start, *end, *prefix = NULL, *attr;
+	size_t plen = 0, alen;
+	char quote;
 
-	if (stream == NULL || event == NULL) {
-		return (0);
+	if ((start = ncntf_event_root(content)) == NULL) {
+		return (NULL);
 	}
 
-	if (strcmp(stream, NCNTF_STREAM_DEFAULT) == 0) {
-		/*
-		 * The default stream contains all NETCONF XML event notifications
-		 * supported by the NETCONF server.
-		 */
-		return (1);
+	/* the name of the element and its prefix */
+	for (end = ++start; *end != '\0' && strchr(" \t\n\r/>", *end) == NULL; end++) {
+		if (*end == ':' && prefix == NULL) {
+			prefix = start;
+			plen = end - start;
+		}
 	}
 
-	if ((s = ncntf_stream_get(stream)) == NULL) {
-		/* stream does not exist or some error occurred */
-		return (0);
-	}
+	/* walk the attributes */
+	while (1) {
+		while (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r') {
+			end++;
+		}
+		if (*end == '\0' || *end == '/' || *end == '>') {
+			return (NULL);
+		}
+		for (attr = end; *end != '\0' && strchr(" \t\n\r=/>", *end) == NULL; end++);
+		alen = end - attr;
+		while (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r') {
+			end++;
+		}
+		if (*end != '=') {
+			return (NULL);
+		}
+		end++;
+		while (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r') {
+			end++;
+		}
+		if ((quote = *end) != '"' && quote != '\'') {
+			return (NULL);
+		}
+		start = end + 1;
+		if ((end = strchr(start, quote)) == NULL) {
+			return (NULL);
+		}
+		end++;
 
-	rules = strdup(s->rules);
-	for (token = strtok(rules, "\n"); token != NULL; token = strtok(NULL, "\n")) {
-		if (strcmp(event, token) == 0) {
-			free(rules);
-			return(1);
+		if (prefix == NULL) {
+			if (alen == 5 && strncmp(attr, "xmlns", 5) == 0) {
+				return (strndup(start, end - start - 1));
+			}
+		} else if (alen == 6 + plen && strncmp(attr, "xmlns:", 6) == 0 && strncmp(attr + 6, prefix, plen) == 0) {
+			return (strndup(start, end - start - 1));
 		}
 	}
-	free(rules);
-
-	/* specified event is not allowed in the stream */
-	return (0);
 }
 
-static int ncntf_event_store(time_t etime, const char* content)
+/*
+ * Store the event into all the streams allowing it. If not NULL, ename is
+ * the name of the content's root element, so it does not need to be found.
+ */
+static int ncntf_event_store(time_t etime, const char* ename, const char* content)
 {
+	static const char suffix[] = "</notification>";
 	int ret = EXIT_SUCCESS;
-	char *event_time = NULL, *aux1 = NULL;
-	char *record = NULL, *ename = NULL;
-	struct stream* s;
+	char *event_time = NULL, *prefix = NULL, *name = NULL, *text = NULL, *ns = NULL;
+	char *compact[2] = {NULL, NULL};
+	struct stream *s, *list;
 	uint64_t etime64;
-	xmlDocPtr edoc;
 	int32_t len;
+	int plen, i, iovcnt;
+	struct iovec record[5], compact_record[2], *iov;
+	size_t reclen, compact_len[2] = {0, 0};
 	ssize_t r;
 	off_t offset;
+	time_t now;
 
 	if (content == NULL) {
 		return (EXIT_FAILURE);
@@ -1324,59 +2945,106 @@ static int ncntf_event_store(time_t etime, const char* content)
 	etime64 = (uint64_t)etime;
 
 	/* get event name string for filter on streams */
-	if ((edoc = xmlReadMemory(content, strlen(content), NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
-		ERROR("xmlReadMemory failed (%s:%d)", __FILE__, __LINE__);
-		ret = EXIT_FAILURE;
-		goto cleanup;
-	}
-	if ((aux1 = (char*)((xmlDocGetRootElement(edoc))->name)) == NULL) {
-		ERROR("xmlDocGetRootElement failed (%s:%d)", __FILE__, __LINE__);
+	if (ename == NULL && (ename = name = ncntf_event_name(content)) == NULL) {
+		ERROR("Invalid event content, an XML element is expected (%s:%d).", __FILE__, __LINE__);
 		ret = EXIT_FAILURE;
 		goto cleanup;
 	}
-	ename = strdup(aux1);
-	xmlFreeDoc(edoc);
 
 	/* complete the event text */
-	len = (int32_t) asprintf(&record, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
-			"<notification xmlns=\"%s\"><eventTime>%s</eventTime>"
-			"%s</notification>",
+	plen = asprintf(&prefix, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+			"<notification xmlns=\"%s\"><eventTime>%s</eventTime>",
 			NC_NS_NOTIFICATIONS,
-			event_time,
-			content);
-	if (len == -1) {
+			event_time);
+	if (plen == -1) {
 		ERROR("Creating an event record failed.");
+		prefix = NULL;
 		ret = EXIT_FAILURE;
 		goto cleanup;
 	}
-	len++; /* include termination null byte */
+	len = (int32_t) (plen + strlen(content) + sizeof(suffix)); /* include termination null byte */
 
-	/* write the event into the stream file(s) */
-	DBG_LOCK("stream_mut");
+	/* the whole record is written at once */
+	record[0].iov_base = &len;
+	record[0].iov_len = sizeof(int32_t);
+	record[1].iov_base = &etime64;
+	record[1].iov_len = sizeof(uint64_t);
+	record[2].iov_base = prefix;
+	record[2].iov_len = plen;
+	record[3].iov_base = (void*)content;
+	record[3].iov_len = strlen(content);
+	record[4].iov_base = (void*)suffix;
+	record[4].iov_len = sizeof(suffix);
+
+	/*
+	 * streams are only added into the list (and freed by ncntf_close()), so
+	 * the list can be walked without holding the list lock, every stream is
+	 * locked separately
+	 */
+	DBG_LOCK("streams_mut");
 	pthread_mutex_lock(streams_mut);
-	for (s = streams; s != NULL; s = s->next) {
+	list = streams;
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+
+	/* write the event into the stream file(s) */
+	for (s = list; s != NULL; s = s->next) {
 		if (s->replay == 0) {
 			continue;
 		}
 
-		if (ncntf_event_isallowed(s->name, ename) != 0) {
+		if (stream_isallowed(s, ename) != 0) {
 			/* log the event to the stream file */
 			if (ncntf_stream_lock(s) == 0) {
+				ncntf_stream_sync(s);
+				/* the compact records are created only once for all the streams */
+				iov = record;
+				iovcnt = 5;
+				reclen = RECORD_PREFIX_SIZE + len;
+				if (s->format != NCNTF_RECORD_XML && strlen(ename) <= UINT16_MAX) {
+					i = (s->format == NCNTF_RECORD_DEFLATE) ? 1 : 0;
+					if (text == NULL && (text = malloc(len)) != NULL) {
+						memcpy(text, prefix, plen);
+						memcpy(text + plen, content, strlen(content));
+						memcpy(text + plen + strlen(content), suffix, sizeof(suffix));
+						if ((ns = ncntf_event_ns(content)) == NULL || strlen(ns) > UINT16_MAX) {
+							free(ns);
+							ns = strdup("");
+						}
+					}
+					if (text != NULL && ns != NULL && compact[i] == NULL) {
+						compact[i] = record_compact_new(etime64, text, len, ename, ns, i, &(compact_len[i]));
+					}
+					if (compact[i] != NULL) {
+						compact_record[i].iov_base = compact[i];
+						compact_record[i].iov_len = compact_len[i];
+						iov = &(compact_record[i]);
+						iovcnt = 1;
+						reclen = compact_len[i];
+					}
+				}
+				if (s->max_size != 0 || s->max_age != 0) {
+					/* apply the retention limits, aging is checked once a second */
+					now = time(NULL);
+					if (ncntf_stream_rotate(s, now, reclen) || s->checked != now) {
+						ncntf_stream_retention(s, now);
+						s->checked = now;
+					}
+				}
 				offset = lseek(s->fd_events, 0, SEEK_END);
-				while (((r = write(s->fd_events, &len, sizeof(int32_t))) == -1) && (errno == EAGAIN ||errno == EINTR));
-				if (r == -1) { goto write_failed; }
-				while (((r = write(s->fd_events, &etime64, sizeof(uint64_t))) == -1) && (errno == EAGAIN ||errno == EINTR));
-				if (r == -1) { goto write_failed; }
-				while (((r = write(s->fd_events, record, len)) == -1) && (errno == EAGAIN ||errno == EINTR));
-				if (r == -1) { goto write_failed; }
-
-write_failed:
-				if (r == -1) {
-					WARN("Writing an event into the stream file failed (%s).", strerror(errno));
+				while (((r = writev(s->fd_events, iov, iovcnt)) == -1) && (errno == EAGAIN ||errno == EINTR));
+				if (r != (ssize_t)reclen) {
+					WARN("Writing an event into the stream file failed (%s).", (r == -1) ? strerror(errno) : "incomplete write");
 					/* revert changes */
 					if (ftruncate(s->fd_events, offset) == -1) {
 						ERROR("ftruncate() on the stream file \'%s\' failed (%s).", s->name, strerror(errno));
 					}
+				} else {
+					nc_metrics_add(NC_METRIC_NTF_STORED, 1);
+					nc_metrics_add(NC_METRIC_NTF_STORED_BYTES, r);
+					index_add(s, offset, etime64);
+					/* wake up the subscribers of this process immediately */
+					stream_notify(s);
 				}
 				lseek(s->fd_events, offset, SEEK_SET);
 				ncntf_stream_unlock(s);
@@ -1385,14 +3053,16 @@ write_failed:
 			}
 		}
 	}
-	DBG_UNLOCK("streams_mut");
-	pthread_mutex_unlock(streams_mut);
 
 cleanup:
 	/* final cleanup */
-	free(record);
-	free(ename);
+	free(prefix);
+	free(name);
 	free(event_time);
+	free(text);
+	free(ns);
+	free(compact[0]);
+	free(compact[1]);
 
 	return (ret);
 }
@@ -1445,6 +3115,7 @@ cleanup:
 static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 {
 	char *content = NULL;
+	const char *ename = NULL;
 	char *aux1 = NULL, *aux2 = NULL, *newstr;
 	NC_DATASTORE ds;
 	NCNTF_EVENT_BY by;
@@ -1517,6 +3188,7 @@ static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 			break;
 		}
 
+		ename = "netconf-config-change";
 		if (asprintf(&content, "<netconf-config-change xmlns=\"urn:ietf:params:xml:ns:yang:ietf-netconf-notifications\">"
 				"<datastore>%s</datastore>"
 				"%s</netconf-config-change>",
@@ -1677,6 +3349,7 @@ static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 			break;
 		}
 
+		ename = "netconf-capability-change";
 		if (asprintf(&content, "<netconf-capability-change xmlns=\"urn:ietf:params:xml:ns:yang:ietf-netconf-notifications\">"
 				"%s%s</netconf-capability-change>",
 				(aux1 == NULL) ? "" : aux1,
@@ -1695,6 +3368,7 @@ static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 			ERROR("Invalid \'session\' parameter of %s.", __func__);
 			return (EXIT_FAILURE);
 		}
+		ename = "netconf-session-start";
 		if (asprintf(&content, "<netconf-session-start xmlns=\"urn:ietf:params:xml:ns:yang:ietf-netconf-notifications\">"
 				"<username>%s</username>"
 				"<session-id>%s</session-id>"
@@ -1735,6 +3409,7 @@ static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 		}
 
 		/* compound the event content */
+		ename = "netconf-session-end";
 		if (asprintf(&content, "<netconf-session-end xmlns=\"urn:ietf:params:xml:ns:yang:ietf-netconf-notifications\">"
 				"<username>%s</username>"
 				"<session-id>%s</session-id>"
@@ -1760,7 +3435,7 @@ static int _event_new(time_t etime, NCNTF_EVENT event, va_list params)
 		break;
 	}
 
-	ret = ncntf_event_store(etime, content);
+	ret = ncntf_event_store(etime, ename, content);
 	free(content);
 	return (ret);
 }
@@ -1795,7 +3470,7 @@ API int ncxmlntf_event_new(time_t etime, NCNTF_EVENT event, ...)
 			va_end(argp);
 			return (EXIT_FAILURE);
 		}
-		retval = ncntf_event_store(etime, content);
+		retval = ncntf_event_store(etime, (data->type == XML_ELEMENT_NODE && data->next == NULL) ? (char*)data->name : NULL, content);
 		free(content);
 	} else {
 		retval = _event_new(etime, event, argp);
@@ -1850,32 +3525,12 @@ API nc_ntf* ncntf_notif_create(time_t event_time, const char* content)
 	}
 	free(etime);
 
-	retval = malloc(sizeof(nc_ntf));
-	if (retval == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+	if ((retval = nc_msg_new(notif_doc)) == NULL) {
+		xmlFreeDoc(notif_doc);
 		return (NULL);
 	}
-	retval->doc = notif_doc;
-	retval->msgid = NULL;
-	retval->error = NULL;
-	retval->next = NULL;
-	retval->with_defaults = NCWD_MODE_NOTSET;
 	retval->type.ntf = NC_NTF_UNKNOWN;
 
-	/* create xpath evaluation context */
-	if ((retval->ctxt = xmlXPathNewContext(retval->doc)) == NULL) {
-		ERROR("%s: notification message XPath context cannot be created.", __func__);
-		nc_msg_free(retval);
-		return NULL;
-	}
-
-	/* register base namespace for the rpc */
-	if (xmlXPathRegisterNs(retval->ctxt, BAD_CAST NC_NS_NOTIFICATIONS_ID, BAD_CAST NC_NS_NOTIFICATIONS) != 0) {
-		ERROR("Registering notification namespace for the message xpath context failed.");
-		nc_msg_free(retval);
-		return NULL;
-	}
-
 	return (retval);
 }
 
@@ -1913,32 +3568,12 @@ API nc_ntf* ncxmlntf_notif_create(time_t event_time, const xmlNodePtr content)
 		return NULL;
 	}
 
-	retval = malloc(sizeof(nc_ntf));
-	if (retval == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+	if ((retval = nc_msg_new(notif_doc)) == NULL) {
+		xmlFreeDoc(notif_doc);
 		return (NULL);
 	}
-	retval->doc = notif_doc;
-	retval->msgid = NULL;
-	retval->error = NULL;
-	retval->next = NULL;
-	retval->with_defaults = NCWD_MODE_NOTSET;
 	retval->type.ntf = NC_NTF_UNKNOWN;
 
-	/* create xpath evaluation context */
-	if ((retval->ctxt = xmlXPathNewContext(retval->doc)) == NULL) {
-		ERROR("%s: notification message XPath context cannot be created.", __func__);
-		nc_msg_free(retval);
-		return NULL;
-	}
-
-	/* register base namespace for the rpc */
-	if (xmlXPathRegisterNs(retval->ctxt, BAD_CAST NC_NS_NOTIFICATIONS_ID, BAD_CAST NC_NS_NOTIFICATIONS) != 0) {
-		ERROR("Registering notification namespace for the message xpath context failed.");
-		nc_msg_free(retval);
-		return NULL;
-	}
-
 	return (retval);
 
 }
@@ -2120,7 +3755,7 @@ API time_t ncntf_notif_get_time(const nc_ntf* notif)
 	}
 
 	/* get eventTime value */
-	result = xmlXPathEvalExpression(BAD_CAST "/ntf:notification/ntf:eventTime", notif_ctxt);
+	result = nc_xpath_eval("/ntf:notification/ntf:eventTime", notif_ctxt);
 	if (result != NULL) {
 		if (result->nodesetval->nodeNr != 1) {
 			t = -1;
@@ -2164,7 +3799,7 @@ static int ncntf_subscription_get_params(const nc_rpc* subscribe_rpc, char **str
 
 	/* get stream name from subscription */
 	if (stream != NULL) {
-		result = xmlXPathEvalExpression(BAD_CAST "//ntf:create-subscription/ntf:stream", srpc_ctxt);
+		result = nc_xpath_eval("//ntf:create-subscription/ntf:stream", srpc_ctxt);
 		if (result == NULL || result->nodesetval == NULL || result->nodesetval->nodeNr != 1) {
 			/* use default stream 'netconf' */
 			*stream = strdup(NCNTF_STREAM_DEFAULT);
@@ -2178,7 +3813,7 @@ static int ncntf_subscription_get_params(const nc_rpc* subscribe_rpc, char **str
 
 	/* get startTime from the subscription */
 	if (start != NULL) {
-		result = xmlXPathEvalExpression(BAD_CAST "//ntf:create-subscription/ntf:startTime", srpc_ctxt);
+		result = nc_xpath_eval("//ntf:create-subscription/ntf:startTime", srpc_ctxt);
 		if (result == NULL || result->nodesetval == NULL || result->nodesetval->nodeNr != 1) {
 			*start = -1;
 		} else {
@@ -2194,7 +3829,7 @@ static int ncntf_subscription_get_params(const nc_rpc* subscribe_rpc, char **str
 
 	/* get stopTime from the subscription */
 	if (stop != NULL) {
-		result = xmlXPathEvalExpression(BAD_CAST "//ntf:create-subscription/ntf:stopTime", srpc_ctxt);
+		result = nc_xpath_eval("//ntf:create-subscription/ntf:stopTime", srpc_ctxt);
 		if (result == NULL || result->nodesetval == NULL || result->nodesetval->nodeNr != 1) {
 			*stop = -1;
 		} else {
@@ -2210,7 +3845,7 @@ static int ncntf_subscription_get_params(const nc_rpc* subscribe_rpc, char **str
 
 	/* get filter from the subscription */
 	if (filter != NULL) {
-		result = xmlXPathEvalExpression(BAD_CAST "//ntf:create-subscription/ntf:filter", srpc_ctxt);
+		result = nc_xpath_eval("//ntf:create-subscription/ntf:filter", srpc_ctxt);
 		if (result == NULL || result->nodesetval == NULL || result->nodesetval->nodeNr != 1) {
 			/* do nothing - filter is not specified */
 		} else {
@@ -2311,6 +3946,316 @@ cleanup:
 	}
 }
 
+/* number of the recently dispatched events kept parsed for other subscribers */
+#define NCNTF_SHARED_EVENTS 64
+
+/*
+ * Event filtered by a specific filter, shared by the subscribers using
+ * the same filter.
+ */
+struct shared_filtered {
+	char* filter; /* serialized filter, the key */
+	xmlDocPtr doc; /* filtered event, NULL if nothing remains */
+	xmlChar* text; /* serialized filtered event */
+	int len;
+	struct shared_filtered *next;
+};
+
+/*
+ * Event read from a stream, shared by all the dispatchers of the process so
+ * the event is parsed and filtered only once. The documents are only read
+ * after they are created.
+ */
+struct shared_event {
+	char* record; /* event as read from the stream, the key */
+	size_t len;
+	xmlDocPtr doc; /* parsed event, NULL if it is invalid */
+	int parsed;
+	struct shared_filtered *filtered;
+	pthread_mutex_t lock; /* protects parsing and the filtered list */
+	unsigned int refs;
+	struct shared_event *next;
+};
+
+/* list of the shared events, the most recent first */
+static struct shared_event *shared_events = NULL;
+static pthread_mutex_t shared_events_mut = PTHREAD_MUTEX_INITIALIZER;
+
+static void shared_event_free(struct shared_event *e)
+{
+	struct shared_filtered *f;
+
+	while ((f = e->filtered) != NULL) {
+		e->filtered = f->next;
+		free(f->filter);
+		xmlFreeDoc(f->doc);
+		xmlFree(f->text);
+		free(f);
+	}
+	xmlFreeDoc(e->doc);
+	free(e->record);
+	pthread_mutex_destroy(&(e->lock));
+	free(e);
+}
+
+/*
+ * Free the unused shared events exceeding the NCNTF_SHARED_EVENTS limit,
+ * shared_events_mut must be locked.
+ */
+static void shared_events_trim(unsigned int limit)
+{
+	struct shared_event *e, **prev;
+	unsigned int count = 0;
+
+	for (prev = &shared_events; (e = *prev) != NULL;) {
+		if (++count > limit && e->refs == 0) {
+			*prev = e->next;
+			shared_event_free(e);
+			continue;
+		}
+		prev = &(e->next);
+	}
+}
+
+/*
+ * Free all the shared events.
+ */
+static void shared_events_free(void)
+{
+	pthread_mutex_lock(&shared_events_mut);
+	shared_events_trim(0);
+	pthread_mutex_unlock(&shared_events_mut);
+}
+
+/*
+ * Get the parsed event of the given stream record, the event is parsed
+ * only by the first dispatcher getting it. The result must be released by
+ * shared_event_put().
+ */
+static struct shared_event* shared_event_get(const char* record)
+{
+	struct shared_event *e;
+	size_t len = strlen(record);
+
+	pthread_mutex_lock(&shared_events_mut);
+	for (e = shared_events; e != NULL; e = e->next) {
+		if (e->len == len && memcmp(e->record, record, len) == 0) {
+			break;
+		}
+	}
+	if (e == NULL) {
+		if ((e = calloc(1, sizeof(struct shared_event))) == NULL || (e->record = strdup(record)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			pthread_mutex_unlock(&shared_events_mut);
+			free(e);
+			return (NULL);
+		}
+		e->len = len;
+		pthread_mutex_init(&(e->lock), NULL);
+		e->next = shared_events;
+		shared_events = e;
+		shared_events_trim(NCNTF_SHARED_EVENTS);
+	}
+	e->refs++;
+	pthread_mutex_unlock(&shared_events_mut);
+
+	pthread_mutex_lock(&(e->lock));
+	if (!e->parsed) {
+		e->doc = xmlReadMemory(e->record, e->len, NULL, NULL, NC_XMLREAD_OPTIONS);
+		e->parsed = 1;
+	}
+	pthread_mutex_unlock(&(e->lock));
+
+	return (e);
+}
+
+static void shared_event_put(struct shared_event *e)
+{
+	pthread_mutex_lock(&shared_events_mut);
+	e->refs--;
+	pthread_mutex_unlock(&shared_events_mut);
+}
+
+/*
+ * Get the serialized filter used as the key of the shared filtered events.
+ */
+static char* filter_key(const struct nc_filter *filter)
+{
+	xmlBufferPtr buf;
+	char* key = NULL;
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		return (NULL);
+	}
+	if (filter->subtree_filter == NULL || xmlNodeDump(buf, filter->subtree_filter->doc, filter->subtree_filter, 0, 0) != -1) {
+		if (asprintf(&key, "%d:%s", filter->type, (char*)xmlBufferContent(buf)) == -1) {
+			key = NULL;
+		}
+	}
+	xmlBufferFree(buf);
+
+	return (key);
+}
+
+/*
+ * Apply the filter on all the content nodes of the event.
+ *
+ * returns the filtered copy of the event, NULL if nothing remains
+ */
+static xmlDocPtr filter_event(xmlDocPtr event, const struct nc_filter *filter)
+{
+	xmlDocPtr event_doc;
+	xmlNodePtr event_node, aux_node, nodelist = NULL;
+
+	if ((event_doc = xmlCopyDoc(event, 1)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	/* filter all content nodes in notification */
+	event_node = event_doc->children->children; /* doc -> <notification> -> <something> */
+	while (event_node != NULL) {
+		/* skip invalid nodes */
+		if (event_node->name == NULL || event_node->ns == NULL || event_node->ns->href == NULL) {
+			event_node = event_node->next;
+			continue;
+		}
+
+		/* skip eventTime element */
+		if (xmlStrcmp(event_node->name, BAD_CAST "eventTime") == 0 &&
+				xmlStrcmp(event_node->ns->href, BAD_CAST NC_NS_NOTIFICATIONS) == 0) {
+			event_node = event_node->next;
+			continue;
+		}
+
+		/* do not filter replayComplete notification */
+		if (xmlStrcmp(event_node->name, BAD_CAST "replayComplete")) {
+			/* filter the data */
+			if (ncxml_filter(event_node, filter, &aux_node, NULL) != 0) {
+				ERROR("Filter failed.");
+				aux_node = xmlCopyNode(event_node, 1);
+			}
+		} else {
+			aux_node = xmlCopyNode(event_node, 1);
+		}
+		if (aux_node != NULL) {
+			aux_node->next = nodelist;
+			nodelist = aux_node;
+		}
+
+		/* detach and free currently filtered node from the original document */
+		aux_node = event_node;
+		event_node = event_node->next; /* find the next node to filter */
+		xmlUnlinkNode(aux_node);
+		xmlFreeNode(aux_node);
+	}
+
+	if (nodelist == NULL) {
+		/* nothing to send */
+		xmlFreeDoc(event_doc);
+		return (NULL);
+	}
+	xmlAddChildList(event_doc->children, nodelist); /* into doc -> <notification> */
+
+	return (event_doc);
+}
+
+/*
+ * Get the event filtered by the given filter, the filter is applied only
+ * by the first dispatcher using the same filter.
+ */
+static struct shared_filtered* shared_event_filter(struct shared_event *e, const char* key, const struct nc_filter *filter)
+{
+	struct shared_filtered *f;
+
+	pthread_mutex_lock(&(e->lock));
+	for (f = e->filtered; f != NULL; f = f->next) {
+		if (strcmp(f->filter, key) == 0) {
+			goto cleanup;
+		}
+	}
+
+	if ((f = calloc(1, sizeof(struct shared_filtered))) == NULL || (f->filter = strdup(key)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(f);
+		f = NULL;
+		goto cleanup;
+	}
+	if ((f->doc = filter_event(e->doc, filter)) != NULL) {
+		xmlDocDumpFormatMemory(f->doc, &(f->text), &(f->len), NC_CONTENT_FORMATTED);
+	}
+	f->next = e->filtered;
+	e->filtered = f;
+
+cleanup:
+	pthread_mutex_unlock(&(e->lock));
+	return (f);
+}
+
+/*
+ * Check NACM permission of the session to receive the event and send it.
+ */
+static void dispatch_event(struct nc_session* session, xmlDocPtr doc, const char* text, size_t len, int batch)
+{
+	nc_ntf ntf;
+	int r;
+
+	/*
+	 * the shared document is only read, the message structure is local and
+	 * NACM does not need its XPath context
+	 */
+	memset(&ntf, 0, sizeof(nc_ntf));
+	ntf.doc = doc;
+	ntf.with_defaults = NCWD_MODE_NOTSET;
+	ntf.type.ntf = NC_NTF_UNKNOWN;
+
+	/* NACM - check notification permition */
+	r = nacm_check_notification(&ntf, session);
+	if (r == NACM_PERMIT) {
+		DBG_LOCK("mut_session");
+		pthread_mutex_lock(&(session->mut_session));
+		DBG_LOCK("mut_ntf");
+		pthread_mutex_lock(&(session->mut_ntf));
+		if (!session->ntf_stop) {
+			DBG_UNLOCK("mut_ntf");
+			pthread_mutex_unlock(&(session->mut_ntf));
+			if (batch) {
+				if (nc_session_queue_notif_text(session, text, len) != EXIT_SUCCESS) {
+					ERROR("Sending a notification failed.");
+				}
+			} else if (nc_session_send_notif_text(session, text, len) != EXIT_SUCCESS) {
+				ERROR("Sending a notification failed.");
+			}
+		} else {
+			DBG_UNLOCK("mut_ntf");
+			pthread_mutex_unlock(&(session->mut_ntf));
+		}
+		DBG_UNLOCK("mut_session");
+		pthread_mutex_unlock(&(session->mut_session));
+	} else {
+		/* update stats */
+		if (nc_info) {
+			NC_STAT_INC(nc_info->stats_nacm.denied_notifs);
+		}
+	}
+}
+
+/*
+ * Write the notifications batched in the session.
+ */
+static void dispatch_flush(struct nc_session* session)
+{
+	if (nc_session_flush_notif(session) != EXIT_SUCCESS) {
+		ERROR("Sending a notification failed.");
+	}
+}
+
+API void ncntf_dispatch_set_batch(size_t size, unsigned int latency)
+{
+	dispatch_batch_size = size;
+	dispatch_batch_latency = latency;
+}
+
 /**
  * @brief Stop the running ncntf_dispatch_receive()
  *
@@ -2325,6 +4270,8 @@ void ncntf_dispatch_stop(struct nc_session *session)
 	pthread_mutex_lock(&(session->mut_ntf));
 	if (session != NULL && session->ntf_active) {
 		session->ntf_stop = 1;
+		/* do not let the dispatcher wait for another event */
+		streams_notify();
 		while (session->ntf_active) {
 			DBG_UNLOCK("mut_ntf");
 			pthread_mutex_unlock(&(session->mut_ntf));
@@ -2353,13 +4300,18 @@ void ncntf_dispatch_stop(struct nc_session *session)
 API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc* subscribe_rpc)
 {
 	long long int count = 0;
-	char* stream = NULL, *event = NULL, *time_s = NULL;
+	char* stream = NULL, *event = NULL, *time_s = NULL, *fkey = NULL;
 	struct nc_filter *filter = NULL;
 	time_t start, stop;
-	xmlDocPtr event_doc, filter_doc;
-	xmlNodePtr event_node, aux_node, nodelist = NULL;
 	nc_ntf* ntf;
 	nc_reply *reply;
+	struct stream *s;
+	struct shared_event *shared;
+	struct shared_filtered *filtered;
+	unsigned int generation;
+	size_t batch_size = dispatch_batch_size;
+	unsigned int batch_latency = dispatch_batch_latency;
+	struct timespec now, deadline = {0, 0};
 
 	if (session == NULL ||
 			session->status != NC_SESSION_STATUS_WORKING ||
@@ -2383,6 +4335,13 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 		ERROR("Parsing create-subscription for parameters failed.");
 		return (-1);
 	}
+	/* subscribers with the same filter share the filtered events */
+	if (filter != NULL && (fkey = filter_key(filter)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		nc_filter_free(filter);
+		free(stream);
+		return (-1);
+	}
 
 	/* check if there is another notification subscription */
 	DBG_LOCK("mut_ntf");
@@ -2392,6 +4351,7 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 		pthread_mutex_unlock(&(session->mut_ntf));
 		WARN("%s: Notification subscription is not allowed on the given session.", __func__);
 		nc_filter_free(filter);
+		free(fkey);
 		free(stream);
 		return (-1);
 	}
@@ -2400,9 +4360,14 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 	DBG_UNLOCK("mut_ntf");
 	pthread_mutex_unlock(&(session->mut_ntf));
 
-	/* prepare xml doc for filtering */
-	filter_doc = xmlNewDoc(BAD_CAST "1.0");
-	filter_doc->encoding = xmlStrdup(BAD_CAST UTF8);
+	/* get the stream to wait for its new events */
+	DBG_LOCK("streams_mut");
+	pthread_mutex_lock(streams_mut);
+	s = ncntf_stream_get(stream);
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+	/* events stored by other processes are notified by the watch */
+	streams_watch_start();
 
 	ncntf_stream_iter_start(stream);
 	while(ncntf_config != NULL) {
@@ -2416,158 +4381,71 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 		DBG_UNLOCK("mut_ntf");
 		pthread_mutex_unlock(&(session->mut_ntf));
 
+		/* remember the generation to not miss an event stored meanwhile */
+		generation = (s != NULL) ? stream_generation(s) : 0;
 		if ((event = ncntf_stream_iter_next(stream, start, stop, NULL)) == NULL) {
+			if (batch_size != 0) {
+				/* no more events right now, do not delay the batched ones */
+				dispatch_flush(session);
+			}
 			if ((stop == -1) || ((stop != -1) && (stop > time(NULL)))) {
-				usleep(NCNTF_DISPATCH_SLEEP);
+				if (s != NULL) {
+					stream_wait(s, generation, stop);
+				} else {
+					usleep(NCNTF_DISPATCH_SLEEP);
+				}
 				continue;
 			} else {
 				DBG("stream iter end: stop=%ld, time=%ld", stop, time(NULL));
 				break;
 			}
 		}
-		if ((event_doc = xmlReadMemory(event, strlen(event), NULL, NULL, NC_XMLREAD_OPTIONS)) != NULL) {
-			/* apply filter */
-			if (filter != NULL) {
-
-				/* filter all content nodes in notification */
-				event_node = event_doc->children->children; /* doc -> <notification> -> <something> */
-				while (event_node != NULL) {
-					/* skip invalid nodes */
-					if (event_node->name == NULL || event_node->ns == NULL || event_node->ns->href == NULL) {
-						event_node = event_node->next;
-						continue;
-					}
-
-					/* skip eventTime element */
-					if (xmlStrcmp(event_node->name, BAD_CAST "eventTime") == 0 &&
-							xmlStrcmp(event_node->ns->href, BAD_CAST NC_NS_NOTIFICATIONS) == 0) {
-						event_node = event_node->next;
-						continue;
-					}
-
-					/* do not filter replayComplete notification */
-					if (xmlStrcmp(event_node->name, BAD_CAST "replayComplete")) {
-						/* filter the data */
-						if (ncxml_filter(event_node, filter, &aux_node, NULL) != 0) {
-							ERROR("Filter failed.");
-							aux_node = xmlCopyNode(event_node, 1);
-						}
-					} else {
-						aux_node = xmlCopyNode(event_node, 1);
-					}
-					if (aux_node != NULL) {
-						aux_node->next = nodelist;
-						nodelist = aux_node;
-					}
-
-					/* detach and free currently filtered node from the original document */
-					aux_node = event_node;
-					event_node = event_node->next; /* find the next node to filter */
-					xmlUnlinkNode(aux_node);
-					xmlFreeNode(aux_node);
-				}
+		if ((shared = shared_event_get(event)) == NULL) {
+			free(event);
+			continue;
+		}
+		if (shared->doc == NULL) {
+			WARN("Invalid format of a stored event, skipping.");
+		} else if (filter == NULL) {
+			/* send the record as it is stored in the stream */
+			dispatch_event(session, shared->doc, shared->record, shared->len, batch_size != 0);
+		} else if ((filtered = shared_event_filter(shared, fkey, filter)) != NULL && filtered->doc != NULL) {
+			dispatch_event(session, filtered->doc, (char*)filtered->text, filtered->len, batch_size != 0);
+		}
+		shared_event_put(shared);
+		free(event);
 
-				if (nodelist != NULL) {
-					xmlAddChildList(event_doc->children, nodelist); /* into doc -> <notification> */
-					nodelist = NULL;
-				} else {
-					/* nothing to send */
-					xmlFreeDoc(event_doc);
-					free(event);
-					continue;
+		if (batch_size != 0 && session->nbuf_count != 0) {
+			/* write the batch when it is full or when its first notification waits too long */
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (session->nbuf_count == 1) {
+				deadline.tv_sec = now.tv_sec + batch_latency / 1000;
+				deadline.tv_nsec = now.tv_nsec + (batch_latency % 1000) * 1000000;
+				if (deadline.tv_nsec >= 1000000000) {
+					deadline.tv_sec++;
+					deadline.tv_nsec -= 1000000000;
 				}
 			}
-
-			ntf = malloc(sizeof(nc_rpc));
-			if (ntf == NULL) {
-				ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-				DBG_LOCK("mut_ntf");
-				pthread_mutex_lock(&(session->mut_ntf));
-				session->ntf_active = 0;
-				DBG_UNLOCK("mut_ntf");
-				pthread_mutex_unlock(&(session->mut_ntf));
-				nc_filter_free(filter);
-				free(stream);
-				return (-1);
-			}
-			ntf->doc = event_doc;
-			ntf->msgid = NULL;
-			ntf->error = NULL;
-			ntf->next = NULL;
-			ntf->with_defaults = NCWD_MODE_NOTSET;
-			ntf->type.ntf = NC_NTF_UNKNOWN;
-			ntf->nacm = NULL;
-
-			/* create xpath evaluation context */
-			if ((ntf->ctxt = xmlXPathNewContext(ntf->doc)) == NULL) {
-				ERROR("%s: notification message XPath context cannot be created.", __func__);
-				DBG_LOCK("mut_ntf");
-				pthread_mutex_lock(&(session->mut_ntf));
-				session->ntf_active = 0;
-				DBG_UNLOCK("mut_ntf");
-				pthread_mutex_unlock(&(session->mut_ntf));
-				nc_filter_free(filter);
-				free(stream);
-				return (-1);
-			}
-
-			/* register base namespace for the rpc */
-			if (xmlXPathRegisterNs(ntf->ctxt, BAD_CAST NC_NS_NOTIFICATIONS_ID, BAD_CAST NC_NS_NOTIFICATIONS) != 0) {
-				ERROR("Registering notification namespace for the message xpath context failed.");
-				DBG_LOCK("mut_ntf");
-				pthread_mutex_lock(&(session->mut_ntf));
-				session->ntf_active = 0;
-				DBG_UNLOCK("mut_ntf");
-				pthread_mutex_unlock(&(session->mut_ntf));
-				nc_filter_free(filter);
-				free(stream);
-				return (-1);
-			}
-
-			/* NACM - check notification permition */
-			if (nacm_check_notification(ntf, session) == NACM_PERMIT) {
-				DBG_LOCK("mut_session");
-				pthread_mutex_lock(&(session->mut_session));
-				DBG_LOCK("mut_ntf");
-				pthread_mutex_lock(&(session->mut_ntf));
-				if (!session->ntf_stop) {
-					DBG_UNLOCK("mut_ntf");
-					pthread_mutex_unlock(&(session->mut_ntf));
-					if (nc_session_send_notif(session, ntf) != EXIT_SUCCESS) {
-						ERROR("Sending a notification failed.");
-					}
-				} else {
-					DBG_UNLOCK("mut_ntf");
-					pthread_mutex_unlock(&(session->mut_ntf));
-				}
-				DBG_UNLOCK("mut_session");
-				pthread_mutex_unlock(&(session->mut_session));
-			} else {
-				/* update stats */
-				if (nc_info) {
-					pthread_rwlock_wrlock(&(nc_info->lock));
-					nc_info->stats_nacm.denied_notifs++;
-					pthread_rwlock_unlock(&(nc_info->lock));
-				}
+			if (session->nbuf_len >= batch_size || now.tv_sec > deadline.tv_sec ||
+					(now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)) {
+				dispatch_flush(session);
 			}
-
-			ncntf_notif_free(ntf);
-		} else {
-			WARN("Invalid format of a stored event, skipping.");
 		}
-		free(event);
 	}
-	xmlFreeDoc(filter_doc);
 	ncntf_stream_iter_finish(stream);
 
 	/* cleanup */
 	nc_filter_free(filter);
+	free(fkey);
 	free(stream);
 
 	DBG_LOCK("mut_ntf");
 	pthread_mutex_lock(&(session->mut_ntf));
 	session->ntf_active = 0;
 	if (!session->ntf_stop) {
+		/* send the rest of the batched notifications first */
+		dispatch_flush(session);
+
 		/* if not finished by external stop, send notificationComplete Notification */
 		ntf = calloc(1, sizeof(nc_rpc));
 		if (ntf == NULL) {
@@ -76,6 +76,29 @@ typedef enum {
 	NCNTF_EVENT_BY_USER /**< event is caused by the user's action */
 }NCNTF_EVENT_BY;
 
+/**
+ * @ingroup notifications
+ * @brief Enumeration of the formats of the records stored in the stream file.
+ */
+typedef enum {
+	NCNTF_RECORD_XML = 0, /**< the notification text only (default) */
+	NCNTF_RECORD_COMPACT = 1, /**< the event name, namespace and time in the record header followed by the notification text */
+	NCNTF_RECORD_DEFLATE = 2 /**< as #NCNTF_RECORD_COMPACT, the larger notification texts are compressed */
+} NCNTF_RECORD_FORMAT;
+
+/**
+ * @ingroup notifications
+ * @brief Description of an event record passed to the ncntf_stream_scan()
+ * callback. The strings are valid only during the callback.
+ */
+struct ncntf_record {
+	time_t time; /**< time of the event */
+	const char* name; /**< name of the event (the root element of the content) */
+	const char* ns; /**< namespace of the event, empty string if not known */
+	size_t size; /**< length of the notification text including the terminating null byte */
+	const char* text; /**< the notification text, NULL if not requested */
+};
+
 /**
  * @ingroup notifications
  * @brief Get the status data in xml form describing the currently used streams.
@@ -104,6 +127,46 @@ int ncntf_stream_new(const char* name, const char* desc, int replay);
  */
 int ncntf_stream_allow_events(const char* stream, const char* event);
 
+/**
+ * @ingroup notifications
+ * @brief Limit the replay log of the given Notification stream. The log is
+ * kept in several segments, an old segment is dropped when the log exceeds
+ * the size limit or when all its events are older than the age limit, so the
+ * limits are applied approximately (by the size of the segment). The time of
+ * the latest dropped event is reported as replayLogAgedTime.
+ *
+ * The limits are not stored in the stream file, every process writing into
+ * the stream is supposed to set them.
+ *
+ * @param[in] stream Name of the stream.
+ * @param[in] size Maximum size of the replay log in bytes, 0 for unlimited.
+ * @param[in] age Maximum age of the events in the replay log in seconds, 0
+ * for unlimited.
+ * @param[in] archive Path to the directory where the dropped segments are moved,
+ * NULL to remove them. The directory must be on the same filesystem as the
+ * stream files.
+ * @return 0 on success, non-zero on error
+ */
+int ncntf_stream_set_retention(const char* stream, size_t size, time_t age, const char* archive);
+
+/**
+ * @ingroup notifications
+ * @brief Set the format of the records stored into the given Notification
+ * stream. The compact records carry the event name, namespace and time in
+ * their header, so ncntf_stream_scan() filters them without reading the
+ * notification texts. Records of all the formats can be mixed in a stream
+ * and all of them are read transparently, but the older libnetconf versions
+ * stop reading the stream at the first compact record.
+ *
+ * The format is not stored in the stream file, every process writing into
+ * the stream is supposed to set it.
+ *
+ * @param[in] stream Name of the stream.
+ * @param[in] format Format of the newly stored records.
+ * @return 0 on success, non-zero on error
+ */
+int ncntf_stream_set_format(const char* stream, NCNTF_RECORD_FORMAT format);
+
 /**
  * @ingroup notifications
  * @brief Get the list of NETCONF event notifications streams.
@@ -162,6 +225,33 @@ char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop, time
  */
 void ncntf_stream_iter_finish(const char* stream);
 
+/**
+ * @ingroup notifications
+ * @brief Walk the records of the given stream (including all its kept
+ * segments) and pass the ones matching the time range and the event names
+ * to the callback. Unlike ncntf_stream_iter_next(), the stream file is read
+ * in large blocks and the compact records (see ncntf_stream_set_format()) are
+ * matched by their header only, the notification text is decompressed and
+ * passed to the callback only if requested. The records stored after the
+ * scan started are not passed.
+ *
+ * @param[in] stream Name of the stream to scan.
+ * @param[in] start Time of the first event the caller is interested in, -1
+ * for no limit.
+ * @param[in] stop Time of the last event the caller is interested in, -1 for
+ * no limit.
+ * @param[in] events NULL terminated list of the event names the caller is
+ * interested in, NULL for all the events.
+ * @param[in] text Non-zero to get the notification text of the matching
+ * records.
+ * @param[in] clb Callback called for every matching record, the scan stops
+ * if it returns non-zero value.
+ * @param[in] arg Arbitrary argument passed to the callback.
+ * @return Number of the matching records, -1 on error.
+ */
+long long int ncntf_stream_scan(const char* stream, time_t start, time_t stop, const char* const* events, int text,
+		int (*clb)(const struct ncntf_record* record, void* arg), void* arg);
+
 /**
  * @ingroup notifications
  * @brief Store a new event in the specified stream. Parameters are specific
@@ -281,6 +371,22 @@ nc_reply* ncntf_subscription_check(const nc_rpc* subscribe_rpc);
  */
 long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc* subscribe_rpc);
 
+/**
+ * @ingroup notifications
+ * @brief Set batching of the notifications sent by ncntf_dispatch_send(). The
+ * notifications available in the stream are collected and written into the
+ * session together, every notification is still framed as a separate message.
+ * The batch is written when it reaches the given size, when its first
+ * notification waits for the given time or when there is no other event
+ * in the stream. The settings apply to the subscriptions started later.
+ *
+ * @param[in] size Maximum size of the batch in bytes, 0 to disable batching
+ * (default).
+ * @param[in] latency Maximum time in milliseconds a notification can wait in
+ * the batch.
+ */
+void ncntf_dispatch_set_batch(size_t size, unsigned int latency);
+
 /**
  * @ingroup notifications
  * @brief Subscribe for receiving notifications from the given session
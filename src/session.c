@@ -46,13 +46,15 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
-#include <dirent.h>
+#include <sys/file.h>
+#include <sys/epoll.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <poll.h>
 #include <pthread.h>
 #include <pwd.h>
 #include <ctype.h>
+#include <zlib.h>
 
 #ifndef DISABLE_LIBSSH
 #	include <libssh/libssh.h>
@@ -101,6 +103,10 @@ extern struct nc_shared_info *nc_info;
  */
 extern int nc_init_flags;
 
+/* client side dispatching of the received replies, see below */
+static void nc_session_reader_stop(struct nc_session* session);
+static void nc_session_async_free(struct nc_session* session);
+
 /**
  * @brief List of possible NETCONF transportation supported by libnetconf
  */
@@ -108,10 +114,15 @@ enum nc_transport {
 	NC_TRTANSPORT_SSH /* netconf-ssh */
 };
 
+/**
+ * @brief Size of the space for the username and source-host strings in the
+ * session record, longer strings are truncated.
+ */
+#define SESSION_DATA_SIZE 512
+
 struct session_list_item {
-	int offset_prev;
-	int offset_next;
-	int size;
+	int next; /* next record in the hash chain or in the list of free records, -1 ends the list */
+	int used; /* flag if the record is occupied */
 	int active; /* flag if the non-dummy session is connected to this record */
 	int scounter; /* number of sessions connected with this record */
 	char session_id[SID_SIZE];
@@ -119,84 +130,99 @@ struct session_list_item {
 	enum nc_transport transport;
 	struct nc_session_stats stats;
 	char login_time[TIME_LENGTH];
-	 /*
-	  * variable length part - data actually contain 2 strings (username and
-	  * source-host whose lengths can differ for each session)
-	  */
 	pthread_rwlock_t lock;
-	char data[1];
+	/* data contain 2 strings - username and source-host */
+	char data[SESSION_DATA_SIZE];
 };
 
+/**
+ * @brief Magic number of the mapped file with the session list, identifies
+ * the layout of the file.
+ */
+#define SESSION_LIST_MAGIC 0x4e435332
+
+/**
+ * @brief Number of buckets in the hash table of the session list.
+ */
+#define SESSION_LIST_BUCKETS 1024
+
+/**
+ * @brief Number of records the session list file grows by.
+ */
+#define SESSION_LIST_STEP 64
+
+/**
+ * @brief Maximal number of records in the session list. The address space
+ * for all of them is reserved when the file is mapped, so the records never
+ * move when the file grows.
+ */
+#define SESSION_LIST_MAX 16384
+
 struct session_list_map {
 	/* start of the mapped file with session list */
-	int size; /* current file size (may include gaps) */
+	unsigned int magic;
+	int size; /* current number of records in the file */
 	int count; /* current number of sessions */
-	int first_offset;
+	int used; /* number of records ever occupied, the records behind were never touched */
+	int free; /* first of the free records, -1 if there is none */
 	pthread_rwlock_t lock; /* lock for the all file - for resizing */
-	struct session_list_item record[1]; /* first record of the session records list */
+	int bucket[SESSION_LIST_BUCKETS]; /* first records of the hash chains indexed by the session ID hash */
+	struct session_list_item record[1]; /* array of the session records */
 };
 
+#define SESSION_LIST_FILESIZE(records) (offsetof(struct session_list_map, record) + (records) * sizeof(struct session_list_item))
+
 static int session_list_fd = -1;
 static struct session_list_map *session_list = NULL;
+static pid_t session_list_lease = 0; /* PID of the process holding the lease in session_list_fd */
 
 /**
  * Sleep time in microseconds to wait between unsuccessful reading due to EAGAIN or EWOULDBLOCK
  */
 #define NC_READ_SLEEP 100
-#ifdef DISABLE_LIBSSH
-#ifdef ENABLE_TLS
-#define NC_WRITE(session,buf,c,ret) \
-	if (session->fd_output != -1) {ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->tls){ \
-		ret = SSL_write(session->tls, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#else /* not ENABLE_TLS (but DISABLE_LIBSSH) */
-#define NC_WRITE(session,buf,c,ret) \
-	if (session->fd_output != -1) {ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#endif /* not ENABLE_TLS */
-#else /* not DISABLE_LIBSSH */
-#ifdef ENABLE_TLS
-#define NC_WRITE(session,buf,c,ret) \
-	if(session->ssh_chan){ \
-		ret = ssh_channel_write (session->ssh_chan, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->tls){ \
-		ret = SSL_write(session->tls, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->fd_output != -1) { \
-		ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#else /* not ENABLE_TLS */
-#define NC_WRITE(session,buf,c,ret) \
-	if(session->ssh_chan){ \
-		ret = ssh_channel_write (session->ssh_chan, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->fd_output != -1) { \
-		ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#endif /* not ENABLE_TLS */
-#endif /* not DISABLE_LIBSSH */
-
-#define SIZE_STEP (1024*16)
+
+/**
+ * Maximal time in milliseconds to wait for the communication channel to become
+ * ready after EAGAIN or EWOULDBLOCK, then the operation is simply retried
+ */
+#define NC_READY_TIMEOUT 1000
+
+/**
+ * Size of the block of data read from the communication channel at once
+ */
+#define NC_READ_BUFSIZE (1024*16)
+
+/**
+ * Receive buffer larger than this size is freed when it becomes empty
+ */
+#define NC_READ_BUFSIZE_MAX (1024*1024)
+
+/**
+ * Maximal size of the message data written into the communication channel at
+ * once, in case of NETCONF 1.1 it is also the maximal size of a chunk
+ */
+#define NC_WRITE_BUFSIZE (1024*64)
+
+/**
+ * Space reserved in front of the send buffer data for the chunk header
+ * ("\n#" + up to 10 digits + "\n")
+ */
+#define NC_WRITE_HDRSIZE 16
+
+/**
+ * Space reserved behind the send buffer data for the end of message tag
+ */
+#define NC_WRITE_ENDSIZE 8
+
+/**
+ * Compression level of the messages sent in the deflate encoding
+ */
+#define NC_DEFLATE_LEVEL Z_DEFAULT_COMPRESSION
+
 int nc_session_monitoring_init(void)
 {
 	struct stat fdinfo;
-	int first = 0, c;
-	size_t size;
+	int first = 0, i;
 	pthread_rwlockattr_t rwlockattr;
 	mode_t um;
 
@@ -217,35 +243,37 @@ int nc_session_monitoring_init(void)
 		return (EXIT_FAILURE);
 	}
 
+	/* do not let another process see the file half initiated */
+	while (flock(session_list_fd, LOCK_EX) == -1 && errno == EINTR);
+
 	/* get the file size */
 	if (fstat(session_list_fd, &fdinfo) == -1) {
 		ERROR("Unable to get the sessions monitoring file information (%s)", strerror(errno));
-		close(session_list_fd);
-		session_list_fd = -1;
-		return (EXIT_FAILURE);
+		goto error;
 	}
 
 	if (fdinfo.st_size == 0) {
 		/* we have a new file, create some initial size using file gaps */
 		first = 1;
-		lseek(session_list_fd, SIZE_STEP - 1, SEEK_SET);
-		while (((c = write(session_list_fd, "", 1)) == -1) && (errno == EAGAIN || errno == EINTR));
-		if (c == -1) {
-			WARN("%s: Preparing the session list file failed (%s).", __func__, strerror(errno));
+		if (ftruncate(session_list_fd, SESSION_LIST_FILESIZE(SESSION_LIST_STEP)) == -1) {
+			ERROR("%s: Preparing the session list file failed (%s).", __func__, strerror(errno));
+			goto error;
 		}
-		lseek(session_list_fd, 0, SEEK_SET);
-		size = SIZE_STEP;
-	} else {
-		size = fdinfo.st_size;
+	} else if ((size_t) fdinfo.st_size < SESSION_LIST_FILESIZE(0)) {
+		ERROR("The sessions monitoring file %s is corrupted.", SESSIONSFILE_PATH);
+		goto error;
 	}
 
-	session_list = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, session_list_fd, 0);
+	/*
+	 * map the space for the maximal number of records, only the part covered
+	 * by the file can be accessed, but the records do not move when the file
+	 * grows, so the statistics of the sessions can point directly into it
+	 */
+	session_list = mmap(NULL, SESSION_LIST_FILESIZE(SESSION_LIST_MAX), PROT_READ | PROT_WRITE, MAP_SHARED, session_list_fd, 0);
 	if (session_list == MAP_FAILED) {
 		ERROR("Accessing the shared sessions monitoring file failed (%s)", strerror(errno));
-		close(session_list_fd);
 		session_list = NULL;
-		session_list_fd = -1;
-		return (EXIT_FAILURE);
+		goto error;
 	}
 
 	if (first) {
@@ -254,53 +282,184 @@ int nc_session_monitoring_init(void)
 		pthread_rwlock_init(&(session_list->lock), &rwlockattr);
 		pthread_rwlockattr_destroy(&rwlockattr);
 		pthread_rwlock_wrlock(&(session_list->lock));
-		session_list->size = SIZE_STEP;
+		session_list->size = SESSION_LIST_STEP;
 		session_list->count = 0;
+		session_list->used = 0;
+		session_list->free = -1;
+		for (i = 0; i < SESSION_LIST_BUCKETS; i++) {
+			session_list->bucket[i] = -1;
+		}
+		session_list->magic = SESSION_LIST_MAGIC;
 		pthread_rwlock_unlock(&(session_list->lock));
+	} else if (session_list->magic != SESSION_LIST_MAGIC) {
+		ERROR("The sessions monitoring file %s has an unknown format.", SESSIONSFILE_PATH);
+		munmap(session_list, SESSION_LIST_FILESIZE(SESSION_LIST_MAX));
+		session_list = NULL;
+		goto error;
 	}
 
+	flock(session_list_fd, LOCK_UN);
 	return (EXIT_SUCCESS);
+
+error:
+	close(session_list_fd);
+	session_list_fd = -1;
+	return (EXIT_FAILURE);
 }
 
 void nc_session_monitoring_close(void)
 {
 	if (session_list) {
-		munmap(session_list, session_list->size);
+		munmap(session_list, SESSION_LIST_FILESIZE(SESSION_LIST_MAX));
 		close(session_list_fd);
 		session_list = NULL;
 		session_list_fd = -1;
+		session_list_lease = 0;
+	}
+}
+
+/*
+ * @brief Take the lease marking the calling process as an owner of monitored
+ * sessions.
+ *
+ * The lease is a write lock of the byte at the offset equal to the owner's PID
+ * in the sessions monitoring file. The kernel releases the lock when the process
+ * terminates, so other processes can check that the owner is alive (and it is
+ * still the same process using libnetconf) by a single fcntl() call.
+ */
+static void nc_session_monitor_lease(void)
+{
+	struct flock lease;
+	pid_t pid = getpid();
+
+	if (session_list_lease == pid) {
+		/* already taken */
+		return;
+	}
+
+	lease.l_type = F_WRLCK;
+	lease.l_whence = SEEK_SET;
+	lease.l_start = pid;
+	lease.l_len = 1;
+	if (fcntl(session_list_fd, F_SETLK, &lease) == -1) {
+		WARN("Unable to mark the process as the owner of monitored sessions (%s).", strerror(errno));
+		return;
+	}
+	session_list_lease = pid;
+}
+
+/*
+ * @return 1 if the process holding the sessions is still alive, 0 otherwise.
+ */
+static int nc_session_monitor_owner_alive(pid_t pid)
+{
+	struct flock lease;
+
+	if (pid == getpid()) {
+		/* locks of the process itself are not reported */
+		return (1);
+	}
+
+	lease.l_type = F_WRLCK;
+	lease.l_whence = SEEK_SET;
+	lease.l_start = pid;
+	lease.l_len = 1;
+	if (fcntl(session_list_fd, F_GETLK, &lease) == -1) {
+		/* we cannot do any check */
+		return (1);
+	}
+
+	return (lease.l_type != F_UNLCK);
+}
+
+static unsigned int session_list_hash(const char* session_id)
+{
+	unsigned int hash = 5381;
+
+	for (; *session_id != '\0'; session_id++) {
+		hash = hash * 33 + (unsigned char) *session_id;
+	}
+
+	return (hash % SESSION_LIST_BUCKETS);
+}
+
+/*
+ * @brief Find the record of the session in the session list, the list must
+ * be locked.
+ *
+ * @param[out] prev Index of the previous record in the hash chain, -1 if the
+ * record is the first one. Can be NULL.
+ */
+static struct session_list_item* nc_session_monitor_find(const char* session_id, int* prev)
+{
+	int i, p = -1;
+
+	for (i = session_list->bucket[session_list_hash(session_id)]; i != -1; p = i, i = session_list->record[i].next) {
+		if (strcmp(session_list->record[i].session_id, session_id) == 0) {
+			if (prev != NULL) {
+				*prev = p;
+			}
+			return (&(session_list->record[i]));
+		}
 	}
+
+	return (NULL);
 }
 
 int nc_session_is_monitored(const char* session_id)
 {
-	struct session_list_item *litem;
+	int ret;
 
-	if (session_list->count == 0) {
+	if (session_list == NULL) {
 		return 0;
 	}
 
-	for(litem = (struct session_list_item*)((char*)(session_list->record) + session_list->first_offset);
-				litem != NULL;
-				litem = (struct session_list_item*)((char*)litem + litem->offset_next)) {
-		if (strcmp(litem->session_id, session_id) == 0) {
-			return 1;
-		}
+	pthread_rwlock_rdlock(&(session_list->lock));
+	ret = (session_list->count != 0 && nc_session_monitor_find(session_id, NULL) != NULL);
+	pthread_rwlock_unlock(&(session_list->lock));
 
-		if (litem->offset_next == 0) {
-			/* we are at the end of the list */
-			break;
+	return (ret);
+}
+
+/*
+ * @brief Get a free record of the session list, enlarge the file if needed.
+ * The list must be locked for writing.
+ *
+ * @return Index of the record, -1 on error.
+ */
+static int nc_session_monitor_alloc(void)
+{
+	int i;
+
+	if (session_list->free != -1) {
+		/* reuse a released record */
+		i = session_list->free;
+		session_list->free = session_list->record[i].next;
+		return (i);
+	}
+
+	if (session_list->used == session_list->size) {
+		if (session_list->size + SESSION_LIST_STEP > SESSION_LIST_MAX) {
+			ERROR("There is not enough space to monitor another NETCONF session.");
+			return (-1);
+		}
+		if (ftruncate(session_list_fd, SESSION_LIST_FILESIZE(session_list->size + SESSION_LIST_STEP)) == -1) {
+			ERROR("Enlarging the sessions monitoring file failed (%s).", strerror(errno));
+			return (-1);
 		}
+		session_list->size += SESSION_LIST_STEP;
 	}
 
-	return 0;
+	return (session_list->used++);
 }
 
 API int nc_session_monitor(struct nc_session* session)
 {
-	struct session_list_item *litem = NULL, *litem_aux;
+	struct session_list_item *litem = NULL;
 	pthread_rwlockattr_t rwlockattr;
-	int prev, next, size, totalsize = 0;
+	unsigned int hash;
+	size_t len;
+	int i;
 
 	if (session->monitored) {
 		return (EXIT_SUCCESS);
@@ -317,132 +476,68 @@ API int nc_session_monitor(struct nc_session* session)
 
 	/* critical section */
 	pthread_rwlock_wrlock(&(session_list->lock));
-	if (session_list->count > 0) {
-		/* find possible duplicity of the record */
-		for(litem = (struct session_list_item*)((char*)(session_list->record) + session_list->first_offset);
-				litem != NULL;
-				litem = (struct session_list_item*)((char*)litem + litem->offset_next)) {
-			if (strcmp(session->session_id, litem->session_id) == 0) {
-				/* session is already monitored */
-
-				/*
-				 * allow to add the session only if the connecting
-				 * session is dummy or if there is no real session
-				 * connected with this record
-				 */
-				if (session->status == NC_SESSION_STATUS_DUMMY) {
-					litem->scounter++;
-					/*
-					 * PID is not updated, since the keep-alive check should
-					 * focus on processes holding the real session, not the dummies
-					 */
-					pthread_rwlock_unlock(&(session_list->lock));
-
-					/* connect session statistics to the shared memory segment */
-					free(session->stats);
-					session->stats = &(litem->stats);
-					session->monitored = 1;
-					return (EXIT_SUCCESS);
-				} else if (session->status == NC_SESSION_STATUS_WORKING && litem->active == 0) {
-					litem->scounter++;
-					litem->active = 1;
-					/* update PID for keep-alive check */
-					litem->pid = getpid();
-					pthread_rwlock_unlock(&(session_list->lock));
-
-					/* connect session statistics to the shared memory segment */
-					free(session->stats);
-					session->stats = &(litem->stats);
-					session->monitored = 1;
-					return (EXIT_SUCCESS);
-				} else if (litem->active == 1) {
-					/* update PID for keep-alive check */
-					litem->pid = getpid();
-					pthread_rwlock_unlock(&(session_list->lock));
-					return (EXIT_SUCCESS);
-				} else {
-					ERROR("%s: specified session is in invalid state and cannot be monitored.", __func__);
-					pthread_rwlock_unlock(&(session_list->lock));
-					return (EXIT_FAILURE);
-				}
-			}
+	if (session_list->count > 0 && (litem = nc_session_monitor_find(session->session_id, NULL)) != NULL) {
+		/* session is already monitored */
 
-			if (litem->offset_next == 0) {
-				/* we are on the end of the list */
-				break;
-			}
+		/*
+		 * allow to add the session only if the connecting
+		 * session is dummy or if there is no real session
+		 * connected with this record
+		 */
+		if (session->status == NC_SESSION_STATUS_DUMMY) {
+			litem->scounter++;
+			/*
+			 * PID is not updated, since the keep-alive check should
+			 * focus on processes holding the real session, not the dummies
+			 */
+			pthread_rwlock_unlock(&(session_list->lock));
+
+			/* connect session statistics to the shared memory segment */
+			free(session->stats);
+			session->stats = &(litem->stats);
+			session->monitored = 1;
+			return (EXIT_SUCCESS);
+		} else if (session->status == NC_SESSION_STATUS_WORKING && litem->active == 0) {
+			litem->scounter++;
+			litem->active = 1;
+			/* update PID for keep-alive check */
+			litem->pid = getpid();
+			nc_session_monitor_lease();
+			pthread_rwlock_unlock(&(session_list->lock));
+
+			/* connect session statistics to the shared memory segment */
+			free(session->stats);
+			session->stats = &(litem->stats);
+			session->monitored = 1;
+			return (EXIT_SUCCESS);
+		} else if (litem->active == 1) {
+			/* update PID for keep-alive check */
+			litem->pid = getpid();
+			nc_session_monitor_lease();
+			pthread_rwlock_unlock(&(session_list->lock));
+			return (EXIT_SUCCESS);
+		} else {
+			ERROR("%s: specified session is in invalid state and cannot be monitored.", __func__);
+			pthread_rwlock_unlock(&(session_list->lock));
+			return (EXIT_FAILURE);
 		}
 	}
 
-	/* find the place for a new record, try to place it into some gap */
-	size = (sizeof(struct session_list_item) - 1) + (
-	                (session->username != NULL) ? (strlen(session->username) + 1) : 1) + (
-	                (session->hostname != NULL) ? (strlen(session->hostname) + 1) : 1);
-	if (session_list->count == 0) {
-		/* we add the first item into the list */
-		litem = &(session_list->record[0]);
-		litem->offset_prev = 0;
-		litem->offset_next = 0;
-		session_list->first_offset = 0;
-	} else if (session_list->first_offset >= size) {
-		/* the gap is in the beginning of the list */
-		litem = &(session_list->record[0]);
-		litem->offset_prev = 0;
-		litem->offset_next = session_list->first_offset;
-		session_list->first_offset = 0;
-	} else {
-		totalsize = session_list->first_offset;
-
-		/* search for a gap inside the list */
-		for (litem = (struct session_list_item*) ((char*) (session_list->record) + session_list->first_offset);
-		                ;
-		                litem = (struct session_list_item*) ((char*) litem + litem->offset_next)) {
-			/* check if there is enough space to add new record */
-			if ((totalsize + litem->size + size) > session_list->size) {
-				ERROR("There is not enough space to monitor another NETCONF session.");
-				pthread_rwlock_unlock(&(session_list->lock));
-				return (EXIT_FAILURE);
-			} else {
-				totalsize += litem->offset_next;
-			}
-
-			if (litem->offset_next >= (size + litem->size)) {
-				/* we have the efficient gap */
-
-				/* correct links from predecessor */
-				prev = litem->size;
-				next = litem->offset_next - litem->size;
-				litem->offset_next = litem->size;
-
-				/* now go into the new record and create connection with sibling records */
-				litem = (struct session_list_item*)((char*)litem + litem->offset_next);
-				litem->offset_prev = prev;
-				litem->offset_next = next;
-
-				/* also correct links in successor */
-				litem_aux = (struct session_list_item*)((char*)litem + litem->offset_next);
-				litem_aux->offset_prev = litem->offset_next;
-				break;
-			} else if (litem->offset_next == 0) {
-				/* we are on the end of the list */
-				prev = litem->size;
-				litem->offset_next = litem->size;
-
-				/* now go into the new record */
-				litem = (struct session_list_item*)((char*)litem + litem->offset_next);
-				litem->offset_prev = prev;
-				litem->offset_next = 0;
-				break;
-			}
-			/* move to another item in the list */
-		}
+	/* get the record for the new session */
+	if ((i = nc_session_monitor_alloc()) == -1) {
+		pthread_rwlock_unlock(&(session_list->lock));
+		return (EXIT_FAILURE);
 	}
+	litem = &(session_list->record[i]);
 	session_list->count++;
 
 	/* fill new structure */
-	litem->size = size;
+	memset(litem, 0, offsetof(struct session_list_item, lock));
+	litem->used = 1;
 	strncpy(litem->session_id, session->session_id, SID_SIZE);
+	litem->session_id[SID_SIZE - 1] = 0; /* terminating null byte */
 	litem->pid = getpid();
+	nc_session_monitor_lease();
 	litem->transport = NC_TRTANSPORT_SSH;
 	if (session->stats != NULL) {
 		memcpy(&(litem->stats), session->stats, sizeof(struct nc_session_stats));
@@ -452,8 +547,15 @@ API int nc_session_monitor(struct nc_session* session)
 	strncpy(litem->login_time, (session->logintime == NULL) ? "" : session->logintime, TIME_LENGTH);
 	litem->login_time[TIME_LENGTH - 1] = 0; /* terminating null byte */
 
-	strcpy(litem->data, (session->username == NULL) ? "" : session->username);
-	strcpy(litem->data + 1 + strlen(litem->data), (session->hostname == NULL) ? "" : session->hostname);
+	/* username and source-host, truncated to fit into the record */
+	len = (session->username == NULL) ? 0 : strlen(session->username);
+	if (len > SESSION_DATA_SIZE / 2 - 1) {
+		len = SESSION_DATA_SIZE / 2 - 1;
+	}
+	memcpy(litem->data, (session->username == NULL) ? "" : session->username, len);
+	litem->data[len] = '\0';
+	strncpy(litem->data + len + 1, (session->hostname == NULL) ? "" : session->hostname, SESSION_DATA_SIZE - len - 1);
+	litem->data[SESSION_DATA_SIZE - 1] = '\0';
 
 	pthread_rwlockattr_init(&rwlockattr);
 	pthread_rwlockattr_setpshared(&rwlockattr, PTHREAD_PROCESS_SHARED);
@@ -467,108 +569,107 @@ API int nc_session_monitor(struct nc_session* session)
 	litem->scounter = 1;
 	session->monitored = 1;
 
+	/* link the record into its hash chain */
+	hash = session_list_hash(litem->session_id);
+	litem->next = session_list->bucket[hash];
+	session_list->bucket[hash] = i;
+
 	/* end of critical section, other processes now can access new record */
 	pthread_rwlock_unlock(&(session_list->lock));
 
 	return (EXIT_SUCCESS);
 }
 
-static void nc_session_monitor_remove(struct session_list_item *litem)
+/*
+ * @brief Remove the record from the session list, the list must be locked
+ * for writing.
+ *
+ * @param[in] prev Index of the previous record in the hash chain as returned
+ * by nc_session_monitor_find().
+ */
+static void nc_session_monitor_remove(struct session_list_item *litem, int prev)
 {
-	struct session_list_item *aux;
+	int i = litem - session_list->record;
 
-	/* reconnect the list */
-	if (litem->offset_prev == 0) { /* first item in the list */
-		session_list->first_offset += litem->offset_next;
+	/* disconnect the record from its hash chain */
+	if (prev == -1) {
+		session_list->bucket[session_list_hash(litem->session_id)] = litem->next;
 	} else {
-		aux = (struct session_list_item*) ((char*) litem - litem->offset_prev);
-		aux->offset_next = (litem->offset_next == 0) ? 0 : (aux->offset_next + litem->offset_next);
+		session_list->record[prev].next = litem->next;
 	}
-	aux = (struct session_list_item*) ((char*) litem + litem->offset_next);
-	aux->offset_prev = (litem->offset_prev == 0) ? 0 : (aux->offset_prev + litem->offset_prev);
+
+	/* and put it into the list of free records */
+	pthread_rwlock_destroy(&(litem->lock));
+	litem->used = 0;
+	litem->next = session_list->free;
+	session_list->free = i;
 	session_list->count--;
 }
 
-/* length of path of /proc/<PID>/fd/<FDNUM> */
-#define ALIVECHECK_PATH_LENGTH 32
+/*
+ * @brief Remove the records of sessions whose owners are not alive.
+ */
 static void nc_session_monitor_alive_check(void)
 {
 	struct session_list_item *litem;
-	char dirpath[ALIVECHECK_PATH_LENGTH];
-	char linkpath[ALIVECHECK_PATH_LENGTH];
-	char linkname[sizeof(SESSIONSFILE_PATH) + 1];
-	char* aux = NULL;
-	int len;
-	DIR *dir;
-	struct dirent* pfd;
+	int i, prev = -1, dead = 0, locked_write = 0;
+	pid_t pid = 0;
+	int alive = 1;
 
-	if (session_list != NULL) {
-		aux = strdup(SESSIONSFILE_PATH);
-		nc_clip_occurences_with(aux, '/', '/');
+	if (session_list == NULL) {
+		return;
+	}
 
-		pthread_rwlock_wrlock(&(session_list->lock));
+	/*
+	 * dead owners are rare, so check them under the read lock first
+	 * and get the write lock only if there is something to remove
+	 */
+	pthread_rwlock_rdlock(&(session_list->lock));
 
-		/* check the whole list of monitored sessions */
-		for (litem = (struct session_list_item*) ((char*) (session_list->record) + session_list->first_offset);
-				;
-		        litem = (struct session_list_item*) ((char*) litem + litem->offset_next)) {
-
-			/* check that the monitored process is still alive */
-			snprintf(dirpath, ALIVECHECK_PATH_LENGTH, "/proc/%d/fd", litem->pid);
-			if (access(dirpath, F_OK) == -1) {
-				/* no such a process exists, remove not alive session item */
-				litem->scounter = 0;
-				nc_session_monitor_remove(litem);
-			} else {
-				/* check that the process is still the same (is using libnetconf) */
-				dir = opendir(dirpath);
-				if (dir == NULL) {
-					if (errno == ENOENT) {
-						/* process /proc directory actually does not exist */
-						litem->scounter = 0;
-						nc_session_monitor_remove(litem);
-					} /* else we cannot do more checks */
-					goto alivecheck_next;
-				}
+again:
+	for (i = 0; session_list->count > 0 && i < session_list->used; i++) {
+		litem = &(session_list->record[i]);
+		if (!litem->used) {
+			continue;
+		}
 
-				/* search in all file descriptors for the sessions stats file */
-				errno = 0;
-				while((pfd = readdir(dir)) != NULL) {
-					snprintf(linkpath, ALIVECHECK_PATH_LENGTH, "%s/%s", dirpath, pfd->d_name);
-					if ((len = readlink(linkpath, linkname, sizeof(linkname))) > 0) {
-						linkname[len] = 0;
-						if (strcmp(linkname, aux) == 0) {
-							/* we have match, the process uses libnetconf */
-							break;
-						}
-					} /* not a symlink or other problem - simply it doesn't match, continue */
-				}
-				if (pfd == NULL) {
-					/* the process does not use libnetconf, remove not alive session item */
-					litem->scounter = 0;
-					nc_session_monitor_remove(litem);
-				}
-				closedir(dir);
-			}
+		/* usually many sessions are held by the same process */
+		if (litem->pid != pid) {
+			pid = litem->pid;
+			alive = nc_session_monitor_owner_alive(pid);
+		}
+		if (alive) {
+			continue;
+		}
 
-alivecheck_next:
-			/* end loop condition */
-			if (litem->offset_next == 0) {
-				/* no other item in the list */
-				break;
-			}
+		if (!locked_write) {
+			dead = 1;
+			break;
 		}
 
+		/* no such a process exists, remove not alive session item */
+		litem->scounter = 0;
+		nc_session_monitor_find(litem->session_id, &prev);
+		nc_session_monitor_remove(litem, prev);
+	}
+
+	if (dead && !locked_write) {
+		/* the record could change in between, so check it all again */
 		pthread_rwlock_unlock(&(session_list->lock));
-		free(aux);
+		pthread_rwlock_wrlock(&(session_list->lock));
+		locked_write = 1;
+		pid = 0;
+		goto again;
 	}
 
+	pthread_rwlock_unlock(&(session_list->lock));
 }
 
 char* nc_session_stats(void)
 {
 	char *aux, *sessions = NULL, *session = NULL;
 	struct session_list_item *litem;
+	int i;
 
 	if (session_list == NULL) {
 		return (NULL);
@@ -577,7 +678,11 @@ char* nc_session_stats(void)
 		nc_session_monitor_alive_check();
 	}
 	pthread_rwlock_rdlock(&(session_list->lock));
-	for (litem = (struct session_list_item*)((char*)(session_list->record) + session_list->first_offset); session_list->count > 0 && litem != NULL;) {
+	for (i = 0; session_list->count > 0 && i < session_list->used; i++) {
+		litem = &(session_list->record[i]);
+		if (!litem->used) {
+			continue;
+		}
 		aux = NULL;
 		if (asprintf(&aux, "<session><session-id>%s</session-id>"
 				"<transport>netconf-ssh</transport>"
@@ -591,10 +696,10 @@ char* nc_session_stats(void)
 				litem->data, /* username */
 				litem->data + (strlen(litem->data) + 1), /* hostname */
 				litem->login_time,
-				litem->stats.in_rpcs,
-				litem->stats.in_bad_rpcs,
-				litem->stats.out_rpc_errors,
-				litem->stats.out_notifications) == -1) {
+				NC_STAT_GET(litem->stats.in_rpcs),
+				NC_STAT_GET(litem->stats.in_bad_rpcs),
+				NC_STAT_GET(litem->stats.out_rpc_errors),
+				NC_STAT_GET(litem->stats.out_notifications)) == -1) {
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 		} else {
 			if (session == NULL) {
@@ -613,13 +718,6 @@ char* nc_session_stats(void)
 				}
 			}
 		}
-
-		/* move to the next record */
-		if (litem->offset_next == 0) {
-			litem = NULL;
-		} else {
-			litem = (struct session_list_item*)((char*)litem + litem->offset_next);
-		}
 	}
 	pthread_rwlock_unlock(&(session_list->lock));
 
@@ -728,27 +826,55 @@ API int nc_session_notif_allowed(struct nc_session *session)
 
 API void nc_cpblts_free(struct nc_cpblts *c)
 {
-	int i;
-
 	if (c == NULL) {
 		return;
 	}
 
-	if (c->list != NULL) {
-		if (c->items <= c->list_size) {
-			for(i = 0; i < c->items; i++) {
-				if (c->list[i] != NULL) {
-					free(c->list[i]);
-				}
-			}
-		} else {
-			WARN("nc_cpblts_free: invalid capabilities structure, some memory may not be freed.");
-		}
-		free(c->list);
-	}
+	/* the capability strings are interned, so only the lists are freed */
+	free(c->list);
+	free(c->base);
+	free(c->xml);
 	free(c);
 }
 
+/*
+ * @brief Get the interned capability identifier, i.e. the capability string
+ * without its parameters.
+ */
+static const char* nc_cpblts_base(const char* capability_string, int add)
+{
+	const char *p;
+	size_t len;
+
+	len = ((p = strchr(capability_string, '?')) != NULL) ? (size_t)(p - capability_string) : strlen(capability_string);
+	return (add ? nc_str_intern(capability_string, len) : nc_str_interned(capability_string, len));
+}
+
+/*
+ * @brief Make a space for the next capability in the list.
+ */
+static int nc_cpblts_grow(struct nc_cpblts* c)
+{
+	void *tmp;
+
+	if ((c->items + 1) < c->list_size) {
+		return (EXIT_SUCCESS);
+	}
+
+	/* resize the capacity of the capabilities list */
+	if ((tmp = realloc(c->list, c->list_size * 2 * sizeof(char*))) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	c->list = tmp;
+	if ((tmp = realloc(c->base, c->list_size * 2 * sizeof(char*))) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	c->base = tmp;
+	c->list_size *= 2;
+
+	return (EXIT_SUCCESS);
+}
+
 API struct nc_cpblts* nc_cpblts_new(const char* const list[])
 {
 	struct nc_cpblts *retval;
@@ -762,27 +888,24 @@ API struct nc_cpblts* nc_cpblts_new(const char* const list[])
 
 	retval->list_size = 10; /* initial value */
 	retval->list = malloc(retval->list_size * sizeof(char*));
-	if (retval->list == NULL) {
+	retval->base = malloc(retval->list_size * sizeof(char*));
+	if (retval->list == NULL || retval->base == NULL) {
 		ERROR("Memory allocation failed: %s (%s:%d).", strerror (errno), __FILE__, __LINE__);
-		free(retval);
+		nc_cpblts_free(retval);
 		return (NULL);
 	}
 	retval->list[0] = NULL;
 
 	if (list != NULL) {
 		for (i = 0; list[i] != NULL; i++) {
-			retval->list[i] = strdup (list[i]);
-			retval->items++;
-			if (retval->items == retval->list_size) {
-				/* resize the capacity of the capabilities list */
-				void *tmp = realloc (retval->list, retval->list_size * 2 * sizeof (char*));
-				if (tmp == NULL) {
-					nc_cpblts_free (retval);
-					return (NULL);
-				}
-				retval->list = tmp;
-				retval->list_size *= 2;
+			if (nc_cpblts_grow(retval) != EXIT_SUCCESS ||
+					(retval->list[i] = (char*) nc_str_intern(list[i], strlen(list[i]))) == NULL ||
+					(retval->base[i] = nc_cpblts_base(list[i], 1)) == NULL) {
+				retval->list[i] = NULL;
+				nc_cpblts_free(retval);
+				return (NULL);
 			}
+			retval->items++;
 			retval->list[i + 1] = NULL;
 		}
 	}
@@ -793,53 +916,42 @@ API struct nc_cpblts* nc_cpblts_new(const char* const list[])
 API int nc_cpblts_add(struct nc_cpblts* capabilities, const char* capability_string)
 {
 	int i;
-	char *s, *p = NULL;
+	const char *s, *base;
 
 	if (capabilities == NULL || capability_string == NULL) {
 		return (EXIT_FAILURE);
 	}
 
-	/* get working copy of capability_string where the parameters will be ignored */
-	s = strdup(capability_string);
-	if ((p = strchr(s, '?')) != NULL) {
-		/* in following comparison, ignore capability's parameters */
-		*p = 0;
+	/* in following comparison, ignore capability's parameters */
+	if ((s = nc_str_intern(capability_string, strlen(capability_string))) == NULL ||
+			(base = nc_cpblts_base(capability_string, 1)) == NULL) {
+		return (EXIT_FAILURE);
 	}
 
+	/* the list changes, forget its serialization */
+	free(capabilities->xml);
+	capabilities->xml = NULL;
+
 	/* find duplicities */
 	for (i = 0; i < capabilities->items; i++) {
-		if (strncmp(capabilities->list[i], s, strlen(s)) == 0) {
+		if (capabilities->base[i] == base) {
 			/* capability is already in the capabilities list, but
 			 * parameters can differ, so substitute the current instance
 			 * with the new one
 			 */
-			free(capabilities->list[i]);
-			if (p != NULL) {
-				*p = '?';
-			}
-			capabilities->list[i] = s;
+			capabilities->list[i] = (char*) s;
 			return (EXIT_SUCCESS);
 		}
 	}
-	/* unhide capability's parameters */
-	if (p != NULL) {
-		*p = '?';
-	}
 
 	/* check size of the capabilities list */
-	if ((capabilities->items + 1) >= capabilities->list_size) {
-		/* resize the capacity of the capabilities list */
-		void *tmp = realloc(capabilities->list, capabilities->list_size * 2 * sizeof (char*));
-		if (tmp == NULL) {
-			free(s);
-			return (EXIT_FAILURE);
-		}
-		capabilities->list = tmp;
-		capabilities->list_size *= 2;
+	if (nc_cpblts_grow(capabilities) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
 	}
 
 	/* add capability into the list */
-	capabilities->list[capabilities->items] = s;
+	capabilities->list[capabilities->items] = (char*) s;
+	capabilities->base[capabilities->items] = base;
 	capabilities->items++;
 	/* set list terminating NULL item */
 	capabilities->list[capabilities->items] = NULL;
@@ -850,7 +962,7 @@ API int nc_cpblts_add(struct nc_cpblts* capabilities, const char* capability_str
 API int nc_cpblts_remove(struct nc_cpblts* capabilities, const char* capability_string)
 {
 	int i;
-	char* s, *p;
+	const char *base;
 
 	if (capabilities == NULL || capability_string == NULL) {
 		return (EXIT_FAILURE);
@@ -861,23 +973,24 @@ API int nc_cpblts_remove(struct nc_cpblts* capabilities, const char* capability_
 		return (EXIT_FAILURE);
 	}
 
-	s = strdup(capability_string);
-	if ((p = strchr(s, '?')) != NULL) {
-		/* in comparison, ignore capability's parameters */
-		p = 0;
+	if ((base = nc_cpblts_base(capability_string, 0)) == NULL) {
+		/* such a capability is in no list */
+		return (EXIT_SUCCESS);
 	}
 
 	for (i = 0; i < capabilities->items; i++) {
-		if (capabilities->list[i] != NULL && strncmp(capabilities->list[i], s, strlen(s)) == 0) {
+		if (capabilities->base[i] == base) {
 			break;
 		}
 	}
-	free(s);
 
 	if (i < capabilities->items) {
-		free(capabilities->list[i]);
+		free(capabilities->xml);
+		capabilities->xml = NULL;
+
 		/* move here the last item from the list */
 		capabilities->list[i] = capabilities->list[capabilities->items - 1];
+		capabilities->base[i] = capabilities->base[capabilities->items - 1];
 		/* and then set the last item in the list to NULL */
 		capabilities->list[capabilities->items - 1] = NULL;
 		capabilities->items--;
@@ -886,55 +999,71 @@ API int nc_cpblts_remove(struct nc_cpblts* capabilities, const char* capability_
 	return (EXIT_SUCCESS);
 }
 
+const char* nc_cpblts_xml(struct nc_cpblts* c)
+{
+	static pthread_mutex_t xml_mut = PTHREAD_MUTEX_INITIALIZER;
+	size_t len;
+	char *p;
+	int i;
+
+	if (c == NULL) {
+		return (NULL);
+	}
+
+	pthread_mutex_lock(&xml_mut);
+	if (c->xml == NULL) {
+		len = strlen("<capabilities></capabilities>") + 1;
+		for (i = 0; i < c->items; i++) {
+			len += strlen("<capability></capability>") + strlen(c->list[i]);
+		}
+		if ((c->xml = malloc(len)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			pthread_mutex_unlock(&xml_mut);
+			return (NULL);
+		}
+		p = stpcpy(c->xml, "<capabilities>");
+		for (i = 0; i < c->items; i++) {
+			p = stpcpy(p, "<capability>");
+			p = stpcpy(p, c->list[i]);
+			p = stpcpy(p, "</capability>");
+		}
+		strcpy(p, "</capabilities>");
+	}
+	pthread_mutex_unlock(&xml_mut);
+
+	return (c->xml);
+}
+
 API const char* nc_cpblts_get(const struct nc_cpblts* c, const char* capability_string)
 {
 	int i;
-	char* s, *p;
+	const char *base;
 
 	if (capability_string == NULL || c == NULL || c->list == NULL) {
 		return (NULL);
 	}
 
-	s = strdup(capability_string);
-	if ((p = strchr(s, '?')) != NULL) {
-		/* in comparison, ignore capability's parameters */
-		p = 0;
+	/* in comparison, ignore capability's parameters */
+	if ((base = nc_cpblts_base(capability_string, 0)) == NULL) {
+		/* never interned, so it cannot be in any list */
+		return (NULL);
 	}
 
-	for (i = 0; c->list[i]; i++) {
-		if (strncmp(s, c->list[i], strlen(s)) == 0) {
-			free(s);
+	for (i = 0; i < c->items; i++) {
+		if (c->base[i] == base) {
 			return (c->list[i]);
 		}
 	}
-	free(s);
 	return (NULL);
-
 }
 
 API int nc_cpblts_enabled(const struct nc_session* session, const char* capability_string)
 {
-	int i;
-	char* s, *p;
-
-	if (capability_string == NULL || session == NULL || session->capabilities == NULL) {
+	if (session == NULL) {
 		return (0);
 	}
 
-	s = strdup(capability_string);
-	if ((p = strchr(s, '?')) != NULL) {
-		/* in comparison, ignore capability's parameters */
-		p = 0;
-	}
-
-	for (i = 0; session->capabilities->list[i]; i++) {
-		if (strncmp(s, session->capabilities->list[i], strlen(s)) == 0) {
-			free(s);
-			return (1);
-		}
-	}
-	free(s);
-	return (0);
+	return (nc_cpblts_get(session->capabilities, capability_string) != NULL);
 }
 
 API void nc_cpblts_iter_start(struct nc_cpblts* c)
@@ -1004,6 +1133,9 @@ API struct nc_cpblts* nc_session_get_cpblts_default(void)
 		nc_cpblts_add(retval, NC_CAP_URL_ID);
 	}
 #endif
+	if (nc_init_flags & NC_INIT_DEFLATE) {
+		nc_cpblts_add(retval, NC_CAP_DEFLATE_ID);
+	}
 
 	/* add namespaces of used datastores as announced capabilities */
 	if ((nslist = get_schemas_capabilities(retval)) != NULL) {
@@ -1177,10 +1309,26 @@ static void announce_nc_session_closing(struct nc_session* session)
 
 void nc_session_close(struct nc_session* session, NC_SESSION_TERM_REASON reason)
 {
-	int i;
+	int i, pooled;
 	struct nc_msg *qmsg, *qmsg_aux;
 	NC_SESSION_STATUS sstatus = session->status;
 
+	/* the reader thread must not touch the session being closed */
+	nc_session_reader_stop(session);
+
+	/* no new channel can be opened on the SSH connection while closing */
+	pooled = nc_session_pool_leave(session);
+
+#ifndef DISABLE_NOTIFICATIONS
+	/*
+	 * let notification receiving/sending function stop, if any - it must be
+	 * done before locking the session, the dispatcher locks it to send events
+	 */
+	if (sstatus != NC_SESSION_STATUS_CLOSING && sstatus != NC_SESSION_STATUS_CLOSED) {
+		ncntf_dispatch_stop(session);
+	}
+#endif
+
 	/* lock session due to accessing its status and other items */
 	if (sstatus != NC_SESSION_STATUS_DUMMY) {
 		DBG_LOCK("mut_session");
@@ -1191,9 +1339,6 @@ void nc_session_close(struct nc_session* session, NC_SESSION_TERM_REASON reason)
 	if (session != NULL && session->status != NC_SESSION_STATUS_CLOSING && session->status != NC_SESSION_STATUS_CLOSED) {
 
 #ifndef DISABLE_NOTIFICATIONS
-		/* let notification receiving/sending function stop, if any */
-		ncntf_dispatch_stop(session);
-
 		/* log closing of the session */
 		if (sstatus != NC_SESSION_STATUS_DUMMY) {
 			ncntf_event_new(-1, NCNTF_BASE_SESSION_END, session, reason, NULL);
@@ -1288,6 +1433,8 @@ void nc_session_close(struct nc_session* session, NC_SESSION_TERM_REASON reason)
 		session->port = NULL;
 
 		/* remove messages from the queues */
+		DBG_LOCK("mut_mqueue");
+		pthread_mutex_lock(&(session->mut_mqueue));
 		for (i = 0, qmsg = session->queue_event; i < 2; i++, qmsg = session->queue_msg) {
 			while (qmsg != NULL) {
 				qmsg_aux = qmsg->next;
@@ -1295,6 +1442,10 @@ void nc_session_close(struct nc_session* session, NC_SESSION_TERM_REASON reason)
 				qmsg = qmsg_aux;
 			}
 		}
+		session->queue_event = NULL;
+		session->queue_msg = NULL;
+		DBG_UNLOCK("mut_mqueue");
+		pthread_mutex_unlock(&(session->mut_mqueue));
 
 		/*
 		 * capabilities, session_id and shared monitoring structure are untouched
@@ -1320,13 +1471,17 @@ void nc_session_close(struct nc_session* session, NC_SESSION_TERM_REASON reason)
 	}
 	session->next = NULL;
 	session->prev = NULL;
+
+	if (pooled) {
+		nc_session_pool_release();
+	}
 }
 
 
 API void nc_session_free(struct nc_session* session)
 {
 	struct session_list_item* litem;
-	int i;
+	int i, prev = -1;
 
 	if (session == NULL) {
 		return;
@@ -1342,51 +1497,56 @@ API void nc_session_free(struct nc_session* session)
 		}
 		free(session->groups);
 	}
+	nacm_rpc_free(session->nacm);
 	if (session->capabilities != NULL) {
 		nc_cpblts_free(session->capabilities);
 	}
+	free(session->rbuf);
+	if (session->rctxt != NULL) {
+		/* partially received message */
+		xmlFreeDoc(session->rctxt->myDoc);
+		xmlFreeParserCtxt(session->rctxt);
+	}
+	free(session->wbuf);
+	if (session->zout != NULL) {
+		deflateEnd(session->zout);
+		free(session->zout);
+	}
+	free(session->zbuf);
+	if (session->zin != NULL) {
+		inflateEnd(session->zin);
+		free(session->zin);
+	}
+	nc_metrics_add(NC_METRIC_NTF_QUEUED, -(int64_t) session->nbuf_count);
+	free(session->nbuf);
+	nc_session_async_free(session);
 
 	/* destroy mutexes */
 	pthread_mutex_destroy(&(session->mut_mqueue));
 	pthread_mutex_destroy(&(session->mut_equeue));
 	pthread_mutex_destroy(&(session->mut_ntf));
 	pthread_mutex_destroy(&(session->mut_session));
+	pthread_cond_destroy(&(session->cond_channel));
 
 	if (session_list != NULL && session->monitored == 1) {
 		/* remove from internal list if session is monitored */
 		pthread_rwlock_wrlock(&(session_list->lock));
-		if (session_list->count > 0) {
-			for (litem = (struct session_list_item*) ((char*) (session_list->record) + session_list->first_offset);
-					;
-					litem = (struct session_list_item*) ((char*) litem + litem->offset_next)) {
-				if (strcmp(litem->session_id, session->session_id) == 0) {
-					/* we have matching record */
-					litem->scounter--;
-					if (litem->scounter == 0) {
-						nc_session_monitor_remove(litem);
-					}
-
-					/* remove link from session statistics into the mapped file */
-					session->stats = NULL;
-
-					/* we are done */
-					break;
-				}
-
-				/* end loop condition */
-				if (litem->offset_next == 0) {
-					/* no other item in the list */
-
-					/* if the session's stats were not connected
-					 * with internal monitoring list, so free it
-					 */
-					free(session->stats);
-
-					/* end the loop */
-					break; /* for loop */
-				}
+		if (session_list->count > 0 && (litem = nc_session_monitor_find(session->session_id, &prev)) != NULL) {
+			/* we have matching record */
+			litem->scounter--;
+			if (litem->scounter == 0) {
+				nc_session_monitor_remove(litem, prev);
 			}
-		}
+
+			/* remove link from session statistics into the mapped file */
+			session->stats = NULL;
+		} else if ((char*) session->stats < (char*) session_list ||
+				(char*) session->stats >= (char*) session_list + SESSION_LIST_FILESIZE(SESSION_LIST_MAX)) {
+			/* if the session's stats were not connected
+			 * with internal monitoring list, so free it
+			 */
+			free(session->stats);
+		} /* else the record was already removed by the keep-alive check */
 		pthread_rwlock_unlock(&(session_list->lock));
 	} else {
 		/* there is no internal session monitoring list so session's
@@ -1408,17 +1568,384 @@ API NC_SESSION_STATUS nc_session_get_status (const struct nc_session* session)
 	return (session->status);
 }
 
-static int nc_session_send(struct nc_session* session, struct nc_msg *msg)
+/**
+ * @brief Wait until the session's communication channel is ready for reading
+ * (POLLIN) or writing (POLLOUT). It is used instead of sleeping when the
+ * channel returns EAGAIN or EWOULDBLOCK.
+ *
+ * @param[in] session Session to wait on.
+ * @param[in] events POLLIN or POLLOUT.
+ */
+static void nc_session_wait_ready(struct nc_session* session, short events)
 {
-	ssize_t c = 0;
-	int len, status;
-	char *text;
+	struct pollfd fds;
+
+#ifndef DISABLE_LIBSSH
+	if (session->ssh_chan != NULL && events == POLLIN) {
+		/* libssh buffers the data internally, so ask it directly */
+		ssh_channel_poll_timeout(session->ssh_chan, NC_READY_TIMEOUT, 0);
+		return;
+	}
+#endif
+
+	fds.fd = -1;
+	if (events == POLLIN) {
+#ifdef ENABLE_TLS
+		if (session->tls != NULL) {
+			fds.fd = SSL_get_fd(session->tls);
+		} else
+#endif
+		{
+			fds.fd = session->fd_input;
+		}
+	} else if (session->transport_socket != -1) {
+		fds.fd = session->transport_socket;
+	} else if (session->fd_output != -1) {
+		fds.fd = session->fd_output;
+	}
+#ifndef DISABLE_LIBSSH
+	else if (session->ssh_chan != NULL) {
+		fds.fd = ssh_get_fd(ssh_channel_get_session(session->ssh_chan));
+	}
+#endif
+#ifdef ENABLE_TLS
+	else if (session->tls != NULL) {
+		fds.fd = SSL_get_fd(session->tls);
+	}
+#endif
+
+	if (fds.fd == -1) {
+		/* there is nothing to wait on */
+		usleep(NC_READ_SLEEP);
+		return;
+	}
+
+	fds.events = events;
+	fds.revents = 0;
+	poll(&fds, 1, NC_READY_TIMEOUT);
+}
+
+/**
+ * @brief Unlock the communication channel locked for sending data and wake up
+ * the receiving threads waiting for it.
+ *
+ * @param[in] session Session whose channel is released.
+ */
+static void nc_session_channel_release(struct nc_session* session)
+{
+	session->mut_channel_flag = 0;
+	pthread_cond_broadcast(&(session->cond_channel));
+	DBG_UNLOCK("mut_channel");
+	pthread_mutex_unlock(session->mut_channel);
+}
+
+/**
+ * @brief Wait for the sending thread to release the communication channel.
+ * The caller must hold the mut_channel.
+ *
+ * @param[in] session Session whose channel is awaited.
+ * @param[in] timeout Timeout in milliseconds, -1 for infinite timeout.
+ * @return EXIT_SUCCESS if the channel is free, EXIT_FAILURE on timeout.
+ */
+static int nc_session_channel_wait(struct nc_session* session, int timeout)
+{
+	struct timespec ts;
+	int r = 0;
+
+	if (timeout > 0) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += timeout / 1000;
+		ts.tv_nsec += (timeout % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+	}
+
+	while (session->mut_channel_flag && timeout != 0 && r == 0) {
+		if (timeout < 0) {
+			r = pthread_cond_wait(&(session->cond_channel), session->mut_channel);
+		} else {
+			r = pthread_cond_timedwait(&(session->cond_channel), session->mut_channel, &ts);
+		}
+	}
+
+	return (session->mut_channel_flag ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * @brief Poll the input file descriptor of the session. The caller must hold
+ * the mut_channel. The lock is released while waiting for the data, so the
+ * sending threads are not blocked, and the result is then checked once more
+ * with the lock held.
+ *
+ * @param[in] session Session to poll.
+ * @param[in,out] fds Structure with the file descriptor to poll.
+ * @param[in] timeout Timeout in milliseconds, -1 for infinite timeout.
+ * @return The same values as poll().
+ */
+static int nc_session_poll_input(struct nc_session* session, struct pollfd *fds, int timeout)
+{
+	int status;
+
+	fds->events = POLLIN;
+	if (timeout != 0) {
+		fds->revents = 0;
+		DBG_UNLOCK("mut_channel");
+		pthread_mutex_unlock(session->mut_channel);
+		status = poll(fds, 1, timeout);
+		DBG_LOCK("mut_channel");
+		pthread_mutex_lock(session->mut_channel);
+		if (status <= 0) {
+			return (status);
+		}
+	}
+
+	fds->revents = 0;
+	return (poll(fds, 1, 0));
+}
+
+/**
+ * @brief Write data into the session's communication channel. The caller must
+ * hold the mut_channel.
+ *
+ * @param[in] session Session to write to.
+ * @param[in] data Data to write.
+ * @param[in] len Length of the data.
+ * @return EXIT_SUCCESS if all the data were written, EXIT_FAILURE otherwise.
+ */
+static int nc_session_write(struct nc_session* session, const char* data, size_t len)
+{
+	size_t c = 0;
+	ssize_t ret;
 #ifndef DISABLE_LIBSSH
 	const char *emsg;
 #endif
-	char buf[1024];
+
+	while (c < len) {
+		errno = 0;
+#ifndef DISABLE_LIBSSH
+		if (session->ssh_chan) {
+			ret = ssh_channel_write(session->ssh_chan, &(data[c]), len - c);
+			if (ret == SSH_ERROR) {
+				if (session->ssh_sess) {
+					emsg = ssh_get_error(session->ssh_sess);
+				} else {
+					emsg = "description not available";
+				}
+				VERB("Writing data into the communication channel failed (%s).", emsg);
+				return (EXIT_FAILURE);
+			}
+		} else
+#endif
+#ifdef ENABLE_TLS
+		if (session->tls) {
+			ret = SSL_write(session->tls, &(data[c]), len - c);
+			if (ret <= 0) {
+				switch (SSL_get_error(session->tls, ret)) {
+				case SSL_ERROR_WANT_READ:
+				case SSL_ERROR_WANT_WRITE:
+					errno = EAGAIN;
+					break;
+				default:
+					break;
+				}
+				ret = -1;
+			}
+		} else
+#endif
+		if (session->fd_output != -1) {
+			ret = write(session->fd_output, &(data[c]), len - c);
+		} else {
+			ret = -1;
+		}
+
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+			nc_session_wait_ready(session, POLLOUT);
+			continue;
+		} else if (ret < 0) {
+			VERB("Writing data into the communication channel failed (%s).", strerror(errno));
+			return (EXIT_FAILURE);
+		}
+		c += ret;
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Write the data from a send buffer into the communication channel. In
+ * case of NETCONF 1.1, the data are framed as a single chunk.
+ *
+ * @param[in] session Session to write to.
+ * @param[in] start Data in a buffer with NC_WRITE_HDRSIZE bytes free in front
+ * of them and NC_WRITE_ENDSIZE bytes free behind them.
+ * @param[in] len Length of the data.
+ * @param[in] last Flag if the end of message tag is supposed to be appended.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int nc_session_frame_write(struct nc_session* session, char *start, size_t len, int last)
+{
+	char hdr[NC_WRITE_HDRSIZE];
+	int hlen;
+
+	if (session->version == NETCONFV11 && len > 0) {
+		/* put the chunk header right in front of the data */
+		hlen = snprintf(hdr, NC_WRITE_HDRSIZE, "\n#%zu\n", len);
+		start -= hlen;
+		memcpy(start, hdr, hlen);
+		len += hlen;
+	}
+	if (last) {
+		if (session->version == NETCONFV11) {
+			memcpy(&(start[len]), NC_V11_END_MSG, strlen(NC_V11_END_MSG));
+			len += strlen(NC_V11_END_MSG);
+		} else { /* NETCONFV10 */
+			memcpy(&(start[len]), NC_V10_END_MSG, strlen(NC_V10_END_MSG));
+			len += strlen(NC_V10_END_MSG);
+		}
+	}
+
+	if (len == 0) {
+		return (EXIT_SUCCESS);
+	}
+
+	return (nc_session_write(session, start, len));
+}
+
+/**
+ * @brief Compress the content of the session's send buffer and write the
+ * compressed data into the communication channel as NETCONF 1.1 chunks. The
+ * first call for a message starts a new deflate stream, the stream is finished
+ * with the last part of the message.
+ *
+ * @param[in] session Session to flush.
+ * @param[in] last Flag if the message is complete, the stream is finished and
+ * the end of message tag is appended.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int nc_session_wbuf_deflate(struct nc_session* session, int last)
+{
+	z_stream *zs;
+	char *start;
+	int r;
+
+	if (!session->zout_active) {
+		if (session->zout == NULL) {
+			session->zbuf = malloc(NC_WRITE_HDRSIZE + NC_WRITE_BUFSIZE + NC_WRITE_ENDSIZE);
+			session->zout = calloc(1, sizeof(z_stream));
+			if (session->zbuf == NULL || session->zout == NULL || deflateInit(session->zout, NC_DEFLATE_LEVEL) != Z_OK) {
+				free(session->zbuf);
+				free(session->zout);
+				session->zbuf = NULL;
+				session->zout = NULL;
+				/* nothing of the message was written yet, continue in plain XML */
+				WARN("Initiating the message compression failed, sending plain messages (session %s).", session->session_id);
+				session->deflate = 0;
+				goto plain;
+			}
+		} else {
+			deflateReset(session->zout);
+		}
+		session->zout_active = 1;
+	}
+	zs = session->zout;
+	start = &(session->zbuf[NC_WRITE_HDRSIZE]);
+
+	zs->next_in = (Bytef*) &(session->wbuf[NC_WRITE_HDRSIZE]);
+	zs->avail_in = session->wbuf_len;
+	do {
+		zs->next_out = (Bytef*) start;
+		zs->avail_out = NC_WRITE_BUFSIZE;
+		r = deflate(zs, last ? Z_FINISH : Z_NO_FLUSH);
+		if (r == Z_STREAM_ERROR) {
+			ERROR("Compressing the message failed (session %s).", session->session_id);
+			return (EXIT_FAILURE);
+		}
+		if (nc_session_frame_write(session, start, NC_WRITE_BUFSIZE - zs->avail_out, 0) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+	} while (zs->avail_out == 0 || (last && r != Z_STREAM_END));
+	session->wbuf_len = 0;
+
+	if (!last) {
+		return (EXIT_SUCCESS);
+	}
+	session->zout_active = 0;
+	return (nc_session_frame_write(session, start, 0, 1));
+
+plain:
+	r = nc_session_frame_write(session, &(session->wbuf[NC_WRITE_HDRSIZE]), session->wbuf_len, last);
+	session->wbuf_len = 0;
+	return (r);
+}
+
+/**
+ * @brief Write the content of the session's send buffer into the communication
+ * channel. In case of NETCONF 1.1, the data are framed as a single chunk.
+ *
+ * When the compact encoding is negotiated, messages longer than the send
+ * buffer are compressed, the shorter ones are sent in plain XML.
+ *
+ * @param[in] session Session to flush.
+ * @param[in] last Flag if the end of message tag is supposed to be appended.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int nc_session_wbuf_flush(struct nc_session* session, int last)
+{
+	size_t len = session->wbuf_len;
+
+	if (session->zout_active || (!last && session->deflate)) {
+		return (nc_session_wbuf_deflate(session, last));
+	}
+
+	session->wbuf_len = 0;
+	return (nc_session_frame_write(session, &(session->wbuf[NC_WRITE_HDRSIZE]), len, last));
+}
+
+/**
+ * @brief libxml2's output callback storing the serialized message into the
+ * session's send buffer and flushing it when it is full.
+ */
+static int nc_session_wbuf_append(void *context, const char *buffer, int len)
+{
+	struct nc_session* session = (struct nc_session*) context;
+	int c = 0;
+	size_t n;
+
+	if (session->wbuf_error) {
+		return (-1);
+	}
+
+	while (c < len) {
+		n = NC_WRITE_BUFSIZE - session->wbuf_len;
+		if (n > (size_t) (len - c)) {
+			n = len - c;
+		}
+		memcpy(&(session->wbuf[NC_WRITE_HDRSIZE + session->wbuf_len]), &(buffer[c]), n);
+		session->wbuf_len += n;
+		c += n;
+
+		if (session->wbuf_len == NC_WRITE_BUFSIZE && nc_session_wbuf_flush(session, 0) != EXIT_SUCCESS) {
+			session->wbuf_error = 1;
+			return (-1);
+		}
+	}
+
+	return (len);
+}
+
+/**
+ * @brief Check that the session's communication channel is able
+ * to send data.
+ *
+ * @param[in] session Session to check.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int nc_session_send_ready(struct nc_session* session)
+{
+	int status;
 	struct pollfd fds;
-	int ret;
 
 	if (session->fd_output == -1 && session->transport_socket == -1
 #ifndef DISABLE_LIBSSH
@@ -1487,273 +2014,142 @@ static int nc_session_send(struct nc_session* session, struct nc_msg *msg)
 		break;
 	}
 
-	/* lock the session for sending the data */
-
-	xmlDocDumpFormatMemory (msg->doc, (xmlChar**) (&text), &len, NC_CONTENT_FORMATTED);
-	DBG("Writing message (session %s): %s", session->session_id, text);
+	return (EXIT_SUCCESS);
+}
 
+/**
+ * @brief Lock the session's communication channel and prepare the send buffer.
+ *
+ * @param[in] session Session to send data.
+ * @return EXIT_SUCCESS or EXIT_FAILURE, the channel is released in case of
+ * failure.
+ */
+static int nc_session_send_start(struct nc_session* session)
+{
+	/* lock the session for sending the data */
 	DBG_LOCK("mut_channel");
 	session->mut_channel_flag = 1;
 	pthread_mutex_lock(session->mut_channel);
-	/* if v1.1 send chunk information before message */
-	if (session->version == NETCONFV11) {
-		snprintf (buf, 1024, "\n#%d\n", (int) strlen (text));
-		c = 0;
-		do {
-			NC_WRITE(session, &(buf[c]), c, ret);
-			if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-				usleep(10);
-				continue;
-			}
-#ifndef DISABLE_LIBSSH
-			if (ret == SSH_ERROR) {
-				DBG_UNLOCK("mut_channel");
-				session->mut_channel_flag = 0;
-				pthread_mutex_unlock(session->mut_channel);
-				if (!session->ssh_chan) {
-					emsg = strerror(errno);
-				} else if (session->ssh_chan && session->ssh_sess) {
-					emsg = ssh_get_error(session->ssh_sess);
-				} else {
-					emsg = "description not available";
-				}
-				VERB("Writing data into the communication channel failed (%s).", emsg);
-				free (text);
-				return (EXIT_FAILURE);
-			}
-#endif
-			if (ret < 0) {
-				DBG_UNLOCK("mut_channel");
-				session->mut_channel_flag = 0;
-				pthread_mutex_unlock(session->mut_channel);
-				free (text);
-				return (EXIT_FAILURE);
-			}
-		} while (c < (ssize_t) strlen (buf));
-	}
 
-	/* write the message */
-	c = 0;
-	do {
-		NC_WRITE(session, &(text[c]), c, ret);
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			usleep(10);
-			continue;
-		}
-#ifndef DISABLE_LIBSSH
-		if (ret == SSH_ERROR) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			if (!session->ssh_chan) {
-				emsg = strerror(errno);
-			} else if (session->ssh_chan && session->ssh_sess) {
-				emsg = ssh_get_error(session->ssh_sess);
-			} else {
-				emsg = "description not available";
-			}
-			VERB("Writing data into the communication channel failed (%s).", emsg);
-			free (text);
-			return (EXIT_FAILURE);
-		}
-#endif
-		if (ret < 0) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			free (text);
+	if (session->wbuf == NULL) {
+		session->wbuf = malloc(NC_WRITE_HDRSIZE + NC_WRITE_BUFSIZE + NC_WRITE_ENDSIZE);
+		if (session->wbuf == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			nc_session_channel_release(session);
 			return (EXIT_FAILURE);
 		}
-	} while (c < (ssize_t) strlen (text));
-	free (text);
+	}
+	session->wbuf_len = 0;
+	session->wbuf_error = 0;
+	session->zout_active = 0;
 
-	/* close message */
-	if (session->version == NETCONFV11) {
-		text = NC_V11_END_MSG;
-	} else { /* NETCONFV10 */
-		text = NC_V10_END_MSG;
+	return (EXIT_SUCCESS);
+}
+
+static int nc_session_send(struct nc_session* session, struct nc_msg *msg)
+{
+	int len;
+	char *text;
+	xmlOutputBufferPtr out;
+
+	if (nc_session_send_ready(session) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
+	if (NC_VERB_ON(NC_VERB_DEBUG)) {
+		xmlDocDumpFormatMemory (msg->doc, (xmlChar**) (&text), &len, NC_CONTENT_FORMATTED);
+		DBG("Writing message (session %s): %s", session->session_id, text);
+		free (text);
+	}
+
+	if (nc_session_send_start(session) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
+	/*
+	 * serialize the message directly into the send buffer, which is written
+	 * into the channel (as a chunk in case of NETCONF 1.1) whenever it is full
+	 */
+	out = xmlOutputBufferCreateIO(nc_session_wbuf_append, NULL, session, NULL);
+	if (out == NULL) {
+		ERROR("%s: creating the output buffer failed.", __func__);
+		nc_session_channel_release(session);
+		return (EXIT_FAILURE);
+	}
+	/* xmlSaveFormatFileTo() flushes and frees the output buffer */
+	if (xmlSaveFormatFileTo(out, msg->doc, NULL, NC_CONTENT_FORMATTED) < 0 || session->wbuf_error) {
+		nc_session_channel_release(session);
+		return (EXIT_FAILURE);
+	}
+
+	/* write the rest of the message with the end of message tag */
+	if (nc_session_wbuf_flush(session, 1) != EXIT_SUCCESS) {
+		nc_session_channel_release(session);
+		return (EXIT_FAILURE);
 	}
-	c = 0;
-	do {
-		NC_WRITE(session, &(text[c]), c, ret);
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			usleep(10);
-			continue;
-		}
-#ifndef DISABLE_LIBSSH
-		if (ret == SSH_ERROR) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			if (!session->ssh_chan) {
-				emsg = strerror(errno);
-			} else if (session->ssh_chan && session->ssh_sess) {
-				emsg = ssh_get_error(session->ssh_sess);
-			} else {
-				emsg = "description not available";
-			}
-			VERB("Writing data into the communication channel failed (%s).", emsg);
-			return (EXIT_FAILURE);
-		}
-#endif
-		if (ret < 0) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			return (EXIT_FAILURE);
-		}
-	} while (c < (ssize_t) strlen (text));
 
 	/* unlock the session's output */
-	DBG_UNLOCK("mut_channel");
-	session->mut_channel_flag = 0;
-	pthread_mutex_unlock(session->mut_channel);
+	nc_session_channel_release(session);
 
 	return (EXIT_SUCCESS);
 }
 
-static int nc_session_read_len(struct nc_session* session, size_t chunk_length, char **text, size_t *len)
+int nc_session_send_text(struct nc_session* session, const char* text, size_t len)
 {
-	char *buf;
-	ssize_t c;
-	size_t rd = 0;
-#ifdef ENABLE_TLS
-	int r;
-#endif
-
-	/* check if we can work with the session */
-	if (session->status != NC_SESSION_STATUS_WORKING &&
-			session->status != NC_SESSION_STATUS_CLOSING) {
+	if (nc_session_send_ready(session) != EXIT_SUCCESS) {
 		return (EXIT_FAILURE);
 	}
 
-	buf = malloc ((chunk_length + 1) * sizeof(char));
-	if (buf == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-		*len = 0;
-		*text = NULL;
+	DBG("Writing message (session %s): %.*s", session->session_id, (int)len, text);
+
+	if (nc_session_send_start(session) != EXIT_SUCCESS) {
 		return (EXIT_FAILURE);
 	}
 
-	while (rd < chunk_length) {
-#ifndef DISABLE_LIBSSH
-		if (session->ssh_chan) {
-			/* read via libssh */
-			c = ssh_channel_read(session->ssh_chan, &(buf[rd]), chunk_length - rd, 0);
-			if (c == SSH_AGAIN) {
-				usleep (NC_READ_SLEEP);
-				continue;
-			} else if (c == SSH_ERROR) {
-				ERROR("Reading from the SSH channel failed (%zd: %s)", ssh_get_error_code(session->ssh_sess), ssh_get_error(session->ssh_sess));
-				free (buf);
-				*len = 0;
-				*text = NULL;
-				return (EXIT_FAILURE);
-			} else if (c == 0) {
-				if (ssh_channel_is_eof(session->ssh_chan)) {
-					ERROR("Server has closed the communication socket");
-					free (buf);
-					*len = 0;
-					*text = NULL;
-					return (EXIT_FAILURE);
-				}
-				usleep (NC_READ_SLEEP);
-				continue;
-			}
-		} else
-#endif
-#ifdef ENABLE_TLS
-		if (session->tls) {
-			/* read via OpenSSL */
-			c = SSL_read(session->tls, &(buf[rd]), chunk_length - rd);
-			if (c < 0 && (r = SSL_get_error(session->tls, c))) {
-				if (r == SSL_ERROR_WANT_READ) {
-					usleep(NC_READ_SLEEP);
-					continue;
-				} else {
-					ERROR("Reading from the TLS session failed (%d: %s)", r);
-					free (buf);
-					*len = 0;
-					*text = NULL;
-					return (EXIT_FAILURE);
-				}
-			}
-		} else
-#endif
-		if (session->fd_input != -1) {
-			/* read via file descriptor */
-			c = read (session->fd_input, &(buf[rd]), chunk_length - rd);
-			if (c == -1) {
-				if (errno == EAGAIN) {
-					usleep (NC_READ_SLEEP);
-					continue;
-				} else {
-					ERROR("Reading from an input file descriptor failed (%s)", strerror(errno));
-					free (buf);
-					*len = 0;
-					*text = NULL;
-					return (EXIT_FAILURE);
-				}
-			}
-		} else {
-			ERROR("No way to read the input, fatal error.");
-			free (buf);
-			*len = 0;
-			*text = NULL;
-			return (EXIT_FAILURE);
-		}
-
-		rd += c;
+	if (nc_session_wbuf_append(session, text, len) != (int)len || nc_session_wbuf_flush(session, 1) != EXIT_SUCCESS) {
+		nc_session_channel_release(session);
+		return (EXIT_FAILURE);
 	}
 
-	/* add terminating null byte */
-	buf[rd] = 0;
+	/* unlock the session's output */
+	nc_session_channel_release(session);
 
-	*len = rd;
-	*text = buf;
 	return (EXIT_SUCCESS);
 }
 
-static int nc_session_read_until(struct nc_session* session, const char* endtag, unsigned int limit, char **text, size_t *len)
+/**
+ * @brief Read available data from the session's communication channel.
+ *
+ * If wait is set, function blocks until at least one byte is read or an error
+ * occurs. Otherwise it returns 0 when there are no data available.
+ *
+ * @param[in] session Session to read from.
+ * @param[out] buf Buffer where to store the data.
+ * @param[in] size Maximum number of bytes to read.
+ * @param[in] wait Flag to block until some data are available.
+ * @return Number of read bytes, -1 on error.
+ */
+static ssize_t nc_session_read_raw(struct nc_session* session, char *buf, size_t size, int wait)
 {
-	size_t rd = 0;
 	ssize_t c;
-	char *buf = NULL;
-	size_t buflen = 0;
+	struct pollfd fds;
 #ifdef ENABLE_TLS
 	int r;
 #endif
 
-	/* check if we can work with the session */
-	if (session->status != NC_SESSION_STATUS_WORKING &&
-			session->status != NC_SESSION_STATUS_CLOSING) {
-		return (EXIT_FAILURE);
-	}
-
-	if (endtag == NULL) {
-		return (EXIT_FAILURE);
-	}
-
-	/* set starting buffer size */
-	buflen = 1024;
-	buf = (char*) malloc (buflen * sizeof(char));
-	if (buf == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-		return (EXIT_FAILURE);
-	}
-
-	for (rd = 0;;) {
-		if (limit > 0 && rd > limit) {
-			free(buf);
-			WARN("%s: reading limit reached.", __func__);
-			return (EXIT_FAILURE);
-		}
+	while (1) {
 #ifndef DISABLE_LIBSSH
 		if (session->ssh_chan) {
 			/* read via libssh */
-			c = ssh_channel_read(session->ssh_chan, &(buf[rd]), 1, 0);
+			if (!wait && ssh_channel_poll(session->ssh_chan, 0) == 0) {
+				return (0);
+			}
+			c = ssh_channel_read(session->ssh_chan, buf, size, 0);
 			if (c == SSH_AGAIN) {
-				usleep (NC_READ_SLEEP);
+				if (!wait) {
+					return (0);
+				}
+				nc_session_wait_ready(session, POLLIN);
 				continue;
 			} else if (c == SSH_ERROR) {
 				if (session->ssh_sess != NULL) {
@@ -1761,27 +2157,15 @@ static int nc_session_read_until(struct nc_session* session, const char* endtag,
 				} else {
 					ERROR("Reading from the SSH channel failed");
 				}
-				free (buf);
-				if (len != NULL) {
-					*len = 0;
-				}
-				if (text != NULL) {
-					*text = NULL;
-				}
-				return (EXIT_FAILURE);
+				return (-1);
 			} else if (c == 0) {
 				if (ssh_channel_is_eof (session->ssh_chan)) {
 					ERROR("Server has closed the communication socket");
-					free (buf);
-					if (len != NULL) {
-						*len = 0;
-					}
-					if (text != NULL) {
-						*text = NULL;
-					}
-					return (EXIT_FAILURE);
+					return (-1);
+				} else if (!wait) {
+					return (0);
 				}
-				usleep (NC_READ_SLEEP);
+				nc_session_wait_ready(session, POLLIN);
 				continue;
 			}
 		} else
@@ -1789,193 +2173,490 @@ static int nc_session_read_until(struct nc_session* session, const char* endtag,
 #ifdef ENABLE_TLS
 		if (session->tls) {
 			/* read via OpenSSL */
-			c = SSL_read(session->tls, &(buf[rd]), 1);
-			if (c < 0 && (r = SSL_get_error(session->tls, c))) {
+			if (!wait && SSL_pending(session->tls) == 0) {
+				fds.fd = SSL_get_fd(session->tls);
+				fds.events = POLLIN;
+				fds.revents = 0;
+				if (poll(&fds, 1, 0) <= 0) {
+					return (0);
+				}
+			}
+			c = SSL_read(session->tls, buf, size);
+			if (c <= 0) {
+				r = SSL_get_error(session->tls, c);
 				if (r == SSL_ERROR_WANT_READ) {
-					usleep(NC_READ_SLEEP);
+					if (!wait) {
+						return (0);
+					}
+					nc_session_wait_ready(session, POLLIN);
 					continue;
+				} else if (r == SSL_ERROR_ZERO_RETURN) {
+					ERROR("Server has closed the TLS session");
+				} else if (r == SSL_ERROR_SYSCALL) {
+					ERROR("Reading from the TLS session failed (%s)", strerror(errno));
+				} else if (r == SSL_ERROR_SSL) {
+					ERROR("Reading from the TLS session failed (%s)", ERR_error_string(r, NULL));
 				} else {
-					if (r == SSL_ERROR_SYSCALL) {
-						ERROR("Reading from the TLS session failed (%s)", strerror(errno));
-					} else if (r == SSL_ERROR_SSL) {
-						ERROR("Reading from the TLS session failed (%s)", ERR_error_string(r, NULL));
-					} else {
-						ERROR("Reading from the TLS session failed (SSL code %d)", r);
-					}
-					free (buf);
-					if (len != NULL) {
-						*len = 0;
-					}
-					if (text != NULL) {
-						*text = NULL;
-					}
-					return (EXIT_FAILURE);
+					ERROR("Reading from the TLS session failed (SSL code %d)", r);
 				}
+				return (-1);
 			}
 		} else
 #endif
 		if (session->fd_input != -1) {
 			/* read via file descriptor */
-			c = read (session->fd_input, &(buf[rd]), 1);
+			if (!wait) {
+				fds.fd = session->fd_input;
+				fds.events = POLLIN;
+				fds.revents = 0;
+				if (poll(&fds, 1, 0) <= 0) {
+					return (0);
+				}
+			}
+			c = read (session->fd_input, buf, size);
 			if (c == -1) {
-				if (errno == EAGAIN) {
-					usleep (NC_READ_SLEEP);
+				if (!wait && errno == EAGAIN) {
+					return (0);
+				} else if (errno == EAGAIN || errno == EINTR) {
+					nc_session_wait_ready(session, POLLIN);
 					continue;
 				} else {
 					ERROR("Reading from an input file descriptor failed (%s)", strerror(errno));
-					free (buf);
-					if (len != NULL) {
-						*len = 0;
-					}
-					if (text != NULL) {
-						*text = NULL;
-					}
-					return (EXIT_FAILURE);
+					return (-1);
 				}
 			} else if (c == 0) {
-				ERROR("EOF received (%s)", strerror(errno));
-				free(buf);
-				if (len != NULL ) {
-					*len = 0;
-				}
-				if (text != NULL ) {
-					*text = NULL;
-				}
-				return (EXIT_FAILURE);
+				ERROR("EOF received");
+				return (-1);
 			}
 		} else {
 			ERROR("No way to read the input, fatal error.");
-			free (buf);
-			if (len != NULL) {
-				*len = 0;
-			}
-			if (text != NULL) {
-				*text = NULL;
-			}
-			return (EXIT_FAILURE);
+			return (-1);
 		}
 
-		rd += c; /* should be rd++ */
-		buf[rd] = '\0';
+		return (c);
+	}
+}
 
-		if ((rd) < strlen (endtag)) {
-			/* not enough data to compare with endtag */
-			continue;
-		} else {
-			/* compare with endtag */
-			if (strcmp (endtag, &(buf[rd - strlen (endtag)])) == 0) {
-				/* end tag found */
-				if (len != NULL) {
-					*len = rd;
-				}
-				if (text != NULL) {
-					*text = buf;
-				} else {
-					free(buf);
-				}
-				return (EXIT_SUCCESS);
-			}
+/**
+ * @brief Read the next block of data from the communication channel into the
+ * session's receive buffer.
+ *
+ * The buffer is compacted or enlarged when there is no free space at its end.
+ *
+ * @param[in] session Session to read from.
+ * @param[in] wait Flag to block until some data are available. If not set, no
+ * data may be added into the buffer.
+ * @return EXIT_SUCCESS if some data were added into the buffer (or there are
+ * no data available and wait is not set), EXIT_FAILURE on error.
+ */
+static int nc_session_fill_rbuf(struct nc_session* session, int wait)
+{
+	ssize_t c;
+	void *tmp;
+
+	if (session->rbuf_start == session->rbuf_end) {
+		/* buffer is empty, start from its beginning */
+		session->rbuf_start = session->rbuf_end = 0;
+		if (session->rbuf_size > NC_READ_BUFSIZE_MAX) {
+			/* do not hold the memory used for some huge message */
+			free(session->rbuf);
+			session->rbuf = NULL;
+			session->rbuf_size = 0;
 		}
+	}
 
-		/* resize buffer if needed */
-		if (rd == (buflen-1)) {
-			/* get more memory for the text */
-			void *tmp = realloc (buf, (2 * buflen) * sizeof(char));
+	if (session->rbuf_size - session->rbuf_end < NC_READ_BUFSIZE) {
+		if (session->rbuf_start > 0) {
+			/* move unprocessed data to the beginning of the buffer */
+			memmove(session->rbuf, &(session->rbuf[session->rbuf_start]), session->rbuf_end - session->rbuf_start);
+			session->rbuf_end -= session->rbuf_start;
+			session->rbuf_start = 0;
+		}
+		if (session->rbuf_size - session->rbuf_end < NC_READ_BUFSIZE) {
+			/* get more memory, keep space for the terminating null byte */
+			tmp = realloc(session->rbuf, (session->rbuf_size == 0) ? (NC_READ_BUFSIZE + 1) : (2 * session->rbuf_size));
 			if (tmp == NULL) {
 				ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-				if (len != NULL) {
-					*len = 0;
-				}
-				if (text != NULL) {
-					*text = NULL;
-				}
-				free(buf);
 				return (EXIT_FAILURE);
 			}
-			buf = tmp;
-			buflen = 2 * buflen;
+			session->rbuf = tmp;
+			session->rbuf_size = (session->rbuf_size == 0) ? (NC_READ_BUFSIZE + 1) : (2 * session->rbuf_size);
 		}
 	}
 
-	/* no one could be here */
-	ERROR("Reading NETCONF message fatal failure");
-	free (buf);
-	if (len != NULL) {
-		*len = 0;
+	c = nc_session_read_raw(session, &(session->rbuf[session->rbuf_end]), session->rbuf_size - session->rbuf_end - 1, wait);
+	if (c < 0) {
+		return (EXIT_FAILURE);
 	}
-	if (text != NULL) {
-		*text = NULL;
+	session->rbuf_end += c;
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Decompress the data of a compressed message and push them into the
+ * XML push parser.
+ *
+ * @param[in] session Session receiving the message.
+ * @param[in] ctxt Push parser context.
+ * @param[in] data Compressed data.
+ * @param[in] n Length of the data.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int nc_session_inflate(struct nc_session* session, xmlParserCtxtPtr ctxt, char *data, size_t n)
+{
+	char buf[NC_READ_BUFSIZE];
+	z_stream *zs = session->zin;
+	int r;
+
+	zs->next_in = (Bytef*) data;
+	zs->avail_in = n;
+	do {
+		zs->next_out = (Bytef*) buf;
+		zs->avail_out = NC_READ_BUFSIZE;
+		r = inflate(zs, Z_NO_FLUSH);
+		if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+			ERROR("Invalid compressed data received (%s).", zs->msg ? zs->msg : "unknown error");
+			return (EXIT_FAILURE);
+		}
+		if (NC_READ_BUFSIZE - zs->avail_out > 0 && xmlParseChunk(ctxt, buf, NC_READ_BUFSIZE - zs->avail_out, 0) != 0) {
+			ERROR("Invalid XML data received.");
+			return (EXIT_FAILURE);
+		}
+		if (r == Z_STREAM_END) {
+			if (zs->avail_in > 0) {
+				ERROR("Invalid data received behind the end of the compressed message.");
+				return (EXIT_FAILURE);
+			}
+			break;
+		}
+	} while (zs->avail_in > 0 || zs->avail_out == 0);
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Start decompressing the received message.
+ *
+ * @param[in] session Session receiving the message.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int nc_session_inflate_start(struct nc_session* session)
+{
+	if (session->zin == NULL) {
+		if ((session->zin = calloc(1, sizeof(z_stream))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (EXIT_FAILURE);
+		}
+		if (inflateInit(session->zin) != Z_OK) {
+			ERROR("Initiating the message decompression failed.");
+			free(session->zin);
+			session->zin = NULL;
+			return (EXIT_FAILURE);
+		}
+	} else {
+		inflateReset(session->zin);
 	}
-	return (EXIT_FAILURE);
+	session->zin_active = 1;
+
+	return (EXIT_SUCCESS);
 }
 
 /**
- * @brief Get the message id string from the NETCONF message
+ * @brief Push the data of a chunk into the XML push parser. The data are passed
+ * to the parser directly from the receive buffer, so the message is not
+ * concatenated into a single string.
  *
- * @param[in] msg NETCONF message to parse.
- * @return 0 on error,\n message-id of the message on success.
+ * @param[in] session Session receiving the message.
+ * @param[in,out] ctxt Push parser context, created with the first non-space
+ * data of the message.
+ * @param[in] data Data of the chunk.
+ * @param[in] n Length of the data.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
  */
-const nc_msgid nc_msg_parse_msgid(const struct nc_msg *msg)
+static int nc_session_parse_data(struct nc_session* session, xmlParserCtxtPtr *ctxt, char *data, size_t n)
 {
-	nc_msgid ret = NULL;
-	xmlAttrPtr prop;
+	if (*ctxt == NULL) {
+		/* skip leading whitespaces */
+		while (n > 0 && isspace(*data)) {
+			data++;
+			n--;
+		}
+		if (n == 0) {
+			return (EXIT_SUCCESS);
+		}
 
-	/* parse and store message-id */
-	prop = xmlHasProp(xmlDocGetRootElement(msg->doc), BAD_CAST "message-id");
-	if (prop != NULL && prop->children != NULL && prop->children->content != NULL) {
-		ret = (char*)prop->children->content;
+		/* a compressed message starts with the zlib header, XML cannot */
+		session->zin_active = 0;
+		if (session->deflate && (unsigned char) *data == 0x78 && nc_session_inflate_start(session) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+
+		if ((*ctxt = xmlCreatePushParserCtxt(NULL, NULL, NULL, 0, NULL)) == NULL) {
+			ERROR("%s: creating the XML parser context failed.", __func__);
+			return (EXIT_FAILURE);
+		}
+		xmlCtxtUseOptions(*ctxt, NC_XMLREAD_OPTIONS);
 	}
-	if (ret == NULL) {
-		if (xmlStrcmp (xmlDocGetRootElement(msg->doc)->name, BAD_CAST "hello") != 0) {
-			WARN("Missing message-id in %s.", (char*)xmlDocGetRootElement(msg->doc)->name);
-			ret = NULL;
-		} else {
-			ret = "hello";
+
+	if (session->zin_active) {
+		if (nc_session_inflate(session, *ctxt, data, n) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
 		}
+	} else if (xmlParseChunk(*ctxt, data, n, 0) != 0) {
+		ERROR("Invalid XML data received.");
+		return (EXIT_FAILURE);
 	}
 
-	return (ret);
+	return (EXIT_SUCCESS);
 }
 
-static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, struct nc_msg** msg)
+/**
+ * @brief Get more data into the session's receive buffer.
+ *
+ * @param[in] session Session to read from.
+ * @param[in] wait Flag to block until some data are available.
+ * @return 1 if some data were added, 0 if there are no data available (only
+ * if wait is not set), -1 on error.
+ */
+static int nc_session_rbuf_more(struct nc_session* session, int wait)
 {
-	struct nc_msg *retval;
-	nc_reply* reply;
-	const char* id;
-	const char *emsg;
-	char *text = NULL, *tmp_text, *chunk = NULL;
-	size_t len;
-	unsigned long long int text_size = 0, total_len = 0;
-	size_t chunk_length;
-	struct pollfd fds;
-	int status;
-	unsigned long int revents;
-	NC_MSG_TYPE msgtype;
-	xmlNodePtr root;
+	size_t len = session->rbuf_end - session->rbuf_start;
 
-	if (session == NULL || (session->status != NC_SESSION_STATUS_WORKING && session->status != NC_SESSION_STATUS_CLOSING)) {
-		ERROR("Invalid session to receive data.");
-		return (NC_MSG_UNKNOWN);
+	if (nc_session_fill_rbuf(session, wait) != EXIT_SUCCESS) {
+		return (-1);
 	}
 
-	/* if there is waiting sending thread, sleep for timeout and return
-	 * with NC_MSG_WOULDBLOCK because we probably relock the mut_channel quite
-	 * fast, so we are trying to avoid starvation this way
-	 */
-	if (session->mut_channel_flag) {
-		usleep(timeout ? timeout : 1);
-		return (NC_MSG_WOULDBLOCK);
-	}
+	return ((session->rbuf_end - session->rbuf_start > len) ? 1 : 0);
+}
 
-	/* lock the session for receiving */
-	DBG_LOCK("mut_channel");
-	pthread_mutex_lock(session->mut_channel);
+/**
+ * @brief Read the chunks of the :base:1.1 message and push their data into the
+ * XML push parser (session->rctxt) as they arrive, up to the end-of-chunks
+ * marker. The progress is kept in the session, so the function can be called
+ * repeatedly without waiting for data and it continues where it stopped.
+ *
+ * @param[in] session Session to read from.
+ * @param[in] wait Flag to block until the whole message is read.
+ * @return 1 if the whole message was read, 0 if more data are needed (only if
+ * wait is not set), -1 on error. The final state is kept in session->rstate
+ * until the message is taken by nc_session_receive().
+ */
+static int nc_session_recv_chunks(struct nc_session* session, int wait)
+{
+	char *data, *found, *eol;
+	size_t n;
+	int r;
 
-	/* use while for possibility of repeating test */
-	while(1) {
-		revents = 0;
-#ifndef DISABLE_LIBSSH
-		if (session->ssh_chan != NULL) {
+	/* check if we can work with the session */
+	if (session->status != NC_SESSION_STATUS_WORKING &&
+			session->status != NC_SESSION_STATUS_CLOSING) {
+		return (-1);
+	}
+
+	while (session->rstate == 0) {
+		data = &(session->rbuf[session->rbuf_start]);
+		n = session->rbuf_end - session->rbuf_start;
+
+		if (session->rchunk > 0) {
+			/* data of the current chunk */
+			if (n > 0) {
+				if (n > session->rchunk) {
+					n = session->rchunk;
+				}
+				session->rbuf_start += n;
+				session->rchunk -= n;
+				if (nc_session_parse_data(session, &session->rctxt, data, n) != EXIT_SUCCESS) {
+					session->rstate = -1;
+				}
+				continue;
+			}
+		} else {
+			/* chunk header, at most one byte can precede it */
+			found = (n >= 2) ? memmem(data, n, "\n#", 2) : NULL;
+			if ((found == NULL && n > 2) || (found != NULL && found - data > 1)) {
+				ERROR("Invalid frame chunk header received.");
+				session->rstate = -1;
+				continue;
+			} else if (found != NULL && (eol = memchr(found + 2, '\n', n - (found + 2 - data))) != NULL) {
+				session->rbuf_start += (eol + 1) - data;
+				if (eol == found + 3 && found[2] == '#') {
+					/* end of chunked framing message */
+					session->rstate = 1;
+					continue;
+				}
+				/* convert string to the size of the following chunk */
+				if ((session->rchunk = strtoul(found + 2, NULL, 10)) == 0) {
+					ERROR("Invalid frame chunk size detected, fatal error.");
+					session->rstate = -1;
+				}
+				continue;
+			}
+		}
+
+		/* read more data */
+		if ((r = nc_session_rbuf_more(session, wait)) == -1) {
+			session->rstate = -1;
+		} else if (r == 0) {
+			return (0);
+		}
+	}
+
+	return (session->rstate);
+}
+
+static int nc_session_read_until(struct nc_session* session, const char* endtag, unsigned int limit, char **text, size_t *len)
+{
+	size_t taglen, checked = 0, msglen;
+	char *found, *buf;
+
+	/* check if we can work with the session */
+	if (session->status != NC_SESSION_STATUS_WORKING &&
+			session->status != NC_SESSION_STATUS_CLOSING) {
+		return (EXIT_FAILURE);
+	}
+
+	if (endtag == NULL) {
+		return (EXIT_FAILURE);
+	}
+	taglen = strlen(endtag);
+
+	while (1) {
+		/* search for the endtag in the buffered data not checked yet */
+		found = NULL;
+		if (session->rbuf_end - session->rbuf_start >= taglen) {
+			found = memmem(&(session->rbuf[session->rbuf_start + checked]),
+					session->rbuf_end - session->rbuf_start - checked,
+					endtag, taglen);
+		}
+		if (found != NULL) {
+			/* end tag found */
+			msglen = (found - &(session->rbuf[session->rbuf_start])) + taglen;
+			if (limit > 0 && msglen > limit + 1) {
+				break;
+			}
+			if (text != NULL) {
+				if ((buf = malloc(msglen + 1)) == NULL) {
+					ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+					break;
+				}
+				memcpy(buf, &(session->rbuf[session->rbuf_start]), msglen);
+				buf[msglen] = '\0';
+				*text = buf;
+			}
+			if (len != NULL) {
+				*len = msglen;
+			}
+			session->rbuf_start += msglen;
+			return (EXIT_SUCCESS);
+		}
+
+		/* the endtag can start in the last (taglen - 1) bytes of the data */
+		if (session->rbuf_end - session->rbuf_start >= taglen) {
+			checked = session->rbuf_end - session->rbuf_start - (taglen - 1);
+		}
+
+		if (limit > 0 && (session->rbuf_end - session->rbuf_start) > limit) {
+			break;
+		}
+
+		/* read more data */
+		if (nc_session_fill_rbuf(session, 1) != EXIT_SUCCESS) {
+			if (len != NULL) {
+				*len = 0;
+			}
+			if (text != NULL) {
+				*text = NULL;
+			}
+			return (EXIT_FAILURE);
+		}
+	}
+
+	if (limit > 0) {
+		WARN("%s: reading limit reached.", __func__);
+	}
+	if (len != NULL) {
+		*len = 0;
+	}
+	if (text != NULL) {
+		*text = NULL;
+	}
+	return (EXIT_FAILURE);
+}
+
+/**
+ * @brief Get the message id string from the NETCONF message
+ *
+ * @param[in] msg NETCONF message to parse.
+ * @return 0 on error,\n message-id of the message on success.
+ */
+const nc_msgid nc_msg_parse_msgid(const struct nc_msg *msg)
+{
+	nc_msgid ret = NULL;
+	xmlAttrPtr prop;
+
+	/* parse and store message-id */
+	prop = xmlHasProp(xmlDocGetRootElement(msg->doc), BAD_CAST "message-id");
+	if (prop != NULL && prop->children != NULL && prop->children->content != NULL) {
+		ret = (char*)prop->children->content;
+	}
+	if (ret == NULL) {
+		if (xmlStrcmp (xmlDocGetRootElement(msg->doc)->name, BAD_CAST "hello") != 0) {
+			WARN("Missing message-id in %s.", (char*)xmlDocGetRootElement(msg->doc)->name);
+			ret = NULL;
+		} else {
+			ret = "hello";
+		}
+	}
+
+	return (ret);
+}
+
+static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, struct nc_msg** msg)
+{
+	struct nc_msg *retval;
+	nc_reply* reply;
+	const char* id;
+	const char *emsg;
+	char *text = NULL, *tmp_text;
+	size_t len;
+	xmlParserCtxtPtr ctxt = NULL;
+	xmlDocPtr doc = NULL;
+	struct pollfd fds;
+	int status, r;
+	unsigned long int revents;
+	NC_MSG_TYPE msgtype;
+	xmlNodePtr root;
+	uint64_t trace_start, trace_framed = 0;
+
+	if (session == NULL || (session->status != NC_SESSION_STATUS_WORKING && session->status != NC_SESSION_STATUS_CLOSING)) {
+		ERROR("Invalid session to receive data.");
+		return (NC_MSG_UNKNOWN);
+	}
+
+	/* lock the session for receiving */
+	DBG_LOCK("mut_channel");
+	pthread_mutex_lock(session->mut_channel);
+
+	/* if there is waiting sending thread, let it go first to avoid its
+	 * starvation and wait (at most for the timeout) until it releases the
+	 * channel, otherwise return with NC_MSG_WOULDBLOCK
+	 */
+	if (nc_session_channel_wait(session, timeout) != EXIT_SUCCESS) {
+		DBG_UNLOCK("mut_channel");
+		pthread_mutex_unlock(session->mut_channel);
+		return (NC_MSG_WOULDBLOCK);
+	}
+
+	/*
+	 * use while for possibility of repeating test, poll is not needed
+	 * if some data are already buffered or the session loop has already
+	 * read the whole message
+	 */
+	while(session->rbuf_start == session->rbuf_end && session->rstate == 0) {
+		revents = 0;
+#ifndef DISABLE_LIBSSH
+		if (session->ssh_chan != NULL) {
 			/* we are getting data from libssh's channel */
 			status = ssh_channel_poll_timeout(session->ssh_chan, timeout, 0);
 			if (status > 0) {
@@ -1984,12 +2665,14 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 		} else
 #endif
 #ifdef ENABLE_TLS
-		if (session->tls != NULL) {
+		if (session->tls != NULL && SSL_pending(session->tls) > 0) {
+			/* OpenSSL has already some decrypted data buffered */
+			status = 1;
+			revents = POLLIN;
+		} else if (session->tls != NULL) {
 			/* we are getting data from TLS session using OpenSSL */
 			fds.fd = SSL_get_fd(session->tls);
-			fds.events = POLLIN;
-			fds.revents = 0;
-			status = poll(&fds, 1, timeout);
+			status = nc_session_poll_input(session, &fds, timeout);
 
 			revents = (unsigned long int) fds.revents;
 		} else
@@ -1997,12 +2680,12 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 		if (session->fd_input != -1) {
 			/* we are getting data from standard file descriptor */
 			fds.fd = session->fd_input;
-			fds.events = POLLIN;
-			fds.revents = 0;
-			status = poll(&fds, 1, timeout);
+			status = nc_session_poll_input(session, &fds, timeout);
 
 			revents = (unsigned long int) fds.revents;
 		} else {
+			DBG_UNLOCK("mut_channel");
+			pthread_mutex_unlock(session->mut_channel);
 			ERROR("Invalid session to receive data.");
 			return (NC_MSG_UNKNOWN);
 		}
@@ -2040,9 +2723,7 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 			ERROR("Input channel error (%s)", emsg);
 			nc_session_close(session, NC_SESSION_TERM_DROPPED);
 			if (nc_info) {
-				pthread_rwlock_wrlock(&(nc_info->lock));
-				nc_info->stats.sessions_dropped++;
-				pthread_rwlock_unlock(&(nc_info->lock));
+				NC_STAT_INC(nc_info->stats.sessions_dropped);
 			}
 			return (NC_MSG_UNKNOWN);
 
@@ -2057,9 +2738,7 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 			ERROR("Input channel closed");
 			nc_session_close(session, NC_SESSION_TERM_DROPPED);
 			if (nc_info) {
-				pthread_rwlock_wrlock(&(nc_info->lock));
-				nc_info->stats.sessions_dropped++;
-				pthread_rwlock_unlock(&(nc_info->lock));
+				NC_STAT_INC(nc_info->stats.sessions_dropped);
 			}
 			return (NC_MSG_UNKNOWN);
 		}
@@ -2067,9 +2746,11 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 		/* we have something to read */
 		break;
 	}
+	trace_start = nc_trace_now();
 
 	switch (session->version) {
 	case NETCONFV10:
+		session->rscanned = 0;
 		if (nc_session_read_until (session, NC_V10_END_MSG, 0, &text, &len) != 0) {
 			goto malformed_msg_channels_unlock;
 		}
@@ -2077,233 +2758,984 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 		DBG("Received message (session %s): %s", session->session_id, text);
 		break;
 	case NETCONFV11:
-		do {
-			if (nc_session_read_until (session, "\n#", 2, NULL, NULL) != 0) {
-				if (total_len > 0) {
-					free (text);
-				}
-				goto malformed_msg_channels_unlock;
-			}
-			if (nc_session_read_until (session, "\n", 0, &chunk, &len) != 0) {
-				if (total_len > 0) {
-					free (text);
-				}
-				goto malformed_msg_channels_unlock;
-			}
-			if (strcmp (chunk, "#\n") == 0) {
-				/* end of chunked framing message */
-				free (chunk);
-				break;
-			}
+		/* build the document incrementally as the chunks arrive, the
+		 * session loop can have already read a part of the message */
+		r = nc_session_recv_chunks(session, 1);
+		ctxt = session->rctxt;
+		session->rctxt = NULL;
+		session->rchunk = 0;
+		session->rstate = 0;
+		if (r != 1) {
+			goto malformed_msg_channels_unlock;
+		}
 
-			/* convert string to the size of the following chunk */
-			chunk_length = strtoul (chunk, (char **) NULL, 10);
-			if (chunk_length == 0) {
-				ERROR("Invalid frame chunk size detected, fatal error.");
-				goto malformed_msg_channels_unlock;
-			}
-			free (chunk);
-			chunk = NULL;
+		if (ctxt == NULL) {
+			ERROR("Empty message received (session %s)", session->session_id);
+			goto malformed_msg_channels_unlock;
+		}
+		/* finish the parsing */
+		xmlParseChunk(ctxt, NULL, 0, 1);
+		if (!ctxt->wellFormed) {
+			ERROR("Invalid XML data received.");
+			goto malformed_msg_channels_unlock;
+		}
+		doc = ctxt->myDoc;
+		ctxt->myDoc = NULL;
+		xmlFreeParserCtxt(ctxt);
+		ctxt = NULL;
+
+		if (NC_VERB_ON(NC_VERB_DEBUG)) {
+			xmlDocDumpFormatMemory (doc, (xmlChar**) (&text), &status, NC_CONTENT_FORMATTED);
+			DBG("Received message (session %s): %s", session->session_id, text);
+			xmlFree (text);
+			text = NULL;
+		}
+		break;
+	default:
+		ERROR("Unsupported NETCONF protocol version (%d)", session->version);
+		goto malformed_msg_channels_unlock;
+		break;
+	}
+
+	DBG_UNLOCK("mut_channel");
+	pthread_mutex_unlock(session->mut_channel);
+	if (trace_start != 0) {
+		trace_framed = nc_trace_now();
+	}
+
+	if (doc == NULL) {
+		if (text == NULL) {
+			ERROR("Empty message received (session %s)", session->session_id);
+			goto malformed_msg;
+		}
+
+		/* skip leading whitespaces */
+		tmp_text=text;
+		while (isspace(*tmp_text)) {
+			tmp_text++;
+		}
+		/* store the received message in libxml2 format */
+		doc = xmlReadDoc (BAD_CAST tmp_text, NULL, NULL, NC_XMLREAD_OPTIONS);
+		free (text);
+		if (doc == NULL) {
+			ERROR("Invalid XML data received.");
+			goto malformed_msg;
+		}
+	}
+
+	if ((retval = nc_msg_new(doc)) == NULL) {
+		xmlFreeDoc (doc);
+		goto malformed_msg;
+	}
+
+	/* parse and store message type */
+	root = xmlDocGetRootElement(retval->doc);
+	/* check namespace */
+	if (!root->ns || !root->ns->href || xmlStrcmp(root->ns->href, BAD_CAST NC_NS_BASE10)) {
+		/* event notification ? */
+		if (root->ns && root->ns->href && !xmlStrcmp(root->ns->href, BAD_CAST NC_NS_NOTIFICATIONS) &&
+				!xmlStrcmp(root->name, BAD_CAST "notification")) {
+			/* we have notification */
+			msgtype = NC_MSG_NOTIFICATION;
+		} else {
+			/* bad namespace */
+			WARN("Unknown (unsupported) namespace of the received message root element.");
+			retval->type.rpc = NC_RPC_UNKNOWN;
+			msgtype = NC_MSG_UNKNOWN;
+		}
+
+	} else 	if (xmlStrcmp (root->name, BAD_CAST "rpc-reply") == 0) {
+		msgtype = NC_MSG_REPLY;
+
+		/* set reply type flag */
+		nc_reply_parse_type(retval);
+
+	} else if (xmlStrcmp (root->name, BAD_CAST "rpc") == 0) {
+		msgtype = NC_MSG_RPC;
+
+		/* set with-defaults if any */
+		nc_rpc_parse_withdefaults(retval, NULL);
+	} else if (xmlStrcmp (root->name, BAD_CAST "hello") == 0) {
+		/* set message type, we have <hello> message */
+		retval->type.reply = NC_REPLY_HELLO;
+		msgtype = NC_MSG_HELLO;
+	} else {
+		WARN("Unknown (unsupported) type of received message detected.");
+		retval->type.rpc = NC_RPC_UNKNOWN;
+		msgtype = NC_MSG_UNKNOWN;
+	}
+
+	if (msgtype == NC_MSG_RPC || msgtype == NC_MSG_REPLY) {
+		/* parse and store message-id */
+		if ((id = nc_msg_parse_msgid(retval)) == NULL) {
+			retval->msgid = NULL;
+		} else {
+			retval->msgid = strdup(id);
+		}
+	} else {
+		retval->msgid = NULL;
+	}
+
+	if (msgtype == NC_MSG_RPC && trace_start != 0 && (retval->trace = nc_trace_new(trace_start)) != NULL) {
+		retval->trace->session_id = session->session_id;
+		retval->trace->phases[NC_TRACE_RECEIVE] = trace_framed - trace_start;
+		nc_trace_add(retval->trace, NC_TRACE_PARSE, trace_framed);
+	}
+
+	/* return the result */
+	*msg = retval;
+	(*msg)->session = session;
+	return (msgtype);
+
+malformed_msg_channels_unlock:
+	if (ctxt != NULL) {
+		xmlFreeDoc(ctxt->myDoc);
+		xmlFreeParserCtxt(ctxt);
+	}
+	DBG_UNLOCK("mut_channel");
+	pthread_mutex_unlock(session->mut_channel);
+
+malformed_msg:
+	if (session->version == NETCONFV11 && session->ssh_sess == NULL) {
+		/* NETCONF version 1.1 define sending error reply from the server */
+		reply = nc_reply_error(nc_err_new(NC_ERR_MALFORMED_MSG));
+		if (reply == NULL) {
+			ERROR("Unable to create the \'Malformed message\' reply");
+			nc_session_close(session, NC_SESSION_TERM_OTHER);
+			return (NC_MSG_UNKNOWN);
+		}
+
+		if (nc_session_send_reply(session, NULL, reply) == 0) {
+			ERROR("Unable to send the \'Malformed message\' reply");
+			nc_session_close(session, NC_SESSION_TERM_OTHER);
+			return (NC_MSG_UNKNOWN);
+		}
+		nc_reply_free(reply);
+	}
+
+	ERROR("Malformed message received, closing the session %s.", session->session_id);
+	nc_session_close(session, NC_SESSION_TERM_OTHER);
+
+	return (NC_MSG_UNKNOWN);
+}
+
+static NC_MSG_TYPE nc_session_recv_msg(struct nc_session* session, int timeout, struct nc_msg** msg)
+{
+	NC_MSG_TYPE ret;
+
+	ret = nc_session_receive (session, timeout, msg);
+	switch (ret) {
+	case NC_MSG_REPLY: /* regular reply received */
+	case NC_MSG_HELLO:
+	case NC_MSG_NOTIFICATION:
+	case NC_MSG_WOULDBLOCK:
+		/* do nothing, just return the type */
+		break;
+	default:
+		ret = NC_MSG_UNKNOWN;
+		break;
+	}
+
+	return (ret);
+}
+
+#define LOCAL_RECEIVE_TIMEOUT 100
+
+/*
+ * Client side dispatching of the received messages. Once the asynchronous
+ * API is used on the session, the received replies are delivered to the
+ * threads waiting for their message-id (registered in the pending table when
+ * the request is sent), the rest goes into the session's queues. The input is
+ * read by the reader thread if started, otherwise by one of the waiting
+ * threads while the others wait for the dispatched messages.
+ *
+ * Requests sent with a completion callback are moved from the pending table
+ * into the list of completed requests when their reply is received, and the
+ * received notifications into the list of notifications if the session has
+ * the notification callback. Both lists are delivered to the callbacks by
+ * nc_session_process() out of the session's locks.
+ */
+struct nc_reply_pending {
+	NC_MSG_TYPE type;      /* NC_MSG_UNKNOWN until the reply is received */
+	nc_reply* reply;
+	void (*reply_clb)(struct nc_session* session, const char* msgid, nc_reply* reply, void* arg);
+	void* clb_arg;
+	char* msgid;           /* set for the requests with the callback only */
+	struct nc_reply_pending* next;
+};
+
+struct nc_session_async {
+	xmlHashTablePtr pending;  /* message-id -> struct nc_reply_pending */
+	xmlHashTablePtr parked;   /* message-id -> struct nc_reply_pending, replies received before their request was registered */
+	pthread_cond_t cond;      /* signalled with mut_mqueue when a message is dispatched */
+	int sending;              /* requests being sent, not yet in the pending table */
+	int reading;              /* some thread is reading the session's input */
+	int errors;               /* unclaimed error replies processed by the callback */
+	int reader;               /* 1 if the reader thread runs, 2 when it has finished */
+	int reader_stop;
+	int reader_joinable;
+	pthread_t reader_thread;
+	struct nc_reply_pending* completed;  /* requests waiting for their callback */
+	struct nc_reply_pending* parked_list; /* the parked replies, the last received first */
+	void (*notif_clb)(struct nc_session* session, nc_ntf* ntf, void* arg);
+	void* notif_clb_arg;
+	struct nc_msg* notifs;    /* notifications waiting for the callback */
+};
+
+static void nc_reply_pending_free(void* payload, const xmlChar* UNUSED(name))
+{
+	struct nc_reply_pending* pending = (struct nc_reply_pending*)payload;
+
+	nc_reply_free(pending->reply);
+	free(pending->msgid);
+	free(pending);
+}
+
+/* mut_mqueue is expected to be locked */
+static struct nc_session_async* nc_session_async_get(struct nc_session* session)
+{
+	struct nc_session_async* async;
+
+	if (session->async != NULL) {
+		return (session->async);
+	}
+
+	if ((async = calloc(1, sizeof(struct nc_session_async))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	if ((async->pending = xmlHashCreate(64)) == NULL || (async->parked = xmlHashCreate(16)) == NULL) {
+		ERROR("Creating the table of the pending replies failed (%s:%d).", __FILE__, __LINE__);
+		xmlHashFree(async->pending, NULL);
+		free(async);
+		return (NULL);
+	}
+	pthread_cond_init(&(async->cond), NULL);
+	session->async = async;
+
+	return (async);
+}
+
+/* stop the reader thread of the session, if any */
+static void nc_session_reader_stop(struct nc_session* session)
+{
+	struct nc_session_async* async = session->async;
+
+	if (async == NULL || !async->reader_joinable || pthread_equal(async->reader_thread, pthread_self())) {
+		/* the reader itself finishes when it sees the closed session */
+		return;
+	}
+
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	async->reader_stop = 1;
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+	pthread_join(async->reader_thread, NULL);
+	async->reader_joinable = 0;
+}
+
+/* free the dispatching structures of the session */
+static void nc_session_async_free(struct nc_session* session)
+{
+	struct nc_session_async* async = session->async;
+	struct nc_reply_pending* pending;
+	struct nc_msg* msg;
+
+	if (async == NULL) {
+		return;
+	}
+
+	nc_session_reader_stop(session);
+	xmlHashFree(async->pending, nc_reply_pending_free);
+	xmlHashFree(async->parked, NULL);
+	while ((pending = async->parked_list) != NULL) {
+		async->parked_list = pending->next;
+		nc_reply_pending_free(pending, NULL);
+	}
+	while ((pending = async->completed) != NULL) {
+		async->completed = pending->next;
+		nc_reply_pending_free(pending, NULL);
+	}
+	while ((msg = async->notifs) != NULL) {
+		async->notifs = msg->next;
+		nc_msg_free(msg);
+	}
+	pthread_cond_destroy(&(async->cond));
+	free(async);
+	session->async = NULL;
+}
+
+static void nc_session_process_error_reply(struct nc_msg* msg)
+{
+	struct nc_err* error;
+
+	for (error = msg->error; error != NULL; error = error->next) {
+		callbacks.process_error_reply(error->tag,
+				error->type,
+				error->severity,
+				error->apptag,
+				error->path,
+				error->message,
+				error->attribute,
+				error->element,
+				error->ns,
+				error->sid);
+	}
+}
+
+/* append the request to the list of the completed ones, keep their order */
+static void nc_session_async_complete(struct nc_session_async* async, struct nc_reply_pending* pending)
+{
+	struct nc_reply_pending* aux;
+
+	pending->next = NULL;
+	if ((aux = async->completed) == NULL) {
+		async->completed = pending;
+	} else {
+		for (; aux->next != NULL; aux = aux->next);
+		aux->next = pending;
+	}
+}
+
+/*
+ * Keep the reply received before its request is registered as pending, the
+ * sending thread takes it from the table after the registration. NULL reply
+ * stands for an error reply already processed by the callback.
+ */
+static int nc_session_async_park(struct nc_session_async* async, const char* msgid, nc_reply* reply)
+{
+	struct nc_reply_pending* parked;
+
+	if ((parked = calloc(1, sizeof(struct nc_reply_pending))) == NULL || (parked->msgid = strdup(msgid)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(parked);
+		return (EXIT_FAILURE);
+	}
+	parked->type = (reply == NULL) ? NC_MSG_NONE : NC_MSG_REPLY;
+	parked->reply = reply;
+	if (xmlHashAddEntry(async->parked, BAD_CAST msgid, parked) != 0) {
+		/* the same message-id is already parked */
+		free(parked->msgid);
+		free(parked);
+		return (EXIT_FAILURE);
+	}
+	parked->next = async->parked_list;
+	async->parked_list = parked;
+
+	return (EXIT_SUCCESS);
+}
+
+/*
+ * Move the parked replies not claimed by any request into the queue for
+ * nc_session_recv_reply() in the order they were received, mut_mqueue is
+ * expected to be locked and no request is expected to be being sent.
+ */
+static void nc_session_async_unpark(struct nc_session* session)
+{
+	struct nc_session_async* async = session->async;
+	struct nc_reply_pending *parked, *list = NULL;
+	struct nc_msg* msg_aux;
+
+	/* reverse the list to get the order of receiving */
+	while ((parked = async->parked_list) != NULL) {
+		async->parked_list = parked->next;
+		parked->next = list;
+		list = parked;
+	}
+	while ((parked = list) != NULL) {
+		list = parked->next;
+		if (parked->type == NC_MSG_UNKNOWN) {
+			/* claimed by its request, already removed from the table */
+			nc_reply_pending_free(parked, NULL);
+			continue;
+		}
+		xmlHashRemoveEntry(async->parked, BAD_CAST parked->msgid, NULL);
+		if (parked->reply == NULL) {
+			async->errors++;
+		} else {
+			parked->reply->next = NULL;
+			if ((msg_aux = session->queue_msg) == NULL) {
+				session->queue_msg = parked->reply;
+			} else {
+				for (; msg_aux->next != NULL; msg_aux = msg_aux->next);
+				msg_aux->next = parked->reply;
+			}
+			parked->reply = NULL;
+		}
+		nc_reply_pending_free(parked, NULL);
+	}
+}
+
+/* mut_mqueue is expected to be locked */
+static void nc_session_async_dispatch(struct nc_session* session, NC_MSG_TYPE type, struct nc_msg* msg)
+{
+	struct nc_session_async* async = session->async;
+	struct nc_reply_pending* pending;
+	struct nc_msg* msg_aux;
+	const char* msgid;
+	int error;
+
+	switch (type) {
+	case NC_MSG_REPLY:
+		msgid = nc_reply_get_msgid(msg);
+		pending = (msgid == NULL) ? NULL : xmlHashLookup(async->pending, BAD_CAST msgid);
+
+		error = (nc_reply_get_type(msg) == NC_REPLY_ERROR && callbacks.process_error_reply != NULL);
+		if (error) {
+			/* processed automatically as nc_session_recv_reply() does */
+			nc_session_process_error_reply(msg);
+		}
+		if (pending != NULL && pending->type == NC_MSG_UNKNOWN) {
+			if (error) {
+				nc_reply_free(msg);
+				pending->type = NC_MSG_NONE;
+			} else {
+				pending->reply = msg;
+				pending->type = NC_MSG_REPLY;
+			}
+			if (pending->reply_clb != NULL) {
+				/* hand it over to nc_session_process() */
+				xmlHashRemoveEntry(async->pending, BAD_CAST pending->msgid, NULL);
+				nc_session_async_complete(async, pending);
+			}
+		} else if (pending == NULL && msgid != NULL && async->sending > 0 &&
+				nc_session_async_park(async, msgid, error ? NULL : msg) == EXIT_SUCCESS) {
+			/* the reply came before its request was registered as pending,
+			 * do not wait for the sending thread, it can be blocked by the
+			 * peer waiting for its replies to be read */
+			if (error) {
+				nc_reply_free(msg);
+			}
+		} else if (error) {
+			nc_reply_free(msg);
+			async->errors++;
+		} else {
+			/* nobody waits for it, keep it for nc_session_recv_reply() */
+			msg->next = NULL;
+			if ((msg_aux = session->queue_msg) == NULL) {
+				session->queue_msg = msg;
+			} else {
+				for (; msg_aux->next != NULL; msg_aux = msg_aux->next);
+				msg_aux->next = msg;
+			}
+		}
+		break;
+	case NC_MSG_NOTIFICATION:
+		msg->next = NULL;
+		if (async->notif_clb != NULL) {
+			/* hand it over to nc_session_process() */
+			if ((msg_aux = async->notifs) == NULL) {
+				async->notifs = msg;
+			} else {
+				for (; msg_aux->next != NULL; msg_aux = msg_aux->next);
+				msg_aux->next = msg;
+			}
+			break;
+		}
+		DBG_LOCK("mut_equeue");
+		pthread_mutex_lock(&(session->mut_equeue));
+		if ((msg_aux = session->queue_event) == NULL) {
+			session->queue_event = msg;
+		} else {
+			for (; msg_aux->next != NULL; msg_aux = msg_aux->next);
+			msg_aux->next = msg;
+		}
+		DBG_UNLOCK("mut_equeue");
+		pthread_mutex_unlock(&(session->mut_equeue));
+		break;
+	case NC_MSG_WOULDBLOCK:
+		/* nothing received */
+		return;
+	default:
+		/* unexpected message or an error */
+		nc_msg_free(msg);
+		break;
+	}
+
+	pthread_cond_broadcast(&(async->cond));
+}
+
+/*
+ * Read and dispatch a single message, mut_mqueue is expected to be locked and
+ * it is unlocked while reading.
+ */
+static NC_MSG_TYPE nc_session_async_read(struct nc_session* session, int timeout)
+{
+	struct nc_msg* msg = NULL;
+	NC_MSG_TYPE ret;
+
+	session->async->reading = 1;
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+
+	ret = nc_session_recv_msg(session, timeout, &msg);
+
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	session->async->reading = 0;
+
+	nc_session_async_dispatch(session, ret, msg);
+	if (ret == NC_MSG_UNKNOWN) {
+		/* wake up the waiting threads to see the session status */
+		pthread_cond_broadcast(&(session->async->cond));
+	}
+
+	return (ret);
+}
+
+/* get the absolute deadline of the timeout for pthread_cond_timedwait() */
+static void nc_session_async_deadline(int timeout, struct timespec* ts)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += timeout / 1000;
+	ts->tv_nsec += (timeout % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+/* remaining milliseconds until the deadline, 0 if it has passed */
+static int nc_session_async_remaining(const struct timespec* deadline)
+{
+	struct timespec now;
+	long long ms;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	ms = (deadline->tv_sec - now.tv_sec) * 1000LL + (deadline->tv_nsec - now.tv_nsec) / 1000000L;
+	return ((ms > 0) ? (int)ms : 0);
+}
+
+/*
+ * One step of waiting for a dispatched message, mut_mqueue is expected to be
+ * locked. The input is read directly if nobody else does it. Returns
+ * NC_MSG_WOULDBLOCK when the timeout (-1 for infinite) elapsed, NC_MSG_UNKNOWN
+ * if the session cannot receive anymore and NC_MSG_NONE otherwise.
+ */
+static NC_MSG_TYPE nc_session_async_step(struct nc_session* session, int timeout, const struct timespec* deadline)
+{
+	struct nc_session_async* async = session->async;
+	struct timespec ts;
+	int wait;
+
+	if (session->status != NC_SESSION_STATUS_WORKING && session->status != NC_SESSION_STATUS_CLOSING) {
+		return (NC_MSG_UNKNOWN);
+	}
+
+	wait = LOCAL_RECEIVE_TIMEOUT;
+	if (timeout == 0) {
+		wait = 0;
+	} else if (timeout > 0 && (wait = nc_session_async_remaining(deadline)) > LOCAL_RECEIVE_TIMEOUT) {
+		wait = LOCAL_RECEIVE_TIMEOUT;
+	}
+
+	if (async->reader == 1 || async->reading) {
+		/* someone else reads the input */
+		if (wait > 0) {
+			nc_session_async_deadline(wait, &ts);
+			pthread_cond_timedwait(&(async->cond), &(session->mut_mqueue), &ts);
+		}
+	} else if (async->reader == 2) {
+		/* the reader thread, and so the session, has finished */
+		return (NC_MSG_UNKNOWN);
+	} else if (nc_session_async_read(session, wait) == NC_MSG_UNKNOWN) {
+		return (NC_MSG_UNKNOWN);
+	}
+
+	if (timeout == 0 || (timeout > 0 && nc_session_async_remaining(deadline) == 0)) {
+		return (NC_MSG_WOULDBLOCK);
+	}
+	return (NC_MSG_NONE);
+}
+
+static void* nc_session_reader(void* arg)
+{
+	struct nc_session* session = (struct nc_session*)arg;
+	struct nc_session_async* async = session->async;
+
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	while (!async->reader_stop) {
+		if (async->reading) {
+			/* a waiting thread started to read before the reader */
+			nc_session_async_step(session, -1, NULL);
+		} else if (nc_session_async_read(session, LOCAL_RECEIVE_TIMEOUT) == NC_MSG_UNKNOWN) {
+			break;
+		}
+	}
+	async->reader = 2;
+	pthread_cond_broadcast(&(async->cond));
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+
+	return (NULL);
+}
+
+API int nc_session_reader_start(struct nc_session* session)
+{
+	struct nc_session_async* async;
+	int r;
+
+	if (session == NULL || session->is_server || session->status != NC_SESSION_STATUS_WORKING) {
+		ERROR("%s: Invalid (client) session.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	if ((async = nc_session_async_get(session)) == NULL) {
+		DBG_UNLOCK("mut_mqueue");
+		pthread_mutex_unlock(&(session->mut_mqueue));
+		return (EXIT_FAILURE);
+	}
+	if (async->reader != 0) {
+		DBG_UNLOCK("mut_mqueue");
+		pthread_mutex_unlock(&(session->mut_mqueue));
+		ERROR("%s: The reader thread of the session was already started.", __func__);
+		return (EXIT_FAILURE);
+	}
+	if ((r = pthread_create(&(async->reader_thread), NULL, nc_session_reader, session)) != 0) {
+		DBG_UNLOCK("mut_mqueue");
+		pthread_mutex_unlock(&(session->mut_mqueue));
+		ERROR("%s: Creating the reader thread failed (%s).", __func__, strerror(r));
+		return (EXIT_FAILURE);
+	}
+	async->reader = 1;
+	async->reader_joinable = 1;
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+
+	return (EXIT_SUCCESS);
+}
+
+/* send the request and register it as pending, with the completion callback if given */
+static const nc_msgid nc_session_send_rpc_pending(struct nc_session* session, nc_rpc *rpc,
+		void (*reply_clb)(struct nc_session* session, const char* msgid, nc_reply* reply, void* arg), void* clb_arg)
+{
+	struct nc_session_async* async;
+	struct nc_reply_pending *pending, *parked;
+	const nc_msgid msgid;
+
+	if (session == NULL || session->is_server) {
+		ERROR("%s: Invalid (client) session.", __func__);
+		return (NULL);
+	}
+
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	if ((async = nc_session_async_get(session)) == NULL ||
+			(pending = calloc(1, sizeof(struct nc_reply_pending))) == NULL) {
+		DBG_UNLOCK("mut_mqueue");
+		pthread_mutex_unlock(&(session->mut_mqueue));
+		return (NULL);
+	}
+	pending->type = NC_MSG_UNKNOWN;
+	pending->reply_clb = reply_clb;
+	pending->clb_arg = clb_arg;
+	/* the replies received meanwhile are parked for the registration */
+	async->sending++;
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+
+	msgid = nc_session_send_rpc(session, rpc);
+
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	async->sending--;
+	if (msgid != NULL && reply_clb != NULL && (pending->msgid = strdup(msgid)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		msgid = NULL;
+	}
+	if (msgid != NULL && (parked = xmlHashLookup(async->parked, BAD_CAST msgid)) != NULL) {
+		/* the reply was received while sending the request, the entry is
+		 * left in the list of the parked replies until its unparking */
+		xmlHashRemoveEntry(async->parked, BAD_CAST msgid, NULL);
+		pending->type = parked->type;
+		pending->reply = parked->reply;
+		parked->type = NC_MSG_UNKNOWN;
+		parked->reply = NULL;
+	}
+	if (msgid == NULL) {
+		nc_reply_pending_free(pending, NULL);
+	} else if (pending->type != NC_MSG_UNKNOWN && reply_clb != NULL) {
+		/* hand it over to nc_session_process() */
+		nc_session_async_complete(async, pending);
+	} else if (xmlHashAddEntry(async->pending, BAD_CAST msgid, pending) != 0) {
+		ERROR("%s: The message-id \"%s\" is already awaited.", __func__, msgid);
+		nc_reply_pending_free(pending, NULL);
+		msgid = NULL;
+	}
+	if (async->sending == 0) {
+		/* no other request can claim the replies parked meanwhile */
+		nc_session_async_unpark(session);
+	}
+	pthread_cond_broadcast(&(async->cond));
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+
+	return (msgid);
+}
+
+API const nc_msgid nc_session_send_rpc_async(struct nc_session* session, nc_rpc *rpc)
+{
+	return (nc_session_send_rpc_pending(session, rpc, NULL, NULL));
+}
+
+API const nc_msgid nc_session_send_rpc_clb(struct nc_session* session, nc_rpc *rpc,
+		void (*func)(struct nc_session* session, const char* msgid, nc_reply* reply, void* arg), void* arg)
+{
+	if (func == NULL) {
+		ERROR("%s: Invalid parameter.", __func__);
+		return (NULL);
+	}
+
+	return (nc_session_send_rpc_pending(session, rpc, func, arg));
+}
+
+API int nc_session_notif_clb(struct nc_session* session, void (*func)(struct nc_session* session, nc_ntf* ntf, void* arg), void* arg)
+{
+	struct nc_session_async* async;
+	struct nc_msg* msg, *msg_aux;
+
+	if (session == NULL || session->is_server) {
+		ERROR("%s: Invalid (client) session.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	if ((async = nc_session_async_get(session)) == NULL) {
+		DBG_UNLOCK("mut_mqueue");
+		pthread_mutex_unlock(&(session->mut_mqueue));
+		return (EXIT_FAILURE);
+	}
+	async->notif_clb = func;
+	async->notif_clb_arg = arg;
+	if (func == NULL && async->notifs != NULL) {
+		/* the undelivered notifications are available via nc_session_recv_notif() again */
+		DBG_LOCK("mut_equeue");
+		pthread_mutex_lock(&(session->mut_equeue));
+		msg = async->notifs;
+		async->notifs = NULL;
+		if ((msg_aux = session->queue_event) == NULL) {
+			session->queue_event = msg;
+		} else {
+			for (; msg_aux->next != NULL; msg_aux = msg_aux->next);
+			msg_aux->next = msg;
+		}
+		DBG_UNLOCK("mut_equeue");
+		pthread_mutex_unlock(&(session->mut_equeue));
+	}
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
 
-			/* now we have size of next chunk, so read the chunk */
-			if (nc_session_read_len (session, chunk_length, &chunk, &len) != 0) {
-				if (total_len > 0) {
-					free (text);
-				}
-				goto malformed_msg_channels_unlock;
-			}
+	return (EXIT_SUCCESS);
+}
 
-			/*
-			 * realloc resulting text buffer if needed (always needed now)
-			 * don't forget count terminating null byte
-			 * */
-			if (text_size < (total_len + len + 1)) {
-				char *tmp = realloc (text, total_len + len + 1);
-				if (tmp == NULL) {
-					ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-					free(text);
-					goto malformed_msg_channels_unlock;
-				}
-				text = tmp;
-				text[total_len] = '\0';
-				text_size = total_len + len + 1;
-			}
-			memcpy(text + total_len, chunk, len);
-			total_len += len;
-			text[total_len] = '\0';
-			free (chunk);
-			chunk = NULL;
+/* xmlHashScanner collecting the requests with the callback */
+static void nc_session_async_collect(void* payload, void* data, const xmlChar* UNUSED(name))
+{
+	struct nc_reply_pending* pending = (struct nc_reply_pending*)payload;
+	struct nc_reply_pending** list = (struct nc_reply_pending**)data;
 
-		} while (1);
-		DBG("Received message (session %s): %s", session->session_id, text);
-		break;
-	default:
-		ERROR("Unsupported NETCONF protocol version (%d)", session->version);
-		goto malformed_msg_channels_unlock;
-		break;
+	if (pending->reply_clb != NULL) {
+		pending->next = *list;
+		*list = pending;
 	}
+}
 
-	DBG_UNLOCK("mut_channel");
-	pthread_mutex_unlock(session->mut_channel);
+API int nc_session_process(struct nc_session* session, int timeout)
+{
+	struct nc_session_async* async;
+	struct nc_reply_pending *pending, *aborted = NULL;
+	struct nc_msg *notifs, *msg;
+	struct timespec deadline;
+	void (*notif_clb)(struct nc_session* session, nc_ntf* ntf, void* arg);
+	void* notif_clb_arg;
+	NC_MSG_TYPE ret;
+	int count = 0;
 
-	if (text == NULL) {
-		ERROR("Empty message received (session %s)", session->session_id);
-		goto malformed_msg;
+	if (session == NULL || session->is_server) {
+		ERROR("%s: Invalid (client) session.", __func__);
+		return (-1);
 	}
-
-	retval = calloc (1, sizeof(struct nc_msg));
-	if (retval == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-		free (text);
-		goto malformed_msg;
+	if (timeout > 0) {
+		nc_session_async_deadline(timeout, &deadline);
 	}
 
-	/* skip leading whitespaces */
-	tmp_text=text;
-	while (isspace(*tmp_text)) {
-		tmp_text++;
-	}
-	/* store the received message in libxml2 format */
-	retval->doc = xmlReadDoc (BAD_CAST tmp_text, NULL, NULL, NC_XMLREAD_OPTIONS);
-	if (retval->doc == NULL) {
-		free (retval);
-		free (text);
-		ERROR("Invalid XML data received.");
-		goto malformed_msg;
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	if ((async = nc_session_async_get(session)) == NULL) {
+		DBG_UNLOCK("mut_mqueue");
+		pthread_mutex_unlock(&(session->mut_mqueue));
+		return (-1);
 	}
-	free (text);
 
-	/* create xpath evaluation context */
-	if ((retval->ctxt = xmlXPathNewContext(retval->doc)) == NULL) {
-		ERROR("%s: rpc message XPath context cannot be created.", __func__);
-		nc_msg_free(retval);
-		goto malformed_msg;
+	/* wait for something to deliver */
+	while ((ret = nc_session_async_step(session, timeout, &deadline)) == NC_MSG_NONE &&
+			async->completed == NULL && async->notifs == NULL);
+	/* and take all the messages already available */
+	while (ret != NC_MSG_UNKNOWN && async->reader != 1 && !async->reading) {
+		if ((ret = nc_session_async_read(session, 0)) == NC_MSG_WOULDBLOCK) {
+			break;
+		}
 	}
 
-	/* register base namespace for the rpc */
-	if (xmlXPathRegisterNs(retval->ctxt, BAD_CAST NC_NS_BASE10_ID, BAD_CAST NC_NS_BASE10) != 0) {
-		ERROR("Registering base namespace for the message xpath context failed.");
-		nc_msg_free(retval);
-		goto malformed_msg;
-	}
-	if (xmlXPathRegisterNs(retval->ctxt, BAD_CAST NC_NS_NOTIFICATIONS_ID, BAD_CAST NC_NS_NOTIFICATIONS) != 0) {
-		ERROR("Registering notifications namespace for the message xpath context failed.");
-		nc_msg_free(retval);
-		goto malformed_msg;
+	if (ret == NC_MSG_UNKNOWN) {
+		/* no reply is going to come, finish the requests with the callback */
+		xmlHashScan(async->pending, nc_session_async_collect, &aborted);
+		while ((pending = aborted) != NULL) {
+			aborted = pending->next;
+			xmlHashRemoveEntry(async->pending, BAD_CAST pending->msgid, NULL);
+			pending->type = NC_MSG_UNKNOWN;
+			nc_session_async_complete(async, pending);
+		}
 	}
-	if (xmlXPathRegisterNs(retval->ctxt, BAD_CAST NC_NS_WITHDEFAULTS_ID, BAD_CAST NC_NS_WITHDEFAULTS) != 0) {
-		ERROR("Registering with-defaults namespace for the message xpath context failed.");
-		nc_msg_free(retval);
-		goto malformed_msg;
+
+	pending = async->completed;
+	async->completed = NULL;
+	notifs = async->notifs;
+	async->notifs = NULL;
+	notif_clb = async->notif_clb;
+	notif_clb_arg = async->notif_clb_arg;
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+
+	/* deliver out of the locks, the callbacks can use the session */
+	for (; pending != NULL; pending = aborted, count++) {
+		aborted = pending->next;
+		pending->reply_clb(session, pending->msgid, pending->reply, pending->clb_arg);
+		pending->reply = NULL;
+		nc_reply_pending_free(pending, NULL);
 	}
-	if (xmlXPathRegisterNs(retval->ctxt, BAD_CAST NC_NS_MONITORING_ID, BAD_CAST NC_NS_MONITORING) != 0) {
-		ERROR("Registering monitoring namespace for the message xpath context failed.");
-		nc_msg_free(retval);
-		goto malformed_msg;
+	for (; notifs != NULL; notifs = msg, count++) {
+		msg = notifs->next;
+		notifs->next = NULL;
+		notif_clb(session, (nc_ntf*)notifs, notif_clb_arg);
 	}
 
-	/* parse and store message type */
-	root = xmlDocGetRootElement(retval->doc);
-	/* check namespace */
-	if (!root->ns || !root->ns->href || xmlStrcmp(root->ns->href, BAD_CAST NC_NS_BASE10)) {
-		/* event notification ? */
-		if (root->ns && root->ns->href && !xmlStrcmp(root->ns->href, BAD_CAST NC_NS_NOTIFICATIONS) &&
-				!xmlStrcmp(root->name, BAD_CAST "notification")) {
-			/* we have notification */
-			msgtype = NC_MSG_NOTIFICATION;
-		} else {
-			/* bad namespace */
-			WARN("Unknown (unsupported) namespace of the received message root element.");
-			retval->type.rpc = NC_RPC_UNKNOWN;
-			msgtype = NC_MSG_UNKNOWN;
-		}
-
-	} else 	if (xmlStrcmp (root->name, BAD_CAST "rpc-reply") == 0) {
-		msgtype = NC_MSG_REPLY;
+	return ((ret == NC_MSG_UNKNOWN) ? -1 : count);
+}
 
-		/* set reply type flag */
-		nc_reply_parse_type(retval);
+API NC_MSG_TYPE nc_session_recv_reply_async(struct nc_session* session, const nc_msgid msgid, int timeout, nc_reply** reply)
+{
+	struct nc_reply_pending* pending;
+	struct timespec deadline;
+	NC_MSG_TYPE ret;
 
-	} else if (xmlStrcmp (root->name, BAD_CAST "rpc") == 0) {
-		msgtype = NC_MSG_RPC;
+	if (session == NULL || msgid == NULL || reply == NULL) {
+		ERROR("%s: Invalid parameter.", __func__);
+		return (NC_MSG_UNKNOWN);
+	}
+	if (timeout > 0) {
+		nc_session_async_deadline(timeout, &deadline);
+	}
 
-		/* set with-defaults if any */
-		nc_rpc_parse_withdefaults(retval, NULL);
-	} else if (xmlStrcmp (root->name, BAD_CAST "hello") == 0) {
-		/* set message type, we have <hello> message */
-		retval->type.reply = NC_REPLY_HELLO;
-		msgtype = NC_MSG_HELLO;
-	} else {
-		WARN("Unknown (unsupported) type of received message detected.");
-		retval->type.rpc = NC_RPC_UNKNOWN;
-		msgtype = NC_MSG_UNKNOWN;
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	if (session->async == NULL || (pending = xmlHashLookup(session->async->pending, BAD_CAST msgid)) == NULL) {
+		DBG_UNLOCK("mut_mqueue");
+		pthread_mutex_unlock(&(session->mut_mqueue));
+		ERROR("%s: No request with the message-id \"%s\" was sent by nc_session_send_rpc_async().", __func__, msgid);
+		return (NC_MSG_UNKNOWN);
 	}
 
-	if (msgtype == NC_MSG_RPC || msgtype == NC_MSG_REPLY) {
-		/* parse and store message-id */
-		if ((id = nc_msg_parse_msgid(retval)) == NULL) {
-			retval->msgid = NULL;
-		} else {
-			retval->msgid = strdup(id);
+	while ((ret = pending->type) == NC_MSG_UNKNOWN) {
+		if ((ret = nc_session_async_step(session, timeout, &deadline)) != NC_MSG_NONE) {
+			if (pending->type != NC_MSG_UNKNOWN) {
+				/* received by the last step */
+				continue;
+			}
+			/* the request stays pending after the timeout */
+			DBG_UNLOCK("mut_mqueue");
+			pthread_mutex_unlock(&(session->mut_mqueue));
+			return (ret);
 		}
-	} else {
-		retval->msgid = NULL;
 	}
 
-	/* return the result */
-	*msg = retval;
-	(*msg)->session = session;
-	return (msgtype);
+	if (ret == NC_MSG_REPLY) {
+		*reply = pending->reply;
+		pending->reply = NULL;
+	}
+	xmlHashRemoveEntry(session->async->pending, BAD_CAST msgid, nc_reply_pending_free);
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
 
-malformed_msg_channels_unlock:
-	DBG_UNLOCK("mut_channel");
-	pthread_mutex_unlock(session->mut_channel);
+	return (ret);
+}
 
-malformed_msg:
-	if (session->version == NETCONFV11 && session->ssh_sess == NULL) {
-		/* NETCONF version 1.1 define sending error reply from the server */
-		reply = nc_reply_error(nc_err_new(NC_ERR_MALFORMED_MSG));
-		if (reply == NULL) {
-			ERROR("Unable to create the \'Malformed message\' reply");
-			nc_session_close(session, NC_SESSION_TERM_OTHER);
-			return (NC_MSG_UNKNOWN);
-		}
+/* nc_session_recv_reply() of the session using the asynchronous API */
+static NC_MSG_TYPE nc_session_recv_reply_dispatched(struct nc_session* session, int timeout, nc_reply** reply)
+{
+	struct timespec deadline;
+	NC_MSG_TYPE ret = NC_MSG_NONE;
 
-		if (nc_session_send_reply(session, NULL, reply) == 0) {
-			ERROR("Unable to send the \'Malformed message\' reply");
-			nc_session_close(session, NC_SESSION_TERM_OTHER);
-			return (NC_MSG_UNKNOWN);
-		}
-		nc_reply_free(reply);
+	if (timeout > 0) {
+		nc_session_async_deadline(timeout, &deadline);
 	}
 
-	ERROR("Malformed message received, closing the session %s.", session->session_id);
-	nc_session_close(session, NC_SESSION_TERM_OTHER);
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	while (1) {
+		if (session->queue_msg != NULL) {
+			/* pop the oldest reply from the queue */
+			*reply = (nc_reply*)(session->queue_msg);
+			session->queue_msg = (*reply)->next;
+			(*reply)->next = NULL;
+			ret = NC_MSG_REPLY;
+			break;
+		} else if (session->async->errors > 0) {
+			/* <rpc-reply> with error information was processed automatically */
+			session->async->errors--;
+			ret = NC_MSG_NONE;
+			break;
+		} else if (ret != NC_MSG_NONE) {
+			break;
+		}
+		ret = nc_session_async_step(session, timeout, &deadline);
+	}
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
 
-	return (NC_MSG_UNKNOWN);
+	return (ret);
 }
 
-static NC_MSG_TYPE nc_session_recv_msg(struct nc_session* session, int timeout, struct nc_msg** msg)
+/* nc_session_recv_notif() of the session using the asynchronous API */
+static NC_MSG_TYPE nc_session_recv_notif_dispatched(struct nc_session* session, int timeout, nc_ntf** ntf)
 {
-	NC_MSG_TYPE ret;
+	struct timespec deadline;
+	NC_MSG_TYPE ret = NC_MSG_NONE;
 
-	ret = nc_session_receive (session, timeout, msg);
-	switch (ret) {
-	case NC_MSG_REPLY: /* regular reply received */
-	case NC_MSG_HELLO:
-	case NC_MSG_NOTIFICATION:
-	case NC_MSG_WOULDBLOCK:
-		/* do nothing, just return the type */
-		break;
-	default:
-		ret = NC_MSG_UNKNOWN;
-		break;
+	if (timeout > 0) {
+		nc_session_async_deadline(timeout, &deadline);
+	}
+
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	while (1) {
+		DBG_LOCK("mut_equeue");
+		pthread_mutex_lock(&(session->mut_equeue));
+		if (session->queue_event != NULL) {
+			/* pop the oldest notification from the queue */
+			*ntf = (nc_ntf*)(session->queue_event);
+			session->queue_event = (*ntf)->next;
+			(*ntf)->next = NULL;
+			ret = NC_MSG_NOTIFICATION;
+		}
+		DBG_UNLOCK("mut_equeue");
+		pthread_mutex_unlock(&(session->mut_equeue));
+		if (ret != NC_MSG_NONE) {
+			break;
+		}
+		ret = nc_session_async_step(session, timeout, &deadline);
 	}
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
 
 	return (ret);
 }
 
-#define LOCAL_RECEIVE_TIMEOUT 100
 API NC_MSG_TYPE nc_session_recv_reply(struct nc_session* session, int timeout, nc_reply** reply)
 {
 	struct nc_msg *msg_aux, *msg = NULL;
@@ -2322,6 +3754,13 @@ API NC_MSG_TYPE nc_session_recv_reply(struct nc_session* session, int timeout, n
 	DBG_LOCK("mut_mqueue");
 	pthread_mutex_lock(&(session->mut_mqueue));
 
+	if (session->async != NULL) {
+		/* replies are dispatched to their waiters */
+		DBG_UNLOCK("mut_mqueue");
+		pthread_mutex_unlock(&(session->mut_mqueue));
+		return (nc_session_recv_reply_dispatched(session, timeout, reply));
+	}
+
 try_again:
 	if (session->queue_msg != NULL) {
 		/* pop the oldest reply from the queue */
@@ -2386,16 +3825,153 @@ try_again:
 		DBG_UNLOCK("mut_equeue");
 		pthread_mutex_unlock(&(session->mut_equeue));
 
-		break;
-	default:
-		nc_msg_free(msg);
-		ret = NC_MSG_UNKNOWN;
-		break;
+		break;
+	default:
+		nc_msg_free(msg);
+		ret = NC_MSG_UNKNOWN;
+		break;
+	}
+
+	/* session lock is no more needed */
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+
+	return (ret);
+}
+
+int nc_session_send_notif_text(struct nc_session* session, const char* text, size_t len)
+{
+	int ret;
+
+	DBG_LOCK("mut_session");
+	pthread_mutex_lock(&(session->mut_session));
+
+	if (session->status != NC_SESSION_STATUS_WORKING && session->status != NC_SESSION_STATUS_CLOSING) {
+		ERROR("Invalid session to send <notification>.");
+		DBG_UNLOCK("mut_session");
+		pthread_mutex_unlock(&(session->mut_session));
+		return (EXIT_FAILURE);
+	}
+
+	ret = nc_session_send_text(session, text, len);
+
+	DBG_UNLOCK("mut_session");
+	pthread_mutex_unlock(&(session->mut_session));
+
+	if (ret == EXIT_SUCCESS) {
+		/* update stats */
+		NC_STAT_INC(session->stats->out_notifications);
+		if (nc_info) {
+			NC_STAT_INC(nc_info->stats.counters.out_notifications);
+		}
+		nc_metrics_add(NC_METRIC_NTF_DISPATCHED, 1);
+	}
+
+	return (ret);
+}
+
+int nc_session_queue_notif_text(struct nc_session* session, const char* text, size_t len)
+{
+	char *aux;
+	size_t size;
+	int hlen = 0;
+
+	if (len > NC_WRITE_BUFSIZE) {
+		/* do not keep large messages, send them right now */
+		if (nc_session_flush_notif(session) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+		return (nc_session_send_notif_text(session, text, len));
+	}
+
+	DBG_LOCK("mut_session");
+	pthread_mutex_lock(&(session->mut_session));
+
+	if (session->status != NC_SESSION_STATUS_WORKING && session->status != NC_SESSION_STATUS_CLOSING) {
+		ERROR("Invalid session to send <notification>.");
+		DBG_UNLOCK("mut_session");
+		pthread_mutex_unlock(&(session->mut_session));
+		return (EXIT_FAILURE);
+	}
+
+	/* make space for the message framed as a single chunk */
+	size = session->nbuf_len + NC_WRITE_HDRSIZE + len + NC_WRITE_ENDSIZE;
+	if (size > session->nbuf_size) {
+		if (size < 2 * session->nbuf_size) {
+			size = 2 * session->nbuf_size;
+		}
+		if ((aux = realloc(session->nbuf, size)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			DBG_UNLOCK("mut_session");
+			pthread_mutex_unlock(&(session->mut_session));
+			return (EXIT_FAILURE);
+		}
+		session->nbuf = aux;
+		session->nbuf_size = size;
+	}
+
+	DBG("Queueing message (session %s): %.*s", session->session_id, (int)len, text);
+
+	aux = &(session->nbuf[session->nbuf_len]);
+	if (session->version == NETCONFV11) {
+		hlen = snprintf(aux, NC_WRITE_HDRSIZE, "\n#%zu\n", len);
+	}
+	memcpy(&(aux[hlen]), text, len);
+	if (session->version == NETCONFV11) {
+		memcpy(&(aux[hlen + len]), NC_V11_END_MSG, strlen(NC_V11_END_MSG));
+		session->nbuf_len += hlen + len + strlen(NC_V11_END_MSG);
+	} else { /* NETCONFV10 */
+		memcpy(&(aux[hlen + len]), NC_V10_END_MSG, strlen(NC_V10_END_MSG));
+		session->nbuf_len += hlen + len + strlen(NC_V10_END_MSG);
+	}
+	session->nbuf_count++;
+	nc_metrics_add(NC_METRIC_NTF_QUEUED, 1);
+
+	DBG_UNLOCK("mut_session");
+	pthread_mutex_unlock(&(session->mut_session));
+
+	return (EXIT_SUCCESS);
+}
+
+int nc_session_flush_notif(struct nc_session* session)
+{
+	int ret = EXIT_FAILURE;
+	unsigned int count;
+
+	DBG_LOCK("mut_session");
+	pthread_mutex_lock(&(session->mut_session));
+
+	if (session->nbuf_len == 0) {
+		/* nothing to do */
+		DBG_UNLOCK("mut_session");
+		pthread_mutex_unlock(&(session->mut_session));
+		return (EXIT_SUCCESS);
 	}
 
-	/* session lock is no more needed */
-	DBG_UNLOCK("mut_mqueue");
-	pthread_mutex_unlock(&(session->mut_mqueue));
+	if (nc_session_send_ready(session) == EXIT_SUCCESS) {
+		/* lock the session for sending the data */
+		DBG_LOCK("mut_channel");
+		session->mut_channel_flag = 1;
+		pthread_mutex_lock(session->mut_channel);
+		ret = nc_session_write(session, session->nbuf, session->nbuf_len);
+		nc_session_channel_release(session);
+	}
+	count = session->nbuf_count;
+	session->nbuf_len = 0;
+	session->nbuf_count = 0;
+	nc_metrics_add(NC_METRIC_NTF_QUEUED, -(int64_t) count);
+
+	DBG_UNLOCK("mut_session");
+	pthread_mutex_unlock(&(session->mut_session));
+
+	if (ret == EXIT_SUCCESS) {
+		/* update stats */
+		NC_STAT_ADD(session->stats->out_notifications, count);
+		if (nc_info) {
+			NC_STAT_ADD(nc_info->stats.counters.out_notifications, count);
+		}
+		nc_metrics_add(NC_METRIC_NTF_DISPATCHED, count);
+	}
 
 	return (ret);
 }
@@ -2427,12 +4003,11 @@ API int nc_session_send_notif(struct nc_session* session, const nc_ntf* ntf)
 
 	if (ret == EXIT_SUCCESS) {
 		/* update stats */
-		session->stats->out_notifications++;
+		NC_STAT_INC(session->stats->out_notifications);
 		if (nc_info) {
-			pthread_rwlock_wrlock(&(nc_info->lock));
-			nc_info->stats.counters.out_notifications++;
-			pthread_rwlock_unlock(&(nc_info->lock));
+			NC_STAT_INC(nc_info->stats.counters.out_notifications);
 		}
+		nc_metrics_add(NC_METRIC_NTF_DISPATCHED, 1);
 	}
 
 	return (ret);
@@ -2452,6 +4027,17 @@ API NC_MSG_TYPE nc_session_recv_notif(struct nc_session* session, int timeout, n
 		local_timeout = LOCAL_RECEIVE_TIMEOUT;
 	}
 
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	if (session->async != NULL) {
+		/* messages are dispatched into the queues */
+		DBG_UNLOCK("mut_mqueue");
+		pthread_mutex_unlock(&(session->mut_mqueue));
+		return (nc_session_recv_notif_dispatched(session, timeout, ntf));
+	}
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+
 	DBG_LOCK("mut_equeue");
 	pthread_mutex_lock(&(session->mut_equeue));
 
@@ -2512,6 +4098,8 @@ API NC_MSG_TYPE nc_session_recv_rpc(struct nc_session* session, int timeout, nc_
 	struct nc_err* e = NULL;
 	nc_reply* reply;
 	unsigned int *counter = NULL;
+	uint64_t trace_start;
+	int access;
 
 	/* use local timeout to avoid continual long time blocking */
 	int local_timeout;
@@ -2585,18 +4173,19 @@ try_again:
 			}
 		}
 		/* update statistics */
-		session->stats->in_rpcs++;
+		NC_STAT_INC(session->stats->in_rpcs);
 		if (nc_info) {
-			pthread_rwlock_wrlock(&(nc_info->lock));
-			nc_info->stats.counters.in_rpcs++;
-			pthread_rwlock_unlock(&(nc_info->lock));
+			NC_STAT_INC(nc_info->stats.counters.in_rpcs);
 		}
 
 		/* NACM init */
+		trace_start = ((*rpc)->trace != NULL) ? nc_trace_now() : 0;
 		nacm_start(*rpc, session);
 
 		/* NACM - check operation access */
-		if (nacm_check_operation(*rpc) != NACM_PERMIT) {
+		access = nacm_check_operation(*rpc);
+		nc_trace_add((*rpc)->trace, NC_TRACE_NACM, trace_start);
+		if (access != NACM_PERMIT) {
 			e = nc_err_new(NC_ERR_ACCESS_DENIED);
 			nc_err_set(e, NC_ERR_PARAM_MSG, "Operation not permitted.");
 			counter = &nc_info->stats_nacm.denied_ops;
@@ -2617,7 +4206,7 @@ try_again:
 				nc_err_set(e, NC_ERR_PARAM_TYPE, "protocol");
 				nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, "source");
 
-				session->stats->in_bad_rpcs++;
+				NC_STAT_INC(session->stats->in_bad_rpcs);
 				counter = &nc_info->stats.counters.in_bad_rpcs;
 				goto replyerror;
 			}
@@ -2630,7 +4219,7 @@ try_again:
 				nc_err_set(e, NC_ERR_PARAM_TYPE, "protocol");
 				nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, "target");
 
-				session->stats->in_bad_rpcs++;
+				NC_STAT_INC(session->stats->in_bad_rpcs);
 				counter = &nc_info->stats.counters.in_bad_rpcs;
 				goto replyerror;
 			}
@@ -2649,11 +4238,9 @@ try_again:
 		ret = NC_MSG_UNKNOWN;
 
 		/* update stats */
-		session->stats->in_bad_rpcs++;
+		NC_STAT_INC(session->stats->in_bad_rpcs);
 		if (nc_info) {
-			pthread_rwlock_wrlock(&(nc_info->lock));
-			nc_info->stats.counters.in_bad_rpcs++;
-			pthread_rwlock_unlock(&(nc_info->lock));
+			NC_STAT_INC(nc_info->stats.counters.in_bad_rpcs);
 		}
 
 		break;
@@ -2672,14 +4259,336 @@ replyerror:
 	nc_reply_free(reply);
 	/* update stats */
 	if (nc_info) {
-		pthread_rwlock_wrlock(&(nc_info->lock));
-		(*counter)++;
-		pthread_rwlock_unlock(&(nc_info->lock));
+		NC_STAT_INC(*counter);
 	}
 
 	return (NC_MSG_NONE); /* message processed internally */
 }
 
+/* initial size of the session list in the session loop structure */
+#define NC_LOOP_SIZE_STEP 16
+/* maximal number of events obtained by a single epoll_wait() call */
+#define NC_LOOP_EVENTS 64
+
+struct nc_session_loop_item {
+	struct nc_session *session;
+	int fd; /* input file descriptor of the session */
+	int ready; /* flag if the fd was reported as readable */
+};
+
+struct nc_session_loop {
+	int epfd; /* epoll file descriptor */
+	int count; /* number of sessions in the loop */
+	int size; /* allocated size of the items list */
+	int next; /* index of the item to be served first */
+	struct nc_session_loop_item *items;
+};
+
+/**
+ * @brief Get the file descriptor which can be polled for the session's input.
+ */
+static int nc_session_input_fd(const struct nc_session* session)
+{
+#ifndef DISABLE_LIBSSH
+	if (session->ssh_chan != NULL) {
+		return (ssh_get_fd(ssh_channel_get_session(session->ssh_chan)));
+	}
+#endif
+#ifdef ENABLE_TLS
+	if (session->tls != NULL) {
+		return (SSL_get_fd(session->tls));
+	}
+#endif
+	return (session->fd_input);
+}
+
+/**
+ * @brief Check if there are some data already read from the session's file
+ * descriptor, but not processed yet, so epoll cannot report them.
+ */
+static int nc_session_input_pending(struct nc_session* session)
+{
+	int ret = 0;
+
+	if (session->status != NC_SESSION_STATUS_WORKING) {
+		return (0);
+	}
+
+	DBG_LOCK("mut_channel");
+	pthread_mutex_lock(session->mut_channel);
+	if (session->rbuf_start != session->rbuf_end || session->rstate != 0) {
+		ret = 1;
+	}
+#ifndef DISABLE_LIBSSH
+	else if (session->ssh_chan != NULL) {
+		ret = (ssh_channel_poll(session->ssh_chan, 0) > 0) ? 1 : 0;
+	}
+#endif
+#ifdef ENABLE_TLS
+	else if (session->tls != NULL) {
+		ret = (SSL_pending(session->tls) > 0) ? 1 : 0;
+	}
+#endif
+	DBG_UNLOCK("mut_channel");
+	pthread_mutex_unlock(session->mut_channel);
+
+	return (ret);
+}
+
+/**
+ * @brief Read the data available on the session's input without blocking and
+ * process them as far as possible. The chunks of a :base:1.1 message are
+ * parsed as they arrive, a :base:1.0 message is buffered until its end is
+ * found. The progress is kept in the session between the calls.
+ *
+ * @return 1 if the session holds a complete message (or its input failed, so
+ * nc_session_recv_rpc() reports the error), 0 if the message is still partial.
+ */
+static int nc_session_loop_fill(struct nc_session* session)
+{
+	size_t taglen = strlen(NC_V10_END_MSG);
+	int ret;
+
+	if (session->status != NC_SESSION_STATUS_WORKING) {
+		return (1);
+	}
+
+	DBG_LOCK("mut_channel");
+	pthread_mutex_lock(session->mut_channel);
+	if (session->version == NETCONFV11) {
+		ret = (nc_session_recv_chunks(session, 0) != 0) ? 1 : 0;
+	} else {
+		while (1) {
+			/* search only the data not checked yet, the end of message can
+			 * start in the last (taglen - 1) checked bytes */
+			if (session->rbuf_end - session->rbuf_start >= session->rscanned + taglen &&
+					memmem(&(session->rbuf[session->rbuf_start + session->rscanned]),
+					session->rbuf_end - session->rbuf_start - session->rscanned,
+					NC_V10_END_MSG, taglen) != NULL) {
+				ret = 1;
+				break;
+			}
+			if (session->rbuf_end - session->rbuf_start >= taglen) {
+				session->rscanned = session->rbuf_end - session->rbuf_start - (taglen - 1);
+			}
+			if ((ret = nc_session_rbuf_more(session, 0)) != 1) {
+				/* no more data (wait for the rest of the message) or an error */
+				ret = (ret == 0) ? 0 : 1;
+				break;
+			}
+		}
+	}
+	DBG_UNLOCK("mut_channel");
+	pthread_mutex_unlock(session->mut_channel);
+
+	return (ret);
+}
+
+API struct nc_session_loop* nc_session_loop_new(void)
+{
+	struct nc_session_loop *loop;
+
+	if ((loop = calloc(1, sizeof(struct nc_session_loop))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	if ((loop->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+		ERROR("%s: epoll_create1() failed (%s).", __func__, strerror(errno));
+		free(loop);
+		return (NULL);
+	}
+
+	return (loop);
+}
+
+API void nc_session_loop_free(struct nc_session_loop* loop)
+{
+	if (loop == NULL) {
+		return;
+	}
+
+	close(loop->epfd);
+	free(loop->items);
+	free(loop);
+}
+
+API int nc_session_loop_add(struct nc_session_loop* loop, struct nc_session* session)
+{
+	struct epoll_event ev;
+	void *tmp;
+	int i, fd;
+
+	if (loop == NULL || session == NULL || session->status != NC_SESSION_STATUS_WORKING) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	if ((fd = nc_session_input_fd(session)) == -1) {
+		ERROR("%s: session %s has no input to wait on.", __func__, session->session_id);
+		return (EXIT_FAILURE);
+	}
+
+	for (i = 0; i < loop->count; i++) {
+		if (loop->items[i].session == session) {
+			/* already there */
+			return (EXIT_SUCCESS);
+		} else if (loop->items[i].fd == fd) {
+			/* another channel of the same SSH session, fd is already registered */
+			break;
+		}
+	}
+
+	if (i == loop->count) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+			ERROR("%s: epoll_ctl() failed (%s).", __func__, strerror(errno));
+			return (EXIT_FAILURE);
+		}
+	}
+
+	if (loop->count == loop->size) {
+		tmp = realloc(loop->items, (loop->size + NC_LOOP_SIZE_STEP) * sizeof(struct nc_session_loop_item));
+		if (tmp == NULL) {
+			ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+			if (i == loop->count) {
+				epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+			}
+			return (EXIT_FAILURE);
+		}
+		loop->items = tmp;
+		loop->size += NC_LOOP_SIZE_STEP;
+	}
+
+	loop->items[loop->count].session = session;
+	loop->items[loop->count].fd = fd;
+	loop->items[loop->count].ready = 0;
+	loop->count++;
+
+	return (EXIT_SUCCESS);
+}
+
+API int nc_session_loop_remove(struct nc_session_loop* loop, struct nc_session* session)
+{
+	int i, j, fd;
+
+	if (loop == NULL || session == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	for (i = 0; i < loop->count; i++) {
+		if (loop->items[i].session == session) {
+			break;
+		}
+	}
+	if (i == loop->count) {
+		return (EXIT_FAILURE);
+	}
+	fd = loop->items[i].fd;
+
+	/* keep the order of the items for the round-robin */
+	memmove(&(loop->items[i]), &(loop->items[i + 1]), (loop->count - i - 1) * sizeof(struct nc_session_loop_item));
+	loop->count--;
+	if (loop->next > i) {
+		loop->next--;
+	}
+	if (loop->next >= loop->count) {
+		loop->next = 0;
+	}
+
+	for (j = 0; j < loop->count; j++) {
+		if (loop->items[j].fd == fd) {
+			/* fd is still used by another channel of the same SSH session */
+			return (EXIT_SUCCESS);
+		}
+	}
+	/* the file descriptor can be already closed, so ignore the errors */
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+
+	return (EXIT_SUCCESS);
+}
+
+API NC_MSG_TYPE nc_session_loop_recv_rpc(struct nc_session_loop* loop, int timeout, struct nc_session** session, nc_rpc** rpc)
+{
+	struct epoll_event events[NC_LOOP_EVENTS];
+	struct timespec start, now;
+	NC_MSG_TYPE ret;
+	int i, j, n, idx, wait;
+
+	if (session != NULL) {
+		*session = NULL;
+	}
+	if (loop == NULL || session == NULL || rpc == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (NC_MSG_UNKNOWN);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (1) {
+		/* sessions with already buffered data are not reported by epoll */
+		for (i = 0; i < loop->count; i++) {
+			if (!loop->items[i].ready && nc_session_input_pending(loop->items[i].session)) {
+				loop->items[i].ready = 1;
+			}
+		}
+
+		/* serve the ready sessions starting from the one after the last served */
+		for (i = 0; i < loop->count; i++) {
+			idx = (loop->next + i) % loop->count;
+			if (!loop->items[idx].ready) {
+				continue;
+			}
+			loop->items[idx].ready = 0;
+
+			if (!nc_session_loop_fill(loop->items[idx].session)) {
+				/* partial message, keep waiting for the rest of it */
+				continue;
+			}
+			ret = nc_session_recv_rpc(loop->items[idx].session, 0, rpc);
+			if (ret == NC_MSG_WOULDBLOCK) {
+				/* e.g. data for another channel on the shared SSH session */
+				continue;
+			}
+			loop->next = (idx + 1) % loop->count;
+			*session = loop->items[idx].session;
+			return (ret);
+		}
+
+		/* compute the remaining time */
+		if (timeout > 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			wait = timeout - ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+			if (wait < 0) {
+				wait = 0;
+			}
+		} else {
+			wait = timeout;
+		}
+
+		n = epoll_wait(loop->epfd, events, NC_LOOP_EVENTS, wait);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ERROR("%s: epoll_wait() failed (%s).", __func__, strerror(errno));
+			return (NC_MSG_UNKNOWN);
+		} else if (n == 0) {
+			return (NC_MSG_WOULDBLOCK);
+		}
+
+		/* mark the sessions with input (or hang-up) */
+		for (j = 0; j < n; j++) {
+			for (i = 0; i < loop->count; i++) {
+				if (loop->items[i].fd == events[j].data.fd) {
+					loop->items[i].ready = 1;
+				}
+			}
+		}
+	}
+}
+
 API const nc_msgid nc_session_send_rpc(struct nc_session* session, nc_rpc *rpc)
 {
 	int ret;
@@ -2766,6 +4675,11 @@ API const nc_msgid nc_session_send_rpc(struct nc_session* session, nc_rpc *rpc)
 	msg = nc_msg_dup ((struct nc_msg*) rpc);
 	/* set message id */
 	if (xmlStrcmp (xmlDocGetRootElement(msg->doc)->name, BAD_CAST "rpc") == 0) {
+		/* the message-id attribute is added only into our copy of the message */
+		if (nc_msg_doc_own(msg) != EXIT_SUCCESS) {
+			nc_msg_free (msg);
+			return (NULL);
+		}
 		/* lock the session due to accessing msgid item */
 		DBG_LOCK("mut_session");
 		pthread_mutex_lock(&(session->mut_session));
@@ -2809,6 +4723,9 @@ API const nc_msgid nc_session_send_reply(struct nc_session* session, const nc_rp
 	const nc_msgid retval = NULL;
 	xmlNsPtr ns;
 	xmlNodePtr msg_root, rpc_root;
+	char* text;
+	size_t len;
+	uint64_t trace_start;
 
 	if (reply == NULL) {
 		ERROR("%s: Invalid <reply> message to send.", __func__);
@@ -2825,8 +4742,30 @@ API const nc_msgid nc_session_send_reply(struct nc_session* session, const nc_rp
 		ERROR("Invalid session to send <rpc-reply>.");
 		return (0); /* failure */
 	}
+	trace_start = (rpc != NULL && rpc->trace != NULL) ? nc_trace_now() : 0;
+
+	if ((text = nc_reply_ok_dump(reply, rpc, &len)) != NULL) {
+		/* shared <ok/> reply, just put the message-id into its serialization */
+		retval = (rpc->msgid == 0) ? nc_msg_parse_msgid(rpc) : rpc->msgid;
+		ret = nc_session_send_text(session, text, len);
+		free(text);
+
+		DBG_UNLOCK("mut_session");
+		pthread_mutex_unlock(&(session->mut_session));
+		if (ret == EXIT_SUCCESS && trace_start != 0) {
+			nc_trace_finish(rpc->trace, rpc, trace_start);
+		}
+		return ((ret != EXIT_SUCCESS) ? 0 : retval);
+	}
 
+	/* the attributes of the rpc are set only in our copy of the reply */
 	msg = nc_msg_dup ((struct nc_msg*) reply);
+	if (msg == NULL || nc_msg_doc_own(msg) != EXIT_SUCCESS) {
+		DBG_UNLOCK("mut_session");
+		pthread_mutex_unlock(&(session->mut_session));
+		nc_msg_free (msg);
+		return (0); /* failure */
+	}
 
 	if (rpc != NULL) {
 		/* get message id */
@@ -2883,13 +4822,14 @@ API const nc_msgid nc_session_send_reply(struct nc_session* session, const nc_rp
 	if (ret != EXIT_SUCCESS) {
 		return (0);
 	} else {
+		if (trace_start != 0) {
+			nc_trace_finish(rpc->trace, rpc, trace_start);
+		}
 		if (reply->type.reply == NC_REPLY_ERROR) {
 			/* update stats */
-			session->stats->out_rpc_errors++;
+			NC_STAT_INC(session->stats->out_rpc_errors);
 			if (nc_info) {
-				pthread_rwlock_wrlock(&(nc_info->lock));
-				nc_info->stats.counters.out_rpc_errors++;
-				pthread_rwlock_unlock(&(nc_info->lock));
+				NC_STAT_INC(nc_info->stats.counters.out_rpc_errors);
 			}
 		}
 		return (retval);
@@ -2908,98 +4848,13 @@ API int nc_msgid_compare(const nc_msgid id1, const nc_msgid id2)
 API NC_MSG_TYPE nc_session_send_recv(struct nc_session* session, nc_rpc *rpc, nc_reply** reply)
 {
 	const nc_msgid msgid;
-	NC_MSG_TYPE replytype;
-	struct nc_msg* queue = NULL, *msg, *p = NULL;
 
-	msgid = nc_session_send_rpc(session, rpc);
-	if (msgid == NULL) {
+	/* the reply is dispatched to us even if other threads use the session */
+	if ((msgid = nc_session_send_rpc_async(session, rpc)) == NULL) {
 		return (NC_MSG_UNKNOWN);
 	}
 
-	DBG_LOCK("mut_mqueue");
-	pthread_mutex_lock(&(session->mut_mqueue));
-
-	/* first, look into the session's list of previously received messages */
-	if ((queue = session->queue_msg) != NULL) {
-		/* search in the queue for the reply with required message ID */
-		for (msg = queue; msg != NULL; msg = msg->next) {
-			/* test message IDs */
-			if (nc_msgid_compare(msgid, nc_reply_get_msgid((nc_reply*) msg)) == 0) {
-				break;
-			}
-
-			/* store the predecessor */
-			p = msg;
-		}
-
-		if (msg != NULL) {
-			/* we have found the reply in the queue */
-			(*reply) = (nc_reply*) msg;
-
-			/* detach the reply from session's queue */
-			if (p == NULL) {
-				/* no predecessor - we detach the first item in the queue */
-				session->queue_msg = msg->next;
-			} else {
-				p->next = msg->next;
-			}
-			msg->next = NULL;
-			DBG_UNLOCK("mut_mqueue");
-			pthread_mutex_unlock(&(session->mut_mqueue));
-			return (NC_MSG_REPLY);
-		} else {
-			/*
-			 * the queue does not contain required reply, we have to
-			 * read it from the input, but first we have to hide
-			 * session's queue from nc_session_recv_reply()
-			 */
-			session->queue_msg = NULL;
-		}
-	}
-	DBG_UNLOCK("mut_mqueue");
-	pthread_mutex_unlock(&(session->mut_mqueue));
-
-	while (1) {
-		replytype = nc_session_recv_reply(session, -1, reply);
-		if (replytype == NC_MSG_REPLY) {
-			/* compare message ID */
-			if (nc_msgid_compare(msgid, nc_reply_get_msgid(*reply)) != 0) {
-				/* reply with different message ID is expected */
-				DBG_LOCK("mut_mqueue");
-				pthread_mutex_lock(&(session->mut_mqueue));
-				/* store this reply for the later use of someone else */
-				if (queue == NULL) {
-					queue = (struct nc_msg*) (*reply);
-				} else {
-					for (msg = queue; msg->next != NULL; msg = msg->next);
-					msg->next = (struct nc_msg*) (*reply);
-				}
-				DBG_UNLOCK("mut_mqueue");
-				pthread_mutex_unlock(&(session->mut_mqueue));
-			} else {
-				/* we have it! */
-				break;
-			}
-		} else if (replytype == NC_MSG_UNKNOWN || replytype == NC_MSG_NONE) {
-			/* some error occured */
-			break;
-		}
-		/*
-		 * else (e.g. Notification or an unexpected reply was received)
-		 * read another message in the loop
-		 */
-	}
-
-	if (queue != NULL) {
-		DBG_LOCK("mut_mqueue");
-		pthread_mutex_lock(&(session->mut_mqueue));
-		/* reconnect hidden queue back to the session */
-		session->queue_msg = queue;
-		DBG_UNLOCK("mut_mqueue");
-		pthread_mutex_unlock(&(session->mut_mqueue));
-	}
-
-	return (replytype);
+	return (nc_session_recv_reply_async(session, msgid, -1, reply));
 }
 
 const char* nc_session_term_string(NC_SESSION_TERM_REASON reason)
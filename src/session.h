@@ -345,6 +345,88 @@ int nc_session_send_notif(struct nc_session* session, const nc_ntf* ntf);
  */
 NC_MSG_TYPE nc_session_recv_rpc(struct nc_session* session, int timeout, nc_rpc** rpc);
 
+/**
+ * @ingroup session
+ * @brief Set of NETCONF sessions waited on together by a server.
+ *
+ * The structure is created by nc_session_loop_new(), sessions are added by
+ * nc_session_loop_add() and \<rpc\>s from all of them are received by
+ * nc_session_loop_recv_rpc().
+ */
+struct nc_session_loop;
+
+/**
+ * @ingroup session
+ * @brief Create a new empty set of sessions to receive \<rpc\>s from.
+ *
+ * Allows a single server process (or thread) to serve many NETCONF sessions
+ * (over SSH channels, TLS or file descriptors) at once instead of blocking
+ * in nc_session_recv_rpc() on each of them separately.
+ *
+ * @return Created session loop structure, NULL on error.
+ */
+struct nc_session_loop* nc_session_loop_new(void);
+
+/**
+ * @ingroup session
+ * @brief Free the session loop structure. The sessions added into the loop
+ * are not affected.
+ *
+ * @param[in] loop Session loop to free.
+ */
+void nc_session_loop_free(struct nc_session_loop* loop);
+
+/**
+ * @ingroup session
+ * @brief Add the session into the set of sessions waited on by the loop.
+ *
+ * @param[in] loop Session loop.
+ * @param[in] session NETCONF session (in the working state) to add.
+ * @return 0 on success, non-zero on error.
+ */
+int nc_session_loop_add(struct nc_session_loop* loop, struct nc_session* session);
+
+/**
+ * @ingroup session
+ * @brief Remove the session from the loop. The caller is supposed to do this
+ * before freeing the session which was (e.g. as a result of its closing)
+ * returned by nc_session_loop_recv_rpc() with #NC_MSG_UNKNOWN.
+ *
+ * @param[in] loop Session loop.
+ * @param[in] session NETCONF session to remove.
+ * @return 0 on success, non-zero if the session is not part of the loop.
+ */
+int nc_session_loop_remove(struct nc_session_loop* loop, struct nc_session* session);
+
+/**
+ * @ingroup rpc
+ * @brief Receive \<rpc\> request from any session in the loop.
+ *
+ * Waits for the input on all the sessions in the loop and reads the message
+ * from the first session with a complete message. The available data are read
+ * without blocking (the chunks of a :base:1.1 message are parsed as they
+ * arrive), so a session sending its message slowly stays in the loop with the
+ * partially received message and does not block the other sessions.
+ * The sessions are served in a round-robin manner, so a busy session cannot
+ * starve the other ones. The
+ * received \<rpc\> is processed the same way as by nc_session_recv_rpc().
+ *
+ * @param[in] loop Session loop to use.
+ * @param[in] timeout Timeout in milliseconds, -1 for infinite timeout, 0 for
+ * non-blocking
+ * @param[out] session NETCONF session from which the message was received
+ * (or where the error occurred).
+ * @param[out] rpc Received \<rpc\>
+ * @return
+ * - #NC_MSG_RPC - success, *rpc points to the received \<rpc\> message.
+ * - #NC_MSG_HELLO - success, *rpc points to the received \<hello\> message.
+ * - #NC_MSG_NONE - message was processed internally (e.g. error reply was sent).
+ * - #NC_MSG_UNKNOWN - error occurred, if *session is set, the error relates to
+ *   this session which was probably closed, check nc_session_get_status().
+ * - #NC_MSG_WOULDBLOCK - receiving timeouted without any received message.
+ */
+NC_MSG_TYPE nc_session_loop_recv_rpc(struct nc_session_loop* loop, int timeout, struct nc_session** session, nc_rpc** rpc);
+
 /**
  * @ingroup reply
  * @brief Receive \<rpc-reply\> response from the specified NETCONF session.
@@ -414,6 +496,123 @@ int nc_msgid_compare(const nc_msgid id1, const nc_msgid id2);
  */
 NC_MSG_TYPE nc_session_send_recv(struct nc_session* session, nc_rpc *rpc, nc_reply** reply);
 
+/**
+ * @ingroup rpc
+ * @brief Send \<rpc\> request via specified NETCONF session and register it
+ * as pending. Its reply is delivered to nc_session_recv_reply_async() called
+ * with the returned message-id, so requests of several threads can be in
+ * flight on one session at the same time.
+ * This function is supposed to be performed only by NETCONF clients.
+ *
+ * Once used on the session, the replies nobody waits for are still available
+ * via nc_session_recv_reply() and notifications via nc_session_recv_notif().
+ *
+ * This function IS thread safe.
+ *
+ * @param[in] session NETCONF session to use.
+ * @param[in] rpc \<rpc\> message to send.
+ * @return 0 on error,\n message-id of sent message on success.
+ */
+const nc_msgid nc_session_send_rpc_async(struct nc_session* session, nc_rpc *rpc);
+
+/**
+ * @ingroup reply
+ * @brief Receive \<rpc-reply\> to the request sent by
+ * nc_session_send_rpc_async(). If no other thread (or the reader thread
+ * started by nc_session_reader_start()) reads the session at the moment, the
+ * calling thread reads and dispatches the incoming messages itself.
+ *
+ * This function IS thread safe.
+ *
+ * @param[in] session NETCONF session to use.
+ * @param[in] msgid Message-id returned by nc_session_send_rpc_async().
+ * @param[in] timeout Timeout in milliseconds, -1 for infinite timeout, 0 for
+ * non-blocking
+ * @param[out] reply Received \<rpc-reply\>
+ * @return
+ * - #NC_MSG_REPLY - success, *reply points to the received \<rpc-reply\> message.
+ * - #NC_MSG_NONE - success, but \<rpc-reply\> with error information was
+ *   processed automatically using callback specified with nc_callback_error_reply()
+ *   function. *reply was not changed.
+ * - #NC_MSG_UNKNOWN - error occurred
+ * - #NC_MSG_WOULDBLOCK - the reply was not received within the timeout, the
+ *   request is still pending and the function can be called again.
+ */
+NC_MSG_TYPE nc_session_recv_reply_async(struct nc_session* session, const nc_msgid msgid, int timeout, nc_reply** reply);
+
+/**
+ * @ingroup session
+ * @brief Start the thread reading the client session and dispatching the
+ * received replies to their waiters (see nc_session_send_rpc_async()) and into
+ * the session's queues of replies and notifications. The thread finishes when
+ * the session is closed.
+ *
+ * @param[in] session Client NETCONF session.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int nc_session_reader_start(struct nc_session* session);
+
+/**
+ * @ingroup rpc
+ * @brief Send \<rpc\> request via specified NETCONF session and register the
+ * callback to be called with its \<rpc-reply\> by nc_session_process(). No
+ * thread has to block waiting for the reply, so one thread can drive many
+ * sessions from an event loop.
+ * This function is supposed to be performed only by NETCONF clients.
+ *
+ * This function IS thread safe.
+ *
+ * @param[in] session NETCONF session to use.
+ * @param[in] rpc \<rpc\> message to send.
+ * @param[in] func Callback function getting the message-id of the request and
+ * the received reply. The reply is passed to the callback to be freed by
+ * nc_reply_free(). It is NULL if the \<rpc-reply\> with error information was
+ * processed by the callback specified with nc_callback_error_reply() or if the
+ * session was terminated before the reply came.
+ * @param[in] arg Argument passed to the callback.
+ * @return 0 on error,\n message-id of sent message on success.
+ */
+const nc_msgid nc_session_send_rpc_clb(struct nc_session* session, nc_rpc *rpc,
+		void (*func)(struct nc_session* session, const char* msgid, nc_reply* reply, void* arg), void* arg);
+
+/**
+ * @ingroup notifications
+ * @brief Set the callback to be called by nc_session_process() with each
+ * Event Notification received on the client session. Until the callback is
+ * unset, the notifications are not available via nc_session_recv_notif().
+ *
+ * @param[in] session Client NETCONF session.
+ * @param[in] func Callback function getting the received notification to be
+ * freed by ncntf_notif_free(). NULL to unset the callback.
+ * @param[in] arg Argument passed to the callback.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int nc_session_notif_clb(struct nc_session* session, void (*func)(struct nc_session* session, nc_ntf* ntf, void* arg), void* arg);
+
+/**
+ * @ingroup session
+ * @brief Read the messages received on the client session and call the
+ * callbacks of the completed requests (see nc_session_send_rpc_clb()) and of
+ * the received notifications (see nc_session_notif_clb()).
+ *
+ * To integrate the session into an event loop, watch the file descriptor
+ * returned by nc_session_get_eventfd() for reading and call the function with
+ * zero timeout whenever it is readable. All the messages available at the
+ * moment are processed, including those buffered by the transport.
+ * If the reader thread (see nc_session_reader_start()) runs, it consumes the
+ * input itself and the messages it dispatched are delivered by this function,
+ * so call it with a timeout instead of watching the file descriptor.
+ *
+ * The callbacks are called from this function without any session's lock held.
+ *
+ * @param[in] session Client NETCONF session.
+ * @param[in] timeout Timeout in milliseconds to wait for something to process,
+ * -1 for infinite timeout, 0 for non-blocking
+ * @return Number of called callbacks, -1 if the session is not able to
+ * receive anymore (the callbacks of all its requests were already called).
+ */
+int nc_session_process(struct nc_session* session, int timeout);
+
 #ifdef __cplusplus
 }
 #endif
@@ -194,7 +194,8 @@ struct nc_session *nc_session_connect_libssh_socket(const char* username, const
 			(r = pthread_mutex_init(&(retval->mut_mqueue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_equeue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_ntf), &mattr)) != 0 ||
-			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0) {
+			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0 ||
+			(r = pthread_cond_init(&(retval->cond_channel), NULL)) != 0) {
 		ERROR("Mutex initialization failed (%s).", strerror(r));
 		pthread_mutexattr_destroy(&mattr);
 		free(retval);
@@ -489,7 +490,8 @@ struct nc_session *nc_session_connect_libssh_channel(struct nc_session *session)
 	if ((r = pthread_mutex_init(&(retval->mut_mqueue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_equeue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_ntf), &mattr)) != 0 ||
-			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0) {
+			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0 ||
+			(r = pthread_cond_init(&(retval->cond_channel), NULL)) != 0) {
 		ERROR("Mutex initialization failed (%s).", strerror(r));
 		pthread_mutexattr_destroy(&mattr);
 		return (NULL);
@@ -536,6 +538,7 @@ shutdown:
 		pthread_mutex_destroy(&(retval->mut_equeue));
 		pthread_mutex_destroy(&(retval->mut_ntf));
 		pthread_mutex_destroy(&(retval->mut_session));
+		pthread_cond_destroy(&(retval->cond_channel));
 		free(retval);
 	}
 	return (NULL);
@@ -547,6 +550,7 @@ struct nc_msg* read_hello_openssh(struct nc_session *session)
 {
 	struct nc_msg *retval;
 	nc_reply* reply;
+	xmlDocPtr doc;
 	xmlNodePtr root;
 	unsigned long long int i, size = BUFFER_SIZE;
 	char *buffer = NULL, c, *aux_buffer;
@@ -603,35 +607,17 @@ struct nc_msg* read_hello_openssh(struct nc_session *session)
 	fclose(session->f_input);
 	session->f_input = NULL;
 
-	/* create the message structure */
-	retval = calloc (1, sizeof(struct nc_msg));
-	if (retval == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-		free (buffer);
-		goto malformed_msg;
-	}
-
 	/* store the received message in libxml2 format */
-	retval->doc = xmlReadDoc (BAD_CAST buffer, NULL, NULL, NC_XMLREAD_OPTIONS);
-	if (retval->doc == NULL) {
-		free (retval);
-		free (buffer);
-		ERROR("Invalid XML data received.");
-		goto malformed_msg;
-	}
+	doc = xmlReadDoc (BAD_CAST buffer, NULL, NULL, NC_XMLREAD_OPTIONS);
 	free (buffer);
-
-	/* create xpath evaluation context */
-	if ((retval->ctxt = xmlXPathNewContext(retval->doc)) == NULL) {
-		ERROR("%s: rpc message XPath context cannot be created.", __func__);
-		nc_msg_free(retval);
+	if (doc == NULL) {
+		ERROR("Invalid XML data received.");
 		goto malformed_msg;
 	}
 
-	/* register base namespace for the rpc */
-	if (xmlXPathRegisterNs(retval->ctxt, BAD_CAST NC_NS_BASE10_ID, BAD_CAST NC_NS_BASE10) != 0) {
-		ERROR("Registering base namespace for the message xpath context failed.");
-		nc_msg_free(retval);
+	/* create the message structure with its XPath context */
+	if ((retval = nc_msg_new(doc)) == NULL) {
+		xmlFreeDoc(doc);
 		goto malformed_msg;
 	}
 
@@ -742,7 +728,8 @@ struct nc_session *nc_session_connect_ssh(const char* username, const char* host
 			(r = pthread_mutex_init(&(retval->mut_mqueue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_equeue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_ntf), &mattr)) != 0 ||
-			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0) {
+			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0 ||
+			(r = pthread_cond_init(&(retval->cond_channel), NULL)) != 0) {
 		ERROR("Mutex initialization failed (%s).", strerror(r));
 		pthread_mutexattr_destroy(&mattr);
 		goto error_cleanup;
@@ -977,6 +964,7 @@ error_cleanup:
 		pthread_mutex_destroy(&(retval->mut_equeue));
 		pthread_mutex_destroy(&(retval->mut_ntf));
 		pthread_mutex_destroy(&(retval->mut_session));
+		pthread_cond_destroy(&(retval->cond_channel));
 
 		close(retval->fd_input);
 		fclose(retval->f_input);
@@ -48,6 +48,9 @@
 #include <netdb.h>
 #include <pthread.h>
 #include <pwd.h>
+#include <time.h>
+
+#include <libxml/hash.h>
 
 #include <openssl/bio.h>
 #include <openssl/ssl.h>
@@ -61,6 +64,32 @@ static pthread_key_t tls_ctx_key;
 /* global SSL X509 store (X509_STORE*) */
 static pthread_key_t tls_store_key;
 static pthread_once_t tls_ctx_once = PTHREAD_ONCE_INIT;
+/* index of the client's session cache in the SSL context's ex_data */
+static int tls_cache_idx = -1;
+
+/* default preferences favouring the AEAD ciphers with the forward secrecy */
+#define NC_TLS_CIPHERS_DEFAULT "ECDHE+AESGCM:ECDHE+CHACHA20:DHE+AESGCM:DHE+CHACHA20:ECDHE+AES:DHE+AES:RSA+AESGCM:RSA+AES:!aNULL:!eNULL:!MD5:!DSS"
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#	define NC_TLS_CURVES_DEFAULT "X25519:P-256:P-384"
+#else
+#	define NC_TLS_CURVES_DEFAULT "P-256:P-384"
+#endif
+static char* tls_ciphers = NULL;
+static char* tls_curves = NULL;
+static pthread_mutex_t tls_prefs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void tls_session_free(void* payload, const xmlChar* UNUSED(name))
+{
+	SSL_SESSION_free((SSL_SESSION*)payload);
+}
+
+/* ex_data destructor of the session cache, called by SSL_CTX_free() */
+static void tls_cache_free(void* UNUSED(parent), void* ptr, CRYPTO_EX_DATA* UNUSED(ad), int UNUSED(idx), long UNUSED(argl), void* UNUSED(argp))
+{
+	if (ptr != NULL) {
+		xmlHashFree((xmlHashTablePtr)ptr, tls_session_free);
+	}
+}
 
 static void tls_ctx_init(void)
 {
@@ -70,6 +99,148 @@ static void tls_ctx_init(void)
 	SSL_load_error_strings();
 	ERR_load_BIO_strings();
 	SSL_library_init();
+
+	tls_cache_idx = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, tls_cache_free);
+}
+
+/* apply the cipher and curve preferences on the SSL context */
+static int tls_ctx_set_preferences(SSL_CTX* tls_ctx)
+{
+	int ret = EXIT_SUCCESS;
+
+	pthread_mutex_lock(&tls_prefs_lock);
+	if (SSL_CTX_set_cipher_list(tls_ctx, tls_ciphers ? tls_ciphers : NC_TLS_CIPHERS_DEFAULT) != 1) {
+		ERROR("Setting the TLS ciphers failed (%s).", ERR_reason_error_string(ERR_get_error()));
+		ret = EXIT_FAILURE;
+	}
+#ifdef SSL_CTRL_SET_CURVES_LIST
+	if (SSL_CTX_set1_curves_list(tls_ctx, tls_curves ? tls_curves : NC_TLS_CURVES_DEFAULT) != 1) {
+		ERROR("Setting the TLS curves failed (%s).", ERR_reason_error_string(ERR_get_error()));
+		ret = EXIT_FAILURE;
+	}
+#	if OPENSSL_VERSION_NUMBER < 0x10100000L
+	/* let the server choose the ECDHE curve from the list */
+	SSL_CTX_set_ecdh_auto(tls_ctx, 1);
+#	endif
+#else
+	if (tls_curves != NULL) {
+		WARN("The OpenSSL version does not allow to set the TLS curves.");
+	}
+#endif
+	pthread_mutex_unlock(&tls_prefs_lock);
+
+	return (ret);
+}
+
+API int nc_tls_set_preferences(const char* ciphers, const char* curves)
+{
+	SSL_CTX* tls_ctx;
+	char *ciphers_dup = NULL, *curves_dup = NULL;
+
+	if ((ciphers != NULL && (ciphers_dup = strdup(ciphers)) == NULL) ||
+			(curves != NULL && (curves_dup = strdup(curves)) == NULL)) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(ciphers_dup);
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&tls_prefs_lock);
+	free(tls_ciphers);
+	tls_ciphers = ciphers_dup;
+	free(tls_curves);
+	tls_curves = curves_dup;
+	pthread_mutex_unlock(&tls_prefs_lock);
+
+	/* the context of the current thread uses them immediately */
+	pthread_once(&tls_ctx_once, tls_ctx_init);
+	if ((tls_ctx = pthread_getspecific(tls_ctx_key)) != NULL) {
+		return (tls_ctx_set_preferences(tls_ctx));
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+API int nc_tls_server_ctx_setup(SSL_CTX* tls_ctx, long session_timeout)
+{
+	static const unsigned char sid_ctx[] = "libnetconf";
+
+	if (tls_ctx == NULL) {
+		ERROR("%s: Invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	pthread_once(&tls_ctx_once, tls_ctx_init);
+
+	/*
+	 * session IDs are cached by the server and the tickets are encrypted by
+	 * the context's key, the ID context is required to resume the sessions
+	 * with the verified client certificates
+	 */
+	SSL_CTX_set_session_cache_mode(tls_ctx, SSL_SESS_CACHE_SERVER);
+	if (SSL_CTX_set_session_id_context(tls_ctx, sid_ctx, sizeof(sid_ctx) - 1) != 1) {
+		ERROR("Setting the TLS session ID context failed (%s).", ERR_reason_error_string(ERR_get_error()));
+		return (EXIT_FAILURE);
+	}
+	SSL_CTX_clear_options(tls_ctx, SSL_OP_NO_TICKET);
+	if (session_timeout > 0) {
+		SSL_CTX_set_timeout(tls_ctx, session_timeout);
+	}
+	/* the server chooses from the preferred ciphers */
+	SSL_CTX_set_options(tls_ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+	return (tls_ctx_set_preferences(tls_ctx));
+}
+
+/* get the cached session for resuming the connection to the host */
+static SSL_SESSION* tls_cache_get(SSL_CTX* tls_ctx, const char* host)
+{
+	xmlHashTablePtr cache;
+	SSL_SESSION* sess;
+
+	if (host == NULL || (cache = SSL_CTX_get_ex_data(tls_ctx, tls_cache_idx)) == NULL ||
+			(sess = xmlHashLookup(cache, BAD_CAST host)) == NULL) {
+		return (NULL);
+	}
+
+	if (SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess) < time(NULL)) {
+		/* expired */
+		xmlHashRemoveEntry(cache, BAD_CAST host, tls_session_free);
+		return (NULL);
+	}
+
+	return (sess);
+}
+
+/* remember the session of the connection for the next connection to the host */
+static void tls_cache_put(SSL_CTX* tls_ctx, const char* host, SSL* tls)
+{
+	xmlHashTablePtr cache;
+	SSL_SESSION* sess;
+
+	if (host == NULL || (sess = SSL_get1_session(tls)) == NULL) {
+		return;
+	}
+
+	if ((cache = SSL_CTX_get_ex_data(tls_ctx, tls_cache_idx)) == NULL) {
+		if ((cache = xmlHashCreate(64)) == NULL || SSL_CTX_set_ex_data(tls_ctx, tls_cache_idx, cache) != 1) {
+			xmlHashFree(cache, NULL);
+			SSL_SESSION_free(sess);
+			return;
+		}
+	}
+	if (xmlHashUpdateEntry(cache, BAD_CAST host, sess, tls_session_free) != 0) {
+		SSL_SESSION_free(sess);
+	}
+}
+
+/* forget the session of the host, e.g. when resuming it failed */
+static void tls_cache_drop(SSL_CTX* tls_ctx, const char* host)
+{
+	xmlHashTablePtr cache;
+
+	if (host != NULL && (cache = SSL_CTX_get_ex_data(tls_ctx, tls_cache_idx)) != NULL) {
+		xmlHashRemoveEntry(cache, BAD_CAST host, tls_session_free);
+	}
 }
 
 API void nc_tls_destroy(void)
@@ -269,6 +440,12 @@ API int nc_tls_init(const char* peer_cert, const char* peer_key, const char *CAf
 		WARN("SSL_CTX_load_verify_locations() failed (%s).", ERR_reason_error_string(ERR_get_error()));
 	}
 
+	/* remember the sessions to resume them when reconnecting */
+	SSL_CTX_set_session_cache_mode(tls_ctx, SSL_SESS_CACHE_CLIENT);
+	if (tls_ctx_set_preferences(tls_ctx) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
 	/* store TLS context for thread */
 	if (destroy) {
 		nc_tls_destroy();
@@ -285,13 +462,14 @@ API struct nc_session *nc_session_accept_tls(const struct nc_cpblts* capabilitie
 	return (_nc_session_accept(capabilities, username, -1, -1, NULL, tls_sess));
 }
 
-struct nc_session *nc_session_connect_tls_socket(const char* username, const char* UNUSED(host), int sock)
+struct nc_session *nc_session_connect_tls_socket(const char* username, const char* host, int sock)
 {
 	struct nc_session *retval;
 	struct passwd *pw;
 	pthread_mutexattr_t mattr;
 	int verify, r;
 	SSL_CTX* tls_ctx;
+	SSL_SESSION* tls_cached;
 
 	tls_ctx = pthread_getspecific(tls_ctx_key);
 	if (tls_ctx == NULL) {
@@ -337,9 +515,15 @@ struct nc_session *nc_session_connect_tls_socket(const char* username, const cha
 	/* Set the SSL_MODE_AUTO_RETRY flag to allow OpenSSL perform re-handshake automatically */
 	SSL_set_mode(retval->tls, SSL_MODE_AUTO_RETRY);
 
+	/* try to resume the previous session with the host instead of the full handshake */
+	if ((tls_cached = tls_cache_get(tls_ctx, host)) != NULL) {
+		SSL_set_session(retval->tls, tls_cached);
+	}
+
 	/* connect and perform the handshake */
 	if (SSL_connect(retval->tls) != 1) {
 		ERROR("Connecting over TLS failed (%s).", ERR_reason_error_string(ERR_get_error()));
+		tls_cache_drop(tls_ctx, host);
 		SSL_free(retval->tls);
 		free(retval->stats);
 		free(retval);
@@ -356,6 +540,12 @@ struct nc_session *nc_session_connect_tls_socket(const char* username, const cha
 		WARN("I'm not happy with the server certificate (%s).", verify_ret_msg[verify]);
 	}
 
+	if (SSL_session_reused(retval->tls)) {
+		VERB("TLS session with %s resumed.", host);
+	}
+	/* the server may have issued a new ticket */
+	tls_cache_put(tls_ctx, host, retval->tls);
+
 	/* fill session structure */
 	retval->transport_socket = sock;
 	retval->fd_input = -1;
@@ -384,7 +574,8 @@ struct nc_session *nc_session_connect_tls_socket(const char* username, const cha
 			(r = pthread_mutex_init(&(retval->mut_mqueue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_equeue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_ntf), &mattr)) != 0 ||
-			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0) {
+			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0 ||
+			(r = pthread_cond_init(&(retval->cond_channel), NULL)) != 0) {
 		ERROR("Mutex initialization failed (%s).", strerror(r));
 		pthread_mutexattr_destroy(&mattr);
 		free(retval);
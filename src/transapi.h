@@ -149,6 +149,10 @@ struct transapi {
 	 * @brief Transapi file monitoring structure.
 	 */
 	struct transapi_file_callbacks* file_clbks;
+	/**
+	 * @brief Transapi batch callbacks mapping structure, can be NULL.
+	 */
+	struct transapi_batch_callbacks* batch_clbks;
 };
 
 /**
@@ -160,6 +164,43 @@ struct clbk {
 	int (*func)(void**, XMLDIFF_OP, xmlNodePtr, xmlNodePtr, struct nc_err**);
 };
 
+/**
+ * @ingroup transapi
+ * @brief Description of a single change passed to a batch callback, the items
+ * have the same meaning as the parameters of the callback in struct clbk.
+ */
+struct transapi_change {
+	XMLDIFF_OP op;
+	xmlNodePtr old_node;
+	xmlNodePtr new_node;
+};
+
+/**
+ * @ingroup transapi
+ * @brief Callbacks receiving all the changes of the sibling nodes with the same
+ * path (typically all the changed instances of a list) in a single call.
+ *
+ * Each path must be also listed in the transapi_data_callbacks structure, which
+ * specifies the order of the callbacks. For the changes of such nodes, the
+ * batch callback is called instead of the one from transapi_data_callbacks.
+ * The children of the nodes are processed before (TRANSAPI_CLBCKS_LEAF_TO_ROOT)
+ * or after (TRANSAPI_CLBCKS_ROOT_TO_LEAF) the batch callback as usual. If the
+ * batch callback fails, all the changes passed to it are considered failed.
+ *
+ * Description of the callback parameters:
+ * void **data[in,out] - the data from the transapi_data_callbacks structure
+ * const struct transapi_change *changes[in] - array of the changes
+ * int count[in] - number of the items in the changes array
+ * struct nc_err **error[out] - error information on failure
+ */
+struct transapi_batch_callbacks {
+	int callbacks_count;
+	struct {
+		const char* path;
+		int (*func)(void**, const struct transapi_change*, int, struct nc_err**);
+	} callbacks[];
+};
+
 /**
  * @ingroup transapi
  * @brief Same as transapi_data_callbacks. Using libxml2 structures for callbacks parameters.
@@ -1,5 +1,6 @@
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include "transapi_internal.h"
 #include "xmldiff.h"
@@ -21,10 +22,29 @@ struct transapi_callbacks_info {
 	keyList keys;
 	TRANSAPI_CLBCKS_ORDER_TYPE order;
 	struct transapi_list *transapis;
+	unsigned int workers;	/* 0 or 1 to call the callbacks one by one */
+	int (**batch)(void**, const struct transapi_change*, int, struct nc_err**);	/* indexed by the priority */
+};
+
+/* subtree of the changes to be applied by a worker thread */
+struct transapi_job {
+	struct xmldiff_tree* tree;
+	struct nc_err* error;
+	int ret;
+};
+
+struct transapi_jobs {
+	pthread_mutex_t lock;
+	struct transapi_job* list;
+	int count;
+	int next;
+	struct transapi_callbacks_info info;
+	NC_EDIT_ERROPT_TYPE erropt;
 };
 
 static int transapi_revert_callbacks_recursive(const struct transapi_callbacks_info *info, struct xmldiff_tree* tree, NC_EDIT_ERROPT_TYPE erropt, struct nc_err** error);
 static int transapi_apply_callbacks_recursive(const struct transapi_callbacks_info *info, struct xmldiff_tree* tree, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error);
+static int transapi_apply_callbacks_recursive_children(const struct transapi_callbacks_info *info, struct xmldiff_tree* tree, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error);
 
 static void transapi_revert_xml_tree(const struct transapi_callbacks_info *info, struct xmldiff_tree* tree)
 {
@@ -86,6 +106,7 @@ static int transapi_revert_callbacks_recursive_own(const struct transapi_callbac
 	char* msg;
 	XMLDIFF_OP op = XMLDIFF_NONE;
 	struct nc_err *new_error = NULL;
+	uint64_t start;
 
 	if (erropt == NC_EDIT_ERROPT_NOTSET || erropt == NC_EDIT_ERROPT_STOP) {
 		/* process the current node */
@@ -175,7 +196,9 @@ static int transapi_revert_callbacks_recursive_own(const struct transapi_callbac
 		free(msg);
 
 		/* revert changes */
+		start = nc_metrics_now();
 		ret = tree->callback(&(info->transapis->tapi->data_clbks->data), op, xmloldnode, xmlnewnode, &new_error);
+		nc_metrics_since(NC_METRIC_HIST_TRANSAPI, 0, start);
 
 		if (ret != EXIT_SUCCESS) {
 			WARN("Reverting configuration changes via transAPI failed, configuration may be inconsistent.");
@@ -252,6 +275,7 @@ static int transapi_apply_callbacks_recursive_own(const struct transapi_callback
 	int ret;
 	char* msg;
 	struct nc_err *new_error = NULL;
+	uint64_t start;
 
 	if (tree->callback) {
 		msg = malloc(strlen(tree->path)+128);
@@ -280,7 +304,9 @@ static int transapi_apply_callbacks_recursive_own(const struct transapi_callback
 		strcpy(msg+strlen(msg)-3, ".");
 		DBG(msg);
 		free(msg);
+		start = nc_metrics_now();
 		ret = tree->callback(&(info->transapis->tapi->data_clbks->data), tree->op, tree->old_node, tree->new_node, &new_error);
+		nc_metrics_since(NC_METRIC_HIST_TRANSAPI, 0, start);
 		if (ret != EXIT_SUCCESS) {
 			ERROR("Callback for path %s failed (%d).", tree->path, ret);
 			if (*error != NULL) {
@@ -303,10 +329,232 @@ static int transapi_apply_callbacks_recursive_own(const struct transapi_callback
 	return (APPLY_CALLBACK_SUCCESS);
 }
 
+/* batch callback connected with the change, NULL if there is none */
+#define BATCH_CALLBACK(info, tree) (((info)->batch != NULL && (tree)->callback != NULL) ? (info)->batch[(tree)->priority] : NULL)
+
+/*
+ * Apply all the not yet applied children of the tree with the specified
+ * priority. All of them have the same path, so their own changes are passed
+ * together to the batch callback.
+ */
+static int transapi_apply_callbacks_batch(const struct transapi_callbacks_info *info, struct xmldiff_tree* tree, int priority, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error)
+{
+	struct xmldiff_tree *child, **list;
+	struct transapi_change *changes;
+	struct nc_err *new_error = NULL;
+	int (*batch)(void**, const struct transapi_change*, int, struct nc_err**) = NULL;
+	int *children_ret;
+	int i, count = 0, ret, retval = APPLY_CALLBACK_SUCCESS;
+
+	for (child = tree->children; child != NULL; child = child->next) {
+		if (child->priority == priority && child->applied == CLBCKS_APPLIED_NONE) {
+			batch = BATCH_CALLBACK(info, child);
+			count++;
+		}
+	}
+	list = malloc(count * sizeof *list);
+	changes = malloc(count * sizeof *changes);
+	children_ret = malloc(count * sizeof *children_ret);
+	if (list == NULL || changes == NULL || children_ret == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(list);
+		free(changes);
+		free(children_ret);
+		return (APPLY_CALLBACK_ERROR);
+	}
+	for (i = 0, child = tree->children; child != NULL; child = child->next) {
+		if (child->priority == priority && child->applied == CLBCKS_APPLIED_NONE) {
+			list[i] = child;
+			changes[i].op = child->op;
+			changes[i].old_node = child->old_node;
+			changes[i].new_node = child->new_node;
+			i++;
+		}
+	}
+
+	if (info->order == TRANSAPI_CLBCKS_LEAF_TO_ROOT) {
+		for (i = 0; i < count; i++) {
+			list[i]->applied = CLBCKS_APPLYING_CHILDREN;
+		}
+		for (i = 0; i < count; i++) {
+			children_ret[i] = transapi_apply_callbacks_recursive_children(info, list[i], erropt, error);
+			if (children_ret[i] == APPLY_CALLBACK_ERROR) {
+				retval = APPLY_CALLBACK_ERROR;
+				goto cleanup;
+			}
+		}
+	}
+
+	DBG("Transapi calling batch callback %s with %d changes.", list[0]->path, count);
+	ret = batch(&(info->transapis->tapi->data_clbks->data), changes, count, &new_error);
+	if (ret != EXIT_SUCCESS) {
+		ERROR("Batch callback for path %s failed (%d).", list[0]->path, ret);
+		if (new_error != NULL) {
+			/* concatenate errors */
+			new_error->next = *error;
+			*error = new_error;
+		}
+		for (i = 0; i < count; i++) {
+			list[i]->applied = CLBCKS_APPLIED_ERROR;
+			if (erropt == NC_EDIT_ERROPT_CONT) {
+				/* on continue-on-error, return not applied changes immediately and then continue */
+				transapi_revert_xml_tree(info, list[i]);
+			}
+		}
+		retval = (erropt == NC_EDIT_ERROPT_CONT) ? APPLY_CALLBACK_CONTINUE : APPLY_CALLBACK_ERROR;
+		goto cleanup;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (info->order == TRANSAPI_CLBCKS_LEAF_TO_ROOT) {
+			list[i]->applied = (children_ret[i] == APPLY_CALLBACK_SUCCESS) ? CLBCKS_APPLIED_FULLY : CLBCKS_APPLIED_NOT_FULLY;
+		} else {
+			/* Callback applied successfully. Applying children callbacks */
+			list[i]->applied = CLBCKS_APPLYING_CHILDREN;
+			ret = transapi_apply_callbacks_recursive_children(info, list[i], erropt, error);
+			if (ret == APPLY_CALLBACK_ERROR) {
+				list[i]->applied = CLBCKS_APPLIED_NOT_FULLY;
+				retval = APPLY_CALLBACK_ERROR;
+				goto cleanup;
+			}
+			list[i]->applied = (ret == APPLY_CALLBACK_SUCCESS) ? CLBCKS_APPLIED_FULLY : CLBCKS_APPLIED_NOT_FULLY;
+		}
+	}
+
+cleanup:
+	free(list);
+	free(changes);
+	free(children_ret);
+
+	return (retval);
+}
+
+static void* transapi_apply_worker(void* arg)
+{
+	struct transapi_jobs* jobs = (struct transapi_jobs*) arg;
+	int i;
+
+	while (1) {
+		pthread_mutex_lock(&jobs->lock);
+		i = jobs->next++;
+		pthread_mutex_unlock(&jobs->lock);
+		if (i >= jobs->count) {
+			break;
+		}
+		jobs->list[i].ret = transapi_apply_callbacks_recursive(&jobs->info, jobs->list[i].tree, jobs->erropt, &jobs->list[i].error);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Apply the sibling subtrees of the same priority concurrently. There is no
+ * ordering relation among them, so each of them is applied by a worker thread
+ * (one by one inside the subtree) and the errors are put together in the
+ * order of the subtrees afterwards.
+ */
+static int transapi_apply_callbacks_wave(const struct transapi_callbacks_info *info, struct xmldiff_tree* tree, int priority, int count, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error)
+{
+	struct transapi_jobs jobs;
+	struct xmldiff_tree* child;
+	struct nc_err* last;
+	pthread_t *threads;
+	int i, nthreads, retval = APPLY_CALLBACK_SUCCESS;
+
+	if ((jobs.list = calloc(count, sizeof(struct transapi_job))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (APPLY_CALLBACK_ERROR);
+	}
+	for (i = 0, child = tree->children; child != NULL; child = child->next) {
+		if (child->priority == priority && child->applied == CLBCKS_APPLIED_NONE) {
+			jobs.list[i++].tree = child;
+		}
+	}
+
+	nthreads = (((unsigned int) count < info->workers) ? (unsigned int) count : info->workers) - 1;
+	if ((threads = malloc(nthreads * sizeof(pthread_t))) == NULL) {
+		nthreads = 0;
+	}
+
+	pthread_mutex_init(&jobs.lock, NULL);
+	jobs.count = count;
+	jobs.next = 0;
+	jobs.info = *info;
+	jobs.info.workers = 0;
+	jobs.erropt = erropt;
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, transapi_apply_worker, &jobs) != 0) {
+			break;
+		}
+	}
+	nthreads = i;
+	/* work in this thread too */
+	transapi_apply_worker(&jobs);
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&jobs.lock);
+	free(threads);
+
+	for (i = 0; i < count; i++) {
+		if (jobs.list[i].error != NULL) {
+			/* concatenate errors */
+			for (last = jobs.list[i].error; last->next != NULL; last = last->next);
+			last->next = *error;
+			*error = jobs.list[i].error;
+		}
+		if (jobs.list[i].ret != EXIT_SUCCESS) {
+			retval = APPLY_CALLBACK_ERROR;
+		}
+	}
+	free(jobs.list);
+
+	return (retval);
+}
+
 static int transapi_apply_callbacks_recursive_children(const struct transapi_callbacks_info *info, struct xmldiff_tree* tree, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error)
 {
 	struct xmldiff_tree* child, *cur_min;
 	int retval = APPLY_CALLBACK_SUCCESS;
+	int count;
+
+	/*
+	 * on continue-on-error, the not applied changes are removed from
+	 * the XML tree immediately, which cannot be done concurrently
+	 */
+	if (info->workers > 1 && erropt != NC_EDIT_ERROPT_CONT) {
+		do {
+			cur_min = NULL;
+			count = 0;
+			for (child = tree->children; child != NULL; child = child->next) {
+				if ((child->priority != PRIORITY_NONE) && child->applied == CLBCKS_APPLIED_NONE) {
+					if (cur_min == NULL || cur_min->priority > child->priority) {
+						cur_min = child;
+						count = 1;
+					} else if (cur_min->priority == child->priority) {
+						count++;
+					}
+				}
+			}
+
+			if (cur_min != NULL && BATCH_CALLBACK(info, cur_min) != NULL) {
+				if (transapi_apply_callbacks_batch(info, tree, cur_min->priority, erropt, error) != APPLY_CALLBACK_SUCCESS) {
+					return (APPLY_CALLBACK_ERROR);
+				}
+			} else if (count > 1) {
+				if (transapi_apply_callbacks_wave(info, tree, cur_min->priority, count, erropt, error) != APPLY_CALLBACK_SUCCESS) {
+					return (APPLY_CALLBACK_ERROR);
+				}
+			} else if (cur_min != NULL) {
+				/* a single subtree, maybe its children can be applied concurrently */
+				if (transapi_apply_callbacks_recursive(info, cur_min, erropt, error) != EXIT_SUCCESS) {
+					return (APPLY_CALLBACK_ERROR);
+				}
+			}
+		} while (cur_min != NULL);
+
+		return (retval);
+	}
 
 	do {
 		cur_min = NULL;
@@ -321,7 +569,16 @@ static int transapi_apply_callbacks_recursive_children(const struct transapi_cal
 			child = child->next;
 		}
 
-		if (cur_min != NULL) {
+		if (cur_min != NULL && BATCH_CALLBACK(info, cur_min) != NULL) {
+			/* Process all the children with the same path at once */
+			switch (transapi_apply_callbacks_batch(info, tree, cur_min->priority, erropt, error)) {
+			case APPLY_CALLBACK_ERROR:
+				return (APPLY_CALLBACK_ERROR);
+			case APPLY_CALLBACK_CONTINUE:
+				retval = APPLY_CALLBACK_CONTINUE;
+				break;
+			}
+		} else if (cur_min != NULL) {
 			/* Process this child recursively */
 			if (transapi_apply_callbacks_recursive(info, cur_min, erropt, error) != EXIT_SUCCESS) {
 				if (erropt == NC_EDIT_ERROPT_NOTSET || erropt == NC_EDIT_ERROPT_STOP || erropt == NC_EDIT_ERROPT_ROLLBACK) {
@@ -394,13 +651,13 @@ static int transapi_apply_callbacks_recursive(const struct transapi_callbacks_in
 }
 
 /* will be called by library after change in running datastore */
-int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr new_doc, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error)
+int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr new_doc, xmlDocPtr edit_doc, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error)
 {
 	struct xmldiff_tree* diff = NULL, *iter;
 	struct transapi_callbacks_info info;
 	int ret = 0;
 
-	if (xmldiff_diff(&diff, old_doc, new_doc, ds->ext_model_tree) == XMLDIFF_ERR) { /* failed to create diff list */
+	if (xmldiff_diff(&diff, old_doc, new_doc, ds->ext_model_tree, edit_doc) == XMLDIFF_ERR) { /* failed to create diff list */
 		ERROR("Model \"%s\" transAPI: failed to create the tree of differences.", ds->data_model->name);
 		xmldiff_free(diff);
 		return EXIT_FAILURE;
@@ -411,9 +668,13 @@ int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr ne
 			info.old = old_doc;
 			info.new = new_doc;
 			info.model = ds->ext_model;
-			info.keys = get_keynode_list(info.model);
+			/* private copy, the shared list is freed with the model
+			 * when the callbacks change it */
+			info.keys = xmlXPathObjectCopy(get_keynode_list(info.model));
 			info.order = ds->transapis->tapi->clbks_order;
 			info.transapis = ds->transapis;
+			info.workers = ds->tapi_workers;
+			info.batch = ds->tapi_batch_callbacks;
 
 			for (iter = diff; iter != NULL; iter = iter->next) {
 				ret += transapi_apply_callbacks_recursive(&info, iter, erropt, error);
@@ -6,6 +6,7 @@
 
 #include <libxml/tree.h>
 #include <libxml/parser.h>
+#include <libxml/hash.h>
 
 #include "netconf_internal.h"
 #include "xmldiff.h"
@@ -392,6 +393,41 @@ static int node_cmp(xmlNodePtr node1, xmlNodePtr node2)
 	return(ret);
 }
 
+/*
+ * @brief Get the concatenated key values of the list instance.
+ *
+ * @param trim Remove the whitespaces around the key values as the edit-config
+ * does when it matches the instances.
+ * @return Key values string to be freed by xmlFree(), NULL in case of error.
+ */
+static xmlChar* list_node_keys(xmlNodePtr node, struct model_tree * model, int trim)
+{
+	int i;
+	xmlNodePtr child;
+	xmlChar *keys, *value;
+	char* trimmed;
+
+	keys = xmlStrdup(BAD_CAST "");
+	for (i = 0; keys != NULL && i < model->keys_count; i++) { /* For every specified key */
+		for (child = node->children; child != NULL; child = child->next) {
+			if (xmlStrEqual(child->name, BAD_CAST model->keys[i])) { /* Find the matching leaf */
+				value = xmlNodeGetContent(child);
+				if (trim && value != NULL) {
+					trimmed = nc_clrwspace((char*)value);
+					keys = xmlStrcat(keys, BAD_CAST trimmed); /* Concatenate key value */
+					free(trimmed);
+				} else {
+					keys = xmlStrcat(keys, value); /* Concatenate key value */
+				}
+				xmlFree(value);
+				break;
+			}
+		}
+	}
+
+	return (keys);
+}
+
 /*
  * @brief Return EXIT_SUCCESS if node1 and node2 have same name, are in the same namespace and
  * have the same key values.
@@ -403,55 +439,16 @@ static int node_cmp(xmlNodePtr node1, xmlNodePtr node2)
  */
 static int list_node_cmp(xmlNodePtr node1, xmlNodePtr node2, struct model_tree * model)
 {
-	int i, ret = EXIT_FAILURE;
-	xmlNodePtr node_tmp;
-	xmlChar * tmp_str, *node1_keys, *node2_keys, *new_keys;
+	int ret = EXIT_FAILURE;
+	xmlChar *node1_keys, *node2_keys;
 
 	if (node_cmp(node1, node2) == EXIT_SUCCESS) {
-		/* For every old node create string holding the concatenated key values */
-		node1_keys = BAD_CAST strdup ("");
-		node2_keys = BAD_CAST strdup ("");
-		for (i=0; i<model->keys_count; i++) { /* For every specified key */
-			node_tmp = node1->children;
-			while (node_tmp) {
-				if (xmlStrEqual(node_tmp->name, BAD_CAST model->keys[i])) { /* Find matching leaf in old document */
-					tmp_str = xmlNodeGetContent (node_tmp);
-					new_keys  = realloc (node1_keys, sizeof(char) * (strlen((const char*)node1_keys)+strlen((const char*)tmp_str)+1));
-					if (new_keys == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						ret = EXIT_FAILURE;
-						goto cleanup;
-					}
-					node1_keys = new_keys;
-					strcat((char*)node1_keys, (char*)tmp_str); /* Concatenate key value */
-					xmlFree(tmp_str);
-					break;
-				}
-				node_tmp = node_tmp->next;
-			}
-			node_tmp = node2->children;
-			while (node_tmp) {
-				if (xmlStrEqual(node_tmp->name, BAD_CAST model->keys[i])) { /* Find matching leaf in old document */
-					tmp_str = xmlNodeGetContent (node_tmp);
-					new_keys = realloc (node2_keys, sizeof(char) * (strlen((const char*)node2_keys)+strlen((const char*)tmp_str)+1));
-					if (new_keys == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						ret = EXIT_FAILURE;
-						goto cleanup;
-					}
-					node2_keys = new_keys;
-					strcat ((char*)node2_keys, (char*)tmp_str); /* Concatenate key value */
-					xmlFree (tmp_str);
-					break;
-				}
-				node_tmp = node_tmp->next;
-			}
-		}
-		if (xmlStrEqual(node1_keys, node2_keys)) {
+		/* For every node create string holding the concatenated key values */
+		node1_keys = list_node_keys(node1, model, 0);
+		node2_keys = list_node_keys(node2, model, 0);
+		if (node1_keys != NULL && node2_keys != NULL && xmlStrEqual(node1_keys, node2_keys)) {
 			ret = EXIT_SUCCESS;
 		}
-
-cleanup:
 		xmlFree(node1_keys);
 		xmlFree(node2_keys);
 	}
@@ -459,7 +456,140 @@ cleanup:
 	return(ret);
 }
 
-static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model);
+/*
+ * @brief Create hash table of the list instances (siblings of the first node
+ * matching the ref node) indexed by their concatenated key values. If more
+ * instances have the same keys, the first one is stored.
+ *
+ * @return Hash table, NULL in case of error.
+ */
+static xmlHashTablePtr list_nodes_hash(xmlNodePtr first, xmlNodePtr ref, struct model_tree * model)
+{
+	xmlHashTablePtr hash;
+	xmlNodePtr node;
+	xmlChar *keys;
+
+	if ((hash = xmlHashCreate(0)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	for (node = first; node != NULL; node = node->next) {
+		if (node_cmp(ref, node)) {
+			continue;
+		}
+		if ((keys = list_node_keys(node, model, 0)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			xmlHashFree(hash, NULL);
+			return (NULL);
+		}
+		/* fails for the duplicated keys, the first instance is kept */
+		xmlHashAddEntry(hash, keys, node);
+		xmlFree(keys);
+	}
+
+	return (hash);
+}
+
+/*
+ * @brief Get the hint for the children of the edit-config node.
+ *
+ * @return The node itself if only its descendants described in the edit can
+ * change, NULL if the whole subtree can change.
+ */
+static xmlNodePtr xmldiff_hint_scope(xmlNodePtr edit_node)
+{
+	xmlChar* op;
+	xmlNodePtr child;
+
+	if ((op = xmlGetNsProp(edit_node, BAD_CAST "operation", BAD_CAST NC_NS_BASE10)) != NULL) {
+		if (!xmlStrEqual(op, BAD_CAST "merge")) {
+			/* the subtree is created, replaced or removed */
+			xmlFree(op);
+			return (NULL);
+		}
+		xmlFree(op);
+	}
+
+	for (child = edit_node->children; child != NULL; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE) {
+			return (edit_node);
+		}
+	}
+
+	/* leaf or a node without any particular content */
+	return (NULL);
+}
+
+/*
+ * @brief Find the edit-config node corresponding to the model node among
+ * the children of the hint node.
+ *
+ * @param[out] child_hint Hint for the children of the model node.
+ * @return 0 if the edit does not touch the model node, 1 otherwise.
+ */
+static int xmldiff_hint_child(xmlNodePtr hint, struct model_tree * model, xmlNodePtr* child_hint)
+{
+	xmlNodePtr edit_node, found = NULL;
+
+	for (edit_node = hint->children; edit_node != NULL; edit_node = edit_node->next) {
+		if (edit_node->type != XML_ELEMENT_NODE || !xmlStrEqual(edit_node->name, BAD_CAST model->name)) {
+			continue;
+		}
+		if (found != NULL) {
+			/* the node is described repeatedly, compare it whole */
+			*child_hint = NULL;
+			return (1);
+		}
+		found = edit_node;
+	}
+
+	if (found == NULL) {
+		return (0);
+	}
+
+	*child_hint = xmldiff_hint_scope(found);
+	return (1);
+}
+
+/*
+ * @brief Create hash table of the list instances described by the edit-config
+ * (children of the hint node) indexed by their concatenated key values.
+ *
+ * @param[out] hash Created hash table. NULL if the whole list must be compared
+ * (an instance is described repeatedly or an error occurred).
+ * @return 0 if the edit does not touch the list, 1 otherwise.
+ */
+static int list_hint_hash(xmlNodePtr hint, struct model_tree * model, xmlHashTablePtr* hash)
+{
+	xmlNodePtr edit_node;
+	xmlChar* keys;
+	int found = 0;
+
+	*hash = xmlHashCreate(0);
+	for (edit_node = hint->children; edit_node != NULL; edit_node = edit_node->next) {
+		if (edit_node->type != XML_ELEMENT_NODE || !xmlStrEqual(edit_node->name, BAD_CAST model->name)) {
+			continue;
+		}
+		found = 1;
+		if (*hash == NULL) {
+			continue;
+		}
+		if ((keys = list_node_keys(edit_node, model, 1)) == NULL || xmlHashAddEntry(*hash, keys, edit_node) != 0) {
+			xmlHashFree(*hash, NULL);
+			*hash = NULL;
+		}
+		xmlFree(keys);
+	}
+
+	if (!found) {
+		xmlHashFree(*hash, NULL);
+		*hash = NULL;
+	}
+	return (found);
+}
+
+static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model, xmlNodePtr hint);
 static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model);
 
 /**
@@ -471,8 +601,10 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
  * @param old_node	current node (or sibling) in the old configuration
  * @param new_node	current node (or sibling) in the new configuration
  * @param model	current node in the model
+ * @param hint	edit-config node whose children describe the changed nodes
+ *		on this level, NULL if all the nodes can be changed
  */
-static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xmlNodePtr old_node, xmlNodePtr new_node, struct model_tree * model)
+static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xmlNodePtr old_node, xmlNodePtr new_node, struct model_tree * model, xmlNodePtr hint)
 {
 	char * next_path;
 	xmlNodePtr old_tmp, new_tmp;
@@ -489,6 +621,16 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 		return XMLDIFF_ERR;
 	}
 
+	/* Skip the nodes not touched by the edit */
+	if (hint != NULL && model->type != YIN_TYPE_AUGMENT && model->type != YIN_TYPE_LIST) {
+		if (model->type == YIN_TYPE_CHOICE) {
+			/* changing a case removes nodes of the other cases, compare them all */
+			hint = NULL;
+		} else if (xmldiff_hint_child(hint, model, &hint) == 0) {
+			return XMLDIFF_NONE;
+		}
+	}
+
 	/* Find the node from the model in the old configuration */
 	for (old_tmp = old_node; old_tmp != NULL; old_tmp = old_tmp->next) {
 		if (xmlStrEqual(old_tmp->name, BAD_CAST model->name)) {
@@ -532,6 +674,11 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 		} else {
 			ret_op = XMLDIFF_NONE;
 		}
+		if (ret_op != XMLDIFF_NONE) {
+			/* the whole subtree was added or removed, including the nodes not
+			 * described in the edit (e.g. the added default values) */
+			hint = NULL;
+		}
 		tmp_diff = malloc(sizeof(struct xmldiff_tree*));
 		*tmp_diff = NULL;
 		tmp_op = XMLDIFF_NONE;
@@ -541,7 +688,7 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 				free(tmp_diff);
 				return (XMLDIFF_ERR);
 			}
-			tmp_op = xmldiff_recursive(tmp_diff, next_path, (old_tmp ? old_tmp->children : NULL), (new_tmp ? new_tmp->children : NULL), &model->children[i]);
+			tmp_op = xmldiff_recursive(tmp_diff, next_path, (old_tmp ? old_tmp->children : NULL), (new_tmp ? new_tmp->children : NULL), &model->children[i], hint);
 			free(next_path);
 
 			if (tmp_op == XMLDIFF_ERR) {
@@ -582,7 +729,7 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 				return (XMLDIFF_ERR);
 			}
 			/* We are moving down the model only (not in the configuration) */
-			tmp_op = xmldiff_recursive(diff, next_path, old_node, new_node, &model->children[i]);
+			tmp_op = xmldiff_recursive(diff, next_path, old_node, new_node, &model->children[i], hint);
 			free(next_path);
 
 			if (tmp_op == XMLDIFF_ERR) {
@@ -619,7 +766,7 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 
 	/* -- LIST -- */
 	case YIN_TYPE_LIST:
-		ret_op = xmldiff_list(diff, path, old_tmp, new_tmp, model);
+		ret_op = xmldiff_list(diff, path, old_tmp, new_tmp, model, hint);
 		break;
 
 	/* -- LEAFLIST -- */
@@ -665,21 +812,31 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 	return ret_op;
 }
 
-static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model)
+static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model, xmlNodePtr hint)
 {
 	XMLDIFF_OP item_ret_op, tmp_op, ret_op = XMLDIFF_NONE;
 	xmlNodePtr* list_added = NULL, *list_removed = NULL, *realloc_tmp;
-	xmlNodePtr list_old_tmp, list_new_tmp, list_old_inter, list_new_inter;
-	xmlChar* old_keys, *new_keys, *old_str, *new_str, *aux_str;
+	xmlNodePtr list_old_tmp, list_new_tmp, item_hint = NULL;
+	xmlHashTablePtr list_index = NULL, hint_index = NULL;
+	xmlChar* keys;
 	struct xmldiff_tree** tmp_diff;
-	int i, list_added_cnt = 0, list_removed_cnt = 0;
+	int i, j, list_added_cnt = 0, list_removed_cnt = 0;
 	char* next_path;
 
+	/* Skip the list if its instances are not touched by the edit */
+	if (hint != NULL && list_hint_hash(hint, model, &hint_index) == 0) {
+		return XMLDIFF_NONE;
+	}
+
 	/* Find matches according to the key elements, process all the elements inside recursively */
 	/* Not matching are _ADD or _REM */
 	/* Maching are _NONE or _CHAIN, according to the return values of the recursive calls */
 
 	/* ---REM--- Go through the old nodes and search for matching nodes in the new document*/
+	if (old_tmp != NULL && (list_index = list_nodes_hash(new_tmp, old_tmp, model)) == NULL) {
+		xmlHashFree(hint_index, NULL);
+		return (XMLDIFF_ERR);
+	}
 	list_old_tmp = old_tmp;
 	while (list_old_tmp) {
 		/* We have to make sure that this really is a list node we are checking now */
@@ -689,66 +846,34 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 		}
 
 		item_ret_op = XMLDIFF_NONE;
-		/* For every old node create string holding the concatenated key values */
-		old_keys = BAD_CAST strdup("");
-		for (i=0; i<model->keys_count; i++) { /* For every specified key */
-			list_old_inter = list_old_tmp->children;
-			while (list_old_inter) {
-				if (xmlStrEqual(list_old_inter->name, BAD_CAST model->keys[i])) { /* Find matching leaf in old document */
-					old_str = xmlNodeGetContent(list_old_inter);
-					aux_str  = realloc(old_keys, sizeof(xmlChar) * (xmlStrlen(old_keys)+xmlStrlen(old_str)+1));
-					if (aux_str == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						xmlFree(old_str);
-						xmlFree(old_keys);
-						return (XMLDIFF_ERR);
-					}
-					old_keys = aux_str;
-					strcat((char*)old_keys, (char*)old_str); /* Concatenate key value */
-					xmlFree(old_str);
-					break;
-				}
-				list_old_inter = list_old_inter->next;
-			}
+		/* For every old node get the concatenated key values and find the matching new node */
+		if ((keys = list_node_keys(list_old_tmp, model, 0)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			xmlHashFree(list_index, NULL);
+			xmlHashFree(hint_index, NULL);
+			free(list_removed);
+			return (XMLDIFF_ERR);
 		}
-
-		/* Go through the new list */
-		list_new_tmp = new_tmp;
-		while (list_new_tmp) {
-			if (node_cmp(old_tmp, list_new_tmp)) {
-				list_new_tmp = list_new_tmp->next;
-				continue;
-			}
-
-			new_keys = BAD_CAST strdup("");
-			for (i = 0; i < model->keys_count; i++) {
-				list_new_inter = list_new_tmp->children;
-				while (list_new_inter) {
-					if (xmlStrEqual(list_new_inter->name, BAD_CAST model->keys[i])) {
-						new_str = xmlNodeGetContent(list_new_inter);
-						aux_str  = realloc(new_keys, sizeof(xmlChar) * (xmlStrlen(new_keys)+xmlStrlen(new_str)+1));
-						if (aux_str == NULL) {
-							ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-							xmlFree(new_keys);
-							xmlFree(new_str);
-							return (XMLDIFF_ERR);
-						}
-						new_keys = aux_str;
-						strcat((char*)new_keys, (char*)new_str);
-						xmlFree(new_str);
-						break;
-					}
-					list_new_inter = list_new_inter->next;
-				}
+		list_new_tmp = xmlHashLookup(list_index, keys);
+		xmlFree(keys);
+		if (list_new_tmp != NULL && hint_index != NULL) {
+			/* the edit-config matches the instances by the trimmed key values */
+			if ((keys = list_node_keys(list_old_tmp, model, 1)) == NULL) {
+				ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+				xmlHashFree(list_index, NULL);
+				xmlHashFree(hint_index, NULL);
+				free(list_removed);
+				return (XMLDIFF_ERR);
 			}
-			if (strcmp((const char*)old_keys, (const char*)new_keys) == 0) { /* Matching item found */
-				xmlFree(new_keys);
-				break;
+			item_hint = xmlHashLookup(hint_index, keys);
+			xmlFree(keys);
+			if (item_hint == NULL) {
+				/* the instance is not touched by the edit */
+				list_old_tmp = list_old_tmp->next;
+				continue;
 			}
-			xmlFree(new_keys);
-			list_new_tmp = list_new_tmp->next;
+			item_hint = xmldiff_hint_scope(item_hint);
 		}
-		xmlFree(old_keys);
 
 		if (list_new_tmp == NULL) { /* Item NOT found in the new document -> removed */
 			xmldiff_add_diff_recursive(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_REM, XML_SIBLING, model);
@@ -756,6 +881,8 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 			/* Remember that the node was removed */
 			if ((realloc_tmp = realloc(list_removed, ++list_removed_cnt * sizeof(xmlNodePtr))) == NULL) {
 				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+				xmlHashFree(list_index, NULL);
+				xmlHashFree(hint_index, NULL);
 				free(list_removed);
 				return (XMLDIFF_ERR);
 			} else {
@@ -768,13 +895,19 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 			for (i = 0; i < model->children_count; i++) {
 				if (asprintf(&next_path, "%s/%s:%s", path, model->children[i].ns_prefix, model->children[i].name) == -1) {
 					ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+					xmlHashFree(list_index, NULL);
+					xmlHashFree(hint_index, NULL);
+					free(list_removed);
 					free(tmp_diff);
 					return (XMLDIFF_ERR);
 				}
-				tmp_op = xmldiff_recursive(tmp_diff, next_path, list_old_tmp->children, list_new_tmp->children, &model->children[i]);
+				tmp_op = xmldiff_recursive(tmp_diff, next_path, list_old_tmp->children, list_new_tmp->children, &model->children[i], item_hint);
 				free(next_path);
 
 				if (tmp_op == XMLDIFF_ERR) {
+					xmlHashFree(list_index, NULL);
+					xmlHashFree(hint_index, NULL);
+					free(list_removed);
 					free(tmp_diff);
 					return (XMLDIFF_ERR);
 				} else {
@@ -790,11 +923,7 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 				if (item_ret_op & (XMLDIFF_ADD | XMLDIFF_REM | XMLDIFF_MOD | XMLDIFF_REORDER | XMLDIFF_CHAIN)) {
 					ret_op |= XMLDIFF_CHAIN;
 				}
-				if (item_ret_op & XMLDIFF_REM) {
-					xmldiff_add_diff(tmp_diff, path, list_old_tmp, list_new_tmp, ret_op, XML_PARENT);
-				} else {
-					xmldiff_add_diff(tmp_diff, path, list_old_tmp, list_new_tmp, ret_op, XML_PARENT);
-				}
+				xmldiff_add_diff(tmp_diff, path, list_old_tmp, list_new_tmp, ret_op, XML_PARENT);
 				*tmp_diff = (*tmp_diff)->parent;
 				xmldiff_addsibling_diff(diff, tmp_diff);
 			}
@@ -802,8 +931,15 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 		}
 		list_old_tmp = list_old_tmp->next;
 	}
+	xmlHashFree(list_index, NULL);
+	list_index = NULL;
+	xmlHashFree(hint_index, NULL);
 
 	/* ---ADD--- Go through the new nodes and search for matching nodes in the old document */
+	if (new_tmp != NULL && (list_index = list_nodes_hash(old_tmp, new_tmp, model)) == NULL) {
+		free(list_removed);
+		return (XMLDIFF_ERR);
+	}
 	list_new_tmp = new_tmp;
 	while (list_new_tmp) {
 		if (node_cmp(new_tmp, list_new_tmp)) {
@@ -811,66 +947,16 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 			continue;
 		}
 
-		item_ret_op = XMLDIFF_NONE;
-		/* For every new node create string holding the concatenated key values */
-		new_keys = BAD_CAST strdup ("");
-		for (i = 0; i < model->keys_count; i++) { /* For every specified key */
-			list_new_inter = list_new_tmp->children;
-			while (list_new_inter) {
-				if (xmlStrEqual(list_new_inter->name, BAD_CAST model->keys[i])) { /* Find matching leaf in the old document */
-					new_str = xmlNodeGetContent(list_new_inter);
-					aux_str = realloc(new_keys, sizeof(xmlChar*) * (xmlStrlen(new_keys)+xmlStrlen(new_str)+1));
-					if (aux_str == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						xmlFree(new_keys);
-						xmlFree(new_str);
-						return (XMLDIFF_ERR);
-					}
-					new_keys = aux_str;
-					strcat((char*)new_keys, (char*)new_str); /* Concatenate key value */
-					xmlFree(new_str);
-					break;
-				}
-				list_new_inter = list_new_inter->next;
-			}
-		}
-		/* Go through the new list */
-		list_old_tmp = old_tmp;
-		while (list_old_tmp) {
-			if (node_cmp(new_tmp, list_old_tmp)) {
-				list_old_tmp = list_old_tmp->next;
-				continue;
-			}
-
-			old_keys = BAD_CAST strdup ("");
-			for (i = 0; i < model->keys_count; i++) {
-				list_old_inter = list_old_tmp->children;
-				while (list_old_inter) {
-					if (xmlStrEqual(list_old_inter->name, BAD_CAST model->keys[i])) {
-						old_str = xmlNodeGetContent(list_old_inter);
-						aux_str = realloc(old_keys, sizeof(xmlChar) * (xmlStrlen(old_keys)+xmlStrlen(old_str)+1));
-						if (aux_str == NULL) {
-							ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-							xmlFree(old_keys);
-							xmlFree(old_str);
-							return (XMLDIFF_ERR);
-						}
-						old_keys = aux_str;
-						strcat((char*)old_keys, (char*)old_str);
-						xmlFree(old_str);
-						break;
-					}
-					list_old_inter = list_old_inter->next;
-				}
-			}
-			if (strcmp((const char*)old_keys, (const char*)new_keys) == 0) { /* Matching item found */
-				free(old_keys);
-				break;
-			}
-			xmlFree(old_keys);
-			list_old_tmp = list_old_tmp->next;
+		/* For every new node get the concatenated key values and find the matching old node */
+		if ((keys = list_node_keys(list_new_tmp, model, 0)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			xmlHashFree(list_index, NULL);
+			free(list_added);
+			free(list_removed);
+			return (XMLDIFF_ERR);
 		}
-		xmlFree(new_keys);
+		list_old_tmp = xmlHashLookup(list_index, keys);
+		xmlFree(keys);
 
 		if (list_old_tmp == NULL) { /* Item NOT found in the old document -> added */
 			xmldiff_add_diff_recursive(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_ADD, XML_SIBLING, model);
@@ -878,7 +964,9 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 			/* Remember that the node was added */
 			if ((realloc_tmp = realloc(list_added, ++list_added_cnt * sizeof(xmlNodePtr))) == NULL) {
 				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+				xmlHashFree(list_index, NULL);
 				free(list_added);
+				free(list_removed);
 				return (XMLDIFF_ERR);
 			} else {
 				list_added = realloc_tmp;
@@ -889,6 +977,7 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 		}
 		list_new_tmp = list_new_tmp->next;
 	}
+	xmlHashFree(list_index, NULL);
 
 	/* list is ordered by user */
 	if (model->ordering == YIN_ORDER_USER) {
@@ -896,6 +985,8 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 		/* Go through old and new list and compare pairs */
 		list_old_tmp = old_tmp;
 		list_new_tmp = new_tmp;
+		/* removed and added nodes are remembered in the document order */
+		i = j = 0;
 
 		while (list_old_tmp && list_new_tmp) {
 			/* Nodes are not part of the list we are now processing */
@@ -909,23 +1000,15 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 			}
 
 			/* Wasn't the old node removed and that's why it isn't in the new config? */
-			for (i = 0; i < list_removed_cnt; ++i) {
-				if (list_old_tmp == list_removed[i]) {
-					break;
-				}
-			}
-			if (i != list_removed_cnt) {
+			if (i < list_removed_cnt && list_old_tmp == list_removed[i]) {
+				++i;
 				list_old_tmp = list_old_tmp->next;
 				continue;
 			}
 
 			/* Wasn't the new node added and that's why it isn't in the old config? */
-			for (i = 0; i < list_added_cnt; ++i) {
-				if (list_new_tmp == list_added[i]) {
-					break;
-				}
-			}
-			if (i != list_added_cnt) {
+			if (j < list_added_cnt && list_new_tmp == list_added[j]) {
+				++j;
 				list_new_tmp = list_new_tmp->next;
 				continue;
 			}
@@ -946,17 +1029,50 @@ static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodeP
 	return ret_op;
 }
 
+/*
+ * @brief Create hash table of the leaf-list instances (first and its siblings
+ * with the specified name) indexed by their values.
+ *
+ * @return Hash table, NULL in case of error.
+ */
+static xmlHashTablePtr leaflist_nodes_hash(xmlNodePtr first, const char* name)
+{
+	xmlHashTablePtr hash;
+	xmlNodePtr node;
+	xmlChar *value;
+
+	if ((hash = xmlHashCreate(0)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	for (node = first; node != NULL; node = node->next) {
+		if (!xmlStrEqual(BAD_CAST name, node->name)) {
+			continue;
+		}
+		value = xmlNodeGetContent(node);
+		xmlHashAddEntry(hash, (value != NULL) ? value : BAD_CAST "", node);
+		xmlFree(value);
+	}
+
+	return (hash);
+}
+
 static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model)
 {
 	XMLDIFF_OP ret_op = XMLDIFF_NONE;
 	char* list_name = strrchr(path, ':')+1;
 	xmlNodePtr* list_added = NULL, *list_removed = NULL, *realloc_tmp;
 	xmlNodePtr list_old_tmp, list_new_tmp;
+	xmlHashTablePtr list_index;
 	xmlChar* new_str, *old_str;
-	int i, list_added_cnt = 0, list_removed_cnt = 0;
+	int i, j, list_added_cnt = 0, list_removed_cnt = 0;
 
 	/* Search for matches, only _ADD and _REM will be here */
 	/* For each in the old node find one from the new nodes or log as _REM */
+	if ((list_index = leaflist_nodes_hash(new_tmp, list_name)) == NULL) {
+		return (XMLDIFF_ERR);
+	}
 	list_old_tmp = old_tmp;
 	while (list_old_tmp) {
 		if (!xmlStrEqual(BAD_CAST list_name, list_old_tmp->name)) {
@@ -964,21 +1080,8 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 			continue;
 		}
 		old_str = xmlNodeGetContent(list_old_tmp);
-		list_new_tmp = new_tmp;
-		while (list_new_tmp) {
-			if (!xmlStrEqual(BAD_CAST list_name, list_new_tmp->name)) {
-				list_new_tmp = list_new_tmp->next;
-				continue;
-			}
-			new_str = xmlNodeGetContent(list_new_tmp);
-			if (xmlStrEqual(old_str, new_str)) {
-				xmlFree(new_str);
-				/* Equivalent found */
-				break;
-			}
-			xmlFree(new_str);
-			list_new_tmp = list_new_tmp->next;
-		}
+		/* Equivalent found? */
+		list_new_tmp = xmlHashLookup(list_index, (old_str != NULL) ? old_str : BAD_CAST "");
 		xmlFree(old_str);
 		if (list_new_tmp == NULL) {
 			xmldiff_add_diff(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_REM, XML_SIBLING);
@@ -986,6 +1089,7 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 			/* Remember that the node was removed */
 			if ((realloc_tmp = realloc(list_removed, ++list_removed_cnt * sizeof(xmlNodePtr))) == NULL) {
 				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+				xmlHashFree(list_index, NULL);
 				free(list_removed);
 				return (XMLDIFF_ERR);
 			} else {
@@ -996,7 +1100,13 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 		list_old_tmp = list_old_tmp->next;
 	}
 
+	xmlHashFree(list_index, NULL);
+
 	/* For each in the new node find one from the old nodes or log as _ADD */
+	if ((list_index = leaflist_nodes_hash(old_tmp, list_name)) == NULL) {
+		free(list_removed);
+		return (XMLDIFF_ERR);
+	}
 	list_new_tmp = new_tmp;
 	while (list_new_tmp) {
 		if (!xmlStrEqual(BAD_CAST list_name, list_new_tmp->name)) {
@@ -1004,21 +1114,8 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 			continue;
 		}
 		new_str = xmlNodeGetContent(list_new_tmp);
-		list_old_tmp = old_tmp;
-		while (list_old_tmp) {
-			if (!xmlStrEqual(BAD_CAST list_name, list_old_tmp->name)) {
-				list_old_tmp = list_old_tmp->next;
-				continue;
-			}
-			old_str = xmlNodeGetContent(list_old_tmp);
-			if (xmlStrEqual(old_str, new_str)) {
-				xmlFree(old_str);
-				/* Equivalent found */
-				break;
-			}
-			xmlFree(old_str);
-			list_old_tmp = list_old_tmp->next;
-		}
+		/* Equivalent found? */
+		list_old_tmp = xmlHashLookup(list_index, (new_str != NULL) ? new_str : BAD_CAST "");
 		xmlFree(new_str);
 		if (list_old_tmp == NULL) {
 			xmldiff_add_diff(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_ADD, XML_SIBLING);
@@ -1026,7 +1123,9 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 			/* remeber that the node was added*/
 			if ((realloc_tmp = realloc(list_added, ++list_added_cnt * sizeof(xmlNodePtr))) == NULL) {
 				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+				xmlHashFree(list_index, NULL);
 				free(list_added);
+				free(list_removed);
 				return (XMLDIFF_ERR);
 			} else {
 				list_added = realloc_tmp;
@@ -1035,6 +1134,7 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 		}
 		list_new_tmp = list_new_tmp->next;
 	}
+	xmlHashFree(list_index, NULL);
 
 	/* leaf-list is ordered by user */
 	if (model->ordering == YIN_ORDER_USER) {
@@ -1042,6 +1142,8 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 		/* Go through old and new list and compare pairs */
 		list_old_tmp = old_tmp;
 		list_new_tmp = new_tmp;
+		/* removed and added nodes are remembered in the document order */
+		i = j = 0;
 
 		while (list_old_tmp && list_new_tmp) {
 			/* Nodes are not part of the leaf-list we are now processing */
@@ -1055,23 +1157,15 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 			}
 
 			/* Wasn't the old node removed and that's why it isn't in the new config? */
-			for (i = 0; i < list_removed_cnt; ++i) {
-				if (list_old_tmp == list_removed[i]) {
-					break;
-				}
-			}
-			if (i != list_removed_cnt) {
+			if (i < list_removed_cnt && list_old_tmp == list_removed[i]) {
+				++i;
 				list_old_tmp = list_old_tmp->next;
 				continue;
 			}
 
 			/* Wasn't the new node added and that's why it isn't in the old config? */
-			for (i = 0; i < list_added_cnt; ++i) {
-				if (list_new_tmp == list_added[i]) {
-					break;
-				}
-			}
-			if (i != list_added_cnt) {
+			if (j < list_added_cnt && list_new_tmp == list_added[j]) {
+				++j;
 				list_new_tmp = list_new_tmp->next;
 				continue;
 			}
@@ -1101,7 +1195,7 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
  *
  * @return xmldiff structure holding all differences between XML documents or NULL
  */
-XMLDIFF_OP xmldiff_diff(struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new, struct model_tree * model)
+XMLDIFF_OP xmldiff_diff(struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new, struct model_tree * model, xmlDocPtr edit)
 {
 	char* path;
 	XMLDIFF_OP ret_op = XMLDIFF_NONE;
@@ -1117,7 +1211,8 @@ XMLDIFF_OP xmldiff_diff(struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 			return (XMLDIFF_ERR);
 		}
-		ret_op = xmldiff_recursive(diff, path, old->children, new->children, &model->children[i]);
+		/* the document node is the parent of the edit's top-level elements */
+		ret_op = xmldiff_recursive(diff, path, old->children, new->children, &model->children[i], (xmlNodePtr)edit);
 		free(path);
 	}
 
@@ -97,10 +97,12 @@ void xmldiff_free (struct xmldiff_tree* diff);
  * @param old		old version of XML document
  * @param new		new version of XML document
  * @param model	data model in YANG format
+ * @param edit	edit-config content that made the new version from the old one,
+ *		only the subtrees it describes are compared. NULL to compare whole documents.
  *
  * @return xmldiff structure holding all differences between XML documents or NULL
  */
-XMLDIFF_OP xmldiff_diff (struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new, struct model_tree * model);
+XMLDIFF_OP xmldiff_diff (struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new, struct model_tree * model, xmlDocPtr edit);
 
 /**
  * @ingroup transapi
@@ -54,6 +54,7 @@
 #include <pwd.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <time.h>
 #include <arpa/inet.h>
 
 #ifdef HAVE_UTMPX_H
@@ -96,7 +97,13 @@ void parse_wdcap(struct nc_cpblts *capabilities, NCWD_MODE *basic, int *supporte
 /* definition in datastore.c */
 char** get_schemas_capabilities(struct nc_cpblts *cpblts);
 
+#ifndef DISABLE_URL
+/* definition in url.c */
+extern int nc_url_protocols;
+#endif
+
 extern struct nc_shared_info *nc_info;
+extern int nc_init_flags;
 
 static pthread_key_t transproto_key;
 static pthread_once_t transproto_key_once = PTHREAD_ONCE_INIT;
@@ -133,11 +140,177 @@ API int nc_session_transport(NC_TRANSPORT proto)
 	return (EXIT_SUCCESS);
 }
 
+/*
+ * Delay before starting the connection attempt to the next address while the
+ * previous attempts are still in progress (Connection Attempt Delay, RFC 8305)
+ */
+#define NC_CONNECT_ATTEMPT_DELAY 100
+
+/* milliseconds elapsed since the given time */
+static int transport_elapsed(const struct timespec* since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000);
+}
+
+static void transport_addr_str(const struct addrinfo* addr, char* buf, size_t size)
+{
+	char host[INET6_ADDRSTRLEN];
+
+	host[0] = '\0';
+	if (addr->ai_family == AF_INET6) {
+		inet_ntop(AF_INET6, &(((struct sockaddr_in6 *)addr->ai_addr)->sin6_addr), host, INET6_ADDRSTRLEN);
+		snprintf(buf, size, "[%s]:%u", host, ntohs(((struct sockaddr_in6 *)addr->ai_addr)->sin6_port));
+	} else {
+		inet_ntop(AF_INET, &(((struct sockaddr_in *)addr->ai_addr)->sin_addr), host, INET6_ADDRSTRLEN);
+		snprintf(buf, size, "%s:%u", host, ntohs(((struct sockaddr_in *)addr->ai_addr)->sin_port));
+	}
+}
+
+/*
+ * Order the addresses for the connection attempts - alternate the address
+ * families, starting with the family of the first address, and keep the
+ * original order otherwise.
+ */
+static void transport_addr_interleave(struct addrinfo** addrs, int count)
+{
+	struct addrinfo* aux;
+	int i, j;
+
+	for (i = 1; i < count; i++) {
+		if (addrs[i]->ai_family != addrs[i - 1]->ai_family) {
+			continue;
+		}
+		/* move here the next address of the other family */
+		for (j = i + 1; j < count && addrs[j]->ai_family == addrs[i - 1]->ai_family; j++);
+		if (j == count) {
+			break;
+		}
+		aux = addrs[j];
+		memmove(&addrs[i + 1], &addrs[i], (j - i) * sizeof(struct addrinfo*));
+		addrs[i] = aux;
+	}
+}
+
+/*
+ * Connect to the first of the addresses accepting the connection. The
+ * non-blocking connection attempts are started one after another with
+ * NC_CONNECT_ATTEMPT_DELAY between them (or immediately when the previous one
+ * fails) and they run concurrently, the first established connection wins and
+ * the others are aborted. The timeout (in milliseconds, -1 for infinite)
+ * limits the whole process.
+ *
+ * Returns the connected socket in the blocking mode or -1, the index of the
+ * connected address is returned in winner.
+ */
+static int transport_connect_race(struct addrinfo** addrs, int count, int timeout, int* winner)
+{
+	struct pollfd* fds;
+	int* index;
+	struct timespec start, last;
+	char addr_str[INET6_ADDRSTRLEN + 9];
+	int next = 0, pending = 0, failed = 0, sock = -1, wait, err, i, j;
+	socklen_t len;
+
+	if (count == 0) {
+		return (-1);
+	}
+	if ((fds = malloc(count * sizeof(struct pollfd))) == NULL || (index = malloc(count * sizeof(int))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(fds);
+		return (-1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (sock == -1 && (pending > 0 || next < count)) {
+		/* start the next attempt if the previous ones failed or are not quick enough */
+		if (next < count && (pending == 0 || failed || transport_elapsed(&last) >= NC_CONNECT_ATTEMPT_DELAY)) {
+			i = next++;
+			failed = 0;
+			clock_gettime(CLOCK_MONOTONIC, &last);
+			if ((fds[pending].fd = socket(addrs[i]->ai_family, addrs[i]->ai_socktype, addrs[i]->ai_protocol)) == -1) {
+				err = errno;
+			} else if (fcntl(fds[pending].fd, F_SETFL, fcntl(fds[pending].fd, F_GETFL) | O_NONBLOCK) == -1) {
+				err = errno;
+				close(fds[pending].fd);
+			} else if (connect(fds[pending].fd, addrs[i]->ai_addr, addrs[i]->ai_addrlen) == 0 || errno == EINPROGRESS) {
+				fds[pending].events = POLLOUT;
+				fds[pending].revents = 0;
+				index[pending++] = i;
+				continue;
+			} else {
+				err = errno;
+				close(fds[pending].fd);
+			}
+			transport_addr_str(addrs[i], addr_str, sizeof(addr_str));
+			VERB("Unable to connect to %s (%s).", addr_str, strerror(err));
+			failed = 1;
+			continue;
+		}
+
+		if (timeout >= 0 && (wait = timeout - transport_elapsed(&start)) <= 0) {
+			break;
+		}
+		if (next < count) {
+			i = NC_CONNECT_ATTEMPT_DELAY - transport_elapsed(&last);
+			wait = (timeout < 0 || i < wait) ? ((i > 0) ? i : 0) : wait;
+		} else if (timeout < 0) {
+			wait = -1;
+		}
+
+		if (poll(fds, pending, wait) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ERROR("poll() failed (%s).", strerror(errno));
+			break;
+		}
+
+		for (i = j = 0; i < pending; i++) {
+			if (fds[i].revents != 0 && sock == -1) {
+				len = sizeof(err);
+				if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1) {
+					err = errno;
+				}
+				if (err == 0) {
+					/* connected */
+					sock = fds[i].fd;
+					*winner = index[i];
+					continue;
+				}
+				transport_addr_str(addrs[index[i]], addr_str, sizeof(addr_str));
+				VERB("Unable to connect to %s (%s).", addr_str, strerror(err));
+				close(fds[i].fd);
+				failed = 1;
+				continue;
+			}
+			/* still in progress */
+			fds[j] = fds[i];
+			index[j++] = index[i];
+		}
+		pending = j;
+	}
+
+	/* abort the other attempts */
+	for (i = 0; i < pending; i++) {
+		close(fds[i].fd);
+	}
+	free(fds);
+	free(index);
+
+	if (sock != -1) {
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
+	}
+	return (sock);
+}
+
 int transport_connect_socket(const char* host, const char* port)
 {
 	int sock = -1;
-	int i;
-	struct addrinfo hints, *res_list, *res;
+	int i, count, winner;
+	struct addrinfo hints, *res_list, *res, **addrs;
 
 	/* Connect to a server */
 	memset(&hints, 0, sizeof hints);
@@ -150,29 +323,20 @@ int transport_connect_socket(const char* host, const char* port)
 		return (-1);
 	}
 
+	/* try all the addresses of both families concurrently */
+	for (count = 0, res = res_list; res != NULL; res = res->ai_next, count++);
+	if ((addrs = malloc(count * sizeof(struct addrinfo*))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		freeaddrinfo(res_list);
+		return (-1);
+	}
 	for (i = 0, res = res_list; res != NULL; res = res->ai_next) {
-		sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-		if (sock == -1) {
-			/* socket was not created, try another resource */
-			i = errno;
-			goto errloop;
-		}
-
-		if (connect(sock, res->ai_addr, res->ai_addrlen) == -1) {
-			/* network connection failed, try another resource */
-			i = errno;
-			close(sock);
-			sock = -1;
-			goto errloop;
-		}
-
-		/* we're done, network connection established */
-		break;
-errloop:
-		VERB("Unable to connect to %s:%s over %s (%s).", host, port,
-				(res->ai_family == AF_INET6) ? "IPv6" : "IPv4", strerror(i));
-		continue;
+		addrs[i++] = res;
 	}
+	transport_addr_interleave(addrs, count);
+
+	sock = transport_connect_race(addrs, count, -1, &winner);
+	free(addrs);
 	freeaddrinfo(res_list);
 
 	if (sock == -1) {
@@ -286,10 +450,11 @@ static char** nc_accept_server_cpblts(char ** server_cpblts_list, char ** client
 
 	c = 0;
 	for (i = 0; server_cpblts_list[i] != NULL; i++) {
-		if (strstr(server_cpblts_list[i], "urn:ietf:params:netconf:base:") == NULL) {
+		if (strstr(server_cpblts_list[i], "urn:ietf:params:netconf:base:") == NULL &&
+				strcmp(server_cpblts_list[i], NC_CAP_DEFLATE_ID) != 0) {
 			result[c++] = strdup(server_cpblts_list[i]);
 		} else {
-			/* some of the base capability detected - check that both sides support it */
+			/* some of the base capability or the message encoding detected - check that both sides support it */
 			for (j = 0; client_cpblts_list[j] != NULL; j++) {
 				if (strcmp(server_cpblts_list[i], client_cpblts_list[j]) == 0) {
 					result[c++] = strdup(server_cpblts_list[i]);
@@ -330,6 +495,7 @@ static char** nc_accept_server_cpblts(char ** server_cpblts_list, char ** client
 static nc_rpc* nc_msg_client_hello(char** cpblts)
 {
 	nc_rpc *msg;
+	xmlDocPtr doc;
 	xmlNodePtr node;
 	int i;
 	xmlNsPtr ns;
@@ -339,45 +505,28 @@ static nc_rpc* nc_msg_client_hello(char** cpblts)
 		return (NULL);
 	}
 
-	msg = calloc(1, sizeof(nc_rpc));
-	if (msg == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-		return (NULL);
-	}
-
-	msg->error = NULL;
-	msg->doc = xmlNewDoc(BAD_CAST "1.0");
-	msg->doc->encoding = xmlStrdup(BAD_CAST UTF8);
-	msg->msgid = NULL;
-	msg->with_defaults = NCWD_MODE_NOTSET;
-	msg->type.rpc = NC_RPC_HELLO;
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	doc->encoding = xmlStrdup(BAD_CAST UTF8);
 
 	/* create root element */
-	msg->doc->children = xmlNewDocNode(msg->doc, NULL, BAD_CAST NC_HELLO_MSG, NULL);
+	doc->children = xmlNewDocNode(doc, NULL, BAD_CAST NC_HELLO_MSG, NULL);
 
 	/* set namespace */
-	ns = xmlNewNs(msg->doc->children, (xmlChar *) NC_NS_BASE10, NULL);
-	xmlSetNs(msg->doc->children, ns);
+	ns = xmlNewNs(doc->children, (xmlChar *) NC_NS_BASE10, NULL);
+	xmlSetNs(doc->children, ns);
 
 	/* create capabilities node */
-	node = xmlNewChild(msg->doc->children, ns, BAD_CAST "capabilities", NULL);
+	node = xmlNewChild(doc->children, ns, BAD_CAST "capabilities", NULL);
 	for (i = 0; cpblts[i] != NULL; i++) {
 		xmlNewChild(node, ns, BAD_CAST "capability", BAD_CAST cpblts[i]);
 	}
 
-	/* create xpath evaluation context */
-	if ((msg->ctxt = xmlXPathNewContext(msg->doc)) == NULL) {
-		ERROR("%s: rpc message XPath context cannot be created.", __func__);
-		nc_msg_free(msg);
-		return NULL;
-	}
-
-	/* register base namespace for the rpc */
-	if (xmlXPathRegisterNs(msg->ctxt, BAD_CAST NC_NS_BASE10_ID, BAD_CAST NC_NS_BASE10) != 0) {
-		ERROR("Registering base namespace for the message xpath context failed.");
-		nc_msg_free(msg);
-		return NULL;
+	/* the message and its XPath context are prepared the same way as for the other messages */
+	if ((msg = nc_msg_new(doc)) == NULL) {
+		xmlFreeDoc(doc);
+		return (NULL);
 	}
+	msg->type.rpc = NC_RPC_HELLO;
 
 	return (msg);
 }
@@ -428,7 +577,11 @@ API void nc_hello_timeout(int timeout)
 
 #define HANDSHAKE_SIDE_SERVER 1
 #define HANDSHAKE_SIDE_CLIENT 2
-static int nc_handshake(struct nc_session *session, char** cpblts, nc_rpc *hello, int side)
+/*
+ * @brief Receive the other side's <hello> and negotiate the capabilities, our
+ * <hello> must be already sent.
+ */
+static int nc_handshake(struct nc_session *session, char** cpblts, int side)
 {
 	int retval = EXIT_SUCCESS;
 	int i;
@@ -436,10 +589,6 @@ static int nc_handshake(struct nc_session *session, char** cpblts, nc_rpc *hello
 	char **recv_cpblts = NULL, **merged_cpblts = NULL;
 	NC_MSG_TYPE reply = NC_MSG_UNKNOWN;
 
-	if (nc_session_send_rpc(session, hello) == 0) {
-		return (EXIT_FAILURE);
-	}
-
 #ifdef DISABLE_LIBSSH
 	if (side == HANDSHAKE_SIDE_CLIENT) {
 		recv_hello = read_hello_openssh(session);
@@ -471,6 +620,9 @@ static int nc_handshake(struct nc_session *session, char** cpblts, nc_rpc *hello
 		retval = EXIT_FAILURE;
 	} else if ((session->capabilities = nc_cpblts_new((const char* const*) merged_cpblts)) == NULL) {
 		retval = EXIT_FAILURE;
+	} else if (session->version == NETCONFV11 && nc_cpblts_enabled(session, NC_CAP_DEFLATE_ID)) {
+		/* compressed data are safe only in the chunked framing */
+		session->deflate = 1;
 	}
 
 	if (recv_cpblts) {
@@ -508,17 +660,300 @@ static int nc_client_handshake(struct nc_session *session, char** cpblts)
 		return (EXIT_FAILURE);
 	}
 
-	retval = nc_handshake(session, cpblts, hello, HANDSHAKE_SIDE_CLIENT);
+	if (nc_session_send_rpc(session, hello) == 0) {
+		nc_rpc_free(hello);
+		return (EXIT_FAILURE);
+	}
 	nc_rpc_free(hello);
 
+	retval = nc_handshake(session, cpblts, HANDSHAKE_SIDE_CLIENT);
+
 	return (retval);
 }
 
 extern int nc_session_is_monitored(const char* session_id);
 
-static int nc_server_handshake(struct nc_session *session, char** cpblts)
+/**
+ * @brief Server capabilities and the serialized server \<hello\> message.
+ *
+ * Computing the capabilities requires walking all the data models, so the
+ * result is shared by all the sessions accepted with the same settings and
+ * it is rebuilt only when the settings, models or their features change.
+ */
+struct server_hello {
+	unsigned int refs;
+	/* settings the capabilities were computed from */
+	char **source; /* capabilities passed to the accept function, NULL for the default ones */
+	int flags;
+	NCWD_MODE wd_basic;
+	int wd_supported;
+	int url;
+	unsigned int models;
+	/* shared result */
+	struct nc_cpblts *cpblts;
+	NCWD_MODE wd_cap_basic;
+	int wd_cap_modes;
+	char *text; /* serialized <hello> without the session ID */
+	size_t len;
+	size_t split; /* position of the session ID in the text */
+};
+
+static struct server_hello *server_hello = NULL;
+static pthread_mutex_t server_hello_mut = PTHREAD_MUTEX_INITIALIZER;
+
+static struct nc_cpblts* server_cpblts_build(const struct nc_cpblts* capabilities)
 {
-	nc_rpc *hello;
+	struct nc_cpblts *server_cpblts = NULL;
+	char *wdc, *wdc_aux;
+#ifndef DISABLE_URL
+	char *straux;
+#endif
+	char list[255];
+	NCWD_MODE mode;
+	char** nslist;
+	int i, r;
+
+	if (capabilities == NULL) {
+		if ((server_cpblts = nc_session_get_cpblts_default()) == NULL) {
+			return (NULL);
+		}
+	} else if ((server_cpblts = nc_cpblts_new((const char* const*)(capabilities->list))) == NULL) {
+		return (NULL);
+	}
+	/* set with-defaults capability announcement */
+	if ((nc_cpblts_get(server_cpblts, NC_CAP_WITHDEFAULTS_ID) != NULL)
+         && ((mode = ncdflt_get_basic_mode()) != NCWD_MODE_NOTSET)) {
+		switch(mode) {
+		case NCWD_MODE_ALL:
+			wdc_aux = "?basic-mode=report-all";
+			break;
+		case NCWD_MODE_TRIM:
+			wdc_aux = "?basic-mode=trim";
+			break;
+		case NCWD_MODE_EXPLICIT:
+			wdc_aux = "?basic-mode=explicit";
+			break;
+		default:
+			wdc_aux = NULL;
+			break;
+		}
+		if (wdc_aux != NULL) {
+			mode = ncdflt_get_supported();
+			list[0] = 0;
+			if ((mode & NCWD_MODE_ALL) != 0) {
+				strcat(list, ",report-all");
+			}
+			if ((mode & NCWD_MODE_ALL_TAGGED) != 0) {
+				strcat(list, ",report-all-tagged");
+			}
+			if ((mode & NCWD_MODE_TRIM) != 0) {
+				strcat(list, ",trim");
+			}
+			if ((mode & NCWD_MODE_EXPLICIT) != 0) {
+				strcat(list, ",explicit");
+			}
+
+			if (strnonempty(list)) {
+				list[0] = '='; /* replace initial comma */
+				r = asprintf(&wdc, "urn:ietf:params:netconf:capability:with-defaults:1.0%s&amp;also-supported%s", wdc_aux, list);
+			} else {
+				/* no also-supported */
+				r = asprintf(&wdc, "urn:ietf:params:netconf:capability:with-defaults:1.0%s", wdc_aux);
+			}
+
+			if (r != -1) {
+				/* add/update capabilities list */
+				nc_cpblts_add(server_cpblts, wdc);
+				free(wdc);
+			} else {
+				WARN("asprintf() failed - with-defaults capability parameters may not be set properly (%s:%d).", __FILE__, __LINE__);
+			}
+		}
+	}
+
+#ifndef DISABLE_URL
+	if (nc_cpblts_get(server_cpblts, NC_CAP_URL_ID) != NULL) {
+		/* update URL capability with enabled protocols */
+		straux = nc_url_gencap();
+		nc_cpblts_add(server_cpblts, straux);
+		free(straux);
+	}
+#endif
+
+	/*
+	 * add namespaces of used datastores as announced capabilities, the
+	 * default capabilities already contain them
+	 */
+	if (capabilities != NULL && (nslist = get_schemas_capabilities(server_cpblts)) != NULL) {
+		for(i = 0; nslist[i] != NULL; i++) {
+			nc_cpblts_add(server_cpblts, nslist[i]);
+			free(nslist[i]);
+		}
+		free(nslist);
+	}
+
+	return (server_cpblts);
+}
+
+static void server_hello_free(struct server_hello *hello)
+{
+	int i;
+
+	if (hello == NULL) {
+		return;
+	}
+
+	if (hello->source != NULL) {
+		for (i = 0; hello->source[i] != NULL; i++) {
+			free(hello->source[i]);
+		}
+		free(hello->source);
+	}
+	nc_cpblts_free(hello->cpblts);
+	free(hello->text);
+	free(hello);
+}
+
+static int server_hello_matches(const struct server_hello *hello, const struct server_hello *settings, const struct nc_cpblts* capabilities)
+{
+	int i;
+
+	if (hello->flags != settings->flags || hello->wd_basic != settings->wd_basic ||
+			hello->wd_supported != settings->wd_supported || hello->url != settings->url ||
+			hello->models != settings->models) {
+		return (0);
+	}
+
+	if (capabilities == NULL || hello->source == NULL) {
+		return (capabilities == NULL && hello->source == NULL);
+	}
+
+	for (i = 0; i < capabilities->items && hello->source[i] != NULL; i++) {
+		if (strcmp(capabilities->list[i], hello->source[i]) != 0) {
+			return (0);
+		}
+	}
+
+	return (i == capabilities->items && hello->source[i] == NULL);
+}
+
+/**
+ * @brief Get the server capabilities and \<hello\> for a new session.
+ *
+ * @param[in] capabilities Capabilities requested by the application, NULL for the default ones.
+ * @return Shared structure to release by server_hello_put(), NULL on error.
+ */
+static struct server_hello* server_hello_get(const struct nc_cpblts* capabilities)
+{
+	struct server_hello settings, *hello;
+	nc_rpc *msg;
+	xmlChar *text;
+	char *sid;
+	int len, i;
+
+	memset(&settings, 0, sizeof settings);
+	settings.flags = nc_init_flags;
+	settings.wd_basic = ncdflt_get_basic_mode();
+	settings.wd_supported = ncdflt_get_supported();
+#ifndef DISABLE_URL
+	settings.url = nc_url_protocols;
+#endif
+	settings.models = ncds_models_version();
+
+	pthread_mutex_lock(&server_hello_mut);
+	if (server_hello != NULL && server_hello_matches(server_hello, &settings, capabilities)) {
+		server_hello->refs++;
+		pthread_mutex_unlock(&server_hello_mut);
+		return (server_hello);
+	}
+
+	/* settings changed, prepare the new capabilities */
+	if ((hello = malloc(sizeof(struct server_hello))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		pthread_mutex_unlock(&server_hello_mut);
+		return (NULL);
+	}
+	*hello = settings;
+	if (capabilities != NULL) {
+		hello->source = malloc((capabilities->items + 1) * sizeof(char*));
+		if (hello->source == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			goto error;
+		}
+		for (i = 0; i < capabilities->items; i++) {
+			hello->source[i] = strdup(capabilities->list[i]);
+		}
+		hello->source[i] = NULL;
+	}
+	if ((hello->cpblts = server_cpblts_build(capabilities)) == NULL) {
+		VERB("Unable to set the client's NETCONF capabilities.");
+		goto error;
+	}
+
+	/* with-defaults capability flags */
+	parse_wdcap(hello->cpblts, &(hello->wd_cap_basic), &(hello->wd_cap_modes));
+
+	/* serialize the <hello> with a placeholder for the session ID */
+	if ((msg = nc_msg_server_hello(hello->cpblts->list, "0")) == NULL) {
+		goto error;
+	}
+	xmlDocDumpFormatMemory(msg->doc, &text, &len, NC_CONTENT_FORMATTED);
+	nc_rpc_free(msg);
+	if (text == NULL || (sid = strstr((char*) text, "<session-id>0</session-id>")) == NULL) {
+		ERROR("%s: serializing the server <hello> failed.", __func__);
+		xmlFree(text);
+		goto error;
+	}
+	hello->split = (sid - (char*) text) + strlen("<session-id>");
+	if ((hello->text = malloc(len)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		xmlFree(text);
+		goto error;
+	}
+	memcpy(hello->text, text, hello->split);
+	memcpy(hello->text + hello->split, text + hello->split + 1, len - hello->split - 1);
+	hello->len = len - 1;
+	xmlFree(text);
+
+	/* replace the previous one, it is freed when the last session stops using it */
+	if (server_hello != NULL && --server_hello->refs == 0) {
+		server_hello_free(server_hello);
+	}
+	server_hello = hello;
+	hello->refs = 2;
+	pthread_mutex_unlock(&server_hello_mut);
+
+	return (hello);
+
+error:
+	pthread_mutex_unlock(&server_hello_mut);
+	server_hello_free(hello);
+	return (NULL);
+}
+
+static void server_hello_put(struct server_hello *hello)
+{
+	pthread_mutex_lock(&server_hello_mut);
+	if (--hello->refs == 0) {
+		server_hello_free(hello);
+	}
+	pthread_mutex_unlock(&server_hello_mut);
+}
+
+void nc_server_hello_cleanup(void)
+{
+	pthread_mutex_lock(&server_hello_mut);
+	if (server_hello != NULL && --server_hello->refs == 0) {
+		server_hello_free(server_hello);
+	}
+	server_hello = NULL;
+	pthread_mutex_unlock(&server_hello_mut);
+}
+
+static int nc_server_handshake(struct nc_session *session, const struct server_hello* hello)
+{
+	char *text;
+	size_t sid_len;
 	int retval;
 
 	/* set session ID */
@@ -533,20 +968,24 @@ static int nc_server_handshake(struct nc_session *session, char** cpblts)
 	} while (nc_session_is_monitored(session->session_id));
 	pthread_rwlock_unlock(&(nc_info->lock));
 
-	/* create server's <hello> message */
-	hello = nc_msg_server_hello(cpblts, session->session_id);
-	if (hello == NULL) {
+	/* complete the prepared server's <hello> message with the session ID */
+	sid_len = strlen(session->session_id);
+	if ((text = malloc(hello->len + sid_len)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
 		return (EXIT_FAILURE);
 	}
+	memcpy(text, hello->text, hello->split);
+	memcpy(text + hello->split, session->session_id, sid_len);
+	memcpy(text + hello->split + sid_len, hello->text + hello->split, hello->len - hello->split);
 
-	retval = nc_handshake(session, cpblts, hello, HANDSHAKE_SIDE_SERVER);
-	nc_rpc_free(hello);
+	if ((retval = nc_session_send_text(session, text, hello->len + sid_len)) == EXIT_SUCCESS) {
+		retval = nc_handshake(session, hello->cpblts->list, HANDSHAKE_SIDE_SERVER);
+	}
+	free(text);
 
 	if (retval != EXIT_SUCCESS) {
 		if (nc_info) {
-			pthread_rwlock_wrlock(&(nc_info->lock));
-			nc_info->stats.bad_hellos++;
-			pthread_rwlock_unlock(&(nc_info->lock));
+			NC_STAT_INC(nc_info->stats.bad_hellos);
 		}
 	}
 
@@ -598,7 +1037,8 @@ API struct nc_session* nc_session_connect_inout(int fd_in, int fd_out, const str
 			(r = pthread_mutex_init(&(retval->mut_mqueue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_equeue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_ntf), &mattr)) != 0 ||
-			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0) {
+			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0 ||
+			(r = pthread_cond_init(&(retval->cond_channel), NULL)) != 0) {
 		ERROR("Mutex initialization failed (%s).", strerror(r));
 		pthread_mutexattr_destroy(&mattr);
 		goto error_cleanup;
@@ -642,6 +1082,7 @@ error_cleanup:
 		pthread_mutex_destroy(&(retval->mut_equeue));
 		pthread_mutex_destroy(&(retval->mut_ntf));
 		pthread_mutex_destroy(&(retval->mut_session));
+		pthread_cond_destroy(&(retval->cond_channel));
 
 		free(retval);
 	}
@@ -801,16 +1242,123 @@ shutdown:
 
 #endif /* not DISABLE_LIBSSH */
 
+/*
+ * Pool of the client's SSH connections used by nc_session_connect_pooled().
+ * The "username@host:port" key refers to one of the NETCONF sessions using
+ * the SSH connection, the others are linked with it (see
+ * nc_session_connect_channel()). The lock is held also while a pooled session
+ * is being closed, so the links of the sessions are not changed meanwhile.
+ */
+static xmlHashTablePtr session_pool = NULL;
+static pthread_mutex_t session_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+API struct nc_session* nc_session_connect_pooled(const char* host, unsigned short port, const char* username, const struct nc_cpblts* cpblts)
+{
+#ifdef DISABLE_LIBSSH
+	/* the SSH connection is made by the external ssh(1) for each session */
+	return (nc_session_connect(host, port, username, cpblts));
+#else
+	struct nc_session *retval = NULL, *master;
+	char* key;
+#ifdef ENABLE_TLS
+	NC_TRANSPORT *transport_proto;
+
+	pthread_once(&transproto_key_once, transproto_init);
+	transport_proto = pthread_getspecific(transproto_key);
+	if (transport_proto != NULL && *transport_proto == NC_TRANSPORT_TLS) {
+		/* nothing to multiplex */
+		return (nc_session_connect(host, port, username, cpblts));
+	}
+#endif
+
+	/* the same defaults as nc_session_connect() uses */
+	if (host == NULL || strisempty(host)) {
+		host = "localhost";
+	}
+	if (port == 0) {
+		port = NC_PORT;
+	}
+	if (asprintf(&key, "%s@%s:%u", (username == NULL) ? "" : username, host, port) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	pthread_mutex_lock(&session_pool_lock);
+	if (session_pool != NULL && (master = xmlHashLookup(session_pool, BAD_CAST key)) != NULL) {
+		/* the key exchange and the authentication were already done */
+		if ((retval = nc_session_connect_channel(master, cpblts)) != NULL) {
+			retval->pool_key = key;
+			pthread_mutex_unlock(&session_pool_lock);
+			return (retval);
+		}
+		/* e.g. the server's limit of the channels per connection was reached */
+		VERB("Unable to open another channel on the SSH connection to %s, connecting again.", host);
+	}
+	pthread_mutex_unlock(&session_pool_lock);
+
+	if ((retval = nc_session_connect(host, port, username, cpblts)) == NULL) {
+		free(key);
+		return (NULL);
+	}
+
+	/* the new connection is used for the next sessions to the host */
+	pthread_mutex_lock(&session_pool_lock);
+	if (session_pool == NULL && (session_pool = xmlHashCreate(64)) == NULL) {
+		ERROR("Creating the pool of the SSH connections failed (%s:%d).", __FILE__, __LINE__);
+	} else if (xmlHashUpdateEntry(session_pool, BAD_CAST key, retval, NULL) == 0) {
+		retval->pool_key = key;
+		key = NULL;
+	}
+	pthread_mutex_unlock(&session_pool_lock);
+	free(key);
+
+	return (retval);
+#endif
+}
+
+int nc_session_pool_leave(struct nc_session* session)
+{
+	struct nc_session *other;
+
+	if (session->pool_key == NULL) {
+		return (0);
+	}
+
+	pthread_mutex_lock(&session_pool_lock);
+	if (session_pool != NULL && xmlHashLookup(session_pool, BAD_CAST session->pool_key) == session) {
+		/* keep the SSH connection in the pool if another session uses it */
+		if ((other = (session->next != NULL) ? session->next : session->prev) != NULL) {
+			xmlHashUpdateEntry(session_pool, BAD_CAST session->pool_key, other, NULL);
+		} else {
+			xmlHashRemoveEntry(session_pool, BAD_CAST session->pool_key, NULL);
+		}
+	}
+	free(session->pool_key);
+	session->pool_key = NULL;
+
+	return (1);
+}
+
+void nc_session_pool_release(void)
+{
+	pthread_mutex_unlock(&session_pool_lock);
+}
+
+void nc_session_pool_cleanup(void)
+{
+	pthread_mutex_lock(&session_pool_lock);
+	xmlHashFree(session_pool, NULL);
+	session_pool = NULL;
+	pthread_mutex_unlock(&session_pool_lock);
+}
+
 struct nc_session* _nc_session_accept(const struct nc_cpblts* capabilities, const char* username, int input, int output, void* ssh_chan, void* tls_sess)
 {
-	int r, i;
+	int r;
 	struct nc_session *retval = NULL;
-	struct nc_cpblts *server_cpblts = NULL;
+	struct server_hello *hello;
 	struct passwd *pw;
-	char *wdc, *wdc_aux, *straux;
-	char list[255];
-	NCWD_MODE mode;
-	char** nslist;
+	char *straux;
 	pthread_mutexattr_t mattr;
 #ifdef HAVE_UTMPX_H
 	struct utmpx protox, *utp;
@@ -871,7 +1419,8 @@ struct nc_session* _nc_session_accept(const struct nc_cpblts* capabilities, cons
 			(r = pthread_mutex_init(&(retval->mut_mqueue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_equeue), &mattr)) != 0 ||
 			(r = pthread_mutex_init(&(retval->mut_ntf), &mattr)) != 0 ||
-			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0) {
+			(r = pthread_mutex_init(&(retval->mut_session), &mattr)) != 0 ||
+			(r = pthread_cond_init(&(retval->cond_channel), NULL)) != 0) {
 		ERROR("Mutex initialization failed (%s).", strerror(r));
 		pthread_mutexattr_destroy(&mattr);
 		return (NULL);
@@ -888,90 +1437,17 @@ struct nc_session* _nc_session_accept(const struct nc_cpblts* capabilities, cons
 		retval->nacm_recovery = 0;
 	}
 
-	if (capabilities == NULL) {
-		if ((server_cpblts = nc_session_get_cpblts_default()) == NULL) {
-			VERB("Unable to set the client's NETCONF capabilities.");
-			nc_session_close(retval, NC_SESSION_TERM_OTHER);
-			return (NULL);
-		}
-	} else {
-		server_cpblts = nc_cpblts_new((const char* const*)(capabilities->list));
-	}
-	/* set with-defaults capability announcement */
-	if ((nc_cpblts_get(server_cpblts, NC_CAP_WITHDEFAULTS_ID) != NULL)
-         && ((mode = ncdflt_get_basic_mode()) != NCWD_MODE_NOTSET)) {
-		switch(mode) {
-		case NCWD_MODE_ALL:
-			wdc_aux = "?basic-mode=report-all";
-			break;
-		case NCWD_MODE_TRIM:
-			wdc_aux = "?basic-mode=trim";
-			break;
-		case NCWD_MODE_EXPLICIT:
-			wdc_aux = "?basic-mode=explicit";
-			break;
-		default:
-			wdc_aux = NULL;
-			break;
-		}
-		if (wdc_aux != NULL) {
-			mode = ncdflt_get_supported();
-			list[0] = 0;
-			if ((mode & NCWD_MODE_ALL) != 0) {
-				strcat(list, ",report-all");
-			}
-			if ((mode & NCWD_MODE_ALL_TAGGED) != 0) {
-				strcat(list, ",report-all-tagged");
-			}
-			if ((mode & NCWD_MODE_TRIM) != 0) {
-				strcat(list, ",trim");
-			}
-			if ((mode & NCWD_MODE_EXPLICIT) != 0) {
-				strcat(list, ",explicit");
-			}
-
-			if (strnonempty(list)) {
-				list[0] = '='; /* replace initial comma */
-				r = asprintf(&wdc, "urn:ietf:params:netconf:capability:with-defaults:1.0%s&amp;also-supported%s", wdc_aux, list);
-			} else {
-				/* no also-supported */
-				r = asprintf(&wdc, "urn:ietf:params:netconf:capability:with-defaults:1.0%s", wdc_aux);
-			}
-
-			if (r != -1) {
-				/* add/update capabilities list */
-				nc_cpblts_add(server_cpblts, wdc);
-				free(wdc);
-			} else {
-				WARN("asprintf() failed - with-defaults capability parameters may not be set properly (%s:%d).", __FILE__, __LINE__);
-			}
-		}
-	}
-
-#ifndef DISABLE_URL
-	if (nc_cpblts_get(server_cpblts, NC_CAP_URL_ID) != NULL) {
-		/* update URL capability with enabled protocols */
-		straux = nc_url_gencap();
-		nc_cpblts_add(server_cpblts, straux);
-		free(straux);
+	if ((hello = server_hello_get(capabilities)) == NULL) {
+		nc_session_close(retval, NC_SESSION_TERM_OTHER);
+		return (NULL);
 	}
-#endif
 
 	retval->status = NC_SESSION_STATUS_WORKING;
 
-	/* add namespaces of used datastores as announced capabilities */
-	if ((nslist = get_schemas_capabilities(server_cpblts)) != NULL) {
-		for(i = 0; nslist[i] != NULL; i++) {
-			nc_cpblts_add(server_cpblts, nslist[i]);
-			free(nslist[i]);
-		}
-		free(nslist);
-	}
-
-	if (nc_server_handshake(retval, server_cpblts->list) != 0) {
+	if (nc_server_handshake(retval, hello) != 0) {
 		nc_session_close(retval, NC_SESSION_TERM_BADHELLO);
 		nc_session_free(retval);
-		nc_cpblts_free(server_cpblts);
+		server_hello_put(hello);
 		return (NULL);
 	}
 
@@ -1018,11 +1494,15 @@ struct nc_session* _nc_session_accept(const struct nc_cpblts* capabilities, cons
 #endif
 	}
 
-	/* set with-defaults capability flags */
-	parse_wdcap(retval->capabilities, &(retval->wd_basic), &(retval->wd_modes));
+	/*
+	 * set with-defaults capability flags, the capability is always taken from
+	 * the server's list
+	 */
+	retval->wd_basic = hello->wd_cap_basic;
+	retval->wd_modes = hello->wd_cap_modes;
 
 	/* cleanup */
-	nc_cpblts_free(server_cpblts);
+	server_hello_put(hello);
 
 #ifndef DISABLE_NOTIFICATIONS
 	/* log start of the session */
@@ -1031,9 +1511,7 @@ struct nc_session* _nc_session_accept(const struct nc_cpblts* capabilities, cons
 
 	retval->logintime = nc_time2datetime(time(NULL), NULL);
 	if (nc_info) {
-		pthread_rwlock_wrlock(&(nc_info->lock));
-		nc_info->stats.sessions_in++;
-		pthread_rwlock_unlock(&(nc_info->lock));
+		NC_STAT_INC(nc_info->stats.sessions_in);
 	}
 
 	if (pw) {
@@ -1209,13 +1687,12 @@ API int nc_callhome_listen_stop(void)
 
 API int nc_callhome_connect(struct nc_mngmt_server *host_list, uint8_t reconnect_secs, uint8_t reconnect_count, const char* server_path, char *const argv[], int *com_socket)
 {
-	struct nc_mngmt_server *srv_iter;
-	struct addrinfo *addr;
-	void *addr_p;
-	char addr_buf[INET6_ADDRSTRLEN];
-	unsigned short port;
-	int sock, sock6, sock4;
-	int i;
+	struct nc_mngmt_server *srv_iter, **srvs;
+	struct addrinfo *addr, **addrs;
+	struct timespec round_start, delay;
+	char addr_buf[INET6_ADDRSTRLEN + 9];
+	int sock, count, winner, ring;
+	int i, j;
 	int pid = -1;
 	char* const *server_argv;
 	char* const sshd_argv[] = {"/usr/sbin/sshd", "-ddd", "-i", NULL};
@@ -1244,19 +1721,34 @@ API int nc_callhome_connect(struct nc_mngmt_server *host_list, uint8_t reconnect
 	}
 	VERB("Call home using \'%s\' server.", server_path);
 
-	/* prepare a socket */
-	if ((sock4 = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
-		ERROR("%s: creating IPv4 socket failed (%s)", __func__, strerror(errno));
-		WARN("%s: IPv4 connection to management servers will not be available.", __func__);
+	/* collect the addresses of all the management servers */
+	for (count = 0, srv_iter = host_list; srv_iter != NULL; srv_iter = (srv_iter->next == host_list) ? NULL : srv_iter->next) {
+		for (addr = srv_iter->addr; addr != NULL; addr = addr->ai_next, count++);
 	}
-	if ((sock6 = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP)) == -1) {
-		ERROR("%s: creating IPv6 socket failed (%s)", __func__, strerror(errno));
-		WARN("%s: IPv6 connection to management servers will not be available.", __func__);
+	if (count == 0) {
+		ERROR("%s: No management server to connect to.", __func__);
+		return (-1);
 	}
-	if (sock4 == -1 && sock6 == -1) {
-		ERROR("%s: Unable to connect to any management server, creating sockets failed.", __func__);
+	addrs = malloc(count * sizeof(struct addrinfo*));
+	srvs = malloc(count * sizeof(struct nc_mngmt_server*));
+	if (addrs == NULL || srvs == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(addrs);
+		free(srvs);
 		return (-1);
 	}
+	/* keep the order of the servers, but alternate the families of each server */
+	for (i = 0, srv_iter = host_list; srv_iter != NULL; srv_iter = (srv_iter->next == host_list) ? NULL : srv_iter->next) {
+		for (j = i, addr = srv_iter->addr; addr != NULL; addr = addr->ai_next, i++) {
+			addrs[i] = addr;
+		}
+		transport_addr_interleave(&addrs[j], i - j);
+		for (; j < i; j++) {
+			srvs[j] = srv_iter;
+		}
+	}
+	/* since host_list is supposed to be ring list, this is potentially never ending loop */
+	ring = (host_list->next != NULL);
 
 	/* remove active flag from the last connected management server information */
 	srv_iter = nc_callhome_mngmt_server_getactive(host_list);
@@ -1264,55 +1756,34 @@ API int nc_callhome_connect(struct nc_mngmt_server *host_list, uint8_t reconnect
 		srv_iter->active = 0;
 	}
 
-	/* since host_list is supposed to be ring list, this is potentially never ending loop */
-	for (srv_iter = host_list; srv_iter != NULL; srv_iter = srv_iter->next) {
-		for (addr = srv_iter->addr; addr != NULL; addr = addr->ai_next) {
-			switch (addr->ai_family) {
-			case AF_INET:
-				if (sock4 == -1) {
-					continue;
-				} else {
-					sock = sock4;
-					addr_p = &(((struct sockaddr_in *)addr->ai_addr)->sin_addr);
-					port = ntohs(((struct sockaddr_in *)addr->ai_addr)->sin_port);
-				}
-				break;
-			case AF_INET6:
-				if (sock6 == -1) {
-					continue;
-				} else {
-					sock = sock6;
-					addr_p = &(((struct sockaddr_in6 *)addr->ai_addr)->sin6_addr);
-					port = ntohs(((struct sockaddr_in6 *)addr->ai_addr)->sin6_port);
-				}
-				break;
-			default:
-				continue;
-			}
-
-			inet_ntop(addr->ai_family, addr_p, addr_buf, INET6_ADDRSTRLEN);
-			for (i = 0; i < reconnect_count; i++) {
-				if (connect(sock, addr->ai_addr, addr->ai_addrlen) == -1) {
-					WARN("Connecting to %s:%u failed (%s)", addr_buf, port, strerror(errno));
-					sleep(reconnect_secs);
-					continue;
-				}
-				VERB("Connected to %s:%u.", addr_buf, port);
-				/* close unused socket */
-				if (sock == sock4) {
-					close(sock6);
-				} else {
-					close(sock4);
-				}
-
-				/* go to start SSH daemon */
-				goto connected;
-			}
+	/*
+	 * each round tries all the servers concurrently and the first connection
+	 * established wins, the rounds are reconnect_secs long
+	 */
+	for (i = 0; ring || i < reconnect_count; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &round_start);
+		sock = transport_connect_race(addrs, count, reconnect_secs ? reconnect_secs * 1000 : -1, &winner);
+		if (sock != -1) {
+			srv_iter = srvs[winner];
+			transport_addr_str(addrs[winner], addr_buf, sizeof(addr_buf));
+			VERB("Connected to %s.", addr_buf);
+			free(addrs);
+			free(srvs);
+
+			/* go to start SSH daemon */
+			goto connected;
+		}
+		WARN("Connecting to the management servers failed.");
+		if ((j = reconnect_secs * 1000 - transport_elapsed(&round_start)) > 0) {
+			/* all the attempts failed quickly, keep the reconnection interval */
+			delay.tv_sec = j / 1000;
+			delay.tv_nsec = (j % 1000) * 1000000L;
+			nanosleep(&delay, NULL);
 		}
 	}
 
-	close(sock4);
-	close(sock6);
+	free(addrs);
+	free(srvs);
 	return(-1);
 
 connected:
@@ -135,6 +135,37 @@ struct nc_session *nc_session_connect_libssh_sess(const char *host, unsigned sho
  */
 struct nc_session *nc_session_connect_channel(struct nc_session *session, const struct nc_cpblts* cpblts);
 
+/**
+ * @ingroup session
+ * @brief Connect to the NETCONF server reusing the SSH connection of another
+ * session to the same server, if any.
+ *
+ * The parameters are the same as for nc_session_connect(). If there is a
+ * session created by this function to the same host and port as the same user
+ * and still working, the new NETCONF session is created on another SSH channel
+ * of its SSH connection (see nc_session_connect_channel()), so the key exchange
+ * and the authentication are done only once per server. Otherwise, or if the
+ * server refuses another channel, a new SSH connection is established and used
+ * for the following sessions. The SSH connection is closed with the last
+ * session using it.
+ *
+ * If libnetconf is compiled without libssh or the TLS transport is used, the
+ * function is equal to nc_session_connect().
+ *
+ * This function IS thread safe.
+ *
+ * @param[in] host Hostname or address (both Ipv4 and IPv6 are accepted). 'localhost'
+ * is used by default if NULL is specified.
+ * @param[in] port Port number of the server. Default value 830 is used if 0 is
+ * specified.
+ * @param[in] username Name of the user to login to the server. The user running the
+ * application (detected from the effective UID) is used if NULL is specified.
+ * @param[in] cpblts NETCONF capabilities structure with capabilities supported
+ * by the client, NULL for the default ones.
+ * @return Structure describing the NETCONF session or NULL in case of an error.
+ */
+struct nc_session *nc_session_connect_pooled(const char *host, unsigned short port, const char *username, const struct nc_cpblts* cpblts);
+
 /**
  * @ingroup session
  * @brief Create NETCONF session communicating via given file descriptors. This
@@ -44,8 +44,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <libxml/xmlsave.h>
 #include <libxml/xmlstring.h>
 
 #include "url_internal.h"
@@ -58,7 +60,8 @@
 #define INIT_FLAGS CURL_GLOBAL_SSL
 #endif
 
-int url_tmpfile;
+/* size of the buffer between the XML serializer and curl when uploading a document */
+#define NC_URL_STREAM_BUFSIZE 65536
 
 /* Struct for uploading data with curl */
 struct nc_url_mem
@@ -67,6 +70,27 @@ struct nc_url_mem
 	size_t size;
 };
 
+/* Struct for streaming a document serialization into curl */
+struct nc_url_stream
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	xmlDocPtr doc;
+	char buffer[NC_URL_STREAM_BUFSIZE];
+	size_t len;
+	int done; /* serializer finished */
+	int aborted; /* curl does not read any more */
+	int error; /* serialization failed */
+};
+
+/* Struct for parsing the downloaded data with curl */
+struct nc_url_parser
+{
+	xmlParserCtxtPtr ctxt;
+	const char *url;
+	size_t received;
+};
+
 // default allowed protocols
 int nc_url_protocols = NC_URL_FILE | NC_URL_SCP;
 
@@ -203,8 +227,9 @@ int nc_url_upload(char *data, const char *url, struct nc_err **e)
 	/* check that the content follows RFC */
 	doc = xmlParseMemory(data, strlen(data));
 	root_element = xmlDocGetRootElement(doc);
-	if (strcmp((char *) root_element->name, "config") != 0) {
+	if (root_element == NULL || strcmp((char *) root_element->name, "config") != 0) {
 		ERROR("%s: source file does not contain config element", __func__);
+		xmlFreeDoc(doc);
 		*e = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*e, NC_ERR_PARAM_MSG, "Data to be stored at URL are invalid.");
 		return EXIT_FAILURE;
@@ -240,48 +265,202 @@ int nc_url_upload(char *data, const char *url, struct nc_err **e)
 	return retval;
 }
 
-static size_t nc_url_writedata(char *ptr, size_t size, size_t nmemb, void* UNUSED(userdata))
+/*
+ * XML serializer's output callback, block until curl takes the data
+ */
+static int nc_url_stream_write(void *context, const char *data, int len)
 {
-	return write(url_tmpfile, ptr, size * nmemb);
+	struct nc_url_stream *stream = (struct nc_url_stream *) context;
+	size_t chunk;
+	int written = 0;
+
+	pthread_mutex_lock(&stream->lock);
+	while (written < len) {
+		while (stream->len == NC_URL_STREAM_BUFSIZE && !stream->aborted) {
+			pthread_cond_wait(&stream->cond, &stream->lock);
+		}
+		if (stream->aborted) {
+			written = -1;
+			break;
+		}
+		chunk = NC_URL_STREAM_BUFSIZE - stream->len;
+		if (chunk > (size_t) (len - written)) {
+			chunk = len - written;
+		}
+		memcpy(stream->buffer + stream->len, data + written, chunk);
+		stream->len += chunk;
+		written += chunk;
+		pthread_cond_signal(&stream->cond);
+	}
+	pthread_mutex_unlock(&stream->lock);
+
+	return (written);
 }
 
-int nc_url_delete_config(const char *url, struct nc_err **e)
+static void* nc_url_stream_serialize(void *arg)
 {
-	return nc_url_upload("<?xml version=\"1.0\"?><config xmlns=\""NC_NS_BASE10"\"></config>", url, e);
+	struct nc_url_stream *stream = (struct nc_url_stream *) arg;
+	xmlSaveCtxtPtr save;
+	int ret = -1;
+
+	if ((save = xmlSaveToIO(nc_url_stream_write, NULL, stream, NULL, XML_SAVE_FORMAT)) != NULL) {
+		ret = xmlSaveDoc(save, stream->doc);
+		if (xmlSaveClose(save) < 0) {
+			ret = -1;
+		}
+	}
+
+	pthread_mutex_lock(&stream->lock);
+	if (ret < 0 && !stream->aborted) {
+		ERROR("%s: serializing the document for the URL upload failed.", __func__);
+		stream->error = 1;
+	}
+	stream->done = 1;
+	pthread_cond_signal(&stream->cond);
+	pthread_mutex_unlock(&stream->lock);
+
+	return (NULL);
 }
 
-int nc_url_check(const char* url)
+/*
+ * curl's READFUNCTION, pass everything the serializer produced so far
+ */
+static size_t nc_url_stream_read(void *ptr, size_t size, size_t nmemb, void *userdata)
 {
-	CURL *curl;
-	int retval;
+	struct nc_url_stream *stream = (struct nc_url_stream *) userdata;
+	size_t copied;
+
+	pthread_mutex_lock(&stream->lock);
+	while (stream->len == 0 && !stream->done) {
+		pthread_cond_wait(&stream->cond, &stream->lock);
+	}
+	if (stream->error) {
+		pthread_mutex_unlock(&stream->lock);
+		return (CURL_READFUNC_ABORT);
+	}
+
+	copied = (stream->len > size * nmemb) ? size * nmemb : stream->len;
+	memcpy(ptr, stream->buffer, copied);
+	stream->len -= copied;
+	memmove(stream->buffer, stream->buffer + copied, stream->len);
+	pthread_cond_signal(&stream->cond);
+	pthread_mutex_unlock(&stream->lock);
+
+	return (copied);
+}
+
+int nc_url_upload_doc(xmlDocPtr doc, const char *url, struct nc_err **e)
+{
+	CURL * curl;
+	CURLcode res;
+	struct nc_url_stream stream;
+	pthread_t serializer;
+	char curl_buffer[CURL_ERROR_SIZE];
+	xmlNodePtr root_element;
+	int retval = EXIT_SUCCESS;
+
+	assert(e);
+
+	/* check that the content follows RFC */
+	root_element = xmlDocGetRootElement(doc);
+	if (root_element == NULL || xmlStrcmp(root_element->name, BAD_CAST "config") != 0) {
+		ERROR("%s: source document does not contain config element", __func__);
+		*e = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*e, NC_ERR_PARAM_MSG, "Data to be stored at URL are invalid.");
+		return EXIT_FAILURE;
+	}
+
+	DBG("Uploading document to URL: %s (via curl)", url);
+
+	/*
+	 * serialize the document in a separate thread, the data are passed to
+	 * curl through a bounded buffer instead of dumping the whole document
+	 * into memory
+	 */
+	memset(&stream, 0, sizeof stream);
+	pthread_mutex_init(&stream.lock, NULL);
+	pthread_cond_init(&stream.cond, NULL);
+	stream.doc = doc;
+	if ((errno = pthread_create(&serializer, NULL, nc_url_stream_serialize, &stream)) != 0) {
+		ERROR("%s: unable to create thread (%s)", __func__, strerror(errno));
+		pthread_mutex_destroy(&stream.lock);
+		pthread_cond_destroy(&stream.cond);
+		*e = nc_err_new(NC_ERR_OP_FAILED);
+		return EXIT_FAILURE;
+	}
 
 	/* set up libcurl */
 	curl_global_init(INIT_FLAGS);
 	curl = curl_easy_init();
 	curl_easy_setopt(curl, CURLOPT_URL, url);
-	retval = curl_easy_perform(curl);
+	curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+	curl_easy_setopt(curl, CURLOPT_READDATA, &stream);
+	curl_easy_setopt(curl, CURLOPT_READFUNCTION, nc_url_stream_read);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curl_buffer);
+	res = curl_easy_perform(curl);
+
+	/* stop the serializer if curl finished prematurely */
+	pthread_mutex_lock(&stream.lock);
+	stream.aborted = 1;
+	pthread_cond_signal(&stream.cond);
+	pthread_mutex_unlock(&stream.lock);
+	pthread_join(serializer, NULL);
+
+	if (res != CURLE_OK) {
+		ERROR("%s: curl error: %s", __func__, curl_buffer);
+		*e = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*e, NC_ERR_PARAM_MSG, curl_buffer);
+		retval = EXIT_FAILURE;
+	}
 
 	/* cleanup */
 	curl_easy_cleanup(curl);
 	curl_global_cleanup();
+	pthread_mutex_destroy(&stream.lock);
+	pthread_cond_destroy(&stream.cond);
 
-	return (retval);
+	return retval;
 }
 
-int nc_url_open(const char *url)
+int nc_url_delete_config(const char *url, struct nc_err **e)
+{
+	return nc_url_upload("<?xml version=\"1.0\"?><config xmlns=\""NC_NS_BASE10"\"></config>", url, e);
+}
+
+/*
+ * curl's WRITEFUNCTION, push the received data directly into the XML parser
+ */
+static size_t nc_url_parsedata(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	struct nc_url_parser *parser = (struct nc_url_parser *) userdata;
+	size_t len = size * nmemb;
+
+	if (len == 0) {
+		return (0);
+	}
+
+	if (parser->ctxt == NULL) {
+		/* the first chunk is used to detect the encoding */
+		if ((parser->ctxt = xmlCreatePushParserCtxt(NULL, NULL, ptr, len, parser->url)) == NULL) {
+			return (0);
+		}
+		xmlCtxtUseOptions(parser->ctxt, NC_XMLREAD_OPTIONS);
+	} else if (xmlParseChunk(parser->ctxt, ptr, len, 0) != 0) {
+		/* stop the transfer, the content is not a well-formed XML */
+		return (0);
+	}
+	parser->received += len;
+
+	return (len);
+}
+
+xmlDocPtr nc_url_read_doc(const char *url, size_t *received)
 {
 	CURL * curl;
 	CURLcode res;
+	struct nc_url_parser parser = {NULL, url, 0};
 	char curl_buffer[CURL_ERROR_SIZE];
-	char url_tmp_name[(sizeof(NC_WORKINGDIR_PATH) / sizeof(char)) + 19] = NC_WORKINGDIR_PATH"/url_tmpfileXXXXXX";
-
-	/* prepare temporary file ... */
-	if ((url_tmpfile = mkstemp(url_tmp_name)) < 0) {
-		ERROR("%s: cannot create temporary file (%s)", __func__, strerror(errno));
-		return (-1);
-	}
-	/* and hide it from the file system */
-	unlink(url_tmp_name);
+	xmlDocPtr doc = NULL;
 
 	DBG("Getting file from URL: %s (via curl)", url);
 
@@ -289,21 +468,38 @@ int nc_url_open(const char *url)
 	curl_global_init(INIT_FLAGS);
 	curl = curl_easy_init();
 	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, nc_url_writedata);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, nc_url_parsedata);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &parser);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curl_buffer);
 	res = curl_easy_perform(curl);
 	if (res != CURLE_OK) {
-		ERROR("%s: curl error: %s", __func__, curl_buffer);
-		close(url_tmpfile);
-		url_tmpfile = -1;
-	} else {
-		/* move back to the beginning of the output file */
-		lseek(url_tmpfile, 0, SEEK_SET);
+		if (parser.ctxt == NULL || parser.ctxt->wellFormed) {
+			VERB("%s: curl error: %s", __func__, curl_buffer);
+		}
+	} else if (parser.ctxt != NULL) {
+		/* finish the document */
+		xmlParseChunk(parser.ctxt, NULL, 0, 1);
+	}
+
+	if (parser.ctxt != NULL) {
+		if (res == CURLE_OK && parser.ctxt->wellFormed) {
+			doc = parser.ctxt->myDoc;
+		} else {
+			if (res == CURLE_OK || !parser.ctxt->wellFormed) {
+				ERROR("%s: error reading XML data from the URL file", __func__);
+			}
+			xmlFreeDoc(parser.ctxt->myDoc);
+		}
+		parser.ctxt->myDoc = NULL;
+		xmlFreeParserCtxt(parser.ctxt);
 	}
 
 	/* cleanup */
 	curl_easy_cleanup(curl);
 	curl_global_cleanup();
 
-	return url_tmpfile;
+	if (received != NULL) {
+		*received = parser.received;
+	}
+	return (doc);
 }
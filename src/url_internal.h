@@ -40,24 +40,24 @@
 #ifndef NC_URL_INTERNAL_H_
 #define NC_URL_INTERNAL_H_
 
+#include <libxml/tree.h>
+
 #include "url.h"
 #include "error.h"
 
 /**
- * @brief Get config file from remote source and store it to temporary file
+ * @brief Get config file from remote source and parse it
  *
- * Caller HAVE TO close file descriptor returned by this function. Tmp file is
- * unliked by nc_url_open.
+ * Received data are passed directly to the XML push parser, so the remote
+ * file is never stored in a temporary file or in memory.
  *
- * @param url source url
- * @return fd on tmp file with remote rpc or -1 on error
+ * @param[in] url source url
+ * @param[out] received number of bytes received from the url, can be NULL.
+ * Zero when the remote file is empty or does not exist.
+ * @return parsed document or NULL on error or when nothing was received
  */
-int nc_url_open(const char* url);
+xmlDocPtr nc_url_read_doc(const char* url, size_t* received);
 
-/**
- * @brief Check if the URL exists (can be opened)
- */
-int nc_url_check(const char* url);
 /**
  * @brief Replaces target file with empty <config> element.
  * @param url target url
@@ -73,6 +73,18 @@ int nc_url_delete_config(const char* url, struct nc_err **e);
  */
 int nc_url_upload(char* data, const char* url, struct nc_err **e);
 
+/**
+ * @brief Uploads document to remote target
+ *
+ * The document is serialized directly into the transfer, no dump of the
+ * whole document is created.
+ *
+ * @param doc configuration data with the <config> root element
+ * @param url target url
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int nc_url_upload_doc(xmlDocPtr doc, const char* url, struct nc_err **e);
+
 /**
  * @brief Generate URL capability string from enabled protocols
  * @return capability string, NULL on error
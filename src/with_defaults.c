@@ -106,581 +106,508 @@ API NCWD_MODE ncdflt_rpc_get_withdefaults(const nc_rpc* rpc)
 }
 
 /*
- * 0 - no match
- * 1 - match found
+ * Precomputed default values of a configuration data model. The tree covers
+ * only the schema nodes with a default value somewhere in their subtree, so
+ * the configuration data are walked together with it just once.
  */
-static int search_choice_match(xmlNodePtr parent, xmlChar* name)
+typedef enum {
+	NCDFLT_NODE_INNER,   /* container or list */
+	NCDFLT_NODE_LEAF,    /* leaf with a default value */
+	NCDFLT_NODE_CHOICE,
+	NCDFLT_NODE_CASE,
+	NCDFLT_NODE_AUGMENT
+} NCDFLT_NODE_TYPE;
+
+struct ncdflt_node {
+	NCDFLT_NODE_TYPE type;
+	xmlChar* name;
+	xmlChar* value;              /* default value of a leaf, default case of a choice */
+	int create;                  /* the node can be created to hold default values */
+	xmlChar** names;             /* data nodes of a case (of all the cases of a choice) */
+	struct ncdflt_node* choice;  /* choice of a case (or of a shorthand case) */
+	struct ncdflt_node* children;
+	struct ncdflt_node* next;
+};
+
+struct ncdflt_defaults {
+	xmlChar* namespace;
+	struct ncdflt_node* nodes;   /* top-level containers */
+};
+
+static int ncdflt_is_stmt(xmlNodePtr node, const char* name)
 {
-	xmlNodePtr aux;
+	return (node->type == XML_ELEMENT_NODE && node->ns != NULL &&
+			xmlStrcmp(node->ns->href, BAD_CAST NC_NS_YIN) == 0 &&
+			(name == NULL || xmlStrcmp(node->name, BAD_CAST name) == 0));
+}
 
-	/* go through all existing elements on the appropriate level in the
-	 * configuration data to check if the currently processed default
-	 * value is created and the node with default value is supposed to
-	 * be created
-	 */
-	for (aux = parent->children; aux != NULL; aux = aux->next) {
-		if (aux->type != XML_ELEMENT_NODE) {
-			continue;
+static xmlChar* ncdflt_stmt_default(xmlNodePtr node)
+{
+	for (node = node->children; node != NULL; node = node->next) {
+		if (ncdflt_is_stmt(node, "default")) {
+			return (xmlGetProp(node, BAD_CAST "value"));
 		}
+	}
+	return (NULL);
+}
+
+static void ncdflt_node_free(struct ncdflt_node* node)
+{
+	struct ncdflt_node* next;
+	int i;
 
-		if (xmlStrcmp(aux->name, name) == 0) {
-			/* we have a match */
-			return (1);
+	for (; node != NULL; node = next) {
+		next = node->next;
+		ncdflt_node_free(node->children);
+		xmlFree(node->name);
+		xmlFree(node->value);
+		for (i = 0; node->names != NULL && node->names[i] != NULL; i++) {
+			xmlFree(node->names[i]);
 		}
+		free(node->names);
+		free(node);
 	}
-
-	return (0);
 }
 
-static xmlChar* check_default_case(xmlNodePtr config_choice, xmlNodePtr model_choice)
+/* remember the name of the data node of the (shorthand) case */
+static int ncdflt_node_name(struct ncdflt_node* node, xmlNodePtr stmt)
 {
-	xmlNodePtr def, aux_model, case_child;
-	xmlChar *name;
+	xmlChar** names;
+	int count;
 
-	/*
-	 * for all cases if the model, check that there is no case in config
-	 * and then return name of the default case
-	 */
+	if (!ncdflt_is_stmt(stmt, "anyxml") && !ncdflt_is_stmt(stmt, "container") &&
+			!ncdflt_is_stmt(stmt, "leaf") && !ncdflt_is_stmt(stmt, "list") &&
+			!ncdflt_is_stmt(stmt, "leaf-list")) {
+		return (EXIT_SUCCESS);
+	}
 
-	/* first, get the name of default case, if no defined, terminate */
-	for (def = model_choice->children; def != NULL; def = def->next) {
-		if (def->type != XML_ELEMENT_NODE || xmlStrcmp(def->name, BAD_CAST "default")) {
-			continue;
+	for (count = 0; node->names != NULL && node->names[count] != NULL; count++);
+	if ((names = realloc(node->names, (count + 2) * sizeof(xmlChar*))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	node->names = names;
+	node->names[count] = xmlGetProp(stmt, BAD_CAST "name");
+	node->names[count + 1] = NULL;
+
+	return (EXIT_SUCCESS);
+}
+
+/* remember the names of the data nodes of the case */
+static int ncdflt_node_names(struct ncdflt_node* node, xmlNodePtr case_stmt)
+{
+	xmlNodePtr aux;
+
+	for (aux = case_stmt->children; aux != NULL; aux = aux->next) {
+		if (ncdflt_node_name(node, aux) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
 		}
-		/* default definition */
-		break;
 	}
-	if (def == NULL) {
+
+	return (EXIT_SUCCESS);
+}
+
+/*
+ * Precompute the defaults of the schema node, NULL is returned if there
+ * is no default value in its subtree (or on error).
+ */
+static struct ncdflt_node* ncdflt_node_build(xmlNodePtr stmt, struct ncdflt_node* choice)
+{
+	struct ncdflt_node *node, *child, *last = NULL;
+	xmlNodePtr aux;
+
+	if ((node = calloc(1, sizeof(struct ncdflt_node))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
 		return (NULL);
 	}
-
-	/* now search for any existing case */
-	for (aux_model = model_choice->children; aux_model != NULL; aux_model = aux_model->next) {
-		if (aux_model->type != XML_ELEMENT_NODE || xmlStrcmp(aux_model->name, BAD_CAST "case")) {
-			continue;
+	node->choice = choice;
+
+	if (ncdflt_is_stmt(stmt, "container")) {
+		node->type = NCDFLT_NODE_INNER;
+		/* presence containers are not created to hold the default values */
+		node->create = 1;
+		for (aux = stmt->children; aux != NULL; aux = aux->next) {
+			if (ncdflt_is_stmt(aux, "presence")) {
+				node->create = 0;
+				break;
+			}
 		}
-		for (case_child = aux_model->children; case_child != NULL; case_child = case_child->next) {
-			if (case_child->type != XML_ELEMENT_NODE) {
-				continue;
+	} else if (ncdflt_is_stmt(stmt, "list")) {
+		node->type = NCDFLT_NODE_INNER;
+	} else if (ncdflt_is_stmt(stmt, "leaf")) {
+		node->type = NCDFLT_NODE_LEAF;
+		node->create = 1;
+		if ((node->value = ncdflt_stmt_default(stmt)) == NULL) {
+			goto nodefault;
+		}
+	} else if (ncdflt_is_stmt(stmt, "choice") && choice == NULL) {
+		node->type = NCDFLT_NODE_CHOICE;
+		node->value = ncdflt_stmt_default(stmt);
+		for (aux = stmt->children; aux != NULL; aux = aux->next) {
+			if (ncdflt_is_stmt(aux, "case") && ncdflt_node_names(node, aux) != EXIT_SUCCESS) {
+				goto nodefault;
 			}
+		}
+	} else if (ncdflt_is_stmt(stmt, "case") && choice != NULL) {
+		node->type = NCDFLT_NODE_CASE;
+		if (ncdflt_node_names(node, stmt) != EXIT_SUCCESS) {
+			goto nodefault;
+		}
+	} else if (ncdflt_is_stmt(stmt, "augment") && choice == NULL) {
+		node->type = NCDFLT_NODE_AUGMENT;
+	} else {
+		goto nodefault;
+	}
 
-			if ((xmlStrcmp(case_child->name, BAD_CAST "anyxml") == 0) ||
-					(xmlStrcmp(case_child->name, BAD_CAST "container") == 0) ||
-					(xmlStrcmp(case_child->name, BAD_CAST "leaf") == 0) ||
-					(xmlStrcmp(case_child->name, BAD_CAST "list") == 0) ||
-					(xmlStrcmp(case_child->name, BAD_CAST "leaf-list") == 0)) {
-				name = xmlGetProp(case_child, BAD_CAST "name");
-				if (search_choice_match(config_choice, name) == 1) {
-					xmlFree(name);
-					return (NULL);
-				}
-				xmlFree(name);
-			}
+	if (node->type != NCDFLT_NODE_AUGMENT && (node->name = xmlGetProp(stmt, BAD_CAST "name")) == NULL) {
+		goto nodefault;
+	}
+	if (choice != NULL && node->type != NCDFLT_NODE_CASE && ncdflt_node_name(node, stmt) != EXIT_SUCCESS) {
+		goto nodefault;
+	}
+	if (node->type == NCDFLT_NODE_LEAF) {
+		return (node);
+	}
+
+	for (aux = stmt->children; aux != NULL; aux = aux->next) {
+		if ((child = ncdflt_node_build(aux, node->type == NCDFLT_NODE_CHOICE ? node : NULL)) == NULL) {
+			continue;
+		}
+		if (last == NULL) {
+			node->children = child;
+		} else {
+			last->next = child;
 		}
+		last = child;
+	}
+	if (node->children != NULL) {
+		return (node);
 	}
 
-	return(xmlGetProp(def, BAD_CAST "value"));
+nodefault:
+	ncdflt_node_free(node);
+	return (NULL);
 }
 
-static xmlNodePtr* fill_default(xmlDocPtr config, xmlNodePtr node, const char* namespace, NCWD_MODE mode)
+struct ncdflt_defaults* ncdflt_defaults_build(const xmlDocPtr model)
 {
-	xmlNodePtr *parents = NULL, *retvals = NULL, *aux_nodeptr;
-	xmlNodePtr aux = NULL;
-	xmlNsPtr ns;
-	xmlChar* value = NULL, *name, *value2;
-	int i, j, k, size = 0, first_call = 0;
-	static xmlNodePtr *created_local = NULL;
-	static int created_count = 0;
-	static int created_size = 0;
+	struct ncdflt_defaults* defaults;
+	struct ncdflt_node *node, *last = NULL;
+	xmlNodePtr root, aux;
 
-	if (mode == NCWD_MODE_NOTSET || mode == NCWD_MODE_EXPLICIT) {
+	if (model == NULL) {
 		return (NULL);
 	}
 
-	if (xmlStrcmp(node->name, BAD_CAST "default") == 0 && xmlStrcmp(node->parent->name, BAD_CAST "choice") == 0) {
-		/* skip default branches of a choice */
+	if ((defaults = calloc(1, sizeof(struct ncdflt_defaults))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
 		return (NULL);
 	}
 
-	if (created_local == NULL) {
-		/* initial (not recursive) call */
-		first_call = 1;
-		created_count = 0;
-		created_size = 32;
-		created_local = malloc(created_size * sizeof(xmlNodePtr));
-		created_local[created_count] = NULL; /* list terminating byte */
-	}
-
-	/* do recursion */
-	if (node->parent == NULL) {
-		if (first_call) {
-			if (retvals == NULL) {
-				for(i = created_count-1; i >= 0; i--) {
-					if (created_local[i]->children == NULL) {
-						/* created parent element, but default value was not finally
-						 * created and no other children element exists -> remove
-						 * the created element
-						 */
-						xmlUnlinkNode(created_local[i]);
-						xmlFreeNode(created_local[i]);
-					}
-				}
+	if ((root = xmlDocGetRootElement(model)) != NULL && ncdflt_is_stmt(root, "module")) {
+		for (aux = root->children; aux != NULL; aux = aux->next) {
+			if (ncdflt_is_stmt(aux, "namespace")) {
+				defaults->namespace = xmlGetProp(aux, BAD_CAST "uri");
+				break;
 			}
-			/* free in last recursion call */
-			created_count = 0;
-			free(created_local);
-			created_local = NULL;
 		}
+	}
+	if (defaults->namespace == NULL) {
+		ERROR("%s: Unable to get namespace from the data model.", __func__);
+		free(defaults);
 		return (NULL);
-	} else if (xmlStrcmp(node->parent->name, BAD_CAST "module") != 0) {
-		/* we will get parent of the config's equivalent of the node */
-		parents = fill_default(config, node->parent, namespace, mode);
-
-		if (parents && xmlStrcmp(node->parent->name, BAD_CAST "choice") == 0) {
-			/* process choices */
-
-			if (xmlStrcmp(node->name, BAD_CAST "case") == 0) {
-				/*
-				 * if there is case defined, we have to skip it and search for
-				 * its subelements since case node itself is not present in
-				 * configuration data
-				 */
-
-				/* so do it for all given parent nodes */
-				for (i = 0; parents[i] != NULL; i++) {
-					/*
-					 * at least one of the case children is supposed to be
-					 * present, if no such element is found, the parent is
-					 * removed from further processing
-					 */
-					for (aux = node->children; aux != NULL; aux = aux->next) {
-						if (aux->type != XML_ELEMENT_NODE) {
-							continue;
-						}
-
-						if ((xmlStrcmp(aux->name, BAD_CAST "anyxml") == 0) ||
-								(xmlStrcmp(aux->name, BAD_CAST "container") == 0) ||
-								(xmlStrcmp(aux->name, BAD_CAST "leaf") == 0) ||
-								(xmlStrcmp(aux->name, BAD_CAST "list") == 0) ||
-								(xmlStrcmp(aux->name, BAD_CAST "leaf-list") == 0)) {
-							value = xmlGetProp(aux, BAD_CAST "name");
-							if (search_choice_match(parents[i], value) != 0) {
-								xmlFree(value);
-								break;
-							}
-							xmlFree(value);
-						}
-					}
-					if (aux == NULL) {
-						/* match not found */
-
-						/* check default case */
-						if ((value = check_default_case(parents[i], node->parent)) != NULL) {
-							/*
-							 * there is no case in config data and default case
-							 * is specified in the model (named value), check
-							 * if it is the currently processed node
-							 */
-							name = xmlGetProp(node, BAD_CAST "name");
-							if (xmlStrcmp(value, name) != 0) {
-								/*
-								 * we are in a different case, remove parent
-								 * from further processing
-								 */
-								parents[i] = NULL;
-							}
-
-							/* cleanup */
-							xmlFree(value);
-							xmlFree(name);
-
-						} else {
-							/*
-							 * there is already some case in config data or no
-							 * default case is specified. Remove parent from
-							 * further processing
-							 */
-							parents[i] = NULL;
-						}
-					}
-				}
-			} else {
-				/*
-				 * if there is no case, the element itself is supposed to be
-				 * present in the configuration data, so search for it
-				 */
-				value = xmlGetProp(node, BAD_CAST "name");
-				for (i = 0; parents[i] != NULL; i++) {
-					if (search_choice_match(parents[i], value) == 0) {
-						name = check_default_case(parents[i], node->parent);
-						if (name == NULL || xmlStrcmp(name, value) != 0) {
-							/* we are not in a default branch */
-							parents[i] = NULL;
-						}
-					}
-				}
-				xmlFree(value);
-			}
-
-			/* consolidate parents */
-			for (j = 0, k = 0; k < i; k++) {
-				if (parents[k]) {
-					parents[j] = parents[k];
-					j++;
-				}
-			}
-			if (j == 0) {
-				free(parents);
-				parents = NULL;
-			}
+	}
 
+	/* only the defaults inside the top-level containers are processed */
+	for (aux = root->children; aux != NULL; aux = aux->next) {
+		if (!ncdflt_is_stmt(aux, "container") || (node = ncdflt_node_build(aux, NULL)) == NULL) {
+			continue;
 		}
-
-		/* if we are in augment or choice node, just go through */
-		if (((xmlStrcmp(node->name, BAD_CAST "augment") == 0) ||
-				(xmlStrcmp(node->name, BAD_CAST "choice") == 0) ||
-				(xmlStrcmp(node->name, BAD_CAST "case") == 0)) &&
-				(xmlStrcmp(node->ns->href, BAD_CAST NC_NS_YIN) == 0)) {
-			return (parents);
+		if (last == NULL) {
+			defaults->nodes = node;
+		} else {
+			last->next = node;
 		}
-	} else {
-		/* we are in the root */
-		aux = config->children;
-		switch (mode) {
-		case NCWD_MODE_ALL:
-		case NCWD_MODE_ALL_TAGGED:
-			/* return root element, create it if it does not exist */
-			retvals = (xmlNodePtr*) malloc(2 * sizeof(xmlNodePtr));
-			if (retvals == NULL) {
-				ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-				goto cleanup;
-			}
-			retvals[1] = NULL;
-			/* create root element */
-			name = xmlGetProp(node, BAD_CAST "name");
-			/* search in all the root elements */
-			for (; aux != NULL; aux = aux->next) {
-				if (xmlStrcmp(aux->name, name) == 0) {
-					break;
-				}
-			}
-			if (aux == NULL) {
-				aux = xmlNewNode(NULL, name);
-				if (config->children == NULL) {
-					xmlDocSetRootElement(config, aux);
-				} else {
-					xmlAddSibling(config->children, aux);
-				}
-				/* set namespace */
-				ns = xmlNewNs(aux, BAD_CAST namespace, NULL);
-				xmlSetNs(aux, ns);
+		last = node;
+	}
 
-				/* remember created node, for later remove if no default child will be created */
-				if (created_count == created_size-1) {
-					/* (re)allocate created list */
-					created_size += 32;
-					aux_nodeptr = realloc(created_local, created_size * sizeof(xmlNodePtr));
-					if (aux_nodeptr == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						free(retvals);
-						goto cleanup;
-					}
-					created_local = aux_nodeptr;
-				}
-				created_local[created_count++] = aux;
-				created_local[created_count] = NULL; /* list terminating byte */
-			}
-			xmlFree(name);
+	return (defaults);
+}
 
-			/* if report-all-tagged, add namespace for default attribute into the whole doc */
-			if (mode == NCWD_MODE_ALL_TAGGED) {
-				xmlNewNs(aux, BAD_CAST "urn:ietf:params:xml:ns:netconf:default:1.0", BAD_CAST "wd");
-			}
+void ncdflt_defaults_free(struct ncdflt_defaults* defaults)
+{
+	if (defaults == NULL) {
+		return;
+	}
 
-			retvals[0] = aux;
-			return (retvals);
-			break;
-		case NCWD_MODE_TRIM:
-			/* search in all the root elements */
-			name = xmlGetProp(node, BAD_CAST "name");
-			for (; aux != NULL; aux = aux->next) {
-				if (xmlStrcmp(aux->name, name) == 0) {
-					break;
-				}
-			}
-			/* return root element, do not create it if it does not exist */
-			if (aux != NULL) {
-				retvals = (xmlNodePtr*) malloc(2 * sizeof(xmlNodePtr));
-				if (retvals == NULL) {
-					ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-					xmlFree(name);
-					goto cleanup;
-				}
-				retvals[0] = aux;
-				retvals[1] = NULL;
-			}
-			xmlFree(name);
-			return (retvals);
-			break;
-		default:
-			/* remove compiler warnings, but do nothing */
-			break;
+	ncdflt_node_free(defaults->nodes);
+	xmlFree(defaults->namespace);
+	free(defaults);
+}
+
+/* 1 if any of the names is present among the parent's children, 0 otherwise */
+static int ncdflt_names_match(xmlNodePtr parent, xmlChar** names)
+{
+	xmlNodePtr aux;
+	int i;
+
+	for (aux = parent->children; names != NULL && aux != NULL; aux = aux->next) {
+		if (aux->type != XML_ELEMENT_NODE) {
+			continue;
 		}
-	}
-	if (parents == NULL) {
-		if (first_call) {
-			if (retvals == NULL) {
-				for(i = created_count-1; i >= 0; i--) {
-					if (created_local[i]->children == NULL) {
-						/* created parent element, but default value was not finally
-						 * created and no other children element exists -> remove
-						 * the created element
-						 */
-						xmlUnlinkNode(created_local[i]);
-						xmlFreeNode(created_local[i]);
-					}
-				}
+		for (i = 0; names[i] != NULL; i++) {
+			if (xmlStrcmp(aux->name, names[i]) == 0) {
+				return (1);
 			}
-			/* free in last recursion call */
-			free(created_local);
-			created_local = NULL;
-			created_count = 0;
 		}
-		return (NULL);
 	}
 
-	for (i = 0, j = 0; parents[i] != NULL; i++) {
-		if (xmlStrcmp(node->name, BAD_CAST "default") == 0) {
-			switch (mode) {
-			case NCWD_MODE_ALL:
-			case NCWD_MODE_ALL_TAGGED:
-				/* we are at the end - set default content if needed */
-				value = xmlGetProp(node, BAD_CAST "value");
-				if (parents[i]->children == NULL) {
-					/* element is empty -> fill it with the default value */
-					xmlNodeSetContent(parents[i], value);
-				} /* else do nothing, configuration data contain (non-)default value */
-
-				if (mode == NCWD_MODE_ALL_TAGGED) {
-					value2 = xmlNodeGetContent(parents[i]);
-					if (xmlStrcmp(value, value2) == 0) {
-						/* add default attribute if element has default value */
-						aux = xmlDocGetRootElement(config);
-						for (ns = aux->nsDef; ns != NULL; ns = ns->next) {
-							if (xmlStrcmp(ns->href, BAD_CAST "urn:ietf:params:xml:ns:netconf:default:1.0") == 0) {
-								break;
-							}
-						}
-						xmlNewNsProp(parents[i], ns, BAD_CAST "default", BAD_CAST "true");
-					}
-					xmlFree(value2);
-				}
+	return (0);
+}
 
-				xmlFree(value);
-				/* continue to another parent node in the list to process */
-				break;
-			case NCWD_MODE_TRIM:
-				/* we are at the end - remove element if it contains default value */
-				if (parents[i]->children != NULL) {
-					value = xmlGetProp(node, BAD_CAST "value");
-					value2 = xmlNodeGetContent(parents[i]);
-					if (xmlStrcmp(value, value2) == 0) {
-						/* element contains default value, remove it */
-						xmlUnlinkNode(parents[i]);
-						xmlFreeNode(parents[i]);
-					}
-					xmlFree(value);
-					xmlFree(value2);
-				}
-				break;
-			default:
-				/* remove compiler warnings, but do nothing */
-				break;
-			}
-		} else {
-			/* remember the number of retvals */
-			k = j;
-			/* find node's equivalents in config */
-			name = xmlGetProp(node, BAD_CAST "name");
-			for(aux = parents[i]->children; aux != NULL; aux = aux->next) {
-				if (xmlStrcmp(aux->name, name) == 0) {
-					/* remember the node */
-					if (size <= j+1) {
-						/* (re)allocate retvals list */
-						size += 32;
-						aux_nodeptr = (xmlNodePtr*) realloc(retvals, size * sizeof(xmlNodePtr));
-						if (aux_nodeptr == NULL) {
-							ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-							/* we're in real troubles here */
-							free(retvals);
-							return (NULL);
-						}
-						retvals = aux_nodeptr;
-					}
+/*
+ * 1 if the (shorthand) case is present in the parent's data or it is the
+ * default case and no other case is present, 0 otherwise
+ */
+static int ncdflt_case_selected(struct ncdflt_node* node, xmlNodePtr parent)
+{
+	if (ncdflt_names_match(parent, node->names)) {
+		return (1);
+	}
+	if (node->choice->value == NULL || ncdflt_names_match(parent, node->choice->names)) {
+		return (0);
+	}
 
-					retvals[j] = aux;
-					j++;
-					retvals[j] = NULL; /* list terminating NULL */
-				}
-			}
+	return (xmlStrcmp(node->choice->value, node->name) == 0);
+}
 
-			switch (mode) {
-			case NCWD_MODE_ALL:
-			case NCWD_MODE_ALL_TAGGED:
-				if (k == j && xmlStrcmp(node->name, BAD_CAST "list") != 0) {
-					/* check, that new node is not a "presence" element */
-					for (aux = node->children; aux != NULL; aux = aux->next) {
-						if (xmlStrcmp(aux->name, BAD_CAST "presence") == 0) {
-							break;
-						}
-					}
-					if (aux != NULL) {
-						/* presence definition found -> leave the case */
+static void ncdflt_apply_leaf(struct ncdflt_node* node, xmlNodePtr leaf, NCWD_MODE mode)
+{
+	xmlNodePtr root;
+	xmlNsPtr ns;
+	xmlChar* value;
+
+	switch (mode) {
+	case NCWD_MODE_ALL:
+	case NCWD_MODE_ALL_TAGGED:
+		if (leaf->children == NULL) {
+			/* element is empty -> fill it with the default value */
+			xmlNodeSetContent(leaf, node->value);
+		} /* else do nothing, configuration data contain (non-)default value */
+
+		if (mode == NCWD_MODE_ALL_TAGGED) {
+			value = xmlNodeGetContent(leaf);
+			if (xmlStrcmp(node->value, value) == 0) {
+				/* add default attribute if element has default value */
+				root = xmlDocGetRootElement(leaf->doc);
+				for (ns = root->nsDef; ns != NULL; ns = ns->next) {
+					if (xmlStrcmp(ns->href, BAD_CAST "urn:ietf:params:xml:ns:netconf:default:1.0") == 0) {
 						break;
 					}
-					/* no new equivalent node found -> create one, but only if it is not supposed to be list */
-					if (size <= j + 1) {
-						/* (re)allocate retvals list */
-						size += 32;
-						aux_nodeptr = (xmlNodePtr*) realloc(retvals, size * sizeof(xmlNodePtr));
-						if (aux_nodeptr == NULL) {
-							ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-							/* we're in real troubles here */
-							free(retvals);
-							return (NULL);
-						}
-						retvals = aux_nodeptr;
-					}
-					/* no new equivalent node found -> create one */
-					retvals[j] = xmlNewChild(parents[i], parents[i]->ns, name, NULL);
-					j++;
-					retvals[j] = NULL; /* list terminating NULL */
-
-					/* remember created node, for later remove if no default child will be created */
-					if (created_count == created_size-1) {
-						/* (re)allocate created list */
-						created_size += 32;
-						aux_nodeptr = realloc(created_local, created_size * sizeof(xmlNodePtr));
-						if (aux_nodeptr == NULL) {
-							ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-							free(retvals);
-							goto cleanup;
-						}
-						created_local = aux_nodeptr;
-					}
-					created_local[created_count++] = retvals[j-1];
-					created_local[created_count] = NULL; /* list terminating byte */
 				}
-				break;
-			case NCWD_MODE_TRIM:
-				/* nothing needed */
-				break;
-			default:
-				/* remove compiler warnings, but do nothing */
-				break;
+				xmlNewNsProp(leaf, ns, BAD_CAST "default", BAD_CAST "true");
 			}
-			xmlFree(name);
+			xmlFree(value);
 		}
+		break;
+	case NCWD_MODE_TRIM:
+		/* remove element if it contains default value */
+		if (leaf->children != NULL) {
+			value = xmlNodeGetContent(leaf);
+			if (xmlStrcmp(node->value, value) == 0) {
+				/* the edited datastore can be recording its changes */
+				edit_node_drop(leaf);
+			}
+			xmlFree(value);
+		}
+		break;
+	default:
+		/* remove compiler warnings, but do nothing */
+		break;
 	}
-	if (parents != NULL) {
-		free(parents);
-	}
+}
 
-cleanup:
-	if (first_call) {
-		if (retvals == NULL) {
-			for(i = created_count-1; i >= 0; i--) {
-				if (created_local[i]->children == NULL) {
-					/* created parent element, but default value was not finally
-					 * created and no other children element exists -> remove
-					 * the created element
-					 */
-					xmlUnlinkNode(created_local[i]);
-					xmlFreeNode(created_local[i]);
-				}
+/* process the defaults of the children of the schema node in the data node */
+static void ncdflt_apply(struct ncdflt_node* schema, xmlNodePtr parent, NCWD_MODE mode)
+{
+	struct ncdflt_node* node;
+	xmlNodePtr aux, next;
+	int found;
+
+	for (node = schema->children; node != NULL; node = node->next) {
+		switch (node->type) {
+		case NCDFLT_NODE_CHOICE:
+		case NCDFLT_NODE_AUGMENT:
+			/* not present in the data, just go through */
+			ncdflt_apply(node, parent, mode);
+			continue;
+		case NCDFLT_NODE_CASE:
+			if (ncdflt_case_selected(node, parent)) {
+				ncdflt_apply(node, parent, mode);
+			}
+			continue;
+		default:
+			if (node->choice != NULL && !ncdflt_case_selected(node, parent)) {
+				/* we are not in the selected (or default) shorthand case */
+				continue;
+			}
+			break;
+		}
+
+		/* process all the node's equivalents in the data */
+		found = 0;
+		for (aux = parent->children; aux != NULL; aux = next) {
+			next = aux->next;
+			if (aux->type != XML_ELEMENT_NODE || xmlStrcmp(aux->name, node->name) != 0) {
+				continue;
+			}
+			found = 1;
+			if (node->type == NCDFLT_NODE_LEAF) {
+				ncdflt_apply_leaf(node, aux, mode);
+			} else {
+				ncdflt_apply(node, aux, mode);
 			}
 		}
-		/* free in last recursion call */
-		free(created_local);
-		created_local = NULL;
-		created_count = 0;
-		created_size = 0;
-	}
 
-	return (retvals);
+		if (!found && node->create && (mode == NCWD_MODE_ALL || mode == NCWD_MODE_ALL_TAGGED)) {
+			/* no equivalent node found -> create one */
+			aux = xmlNewChild(parent, parent->ns, node->name, NULL);
+			if (node->type == NCDFLT_NODE_LEAF) {
+				ncdflt_apply_leaf(node, aux, mode);
+			} else {
+				ncdflt_apply(node, aux, mode);
+			}
+			if (aux->children == NULL) {
+				/* no default value was finally created inside */
+				xmlUnlinkNode(aux);
+				xmlFreeNode(aux);
+			}
+		}
+	}
 }
 
 int ncdflt_default_values(xmlDocPtr config, const xmlDocPtr model, NCWD_MODE mode)
 {
-	xmlXPathContextPtr model_ctxt = NULL;
-	xmlXPathObjectPtr defaults = NULL, query;
-	xmlNodePtr root;
-	xmlChar* namespace = NULL;
-	int i;
+	struct ncdflt_defaults *defaults, *aux_defaults = NULL;
+	struct ncdflt_node* node;
+	xmlNodePtr root, aux;
+	xmlNsPtr ns;
+	int created;
 
 	if (config == NULL || model == NULL) {
 		return (EXIT_FAILURE);
 	}
 
-	if (mode == NCWD_MODE_NOTSET || mode == NCWD_MODE_EXPLICIT) {
+	if (mode != NCWD_MODE_ALL && mode != NCWD_MODE_ALL_TAGGED && mode != NCWD_MODE_TRIM) {
 		/* nothing to do */
 		return (EXIT_SUCCESS);
 	}
 
-	/* create xpath evaluation context */
-	if ((model_ctxt = xmlXPathNewContext(model)) == NULL) {
-		WARN("%s: Creating the XPath context failed.", __func__);
-		/* with-defaults cannot be found */
+	/* use the defaults precomputed in the model index, if not available, get them now */
+	if ((defaults = model_index_defaults(model)) == NULL &&
+			(defaults = aux_defaults = ncdflt_defaults_build(model)) == NULL) {
 		return (EXIT_FAILURE);
 	}
-	if (xmlXPathRegisterNs(model_ctxt, BAD_CAST "yin", BAD_CAST NC_NS_YIN) != 0) {
-		ERROR("%s: Registering yin namespace for the model xpath context failed.", __func__);
-		xmlXPathFreeContext(model_ctxt);
-		return (EXIT_FAILURE);
-	}
-	if ((query = xmlXPathEvalExpression(BAD_CAST "/yin:module/yin:namespace", model_ctxt)) == NULL) {
-		ERROR("%s: Unable to get namespace from the data model.", __func__);
-		xmlXPathFreeContext(model_ctxt);
-		return (EXIT_FAILURE);
-	}
-	if (xmlXPathNodeSetIsEmpty(query->nodesetval) || (namespace = xmlGetProp(query->nodesetval->nodeTab[0], BAD_CAST "uri")) == NULL) {
-		ERROR("%s: Unable to get namespace from the data model.", __func__);
-		xmlFree(namespace);
-		xmlXPathFreeObject(query);
-		xmlXPathFreeContext(model_ctxt);
-		return (EXIT_FAILURE);
-	}
-	xmlXPathFreeObject(query);
 
-	if ((defaults = xmlXPathEvalExpression(BAD_CAST "/yin:module/yin:container//yin:default", model_ctxt)) != NULL) {
-		if (!xmlXPathNodeSetIsEmpty(defaults->nodesetval)) {
-			/* if report-all-tagged, add namespace for default attribute into the whole doc */
-			root = xmlDocGetRootElement(config);
-			if (mode == NCWD_MODE_ALL_TAGGED && root != NULL) {
-				xmlNewNs(root, BAD_CAST "urn:ietf:params:xml:ns:netconf:default:1.0", BAD_CAST "wd");
+	if (defaults->nodes != NULL) {
+		/* if report-all-tagged, add namespace for default attribute into the whole doc */
+		root = xmlDocGetRootElement(config);
+		if (mode == NCWD_MODE_ALL_TAGGED && root != NULL) {
+			xmlNewNs(root, BAD_CAST "urn:ietf:params:xml:ns:netconf:default:1.0", BAD_CAST "wd");
+		}
+
+		for (node = defaults->nodes; node != NULL; node = node->next) {
+			/* search in all the root elements */
+			for (aux = config->children; aux != NULL; aux = aux->next) {
+				if (xmlStrcmp(aux->name, node->name) == 0) {
+					break;
+				}
 			}
-			/* process all defaults elements */
-			for (i = 0; i < defaults->nodesetval->nodeNr; i++) {
-				if (xmlStrcmp(defaults->nodesetval->nodeTab[i]->parent->name, BAD_CAST "choice") == 0) {
-					/* skip defaults for choices */
+			created = 0;
+			if (aux == NULL) {
+				if (mode == NCWD_MODE_TRIM) {
 					continue;
 				}
-				fill_default(config, defaults->nodesetval->nodeTab[i], (char*)namespace, mode);
+				/* create root element */
+				aux = xmlNewNode(NULL, node->name);
+				if (config->children == NULL) {
+					xmlDocSetRootElement(config, aux);
+				} else {
+					xmlAddSibling(config->children, aux);
+				}
+				ns = xmlNewNs(aux, defaults->namespace, NULL);
+				xmlSetNs(aux, ns);
+				created = 1;
+			}
+			if (mode == NCWD_MODE_ALL_TAGGED) {
+				xmlNewNs(aux, BAD_CAST "urn:ietf:params:xml:ns:netconf:default:1.0", BAD_CAST "wd");
+			}
+
+			ncdflt_apply(node, aux, mode);
+
+			if (created && aux->children == NULL) {
+				/* no default value was finally created inside */
+				xmlUnlinkNode(aux);
+				xmlFreeNode(aux);
 			}
 		}
-		xmlXPathFreeObject(defaults);
 	}
-	xmlFree(namespace);
-	xmlXPathFreeContext(model_ctxt);
+	ncdflt_defaults_free(aux_defaults);
 
 	return (EXIT_SUCCESS);
 }
 
-int ncdflt_default_clear(xmlDocPtr config)
+/*
+ * remove the tagged default nodes of the children of the schema node from the
+ * data node, 1 is returned if anything was removed
+ */
+static int ncdflt_clear(struct ncdflt_node* schema, xmlNodePtr parent)
+{
+	struct ncdflt_node* node;
+	xmlNodePtr aux, next;
+	xmlChar* value;
+	int removed = 0;
+
+	for (node = schema->children; node != NULL; node = node->next) {
+		if (node->type == NCDFLT_NODE_CHOICE || node->type == NCDFLT_NODE_CASE || node->type == NCDFLT_NODE_AUGMENT) {
+			/* not present in the data, just go through */
+			removed |= ncdflt_clear(node, parent);
+			continue;
+		}
+
+		for (aux = parent->children; aux != NULL; aux = next) {
+			next = aux->next;
+			if (aux->type != XML_ELEMENT_NODE || xmlStrcmp(aux->name, node->name) != 0) {
+				continue;
+			}
+			if (node->type == NCDFLT_NODE_LEAF) {
+				value = xmlGetNsProp(aux, BAD_CAST "default", BAD_CAST "urn:ietf:params:xml:ns:netconf:default:1.0");
+				if (xmlStrcmp(value, BAD_CAST "true") == 0) {
+					/* element contain default value, remove it */
+					xmlUnlinkNode(aux);
+					xmlFreeNode(aux);
+					removed = 1;
+				}
+				xmlFree(value);
+			} else if (ncdflt_clear(node, aux) && aux->children == NULL) {
+				/* only the default nodes were inside */
+				xmlUnlinkNode(aux);
+				xmlFreeNode(aux);
+				removed = 1;
+			}
+		}
+	}
+
+	return (removed);
+}
+
+int ncdflt_default_clear(xmlDocPtr config, const xmlDocPtr model)
 {
 	xmlXPathContextPtr ctxt = NULL;
 	xmlXPathObjectPtr defaults = NULL;
-	xmlNodePtr aux;
+	struct ncdflt_defaults* model_defaults;
+	struct ncdflt_node* node;
+	xmlNodePtr aux, next, removed = NULL;
 	int i;
 
 	if (config == NULL) {
@@ -692,6 +619,33 @@ int ncdflt_default_clear(xmlDocPtr config)
 		return (EXIT_SUCCESS);
 	}
 
+	if ((model_defaults = model_index_defaults(model)) != NULL) {
+		/* the default nodes can be only where the model defines them */
+		for (node = model_defaults->nodes; node != NULL; node = node->next) {
+			for (aux = config->children; aux != NULL; aux = next) {
+				next = aux->next;
+				if (aux->type != XML_ELEMENT_NODE || xmlStrcmp(aux->name, node->name) != 0) {
+					continue;
+				}
+				if (ncdflt_clear(node, aux) && aux->children == NULL) {
+					/*
+					 * the wd namespace of the remaining default nodes can be
+					 * defined here, so free the node after the whole walk
+					 */
+					xmlUnlinkNode(aux);
+					aux->next = removed;
+					removed = aux;
+				}
+			}
+		}
+		for (aux = removed; aux != NULL; aux = next) {
+			next = aux->next;
+			aux->next = NULL;
+			xmlFreeNode(aux);
+		}
+		return (EXIT_SUCCESS);
+	}
+
 	/* create xpath evaluation context */
 	if ((ctxt = xmlXPathNewContext(config)) == NULL) {
 		WARN("%s: Creating the XPath context failed.", __func__);
@@ -702,7 +656,7 @@ int ncdflt_default_clear(xmlDocPtr config)
 		xmlXPathFreeContext(ctxt);
 		return (EXIT_FAILURE);
 	}
-	defaults = xmlXPathEvalExpression(BAD_CAST "//*[@wd:default=\"true\"]", ctxt);
+	defaults = nc_xpath_eval("//*[@wd:default=\"true\"]", ctxt);
 	if (defaults != NULL) {
 		/* remove them */
 		for (i = 0; i < defaults->nodesetval->nodeNr; i++) {
@@ -752,7 +706,7 @@ int ncdflt_edit_remove_default(xmlDocPtr config, const xmlDocPtr model)
 		xmlXPathFreeContext(ctxt);
 		return (EXIT_FAILURE);
 	}
-	defaults = xmlXPathEvalExpression(BAD_CAST "//data:*[@wd:default=\"true\"]", ctxt);
+	defaults = nc_xpath_eval("//data:*[@wd:default=\"true\"]", ctxt);
 	if (defaults != NULL) {
 		/* RFC 6243 requires us to check, that the data contains correct default values */
 		for (i = 0; i < defaults->nodesetval->nodeNr; i++) {